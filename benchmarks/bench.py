@@ -0,0 +1,209 @@
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: benchmark suite for the stratification, sampling, and calculation functions
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+#Example usage:
+#
+#   python benchmarks/bench.py --size 4096 --threads 1 4 16 --output results.json
+#   python benchmarks/bench.py --types int16 float32 --blocks tiled scanline --compression NONE DEFLATE
+#   python benchmarks/bench.py --cases breaks srs --compare baseline.json --tolerance 0.1
+#
+#The synthetic rasters are generated once per raster configuration into --workdir (a temporary
+#folder by default), then every case is timed on every configuration with every thread count.
+#Results are written as JSON. If --compare is given, the median of every case is compared
+#against a previous result file and the script exits with status 1 if any case is slower
+#by more than --tolerance, so it can be used to catch regressions before upgrading.
+
+import argparse
+import itertools
+import json
+import os
+import platform
+import statistics
+import sys
+import tempfile
+import time
+from importlib import metadata
+
+sys.path.append(os.path.dirname(__file__))
+from synthetic import generate_raster, value_range, GDAL_TYPES
+
+import sgspy as sgs
+from osgeo import gdal
+
+##
+# Each case is a function taking the generated rasters and a thread count, which
+# calls a single sgspy function. The rasters are opened once per configuration, so
+# opening them is not part of the timing.
+CASES = {
+    'breaks': lambda r, t: sgs.breaks(r['mraster'], breaks={'band0': r['breaks'][4], 'band1': r['breaks'][3]}, map=True, thread_count=t),
+    'quantiles': lambda r, t: sgs.quantiles(r['mraster'], quantiles={'band0': 10, 'band1': 5}, map=True, thread_count=t),
+    'pipeline': lambda r, t: sgs.pipeline(r['mraster'], breaks={'band0': r['breaks'][4]}, quantiles={'band1': 5}, thread_count=t),
+    'map': lambda r, t: sgs.map((r['sraster'], [0, 1], [5, 5]), thread_count=t),
+    'strat_random': lambda r, t: sgs.strat(r['sraster'], 500, num_strata=5, band=0, method='random', thread_count=t),
+    'strat_random_mindist': lambda r, t: sgs.strat(r['sraster'], 500, num_strata=5, band=0, method='random', mindist=r['mindist'], thread_count=t),
+    'strat_queinnec': lambda r, t: sgs.strat(r['sraster'], 500, num_strata=5, band=0, method='Queinnec', thread_count=t),
+    'strat_queinnec_mindist': lambda r, t: sgs.strat(r['sraster'], 500, num_strata=5, band=0, method='Queinnec', mindist=r['mindist'], thread_count=t),
+    'srs': lambda r, t: sgs.srs(r['mraster'], 500, thread_count=t),
+    'srs_mindist': lambda r, t: sgs.srs(r['mraster'], 500, mindist=r['mindist'], thread_count=t),
+
+    #enough samples that several batches of candidates are checked against the mindist grid in parallel
+    'srs_mindist_many': lambda r, t: sgs.srs(r['mraster'], 50000, mindist=r['mindist'], thread_count=t),
+    'strat_random_mindist_many': lambda r, t: sgs.strat(r['sraster'], 50000, num_strata=5, band=0, method='random', mindist=r['mindist'], thread_count=t),
+
+    'clhs': lambda r, t: sgs.clhs(r['mraster'], 100, iterations=2000, thread_count=t),
+    'pca': lambda r, t: sgs.pca(r['mraster'], 2, thread_count=t),
+}
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="benchmark the sgspy functions on synthetic rasters.")
+    parser.add_argument('--size', type=int, nargs='+', default=[2048], help="raster width and height in pixels")
+    parser.add_argument('--bands', type=int, default=3, help="number of bands of the covariate raster")
+    parser.add_argument('--types', nargs='+', default=['float32'], choices=list(GDAL_TYPES.keys()), help="covariate raster data types")
+    parser.add_argument('--blocks', nargs='+', default=['tiled'], choices=['tiled', 'scanline'], help="raster block shapes")
+    parser.add_argument('--block-size', type=int, default=256, help="tile width and height of tiled rasters")
+    parser.add_argument('--nodata', type=float, nargs='+', default=[0.1], help="fractions of nodata pixels")
+    parser.add_argument('--compression', nargs='+', default=['NONE'], help="GeoTIFF compression methods")
+    parser.add_argument('--threads', type=int, nargs='+', default=[1, os.cpu_count()], help="thread counts")
+    parser.add_argument('--cases', nargs='+', default=list(CASES.keys()), choices=list(CASES.keys()), help="functions to benchmark")
+    parser.add_argument('--repeat', type=int, default=3, help="number of timed runs of each case")
+    parser.add_argument('--workdir', default=None, help="folder to write the synthetic rasters to")
+    parser.add_argument('--output', default='benchmark.json', help="JSON file to write the results to")
+    parser.add_argument('--compare', default=None, help="previous JSON result file to compare against")
+    parser.add_argument('--tolerance', type=float, default=0.1, help="allowed slowdown relative to --compare before failing")
+    return parser.parse_args()
+
+def context(args):
+    try:
+        version = metadata.version('sgspy')
+    except metadata.PackageNotFoundError:
+        version = 'unknown'
+
+    return {
+        'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'sgspy_version': version,
+        'gdal_version': gdal.__version__,
+        'python_version': platform.python_version(),
+        'platform': platform.platform(),
+        'processor': platform.processor(),
+        'cpu_count': os.cpu_count(),
+        'repeat': args.repeat,
+    }
+
+def generate(workdir, size, dtype, block, nodata, compression, args):
+    name = "{}_{}_{}_{}_{}".format(size, dtype, block, nodata, compression)
+    mraster_path = os.path.join(workdir, 'mraster_' + name + '.tif')
+    sraster_path = os.path.join(workdir, 'sraster_' + name + '.tif')
+
+    options = {
+        'width': size,
+        'height': size,
+        'block': block,
+        'block_size': args.block_size,
+        'nodata_fraction': nodata,
+        'compression': compression,
+    }
+    if not os.path.exists(mraster_path):
+        generate_raster(mraster_path, bands=args.bands, dtype=dtype, seed=1, **options)
+    if not os.path.exists(sraster_path):
+        generate_raster(sraster_path, bands=2, num_strata=5, seed=2, **options)
+
+    #evenly spaced breaks within the range of values generate_raster uses for the data type
+    (low, high) = value_range(dtype)
+    breaks = {n: [low + (high - low) * (i + 1) / (n + 1) for i in range(n)] for n in [3, 4]}
+
+    return {
+        'breaks': breaks,
+        'mraster': sgs.SpatialRaster(mraster_path),
+        'sraster': sgs.SpatialRaster(sraster_path),
+
+        #a mindist of a few pixels, so that it is checked but doesn't prevent the samples being found
+        'mindist': 3 * 20,
+    }
+
+def run(args, workdir):
+    results = []
+    configs = itertools.product(args.size, args.types, args.blocks, args.nodata, args.compression)
+    for (size, dtype, block, nodata, compression) in configs:
+        raster = {'size': size, 'dtype': dtype, 'block': block, 'nodata_fraction': nodata, 'compression': compression}
+        print("generating {}".format(raster), flush=True)
+        rasters = generate(workdir, size, dtype, block, nodata, compression, args)
+
+        for (case, threads) in itertools.product(args.cases, args.threads):
+            times = []
+            error = None
+            for _ in range(args.repeat):
+                start = time.perf_counter()
+                try:
+                    CASES[case](rasters, threads)
+                except Exception as e:
+                    error = str(e)
+                    break
+                times.append(time.perf_counter() - start)
+
+            result = {
+                'name': "{}/{}/{}/{}/{}/{}/threads:{}".format(case, size, dtype, block, nodata, compression, threads),
+                'case': case,
+                'raster': raster,
+                'threads': threads,
+                'times': times,
+            }
+            if error is None:
+                result['min'] = min(times)
+                result['median'] = statistics.median(times)
+                print("{:<72} {:>10.4f}s".format(result['name'], result['median']), flush=True)
+            else:
+                result['error'] = error
+                print("{:<72} {:>11}".format(result['name'], 'error'), flush=True)
+            results.append(result)
+
+    return results
+
+def compare(results, path, tolerance):
+    with open(path) as f:
+        baseline = {result['name']: result for result in json.load(f)['benchmarks']}
+
+    regressions = []
+    for result in results:
+        previous = baseline.get(result['name'])
+        if previous is None or 'median' not in previous or 'median' not in result:
+            continue
+
+        ratio = result['median'] / previous['median']
+        if ratio > 1 + tolerance:
+            regressions.append((result['name'], ratio))
+
+    for (name, ratio) in regressions:
+        print("regression: {} is {:.1f}% slower".format(name, (ratio - 1) * 100))
+
+    return len(regressions) == 0
+
+def main():
+    args = parse_args()
+
+    if args.workdir is None:
+        workdir_obj = tempfile.TemporaryDirectory()
+        workdir = workdir_obj.name
+    else:
+        os.makedirs(args.workdir, exist_ok=True)
+        workdir = args.workdir
+
+    results = run(args, workdir)
+
+    with open(args.output, 'w') as f:
+        json.dump({'context': context(args), 'benchmarks': results}, f, indent=2)
+    print("results written to " + args.output)
+
+    if args.compare is not None and not compare(results, args.compare, args.tolerance):
+        sys.exit(1)
+
+    if any('error' in result for result in results):
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,197 @@
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: synthetic raster generation for benchmarks
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+import numpy as np
+from osgeo import gdal, osr
+
+gdal.UseExceptions()
+
+#the number of rows generated and written at a time, so large rasters are never entirely in memory
+ROWS_PER_STRIP = 256
+
+GDAL_TYPES = {
+    'int8': gdal.GDT_Int8,
+    'uint16': gdal.GDT_UInt16,
+    'int16': gdal.GDT_Int16,
+    'uint32': gdal.GDT_UInt32,
+    'int32': gdal.GDT_Int32,
+    'float32': gdal.GDT_Float32,
+    'float64': gdal.GDT_Float64,
+}
+
+NODATA_VALUES = {
+    'int8': -128,
+    'uint16': 65535,
+    'int16': -32768,
+    'uint32': 4294967295,
+    'int32': -2147483648,
+    'float32': -9999,
+    'float64': -9999,
+}
+
+##
+# Generate a synthetic GeoTIFF for benchmarking.
+#
+# Each band is a smooth field (a sum of random sinusoids) with added noise, scaled
+# to the range of the data type (or [0, 100] for floating point types), so that breaks,
+# quantiles, and clustering behave as they would on real covariates rather than on
+# uniform noise. A fraction of the pixels, in contiguous patches like the areas outside
+# of a real survey boundary, are set to the nodata value in every band.
+#
+# If num_strata is given, each band is instead a strat raster with values in
+# [0, num_strata), which is what map and strat take as input.
+#
+# Parameters
+# --------------------
+# path : str @n
+#     the filename of the GeoTIFF to write @n @n
+# width : int @n
+#     the width of the raster in pixels @n @n
+# height : int @n
+#     the height of the raster in pixels @n @n
+# bands : int @n
+#     the number of bands @n @n
+# dtype : str @n
+#     one of the keys of GDAL_TYPES @n @n
+# block : str @n
+#     'tiled' for square tiles of block_size, or 'scanline' for single row strips @n @n
+# block_size : int @n
+#     the tile width and height if block is 'tiled' @n @n
+# nodata_fraction : float @n
+#     the approximate fraction of pixels which are nodata @n @n
+# compression : str @n
+#     the GeoTIFF COMPRESS creation option, for example 'NONE', 'DEFLATE', 'LZW', or 'ZSTD' @n @n
+# num_strata : int @n
+#     if given, the number of strata of a strat raster @n @n
+# pixel_size : float @n
+#     the width and height of a pixel in meters @n @n
+# seed : int @n
+#     the random seed, so the same raster is generated every time @n @n
+def generate_raster(
+    path: str,
+    width: int,
+    height: int,
+    bands: int = 3,
+    dtype: str = 'float32',
+    block: str = 'tiled',
+    block_size: int = 256,
+    nodata_fraction: float = 0.1,
+    compression: str = 'NONE',
+    num_strata: int = None,
+    pixel_size: float = 20,
+    seed: int = 0):
+
+    if dtype not in GDAL_TYPES:
+        raise ValueError("dtype must be one of " + ", ".join(GDAL_TYPES.keys()) + ".")
+
+    if block not in ['tiled', 'scanline']:
+        raise ValueError("block must be either 'tiled' or 'scanline'.")
+
+    if nodata_fraction < 0 or nodata_fraction >= 1:
+        raise ValueError("nodata_fraction must be at least 0 and less than 1.")
+
+    options = ['COMPRESS=' + compression, 'BIGTIFF=IF_SAFER']
+    if block == 'tiled':
+        options += ['TILED=YES', 'BLOCKXSIZE=' + str(block_size), 'BLOCKYSIZE=' + str(block_size)]
+    else:
+        options += ['BLOCKYSIZE=1']
+
+    if num_strata is not None:
+        #strat rasters use -1 as nodata, so they require a signed type
+        dtype = 'int8' if num_strata <= 127 else 'int16' if num_strata <= 32767 else 'int32'
+        nodata = -1
+    else:
+        nodata = NODATA_VALUES[dtype]
+
+    driver = gdal.GetDriverByName('GTiff')
+    ds = driver.Create(path, width, height, bands, GDAL_TYPES[dtype], options=options)
+
+    #UTM zone 17N, somewhere in Ontario
+    x_origin = 500000
+    y_origin = 5500000
+    ds.SetGeoTransform([x_origin, pixel_size, 0, y_origin, 0, -pixel_size])
+    srs = osr.SpatialReference()
+    srs.ImportFromEPSG(32617)
+    ds.SetProjection(srs.ExportToWkt())
+
+    rng = np.random.default_rng(seed)
+    np_type = np.dtype(dtype)
+    (low, high) = value_range(dtype)
+
+    #the nodata mask is a smooth field thresholded at the nodata fraction, so nodata comes in patches
+    mask_waves = _random_waves(rng, width, height)
+    mask_threshold = _field_quantile(mask_waves, rng, width, height, nodata_fraction)
+
+    band_waves = [_random_waves(rng, width, height) for _ in range(bands)]
+    for band in range(bands):
+        ds.GetRasterBand(band + 1).SetNoDataValue(nodata)
+        ds.GetRasterBand(band + 1).SetDescription('band' + str(band))
+
+    for y_off in range(0, height, ROWS_PER_STRIP):
+        rows = min(ROWS_PER_STRIP, height - y_off)
+        y, x = np.mgrid[y_off:y_off + rows, 0:width]
+        nodata_mask = _field(mask_waves, x, y) < mask_threshold
+
+        for band in range(bands):
+            field = _field(band_waves[band], x, y)
+            field = field + rng.normal(0, 0.05, field.shape)
+
+            #map the field onto the output range, the few values outside of [-1, 1] are clipped
+            unit = np.clip((field + 1) / 2, 0, 1 - 1e-9)
+            if num_strata is not None:
+                vals = np.floor(unit * num_strata)
+            else:
+                vals = low + unit * (high - low)
+
+            vals[nodata_mask] = nodata
+            ds.GetRasterBand(band + 1).WriteArray(vals.astype(np_type), 0, y_off)
+
+    ds.FlushCache()
+    ds = None
+    return path
+
+##
+# The range of the (non-strat) values generated for a data type, which is within
+# [-1000, 1000] for integer types, excluding the nodata value, and [0, 100] for
+# floating point types.
+def value_range(dtype):
+    np_type = np.dtype(dtype)
+    if np.issubdtype(np_type, np.integer):
+        info = np.iinfo(np_type)
+        return (max(info.min + 1, -1000), min(info.max - 1, 1000))
+    return (0, 100)
+
+def _random_waves(rng, width, height, count=6):
+    #frequencies are chosen so there are between 1 and 8 cycles across the raster
+    return [
+        (
+            rng.uniform(1, 8) * 2 * np.pi / width,
+            rng.uniform(1, 8) * 2 * np.pi / height,
+            rng.uniform(0, 2 * np.pi),
+            rng.uniform(0.5, 1),
+        )
+        for _ in range(count)
+    ]
+
+def _field(waves, x, y):
+    total = np.zeros(x.shape)
+    norm = 0
+    for (fx, fy, phase, amplitude) in waves:
+        total += amplitude * np.sin(fx * x + fy * y + phase)
+        norm += amplitude
+    return total * (2 / norm)
+
+def _field_quantile(waves, rng, width, height, fraction):
+    if fraction == 0:
+        return -np.inf
+
+    #estimate the threshold from a random sample of positions rather than the whole field
+    x = rng.integers(0, width, 100000)
+    y = rng.integers(0, height, 100000)
+    return np.quantile(_field(waves, x, y), fraction)
@@ -59,7 +59,12 @@ from . import stratify
 from .utils import (
     SpatialRaster,
     SpatialVector,
-    StratRasterBandMetadata
+    StratRasterBandMetadata,
+    set_remote_read_options,
+    set_memory_limit,
+    memory_usage,
+    profile,
+    write_trace,
 )
 
 from .calculate import (
@@ -74,6 +79,9 @@ from .sample import (
     nc,
     srs,
     strat,
+    strat_partial,
+    merge_strat_partials,
+    allocate_strat_partials,
     systematic,
 )
 
@@ -83,6 +91,7 @@ from .stratify import (
     poly,
     quantiles,
     map,
+    pipeline,
 )
 
 __all__ = list(
@@ -51,6 +51,23 @@ from _sgs import dist_cpp
 # other is the array of counts of type int64. The array of bins will be one value longer
 # than the array of counts, as it countains not just the minimum value but also the maximum value.
 #
+# The band is read a single time, while counting the values within a very large number of narrow
+# provisional bins whose range isn't yet known. A provisional bin which spans the boundary between
+# two bins is counted in the bin containing it's center, so near a boundary (within about 2 millionths
+# of the range of values) a pixel may be counted in the neighbouring bin. If 'exact' is True, the
+# pixels of those provisional bins are binned exactly instead, which for floating point or wide ranged
+# bands usually requires reading most of the band a second time. Integer bands with a range of
+# fewer than about a million values are always binned exactly in a single read.
+#
+# The 'overview' parameter calculates the distribution from an overview of the raster (see
+# SpatialRaster.overview()) rather than every pixel, which reads only a fraction of a large
+# or remote raster. The counts are then those of the overview pixels, and the values of the
+# samples are also taken from the overview. If the overview was built with nearest neighbour
+# resampling, with n overview pixels the fraction of pixels in any bin is within about
+# 2 * sqrt(ln(2 / a) / 2n) of the fraction for the full raster with probability 1 - a. The
+# minimum and maximum of an overview may be within those of the full raster. Overviews built
+# by averaging narrow the distribution, and have no such bound.
+#
 # For example, if the minimum pixel value in the raster is 1, and the maximum pixel value in the
 # raster is 3, 3 and the bin size is 4, then the bin array would be [1.0, 1.5, 2.0, 2.5, 3.0]. 
 # The array of counts would then be of length 4, where the first element (index 0) would be
@@ -91,6 +108,14 @@ from _sgs import dist_cpp
 #   the number of bins in the histogram distribution @n @n 
 # plot : bool @n 
 #   whether to plot a histogram of the distribution @n @n 
+# use_statistics : bool @n
+#   whether to use the minimum and maximum from the exact statistics stored with the raster (if they exist) instead of calculating them @n @n
+# exact : bool @n
+#   whether to bin the pixels near the boundaries of bins exactly, which may require reading the band twice @n @n
+# thread_count : int @n
+#   the number of threads to use when calculating the distribution @n @n
+# overview : Optional[int] @n
+#   the overview level to calculate the distribution from, or None to use every pixel @n @n
 #
 # Returns
 # --------------------
@@ -101,7 +126,11 @@ def distribution(
     samples: Optional[SpatialVector] = None,
     layer: Optional[str] = None,
     bins: int = 50,
-    plot: bool = True):
+    plot: bool = True,
+    use_statistics: bool = False,
+    exact: bool = False,
+    thread_count: int = 8,
+    overview: Optional[int] = None):
 
     if type(rast) is not SpatialRaster:
         raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster.")
@@ -121,6 +150,18 @@ def distribution(
     if type(plot) is not bool:
         raise TypeError("'plot' parameter must be of type bool.")
 
+    if type(use_statistics) is not bool:
+        raise TypeError("'use_statistics' parameter must be of type bool.")
+
+    if type(exact) is not bool:
+        raise TypeError("'exact' parameter must be of type bool.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if overview is not None and type(overview) is not int:
+        raise TypeError("'overview' parameter, if given, must be of type int.")
+
     if band is None and len(rast.bands) > 1:
         raise ValueError("'If the raster has more than 1 band, the 'band' parameter must be given.")
 
@@ -153,11 +194,17 @@ def distribution(
     if bins < 1:
         raise ValueError("'bins' parameter must be 1 or greater.")
 
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    if overview is not None:
+        rast = rast.overview(overview)
+
     #the reason why there is a cpp function written to do this, rather than just using
     #numpys histogram function is because numpys histogram function requires that all
     #the data be in a numpy array (in memory) at once, and on very large raster images 
     #this is not possible.
-    result = dist_cpp(rast.cpp_raster, band, cpp_vector, layer, bins)
+    result = dist_cpp(rast.cpp_raster, band, cpp_vector, layer, bins, use_statistics, exact, thread_count)
 
     if plot:
         [pop_bins, pop_counts] = result["population"]
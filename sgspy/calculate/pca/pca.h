@@ -12,11 +12,17 @@
  * @ingroup calculate
  */
 
+#include <exception>
 #include <iostream>
 #include <numeric>
 
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+#include <mkl.h>
+
 #include "utils/helper.h"
 #include "utils/raster.h"
+#include "utils/reader.h"
 
 #include "oneapi/dal.hpp"
 
@@ -184,8 +190,8 @@ calculatePCA(
  * All of the blocks are iterated through, and within each iteration the following
  * is done:
  *
- * First, the input raster band blocks are read into memory using the GDALRasterBand 
- * RasterIO function. Bands are read into memory in a row-wise manor 
+ * First, the input raster band blocks are read into memory by a BlockReader, which
+ * reads the next blocks on an I/O thread using the GDALRasterBand RasterIO function. Bands are read into memory in a row-wise manor 
  * such that a row indicates a single pixel, and a column indicates a raster band.
  * This means that in between each pixel and the next, a gap must be left for the
  * remaining band values for that pixel index to be written to. This is done
@@ -209,8 +215,8 @@ calculatePCA(
  * @param size_t size
  * @param int xBlockSize
  * @param int yBlockSize
- * @param int xBlocks
- * @param int yBlocks
+ * @param int width
+ * @param int height
  * @param int nComp
  * @returns PCAResult<T>
  */
@@ -222,12 +228,11 @@ calculatePCA(
 	size_t size,
 	int xBlockSize,
 	int yBlockSize,
-	int xBlocks,
-	int yBlocks,
+	int width,
+	int height,
 	int nComp)
 {
 	int bandCount = static_cast<int>(bands.size());
-	T *p_data = reinterpret_cast<T *>(VSIMalloc3(xBlockSize * yBlockSize, bandCount, size));
 
 	std::vector<helper::Variance> bandVariances(bandCount);
 	std::vector<T> noDataVals(bandCount);
@@ -238,62 +243,58 @@ calculatePCA(
 	const auto desc = oneapi::dal::pca::descriptor<T, oneapi::dal::pca::method::cov>().set_component_count(nComp).set_deterministic(true);
 	oneapi::dal::pca::partial_train_result<> partial_result;
 
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			int xValid, yValid;
-			bands[0].p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-		
-			//read bands into memory	
-			for (int i = 0; i < bandCount; i++) {
-				bands[i].p_band->RasterIO(
-					GF_Read,
-					xBlock * xBlockSize,
-					yBlock * yBlockSize,
-					xValid,
-					yValid,
-					(void *)((size_t)p_data + i * size),
-					xValid,
-					yValid,
-					type,
-					size * bands.size(),
-					size * bands.size() * static_cast<size_t>(xBlockSize)
-				);				
-			}
-
-			//remove nodata values
-			int nFeatures = 0;
+	//bands are read into an interleaved buffer ahead of time on an I/O thread
+	std::vector<helper::RasterBandMetaData *> p_bands(bandCount);
+	for (int i = 0; i < bandCount; i++) {
+		p_bands[i] = &bands[i];
+	}
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	reader::BlockReader blocks(
+		p_bands,
+		reader::blockWindows(xBlockSize, yBlockSize, width, height, 0, yBlocks),
+		xBlockSize,
+		yBlockSize,
+		type,
+		size
+	);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+		int xValid = p_block->window.xValid;
+		int yValid = p_block->window.yValid;
+
+		//remove nodata values, iterating in row-major order so that a
+		//pixel is never overwritten before it has been read
+		int nFeatures = 0;
+		for (int y = 0; y < yValid; y++) {
 			for (int x = 0; x < xValid; x++) {
-				for (int y = 0; y < yValid; y++) {
-					bool isNan = false;
-					for (int b = 0; b < bandCount; b++) {
-						T val = p_data[((y * xBlockSize) + x) * bandCount + b];
-						isNan = std::isnan(val) || val == noDataVals[b];
-						if (isNan) {
-							break;
-						}
-						p_data[nFeatures * bandCount + b] = val;
+				bool isNan = false;
+				for (int b = 0; b < bandCount; b++) {
+					T val = p_data[((y * xBlockSize) + x) * bandCount + b];
+					isNan = std::isnan(val) || val == noDataVals[b];
+					if (isNan) {
+						break;
 					}
-					nFeatures += !isNan;
+					p_data[nFeatures * bandCount + b] = val;
 				}
+				nFeatures += !isNan;
 			}
+		}
 
-			//update variance calculations
-			for (int i = 0; i < nFeatures; i++) {
-				for (int b = 0; b < bandCount; b++) {
-					T val = p_data[i * bandCount + b];
-					bandVariances[b].update(static_cast<double>(val));	
-				}
+		//update variance calculations
+		for (int i = 0; i < nFeatures; i++) {
+			for (int b = 0; b < bandCount; b++) {
+				T val = p_data[i * bandCount + b];
+				bandVariances[b].update(static_cast<double>(val));	
 			}
-
-			//calculate partial result
-			DALHomogenTable table = DALHomogenTable(p_data, nFeatures, bandCount, [](const T*){}, oneapi::dal::data_layout::row_major);
-			partial_result = oneapi::dal::partial_train(desc, partial_result, table);
 		}
+
+		//calculate partial result
+		DALHomogenTable table = DALHomogenTable(p_data, nFeatures, bandCount, [](const T*){}, oneapi::dal::data_layout::row_major);
+		partial_result = oneapi::dal::partial_train(desc, partial_result, table);
 	}
 
 	auto result = oneapi::dal::finalize_train(desc, partial_result);
-	
-	VSIFree(p_data);
 
 	PCAResult<T> retval;
 	auto eigenvectors = result.get_eigenvectors();
@@ -314,7 +315,7 @@ calculatePCA(
 
 		retval.eigenvectors[i].resize(eigCols);
 		for (int64_t j = 0; j < eigCols; j++) {
-			retval.eigenvectors[i][j] = static_cast<T>(eigValBlock[i * eigCols + j]);
+			retval.eigenvectors[i][j] = static_cast<T>(eigVecBlock[i * eigCols + j]);
 		}
 	}
 	
@@ -455,10 +456,34 @@ writePCA(
 		);
 	}
 
-	VSIFree(p_data);
 	VSIFree(p_comp);
 }
 
+/**
+ * @ingroup pca
+ * This helper function multiplies the matrices C = A * B^T, where A is row-major
+ * (m x k), B is row-major (n x k), and C is row-major (m x n), adding the result
+ * to the values already in C. MKL's cblas_sgemm() or cblas_dgemm() is used
+ * depending on the type.
+ *
+ * @param int m
+ * @param int n
+ * @param int k
+ * @param const T *p_a
+ * @param const T *p_b
+ * @param T *p_c
+ */
+template <typename T>
+inline void
+gemmTransB(int m, int n, int k, const T *p_a, const T *p_b, T *p_c) {
+	if constexpr (std::is_same_v<T, float>) {
+		cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, m, n, k, 1.0f, p_a, k, p_b, k, 1.0f, p_c, n);
+	}
+	else {
+		cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, m, n, k, 1.0, p_a, k, p_b, k, 1.0, p_c, n);
+	}
+}
+
 /**
  * @ingroup pca
  * This function is used to write the output principal components to a
@@ -466,25 +491,21 @@ writePCA(
  * been calculated for the input raster. This function is used in the
  * case where the raster is large, and should be processed in blocks.
  *
- * For each block:
- *
- * First, the input raster bands are read into memory using the GDALRasterBand 
- * RasterIO function. Bands are read into memory in a row-wise manor 
- * such that a row indicates a single pixel, and a column indicates a raster band.
- * This means that in between each pixel and the next, a gap must be left for the
- * remaining band values for that pixel index to be written to. This is done
- * using the nPixelSpace, and nLineSpace arguments of RasterIO. The data pixels 
- * are iterated over: scaled, shifted, and set to nan if at a no data pixel.
- *
- * Next, a matrix of pca eigenvectors are allocated and read into a new location.
+ * Centering and scaling are folded into the projection, since for
+ * component c:
+ * sum_b(e_cb * (x_b - mean_b) / stdev_b) = sum_b(w_cb * x_b) + offset_c
+ * where w_cb = e_cb / stdev_b and offset_c = -sum_b(w_cb * mean_b). Each
+ * block is then projected with a single matrix multiplication (GEMM) of the
+ * (nComp x bandCount) weights against the interleaved (pixels x bandCount)
+ * block, into a (nComp x pixels) output which holds one contiguous plane per
+ * component that can be written directly to the output band. Pixels with
+ * a no data value in any band are set to nan afterwards.
  *
- * Both the data matrix and the pca matrix are turned into oneDAL homogen tables,
- * and the result of a linear kernel calculation is written to the output.
- *
- * The reason a linear kernel is used, is because the result is essentially just
- * a bunch of dot products. It's possible to do these dot products one at a time
- * for each output pixel and component. However, the linear kernel, which is
- * originally meant for fast machine learning use, does exactly what we need.
+ * The raster is split into chunks of rows of blocks depending on the number
+ * of threads. Each chunk is processed within a thread pool, with its own
+ * BlockReader which reads the next blocks of the chunk on an I/O thread.
+ * MKL's own threading is disabled within the pool threads, since every
+ * thread is already busy with its own chunk.
  *
  * @param std::vector<RasterBandMetaData>& bands
  * @param std::vector<RasterBandMetaData>& PCABands
@@ -493,8 +514,9 @@ writePCA(
  * @param size_t size
  * @param int xBlockSize
  * @param int yBlockSize
- * @param int xBlocks
- * @param int yBlocks
+ * @param int width
+ * @param int height
+ * @param int threads
  */
 template <typename T>
 void 
@@ -506,8 +528,9 @@ writePCA(
 	size_t size,
 	int xBlockSize,
 	int yBlockSize,
-	int xBlocks,
-	int yBlocks)
+	int width,
+	int height,
+	int threads)
 {
 	int bandCount = static_cast<int>(bands.size());
 	int nComp = static_cast<int>(PCABands.size());
@@ -517,85 +540,110 @@ writePCA(
 		noDataVals[i] = static_cast<T>(bands[i].nan);
 	}
 
-	T *p_data = reinterpret_cast<T *>(VSIMalloc3(xBlockSize * yBlockSize, size, bandCount));
-	T *p_comp = reinterpret_cast<T *>(VSIMalloc3(nComp, bandCount, size));
+	//fold the centering and scaling of each band into the eigenvectors
+	std::vector<T> weights(static_cast<size_t>(nComp) * bandCount);
+	std::vector<T> offsets(nComp, 0);
+	for (int c = 0; c < nComp; c++) {
+		double offset = 0;
+		for (int b = 0; b < bandCount; b++) {
+			double weight = static_cast<double>(result.eigenvectors[c][b]) / result.stdevs[b];
+			weights[c * bandCount + b] = static_cast<T>(weight);
+			offset -= weight * result.means[b];
+		}
+		offsets[c] = static_cast<T>(offset);
+	}
 
-	//create DAL homogen table wrappers for input data
-	const auto dataTable = DALHomogenTable(p_data, xBlockSize * yBlockSize, bandCount, [](const T*){}, oneapi::dal::data_layout::row_major);
-	const auto compTable = DALHomogenTable(p_comp, nComp, bandCount, [](const T*){}, oneapi::dal::data_layout::row_major);
+	std::vector<helper::RasterBandMetaData *> p_bands(bandCount);
+	for (int b = 0; b < bandCount; b++) {
+		p_bands[b] = &bands[b];
+	}
 
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			int xValid, yValid;
-			bands[0].p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-		
-			//read bands into memory, specifically into the memory location of the dal data homogen table
-			for (int b = 0; b < bandCount; b++) {
-				bands[b].p_band->RasterIO(
-					GF_Read,
-					xBlock * xBlockSize,
-					yBlock * yBlockSize,
-					xValid,
-					yValid,
-					(void *)((size_t)p_data + b * size),
-					xValid,
-					yValid,
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
+	std::vector<std::exception_ptr> errors(chunks, nullptr);
+
+	boost::asio::thread_pool pool(threads);
+	for (int i = 0; i < chunks; i++) {
+		int yBlockStart = i * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+		std::exception_ptr *p_error = &errors[i];
+
+		boost::asio::post(pool, [&, yBlockStart, yBlockEnd, p_error] {
+			try {
+				int mklThreads = mkl_set_num_threads_local(1);
+
+				size_t pixels = static_cast<size_t>(xBlockSize) * static_cast<size_t>(yBlockSize);
+				std::vector<T> components(static_cast<size_t>(nComp) * pixels);
+
+				//bands are read into an interleaved buffer ahead of time on an I/O thread
+				reader::BlockReader blocks(
+					p_bands,
+					reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+					xBlockSize,
+					yBlockSize,
 					type,
-					size * bands.size(),
-					size * bands.size() * static_cast<size_t>(xBlockSize)
-				);				
-			}
+					size
+				);
 
-			//scale and shift data pixels, set no data pixels to nan
-			for (int i = 0; i < xBlockSize * yBlockSize; i++) {
-				int bi = i * bandCount;
+				while (reader::Block *p_block = blocks.next()) {
+					T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+					int xBlock = p_block->window.xBlock;
+					int yBlock = p_block->window.yBlock;
+					int xValid = p_block->window.xValid;
+					int yValid = p_block->window.yValid;
 
-				for (int b = 0; b < bandCount; b++) {
-					T val = p_data[bi + b];
-					p_data[bi + b] = (val == noDataVals[b]) ?
-						resultNan :
-						(val - result.means[b]) / result.stdevs[b];
+					//center, scale, and project every pixel of the block at once
+					for (int c = 0; c < nComp; c++) {
+						std::fill(components.begin() + c * pixels, components.begin() + (c + 1) * pixels, offsets[c]);
+					}
+					gemmTransB<T>(nComp, static_cast<int>(pixels), bandCount, weights.data(), p_data, components.data());
+
+					//set pixels with a no data value in any band to nan
+					for (int y = 0; y < yValid; y++) {
+						for (int x = 0; x < xValid; x++) {
+							size_t index = static_cast<size_t>(y) * xBlockSize + x;
+							for (int b = 0; b < bandCount; b++) {
+								if (p_data[index * bandCount + b] == noDataVals[b]) {
+									for (int c = 0; c < nComp; c++) {
+										components[c * pixels + index] = resultNan;
+									}
+									break;
+								}
+							}
+						}
+					}
+
+					//write the result to the output
+					for (int c = 0; c < nComp; c++) {
+						helper::rasterBandIO(
+							PCABands[c],
+							components.data() + c * pixels,
+							xBlockSize,
+							yBlockSize,
+							xBlock,
+							yBlock,
+							xValid,
+							yValid,
+							false //read = false
+						);
+					}
 				}
-			}
 
-			/**
-	 		 * the result for each output principal component pixel is just the dot product of that pixel's data values
-	 		 * with the corresponding principal component eigenvector.
-	 		 * 
-	 		 * oneDAL has a fast way to calculate dot products which is originally meant to be used for
-			 * machine learning (as I understand it) but it does exactly what we need -- multiply large matrices.
-			 */
-
-			//create DAL descriptor and compute the result
-			const auto kernel_desc = oneapi::dal::linear_kernel::descriptor{}.set_scale(1.0).set_shift(0.0);
-			const auto compute_result = oneapi::dal::compute(kernel_desc, dataTable, compTable);
-
-			//get the raw data from the result
-			const auto values = compute_result.get_values();
-			oneapi::dal::row_accessor<const T> valAcc {values};
-			const T *p_result = valAcc.pull({0, xBlockSize * yBlockSize}).get_data();
-
-			//write the raw result to the output
-			for (int c = 0; c < nComp; c++) {
-				PCABands[c].p_band->RasterIO(
-					GF_Write,
-					xBlock * xBlockSize,
-					yBlock * yBlockSize,
-					xValid,
-					yValid,
-					(void *)((size_t)p_comp + c * size),
-					xValid,
-					yValid,
-					type,
-					size * nComp,
-					size * nComp * xBlockSize
-				);
+				mkl_set_num_threads_local(mklThreads);
 			}
-		}
+			catch (...) {
+				*p_error = std::current_exception();
+			}
+		});
 	}
+	pool.join();
 
-	VSIFree(p_data);
-	VSIFree(p_comp);
+	for (const std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
 }
 
 /**
@@ -632,6 +680,7 @@ writePCA(
  * @param std::string tempFolder
  * @param std::string filename
  * @param std::mape<std::string, std::string> driverOptions
+ * @param int threads
  * @returns std::tuple<
  *		GDALRasterWrapper *,
  *		std::vector<std::vector<double>>
@@ -651,7 +700,8 @@ pca(
 	bool largeRaster,
 	std::string tempFolder,
 	std::string filename,
-	std::map<std::string, std::string> driverOptions)
+	std::map<std::string, std::string> driverOptions,
+	int threads)
 {
 	GDALAllRegister();
 
@@ -672,11 +722,20 @@ pca(
 	int xBlockSize, yBlockSize;
 	p_raster->getRasterBand(0)->GetBlockSize(&xBlockSize, &yBlockSize);
 
+	//output bands of a VRT dataset are each their own dataset, and can be written at the same time
+	std::mutex bandMutex;
+	std::mutex pcaBandMutex;
+	std::vector<std::mutex> pcaBandMutexes(isVRTDataset ? nComp : 0);
+	for (int i = 0; i < nComp; i++) {
+		pcaBands[i].p_mutex = isVRTDataset ? &pcaBandMutexes[i] : &pcaBandMutex;
+	}
+
 	GDALDataType type = GDT_Float32;
 	size_t size = sizeof(float);
 	for (int i = 0; i < bandCount; i++) {
 		bands[i].p_band = p_raster->getRasterBand(i);
 		bands[i].nan = bands[i].p_band->GetNoDataValue();
+		bands[i].p_mutex = &bandMutex;
 
 		if (p_raster->getRasterBandType(i) == GDT_Float64) {
 			type = GDT_Float64;
@@ -747,10 +806,6 @@ pca(
 		);
 	}
 
-	//get block size
-	int xBlocks = (width + xBlockSize - 1) / xBlockSize;
-	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
-
 	//these vectors are not used for calculation, but set and returned to the Python side of the application for reference
 	std::vector<std::vector<double>> eigenvectors; 
 	std::vector<double> eigenvalues;
@@ -762,8 +817,8 @@ pca(
 		case GDT_Float32: {
 			PCAResult<float> result;
 			if (largeRaster) {
-				result = calculatePCA<float>(bands, type, size, xBlockSize, yBlockSize, xBlocks, yBlocks, nComp);
-				writePCA<float>(bands, pcaBands, result, type, size, xBlockSize, yBlockSize, xBlocks, yBlocks);
+				result = calculatePCA<float>(bands, type, size, xBlockSize, yBlockSize, width, height, nComp);
+				writePCA<float>(bands, pcaBands, result, type, size, xBlockSize, yBlockSize, width, height, threads);
 			}
 			else {
 				result = calculatePCA<float>(bands, type, size, width, height, nComp);
@@ -791,8 +846,8 @@ pca(
 		case GDT_Float64: {
 			PCAResult<double> result;
 			if (largeRaster) {
-				result = calculatePCA<double>(bands, type, size, xBlockSize, yBlockSize, xBlocks, yBlocks, nComp);
-				writePCA<double>(bands, pcaBands, result, type, size, xBlockSize, yBlockSize, xBlocks, yBlocks);
+				result = calculatePCA<double>(bands, type, size, xBlockSize, yBlockSize, width, height, nComp);
+				writePCA<double>(bands, pcaBands, result, type, size, xBlockSize, yBlockSize, width, height, threads);
 			}
 			else {
 				result = calculatePCA<double>(bands, type, size, width, height, nComp);
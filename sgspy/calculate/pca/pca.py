@@ -44,6 +44,12 @@ GIGABYTE = 1073741824
 # raster is both centered and scaled, then output values are calculated
 # for each principal component.
 # 
+# the thread_count parameter specifies the number of threads which this function will 
+# utilize in the case where the raster is large and may not fit in memory. If the full
+# raster can fit in memory and does not need to be processed in blocks, this argument
+# will be ignored. The default is 8 threads, although the optimal number will depend significantly
+# on the hardware being used and my be less or more than 8.
+# 
 # Examples
 # --------------------
 # rast = sgspy.SpatialRaster("raster.tif") @n
@@ -68,6 +74,8 @@ GIGABYTE = 1073741824
 #     whether to return the eigenvectors, eigenvalues, means, and stdevs with the SpatialRaster @n @n
 # driver_options : dict @n
 #    the creation options as defined by GDAL which will be passed when creating output files @n @n
+# thread_count : int @n
+#     the number of threads to use when multithreading large images @n @n
 # 
 # Returns
 # --------------------
@@ -77,7 +85,8 @@ def pca(
     num_comp: int,
     filename: str = '',
     return_metadata: bool = False,
-    driver_options: dict = None
+    driver_options: dict = None,
+    thread_count: int = 8
     ):
         
     if type(rast) is not SpatialRaster:
@@ -96,6 +105,9 @@ def pca(
     if driver_options is not None and type(driver_options) is not dict: 
         raise TypeError("'driver_options' parameter, if given, must be of type dict.")
 
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
     if rast.closed:
         raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
 
@@ -108,6 +120,9 @@ def pca(
         msg = f"the number of components must be greater than zero and less than or equal to the total number of raster bands ({len(rast.bands)})."
         raise ValueError(msg)
 
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
     #ensure driver options keys are string, and convert driver options vals to string
     driver_options_str = {}
     if driver_options:
@@ -140,7 +155,8 @@ def pca(
         large_raster,
         temp_dir,
         filename,
-        driver_options_str
+        driver_options_str,
+        thread_count
     )
 
     metadata = (eigenvectors, eigenvalues, means, stdevs)
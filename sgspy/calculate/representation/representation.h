@@ -0,0 +1,174 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: C++ implementation of the representation of an existing sample network
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup representation representation
+ * @ingroup calculate
+ */
+
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+#include "utils/helper.h"
+#include "utils/hypercube.h"
+#include "utils/raster.h"
+#include "utils/reader.h"
+#include "utils/vector.h"
+
+namespace sgs {
+namespace representation {
+
+/**
+ * @ingroup representation
+ * This function calculates how well an existing sample network represents the strata
+ * of a stratified raster band, by counting the number of pixels and the number of
+ * samples within every strata.
+ *
+ * The band is iterated through in blocks split between threads (see
+ * hypercube::forEachPixel()), where each thread counts the pixels of it's own
+ * chunk, so the band is never entirely in memory. The strata of the samples are read
+ * using reader::readPixels(), which only reads the blocks which contain a sample.
+ * Pixels and samples which are nodata or have a negative strata are not counted.
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param int bandNum
+ * @param GDALVectorWrapper *p_existing
+ * @param int threads
+ * @returns std::tuple<std::vector<int64_t>, std::vector<int64_t>> pixel and sample counts, indexed by strata
+ */
+std::tuple<std::vector<int64_t>, std::vector<int64_t>>
+strataRepresentation(
+	raster::GDALRasterWrapper *p_raster,
+	int bandNum,
+	vector::GDALVectorWrapper *p_existing,
+	int threads)
+{
+	GDALAllRegister();
+
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+	std::mutex mutex;
+
+	std::vector<helper::RasterBandMetaData> bands(1);
+	helper::RasterBandMetaData& band = bands[0];
+	band.p_band = p_raster->getRasterBand(bandNum);
+	band.type = p_raster->getRasterBandType(bandNum);
+	band.size = p_raster->getRasterBandTypeSize(bandNum);
+	band.nan = band.p_band->GetNoDataValue();
+	band.p_mutex = &mutex;
+	band.p_band->GetBlockSize(&band.xBlockSize, &band.yBlockSize);
+
+	//strata are integers, which every supported type converts to a double exactly
+	int chunks = hypercube::chunkCount(height, band.yBlockSize, threads);
+	std::vector<std::vector<int64_t>> chunkCounts(chunks);
+	hypercube::forEachPixel<double>(bands, nullptr, width, height, threads, [&chunkCounts](int chunk, const double *p_strata, int, int, bool) {
+		if (*p_strata < 0) {
+			return;
+		}
+
+		std::vector<int64_t>& counts = chunkCounts[chunk];
+		size_t strata = static_cast<size_t>(*p_strata);
+		if (strata >= counts.size()) {
+			counts.resize(strata + 1, 0);
+		}
+		counts[strata]++;
+	});
+
+	std::vector<int64_t> pixelCounts;
+	for (const std::vector<int64_t>& counts : chunkCounts) {
+		if (counts.size() > pixelCounts.size()) {
+			pixelCounts.resize(counts.size(), 0);
+		}
+		for (size_t strata = 0; strata < counts.size(); strata++) {
+			pixelCounts[strata] += counts[strata];
+		}
+	}
+
+	std::vector<int> pixelX, pixelY;
+	hypercube::existingPixels(p_existing, p_raster, pixelX, pixelY);
+
+	//each sample is written by exactly one call, so no locking is required
+	std::vector<int64_t> sampleStrata(pixelX.size(), -1);
+	if (!pixelX.empty()) {
+		reader::readPixels({&band}, pixelX.data(), pixelY.data(), pixelX.size(), width, height, threads, [&](size_t i, const double *p_strata) {
+			if (!std::isnan(*p_strata) && *p_strata != band.nan && *p_strata >= 0) {
+				sampleStrata[i] = static_cast<int64_t>(*p_strata);
+			}
+		});
+	}
+
+	std::vector<int64_t> sampleCounts(pixelCounts.size(), 0);
+	for (int64_t strata : sampleStrata) {
+		if (strata == -1) {
+			continue;
+		}
+		if (static_cast<size_t>(strata) >= sampleCounts.size()) {
+			pixelCounts.resize(strata + 1, 0);
+			sampleCounts.resize(strata + 1, 0);
+		}
+		sampleCounts[strata]++;
+	}
+
+	return {pixelCounts, sampleCounts};
+}
+
+/**
+ * @ingroup representation
+ * This function calculates how well an existing sample network represents the feature
+ * space of a multi-band raster, by comparing the quantile matrix of the raster
+ * (see hypercube::QuantileMatrix) against the number of samples within each quantile
+ * of each band. This is the same comparison AHELS uses to decide where new samples
+ * are required.
+ *
+ * The quantile matrix is calculated in two streaming passes over the raster using
+ * hypercube::calculateMatrix(), so the raster is never entirely in memory, and the
+ * break values have a rank error of at most eps.
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param int nQuant
+ * @param GDALVectorWrapper *p_existing
+ * @param double eps
+ * @param int threads
+ * @returns std::tuple<std::vector<std::vector<double>>, std::vector<int64_t>, std::vector<int64_t>>
+ * 	the breaks of every band, and the pixel and sample counts indexed by band * nQuant + quantile
+ */
+std::tuple<std::vector<std::vector<double>>, std::vector<int64_t>, std::vector<int64_t>>
+quantileRepresentation(
+	raster::GDALRasterWrapper *p_raster,
+	int nQuant,
+	vector::GDALVectorWrapper *p_existing,
+	double eps,
+	int threads)
+{
+	GDALAllRegister();
+
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+	std::mutex mutex;
+
+	GDALDataType type;
+	std::vector<helper::RasterBandMetaData> bands = hypercube::getBands(p_raster, &mutex, type);
+
+	hypercube::QuantileMatrix matrix = type == GDT_Float64 ?
+		hypercube::calculateMatrix<double>(bands, width, height, nQuant, eps, threads) :
+		hypercube::calculateMatrix<float>(bands, width, height, nQuant, eps, threads);
+
+	std::vector<int> pixelX, pixelY;
+	hypercube::existingPixels(p_existing, p_raster, pixelX, pixelY);
+
+	int64_t samples;
+	std::vector<int64_t> sampleCounts = hypercube::countSamples(bands, matrix, pixelX, pixelY, width, height, threads, samples);
+
+	return {matrix.breaks, matrix.counts, sampleCounts};
+}
+
+} //namespace representation
+} //namespace sgs
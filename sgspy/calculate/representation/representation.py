@@ -1,3 +1,189 @@
-def representation():
-    print(__file__)
-    raise NotImplementedError
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: calculate the representation of an existing sample network
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+##
+# @defgroup user_representation representation
+# @ingroup user_calculate
+
+import os
+import sys
+import site
+from sgspy.utils import SpatialRaster, SpatialVector
+from typing import Optional
+
+import numpy as np
+
+#ensure _sgs binary can be found
+site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackages()))[0]
+sys.path.append(os.path.join(site_packages, "sgspy"))
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from _sgs import strata_representation_cpp, quantile_representation_cpp
+
+##
+# @ingroup user_representation
+#
+# This function calculates how well an existing sample network represents a raster, in the
+# same way as the calculate_representation function of the sgsR package.
+#
+# If num_quantiles is not given, the raster is treated as a stratified raster, and the
+# representation of every strata of the given band is calculated. If the raster has more than
+# one band the 'band' parameter must be passed. The returned dict contains an array for each
+# of the following keys, indexed by strata: 'strata', 'raster_count' (the number of pixels of
+# each strata), 'sample_count' (the number of samples within each strata), 'raster_coverage'
+# and 'sample_coverage' (those counts as a fraction of the total), and 'difference' (the sample
+# coverage minus the raster coverage). Strata which no pixels or samples fall within are dropped.
+#
+# If num_quantiles is given, every band of the raster is split into num_quantiles quantiles
+# and the representation of every quantile of every band is calculated, in the same way as
+# sgspy.sample.ahels. The returned dict contains 'quantiles' (a dict of the break values of
+# each band), and 'raster_coverage', 'sample_coverage', and 'ratio' arrays of shape
+# (band count, num_quantiles), where the ratio is the sample coverage divided by the raster
+# coverage. The ratio is nan for quantiles which no pixels fall within.
+#
+# The raster is never loaded into memory all at once, it is streamed through in blocks using
+# thread_count threads. The rank of every quantile is within eps times the number of pixels of
+# its exact rank. Samples which fall outside of the raster, or on a nodata pixel, are not counted.
+#
+# Examples
+# --------------------
+# srast = sgspy.SpatialRaster("sraster.tif") @n
+# existing = sgspy.SpatialVector("existing_samples.shp") @n
+# result = sgspy.calculate.representation(srast, existing) @n
+# print(result['difference'])
+#
+# rast = sgspy.SpatialRaster("mraster.tif") @n
+# existing = sgspy.SpatialVector("existing_samples.shp") @n
+# result = sgspy.calculate.representation(rast, existing, num_quantiles=10) @n
+# print(result['ratio'])
+#
+# Parameters
+# --------------------
+# rast : SpatialRaster @n
+#   raster data structure containing the input raster @n @n
+# existing : SpatialVector @n
+#   the sample network, containing a single layer of Point or MultiPoint geometries @n @n
+# band : Optional[str | int] @n
+#   the strata band to use within 'rast' if 'rast' has more than one band and num_quantiles is not given @n @n
+# num_quantiles : Optional[int] @n
+#   the number of quantiles to split each band into, or None to use the strata of 'band' @n @n
+# eps : float @n
+#   the epsilon value, controlling the error of the stream-processed quantiles @n @n
+# thread_count : int @n
+#   the number of threads to use @n @n
+#
+# Returns
+# --------------------
+# a dict containing the representation of either each strata or each quantile
+def representation(
+    rast: SpatialRaster,
+    existing: SpatialVector,
+    band: Optional[str | int] = None,
+    num_quantiles: Optional[int] = None,
+    eps: float = .001,
+    thread_count: int = 8):
+
+    if type(rast) is not SpatialRaster:
+        raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster.")
+
+    if type(existing) is not SpatialVector:
+        raise TypeError("'existing' parameter must be of type sgspy.SpatialVector.")
+
+    if band is not None and type(band) not in [str, int]:
+        raise TypeError("'band' parameter, if given, must be of type int or string.")
+
+    if num_quantiles is not None and type(num_quantiles) is not int:
+        raise TypeError("'num_quantiles' parameter, if given, must be of type int.")
+
+    if type(eps) is not float:
+        raise TypeError("'eps' parameter must be of type float.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if rast.closed:
+            raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
+
+    if num_quantiles is not None and band is not None:
+        raise ValueError("only one of the 'band' and 'num_quantiles' parameters may be given.")
+
+    if num_quantiles is not None and num_quantiles < 2:
+        raise ValueError("num_quantiles must be at least 2.")
+
+    if eps <= 0 or eps >= 1:
+        raise ValueError("eps must be between 0 and 1.")
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    if len(existing.layers) > 1:
+        raise ValueError("the 'existing' vector must contain only a single layer.")
+
+    if num_quantiles is not None:
+        [quantiles, raster_counts, sample_counts] = quantile_representation_cpp(
+            rast.cpp_raster,
+            num_quantiles,
+            existing.cpp_vector,
+            eps,
+            thread_count
+        )
+
+        raster_counts = np.array(raster_counts, dtype=np.int64).reshape(rast.band_count, num_quantiles)
+        sample_counts = np.array(sample_counts, dtype=np.int64).reshape(rast.band_count, num_quantiles)
+        raster_coverage = raster_counts / np.sum(raster_counts, axis=1, keepdims=True)
+        sample_total = np.sum(sample_counts, axis=1, keepdims=True)
+        sample_coverage = sample_counts / np.maximum(sample_total, 1)
+        with np.errstate(divide='ignore', invalid='ignore'):
+            ratio = np.where(raster_counts > 0, sample_coverage / raster_coverage, np.nan)
+
+        return {
+            "quantiles": {band: breaks for (band, breaks) in zip(rast.bands, quantiles)},
+            "raster_coverage": raster_coverage,
+            "sample_coverage": sample_coverage,
+            "ratio": ratio,
+        }
+
+    if band is None and len(rast.bands) > 1:
+        raise ValueError("'If the raster has more than 1 band, the 'band' parameter must be given.")
+
+    if type(band) is int and (band < 0 or band >= len(rast.bands)):
+        raise ValueError("0-indexed band of " + str(band) + " given, but raster only has " + str(rast.band_count) + " bands.")
+
+    if type(band) is str and band not in rast.bands:
+        raise ValueError("'If the 'band' parameter is of type str, it must match one of the bands in the 'rast' SpatialRaster object.")
+
+    band = 0 if band is None else rast.get_band_index(band)
+
+    [raster_counts, sample_counts] = strata_representation_cpp(
+        rast.cpp_raster,
+        band,
+        existing.cpp_vector,
+        thread_count
+    )
+
+    raster_counts = np.array(raster_counts, dtype=np.int64)
+    sample_counts = np.array(sample_counts, dtype=np.int64)
+    strata = np.arange(len(raster_counts))
+
+    #drop strata which neither pixels nor samples fall within
+    keep = (raster_counts > 0) | (sample_counts > 0)
+    strata = strata[keep]
+    raster_counts = raster_counts[keep]
+    sample_counts = sample_counts[keep]
+
+    raster_coverage = raster_counts / max(np.sum(raster_counts), 1)
+    sample_coverage = sample_counts / max(np.sum(sample_counts), 1)
+
+    return {
+        "strata": strata,
+        "raster_count": raster_counts,
+        "sample_count": sample_counts,
+        "raster_coverage": raster_coverage,
+        "sample_coverage": sample_coverage,
+        "difference": sample_coverage - raster_coverage,
+    }
@@ -54,26 +54,44 @@
  * helper functions which are used accross multiple sgs functions.
  */
 
+#include "utils/budget.h"
 #include "utils/raster.h"
 #include "utils/vector.h"
 #include "utils/dist.h"
+#include "utils/profile.h"
 #include "calculate/pca/pca.h"
+#include "calculate/representation/representation.h"
+#include "sample/ahels/ahels.h"
 #include "sample/clhs/clhs.h"
+#include "sample/nc/nc.h"
 #include "sample/srs/srs.h"
 #include "sample/strat/strat.h"
 #include "sample/systematic/systematic.h"
 #include "stratify/breaks/breaks.h"
+#include "stratify/kmeans/kmeans.h"
 #include "stratify/map/map.h"
+#include "stratify/pipeline/pipeline.h"
 #include "stratify/poly/poly.h"
 #include "stratify/quantiles/quantiles.h"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+//the GIL is released for the duration of every long-running function using
+//py::call_guard<py::gil_scoped_release>, so that multiple Python threads can run
+//sgs functions at the same time. None of these functions access Python objects
+//internally, their arguments are converted before the GIL is released and their
+//return values are converted after it has been re-acquired.
+//
+//The same functions also run as a buffer budget Operation (see utils/budget.h),
+//so that no raster band buffers are evicted while they're in use.
+//
+//GDAL dataset handles are not thread safe, so the same raster or vector should
+//not be used by multiple calls running at the same time.
 PYBIND11_MODULE(_sgs, m) {
 	// source code in sgspy/utils/raster.h
 	py::class_<sgs::raster::GDALRasterWrapper>(m, "GDALRasterWrapper")
-		.def(py::init<std::string, std::string>())
+		.def(py::init<std::string, std::string>(), py::call_guard<py::gil_scoped_release>())
 		.def(py::init<py::buffer, std::vector<double>, std::string, std::vector<double>, std::vector<std::string>, std::string>())
 		.def("get_driver", &sgs::raster::GDALRasterWrapper::getDriver)
 		.def("get_crs", &sgs::raster::GDALRasterWrapper::getCRS)
@@ -95,34 +113,92 @@ PYBIND11_MODULE(_sgs, m) {
 		.def("get_data_type", &sgs::raster::GDALRasterWrapper::getDataType)
 		.def("set_temp_dir", &sgs::raster::GDALRasterWrapper::setTempDir)
 		.def("get_temp_dir", &sgs::raster::GDALRasterWrapper::getTempDir)
+		.def("set_persist_statistics", &sgs::raster::GDALRasterWrapper::setPersistStatistics)
+		.def("clear_statistics", &sgs::raster::GDALRasterWrapper::clearStatistics)
+		.def("get_block_size", &sgs::raster::GDALRasterWrapper::getBlockSize)
+		.def("window", &sgs::raster::GDALRasterWrapper::window)
+		.def("extract", &sgs::raster::GDALRasterWrapper::extract)
+		.def("get_overview_count", &sgs::raster::GDALRasterWrapper::getOverviewCount)
+		.def("overview", &sgs::raster::GDALRasterWrapper::overview)
 		.def("release_band_buffers", &sgs::raster::GDALRasterWrapper::releaseBandBuffers)
 		.def("close", &sgs::raster::GDALRasterWrapper::close);
 
+	m.def("set_remote_read_options", &sgs::raster::setRemoteReadOptions);
+
+	// source code in sgspy/utils/budget.h
+	m.def("set_memory_limit", &sgs::budget::setLimit, pybind11::arg("limit"));
+	m.def("memory_usage", &sgs::budget::usage);
+
+	// source code in sgspy/utils/profile.h
+	m.def("profile_start", &sgs::profile::start, pybind11::arg("trace"));
+	m.def("profile_stop", &sgs::profile::stop);
+
 	// source code in sgspy/utils/vector.h
 	py::class_<sgs::vector::GDALVectorWrapper>(m, "GDALVectorWrapper")
-		.def(py::init<std::string, std::string>())
+		.def(py::init<std::string, std::string>(), py::call_guard<py::gil_scoped_release>())
 		.def(py::init<py::bytes, std::string, std::string, std::string>())
 		.def("get_layer_names", &sgs::vector::GDALVectorWrapper::getLayerNames)
 		.def("get_layer_info", &sgs::vector::GDALVectorWrapper::getLayerInfo)
 		.def("get_points", &sgs::vector::GDALVectorWrapper::getPoints)
 		.def("get_wkt_points", &sgs::vector::GDALVectorWrapper::getPointsAsWkt)
 		.def("get_linestrings", &sgs::vector::GDALVectorWrapper::getLineStrings)
-		.def("write", &sgs::vector::GDALVectorWrapper::write)
+		.def("write", &sgs::vector::GDALVectorWrapper::write, py::call_guard<py::gil_scoped_release>())
 		.def("get_projection", &sgs::vector::GDALVectorWrapper::getFullProjectionInfo);
 
 	// source code in sgspy/utils/dist.h
 	m.def("dist_cpp", &sgs::dist::dist,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
 		pybind11::arg("p_raster"),
 		pybind11::arg("band"),
 		pybind11::arg("p_vector").none(true),
 		pybind11::arg("layer"),
-		pybind11::arg("nBuckets"));
+		pybind11::arg("nBuckets"),
+		pybind11::arg("useStatistics"),
+		pybind11::arg("exact"),
+		pybind11::arg("threads"));
 
 	// source code in sgspy/calculate/pca/pca.h
-	m.def("pca_cpp", &sgs::pca::pca);
+	m.def("pca_cpp", &sgs::pca::pca,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>());
+
+	// source code in sgspy/calculate/representation/representation.h
+	m.def("strata_representation_cpp", &sgs::representation::strataRepresentation,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
+		pybind11::arg("p_raster"),
+		pybind11::arg("bandNum"),
+		pybind11::arg("p_existing"),
+		pybind11::arg("threads"));
+
+	m.def("quantile_representation_cpp", &sgs::representation::quantileRepresentation,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
+		pybind11::arg("p_raster"),
+		pybind11::arg("nQuant"),
+		pybind11::arg("p_existing"),
+		pybind11::arg("eps"),
+		pybind11::arg("threads"));
+
+	// source code in sgspy/sample/ahels/ahels.h
+	m.def("ahels_cpp", &sgs::ahels::ahels,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
+		pybind11::arg("p_raster"),
+		pybind11::arg("p_existing"),
+		pybind11::arg("nQuant"),
+		pybind11::arg("numSamples"),
+		pybind11::arg("threshold"),
+		pybind11::arg("tolerance"),
+		pybind11::arg("p_access").none(true),
+		pybind11::arg("layerName"),
+		pybind11::arg("buffInner"),
+		pybind11::arg("buffOuter"),
+		pybind11::arg("eps"),
+		pybind11::arg("plot"),
+		pybind11::arg("tempFolder"),
+		pybind11::arg("filename"),
+		pybind11::arg("threads"));
 
 	// source code in sgspy/sample/clhs/clhs.h
 	m.def("clhs_cpp", &sgs::clhs::clhs,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
 		pybind11::arg("p_raster"),
 		pybind11::arg("nSamp"),
 		pybind11::arg("iterations"),
@@ -132,12 +208,36 @@ PYBIND11_MODULE(_sgs, m) {
 		pybind11::arg("buffOuter"),
 		pybind11::arg("p_existing").none(true),
 		pybind11::arg("replace"),
+		pybind11::arg("chains"),
+		pybind11::arg("exchange"),
+		pybind11::arg("threads"),
+		pybind11::arg("compact"),
 		pybind11::arg("plot"),
 		pybind11::arg("tempFolder"),
 		pybind11::arg("filename"));
 
+	// source code in sgspy/sample/nc/nc.h
+	m.def("nc_cpp", &sgs::nc::nc,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
+		pybind11::arg("p_raster"),
+		pybind11::arg("numSamples"),
+		pybind11::arg("k"),
+		pybind11::arg("poolSize"),
+		pybind11::arg("maxIterations"),
+		pybind11::arg("accuracy"),
+		pybind11::arg("scale"),
+		pybind11::arg("p_access").none(true),
+		pybind11::arg("layerName"),
+		pybind11::arg("buffInner"),
+		pybind11::arg("buffOuter"),
+		pybind11::arg("plot"),
+		pybind11::arg("tempFolder"),
+		pybind11::arg("filename"),
+		pybind11::arg("threads"));
+
 	// source code in sgspy/sample/srs/srs.h
 	m.def("srs_cpp", &sgs::srs::srs, 
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
 		pybind11::arg("p_raster"),
 		pybind11::arg("numSamples"),
 		pybind11::arg("mindist"),
@@ -148,10 +248,13 @@ PYBIND11_MODULE(_sgs, m) {
 		pybind11::arg("buffOuter"),
 		pybind11::arg("plot"),
 		pybind11::arg("tempFolder"),
-		pybind11::arg("filename"));
+		pybind11::arg("filename"),
+		pybind11::arg("threads"),
+		pybind11::arg("seed"));
 
 	// source code in sgspy/sample/strat/strat.h
 	m.def("strat_cpp", &sgs::strat::strat,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
 		pybind11::arg("p_raster"),
 		pybind11::arg("bandNum"),
 		pybind11::arg("numSamples"),
@@ -173,10 +276,33 @@ PYBIND11_MODULE(_sgs, m) {
 		pybind11::arg("mapStratMapping"),
 		pybind11::arg("plot"),
 		pybind11::arg("filename"),
-		pybind11::arg("tempFolder"));
+		pybind11::arg("tempFolder"),
+		pybind11::arg("threads"),
+		pybind11::arg("bounded"));
+
+	m.def("strat_partial_cpp", &sgs::strat::stratPartial,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
+		pybind11::arg("p_raster"),
+		pybind11::arg("bandNum"),
+		pybind11::arg("numStrata"),
+		pybind11::arg("p_mraster").none(true),
+		pybind11::arg("mrastBandNum"),
+		pybind11::arg("threads"));
+
+	m.def("merge_strat_partials_cpp", &sgs::strat::mergePartials,
+		pybind11::arg("tileCounts"),
+		pybind11::arg("tileVariances"));
+
+	m.def("allocate_strat_partials_cpp", &sgs::strat::allocatePartials,
+		pybind11::arg("numSamples"),
+		pybind11::arg("allocation"),
+		pybind11::arg("weights"),
+		pybind11::arg("tileCounts"),
+		pybind11::arg("tileVariances"));
 
 	// source code in sgspy/sample/systematic/systematic.h
 	m.def("systematic_cpp", &sgs::systematic::systematic,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>(),
 		pybind11::arg("p_raster"),
 		pybind11::arg("cellSize"),
 		pybind11::arg("shape"),
@@ -188,17 +314,31 @@ PYBIND11_MODULE(_sgs, m) {
 		pybind11::arg("buffOuter"),
 		pybind11::arg("force"),
 		pybind11::arg("plot"),
-		pybind11::arg("filename"));
+		pybind11::arg("tempFolder"),
+		pybind11::arg("filename"),
+		pybind11::arg("threads"));
 
 	// source code in sgspy/stratify/breaks/breaks.h
-	m.def("breaks_cpp", &sgs::breaks::breaks);
+	m.def("breaks_cpp", &sgs::breaks::breaks,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>());
+
+	// source code in sgspy/stratify/kmeans/kmeans.h
+	m.def("kmeans_cpp", &sgs::kmeans::kmeans,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>());
 
 	// source code in sgspy/stratify/map/map_stratifications.h
-	m.def("map_cpp", &sgs::map::map);
+	m.def("map_cpp", &sgs::map::map,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>());
+
+	// source code in sgspy/stratify/pipeline/pipeline.h
+	m.def("pipeline_cpp", &sgs::pipeline::pipeline,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>());
 
 	// source code in sgspy/stratify/poly/poly.h
-	m.def("poly_cpp", &sgs::poly::poly);
+	m.def("poly_cpp", &sgs::poly::poly,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>());
 
 	// source code in sgspy/stratify/quantiles/quantiles.h
-	m.def("quantiles_cpp", &sgs::quantiles::quantiles);
+	m.def("quantiles_cpp", &sgs::quantiles::quantiles,
+		py::call_guard<sgs::budget::Operation, py::gil_scoped_release>());
 }
@@ -17,7 +17,7 @@ from .ahels import ahels
 from .clhs import clhs
 from .nc import nc
 from .srs import srs
-from .strat import strat
+from .strat import strat, strat_partial, merge_strat_partials, allocate_strat_partials
 from .systematic import systematic
 
 __all__ = [
@@ -26,5 +26,8 @@ __all__ = [
     "nc",
     "srs",
     "strat",
+    "strat_partial",
+    "merge_strat_partials",
+    "allocate_strat_partials",
     "systematic",
 ]
@@ -0,0 +1,500 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: C++ implementation of the adapted hypercube evaluation of a legacy sample
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup ahels ahels
+ * @ingroup sample
+ */
+
+#pragma once
+
+#include <limits>
+#include <random>
+#include <unordered_set>
+
+#include "utils/access.h"
+#include "utils/existing.h"
+#include "utils/helper.h"
+#include "utils/hypercube.h"
+#include "utils/raster.h"
+#include "utils/vector.h"
+
+#include <xoshiro.h>
+
+//the number of candidate pixels kept for each quantile of each band per pass over the raster
+#define AHELS_RESERVOIR_SIZE 256
+
+namespace sgs {
+namespace ahels {
+
+/**
+ * @ingroup ahels
+ * A uniform random sample (reservoir sample) of the pixels which fall within
+ * a single quantile of a single band, which new samples are drawn from. The
+ * features of every band are kept with each pixel, since adding a sample changes
+ * the sample count of it's quantile in every band.
+ */
+template <typename T>
+struct Reservoir {
+	std::vector<int64_t> pixels;
+	std::vector<T> features;
+	int64_t seen = 0;
+
+	/**
+	 * Offer a pixel to the reservoir, which keeps it with probability
+	 * AHELS_RESERVOIR_SIZE / seen (Vitter's algorithm R).
+	 *
+	 * @param int64_t pixel
+	 * @param const T *p_features
+	 * @param int nFeat
+	 * @param xso::xoshiro_4x64_plus& rng
+	 */
+	inline void
+	offer(int64_t pixel, const T *p_features, int nFeat, xso::xoshiro_4x64_plus& rng) {
+		this->seen++;
+		if (this->pixels.size() < AHELS_RESERVOIR_SIZE) {
+			this->pixels.push_back(pixel);
+			this->features.insert(this->features.end(), p_features, p_features + nFeat);
+			return;
+		}
+
+		uint64_t slot = std::uniform_int_distribution<uint64_t>(0, this->seen - 1)(rng);
+		if (slot < AHELS_RESERVOIR_SIZE) {
+			this->pixels[slot] = pixel;
+			std::copy(p_features, p_features + nFeat, this->features.begin() + slot * nFeat);
+		}
+	}
+
+	/**
+	 * Take a random pixel out of the reservoir, writing it's features to p_features.
+	 *
+	 * @param int nFeat
+	 * @param T *p_features
+	 * @param xso::xoshiro_4x64_plus& rng
+	 * @returns int64_t the pixel, or -1 if the reservoir is empty
+	 */
+	inline int64_t
+	take(int nFeat, T *p_features, xso::xoshiro_4x64_plus& rng) {
+		if (this->pixels.empty()) {
+			return -1;
+		}
+
+		size_t slot = std::uniform_int_distribution<size_t>(0, this->pixels.size() - 1)(rng);
+		int64_t pixel = this->pixels[slot];
+		std::copy(this->features.begin() + slot * nFeat, this->features.begin() + (slot + 1) * nFeat, p_features);
+
+		//move the last pixel into the slot of the taken pixel
+		this->pixels[slot] = this->pixels.back();
+		this->pixels.pop_back();
+		std::copy(this->features.end() - nFeat, this->features.end(), this->features.begin() + slot * nFeat);
+		this->features.resize(this->features.size() - nFeat);
+		return pixel;
+	}
+
+	/**
+	 * Merge the reservoir of another chunk of the raster into this one, so the
+	 * result is a uniform random sample of the pixels seen by both. Each slot is
+	 * filled from one of the two reservoirs with probability proportional to the
+	 * number of pixels it has seen which are not yet represented, which draws
+	 * from the combined pixels without replacement.
+	 *
+	 * @param Reservoir<T>& other
+	 * @param int nFeat
+	 * @param xso::xoshiro_4x64_plus& rng
+	 */
+	void merge(Reservoir<T>& other, int nFeat, xso::xoshiro_4x64_plus& rng) {
+		if (other.seen == 0) {
+			return;
+		}
+
+		Reservoir<T> merged;
+		merged.seen = this->seen + other.seen;
+
+		int64_t remaining = this->seen;
+		int64_t otherRemaining = other.seen;
+		std::vector<T> features(nFeat);
+		size_t size = std::min<int64_t>(AHELS_RESERVOIR_SIZE, merged.seen);
+		while (merged.pixels.size() < size) {
+			bool fromOther = std::uniform_int_distribution<int64_t>(0, remaining + otherRemaining - 1)(rng) >= remaining;
+			Reservoir<T>& source = fromOther ? other : *this;
+			(fromOther ? otherRemaining : remaining)--;
+
+			int64_t pixel = source.take(nFeat, features.data(), rng);
+			merged.pixels.push_back(pixel);
+			merged.features.insert(merged.features.end(), features.begin(), features.end());
+		}
+
+		*this = std::move(merged);
+	}
+};
+
+/**
+ * @ingroup ahels
+ * Offer every candidate pixel to the reservoir of it's quantile in every band. A
+ * candidate is not nan in any band, is accessible, and isn't already a sample. Each
+ * chunk of the raster fills it's own reservoirs, which are merged once every chunk
+ * is read.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param RasterBandMetaData *p_access
+ * @param const hypercube::QuantileMatrix& matrix
+ * @param const std::unordered_set<int64_t>& sampled
+ * @param int width
+ * @param int height
+ * @param int threads
+ * @param xso::xoshiro_4x64_plus& rng
+ * @returns std::vector<Reservoir<T>> indexed by band * nQuant + quantile
+ */
+template <typename T>
+std::vector<Reservoir<T>>
+fillReservoirs(
+	std::vector<helper::RasterBandMetaData>& bands,
+	helper::RasterBandMetaData *p_access,
+	const hypercube::QuantileMatrix& matrix,
+	const std::unordered_set<int64_t>& sampled,
+	int width,
+	int height,
+	int threads,
+	xso::xoshiro_4x64_plus& rng)
+{
+	int nFeat = static_cast<int>(bands.size());
+	int nQuant = matrix.nQuant;
+	int chunks = hypercube::chunkCount(height, bands[0].yBlockSize, threads);
+
+	std::vector<std::vector<Reservoir<T>>> chunkReservoirs(chunks, std::vector<Reservoir<T>>(static_cast<size_t>(nFeat) * nQuant));
+	std::vector<xso::xoshiro_4x64_plus> rngs(chunks);
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		rngs[chunk].seed(rng());
+	}
+
+	hypercube::forEachPixel<T>(bands, p_access, width, height, threads, [&](int chunk, const T *p_features, int x, int y, bool accessible) {
+		int64_t pixel = static_cast<int64_t>(y) * width + x;
+		if (!accessible || sampled.count(pixel)) {
+			return;
+		}
+
+		for (int b = 0; b < nFeat; b++) {
+			int q = matrix.quantile(b, p_features[b]);
+			chunkReservoirs[chunk][static_cast<size_t>(b) * nQuant + q].offer(pixel, p_features, nFeat, rngs[chunk]);
+		}
+	});
+
+	for (int chunk = 1; chunk < chunks; chunk++) {
+		for (size_t cell = 0; cell < chunkReservoirs[0].size(); cell++) {
+			chunkReservoirs[0][cell].merge(chunkReservoirs[chunk][cell], nFeat, rng);
+		}
+	}
+
+	return std::move(chunkReservoirs[0]);
+}
+
+/**
+ * @ingroup ahels
+ * This function adds samples to an existing sample network using the adapted
+ * hypercube evaluation of a legacy sample (AHELS) algorithm, as in the sample_ahels
+ * function of the sgsR package:
+ *
+ * Malone, B.P., Minansy, B., Brungard, C. 2019. Some methods to improve the utility
+ * of conditioned Latin hypercube sampling. PeerJ 7:e6451.
+ *
+ * The feature space is the quantile matrix of every band of the raster (see
+ * hypercube::QuantileMatrix). For each quantile of each band, the ratio is the fraction
+ * of samples within it divided by the fraction of pixels within it. Samples are added
+ * one at a time to the quantile with the lowest ratio, and the ratios updated, until
+ * either numSamples samples have been added, or (if numSamples is -1) every ratio is at
+ * least threshold - tolerance. Quantiles which no pixels fall within are ignored.
+ *
+ * The raster is never entirely in memory. There is one streaming pass to calculate
+ * the breaks of the quantile matrix (a quantile sketch with rank error eps), and a second
+ * which counts the pixels within each quantile and keeps a reservoir of random candidate
+ * pixels for each quantile of each band, split between threads. New samples are taken
+ * from the reservoir of the quantile with the lowest ratio. If a reservoir runs out (more
+ * than AHELS_RESERVOIR_SIZE samples are added to a single quantile), the candidates are
+ * read again, excluding the pixels which are already samples.
+ *
+ * Candidates must be within the accessible area if an access network is given. As with
+ * the other sampling functions, the existing samples are included in the output with an
+ * 'existing' field of 1, and the new samples have an 'existing' field of 0.
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param GDALVectorWrapper *p_existing
+ * @param int nQuant
+ * @param int64_t numSamples
+ * @param double threshold
+ * @param double tolerance
+ * @param GDALVectorWrapper *p_access
+ * @param std::string layerName
+ * @param double buffInner
+ * @param double buffOuter
+ * @param double eps
+ * @param bool plot
+ * @param std::string tempFolder
+ * @param std::string filename
+ * @param int threads
+ * @returns std::tuple<std::vector<std::vector<double>>, GDALVectorWrapper *, size_t, std::vector<std::vector<double>>, std::vector<double>>
+ * 	the coordinates of the samples to plot, the sample network, the number of samples added, the breaks of every
+ * 	band, and the final ratio of every quantile indexed by band * nQuant + quantile (nan for ignored quantiles).
+ */
+template <typename T>
+std::tuple<std::vector<std::vector<double>>, vector::GDALVectorWrapper *, size_t, std::vector<std::vector<double>>, std::vector<double>>
+ahelsImpl(
+	raster::GDALRasterWrapper *p_raster,
+	std::vector<helper::RasterBandMetaData>& bands,
+	vector::GDALVectorWrapper *p_existing,
+	int nQuant,
+	int64_t numSamples,
+	double threshold,
+	double tolerance,
+	vector::GDALVectorWrapper *p_access,
+	std::string layerName,
+	double buffInner,
+	double buffOuter,
+	double eps,
+	bool plot,
+	std::string tempFolder,
+	std::string filename,
+	int threads)
+{
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+	double *GT = p_raster->getGeotransform();
+	int nFeat = static_cast<int>(bands.size());
+	size_t cells = static_cast<size_t>(nFeat) * nQuant;
+
+	std::vector<double> xCoords, yCoords;
+
+	//create output dataset before doing anything which will take a long time in case of failure.
+	GDALDriver *p_driver = GetGDALDriverManager()->GetDriverByName("MEM");
+	if (!p_driver) {
+		throw std::runtime_error("unable to create output sample dataset driver.");
+	}
+	GDALDataset *p_samples = p_driver->Create("", 0, 0, 0, GDT_Unknown, nullptr);
+	if (!p_samples) {
+		throw std::runtime_error("unable to create output dataset with driver.");
+	}
+
+	vector::GDALVectorWrapper *p_wrapper = new vector::GDALVectorWrapper(p_samples, std::string(p_raster->getDataset()->GetProjectionRef()));
+	OGRLayer *p_layer = p_samples->CreateLayer("samples", p_wrapper->getSRS(), wkbPoint, nullptr);
+	if (!p_layer) {
+		throw std::runtime_error("unable to create output dataset layer.");
+	}
+
+	//the existing samples are added to the output layer by the Existing struct
+	existing::Existing existing(
+		p_existing,
+		p_raster,
+		GT,
+		width,
+		p_layer,
+		plot,
+		xCoords,
+		yCoords
+	);
+
+	std::mutex accessMutex;
+	access::Access access(
+		p_access,
+		p_raster,
+		layerName,
+		buffInner,
+		buffOuter,
+		true,
+		tempFolder,
+		bands[0].xBlockSize,
+		bands[0].yBlockSize,
+		threads
+	);
+	access.band.p_mutex = &accessMutex;
+
+	//step 1: the quantile matrix of the raster
+	hypercube::QuantileMatrix matrix;
+	matrix.nQuant = nQuant;
+	matrix.breaks = hypercube::calculateBreaks<T>(bands, width, height, nQuant, eps, threads);
+
+	//step 2: the quantile counts of the existing samples
+	std::vector<int> pixelX, pixelY;
+	hypercube::existingPixels(p_existing, p_raster, pixelX, pixelY);
+	int64_t samples;
+	std::vector<int64_t> sampleCounts = hypercube::countSamples(bands, matrix, pixelX, pixelY, width, height, threads, samples);
+
+	std::unordered_set<int64_t> sampled;
+	for (size_t i = 0; i < pixelX.size(); i++) {
+		sampled.insert(static_cast<int64_t>(pixelY[i]) * width + pixelX[i]);
+	}
+
+	//step 3: count the pixels within each quantile, and fill the candidate reservoirs
+	xso::xoshiro_4x64_plus rng;
+	std::vector<Reservoir<T>> reservoirs;
+	{
+		int chunks = hypercube::chunkCount(height, bands[0].yBlockSize, threads);
+		std::vector<std::vector<int64_t>> counts(chunks, std::vector<int64_t>(cells, 0));
+		std::vector<int64_t> pixels(chunks, 0);
+		hypercube::forEachPixel<T>(bands, nullptr, width, height, threads, [&](int chunk, const T *p_features, int, int, bool) {
+			for (int b = 0; b < nFeat; b++) {
+				counts[chunk][static_cast<size_t>(b) * nQuant + matrix.quantile(b, p_features[b])]++;
+			}
+			pixels[chunk]++;
+		});
+
+		matrix.counts.assign(cells, 0);
+		for (int chunk = 0; chunk < chunks; chunk++) {
+			for (size_t cell = 0; cell < cells; cell++) {
+				matrix.counts[cell] += counts[chunk][cell];
+			}
+			matrix.pixels += pixels[chunk];
+		}
+
+		reservoirs = fillReservoirs<T>(bands, access.used ? &access.band : nullptr, matrix, sampled, width, height, threads, rng);
+	}
+
+	//step 4: add samples to the quantile with the lowest ratio until done
+	std::vector<bool> ignored(cells);
+	for (size_t cell = 0; cell < cells; cell++) {
+		ignored[cell] = matrix.counts[cell] == 0;
+	}
+
+	auto ratio = [&](size_t cell) {
+		if (samples == 0) {
+			return 0.0;
+		}
+		double sampleDensity = static_cast<double>(sampleCounts[cell]) / static_cast<double>(samples);
+		return sampleDensity / matrix.density(cell / nQuant, cell % nQuant);
+	};
+
+	helper::Field fieldExistingFalse("existing", 0);
+	std::vector<T> features(nFeat);
+	size_t added = 0;
+	while (numSamples == -1 || static_cast<int64_t>(added) < numSamples) {
+		size_t lowest = cells;
+		double lowestRatio = std::numeric_limits<double>::infinity();
+		for (size_t cell = 0; cell < cells; cell++) {
+			if (ignored[cell]) {
+				continue;
+			}
+			double cellRatio = ratio(cell);
+			if (cellRatio < lowestRatio) {
+				lowestRatio = cellRatio;
+				lowest = cell;
+			}
+		}
+
+		if (lowest == cells || (numSamples == -1 && lowestRatio >= threshold - tolerance)) {
+			break;
+		}
+
+		//take a candidate which hasn't been added since the reservoirs were filled
+		int64_t pixel = reservoirs[lowest].take(nFeat, features.data(), rng);
+		while (pixel != -1 && sampled.count(pixel)) {
+			pixel = reservoirs[lowest].take(nFeat, features.data(), rng);
+		}
+
+		if (pixel == -1) {
+			//every candidate of this quantile was taken, so read the candidates again
+			if (reservoirs[lowest].seen > AHELS_RESERVOIR_SIZE) {
+				reservoirs = fillReservoirs<T>(bands, access.used ? &access.band : nullptr, matrix, sampled, width, height, threads, rng);
+			}
+			else {
+				//every candidate of this quantile is already a sample
+				ignored[lowest] = true;
+			}
+			continue;
+		}
+
+		sampled.insert(pixel);
+		for (int b = 0; b < nFeat; b++) {
+			sampleCounts[static_cast<size_t>(b) * nQuant + matrix.quantile(b, features[b])]++;
+		}
+		samples++;
+
+		const auto [x, y] = helper::sample_to_point(GT, static_cast<int>(pixel % width), static_cast<int>(pixel / width));
+		OGRPoint point = OGRPoint(x, y);
+		existing.used ?
+			helper::addPoint(&point, p_layer, &fieldExistingFalse) :
+			helper::addPoint(&point, p_layer);
+
+		if (plot) {
+			xCoords.push_back(x);
+			yCoords.push_back(y);
+		}
+		added++;
+	}
+
+	std::vector<double> ratios(cells, std::nan(""));
+	for (size_t cell = 0; cell < cells; cell++) {
+		if (matrix.counts[cell] != 0) {
+			ratios[cell] = ratio(cell);
+		}
+	}
+
+	if (filename != "") {
+		try {
+			p_wrapper->write(filename);
+		}
+		catch (const std::exception& e) {
+			std::cout << "Exception thrown trying to write file: " << e.what() << std::endl;
+		}
+	}
+
+	return {{xCoords, yCoords}, p_wrapper, added, matrix.breaks, ratios};
+}
+
+/**
+ * @ingroup ahels
+ * Entry point of AHELS, which processes the bands as double precision values if
+ * any of them is of type double, otherwise as single precision values. See ahelsImpl().
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param GDALVectorWrapper *p_existing
+ * @param int nQuant
+ * @param int64_t numSamples
+ * @param double threshold
+ * @param double tolerance
+ * @param GDALVectorWrapper *p_access
+ * @param std::string layerName
+ * @param double buffInner
+ * @param double buffOuter
+ * @param double eps
+ * @param bool plot
+ * @param std::string tempFolder
+ * @param std::string filename
+ * @param int threads
+ */
+std::tuple<std::vector<std::vector<double>>, vector::GDALVectorWrapper *, size_t, std::vector<std::vector<double>>, std::vector<double>>
+ahels(
+	raster::GDALRasterWrapper *p_raster,
+	vector::GDALVectorWrapper *p_existing,
+	int nQuant,
+	int64_t numSamples,
+	double threshold,
+	double tolerance,
+	vector::GDALVectorWrapper *p_access,
+	std::string layerName,
+	double buffInner,
+	double buffOuter,
+	double eps,
+	bool plot,
+	std::string tempFolder,
+	std::string filename,
+	int threads)
+{
+	GDALAllRegister();
+
+	std::mutex mutex;
+	GDALDataType type;
+	std::vector<helper::RasterBandMetaData> bands = hypercube::getBands(p_raster, &mutex, type);
+
+	return type == GDT_Float64 ?
+		ahelsImpl<double>(p_raster, bands, p_existing, nQuant, numSamples, threshold, tolerance, p_access,
+				  layerName, buffInner, buffOuter, eps, plot, tempFolder, filename, threads) :
+		ahelsImpl<float>(p_raster, bands, p_existing, nQuant, numSamples, threshold, tolerance, p_access,
+				 layerName, buffInner, buffOuter, eps, plot, tempFolder, filename, threads);
+}
+
+} //namespace ahels
+} //namespace sgs
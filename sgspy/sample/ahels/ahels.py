@@ -1,3 +1,279 @@
-def ahels():
-    print(__file__)
-    raise NotImplementedError
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: adapted hypercube evaluation of a legacy sample (ahels)
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+##
+# @defgroup user_ahels ahels
+# @ingroup user_sample
+
+import os
+import sys
+import site
+import tempfile
+from typing import Optional
+
+import numpy as np
+import matplotlib.pyplot as plt
+
+from sgspy.utils import (
+    SpatialRaster,
+    SpatialVector,
+    plot,
+)
+
+#ensure _sgs binary can be found
+site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackages()))[0]
+sys.path.append(os.path.join(site_packages, "sgspy"))
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from _sgs import ahels_cpp
+
+##
+# @ingroup user_ahels
+# This function adds samples to an existing sample network using the adapted hypercube
+# evaluation of a legacy sample (AHELS) algorithm, see the following article for an in
+# depth description of the method itself:
+#
+# Malone, B.P., Minansy, B., Brungard, C. 2019. Some methods to improve the utility of
+# conditioned Latin hypercube sampling. PeerJ 7:e6451.
+#
+# Every band of the raster is split into num_quantiles quantiles. For each quantile of each
+# band, the ratio is the fraction of the samples which fall within it divided by the fraction
+# of the pixels which fall within it, so a ratio below 1 means the quantile is under-represented
+# by the samples. Samples are added one at a time to the quantile with the lowest ratio until
+# either num_samples samples have been added or, if num_samples is not given, every ratio is at
+# least threshold - tolerance.
+#
+# The raster is never loaded into memory all at once. The quantiles are calculated by streaming
+# through the raster in blocks using thread_count threads, where the rank of every quantile is
+# within eps times the number of pixels of its exact rank. A random subset of candidate pixels
+# is kept for every quantile while counting the pixels within each quantile.
+#
+# An access vector of LineString or MultiLineString type can be provided, in which case new
+# samples are only added within the accessible area. The ratios are still calculated using
+# every pixel of the raster. buff_outer specifies the buffer distance around the geometry which
+# is allowed to be included in the sampling, buff_inner specifies the buffer distance around
+# the geometry which is not allowed to be included in the sampling. buff_outer must be larger
+# than buff_inner. For a multi layer vector, layer_name must be specified.
+#
+# The output contains the existing samples, with an 'existing' field of 1, and the new samples,
+# with an 'existing' field of 0. If details is True, a dict is also returned containing the
+# 'quantiles' (the break values of each band) and the 'ratio' of each quantile of each band
+# after the samples are added. The ratio is nan for quantiles which no pixels fall within.
+#
+# Examples
+# --------------------
+# rast = sgspy.SpatialRaster("raster.tif") @n
+# existing = sgspy.SpatialVector("existing_samples.shp") @n
+# samples = sgspy.sample.ahels(rast, existing, num_samples=50)
+#
+# rast = sgspy.SpatialRaster("raster.tif") @n
+# existing = sgspy.SpatialVector("existing_samples.shp") @n
+# samples = sgspy.sample.ahels(rast, existing, threshold=0.8, tolerance=0.05, plot=True, filename="ahels_samples.shp")
+#
+# rast = sgspy.SpatialRaster("raster.tif") @n
+# existing = sgspy.SpatialVector("existing_samples.shp") @n
+# access = sgspy.SpatialVector("access_network.shp") @n
+# samples, details = sgspy.sample.ahels(rast, existing, num_samples=50, access=access, buff_outer=300, details=True)
+#
+# Parameters
+# --------------------
+# rast : SpatialRaster @n
+#     raster data structure containing the raster to sample @n @n
+# existing : SpatialVector @n
+#     a vector specifying existing sample points @n @n
+# num_quantiles : int @n
+#     the number of quantiles to split each band into @n @n
+# num_samples : int @n
+#     the number of samples to add, if not given samples are added until the threshold is met @n @n
+# threshold : float @n
+#     the ratio every quantile must reach if num_samples is not given @n @n
+# tolerance : float @n
+#     the amount each ratio may be below the threshold @n @n
+# access : SpatialVector @n
+#     a vector specifying access network @n @n
+# layer_name : str @n
+#     the layer within access that is to be used for sampling @n @n
+# buff_inner : int | float @n
+#     buffer boundary specifying distance from access which CANNOT be sampled @n @n
+# buff_outer : int | float @n
+#     buffer boundary specifying distance from access which CAN be sampled @n @n
+# eps : float @n
+#     the epsilon value, controlling the error of the stream-processed quantiles @n @n
+# thread_count : int @n
+#     the number of threads to use @n @n
+# details : bool @n
+#     whether to also return the quantiles and ratios @n @n
+# plot : bool @n
+#     whether to plot the samples or not @n @n
+# filename : str @n
+#     the filename to write to, or '' if file should not be written @n @n
+#
+# Returns
+# --------------------
+# a SpatialVector object containing point geometries of sample locations, and a dict of
+# details if details is True
+def ahels(
+    rast: SpatialRaster,
+    existing: SpatialVector,
+    num_quantiles: int = 10,
+    num_samples: Optional[int] = None,
+    threshold: float = 0.9,
+    tolerance: float = 0,
+    access: Optional[SpatialVector] = None,
+    layer_name: Optional[str] = None,
+    buff_inner: Optional[int | float] = None,
+    buff_outer: Optional[int | float] = None,
+    eps: float = .001,
+    thread_count: int = 8,
+    details: bool = False,
+    plot: bool = False,
+    filename: str = ''):
+
+    if type(rast) is not SpatialRaster:
+        raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster.")
+
+    if type(existing) is not SpatialVector:
+        raise TypeError("'existing' parameter must be of type sgspy.SpatialVector.")
+
+    if type(num_quantiles) is not int:
+        raise TypeError("'num_quantiles' parameter must be of type int.")
+
+    if num_samples is not None and type(num_samples) is not int:
+        raise TypeError("'num_samples' parameter, if given, must be of type int.")
+
+    if type(threshold) not in [int, float]:
+        raise TypeError("'threshold' parameter must be of type float.")
+
+    if type(tolerance) not in [int, float]:
+        raise TypeError("'tolerance' parameter must be of type float.")
+
+    if access is not None and type(access) is not SpatialVector:
+        raise TypeError("'access' parameter, if given, must be of type sgspy.SpatialVector.")
+
+    if layer_name is not None and type(layer_name) is not str:
+        raise TypeError("'layer_name' parameter, if given, must be of type str.")
+
+    if buff_inner is not None and type(buff_inner) not in [int, float]:
+        raise TypeError("'buff_inner' parameter, if given, must be of type int or float.")
+
+    if buff_outer is not None and type(buff_outer) not in [int, float]:
+        raise TypeError("'buff_outer' parameter, if given, must be of type int or float.")
+
+    if type(eps) is not float:
+        raise TypeError("'eps' parameter must be of type float.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if type(details) is not bool:
+        raise TypeError("'details' parameter must be of type bool.")
+
+    if type(plot) is not bool:
+        raise TypeError("'plot' parameter must be of type bool.")
+
+    if type(filename) is not str:
+        raise TypeError("'filename' paramter must be of type str.")
+
+    if rast.closed:
+            raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
+
+    if num_quantiles < 2:
+        raise ValueError("num_quantiles must be at least 2.")
+
+    if num_samples is not None and num_samples < 1:
+        raise ValueError("num_samples, if given, must be greater than 0.")
+
+    if threshold <= 0 or threshold > 1:
+        raise ValueError("threshold must be greater than 0 and at most 1.")
+
+    if tolerance < 0 or tolerance > 0.1:
+        raise ValueError("tolerance must be between 0 and 0.1.")
+
+    if eps <= 0 or eps >= 1:
+        raise ValueError("eps must be between 0 and 1.")
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    if (access):
+        if layer_name is None:
+            if len(access.layers) > 1:
+                raise ValueError("if there are multiple layers in the access vector, layer_name parameter must be passed.")
+            layer_name = access.layers[0]
+
+        if layer_name not in access.layers:
+            raise ValueError("layer specified by 'layer_name' does not exist in the access vector")
+
+        if buff_inner is None or buff_inner < 0:
+            buff_inner = 0
+
+        if buff_outer is None or buff_outer < 0:
+            raise ValueError("if an access vector is given, buff_outer must be a float greater than 0.")
+
+        if buff_inner >= buff_outer:
+            raise ValueError("buff_outer must be greater than buff_inner")
+
+        access_vector = access.cpp_vector
+    else:
+        access_vector = None
+        layer_name = ""
+        buff_inner = -1
+        buff_outer = -1
+
+    temp_dir = rast.cpp_raster.get_temp_dir()
+    if temp_dir == "":
+        temp_dir = tempfile.mkdtemp()
+        rast.cpp_raster.set_temp_dir(temp_dir)
+
+    [sample_coordinates, cpp_vector, num_points, quantiles, ratios] = ahels_cpp(
+        rast.cpp_raster,
+        existing.cpp_vector,
+        num_quantiles,
+        -1 if num_samples is None else num_samples,
+        float(threshold),
+        float(tolerance),
+        access_vector,
+        layer_name,
+        buff_inner,
+        buff_outer,
+        eps,
+        plot,
+        temp_dir,
+        filename,
+        thread_count
+    )
+
+    if num_samples is not None and num_points < num_samples:
+        print("unable to find the full {} samples within the given constraints. Sampled {} points.".format(num_samples, num_points))
+
+    #plot new vector if requested
+    if plot:
+        try:
+            fig, ax = plt.subplots()
+            rast.plot(ax, band=rast.bands[0])
+            title = "samples on " + rast.bands[0]
+
+            if access:
+                access.plot('LineString', ax)
+                title += " with access"
+
+            ax.plot(sample_coordinates[0], sample_coordinates[1], '.r')
+            ax.set_title(label=title)
+            plt.show()
+
+        except Exception as e:
+            print("unable to plot output: " + str(e))
+
+    samples = SpatialVector(cpp_vector)
+    if not details:
+        return samples
+
+    return samples, {
+        "quantiles": {band: breaks for (band, breaks) in zip(rast.bands, quantiles)},
+        "ratio": np.array(ratios).reshape(rast.band_count, num_quantiles),
+    }
@@ -12,13 +12,25 @@
  * @ingroup sample
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <random>
+#include <unordered_set>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
 
 #include "utils/access.h"
 #include "utils/existing.h"
 #include "utils/helper.h"
+#include "utils/profile.h"
 #include "utils/raster.h"
+#include "utils/reader.h"
 #include "utils/vector.h"
 
 #include <mkl.h>
@@ -36,12 +48,16 @@ namespace clhs {
  * @ingroup clhs
  * Structure for containing the x and y positions of a point,
  * along with an array of its feature values.
+ *
+ * If the point was taken from a compact pool, the features are decoded
+ * into the values vector, and p_features points to it.
  */
 template <typename T>
 struct Point {
 	T *p_features = nullptr;
 	int x = -1;
 	int y = -1;
+	std::vector<T> values;
 };
 
 /**
@@ -62,6 +78,12 @@ getQuantile(T val, std::vector<T>& quantiles) {
 		std::distance(quantiles.begin(), it);
 }
 
+/**
+ * @ingroup clhs
+ * The largest code of a feature stored in a compact pool.
+ */
+#define CLHS_COMPACT_MAX_CODE 65535
+
 /**
  * @ingroup clhs
  * This class is responsible for managing the data for the clhs sampling method.
@@ -69,6 +91,24 @@ getQuantile(T val, std::vector<T>& quantiles) {
  * It contains a vector with the feature values of all added pixels, as well as 
  * the x and y values of those pixels, and can randomly return one of those pixels
  * as desired. It also stores the correlation matrix of the raster. 
+ *
+ * COMPACT MODE:
+ * The pool may contain up to tens of millions of pixels, which in double precision
+ * with many features requires gigabytes of memory. In compact mode, each feature is
+ * stored as a 16 bit code within a per-feature range, where the value of a code c is
+ * low + c * step, and the x and y coordinates are packed into a single 32 bit pixel
+ * index (if the raster has fewer than 2^32 pixels). This reduces the memory of the pool
+ * by 2x compared to float, and 4x compared to double.
+ *
+ * The range of a feature covers the minimum and maximum of the values pooled so far. When
+ * a value outside of it is added, the range is widened to at least double its previous
+ * width, and the codes of that feature are re-encoded within the new range. Each value is
+ * therefore always within a step (range / CLHS_COMPACT_MAX_CODE, at most twice the range of
+ * the feature divided by CLHS_COMPACT_MAX_CODE) of it's original value, regardless of where
+ * in the range of the band the first pixels fall. Since the range at least doubles every time,
+ * the error added by re-encoding stays within that step, and the pool is only re-encoded a few
+ * times, almost always before many pixels have been added. Points are decoded when drawn by
+ * getRandomPoint().
  */
 template <typename T>
 class CLHSDataManager {
@@ -81,6 +121,15 @@ class CLHSDataManager {
 	int64_t size;
 	uint64_t ucount;
 
+	//for compact mode
+	bool compact = false;
+	bool packed = false;
+	int width = 0;
+	std::vector<uint16_t> codes;
+	std::vector<uint32_t> indices;
+	std::vector<double> lows;
+	std::vector<double> steps;
+
 	//for existing sample points
 	std::vector<T> efeatures;
 	std::vector<int> ex;
@@ -96,6 +145,71 @@ class CLHSDataManager {
 	xso::xoshiro_4x64_plus *p_rng = nullptr;
 	uint64_t mask = 0;
 
+	/**
+	 * This function grows the pool vectors by another 1,000,000 points.
+	 */
+	inline void
+	grow() {
+		if (this->compact) {
+			this->codes.resize(this->codes.size() + MILLION * this->nFeat);
+		}
+		else {
+			this->features.resize(this->features.size() + MILLION * this->nFeat);
+		}
+
+		if (this->packed) {
+			this->indices.resize(this->indices.size() + MILLION);
+		}
+		else {
+			this->x.resize(this->x.size() + MILLION);
+			this->y.resize(this->y.size() + MILLION);
+		}
+		this->size += MILLION;
+	}
+
+	/**
+	 * This function encodes a feature value of a compact pool, first widening the range
+	 * of the feature (and re-encoding the codes of the points already in the pool) if the
+	 * value is outside of it.
+	 *
+	 * @param int f
+	 * @param double val
+	 * @returns uint16_t
+	 */
+	inline uint16_t
+	encode(int f, double val) {
+		double& low = this->lows[f];
+		double& step = this->steps[f];
+		double high = low + step * CLHS_COMPACT_MAX_CODE;
+
+		if (this->count == 0) {
+			low = val;
+			step = 0;
+			return 0;
+		}
+
+		if (val < low || val > high) {
+			//widen the range to at least twice its width, in the direction of the value
+			double width = high - low;
+			double newLow = val < low ? std::min(val, high - 2 * width) : low;
+			double newHigh = val > high ? std::max(val, low + 2 * width) : high;
+			double newStep = (newHigh - newLow) / CLHS_COMPACT_MAX_CODE;
+
+			for (size_t i = 0; i < this->count; i++) {
+				uint16_t& code = this->codes[i * this->nFeat + f];
+				double old = low + step * code;
+				code = static_cast<uint16_t>(std::clamp(std::round((old - newLow) / newStep), 0.0, static_cast<double>(CLHS_COMPACT_MAX_CODE)));
+			}
+
+			low = newLow;
+			step = newStep;
+		}
+
+		return step > 0 ?
+			static_cast<uint16_t>(std::clamp(std::round((val - low) / step), 0.0, static_cast<double>(CLHS_COMPACT_MAX_CODE))) :
+			0;
+	}
+
 	public:
 	/**
 	 * Constructor, sets the nFeat, nSamp, and random number generator. Also
@@ -104,20 +218,41 @@ class CLHSDataManager {
 	 *
 	 * set sizes and count values of existing pixels if required.
 	 *
+	 * If compact is true, the pool is stored in compact mode. The x and y
+	 * coordinates are only packed if every pixel index of a raster of the
+	 * given width and height fits in 32 bits.
+	 *
 	 * @param int nFeat
 	 * @param int nSamp
 	 * @param xso::xoshiro_4x64_plus *p_rng
 	 * @param int existingCount
+	 * @param bool compact
+	 * @param int width
+	 * @param int height
 	 */
-	CLHSDataManager(int nFeat, int nSamp, xso::xoshiro_4x64_plus *p_rng, size_t existingCount) {
+	CLHSDataManager(
+		int nFeat, 
+		int nSamp, 
+		xso::xoshiro_4x64_plus *p_rng, 
+		size_t existingCount,
+		bool compact = false,
+		int width = 0,
+		int height = 0) 
+	{
 		this->nFeat = nFeat;
 		this->nSamp = nSamp;
 		this->count = 0;
 		this->fi = 0;
-		this->size = MILLION;
-		this->features.resize(MILLION * nFeat);
-		this->x.resize(MILLION);
-		this->y.resize(MILLION);
+		this->size = 0;
+
+		this->compact = compact;
+		this->packed = compact && static_cast<uint64_t>(width) * static_cast<uint64_t>(height) <= std::numeric_limits<uint32_t>::max();
+		this->width = width;
+		if (compact) {
+			this->lows.resize(nFeat, 0);
+			this->steps.resize(nFeat, 0);
+		}
+		grow();
 
 		this->p_rng = p_rng;
 
@@ -134,7 +269,8 @@ class CLHSDataManager {
 	 * pixel containing those features.
 	 *
 	 * The x, y, and features vectors are updated accordingly and resized
-	 * if required.
+	 * if required. In compact mode, the features are encoded (see encode())
+	 * and the coordinates are packed.
 	 *
 	 * @param T *p_features
 	 * @param int x
@@ -142,20 +278,30 @@ class CLHSDataManager {
 	 */
 	inline void
 	addPoint(T *p_features, int x, int y) {
-		for (int f = 0; f < nFeat; f++) {
-			features[this->fi] = p_features[f];
-			this->fi++;
+		if (this->compact) {
+			for (int f = 0; f < nFeat; f++) {
+				this->codes[this->fi] = encode(f, static_cast<double>(p_features[f]));
+				this->fi++;
+			}
+		}
+		else {
+			for (int f = 0; f < nFeat; f++) {
+				features[this->fi] = p_features[f];
+				this->fi++;
+			}
 		}
 
-		this->x[this->count] = x;
-	       	this->y[this->count] = y;
+		if (this->packed) {
+			this->indices[this->count] = static_cast<uint32_t>(y) * static_cast<uint32_t>(this->width) + static_cast<uint32_t>(x);
+		}
+		else {
+			this->x[this->count] = x;
+			this->y[this->count] = y;
+		}
 		this->count++;
 
-		if (this->count == this->size) {
-			this->features.resize(this->features.size() + MILLION * this->nFeat);
-			this->x.resize(this->x.size() + MILLION);
-			this->y.resize(this->y.size() + MILLION);
-			this->size += MILLION;
+		if (this->count == static_cast<size_t>(this->size)) {
+			grow();
 		}	
 	}
 
@@ -164,7 +310,8 @@ class CLHSDataManager {
 	 * takes a feature vector (array) as a parameter alongside the x and y indices of the pixel
 	 * containing those features.
 	 *
-	 * The x, y, and features vectors are updated accordingly.
+	 * The x, y, and features vectors are updated accordingly. Existing samples are never
+	 * stored in compact mode, as there are few of them.
 	 *
 	 * @param T* p_features
 	 * @param int x
@@ -188,7 +335,8 @@ class CLHSDataManager {
 	 * matrix, which is calculated just after the raster reading finishes,
 	 * is passed as a parameter so that it can be saved.
 	 *
-	 * The x, y, and features vectors are resized.
+	 * The x, y, and features vectors are resized, and the unused capacity
+	 * is released.
 	 *
 	 * A mask, which is used along with the random number generator to 
 	 * generate random indices within the saved points, is generated.
@@ -210,9 +358,25 @@ class CLHSDataManager {
 		
 		this->corr = corr;
 
-		this->x.resize(this->count);
-		this->y.resize(this->count);
-		this->features.resize(this->count * nFeat);
+		if (this->packed) {
+			this->indices.resize(this->count);
+			this->indices.shrink_to_fit();
+		}
+		else {
+			this->x.resize(this->count);
+			this->y.resize(this->count);
+			this->x.shrink_to_fit();
+			this->y.shrink_to_fit();
+		}
+
+		if (this->compact) {
+			this->codes.resize(this->count * nFeat);
+			this->codes.shrink_to_fit();
+		}
+		else {
+			this->features.resize(this->count * nFeat);
+			this->features.shrink_to_fit();
+		}
 		this->ucount = static_cast<uint64_t>(this->count);
 
 		//use bit twiddling to fill the mask
@@ -227,7 +391,7 @@ class CLHSDataManager {
 		//resize existing sample vectors 
 		this->ex.resize(this->ecount);
 		this->ey.resize(this->ecount);
-		this->features.resize(this->ecount * nFeat);
+		this->efeatures.resize(this->ecount * nFeat);
 	}
 
 	/**
@@ -242,101 +406,369 @@ class CLHSDataManager {
 	 * The reason the generator is initially bit shifted by 11 is because
 	 * the type of generator used is not as random in the first 11 bits.
 	 *
+	 * The random number generator is passed so that multiple annealing chains
+	 * may each draw from the (read-only) pool with their own generator.
+	 *
+	 * @param xso::xoshiro_4x64_plus& rng
 	 * @returns uint64_t
 	 */
 	inline uint64_t
-	randomIndex() {
-		uint64_t index = ((*p_rng)() >> 11) & mask;
+	randomIndex(xso::xoshiro_4x64_plus& rng) const {
+		uint64_t index = (rng() >> 11) & mask;
 
 		while (index >= this->ucount) {
-			index = ((*p_rng)() >> 11) & mask;
+			index = (rng() >> 11) & mask;
 		}
 
 		return index;
 	}
 
 	/**
-	 * This function sets the x, y, and features pointer for a given index.
+	 * This function sets the x, y, and features pointer of a random point.
+	 *
+	 * In compact mode, the features are decoded into the values vector of
+	 * the point, so the features pointer is only valid until the point is
+	 * used again.
+	 *
+	 * @param Point<T>& point
+	 * @param xso::xoshiro_4x64_plus& rng
+	 */
+	inline void
+	getRandomPoint(Point<T>& point, xso::xoshiro_4x64_plus& rng) {
+		uint64_t index = randomIndex(rng);
+
+		if (this->compact) {
+			point.values.resize(nFeat);
+			const uint16_t *p_codes = this->codes.data() + (index * nFeat);
+			for (int f = 0; f < nFeat; f++) {
+				point.values[f] = static_cast<T>(this->lows[f] + this->steps[f] * p_codes[f]);
+			}
+			point.p_features = point.values.data();
+		}
+		else {
+			point.p_features = this->features.data() + (index * nFeat);
+		}
+
+		if (this->packed) {
+			point.x = static_cast<int>(this->indices[index] % static_cast<uint32_t>(this->width));
+			point.y = static_cast<int>(this->indices[index] / static_cast<uint32_t>(this->width));
+		}
+		else {
+			point.x = x[index];
+			point.y = y[index];
+		}
+	}
+
+	/**
+	 * This function sets the x, y, and features pointer of a random point, using
+	 * the random number generator passed to the constructor.
 	 *
 	 * @param Point<T>& point
-	 * @param uint64_t index
 	 */
 	inline void
 	getRandomPoint(Point<T>& point) {
-		uint64_t index = randomIndex();
+		getRandomPoint(point, *this->p_rng);
+	}
 
-		point.p_features = this->features.data() + (index * nFeat);
-		point.x = x[index];
-		point.y = y[index];
+	/**
+	 * Get the correlation matrix of the entire sample space, which was
+	 * passed to finalize().
+	 *
+	 * @returns std::vector<std::vector<T>>&
+	 */
+	inline std::vector<std::vector<T>>&
+	getCorrelation() {
+		return this->corr;
 	}
 
 	/**
-	 * This function calculates the output to the continuous objective function
-	 * for the clhs method. The goal of the clhs method is to have a latin hypercube
-	 * output of samples. This is defined as having a single sample between each quantile
-	 * of the hypercube for every feature. This function returns 0 if the sample is a 
-	 * latin hypercube, and the number of samples off if it is not. 
+	 * Copy features, x, and y vectors of the existing samples from CLHS data manager.
 	 *
-	 * The output of this function, along with the output of the correlation objective
-	 * function are used to determine whether a sample should be kept or not. Lower values
-	 * are better.
+	 * @param std::vector<T>& features
+	 * @param std::vector<int>& x
+	 * @param std::vector<int>& y
+	 */
+	inline void
+	getExistingFeatures(std::vector<T>& features, std::vector<int>& x, std::vector<int>& y) {
+		features = this->efeatures;
+		x = this->ex;
+		y = this->ey;
+	}
+};
+
+/**
+ * @ingroup clhs
+ * The number of accepted swaps, as a multiple of the sample size, after which the
+ * running sums of the CLHSObjective are recalculated from scratch. This bounds
+ * the accumulated floating point error of the incremental updates, while keeping
+ * the amortized cost of a swap O(nFeat^2).
+ */
+#define CLHS_OBJECTIVE_REFRESH 1
+
+/**
+ * @ingroup clhs
+ * This class evaluates the clhs objective function incrementally throughout the
+ * simulated annealing schedule. Since a single swap only changes one sample, there
+ * is no need to recalculate the objective function over every sample.
+ *
+ * QUANTILE OBJECTIVE:
+ * The quantile objective is the sum of |count - 1| over the sample count of every quantile
+ * of every feature. A swap changes at most two counts per feature, so the change in the
+ * objective function is calculated in O(nFeat).
+ *
+ * CORRELATION OBJECTIVE:
+ * The correlation objective is the sum of the absolute differences between the correlation
+ * matrix of the sample, and the correlation matrix of the entire sample space (which is
+ * stored by the CLHSDataManager). Rather than recalculating the correlation matrix of the
+ * sample, the sum of each feature and the sum of the product of every pair of features are
+ * stored. A swap subtracts the old sample and adds the new one, and the correlation matrix
+ * can be calculated directly from these sums. This is O(nFeat^2) rather than O(nSamp * nFeat^2).
+ *
+ * The sums are stored as doubles regardless of the raster type, and every feature is shifted
+ * by the mean of the initial sample to avoid catastrophic cancellation when the variance of a
+ * feature is small compared to its magnitude. To bound the error accumulated by many updates,
+ * the sums are recalculated once every CLHS_OBJECTIVE_REFRESH * nSamp accepted swaps.
+ *
+ * A swap is first proposed with propose(), which calculates the objective of the candidate
+ * sample without altering the current sums. The swap is then either accepted with accept(), 
+ * or rejected with reject().
+ */
+template <typename T>
+class CLHSObjective {
+	private:
+	size_t nFeat;
+	size_t nSamp;
+	std::vector<std::vector<T>>& corr;
+
+	std::vector<double> shift;
+	std::vector<double> sums;
+	std::vector<double> products;
+	std::vector<double> candidateSums;
+	std::vector<double> candidateProducts;
+
+	int objQ = 0;
+	int candidateObjQ = 0;
+	T objC = 0;
+	T candidateObjC = 0;
+	size_t accepted = 0;
+
+	/**
+	 * This function recalculates the sums and products of every feature in the
+	 * sample from scratch.
 	 *
-	 * @param std::vector<std::vector<int>>& sampleCountPerQuantile
+	 * @param const std::vector<T>& features
+	 */
+	inline void
+	calculateSums(const std::vector<T>& features) {
+		std::fill(this->sums.begin(), this->sums.end(), 0.0);
+		std::fill(this->products.begin(), this->products.end(), 0.0);
+
+		for (size_t si = 0; si < this->nSamp; si++) {
+			const T *p_features = features.data() + (si * this->nFeat);
+			for (size_t i = 0; i < this->nFeat; i++) {
+				double vi = static_cast<double>(p_features[i]) - this->shift[i];
+				this->sums[i] += vi;
+				for (size_t j = i; j < this->nFeat; j++) {
+					double vj = static_cast<double>(p_features[j]) - this->shift[j];
+					this->products[(i * this->nFeat) + j] += vi * vj;
+				}
+			}
+		}
+	}
+
+	/**
+	 * This function calculates the correlation objective function from a set of sums and
+	 * products. The correlation between two features is calculated as:
+	 * (n * sum(xy) - sum(x) * sum(y)) / sqrt((n * sum(xx) - sum(x)^2) * (n * sum(yy) - sum(y)^2))
+	 *
+	 * A feature without any variance within the sample has a correlation of 0 with every
+	 * other feature.
+	 *
+	 * @param const std::vector<double>& sums
+	 * @param const std::vector<double>& products
 	 * @returns T
 	 */
 	inline T
-	quantileObjectiveFunc(std::vector<int>& sampleCountPerQuantile) {
-		int retval = 0;
+	correlationObjective(const std::vector<double>& sums, const std::vector<double>& products) {
+		double n = static_cast<double>(this->nSamp);
+		double retval = 0;
+
+		for (size_t i = 0; i < this->nFeat; i++) {
+			double vari = n * products[(i * this->nFeat) + i] - sums[i] * sums[i];
+			retval += std::abs((vari > 0 ? 1.0 : 0.0) - static_cast<double>(this->corr[i][i]));
+
+			for (size_t j = i + 1; j < this->nFeat; j++) {
+				double varj = n * products[(j * this->nFeat) + j] - sums[j] * sums[j];
+				double cor = 0;
+				if (vari > 0 && varj > 0) {
+					cor = (n * products[(i * this->nFeat) + j] - sums[i] * sums[j]) / std::sqrt(vari * varj);
+				}
 
-		for (const int& count : sampleCountPerQuantile) {
-			retval += std::abs(count - 1);
+				//the correlation matrix is symmetric
+				retval += std::abs(cor - static_cast<double>(this->corr[i][j]));
+				retval += std::abs(cor - static_cast<double>(this->corr[j][i]));
+			}
 		}
 
 		return static_cast<T>(retval);
 	}
 
+	public:
 	/**
-	 * This function calculates the output to the objective function for the 
-	 * differences in the correlation matricies for the clhs method. This
-	 * function penalizes the sample for having features which are correlated
-	 * differently than the whole sample space.
+	 * Constructor, sizes the sum vectors. The correlation matrix of the entire sample
+	 * space is taken from the CLHSDataManager.
 	 *
-	 * The output of this function, along with the output of the quantile
-	 * objective function are used to determine whether as ample should be kept or not.
-	 * Lower values are better.
+	 * @param CLHSDataManager<T>& clhs
+	 * @param size_t nSamp
+	 * @param size_t nFeat
+	 */
+	CLHSObjective(CLHSDataManager<T>& clhs, size_t nSamp, size_t nFeat) : corr(clhs.getCorrelation()) {
+		this->nSamp = nSamp;
+		this->nFeat = nFeat;
+		this->shift.resize(nFeat, 0.0);
+		this->sums.resize(nFeat, 0.0);
+		this->products.resize(nFeat * nFeat, 0.0);
+		this->candidateSums.resize(nFeat, 0.0);
+		this->candidateProducts.resize(nFeat * nFeat, 0.0);
+	}
+
+	/**
+	 * This function calculates the objective function of the initial sample.
+	 *
+	 * @param const std::vector<T>& features
+	 * @param const std::vector<int>& sampleCountPerQuantile
+	 * @returns T
+	 */
+	inline T
+	init(const std::vector<T>& features, const std::vector<int>& sampleCountPerQuantile) {
+		for (size_t si = 0; si < this->nSamp; si++) {
+			for (size_t i = 0; i < this->nFeat; i++) {
+				this->shift[i] += static_cast<double>(features[(si * this->nFeat) + i]);
+			}
+		}
+		for (size_t i = 0; i < this->nFeat; i++) {
+			this->shift[i] /= static_cast<double>(this->nSamp);
+		}
+
+		calculateSums(features);
+
+		this->objQ = 0;
+		for (const int& count : sampleCountPerQuantile) {
+			this->objQ += std::abs(count - 1);
+		}
+		this->objC = correlationObjective(this->sums, this->products);
+		this->accepted = 0;
+
+		return static_cast<T>(this->objQ) + this->objC;
+	}
+
+	/**
+	 * This function calculates the objective function of the sample if the features
+	 * of one sample (p_old) were replaced by new features (p_new). The sample counts per
+	 * quantile are updated to reflect the new sample, as the annealing loop uses them to
+	 * find the most redundant sample. They are reverted if the swap is rejected.
 	 *
-	 * @param std::vector<std::vector<T>> corr
+	 * @param std::vector<int>& sampleCountPerQuantile
+	 * @param const T *p_old
+	 * @param const T *p_new
+	 * @param const std::vector<int>& oldq
+	 * @param const std::vector<int>& newq
 	 * @returns T
 	 */
 	inline T
-	correlationObjectiveFunc(std::vector<std::vector<T>>& corr) {
-		T retval = 0;
+	propose(
+		std::vector<int>& sampleCountPerQuantile, 
+		const T *p_old, 
+		const T *p_new, 
+		const std::vector<int>& oldq, 
+		const std::vector<int>& newq)
+	{
+		//update quantile counts, and the quantile objective by only the counts which change
+		this->candidateObjQ = this->objQ;
+		for (size_t f = 0; f < this->nFeat; f++) {
+			int& oldCount = sampleCountPerQuantile[(f * this->nSamp) + oldq[f]];
+			this->candidateObjQ += std::abs(oldCount - 2) - std::abs(oldCount - 1);
+			oldCount--;
+
+			int& newCount = sampleCountPerQuantile[(f * this->nSamp) + newq[f]];
+			this->candidateObjQ += std::abs(newCount) - std::abs(newCount - 1);
+			newCount++;
+		}
 
-		for (size_t i = 0; i < this->corr.size(); i++) {
-			for (size_t j = 0; j < this->corr[i].size(); j++) {
-				retval += std::abs(corr[i][j] - this->corr[i][j]);
+		//remove the old sample from, and add the new sample to, the sums and products
+		for (size_t i = 0; i < this->nFeat; i++) {
+			double oi = static_cast<double>(p_old[i]) - this->shift[i];
+			double ni = static_cast<double>(p_new[i]) - this->shift[i];
+			this->candidateSums[i] = this->sums[i] + ni - oi;
+
+			for (size_t j = i; j < this->nFeat; j++) {
+				double oj = static_cast<double>(p_old[j]) - this->shift[j];
+				double nj = static_cast<double>(p_new[j]) - this->shift[j];
+				size_t index = (i * this->nFeat) + j;
+				this->candidateProducts[index] = this->products[index] + ni * nj - oi * oj;
 			}
 		}
-	
-		return retval;
+
+		this->candidateObjC = correlationObjective(this->candidateSums, this->candidateProducts);
+		return static_cast<T>(this->candidateObjQ) + this->candidateObjC;
 	}
 
 	/**
-	 * Copy features, x, and y vectors from CLHS data manager.
+	 * This function accepts the most recently proposed swap. The features vector must
+	 * already contain the new sample.
 	 *
-	 * @param std::vector<T>& features
-	 * @param std::vector<int>& x
-	 * @param std::vector<int>& y
+	 * @param const std::vector<T>& features
 	 */
 	inline void
-	getExistingFeatures(std::vector<T>& features, std::vector<int>& x, std::vector<int>& y) {
-		features.resize(this->efeatures.size());
-		x.resize(this->ex.size());
-		y.resize(this->ey.size());
+	accept(const std::vector<T>& features) {
+		std::swap(this->sums, this->candidateSums);
+		std::swap(this->products, this->candidateProducts);
+		this->objQ = this->candidateObjQ;
+		this->objC = this->candidateObjC;
+
+		this->accepted++;
+		if (this->accepted == CLHS_OBJECTIVE_REFRESH * this->nSamp) {
+			calculateSums(features);
+			this->objC = correlationObjective(this->sums, this->products);
+			this->accepted = 0;
+		}
+	}
 
-		std::memcpy(features.data(), this->efeatures.data(), this->efeatures.size() * sizeof(T));
-		std::memcpy(x.data(), this->ex.data(), this->ex.size() * sizeof(int));
-		std::memcpy(y.data(), this->ey.data(), this->ey.size() * sizeof(int));
+	/**
+	 * This function rejects the most recently proposed swap, reverting the sample
+	 * counts per quantile.
+	 *
+	 * @param std::vector<int>& sampleCountPerQuantile
+	 * @param const std::vector<int>& oldq
+	 * @param const std::vector<int>& newq
+	 */
+	inline void
+	reject(std::vector<int>& sampleCountPerQuantile, const std::vector<int>& oldq, const std::vector<int>& newq) {
+		for (size_t f = 0; f < this->nFeat; f++) {
+			sampleCountPerQuantile[(f * this->nSamp) + newq[f]]--;
+			sampleCountPerQuantile[(f * this->nSamp) + oldq[f]]++;
+		}
+	}
+
+	/**
+	 * This function returns the quantile objective of the current sample, which is 0
+	 * if the sample is a latin hypercube.
+	 *
+	 * @returns int
+	 */
+	inline int
+	quantileObjective() {
+		return this->objQ;
+	}
+
+	/**
+	 * This function return the objective of the current sample.
+	 *
+	 * @returns T
+	 */
+	inline T
+	objective() {
+		return static_cast<T>(this->objQ) + this->objC;
 	}
 };
 
@@ -434,7 +866,6 @@ readRaster(
 	int xBlockSize = bands[0].xBlockSize;
 	int yBlockSize = bands[0].yBlockSize;
 
-	int xBlocks = (width + xBlockSize - 1) / xBlockSize;
 	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
 
 	double deps = .001;
@@ -446,10 +877,6 @@ readRaster(
 		quantileBuffers[i].resize(xBlockSize * yBlockSize);
 	}
 
-	if (access.used) {
-		access.band.p_buffer = VSIMalloc3(xBlockSize, yBlockSize, access.band.size); 
-	}
-
 	//create descriptor for correlation matrix streaming calculation with oneDAL
 	const auto cor_desc = oneapi::dal::covariance::descriptor{}.set_result_options(oneapi::dal::covariance::result_options::cor_matrix);
 	oneapi::dal::covariance::partial_compute_result<> partial_result;
@@ -493,152 +920,145 @@ readRaster(
 		}
 	}
 
-	int8_t *p_access = reinterpret_cast<int8_t *>(access.band.p_buffer);
-
 	bool calledEditStreamQuantiles = false;
-	void *p_data = reinterpret_cast<void *>(corrBuffer.data());
-
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			//get block size
-			int xValid, yValid;
-			bands[0].p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-
-			//read bands into memory
-			for (int i = 0; i < count ; i++) {
-				CPLErr err = bands[i].p_band->RasterIO(
-					GF_Read,
-					xBlock * xBlockSize,
-					yBlock * yBlockSize,
-					xValid,
-					yValid,
-					(void *)((size_t)p_data + i * size),
-					xValid,
-					yValid,
-					type,
-					size * static_cast<size_t>(count),
-					size * static_cast<size_t>(count) * static_cast<size_t>(xBlockSize) 
-				);
 
-				if (err) {
-					throw std::runtime_error("Error reading data from raster band.");
-				}
-			}
+	//the bands are read into an interleaved buffer, and the access band into it's own buffer,
+	//ahead of time on I/O threads while the current block is processed
+	std::vector<helper::RasterBandMetaData *> p_bands(count);
+	for (int i = 0; i < count; i++) {
+		p_bands[i] = &bands[i];
+	}
+	std::vector<reader::Window> windows = reader::blockWindows(xBlockSize, yBlockSize, width, height, 0, yBlocks);
+	reader::BlockReader blocks(p_bands, windows, xBlockSize, yBlockSize, type, size);
 
-			//calculate rand vals
-			rand.calculateRandValues();
+	std::unique_ptr<reader::BlockReader> p_accessBlocks;
+	if (access.used) {
+		p_accessBlocks = std::make_unique<reader::BlockReader>(
+			std::vector<helper::RasterBandMetaData *>{&access.band}, 
+			windows, 
+			xBlockSize, 
+			yBlockSize
+		);
+	}
 
-			//read access band into memory if used
-			if (access.used) {
-				rasterBandIO(access.band, access.band.p_buffer, xBlockSize, yBlockSize, xBlock, yBlock, xValid, yValid, true, false);
-			}
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+		int xBlock = p_block->window.xBlock;
+		int yBlock = p_block->window.yBlock;
+		int xValid = p_block->window.xValid;
+		int yValid = p_block->window.yValid;
 
-			//iterate through pixels
-			n = 0;
-			for (int y = 0; y < yValid; y++) {
-				int index = y * xBlockSize;
-				for (int x = 0; x < xValid; x++) {
-					bool isNan = false;
-					T *p_buff = corrBuffer.data() + (index * count);
-					for (int b = 0; b < count; b++) {
-						T val = p_buff[b];
-						isNan = std::isnan(val) || val == bands[b].nan;
-
-						if (isNan) {
-							break;
-						}	
-
-						quantileBuffers[b][n] = val;
-						corrBuffer[n * count + b] = val;
+		//calculate rand vals
+		rand.calculateRandValues();
+
+		//get access band block if used
+		int8_t *p_access = nullptr;
+		if (access.used) {
+			p_access = reinterpret_cast<int8_t *>(p_accessBlocks->next()->buffers[0]);
+		}
+
+		//iterate through pixels
+		n = 0;
+		for (int y = 0; y < yValid; y++) {
+			int index = y * xBlockSize;
+			for (int x = 0; x < xValid; x++) {
+				bool isNan = false;
+				T *p_buff = p_data + (index * count);
+				for (int b = 0; b < count; b++) {
+					T val = p_buff[b];
+					isNan = std::isnan(val) || val == bands[b].nan;
+
+					if (isNan) {
+						break;
 					}	
 
-					if (!isNan) {
-						n++;
-						
-						bool accessible = !access.used || p_access[index] != 1;
-
-						if (existing.used && existing.containsIndex(x + xBlock * xBlockSize, y + yBlock * yBlockSize)) {
-							clhs.addExistingPoint(
-								p_buff,
-								xBlock * xBlockSize + x,
-								yBlock * yBlockSize + y
-							);
-						}
-						else if (accessible && rand.next()) {
-							clhs.addPoint(
-								p_buff,
-								xBlock * xBlockSize + x,
-								yBlock * yBlockSize + y		
-							);
-						}
-					}
-					index++;
-				}
-			}
+					quantileBuffers[b][n] = val;
+					corrBuffer[n * count + b] = val;
+				}	
 
-			if (n == 0) {
-				continue;
-			}
+				if (!isNan) {
+					n++;
+					
+					bool accessible = !access.used || p_access[index] != 1;
 
-			//MKL functions have different versions for single/double precision floating point data
-			if (type == GDT_Float64) {
-				if (!calledEditStreamQuantiles) {
-					for (int i = 0; i < count; i++) {
-						//reinterpret cast the pointers for compiler reasons
-						status = vsldSSEditStreamQuantiles(
-							quantileTasks[i],
-							&quant_order_n,
-							reinterpret_cast<double *>(probabilities[i].data()),
-							reinterpret_cast<double *>(quantiles[i].data()),
-							&nparams,
-							&deps
+					if (existing.used && existing.containsIndex(x + xBlock * xBlockSize, y + yBlock * yBlockSize)) {
+						clhs.addExistingPoint(
+							p_buff,
+							xBlock * xBlockSize + x,
+							yBlock * yBlockSize + y
+						);
+					}
+					else if (accessible && rand.keep(index)) {
+						clhs.addPoint(
+							p_buff,
+							xBlock * xBlockSize + x,
+							yBlock * yBlockSize + y		
 						);
 					}
-					calledEditStreamQuantiles = true;
 				}
+				index++;
+			}
+		}
+
+		if (n == 0) {
+			continue;
+		}
+
+		//MKL functions have different versions for single/double precision floating point data
+		if (type == GDT_Float64) {
+			if (!calledEditStreamQuantiles) {
 				for (int i = 0; i < count; i++) {
-					status = vsldSSCompute(
+					//reinterpret cast the pointers for compiler reasons
+					status = vsldSSEditStreamQuantiles(
 						quantileTasks[i],
-						VSL_SS_STREAM_QUANTS,
-						VSL_SS_METHOD_SQUANTS_ZW_FAST
+						&quant_order_n,
+						reinterpret_cast<double *>(probabilities[i].data()),
+						reinterpret_cast<double *>(quantiles[i].data()),
+						&nparams,
+						&deps
 					);
 				}
+				calledEditStreamQuantiles = true;
 			}
-			else { //type == GDT_Float32
-				if (!calledEditStreamQuantiles) {
-					for (int i = 0; i < count; i++) {
-						//reinterpret cast the pointers for compiler reasons
-						status = vslsSSEditStreamQuantiles(
-							quantileTasks[i],
-							&quant_order_n,
-							reinterpret_cast<float *>(probabilities[i].data()),
-							reinterpret_cast<float *>(quantiles[i].data()),
-							&nparams,
-							&seps
-						);
-					}
-					calledEditStreamQuantiles = true;
-				}
-				for (int i = 0; i < count; i++) {	
-					status = vslsSSCompute(
+			for (int i = 0; i < count; i++) {
+				status = vsldSSCompute(
+					quantileTasks[i],
+					VSL_SS_STREAM_QUANTS,
+					VSL_SS_METHOD_SQUANTS_ZW_FAST
+				);
+			}
+		}
+		else { //type == GDT_Float32
+			if (!calledEditStreamQuantiles) {
+				for (int i = 0; i < count; i++) {
+					//reinterpret cast the pointers for compiler reasons
+					status = vslsSSEditStreamQuantiles(
 						quantileTasks[i],
-						VSL_SS_STREAM_QUANTS,
-						VSL_SS_METHOD_SQUANTS_ZW_FAST
+						&quant_order_n,
+						reinterpret_cast<float *>(probabilities[i].data()),
+						reinterpret_cast<float *>(quantiles[i].data()),
+						&nparams,
+						&seps
 					);
 				}
-
+				calledEditStreamQuantiles = true;
+			}
+			for (int i = 0; i < count; i++) {	
+				status = vslsSSCompute(
+					quantileTasks[i],
+					VSL_SS_STREAM_QUANTS,
+					VSL_SS_METHOD_SQUANTS_ZW_FAST
+				);
 			}
 
-			//update correlation matrix calculations
-			DALHomogenTable table = DALHomogenTable(corrBuffer.data(), n, count, [](const T *){}, oneapi::dal::data_layout::row_major);
-			partial_result = oneapi::dal::partial_compute(cor_desc, partial_result, table); 
 		}
-	}
 
-	if (access.used) {
-		VSIFree(access.band.p_buffer);
+		//update correlation matrix calculations
+		DALHomogenTable table = DALHomogenTable(corrBuffer.data(), n, count, [](const T *){}, oneapi::dal::data_layout::row_major);
+		partial_result = oneapi::dal::partial_compute(cor_desc, partial_result, table); 
 	}
 
+
 	//calculate and update clhs data manager with correlation matrix
 	auto result = oneapi::dal::finalize_compute(cor_desc, partial_result);
 	auto correlation = result.get_cor_matrix();
@@ -664,35 +1084,275 @@ readRaster(
 	clhs.finalize(corr);
 }
 
+/**
+ * @ingroup clhs
+ * The ratio between the temperatures of adjacent annealing chains when chains
+ * periodically exchange samples (parallel tempering). Chain c anneals at
+ * CLHS_TEMPERATURE_LADDER^c times the base temperature.
+ */
+#define CLHS_TEMPERATURE_LADDER 2.0
+
+/**
+ * @ingroup clhs
+ * This struct contains the state of a single simulated annealing chain, which
+ * is the sample itself, the quantile counts of the sample, and the incremental
+ * objective function. Chains only share the (read-only) pool of points in the 
+ * CLHSDataManager, so they can be annealed concurrently.
+ *
+ * Exceptions can't be thrown out of a thread pool, so any exception thrown while
+ * annealing the chain is stored and re-thrown once the threads have been joined.
+ */
+template <typename T>
+struct CLHSChain {
+	std::vector<T> features;
+	std::vector<int> x;
+	std::vector<int> y;
+	std::vector<int> sampleCountPerQuantile;
+	std::vector<int> quantilesOfEachSample;
+	std::unordered_set<uint64_t> points;
+	std::unique_ptr<CLHSObjective<T>> p_objective;
+	T obj = 0;
+	std::exception_ptr error = nullptr;
+};
+
+/**
+ * @ingroup clhs
+ * This function adds random samples from the pool of points to a chain, until
+ * the chain has nSamp samples. The first 'starti' samples of the chain are existing
+ * samples which must be kept. The objective function of the chain is then initialized.
+ *
+ * @param CLHSChain<T>& chain
+ * @param CLHSDataManager<T>& clhs
+ * @param std::vector<std::vector<T>>& quantiles
+ * @param xso::xoshiro_4x64_plus& rng
+ * @param size_t starti
+ * @param size_t nSamp
+ * @param size_t nFeat
+ */
+template <typename T>
+inline void
+initChain(
+	CLHSChain<T>& chain,
+	CLHSDataManager<T>& clhs,
+	std::vector<std::vector<T>>& quantiles,
+	xso::xoshiro_4x64_plus& rng,
+	size_t starti,
+	size_t nSamp,
+	size_t nFeat)
+{
+	chain.features.resize(nSamp * nFeat);
+	chain.x.resize(nSamp);
+	chain.y.resize(nSamp);
+
+	//get first random samples
+	size_t i = starti;
+	Point<T> p;
+	while (i < nSamp) {
+		clhs.getRandomPoint(p, rng);
+
+		if (chain.points.contains((((uint64_t) p.x) << 32) | ((uint64_t) p.y))) {
+			continue;
+		}
+
+		chain.x[i] = p.x;
+		chain.y[i] = p.y;
+		
+		for (size_t f = 0; f < nFeat; f++) {
+			T val = p.p_features[f];
+			chain.features[(i * nFeat) + f] = val;
+
+			int q = getQuantile<T>(val, quantiles[f]);
+			chain.sampleCountPerQuantile[(f * nSamp) + q]++;
+			chain.quantilesOfEachSample[(i * nFeat) + f] = q;
+		}
+
+		chain.points.insert((((uint64_t) p.x) << 32) | ((uint64_t) p.y));
+		i++;
+	}
+
+	//calculate the objective function of the initial sample
+	chain.p_objective = std::make_unique<CLHSObjective<T>>(clhs, nSamp, nFeat);
+	chain.obj = chain.p_objective->init(chain.features, chain.sampleCountPerQuantile);
+}
+
+/**
+ * @ingroup clhs
+ * This function runs the simulated annealing schedule of a single chain, from iteration
+ * 'begin' up to (but not including) iteration 'end'. The temperature at iteration i is 
+ * (1 - i / iterations) * scale. The chain stops early if it becomes a latin hypercube.
+ *
+ * The sample is constanty being updated and tested by replacing one of the samples. The old
+ * vs new samples are compared using the objective function, and the likelyhood that the sample
+ * is added (whether it's an improvement or not) depends both on a random probability, and the 
+ * tempreature which decreases after every iteration. Essentially, at the start of the algorithm
+ * it is far more likely that a sample may be accepted if it makes the objective function worse.
+ * The reason why the algorithm doesn't always accept an improvement and reject a decrease is to
+ * avoid finding a local maximum (which is not a global maximum). At the start of each iteration,
+ * there is also a 50% chance that the sample removed is NOT random, but removed from the quantile
+ * which has the most samples (essentially removing the 'worst' pixel).
+ *
+ * @param CLHSChain<T>& chain
+ * @param CLHSDataManager<T>& clhs
+ * @param std::vector<std::vector<T>>& quantiles
+ * @param xso::xoshiro_4x64_plus& rng
+ * @param size_t starti
+ * @param size_t nSamp
+ * @param size_t nFeat
+ * @param size_t iterations
+ * @param size_t begin
+ * @param size_t end
+ * @param double scale
+ */
+template <typename T>
+inline void
+annealChain(
+	CLHSChain<T>& chain,
+	CLHSDataManager<T>& clhs,
+	std::vector<std::vector<T>>& quantiles,
+	xso::xoshiro_4x64_plus& rng,
+	size_t starti,
+	size_t nSamp,
+	size_t nFeat,
+	size_t iterations,
+	size_t begin,
+	size_t end,
+	double scale)
+{
+	std::uniform_real_distribution<T> dist(0.0, 1.0);
+	std::uniform_int_distribution<size_t> indexDist(starti, nSamp - 1);
+
+	CLHSObjective<T>& objective = *chain.p_objective;
+	std::vector<T>& features = chain.features;
+	std::vector<int>& sampleCountPerQuantile = chain.sampleCountPerQuantile;
+	std::vector<int>& quantilesOfEachSample = chain.quantilesOfEachSample;
+
+	//features of old (before random new index) index
+	std::vector<T> oldf(nFeat);
+	std::vector<int> oldq(nFeat);
+
+	//reused by every iteration, so a compact pool decodes into the same buffer
+	Point<T> p;
+	std::vector<int> newq(nFeat);
+
+	//If we have a perfect latin hypercube -- or if we pass enough iterations -- stop iterating.
+	size_t iteration = begin;
+	for (; iteration < end && objective.quantileObjective() != 0; iteration++) {
+		double temp = (1.0 - static_cast<double>(iteration) / static_cast<double>(iterations)) * scale;
+
+		size_t i; //the index within the indices, x, y, and features vector so we know what to swap without searching
+		if (dist(rng) < 0.5) {
+			//50% of the time, choose a random sample to replace
+			i = indexDist(rng);
+		}
+		else {
+			//50% of the time, choose the worst sample to replace
+
+			//get the sample with the worst redundancy. In other words, the one which is in the
+			//most over-represented quantile across all features
+			size_t worstRedundancyIndex = 0;
+			size_t worstRedundancy = 0;
+			for (size_t si = starti; si < nSamp; si++) {
+				size_t curSampleRedundancy = 0;
+				for (size_t fi = 0; fi < nFeat; fi++) {
+					size_t q = quantilesOfEachSample[(si * nFeat) + fi];
+					curSampleRedundancy += sampleCountPerQuantile[(fi * nSamp) + q];
+				}
+				if (curSampleRedundancy > worstRedundancy) {
+					worstRedundancy = curSampleRedundancy;
+					worstRedundancyIndex = si;
+				}
+			}
+			i = worstRedundancyIndex;
+		}
+
+		//move selected replacement to 'oldf' vector to retain the old values in case we revert back
+		//to that state
+		std::memcpy(oldf.data(), features.data() + (i * nFeat), nFeat * sizeof(T));
+
+		//select a new index
+		clhs.getRandomPoint(p, rng);
+		while (chain.points.contains((((uint64_t) p.x) << 32) | ((uint64_t) p.y))) {
+			clhs.getRandomPoint(p, rng);
+		}
+
+		//move new features into feature vector
+		std::memcpy(features.data() + (i * nFeat), p.p_features, nFeat * sizeof(T));
+	
+		//get the quantiles of the old and new features
+		for (size_t f = 0; f < nFeat; f++) {
+			oldq[f] = getQuantile(oldf[f], quantiles[f]);
+			newq[f] = getQuantile(p.p_features[f], quantiles[f]);
+		}
+
+		//calculate the objective function of the new sample incrementally
+		T newObj = objective.propose(sampleCountPerQuantile, oldf.data(), p.p_features, oldq, newq);
+		T delta = newObj - chain.obj;
+
+		bool keep = dist(rng) < std::exp(-1 * delta / temp);
+
+		if (keep) {
+			//update the new changes
+			chain.points.erase((((uint64_t) chain.x[i]) << 32) | ((uint64_t) chain.y[i]));
+			chain.points.insert((((uint64_t) p.x) << 32) | ((uint64_t) p.y));
+
+			chain.x[i] = p.x;
+			chain.y[i] = p.y;
+		
+			std::memcpy(quantilesOfEachSample.data() + (i * nFeat), newq.data(), sizeof(int) * nFeat);
+
+			objective.accept(features);
+			chain.obj = objective.objective();
+		}
+		else {
+			//revert back to old changes
+			objective.reject(sampleCountPerQuantile, oldq, newq);
+
+			std::memcpy(
+				reinterpret_cast<void *>(features.data() + (i * nFeat)),
+				reinterpret_cast<void *>(oldf.data()),
+				nFeat * sizeof(T)
+			);
+		}
+	}
+
+	profile::addIterations(static_cast<int64_t>(iteration - begin));
+}
+
 /**
  * @ingroup clhs
  * This function is responsible for selecting the samples will be in the final sample
  * using the Conditioned Latin Hypercube Sampling (clhs) method. The CLHSDataManager
- * contains a pool of points which may be selected, as well as objective functions which
- * will calculate how good each sample is depending on the number of samples within
+ * contains a pool of points which may be selected, and the CLHSObjective incrementally 
+ * calculates how good each sample is depending on the number of samples within
  * each features quantiles, and how closely matching the correlation matrices are between
  * the sample compared to the entire sample space.
  *
- * The clhs method uses a simulated annealing algorithm, wherein the sample is constanty being
- * updated and tested by replacing one of the samples. The old vs new samples are compared usign
- * the objective functions, and the likelyhood that the sample is added (whether it's an improvement
- * or not) depends both on a random probability, and the tempreature parameter which decreases after
- * every iteration. Essentially, at the start of the algorithm it is far more likely that a sample
- * may be accepted if it makes the objective function worse. The reason why the algorithm doesn't always
- * accept an improvement and reject a decrease is to avoid finding a local maximum (which is not a
- * global maximum). At the start of each iteration, there is also a 50% chance that the sample removed
- * is NOT random, but removed from the quantile which has the most samples (essentially removing the 
- * 'worst' pixel).
+ * First, existing samples are added, and up to 'replace' of the most redundant existing
+ * samples are removed. The remaining existing samples are written to the output layer.
+ *
+ * Then, 'chains' independent simulated annealing chains (see annealChain()) are run in a 
+ * thread pool, each starting from its own random sample and using its own random number 
+ * generator. The pool of points is shared between the chains, and is only read. 
+ *
+ * If 'exchange' is greater than 0, the chains anneal at increasing temperatures 
+ * (see CLHS_TEMPERATURE_LADDER) and every 'exchange' iterations adjacent chains may swap 
+ * their samples using the parallel tempering criterion. This lets a cold chain escape a
+ * local minimum by taking the sample of a hotter chain.
  *
- * Once all of the samples are chosen, they are added to the output layer and the function completes.
+ * Once all of the chains are finished, the samples of the chain with the lowest objective
+ * are added to the output layer and the function completes.
  *
  * @param std::vector<std::vector<T>>& quantiles
+ * @param CLHSDataManager<T>& clhs
  * @param xso::xoshiro_4x64_plus& rng
  * @param existing::Existing& existing
  * @param int replace
  * @param int iterations
  * @param int nSamp
  * @param int nFeat
+ * @param int chains
+ * @param int exchange
+ * @param int threads
  * @param OGRLayer *p_layer
  * @param double *GT
  * @param bool plot
@@ -709,6 +1369,9 @@ selectSamples(std::vector<std::vector<T>>& quantiles,
 	      size_t iterations,
 	      size_t nSamp,
 	      size_t nFeat,
+	      size_t chains,
+	      size_t exchange,
+	      int threads,
 	      OGRLayer *p_layer,
 	      double *GT,
 	      bool plot,
@@ -814,184 +1477,102 @@ selectSamples(std::vector<std::vector<T>>& quantiles,
 		return;
 	}
 
-	std::uniform_real_distribution<T> dist(0.0, 1.0);
-	std::uniform_int_distribution<size_t> indexDist(starti, nSamp - 1);
-
-	std::vector<std::vector<T>> corr(nFeat);
-	for (int i = 0; i < nFeat; i++) {
-		corr[i].resize(nFeat);
-	}
-
-	features.resize(nSamp * nFeat);
-	x.resize(nSamp);
-	y.resize(nSamp);
-
-	//get first random samples
-	int i = starti;
-	Point<T> p;
-	while (i < nSamp) {
-		clhs.getRandomPoint(p);
-
-		if (points.contains((((uint64_t) p.x) << 32) | ((uint64_t) p.y))) {
-			continue;
-		}
-
-		x[i] = p.x;
-		y[i] = p.y;
-		
-		for (int f = 0; f < nFeat; f++) {
-			T val = p.p_features[f];
-			features[(i * nFeat) + f] = val;
-
-			int q = getQuantile<T>(val, quantiles[f]);
-			sampleCountPerQuantile[(f * nSamp) + q]++;
-			quantilesOfEachSample[(i * nFeat) + f] = q;
-		}
-
-		points.insert((((uint64_t) p.x) << 32) | ((uint64_t) p.y));
-		i++;
+	//every chain starts with the kept existing samples, and has its own random number generator.
+	//The first chain uses the generator which was used to build the pool.
+	features.resize(starti * nFeat);
+	x.resize(starti);
+	y.resize(starti);
+
+	std::vector<CLHSChain<T>> chainStates(chains);
+	std::vector<xso::xoshiro_4x64_plus> rngs(chains);
+	rngs[0] = rng;
+	for (CLHSChain<T>& chain : chainStates) {
+		chain.features = features;
+		chain.x = x;
+		chain.y = y;
+		chain.sampleCountPerQuantile = sampleCountPerQuantile;
+		chain.quantilesOfEachSample = quantilesOfEachSample;
+		chain.points = points;
 	}
 
-	//define covariance calculation 
-	DALHomogenTable table = DALHomogenTable(features.data(), nSamp, nFeat, [](const T *){}, oneapi::dal::data_layout::row_major);
-	const auto cor_desc = oneapi::dal::covariance::descriptor{}.set_result_options(oneapi::dal::covariance::result_options::cor_matrix);		
-	const auto result = oneapi::dal::compute(cor_desc, table);
-	oneapi::dal::row_accessor<const T> acc {result.get_cor_matrix()};
-	for (int i = 0; i < nFeat; i++) {
-		auto row = acc.pull({i, i + 1});
-
-		for (int j = 0; j < nFeat; j++) {
-			corr[i][j] = row[j];
+	//the temperature of each chain, relative to the base annealing schedule
+	std::vector<double> scales(chains, 1.0);
+	if (exchange != 0) {
+		for (size_t c = 1; c < chains; c++) {
+			scales[c] = scales[c - 1] * CLHS_TEMPERATURE_LADDER;
 		}
 	}
 
-	double temp = 1;
-	double d = temp / static_cast<double>(iterations);
-
-	T obj = 0;
-	T objQ = clhs.quantileObjectiveFunc(sampleCountPerQuantile);
-	T objC = clhs.correlationObjectiveFunc(corr);
-
-	obj = objQ + objC;
-
-	//features of old (before random new index) index
-	std::vector<T> oldf(nFeat);
-
-	//begin annealing schedule. If we have a perfect latin hypercube -- or if we pass enough iterations -- stop iterating.
-	while (temp > 0 && objQ != 0) {
-		size_t i; //the index within the indices, x, y, and features vector so we know what to swap without searching
-		if (dist(rng) < 0.5) {
-			//50% of the time, choose a random sample to replace
-			i = indexDist(rng);
-		}
-		else {
-			//50% of the time, choose the worst sample to replace
-
-			//get the sample with the worst redundancy. In other words, the one which is in the
-			//most over-represented quantile across all features
-			size_t worstRedundancyIndex = 0;
-			size_t worstRedundancy = 0;
-			for (size_t si = starti; si < nSamp; si++) {
-				size_t curSampleRedundancy = 0;
-				for (size_t fi = 0; fi < nFeat; fi++) {
-					size_t q = quantilesOfEachSample[(si * nFeat) + fi];
-					curSampleRedundancy += sampleCountPerQuantile[(fi * nSamp) + q];
+	//without exchange between chains, the annealing schedule is run all at once
+	size_t round = (exchange != 0 && chains > 1) ? exchange : std::max(iterations, static_cast<size_t>(1));
+	threads = static_cast<int>(std::min(static_cast<size_t>(threads), chains));
+
+	std::uniform_real_distribution<double> exchangeDist(0.0, 1.0);
+	bool init = true;
+
+	for (size_t begin = 0; begin < iterations || init; begin += round) {
+		size_t end = std::min(iterations, begin + round);
+
+		boost::asio::thread_pool pool(threads);
+		for (size_t c = 0; c < chains; c++) {
+			CLHSChain<T> *p_chain = &chainStates[c];
+			xso::xoshiro_4x64_plus *p_rng = &rngs[c];
+			double scale = scales[c];
+
+			boost::asio::post(pool, [
+				p_chain, p_rng, scale, init, begin, end, starti, nSamp, nFeat, iterations, 
+				&clhs, &quantiles
+			] {
+				try {
+					if (init) {
+						initChain<T>(*p_chain, clhs, quantiles, *p_rng, starti, nSamp, nFeat);
+					}
+					annealChain<T>(*p_chain, clhs, quantiles, *p_rng, starti, nSamp, nFeat, iterations, begin, end, scale);
 				}
-				if (curSampleRedundancy > worstRedundancy) {
-					worstRedundancy = curSampleRedundancy;
-					worstRedundancyIndex = si;
+				catch (...) {
+					p_chain->error = std::current_exception();
 				}
-			}
-			i = worstRedundancyIndex;
-		}
-
-		//move selected replacement to 'oldf' vector to retain the old values in case we revert back
-		//to that state
-		std::memcpy(oldf.data(), features.data() + (i * nFeat), nFeat * sizeof(T));
-
-		//select a new index
-		Point<T> p;
-		clhs.getRandomPoint(p);
-		while (points.contains((((uint64_t) p.x) << 32) | ((uint64_t) p.y))) {
-			clhs.getRandomPoint(p);
-		}
-
-		//move new features into feature vector
-		std::memcpy(features.data() + (i * nFeat), p.p_features, nFeat * sizeof(T));
-	
-		//recalculate sample count per quantile
-		std::vector<int> oldq(nFeat);
-		std::vector<int> newq(nFeat);
-		for (int f = 0; f < nFeat; f++) {
-			//decrement based removal of on old features
-			int q = getQuantile(oldf[f], quantiles[f]);
-			oldq[f] = q;
-			sampleCountPerQuantile[(f * nSamp) + q]--;
-
-			//increment based on inputof new features
-			q = getQuantile(p.p_features[f], quantiles[f]);
-			newq[f] = q;
-			sampleCountPerQuantile[(f * nSamp) + q]++;
+			});
 		}
+		pool.join();
+		init = false;
 
-		//recalculate objective function from quantiles
-		T newObjQ = clhs.quantileObjectiveFunc(sampleCountPerQuantile);
-		
-		//recalculate correlation matrix
-		const auto result = oneapi::dal::compute(cor_desc, table); // we update the table in place
-		oneapi::dal::row_accessor<const T> acc {result.get_cor_matrix()};
-		for (int j = 0; j < nFeat; j++) {
-			auto row = acc.pull({j, j + 1});
-
-			for (int k = 0; k < nFeat; k++) {
-				corr[j][k] = row[k];
+		for (CLHSChain<T>& chain : chainStates) {
+			if (chain.error) {
+				std::rethrow_exception(chain.error);
 			}
 		}
 
-		//recalculate objective function from correlation matrix
-		T newObjC = clhs.correlationObjectiveFunc(corr);
-
-		T newObj = newObjQ + newObjC;
-		T delta = newObj - obj;
-
-		bool keep = dist(rng) < std::exp(-1 * delta / temp);
-
-		if (keep) {
-			//update the new changes
-			points.erase((((uint64_t) x[i]) << 32) | ((uint64_t) y[i]));
-			points.insert((((uint64_t) p.x) << 32) | ((uint64_t) p.y));
-
-			x[i] = p.x;
-			y[i] = p.y;
-		
-			std::memcpy(quantilesOfEachSample.data() + (i * nFeat), newq.data(), sizeof(int) * nFeat);
-
-			objC = newObjC;
-			objQ = newObjQ;
-			obj = newObj;
-		}
-		else {
-			//revert back to old changes
-			for (int f = 0; f < nFeat; f++) {
-				sampleCountPerQuantile[(f * nSamp) + newq[f]]--;
-				sampleCountPerQuantile[(f * nSamp) + oldq[f]]++;
+		//parallel tempering: adjacent chains swap samples with probability 
+		//min(1, exp((obj_c - obj_c+1) * (1 / temp_c - 1 / temp_c+1)))
+		double temp = 1.0 - static_cast<double>(end) / static_cast<double>(iterations);
+		if (exchange != 0 && end < iterations && temp > 0) {
+			for (size_t c = (begin / round) % 2; c + 1 < chains; c += 2) {
+				double beta = 1.0 / (temp * scales[c]);
+				double nbeta = 1.0 / (temp * scales[c + 1]);
+				double delta = static_cast<double>(chainStates[c].obj - chainStates[c + 1].obj) * (beta - nbeta);
+
+				if (exchangeDist(rng) < std::exp(delta)) {
+					std::swap(chainStates[c], chainStates[c + 1]);
+				}
 			}
-
-			std::memcpy(
-				reinterpret_cast<void *>(features.data() + (i * nFeat)),
-				reinterpret_cast<void *>(oldf.data()),
-				nFeat * sizeof(T)
-			);
 		}
+	}
 
-		//update annealing temperature
-		temp -= d;
+	//take the samples of the chain with the best (lowest) objective
+	size_t best = 0;
+	for (size_t c = 1; c < chains; c++) {
+		if (chainStates[c].obj < chainStates[best].obj) {
+			best = c;
+		}
 	}
+	std::vector<int>& bestx = chainStates[best].x;
+	std::vector<int>& besty = chainStates[best].y;
 
 	//add samples to output layer
 	helper::Field fieldExistingFalse("existing", 0);
-	for (int i = starti ; i < nSamp; i++) {
-		const auto [xCoord, yCoord] = helper::sample_to_point(GT, x[i], y[i]);
+	for (size_t i = starti ; i < nSamp; i++) {
+		const auto [xCoord, yCoord] = helper::sample_to_point(GT, bestx[i], besty[i]);
 		OGRPoint point = OGRPoint(xCoord, yCoord);
 		existing.used ? 
 			helper::addPoint(&point, p_layer, &fieldExistingFalse) :
@@ -1028,6 +1609,12 @@ selectSamples(std::vector<std::vector<T>>& quantiles,
  * @param std::string layerName
  * @param double buffInner
  * @param double buffOuter
+ * @param GDALVectorWrapper *p_existing
+ * @param size_t replace
+ * @param int chains
+ * @param int exchange
+ * @param int threads
+ * @param bool compact
  * @param bool plot
  * @param std::string tempFolder
  * @param std::string filename
@@ -1044,11 +1631,16 @@ clhs(
 	double buffOuter,
 	vector::GDALVectorWrapper *p_existing,
 	size_t replace,
+	int chains,
+	int exchange,
+	int threads,
+	bool compact,
 	bool plot,
 	std::string tempFolder,
 	std::string filename)
 {
 	GDALAllRegister();
+	profile::Scope phases(profile::SETUP);
 
 	int width = p_raster->getWidth();
 	int height = p_raster->getHeight();
@@ -1091,7 +1683,8 @@ clhs(
 		true,
 		tempFolder,
 		bands[0].xBlockSize,
-		bands[0].yBlockSize
+		bands[0].yBlockSize,
+		threads
 	);
 
 	existing::Existing existing(
@@ -1134,27 +1727,32 @@ clhs(
 		std::vector<std::vector<double>> quantiles;
 		
 		//create instance of data management class
-		CLHSDataManager<double> clhs(nFeat, nSamp, &rng, existing.count());
+		CLHSDataManager<double> clhs(nFeat, nSamp, &rng, existing.count(), compact, width, height);
 
 		//read raster, calculating quantiles, correlation matrix, and adding points to sample from.
+		phases.next(profile::SCAN);
 		readRaster<double>(bands, clhs, access, existing, rand, type, quantiles, sizeof(double), width, height, nFeat, nSamp);
 
 		//select samples and add them to output layer
-		selectSamples<double>(quantiles, clhs, rng, existing, replace, iterations, nSamp, nFeat, p_layer, GT, plot, xCoords, yCoords);
+		phases.next(profile::ANNEAL);
+		selectSamples<double>(quantiles, clhs, rng, existing, replace, iterations, nSamp, nFeat, chains, exchange, threads, p_layer, GT, plot, xCoords, yCoords);
 	}
 	else { //type == GDT_Float32	
 		std::vector<std::vector<float>> quantiles;
 
 		//create instance of data management class
-		CLHSDataManager<float> clhs(nFeat, nSamp, &rng, existing.count());
+		CLHSDataManager<float> clhs(nFeat, nSamp, &rng, existing.count(), compact, width, height);
 
 		//read raster, calculating quantiles, correlation matrix, and adding points to sample from.
+		phases.next(profile::SCAN);
 		readRaster<float>(bands, clhs, access, existing, rand, type, quantiles, sizeof(float), width, height, nFeat, nSamp);
 
 		//select samples and add them to output layer
-		selectSamples<float>(quantiles, clhs, rng, existing, replace, iterations, nSamp, nFeat, p_layer, GT, plot, xCoords, yCoords);
+		phases.next(profile::ANNEAL);
+		selectSamples<float>(quantiles, clhs, rng, existing, replace, iterations, nSamp, nFeat, chains, exchange, threads, p_layer, GT, plot, xCoords, yCoords);
 	}
 
+	phases.next(profile::OUTPUT);
 	if (filename != "") {
 		try {
 			p_wrapper->write(filename);
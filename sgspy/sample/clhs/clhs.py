@@ -15,6 +15,7 @@ import os
 import sys
 import site
 import tempfile
+from contextlib import nullcontext
 from typing import Optional
 import warnings
 
@@ -25,6 +26,7 @@ from sgspy.utils import (
     SpatialRaster,
     SpatialVector,
     plot,
+    profile,
 )
 
 #ensure _sgs binary can be found
@@ -61,6 +63,28 @@ from _sgs import clhs_cpp
 # which are in the most over-represented areas of the sample space. There may be less than 'replace'
 # number of samples replaced, if each point in the remaining existing samples is not over-represented at all.
 #
+# The 'chains' parameter specifies the number of independent simulated annealing chains, which are run
+# in parallel on up to 'thread_count' threads. Every chain draws from the same pool of pixels, and the
+# samples of the chain with the best objective are returned. If 'exchange_interval' is greater than 0,
+# the chains are run at increasing temperatures and adjacent chains may exchange their samples every
+# 'exchange_interval' iterations (parallel tempering).
+#
+# The 'compact' parameter reduces the memory used by the pool of pixels which the samples are chosen
+# from. Each feature is stored as a 16 bit code within the range of the band's values, and pixel
+# coordinates are packed into a single 32 bit index. This cuts memory use of the pool by 2-4x, which
+# allows large rasters with many bands to be sampled on machines with limited memory, at the cost of
+# a small loss in precision (at most 1/32768 of the band's range) of the feature values used by the
+# annealing objective.
+#
+# The 'overview' parameter builds the pool of pixels from an overview of the raster (see
+# SpatialRaster.overview()) rather than every pixel, which reads only a fraction of a large
+# or remote raster. The samples are then located at the centres of overview pixels, and the
+# quantiles which define the latin hypercube are those of the overview. If the overview was
+# built with nearest neighbour resampling, with n overview pixels the rank of each of those
+# quantiles is within about sqrt(ln(2 / a) / 2n) of its exact rank (as a fraction of the
+# pixels) with probability 1 - a. Overviews built by averaging narrow the range of each
+# band, and have no such bound.
+#
 # The output is an object of type sgspy.SpatialVector which contains the chosen sample points.
 #
 # Examples
@@ -87,6 +111,9 @@ from _sgs import clhs_cpp
 # existing = sgspy.SpatialVector("existing_network.shp") @n
 # samples = sgspy.sample.clhs(rast, num_samples=250, existing=existing, replace=100)
 #
+# rast = sgspy.SpatialRaster("raster.tif") @n
+# samples = sgspy.sample.clhs(rast, num_samples=250, chains=8, exchange_interval=500)
+#
 # Parameters
 # --------------------
 # rast : SpatialRaster @n
@@ -107,14 +134,27 @@ from _sgs import clhs_cpp
 #     a vector specifying an existing sample network @n @n
 # replace : int @n
 #     the number of existing sample plots which it is okay to remove and replace @n @n
+# chains : int @n
+#     the number of simulated annealing chains to run, the best of which is returned @n @n
+# exchange_interval : int @n
+#     the number of iterations between sample exchanges of adjacent chains, or 0 for independent chains @n @n
+# thread_count : int @n
+#     the number of threads to run the chains on @n @n
+# compact : bool @n
+#     whether to store the pool of pixels in a compact reduced precision form @n @n
+# overview : Optional[int] @n
+#     the overview level to build the pool of pixels from, or None to use every pixel @n @n
 # plot : bool @n
 #     whether to plot the output samples or not @n @n
 # filename : str @n
 #     the filename to write to, or '' if file should not be written @n @n
+# stats : bool @n
+#     whether to also return a dict of where time was spent, see sgspy.profile @n @n
 #
 # Returns
 # --------------------
-# a SpatialVector object containing point geometries of sample locations
+# a SpatialVector object containing point geometries of sample locations, and a stats dict
+# if stats is True
 def clhs(
     rast: SpatialRaster,
     num_samples: int,
@@ -125,8 +165,14 @@ def clhs(
     buff_outer: Optional[int | float] = None,
     existing: Optional[SpatialVector] = None,
     replace: int = None,
+    chains: int = 1,
+    exchange_interval: int = 0,
+    thread_count: int = 8,
+    compact: bool = False,
     plot: bool = False,
-    filename: str = ''):
+    filename: str = '',
+    overview: Optional[int] = None,
+    stats: bool = False):
         
     if type(rast) is not SpatialRaster:
         raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster.")
@@ -155,18 +201,45 @@ def clhs(
     if replace is not None and type(replace) is not int:
         raise TypeError("'replace' parameter, if given, must be of type int.")
 
+    if type(chains) is not int:
+        raise TypeError("'chains' parameter must be of type int.")
+
+    if type(exchange_interval) is not int:
+        raise TypeError("'exchange_interval' parameter must be of type int.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if type(compact) is not bool:
+        raise TypeError("'compact' parameter must be of type bool.")
+
     if type(plot) is not bool:
         raise TypeError("'plot' parameter must be of type bool.")
 
     if type(filename) is not str:
         raise TypeError("'filename' parameter must be of type str.")
 
+    if type(stats) is not bool:
+        raise TypeError("'stats' parameter must be of type bool.")
+
+    if overview is not None and type(overview) is not int:
+        raise TypeError("'overview' parameter, if given, must be of type int.")
+
     if rast.closed:
             raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
 
     if num_samples < 1:
         raise ValueError("num_samples must be greater than 0")
 
+    if chains < 1:
+        raise ValueError("'chains' parameter must be greater than 0.")
+
+    if exchange_interval < 0:
+        raise ValueError("'exchange_interval' parameter can't be less than 0.")
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
     if (access):
         if layer_name is None:
             if len(access.layers) > 1:
@@ -202,26 +275,32 @@ def clhs(
 
     existing_vector = existing.cpp_vector if existing else None
 
+    pool_rast = rast if overview is None else rast.overview(overview)
 
-    temp_dir = rast.cpp_raster.get_temp_dir()
+    temp_dir = pool_rast.cpp_raster.get_temp_dir()
     if temp_dir == "":
         temp_dir = tempfile.mkdtemp()
-        rast.cpp_raster.set_temp_dir(temp_dir)
-
-    [sample_coordinates, cpp_vector] = clhs_cpp(
-        rast.cpp_raster,
-        num_samples,
-        iterations,
-        access_vector,
-        layer_name,
-        buff_inner,
-        buff_outer,
-        existing_vector,
-        replace,
-        plot,
-        temp_dir,
-        filename
-    )
+        pool_rast.cpp_raster.set_temp_dir(temp_dir)
+
+    with profile() if stats else nullcontext() as run_stats:
+        [sample_coordinates, cpp_vector] = clhs_cpp(
+            pool_rast.cpp_raster,
+            num_samples,
+            iterations,
+            access_vector,
+            layer_name,
+            buff_inner,
+            buff_outer,
+            existing_vector,
+            replace,
+            chains,
+            exchange_interval,
+            thread_count,
+            compact,
+            plot,
+            temp_dir,
+            filename
+        )
 
     #plot new vector if requested
     if plot:
@@ -241,4 +320,8 @@ def clhs(
         except Exception as e:
             print("unable to plot output: " + str(e))
 
-    return SpatialVector(cpp_vector)
+    samples = SpatialVector(cpp_vector)
+    if not stats:
+        return samples
+
+    return samples, run_stats
@@ -0,0 +1,297 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: C++ implementation of nearest centroid sampling
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup nc nc
+ * @ingroup sample
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+#include "stratify/kmeans/kmeans.h"
+#include "utils/access.h"
+#include "utils/helper.h"
+#include "utils/hypercube.h"
+#include "utils/raster.h"
+#include "utils/vector.h"
+
+namespace sgs {
+namespace nc {
+
+/**
+ * @ingroup nc
+ * A candidate sample, as the squared distance between the standardized features
+ * of the pixel and it's centroid, and the index of the pixel. Candidates are compared
+ * by distance then by index, so the selected samples do not depend on the order in
+ * which the chunks of the raster are read.
+ */
+template <typename T>
+using Candidate = std::pair<T, int64_t>;
+
+/**
+ * @ingroup nc
+ * A max heap of the k nearest candidates of a centroid, where the furthest candidate
+ * is on top so it can be replaced when a nearer one is found.
+ */
+template <typename T>
+using CandidateHeap = std::priority_queue<Candidate<T>>;
+
+/**
+ * @ingroup nc
+ * Push a candidate onto a heap which holds at most k candidates.
+ *
+ * @param CandidateHeap<T>& heap
+ * @param Candidate<T> candidate
+ * @param int k
+ */
+template <typename T>
+inline void
+pushCandidate(CandidateHeap<T>& heap, Candidate<T> candidate, int k) {
+	if (static_cast<int>(heap.size()) < k) {
+		heap.push(candidate);
+	}
+	else if (candidate < heap.top()) {
+		heap.pop();
+		heap.push(candidate);
+	}
+}
+
+/**
+ * @ingroup nc
+ * This function selects the samples of nearest centroid sampling for a particular
+ * floating point type T, see nc().
+ *
+ * @returns std::tuple<std::vector<std::vector<double>>, GDALVectorWrapper *, size_t, std::vector<std::vector<double>>, std::vector<int>>
+ */
+template <typename T>
+std::tuple<std::vector<std::vector<double>>, vector::GDALVectorWrapper *, size_t, std::vector<std::vector<double>>, std::vector<int>>
+ncImpl(
+	raster::GDALRasterWrapper *p_raster,
+	std::vector<helper::RasterBandMetaData>& bands,
+	GDALDataType type,
+	int numSamples,
+	int k,
+	int64_t poolSize,
+	int maxIterations,
+	double accuracy,
+	bool scale,
+	vector::GDALVectorWrapper *p_access,
+	std::string layerName,
+	double buffInner,
+	double buffOuter,
+	bool plot,
+	std::string tempFolder,
+	std::string filename,
+	int threads)
+{
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+	double *GT = p_raster->getGeotransform();
+	int nFeat = static_cast<int>(bands.size());
+
+	std::vector<double> xCoords, yCoords;
+
+	//create output dataset before doing anything which will take a long time in case of failure.
+	GDALDriver *p_driver = GetGDALDriverManager()->GetDriverByName("MEM");
+	if (!p_driver) {
+		throw std::runtime_error("unable to create output sample dataset driver.");
+	}
+	GDALDataset *p_samples = p_driver->Create("", 0, 0, 0, GDT_Unknown, nullptr);
+	if (!p_samples) {
+		throw std::runtime_error("unable to create output dataset with driver.");
+	}
+
+	vector::GDALVectorWrapper *p_wrapper = new vector::GDALVectorWrapper(p_samples, std::string(p_raster->getDataset()->GetProjectionRef()));
+	OGRLayer *p_layer = p_samples->CreateLayer("samples", p_wrapper->getSRS(), wkbPoint, nullptr);
+	if (!p_layer) {
+		throw std::runtime_error("unable to create output dataset layer.");
+	}
+
+	std::mutex accessMutex;
+	access::Access access(
+		p_access,
+		p_raster,
+		layerName,
+		buffInner,
+		buffOuter,
+		true,
+		tempFolder,
+		bands[0].xBlockSize,
+		bands[0].yBlockSize,
+		threads
+	);
+	access.band.p_mutex = &accessMutex;
+
+	//step 1: train the k-means model on a random pool of the raster
+	std::vector<T> centroids, offsets, scales;
+	std::vector<std::vector<double>> retCentroids = kmeans::train<T>(
+		bands, type, numSamples, poolSize, maxIterations, accuracy, scale,
+		p_raster->getPixelWidth(), p_raster->getPixelHeight(), width, height, threads,
+		centroids, offsets, scales
+	);
+
+	//step 2: find the k nearest accessible member pixels of every centroid
+	int chunks = hypercube::chunkCount(height, bands[0].yBlockSize, threads);
+	std::vector<std::vector<CandidateHeap<T>>> chunkHeaps(chunks, std::vector<CandidateHeap<T>>(numSamples));
+	hypercube::forEachPixel<T>(bands, access.used ? &access.band : nullptr, width, height, threads, [&](int chunk, const T *p_features, int x, int y, bool accessible) {
+		if (!accessible) {
+			return;
+		}
+
+		int nearest = 0;
+		T nearestDist = std::numeric_limits<T>::max();
+		for (int c = 0; c < numSamples; c++) {
+			const T *p_centroid = centroids.data() + static_cast<size_t>(c) * nFeat;
+			T dist = 0;
+			for (int b = 0; b < nFeat; b++) {
+				T diff = (p_features[b] - offsets[b]) / scales[b] - p_centroid[b];
+				dist += diff * diff;
+			}
+
+			if (dist < nearestDist) {
+				nearestDist = dist;
+				nearest = c;
+			}
+		}
+
+		pushCandidate<T>(chunkHeaps[chunk][nearest], {nearestDist, static_cast<int64_t>(y) * width + x}, k);
+	});
+
+	for (int chunk = 1; chunk < chunks; chunk++) {
+		for (int c = 0; c < numSamples; c++) {
+			CandidateHeap<T>& heap = chunkHeaps[chunk][c];
+			while (!heap.empty()) {
+				pushCandidate<T>(chunkHeaps[0][c], heap.top(), k);
+				heap.pop();
+			}
+		}
+	}
+
+	//step 3: add the samples of every centroid, nearest first
+	std::vector<int> clusters;
+	size_t added = 0;
+	for (int c = 0; c < numSamples; c++) {
+		CandidateHeap<T>& heap = chunkHeaps[0][c];
+		std::vector<int64_t> pixels;
+		while (!heap.empty()) {
+			pixels.push_back(heap.top().second);
+			heap.pop();
+		}
+		std::reverse(pixels.begin(), pixels.end());
+
+		for (int64_t pixel : pixels) {
+			const auto [x, y] = helper::sample_to_point(GT, static_cast<int>(pixel % width), static_cast<int>(pixel / width));
+			OGRPoint point = OGRPoint(x, y);
+			helper::addPoint(&point, p_layer);
+
+			if (plot) {
+				xCoords.push_back(x);
+				yCoords.push_back(y);
+			}
+			clusters.push_back(c);
+			added++;
+		}
+	}
+
+	if (filename != "") {
+		try {
+			p_wrapper->write(filename);
+		}
+		catch (const std::exception& e) {
+			std::cout << "Exception thrown trying to write file: " << e.what() << std::endl;
+		}
+	}
+
+	return {{xCoords, yCoords}, p_wrapper, added, retCentroids, clusters};
+}
+
+/**
+ * @ingroup nc
+ * This function samples a raster using nearest centroid sampling, as in the
+ * sample_nc function of the sgsR package:
+ *
+ * Melville, G., & Stone, C. (2016). Optimising nearest neighbour information—a simple,
+ * efficient sampling strategy for forestry plot imputation using remotely sensed data.
+ * Australian Forestry, 79(3), 217–228.
+ *
+ * The feature space of every band of the raster is clustered into numSamples clusters
+ * using k-means, trained on a random pool of at most roughly poolSize pixels in the
+ * same way as the kmeans stratification (see kmeans::train()). The k pixels nearest
+ * to each centroid, among the pixels which are nearest to that centroid, are then used
+ * as samples. Using only the members of each cluster means no pixel is selected by more
+ * than one centroid.
+ *
+ * The nearest pixels are found in a single streaming pass over the raster, split
+ * between threads, where each thread keeps a heap of the k nearest pixels of every
+ * centroid within it's own chunk of the raster. The heaps are merged once every chunk
+ * is read, so the memory used does not depend on the size of the raster. If an access
+ * network is given, only accessible pixels are used as samples, although the clusters
+ * are trained on the whole raster.
+ *
+ * The bands are processed as double precision values if any of them is of type
+ * double, otherwise as single precision values.
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param int numSamples
+ * @param int k
+ * @param int64_t poolSize
+ * @param int maxIterations
+ * @param double accuracy
+ * @param bool scale
+ * @param GDALVectorWrapper *p_access
+ * @param std::string layerName
+ * @param double buffInner
+ * @param double buffOuter
+ * @param bool plot
+ * @param std::string tempFolder
+ * @param std::string filename
+ * @param int threads
+ * @returns std::tuple<std::vector<std::vector<double>>, GDALVectorWrapper *, size_t, std::vector<std::vector<double>>, std::vector<int>>
+ * 	the coordinates of the samples to plot, the sample network, the number of samples, the centroids in the
+ * 	units of the raster bands, and the cluster of every sample.
+ */
+std::tuple<std::vector<std::vector<double>>, vector::GDALVectorWrapper *, size_t, std::vector<std::vector<double>>, std::vector<int>>
+nc(
+	raster::GDALRasterWrapper *p_raster,
+	int numSamples,
+	int k,
+	int64_t poolSize,
+	int maxIterations,
+	double accuracy,
+	bool scale,
+	vector::GDALVectorWrapper *p_access,
+	std::string layerName,
+	double buffInner,
+	double buffOuter,
+	bool plot,
+	std::string tempFolder,
+	std::string filename,
+	int threads)
+{
+	GDALAllRegister();
+
+	std::mutex mutex;
+	GDALDataType type;
+	std::vector<helper::RasterBandMetaData> bands = hypercube::getBands(p_raster, &mutex, type);
+
+	return type == GDT_Float64 ?
+		ncImpl<double>(p_raster, bands, type, numSamples, k, poolSize, maxIterations, accuracy, scale,
+			       p_access, layerName, buffInner, buffOuter, plot, tempFolder, filename, threads) :
+		ncImpl<float>(p_raster, bands, type, numSamples, k, poolSize, maxIterations, accuracy, scale,
+			      p_access, layerName, buffInner, buffOuter, plot, tempFolder, filename, threads);
+}
+
+} //namespace nc
+} //namespace sgs
@@ -1,3 +1,256 @@
-def nc():
-    print(__file__)
-    raise NotImplementedError
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: nearest centroid sampling (nc)
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+##
+# @defgroup user_nc nc
+# @ingroup user_sample
+
+import os
+import sys
+import site
+import tempfile
+from typing import Optional
+
+import matplotlib.pyplot as plt
+
+from sgspy.utils import (
+    SpatialRaster,
+    SpatialVector,
+    plot,
+)
+
+#ensure _sgs binary can be found
+site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackages()))[0]
+sys.path.append(os.path.join(site_packages, "sgspy"))
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from _sgs import nc_cpp
+
+##
+# @ingroup user_nc
+# This function conducts nearest centroid sampling, see the following article for an in
+# depth description of the method itself:
+#
+# Melville, G., & Stone, C. (2016). Optimising nearest neighbour information—a simple,
+# efficient sampling strategy for forestry plot imputation using remotely sensed data.
+# Australian Forestry, 79(3), 217–228.
+#
+# The pixels of every band of the raster are clustered into num_samples clusters using k-means,
+# and the k pixels nearest to each cluster centroid are selected as samples, for a total of
+# num_samples * k samples. Only the pixels which belong to a cluster are considered when
+# selecting the samples of that cluster, so no pixel is selected twice. A cluster with fewer
+# than k pixels contributes all of them.
+#
+# The raster is never loaded into memory all at once. The k-means model is trained on a random
+# pool of roughly pool_size pixels, in the same way as sgspy.stratify.kmeans, and the nearest
+# pixels are found while the raster is iterated through in blocks using thread_count threads.
+# If scale is True, each band is standardized by it's mean and standard deviation within the
+# pool before clustering, so bands with large values do not dominate the distances.
+#
+# An access vector of LineString or MultiLineString type can be provided, in which case only
+# accessible pixels are selected as samples. The clusters are still trained on the whole
+# raster. buff_outer specifies the buffer distance around the geometry which is allowed to be
+# included in the sampling, buff_inner specifies the buffer distance around the geometry which
+# is not allowed to be included in the sampling. buff_outer must be larger than buff_inner. For
+# a multi layer vector, layer_name must be specified.
+#
+# Examples
+# --------------------
+# rast = sgspy.SpatialRaster("raster.tif") @n
+# samples = sgspy.sample.nc(rast, num_samples=50)
+#
+# rast = sgspy.SpatialRaster("raster.tif") @n
+# samples = sgspy.sample.nc(rast, num_samples=25, k=2, plot=True, filename="nc_samples.shp")
+#
+# rast = sgspy.SpatialRaster("raster.tif") @n
+# access = sgspy.SpatialVector("access_network.shp") @n
+# samples = sgspy.sample.nc(rast, num_samples=50, access=access, buff_inner=50, buff_outer=300)
+#
+# Parameters
+# --------------------
+# rast : SpatialRaster @n
+#     raster data structure containing the raster to sample @n @n
+# num_samples : int @n
+#     the number of clusters (centroids) @n @n
+# k : int @n
+#     the number of samples to select for each cluster @n @n
+# pool_size : int @n
+#     the approximate number of pixels to train the k-means model on @n @n
+# max_iterations : int @n
+#     the maximum number of k-means iterations @n @n
+# accuracy : float @n
+#     the k-means accuracy threshold at which training stops @n @n
+# scale : bool @n
+#     whether to standardize the bands before clustering @n @n
+# access : SpatialVector @n
+#     a vector specifying access network @n @n
+# layer_name : str @n
+#     the layer within access that is to be used for sampling @n @n
+# buff_inner : int | float @n
+#     buffer boundary specifying distance from access which CANNOT be sampled @n @n
+# buff_outer : int | float @n
+#     buffer boundary specifying distance from access which CAN be sampled @n @n
+# thread_count : int @n
+#     the number of threads to use @n @n
+# plot : bool @n
+#     whether to plot the samples or not @n @n
+# filename : str @n
+#     the filename to write to, or '' if file should not be written @n @n
+#
+# Returns
+# --------------------
+# a SpatialVector object containing point geometries of sample locations
+def nc(
+    rast: SpatialRaster,
+    num_samples: int,
+    k: int = 1,
+    pool_size: int = 1000000,
+    max_iterations: int = 300,
+    accuracy: float = 1e-4,
+    scale: bool = True,
+    access: Optional[SpatialVector] = None,
+    layer_name: Optional[str] = None,
+    buff_inner: Optional[int | float] = None,
+    buff_outer: Optional[int | float] = None,
+    thread_count: int = 8,
+    plot: bool = False,
+    filename: str = ''):
+
+    if type(rast) is not SpatialRaster:
+        raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster.")
+
+    if type(num_samples) is not int:
+        raise TypeError("'num_samples' parameter must be of type int.")
+
+    if type(k) is not int:
+        raise TypeError("'k' parameter must be of type int.")
+
+    if type(pool_size) is not int:
+        raise TypeError("'pool_size' parameter must be of type int.")
+
+    if type(max_iterations) is not int:
+        raise TypeError("'max_iterations' parameter must be of type int.")
+
+    if type(accuracy) not in [int, float]:
+        raise TypeError("'accuracy' parameter must be of type float.")
+
+    if type(scale) is not bool:
+        raise TypeError("'scale' parameter must be of type bool.")
+
+    if access is not None and type(access) is not SpatialVector:
+        raise TypeError("'access' parameter, if given, must be of type sgspy.SpatialVector.")
+
+    if layer_name is not None and type(layer_name) is not str:
+        raise TypeError("'layer_name' parameter, if given, must be of type str.")
+
+    if buff_inner is not None and type(buff_inner) not in [int, float]:
+        raise TypeError("'buff_inner' parameter, if given, must be of type int or float.")
+
+    if buff_outer is not None and type(buff_outer) not in [int, float]:
+        raise TypeError("'buff_outer' parameter, if given, must be of type int or float.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if type(plot) is not bool:
+        raise TypeError("'plot' parameter must be of type bool.")
+
+    if type(filename) is not str:
+        raise TypeError("'filename' paramter must be of type str.")
+
+    if rast.closed:
+            raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
+
+    if num_samples < 1:
+        raise ValueError("num_samples must be greater than 0")
+
+    if k < 1:
+        raise ValueError("k must be greater than 0")
+
+    if pool_size < num_samples:
+        raise ValueError("pool_size must be at least num_samples.")
+
+    if max_iterations < 1:
+        raise ValueError("max_iterations must be greater than 0.")
+
+    if accuracy < 0:
+        raise ValueError("accuracy can't be negative.")
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    if (access):
+        if layer_name is None:
+            if len(access.layers) > 1:
+                raise ValueError("if there are multiple layers in the access vector, layer_name parameter must be passed.")
+            layer_name = access.layers[0]
+
+        if layer_name not in access.layers:
+            raise ValueError("layer specified by 'layer_name' does not exist in the access vector")
+
+        if buff_inner is None or buff_inner < 0:
+            buff_inner = 0
+
+        if buff_outer is None or buff_outer < 0:
+            raise ValueError("if an access vector is given, buff_outer must be a float greater than 0.")
+
+        if buff_inner >= buff_outer:
+            raise ValueError("buff_outer must be greater than buff_inner")
+
+        access_vector = access.cpp_vector
+    else:
+        access_vector = None
+        layer_name = ""
+        buff_inner = -1
+        buff_outer = -1
+
+    temp_dir = rast.cpp_raster.get_temp_dir()
+    if temp_dir == "":
+        temp_dir = tempfile.mkdtemp()
+        rast.cpp_raster.set_temp_dir(temp_dir)
+
+    [sample_coordinates, cpp_vector, num_points, centroids, clusters] = nc_cpp(
+        rast.cpp_raster,
+        num_samples,
+        k,
+        pool_size,
+        max_iterations,
+        float(accuracy),
+        scale,
+        access_vector,
+        layer_name,
+        buff_inner,
+        buff_outer,
+        plot,
+        temp_dir,
+        filename,
+        thread_count
+    )
+
+    if num_points < num_samples * k:
+        print("unable to find the full {} samples within the given constraints. Sampled {} points.".format(num_samples * k, num_points))
+
+    #plot new vector if requested
+    if plot:
+        try:
+            fig, ax = plt.subplots()
+            rast.plot(ax, band=rast.bands[0])
+            title = "samples on " + rast.bands[0]
+
+            if access:
+                access.plot('LineString', ax)
+                title += " with access"
+
+            ax.plot(sample_coordinates[0], sample_coordinates[1], '.r')
+            ax.set_title(label=title)
+            plt.show()
+
+        except Exception as e:
+            print("unable to plot output: " + str(e))
+
+    return SpatialVector(cpp_vector)
@@ -12,40 +12,221 @@
  * @ingroup sample
  */
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <xoshiro.h>
 
 #include "utils/access.h"
 #include "utils/existing.h"
+#include "utils/grid.h"
 #include "utils/helper.h"
 #include "utils/raster.h"
 #include "utils/vector.h"
 
+#define SRS_OVERVIEW_MAX_PIXELS 4194304
+#define SRS_RANDOM_ACCESS_ROUNDS 8
+
 namespace sgs {
 namespace srs {
 
 /**
  * @ingroup srs
+ * This struct contains an estimate of where the valid (not nodata) pixels of the
+ * raster are, which is used to decide between the random access and full raster
+ * read strategies. It contains:
+ *
+ * std::vector<uint8_t> empty:
+ * 	whether each block is known to contain only nodata pixels. This is only
+ * 	known if the driver reports sparse block information, for example
+ * 	a GeoTIFF which has tiles that were never written.
+ *
+ * size_t nonEmptyBlocks, nonEmptyPixels:
+ * 	the number of blocks (and pixels within those blocks) which aren't known
+ * 	to be empty.
+ *
+ * double validFraction:
+ * 	the estimated fraction of pixels within the non-empty blocks which aren't
+ * 	nodata. This is estimated from an overview of the band if there is one, 
+ * 	otherwise it is assumed that half of the pixels are nodata.
+ *
+ * bool estimated:
+ * 	whether validFraction was estimated from an overview.
+ */
+struct BlockCoverage {
+	std::vector<uint8_t> empty;
+	size_t nonEmptyBlocks = 0;
+	size_t nonEmptyPixels = 0;
+	double validFraction = 0.5;
+	bool estimated = false;
+};
+
+/**
+ * @ingroup srs
+ * This function calculates the BlockCoverage of a raster band.
  *
+ * GDALRasterBand::GetDataCoverageStatus() is called on every block to find blocks
+ * which are entirely empty. This is a cheap call which doesn't read any pixels, and
+ * if it isn't implemented by the driver on the first block it is not called again.
+ *
+ * An empty block (for example a sparse GeoTIFF block) is read as a fill value, which is
+ * only nodata if the band has a nodata value, otherwise the pixels of the block are valid.
+ * Empty blocks are therefore only treated as having no valid pixels if the band has a
+ * nodata value, and a pixel of the first empty block reads as that nodata value.
+ *
+ * Then, the most detailed overview with no more than SRS_OVERVIEW_MAX_PIXELS pixels
+ * is read (if it exists), and the fraction of its pixels which lie within non-empty
+ * blocks and aren't nodata is used as the valid fraction.
+ *
+ * @param helper::RasterBandMetaData& band
+ * @param int width
+ * @param int height
+ * @param int xBlocks
+ * @param int yBlocks
+ * @returns BlockCoverage
+ */
+inline BlockCoverage
+getBlockCoverage(helper::RasterBandMetaData& band, int width, int height, int xBlocks, int yBlocks) {
+	BlockCoverage coverage;
+	coverage.empty.assign(static_cast<size_t>(xBlocks) * static_cast<size_t>(yBlocks), 0);
+
+	int hasNoData = 0;
+	double nodata = band.p_band->GetNoDataValue(&hasNoData);
+	bool implemented = hasNoData;
+	bool filled = false;
+	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
+		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
+			int xValid, yValid;
+			band.p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
+
+			if (implemented) {
+				int status = band.p_band->GetDataCoverageStatus(
+					xBlock * band.xBlockSize,
+					yBlock * band.yBlockSize,
+					xValid,
+					yValid,
+					0,
+					nullptr
+				);
+
+				implemented = !(status & GDAL_DATA_COVERAGE_STATUS_UNIMPLEMENTED);
+				if (implemented && status == GDAL_DATA_COVERAGE_STATUS_EMPTY && !filled) {
+					//check the fill value of empty blocks is the nodata value
+					double fill;
+					CPLErr err = band.p_band->RasterIO(GF_Read, xBlock * band.xBlockSize, yBlock * band.yBlockSize, 1, 1, &fill, 1, 1, GDT_Float64, 0, 0);
+					implemented = !err && (fill == nodata || (std::isnan(fill) && std::isnan(nodata)));
+					filled = true;
+				}
+
+				if (implemented && status == GDAL_DATA_COVERAGE_STATUS_EMPTY) {
+					coverage.empty[static_cast<size_t>(yBlock) * xBlocks + xBlock] = 1;
+					continue;
+				}
+			}
+
+			coverage.nonEmptyBlocks++;
+			coverage.nonEmptyPixels += static_cast<size_t>(xValid) * static_cast<size_t>(yValid);
+		}
+	}
+
+	//find the most detailed overview which is small enough to read in full
+	GDALRasterBand *p_overview = nullptr;
+	for (int i = 0; i < band.p_band->GetOverviewCount(); i++) {
+		GDALRasterBand *p_band = band.p_band->GetOverview(i);
+		if (!p_band) {
+			continue;
+		}
+
+		int64_t pixels = static_cast<int64_t>(p_band->GetXSize()) * static_cast<int64_t>(p_band->GetYSize());
+		if (pixels > SRS_OVERVIEW_MAX_PIXELS || pixels == 0) {
+			continue;
+		}
+
+		if (!p_overview || pixels > static_cast<int64_t>(p_overview->GetXSize()) * p_overview->GetYSize()) {
+			p_overview = p_band;
+		}
+	}
+
+	if (!p_overview || coverage.nonEmptyBlocks == 0) {
+		return coverage;
+	}
+
+	int oxSize = p_overview->GetXSize();
+	int oySize = p_overview->GetYSize();
+	std::vector<double> values(static_cast<size_t>(oxSize) * static_cast<size_t>(oySize));
+	CPLErr err = p_overview->RasterIO(GF_Read, 0, 0, oxSize, oySize, values.data(), oxSize, oySize, GDT_Float64, 0, 0);
+	if (err) {
+		return coverage;
+	}
+
+	int hasOverviewNoData = 0;
+	double nan = p_overview->GetNoDataValue(&hasOverviewNoData);
+	if (!hasOverviewNoData) {
+		nan = band.nan;
+	}
+
+	size_t valid = 0;
+	size_t total = 0;
+	for (int oy = 0; oy < oySize; oy++) {
+		//the full resolution pixel at the center of the overview pixel
+		int y = static_cast<int>((oy + 0.5) * height / oySize);
+		int yBlock = y / band.yBlockSize;
+		for (int ox = 0; ox < oxSize; ox++) {
+			int x = static_cast<int>((ox + 0.5) * width / oxSize);
+			int xBlock = x / band.xBlockSize;
+			if (coverage.empty[static_cast<size_t>(yBlock) * xBlocks + xBlock]) {
+				continue;
+			}
+
+			double val = values[static_cast<size_t>(oy) * oxSize + ox];
+			total++;
+			valid += !(std::isnan(val) || val == nan);
+		}
+	}
+
+	if (total != 0) {
+		//never assume there are no valid pixels, as the overview may miss sparse valid pixels
+		coverage.validFraction = std::max(static_cast<double>(valid) / static_cast<double>(total), 1.0 / static_cast<double>(total));
+		coverage.estimated = true;
+	}
+
+	return coverage;
+}
+
+/**
+ * @ingroup srs
  * This function generates random index values to sample. This method is fast
  * in many circumstances, because it does not require the entire raster to be read.
- * 
- * However, in cases where there are a very large number of samples, or a low percentage
- * of the raster is sampleable, it may be slower than reading through the entire raster.
- * This is because calling the RasterIO function incurs significant overhead, especially
- * in random access patterns.
+ *
+ * Random pixel positions are generated uniformly across the blocks which aren't known to
+ * be empty, in rounds. The positions of each round are grouped by the block they fall in,
+ * and each of those blocks is read once (along with the access block if required) to check
+ * every position within it. The valid positions are then added in the order they were
+ * generated, so the result is a uniform random selection of the valid pixels.
+ *
+ * The number of positions generated in each round is the number of remaining samples divided
+ * by the estimated valid fraction, with a margin. If more than maxBlocks blocks would be read,
+ * false is returned and the caller should read the whole raster instead.
  *
  * @param helper::RasterBandMetaData& band
  * @param int width
  * @param int height
- * @param int numSamples
+ * @param size_t numSamples
+ * @param size_t maxBlocks
+ * @param BlockCoverage& coverage
+ * @param double accessFraction
  * @param access::Access& access
  * @param existing::Existing& existing
- * @param std::unordered_set<helper::Index>& index
- * @param xso::xoshiro_4x64_plus rng
+ * @param std::vector<helper::Index>& indices
+ * @param xso::xoshiro_4x64_plus& rng
  * @returns bool
  */
 template <typename T>
@@ -54,95 +235,148 @@ getRandomIndices(
 	helper::RasterBandMetaData& band,
 	int width,
 	int height,
-	int numSamples,
+	size_t numSamples,
+	size_t maxBlocks,
+	BlockCoverage& coverage,
+	double accessFraction,
 	access::Access& access,
 	existing::Existing& existing,
 	std::vector<helper::Index>& indices,
-	xso::xoshiro_4x64_plus rng)
+	xso::xoshiro_4x64_plus& rng)
 {
 	T nan = static_cast<T>(band.nan);
+	int xBlocks = (width + band.xBlockSize - 1) / band.xBlockSize;
+	int yBlocks = (height + band.yBlockSize - 1) / band.yBlockSize;
+	
+	//cumulative pixel counts of the non-empty blocks, used to choose a block for a uniform pixel position
+	std::vector<size_t> blockIds;
+	std::vector<uint64_t> cumulativePixels;
+	uint64_t totalPixels = 0;
+	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
+		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
+			size_t id = static_cast<size_t>(yBlock) * xBlocks + xBlock;
+			if (coverage.empty[id]) {
+				continue;
+			}
 
-	uint64_t width64 = static_cast<int64_t>(width);
-	uint64_t height64 = static_cast<int64_t>(height);
-
-	//get mask for rng output using bit twiddling
-	uint64_t maxIndex = width64 * height64 - 1;
-	uint64_t mask = maxIndex;
-	mask |= mask >> 1;
-	mask |= mask >> 2;
-	mask |= mask >> 4;
-	mask |= mask >> 8;
-	mask |= mask >> 16;
-	mask |= mask >> 32;
-
-	int iterations = 0;
-	int maxIterations = numSamples * 11;
-	std::unordered_set<uint64_t> indexSet;
-	while (iterations < maxIterations && indices.size() < static_cast<size_t>(numSamples)) {
-		//generate a random valid index
-		//
-		//bit shift by 11 because lower 11 bits are not random enough in this (fast) xoshiro configuration
-		uint64_t index = (rng() >> 11) & mask; 
-		while (index > maxIndex) {
-			index = (rng() >> 11) & mask;
-		}
-		int x = static_cast<int>(index % width64);
-		int y = static_cast<int>(index / width64);
-		
-		//read the value from that index
-		T val;
-		CPLErr err = band.p_band->RasterIO(GF_Read, x, y, 1, 1, &val, 1, 1, band.type, 0, 0);
-		if (err) {
-			throw std::runtime_error("error reading pixel from raster band using GDALRasterBand::RasterIO().");
+			int xValid = std::min(band.xBlockSize, width - xBlock * band.xBlockSize);
+			int yValid = std::min(band.yBlockSize, height - yBlock * band.yBlockSize);
+			totalPixels += static_cast<uint64_t>(xValid) * static_cast<uint64_t>(yValid);
+			blockIds.push_back(id);
+			cumulativePixels.push_back(totalPixels);
 		}
+	}
 
-		//check if val is nan
-		bool isNan = std::isnan(val) || val == nan;
-		if (isNan) {
-			iterations++;
-			continue;
+	if (totalPixels == 0) {
+		return false;
+	}
+
+	std::uniform_int_distribution<uint64_t> pixelDist(0, totalPixels - 1);
+	std::unordered_set<uint64_t> tried;
+	size_t blocksRead = 0;
+	double validFraction = std::max(coverage.validFraction * accessFraction, 1e-9);
+	int8_t *p_access = access.used ? reinterpret_cast<int8_t *>(access.band.p_buffer) : nullptr;
+
+	struct Candidate {
+		size_t block;
+		int x;
+		int y;
+		bool valid = false;
+	};
+
+	for (int round = 0; round < SRS_RANDOM_ACCESS_ROUNDS && indices.size() < numSamples; round++) {
+		size_t remaining = numSamples - indices.size();
+		size_t draws = static_cast<size_t>(std::ceil(remaining * 1.25 / validFraction)) + 16;
+		draws = static_cast<size_t>(std::min<uint64_t>(draws, totalPixels - tried.size()));
+		if (draws == 0) {
+			break;
 		}
 
-		//check if pixel is accessible
-		bool accessible = !access.used;
-		if (access.used) {
-			int8_t accessVal;
-			CPLErr err = access.band.p_band->RasterIO(GF_Read, x, y, 1, 1, &accessVal, 1, 1, access.band.type, 0, 0);
-			if (err) {
-				throw std::runtime_error("error reading pixel from access raster band using GDALRasterBand::RasterIO().");
+		//generate unique random pixel positions
+		std::vector<Candidate> candidates;
+		candidates.reserve(draws);
+		while (candidates.size() < draws) {
+			uint64_t pixel = pixelDist(rng);
+			size_t b = std::upper_bound(cumulativePixels.begin(), cumulativePixels.end(), pixel) - cumulativePixels.begin();
+			uint64_t offset = pixel - (b == 0 ? 0 : cumulativePixels[b - 1]);
+
+			size_t id = blockIds[b];
+			int xBlock = static_cast<int>(id % xBlocks);
+			int yBlock = static_cast<int>(id / xBlocks);
+			int xValid = std::min(band.xBlockSize, width - xBlock * band.xBlockSize);
+			int x = xBlock * band.xBlockSize + static_cast<int>(offset % xValid);
+			int y = yBlock * band.yBlockSize + static_cast<int>(offset / xValid);
+
+			if (!tried.insert(static_cast<uint64_t>(y) * width + x).second) {
+				continue;
 			}
-			accessible = accessVal != 1;
+			candidates.push_back({id, x, y});
 		}
-		if (!accessible) {
-			iterations++;
-			continue;
+
+		//group the positions by block, so that each block is read once
+		std::vector<uint32_t> order(candidates.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = static_cast<uint32_t>(i);
 		}
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return candidates[a].block < candidates[b].block;
+		});
+
+		size_t i = 0;
+		while (i < order.size()) {
+			size_t id = candidates[order[i]].block;
+			if (blocksRead == maxBlocks) {
+				return false;
+			}
 
-		//check if pixel is already sampled
-		bool alreadySampled = existing.used && existing.containsIndex(x, y);
-		alreadySampled |= indexSet.find(index) != indexSet.end();
-		if (alreadySampled) {
-			iterations++;
-			continue;
+			int xBlock = static_cast<int>(id % xBlocks);
+			int yBlock = static_cast<int>(id / xBlocks);
+			int xValid = std::min(band.xBlockSize, width - xBlock * band.xBlockSize);
+			int yValid = std::min(band.yBlockSize, height - yBlock * band.yBlockSize);
+			helper::rasterBandIO(band, band.p_buffer, band.xBlockSize, band.yBlockSize, xBlock, yBlock, xValid, yValid, true, false);
+			if (access.used) {
+				helper::rasterBandIO(access.band, access.band.p_buffer, band.xBlockSize, band.yBlockSize, xBlock, yBlock, xValid, yValid, true, false);
+			}
+			blocksRead++;
+
+			for (; i < order.size() && candidates[order[i]].block == id; i++) {
+				Candidate& candidate = candidates[order[i]];
+				size_t blockIndex = static_cast<size_t>(candidate.y - yBlock * band.yBlockSize) * band.xBlockSize + (candidate.x - xBlock * band.xBlockSize);
+
+				T val = reinterpret_cast<T *>(band.p_buffer)[blockIndex];
+				bool isNan = std::isnan(val) || val == nan;
+				bool accessible = !access.used || p_access[blockIndex] != 1;
+				bool alreadySampled = existing.used && existing.containsIndex(candidate.x, candidate.y);
+				candidate.valid = !isNan && accessible && !alreadySampled;
+			}
 		}
 
-		//add index to indices map if the pixel is not nan, accessible, and not already sampled
-		indexSet.insert(index);
-		indices.push_back(helper::Index(x, y));
-		iterations++;	
+		//add the valid positions in the order they were generated
+		for (const Candidate& candidate : candidates) {
+			if (indices.size() == numSamples) {
+				break;
+			}
+
+			if (candidate.valid) {
+				indices.push_back(helper::Index(candidate.x, candidate.y));
+			}
+		}
 	}
 
-	return indices.size() == static_cast<size_t>(numSamples);
+	return indices.size() == numSamples;
 }
 
 /**
  * @ingroup srs
  * This is a helper function for processing a block of the raster. For each
- * pixel in the block: 
+ * pixel in the block which the rng has chosen to potentially be added: 
  * The value is checked, and not added if it is a nanvalue. 
  * The pixel is checked to ensure it is within an accessible area.
  * The pixel is checked to ensure it hasn't already been added as a pre-existing sample point.
- * The next rng value is checked to see whether it is one of the chosen pixels to be added.
+ *
+ * The function is specialized on the pixel type T of the band, and on whether
+ * the access and existing checks are required, so the only checks compiled into
+ * the loop are the ones which are used (see helper::dispatchFlags()).
  *
  * @param RasterBandMetaData& band
  * @param Access& access
@@ -155,7 +389,7 @@ getRandomIndices(
  * @param int xValid
  * @param int yValid 
  */
-template <typename T>
+template <typename T, bool HasAccess, bool HasExisting>
 inline void
 processBlock(
 	helper::RasterBandMetaData& band,
@@ -172,44 +406,43 @@ processBlock(
 	int8_t *p_access = reinterpret_cast<int8_t *>(access.band.p_buffer);
 
 	for (int y = 0; y < yValid; y++) {
-		size_t blockIndex = static_cast<size_t>(y * band.xBlockSize);
-		for (int x = 0; x < xValid; x++) {
+		size_t rowStart = static_cast<size_t>(y * band.xBlockSize);
+
+		//only the pixels chosen by the rng are checked, skipping rejected pixels a word at a time
+		rand.forEachKept(rowStart, rowStart + xValid, [&](size_t blockIndex) {
+			int x = static_cast<int>(blockIndex - rowStart);
+
 			//get val
-			T val = helper::getPixelValueDependingOnType<T>(band.type, band.p_buffer, blockIndex);
+			T val = reinterpret_cast<T *>(band.p_buffer)[blockIndex];
 
 			//check nan
-			bool isNan = val == nan || std::isnan(val);
+			bool isNan = val == nan;
+			if constexpr (std::is_floating_point_v<T>) {
+				isNan |= std::isnan(val);
+			}
 			if (isNan) {
-				blockIndex++;
-				continue;
+				return;
 			}
 
 			//check access
-			if (access.used && p_access[blockIndex] == 1) {
-				blockIndex++;
-				continue;
+			if constexpr (HasAccess) {
+				if (p_access[blockIndex] == 1) {
+					return;
+				}
 			}
 
 			helper::Index index = {x + xBlock * band.xBlockSize, y + yBlock * band.yBlockSize};
 			
 			//check existing
-			if (existing.used && existing.containsIndex(index.x, index.y)) {
-				blockIndex++;
-				continue;
-			}
-
-			//check rand val
-			if (!rand.next()) {
-				blockIndex++;
-				continue;
+			if constexpr (HasExisting) {
+				if (existing.containsIndex(index.x, index.y)) {
+					return;
+				}
 			}
 
 			//add index to indices
 			indices.push_back(index);
-
-			//increment within-block index
-			blockIndex++;
-		}
+		});
 	}
 }
 
@@ -242,6 +475,8 @@ processBlock(
  * Next, a rng() function is created usign the xoshiro library, the specific
  * randm number generator is the xoshrio256++
  * https://vigna.di.unimi.it/ftp/papers/ScrambledLinear.pdf	
+ * If a seed is given (it isn't -1) the generator is seeded with it, so the
+ * samples are reproducible.
  *
  * The impetus behind usign the rng() function to determine which pixels
  * should be added DURING iteration, rather than afterwards, is it removes the
@@ -256,16 +491,22 @@ processBlock(
  * getProbabilityMultiplier() function.
  *
  * Then, the raster is processed in one of two ways. One using a random access
- * strategy where random indexes are calculated and checked for validity, and 
- * another where the entire raster is read. The decision between these two
- * is calculated to minimize the number of blocks read into memory, as this
- * is the main bottleneck in processing time.
+ * strategy where random indexes are calculated and checked for validity, reading
+ * each block containing one of them once, and another where the entire raster is
+ * read. The decision between these two is calculated to minimize the number of blocks
+ * read into memory, as this is the main bottleneck in processing time. The number
+ * of valid pixels used in this decision is estimated using getBlockCoverage(), and
+ * blocks known to be empty are skipped by both strategies.
  *
  * Once all possible pixels have been selected, there may be extra
  * indices in the indicies vector. Because simply sampling the first
  * few we need would might NOT be in a random order, the indices are first shuffled.
  * After being shuffled, the indexes are added to the output dataset
  * as samples if they don't occur within mindist if an already existing pixel.
+ * If more than one thread is given, batches of candidates are first checked
+ * against the already accepted samples in parallel, see SpatialGrid::query(),
+ * so only the candidates which might be valid are checked serially. The samples
+ * chosen are the same as when a single thread is used.
  *
  * @param GDALRasterWrapper *p_raster
  * @param size_t numSamples
@@ -278,6 +519,8 @@ processBlock(
  * @param bool plot
  * @param std::string tempFolder
  * @param std::string filename
+ * @param int threads
+ * @param int64_t seed the seed of the random number generator, or -1 for a random seed
  * @returns std::tuple<std::vector<std::vector<double>>, GDALVectorWrapper *, size_t>
  */
 std::tuple<std::vector<std::vector<double>>, vector::GDALVectorWrapper *, size_t> 
@@ -292,7 +535,9 @@ srs(
 	double buffOuter,
 	bool plot,
 	std::string tempFolder,
-	std::string filename)
+	std::string filename,
+	int threads,
+	int64_t seed)
 {
 	GDALAllRegister();
 
@@ -341,7 +586,8 @@ srs(
 		true,
 		tempFolder,
 		band.xBlockSize,
-		band.yBlockSize
+		band.yBlockSize,
+		threads
 	);
 
 	if (access.used) {
@@ -364,12 +610,12 @@ srs(
 	int yBlocks = (height + band.yBlockSize - 1) / band.yBlockSize;
 	std::vector<helper::Index> indices;
 
-	std::vector<bool> randVals(band.xBlockSize * band.yBlockSize);
-	int randValIndex = band.xBlockSize * band.yBlockSize;
-
 	//fast random number generator using xoshiro256++
 	//https://vigna.di.unimi.it/ftp/papers/ScrambledLinear.pdf	
 	xso::xoshiro_4x64_plus rng;
+	if (seed != -1) {
+		rng.seed(static_cast<uint64_t>(seed));
+	}
 
 	// when reading pixels or blocks into memory using GDAL, the whole block is always read into memory.
 	// This reading of blocks is a large portion of the runtime for the processing of raster images.
@@ -383,96 +629,62 @@ srs(
 	//  2. acessible
 	//  3. not already sampled
 	//
-	// However, there are cases when more blocks will be read into memory by randomly selecting 
-	// pixels compared to reading through the whole raster. This is because random access patterns
-	// have a VERY low hit rate in the cache, leading to significant thrashing -- we have to assume
-	// every time a pixel is read a block is read into the cache whereas when the entire raster is
-	// read sequentially, a new block must be read into the cache ONLY when the first pixel in that
-	// block is looked at.
+	// The random access strategy generates random pixel positions in rounds, and reads each block
+	// containing at least one of those positions exactly once per round. So, the number of blocks
+	// it reads is the number of distinct blocks hit by the random positions, which depends on how
+	// many positions have to be generated to find enough valid pixels.
 	//
-	// In the following, we attemt to estimate which method will result in the smaller number of 
-	// blocks read into memory and use that to generate random pixels, assuming that half of the
-	// raster is nan.
+	// In the following, the fraction of valid pixels is estimated using the BlockCoverage, which knows
+	// which blocks are empty (if the driver reports it) and estimates the fraction of nodata pixels in
+	// the remaining blocks from an overview (if there is one, otherwise assuming half are nodata). Empty
+	// blocks are skipped by both strategies. Then, the expected number of distinct blocks read by the
+	// random access strategy is compared against the number of blocks read by the full raster read.
 	//
 	// worth noting -- if not enough pixels are able to be determined using the random access method,
 	// the full raster read method is then used.
-
-	//total blocks is yBlocks * xBlocks	
-	size_t numBlocks = static_cast<size_t>(xBlocks) * static_cast<size_t>(yBlocks);
+	BlockCoverage coverage = getBlockCoverage(band, width, height, xBlocks, yBlocks);
 
 	//desired samples is x3 if using mindist
 	size_t desiredSamples = static_cast<size_t>(useMindist ? numSamples * 3 : numSamples);
 
-	//total number of pixels in the raster
-	size_t allPixels = static_cast<size_t>(width) * static_cast<size_t>(height);
-
-	//total area is width * height * pixelWidth * pixelHeight == allPixels * pixelWidth * pixelHeight
+	//total area is width * height * pixelWidth * pixelHeight
 	double totalArea = static_cast<double>(p_raster->getPixelHeight()) * 
 		           static_cast<double>(p_raster->getPixelWidth()) * 
-			   static_cast<double>(allPixels);
-
-	//accessible pixels is the proportion of pixels which are within the accessible area times the total pixel count
-	double accessiblePixels = allPixels * (access.used ? (access.area / totalArea) : 1.0);
-
-	//valid pixels divides the accessible pixels by 2 (assuming half nan), then subtracts existing samples
-	size_t validPixels = static_cast<size_t>(accessiblePixels / 2.0) - (existing.used ? existing.samples.size() : 0);
-	
-	size_t randomAccessBlocksRequired = 0;
-
-        while (desiredSamples > 0 && randomAccessBlocksRequired < numBlocks) {
-		//the likelihood of guessing a valid pixel is equal to (remainingValidPixles / allPixels)
-		//
-		//therefore it is estimated there will be a total number of 1 / (remainingValidPixels / allPixels)
-		//guesses or random block accesses.
-		//
-		//This is equivalent to allPixels / validPixels.
-		//
-		//Then, since we sampled 1 pixel we reduce the number of valid remaining pixels by 1.
+			   static_cast<double>(width) * static_cast<double>(height);
+	double accessFraction = access.used ? std::min(1.0, std::abs(access.area / totalArea)) : 1.0;
 
-		randomAccessBlocksRequired += (allPixels / validPixels);
-		validPixels--;
-		desiredSamples--;
-	}
-
-	//set max number of random accesses as the estimated required number * 1.25
-	size_t maxRandomAccessBlocks = randomAccessBlocksRequired + randomAccessBlocksRequired / 4;
+	//valid pixels is the estimated number of valid pixels within non-empty blocks, minus the existing samples
+	double validPixels = static_cast<double>(coverage.nonEmptyPixels) * coverage.validFraction * accessFraction
+			   - (existing.used ? existing.samples.size() : 0);
 
-	//if the max estimated number of blocks read into memory under a random access strategy is less than
-	//reading the whole raster, try the random access strategy capping the number of accesses at this max value.
-	//
-	//Then, only read the entire raster if not enough pixels were read by the random strategy
 	bool haveEnoughSamples = false;
-	if (maxRandomAccessBlocks < numBlocks) {
-		desiredSamples = static_cast<size_t>(useMindist ? numSamples * 3 : numSamples);
-
-		switch (band.type) {
-			case GDT_Int8:
-				haveEnoughSamples = getRandomIndices<int8_t>(band, width, height, desiredSamples, access, existing, indices, rng);
-				break;
-			case GDT_UInt16:
-				haveEnoughSamples = getRandomIndices<uint16_t>(band, width, height, desiredSamples, access, existing, indices, rng);
-				break;
-			case GDT_Int16:
-				haveEnoughSamples = getRandomIndices<int16_t>(band, width, height, desiredSamples, access, existing, indices, rng);
-				break;
-			case GDT_UInt32:
-			 	haveEnoughSamples = getRandomIndices<uint32_t>(band, width, height, desiredSamples, access, existing, indices, rng);
-				break;
-			case GDT_Int32:
-				haveEnoughSamples = getRandomIndices<int32_t>(band, width, height, desiredSamples, access, existing, indices, rng);
-				break;
-			case GDT_Float32:
-				haveEnoughSamples = getRandomIndices<float>(band, width, height, desiredSamples, access, existing, indices, rng);
-				break;
-			case GDT_Float64:
-				haveEnoughSamples = getRandomIndices<double>(band, width, height, desiredSamples, access, existing, indices, rng);
-				break;
-			default:
-				throw std::runtime_error("raster pixel data type not supported.");
+	if (validPixels > desiredSamples && coverage.nonEmptyBlocks != 0) {
+		//the number of random positions expected to be required, and the expected number of
+		//distinct blocks containing them if they are spread uniformly across the non-empty blocks.
+		double n = static_cast<double>(coverage.nonEmptyBlocks);
+		double draws = desiredSamples * static_cast<double>(coverage.nonEmptyPixels) / validPixels;
+		double expectedBlocks = n * (1.0 - std::exp(-draws / n));
+
+		//set max number of blocks read as the estimated required number * 1.25
+		size_t maxRandomAccessBlocks = static_cast<size_t>(expectedBlocks * 1.25) + 1;
+
+		//if the max estimated number of blocks read into memory under a random access strategy is less than
+		//reading the whole raster, try the random access strategy capping the number of block reads at this max value.
+		//
+		//Then, only read the entire raster if not enough pixels were found by the random strategy
+		if (maxRandomAccessBlocks < coverage.nonEmptyBlocks) {
+			haveEnoughSamples = helper::dispatchPixelType(band.type, [&](auto tag) {
+				return getRandomIndices<typename decltype(tag)::type>(
+					band, width, height, desiredSamples, maxRandomAccessBlocks, coverage, accessFraction, access, existing, indices, rng
+				);
+			});
 		}
 	}
 
 	if (!haveEnoughSamples) {
+		//discard any indices from an unsuccessful random access attempt, they will be found again
+		indices.clear();
+
 		//the multiplier which will be multiplied by the 53 most significant bits of the output of the
 		//random number generator to see whether a pixel should be added or not. The multiplier is
 		//a uint64_t number where the least significant n bits are 1 and the remaining are 0. The pixel
@@ -483,13 +695,18 @@ srs(
 		//to make that percentage happen. Doing this enables retaining only a small portion of pixel data
 		//and reducing memory footprint significantly, otherwise the index of every pixel
 		//would have to be stored, which would not be feasible for large rasters.
+		//
+		//If the valid fraction was estimated from an overview, the number of samples is scaled up by it
+		//(and by the fraction of pixels in non-empty blocks) so that enough pixels are retained.
+		double scale = coverage.estimated ? coverage.validFraction : 1.0;
+		scale *= static_cast<double>(std::max<size_t>(coverage.nonEmptyPixels, 1)) / (static_cast<double>(width) * static_cast<double>(height));
 		uint64_t multiplier = helper::getProbabilityMultiplier(
 			width, 
 			height, 
 			p_raster->getPixelWidth(), 
 			p_raster->getPixelHeight(), 
 			8, 
-			numSamples, 
+			static_cast<int>(std::min(std::ceil(numSamples / scale), static_cast<double>(INT_MAX / 24))), 
 			useMindist, 
 			access.area
 		);
@@ -499,6 +716,11 @@ srs(
 		for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
 			for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
 				int xValid, yValid;
+
+				//skip blocks which are known to be empty
+				if (coverage.empty[static_cast<size_t>(yBlock) * xBlocks + xBlock]) {
+					continue;
+				}
 	
 				//read block
 				band.p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
@@ -513,31 +735,13 @@ srs(
 				rand.calculateRandValues();
 	
 				//process block
-				switch (band.type) {
-					case GDT_Int8:
-						processBlock<int8_t>(band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid);
-						break;
-					case GDT_UInt16:
-						processBlock<uint16_t>(band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid);
-						break;
-					case GDT_Int16:
-						processBlock<int16_t>(band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid);
-						break;
-					case GDT_UInt32:
-						processBlock<uint32_t>(band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid);
-						break;
-					case GDT_Int32:
-						processBlock<int32_t>(band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid);
-						break;
-					case GDT_Float32:
-						processBlock<float>(band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid);
-						break;
-					case GDT_Float64:
-						processBlock<double>(band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid);
-						break;
-					default:
-						throw std::runtime_error("raster pixel data type is not supported.");
-				}
+				helper::dispatchPixelType(band.type, [&](auto tag) {
+					helper::dispatchFlags([&](auto hasAccess, auto hasExisting) {
+						processBlock<typename decltype(tag)::type, hasAccess, hasExisting>(
+							band, access, existing, indices, rand, xBlock, yBlock, xValid, yValid
+						);
+					}, access.used, existing.used);
+				});
 			}
 		}	
 	}
@@ -546,17 +750,49 @@ srs(
 	
 	size_t samplesAdded = existing.used ? existing.count() : 0;
 	size_t i = 0;
-	helper::NeighborMap neighbor_map;
-	double mindist_sq = mindist * mindist;
+	std::unique_ptr<grid::SpatialGrid> p_grid;
+	if (useMindist) {
+		p_grid = std::make_unique<grid::SpatialGrid>(GT, width, height, mindist);
+		p_grid->reserve(numSamples);
+	}
+
+	//if using multiple threads, check the mindist of a batch of candidates against the grid
+	//at once, then try to add only the candidates without a neighbor in shuffled order below.
+	//The thread pool is created once, and used by every batch.
+	bool parallelMindist = useMindist && threads > 1;
+	std::unique_ptr<boost::asio::thread_pool> p_pool;
+	if (parallelMindist) {
+		p_pool = std::make_unique<boost::asio::thread_pool>(threads);
+	}
+	std::vector<double> xs;
+	std::vector<double> ys;
+	std::vector<uint8_t> rejected;
+	size_t batchStart = 0;
+	size_t batchEnd = 0;
 	
 	helper::Field fieldExistingFalse("existing", 0);
 	while (samplesAdded < numSamples && i < indices.size()) {
+		if (parallelMindist && i == batchEnd) {
+			batchStart = i;
+			batchEnd = std::min(indices.size(), i + GRID_PARALLEL_BATCH);
+			xs.resize(batchEnd - batchStart);
+			ys.resize(batchEnd - batchStart);
+			rejected.resize(batchEnd - batchStart);
+			for (size_t j = batchStart; j < batchEnd; j++) {
+				std::tie(xs[j - batchStart], ys[j - batchStart]) = helper::sample_to_point(GT, indices[j]);
+			}
+			p_grid->query(xs.data(), ys.data(), batchEnd - batchStart, rejected.data(), *p_pool, threads);
+		}
+
 		helper::Index index = indices[i];
 		bool valid = true;
 		const auto [x, y] = helper::sample_to_point(GT, index);
 	
-		if (useMindist) {
-			valid = helper::is_valid_sample(x, y, neighbor_map, mindist, mindist_sq);
+		if (parallelMindist && rejected[i - batchStart]) {
+			valid = false;
+		}
+		else if (useMindist) {
+			valid = p_grid->tryInsert(x, y);
 		}
 	
 		if (valid) {
@@ -51,6 +51,16 @@ from _sgs import srs_cpp
 # added and random samples are chosen as required until num_samples number
 # of samples are chosen.
 #
+# If mindist is given, the thread_count parameter specifies the number of threads
+# used to check the minimum distance between candidate sample points. When more than
+# one thread is used, batches of candidates are checked against the samples accepted
+# so far at the same time, and only the remaining candidates are checked one by one.
+# The samples chosen do not depend on the number of threads.
+# If access is given, the same number of threads are used to build the access mask.
+#
+# If seed is given, the random number generator is seeded with it, so calling srs
+# again with the same raster, parameters, and seed gives the same samples.
+#
 # Examples
 # --------------------
 # rast = sgspy.SpatialRaster("raster.tif") @n
@@ -93,6 +103,10 @@ from _sgs import srs_cpp
 #     whether to plot the samples or not @n @n
 # filename : str @n
 #     the filename to write to, or '' if file should not be written @n @n
+# thread_count : int @n
+#     the number of threads to use when checking mindist and building the access mask @n @n
+# seed : Optional[int] @n
+#     the seed of the random number generator, a random seed is used if not given @n @n
 #
 #
 # Returns
@@ -108,7 +122,9 @@ def srs(
     buff_inner: Optional[int | float] = None,
     buff_outer: Optional[int | float] = None,
     plot: bool = False,
-    filename: str = ''):
+    filename: str = '',
+    thread_count: int = 8,
+    seed: Optional[int] = None):
         
     if type(rast) is not SpatialRaster:
         raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster.")
@@ -140,6 +156,12 @@ def srs(
     if type(filename) is not str:
         raise TypeError("'filename' paramter must be of type str.")
 
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if seed is not None and type(seed) is not int:
+        raise TypeError("'seed' parameter, if given, must be of type int.")
+
     if rast.closed:
             raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
 
@@ -152,6 +174,12 @@ def srs(
     if mindist < 0:
         raise ValueError("mindist must be greater than or equal to 0")
 
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    if seed is not None and seed < 0:
+        raise ValueError("seed must be greater than or equal to 0")
+
 
 
     if (access):
@@ -201,7 +229,9 @@ def srs(
         buff_outer,
         plot,
         temp_dir,
-        filename
+        filename,
+        thread_count,
+        -1 if seed is None else seed
     )
     
     if num_points < num_samples:
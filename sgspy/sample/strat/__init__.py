@@ -1,2 +1,2 @@
 from . import strat
-from .strat import strat
+from .strat import strat, strat_partial, merge_strat_partials, allocate_strat_partials
@@ -12,17 +12,29 @@
  * @ingroup sample
  */
 
+#include <exception>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <tuple>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
 
 #include "utils/access.h"
 #include "utils/existing.h"
+#include "utils/grid.h"
 #include "utils/helper.h"
+#include "utils/profile.h"
 #include "utils/raster.h"
+#include "utils/reader.h"
 #include "utils/vector.h"
 
 #include <xoshiro.h>
 
+#define STRAT_RESERVOIR_FACTOR	4
+#define STRAT_RESERVOIR_MIN	1000
+
 namespace sgs {
 namespace strat {
 
@@ -79,8 +91,16 @@ calculateAllocation(
 			remainder -= count;
 		}
 	}
+	else if (allocation == "fixed") {
+		//the weights are the exact sample counts per stratum, calculated globally by allocatePartials()
+		for (int64_t i = 0; i < numStrata; i++) {
+			int64_t count = static_cast<int64_t>(weights[i]);
+			retval.push_back(count);
+			remainder -= count;
+		}
+	}
 	else { 
-		throw std::runtime_error("allocation method must be one of 'prop', 'equal', 'manual', or 'optim'.");
+		throw std::runtime_error("allocation method must be one of 'prop', 'equal', 'manual', 'optim', or 'fixed'.");
 	}
 
 	//redistribute remainder pixels among strata, and check strata sizes
@@ -98,6 +118,48 @@ calculateAllocation(
 	return retval;
 }
 
+/**
+ * @ingroup strat
+ * Helper function which calculates the reservoir capacity of each strata when strat is
+ * run with bounded memory. This is an upper bound on the number of samples each strata
+ * may be allocated by calculateAllocation(), multiplied by STRAT_RESERVOIR_FACTOR so there
+ * are spare indices for those rejected by mindist, and at least STRAT_RESERVOIR_MIN.
+ *
+ * The allocation of 'equal', 'manual', and 'fixed' allocation is known before the raster
+ * is read. With 'prop' and 'optim' allocation it depends on the strata counts and variances,
+ * so any strata may be allocated up to every sample.
+ *
+ * @param int64_t numSamples
+ * @param int64_t numStrata
+ * @param std::string allocation
+ * @param std::vector<double>& weights
+ * @returns std::vector<int64_t>
+ */
+inline std::vector<int64_t>
+reservoirCapacities(int64_t numSamples, int64_t numStrata, std::string allocation, std::vector<double>& weights) {
+	std::vector<int64_t> retval(numStrata);
+	for (int64_t i = 0; i < numStrata; i++) {
+		int64_t count;
+		if (allocation == "equal") {
+			count = numSamples / numStrata;
+		}
+		else if (allocation == "manual") {
+			count = static_cast<int64_t>(static_cast<double>(numSamples) * weights[i]);
+		}
+		else if (allocation == "fixed") {
+			count = static_cast<int64_t>(weights[i]);
+		}
+		else {
+			count = numSamples;
+		}
+
+		//the remainder redistributed by calculateAllocation() adds at most a few samples to each strata
+		count += numStrata;
+		retval[i] = std::max<int64_t>(STRAT_RESERVOIR_MIN, count * STRAT_RESERVOIR_FACTOR);
+	}
+	return retval;
+}
+
 /**
  * @ingroup strat
  * This struct deals with the 'optim' allocation method. The optim allocation
@@ -105,6 +167,11 @@ calculateAllocation(
  * a seperate raster band. This struct stores band information for the
  * raster band which is used to calculate the variance, the variance per
  * strata, as well as whether the optim method is used.
+ *
+ * The raster is processed by multiple threads, so the buffer the band is
+ * read into and the per-strata Variance calculations during iteration are
+ * owned by each thread. Once a thread is finished, it's variances are
+ * merged into the variances vector of this struct.
  */
 struct OptimAllocationDataManager {
 	helper::RasterBandMetaData band;
@@ -133,60 +200,45 @@ struct OptimAllocationDataManager {
 		this->band.p_band->GetBlockSize(&this->band.xBlockSize, &this->band.yBlockSize);
 		this->used = true;
 	}
-	
-	/**
-	 * Deconstructor, this method frees memory which would be allocated if this object
-	 * was used.
-	 */
-	~OptimAllocationDataManager() {
-		if (this->used) {
-			VSIFree(this->band.p_buffer);
-		}
-	}
 
 	/**
-	 * Initializes some of the data within the struct, setting the size of the vector
-	 * which contains Variance information, as well as allocating the memory which
-	 * will be used to store the raster band.
+	 * Initializes the size of the vector which contains the merged Variance
+	 * information.
 	 *
 	 * @param int numStrata
-	 * @param int xBlockSize
-	 * @param int yBlockSize
 	 */
 	inline void
-	init(int numStrata, int xBlockSize, int yBlockSize) {
+	init(int numStrata) {
 		this->variances.resize(numStrata);
-		this->band.p_buffer = VSIMalloc3(xBlockSize, yBlockSize, band.size);
 	}
 
 	/**
-	 * This function reads a new block of data in from the raster band which this
-	 * struct controls.
+	 * This function updates the Variance calculation for a particular pixel. The index of the pixel within
+	 * the buffer is given, to get the pixel value. The strata is also given to indicate which strata's variance
+	 * to update. This function should not be called if the pixel is nan.
 	 *
-	 * @param int xBlockSize
-	 * @param int yBlockSize
-	 * @param int xBlock
-	 * @param int yBlock
-	 * @param int xValid
-	 * @param int yValid
+	 * @param std::vector<Variance>& threadVariances
+	 * @param void *p_buffer
+	 * @param int index
+	 * @param int strata
 	 */
 	inline void
-	readNewBlock(int xBlockSize, int yBlockSize, int xBlock, int yBlock, int xValid, int yValid) {
-		helper::rasterBandIO(this->band, this->band.p_buffer, xBlockSize, yBlockSize, xBlock, yBlock, xValid, yValid, true, false);
+	update(std::vector<helper::Variance>& threadVariances, void *p_buffer, int index, int strata) {
+		double val = helper::getPixelValueDependingOnType<double>(this->band.type, p_buffer, index);
+		threadVariances[strata].update(val);
 	}
 
 	/**
-	 * This function updates the Variance calculation for a particular pixel. The index of the pixel within
-	 * the block is given, to get the pixel value. The strata is also given to indicate which strata's variance
-	 * to update. This function should not be called if the pixel is nan.
+	 * This function merges the per-strata Variance calculations of a single thread into
+	 * the variances of this struct.
 	 *
-	 * @param int index
-	 * @param int strata
+	 * @param std::vector<Variance>& threadVariances
 	 */
 	inline void
-	update(int index, int strata) {
-		double val = helper::getPixelValueDependingOnType<double>(this->band.type, this->band.p_buffer, index);
-		variances[strata].update(val);	
+	merge(std::vector<helper::Variance>& threadVariances) {
+		for (size_t i = 0; i < this->variances.size(); i++) {
+			this->variances[i].merge(threadVariances[i]);
+		}
 	}
 
 	/**
@@ -238,6 +290,12 @@ struct OptimAllocationDataManager {
  * strata, meaning that if there are less than x (10,000) pixels of a particular strata,
  * all pixels within that strata will be saved and there is not a worry of missing out on
  * a particular strata due to having a lower proportion. 
+ *
+ * If capacities are given (see reservoirCapacities()), the saved indices of each strata are
+ * a reservoir of at most that many of the indices offered to it, which is a uniform random
+ * sample of them (Vitter's algorithm R). The memory used then depends on the number of
+ * samples rather than the number of pixels. The indexCountPerStrata vector always counts
+ * every index offered, so it is still compared against the number of samples required.
  */
 class IndexStorageVectors {
 private:
@@ -249,20 +307,64 @@ private:
 	std::vector<int64_t> firstXIndexCountPerStrata;
 	std::vector<std::vector<helper::Index>> firstXIndexesPerStrata;
 
+	std::vector<int64_t> capacities;
+	xso::xoshiro_4x64_plus rng;
+
 	int64_t numStrata;
 	int64_t x;
 
+	/**
+	 * merge the reservoir of another storage vectors into the reservoir of a strata, so that
+	 * the result is a uniform random sample of the indices offered to either. Each slot is
+	 * filled from one of the two reservoirs with probability proportional to the number of
+	 * indices it has been offered which are not yet represented, in the same way as
+	 * ahels::Reservoir::merge().
+	 *
+	 * @param int64_t strata
+	 * @param IndexStorageVectors& other
+	 */
+	void
+	mergeReservoir(int64_t strata, IndexStorageVectors& other) {
+		std::vector<helper::Index>& mine = this->indexesPerStrata[strata];
+		std::vector<helper::Index>& theirs = other.indexesPerStrata[strata];
+		int64_t remaining = this->indexCountPerStrata[strata];
+		int64_t otherRemaining = other.indexCountPerStrata[strata];
+		size_t size = static_cast<size_t>(std::min(this->capacities[strata], remaining + otherRemaining));
+
+		std::vector<helper::Index> merged;
+		merged.reserve(size);
+		while (merged.size() < size) {
+			bool fromOther = std::uniform_int_distribution<int64_t>(0, remaining + otherRemaining - 1)(this->rng) >= remaining;
+			std::vector<helper::Index>& source = fromOther ? theirs : mine;
+			(fromOther ? otherRemaining : remaining)--;
+
+			//take a random index out of the source, moving it's last index into the slot
+			size_t slot = std::uniform_int_distribution<size_t>(0, source.size() - 1)(this->rng);
+			merged.push_back(source[slot]);
+			source[slot] = source.back();
+			source.pop_back();
+		}
+
+		mine.swap(merged);
+		std::vector<helper::Index>().swap(theirs);
+	}
+
 public:
 	/**
 	 * Constructor. Set the numStrata and x variables.
 	 * Also, resize the vectors so that their size is numStrata.
+	 * 
+	 * The first x vectors grow as indices are added rather than being
+	 * allocated up front, since most strata have far more than x pixels.
 	 *
 	 * @param int64_t numStrata
 	 * @param int64_t x
+	 * @param std::vector<int64_t> capacities the reservoir size of each strata, or empty to keep every index
 	 */
-	IndexStorageVectors(int64_t numStrata, int64_t x) {
+	IndexStorageVectors(int64_t numStrata, int64_t x, std::vector<int64_t> capacities = {}) {
 		this->numStrata = numStrata;
 		this->x = x;
+		this->capacities = std::move(capacities);
 
 		this->strataCounts.resize(numStrata);
 		
@@ -271,9 +373,6 @@ public:
 		
 		this->firstXIndexCountPerStrata.resize(numStrata, 0);
 		this->firstXIndexesPerStrata.resize(numStrata);
-		for (int64_t i = 0; i < numStrata; i++) {
-			this->firstXIndexesPerStrata[i].resize(x);
-		}
 	}
 
 	/**
@@ -295,8 +394,17 @@ public:
 	 */
 	inline void
 	updateIndexesVector(int strata, helper::Index& index) {
-		this->indexesPerStrata[strata].push_back(index);
-		this->indexCountPerStrata[strata]++;
+		int64_t count = ++this->indexCountPerStrata[strata];
+		if (this->capacities.empty() || count <= this->capacities[strata]) {
+			this->indexesPerStrata[strata].push_back(index);
+			return;
+		}
+
+		//the reservoir is full, keep the index with probability capacity / count
+		uint64_t slot = std::uniform_int_distribution<uint64_t>(0, count - 1)(this->rng);
+		if (slot < static_cast<uint64_t>(this->capacities[strata])) {
+			this->indexesPerStrata[strata][slot] = index;
+		}
 	}
 
 	/**
@@ -310,7 +418,7 @@ public:
 	updateFirstXIndexesVector(int strata, helper::Index& index) {
 		int64_t i = firstXIndexCountPerStrata[strata];
 		if (i < this->x) {
-			firstXIndexesPerStrata[strata][i] = index;
+			firstXIndexesPerStrata[strata].push_back(index);
 			firstXIndexCountPerStrata[strata]++;	
 		}
 		else if (i == this->x) {
@@ -320,7 +428,54 @@ public:
 	}
 
 	/**
-	 * get references to shuffled strata index vectors. This method is called after the 
+	 * merge the index storage vectors filled by a single thread into this one. Strata counts
+	 * are summed, and saved indices are appended, or their reservoirs are merged if the
+	 * combined count exceeds the capacity of the strata. The first x indices of the other
+	 * storage vectors are appended only if the combined count does not exceed x, otherwise
+	 * the strata is marked as having too many pixels for the first x indices to be used,
+	 * in the same way as if the pixels had been iterated through by a single thread.
+	 *
+	 * @param IndexStorageVectors& other
+	 */
+	inline void
+	merge(IndexStorageVectors& other) {
+		for (int64_t i = 0; i < this->numStrata; i++) {
+			this->strataCounts[i] += other.strataCounts[i];
+
+			if (!this->capacities.empty() && this->indexCountPerStrata[i] + other.indexCountPerStrata[i] > this->capacities[i]) {
+				mergeReservoir(i, other);
+			}
+			else if (this->indexesPerStrata[i].empty()) {
+				this->indexesPerStrata[i].swap(other.indexesPerStrata[i]);
+			}
+			else {
+				auto begin = other.indexesPerStrata[i].begin();
+				auto end = other.indexesPerStrata[i].end();
+				this->indexesPerStrata[i].insert(this->indexesPerStrata[i].end(), begin, end);
+				std::vector<helper::Index>().swap(other.indexesPerStrata[i]);
+			}
+			this->indexCountPerStrata[i] += other.indexCountPerStrata[i];
+
+			int64_t count = this->firstXIndexCountPerStrata[i];
+			int64_t otherCount = other.firstXIndexCountPerStrata[i];
+			if (count > this->x) {
+				continue;
+			}
+
+			if (count + otherCount > this->x) {
+				std::vector<helper::Index>().swap(this->firstXIndexesPerStrata[i]);
+				this->firstXIndexCountPerStrata[i] = this->x + 1;
+			}
+			else {
+				auto begin = other.firstXIndexesPerStrata[i].begin();
+				this->firstXIndexesPerStrata[i].insert(this->firstXIndexesPerStrata[i].end(), begin, begin + otherCount);
+				this->firstXIndexCountPerStrata[i] = count + otherCount;
+			}
+		}
+	}
+
+	/**
+	 * get references to shuffled strata index vectors. This method is called after the
 	 * whole raster has been iterated through, and potential sample pixels are saved.
 	 *
 	 * If there are not enough values in the normal saved strata, but the first X samples
@@ -377,6 +532,26 @@ public:
 		return this->strataCounts;
 	}
 
+	/**
+	 * get the number of first x indices stored per strata.
+	 *
+	 * @returns int64_t
+	 */
+	inline int64_t
+	getX(void) {
+		return this->x;
+	}
+
+	/**
+	 * get the reservoir capacity of each strata, which is empty if every index is kept.
+	 *
+	 * @returns std::vector<int64_t>
+	 */
+	inline std::vector<int64_t>
+	getCapacities(void) {
+		return this->capacities;
+	}
+
 	/**
 	 * get the total number of data (not nan) pixels.
 	 *
@@ -396,15 +571,97 @@ public:
 
 /**
  * @ingroup strat
- * This function processes the strat raster in blocks using the 'random' method. In the random
- * method, every pixel in a particular strata has the same priority of being added as any
- * other pixel in that strata.
+ * This struct stores the results of a single chunk of the raster, which is processed by
+ * a single thread. Each thread fills its own index storage vectors, existing samples, and
+ * optim variances, so no locking is required while iterating through pixels. Once every
+ * thread has finished, the results of each chunk are merged in order.
+ *
+ * Exceptions can't be thrown out of a thread pool, so any exception thrown while processing
+ * the chunk is stored and re-thrown once the threads have been joined.
+ */
+struct StratChunkResult {
+	IndexStorageVectors indices;
+	IndexStorageVectors queinnecIndices;
+	std::vector<std::vector<OGRPoint>> existingSamples;
+	std::vector<helper::Variance> variances;
+	std::exception_ptr error = nullptr;
+
+	/**
+	 * Constructor, creates the index storage vectors, existing samples vector, and optim
+	 * variances vector for a chunk. The queinnec index storage vectors and variances
+	 * are left empty if they won't be used.
+	 *
+	 * @param int64_t numStrata
+	 * @param int64_t x
+	 * @param std::vector<int64_t> capacities
+	 * @param bool queinnec
+	 * @param bool optim
+	 */
+	StratChunkResult(int64_t numStrata, int64_t x, std::vector<int64_t> capacities, bool queinnec, bool optim) :
+		indices(numStrata, x, capacities),
+		queinnecIndices(queinnec ? numStrata : 0, x, queinnec ? capacities : std::vector<int64_t>()),
+		existingSamples(numStrata),
+		variances(optim ? numStrata : 0)
+	{}
+};
+
+/**
+ * @ingroup strat
+ * This function merges the results of every chunk processed by a thread into the
+ * final index storage vectors, existing samples, and optim variances. The chunks
+ * are merged in raster order, and any exception thrown by a thread is re-thrown.
+ *
+ * @param std::vector<StratChunkResult>& results
+ * @param IndexStorageVectors& indices
+ * @param IndexStorageVectors *p_queinnecIndices
+ * @param std::vector<std::vector<OGRPoint>>& existingSamples
+ * @param OptimAllocationDataManager& optim
+ */
+inline void
+mergeChunkResults(
+	std::vector<StratChunkResult>& results,
+	IndexStorageVectors& indices,
+	IndexStorageVectors *p_queinnecIndices,
+	std::vector<std::vector<OGRPoint>>& existingSamples,
+	OptimAllocationDataManager& optim)
+{
+	for (StratChunkResult& result : results) {
+		if (result.error) {
+			std::rethrow_exception(result.error);
+		}
+	}
+
+	for (StratChunkResult& result : results) {
+		indices.merge(result.indices);
+
+		if (p_queinnecIndices) {
+			p_queinnecIndices->merge(result.queinnecIndices);
+		}
+
+		for (size_t i = 0; i < existingSamples.size(); i++) {
+			auto begin = result.existingSamples[i].begin();
+			auto end = result.existingSamples[i].end();
+			existingSamples[i].insert(existingSamples[i].end(), begin, end);
+		}
+
+		if (optim.used) {
+			optim.merge(result.variances);
+		}
+	}
+}
+
+/**
+ * @ingroup strat
+ * This function processes a chunk of rows of blocks within the strat raster using the 'random'
+ * method. It is called from within a thread by the processBlocksStratRandom() function, and
+ * fills the index storage vectors, existing samples, and variances of it's own StratChunkResult.
  *
- * First, memory is allocated and structures are initialized for random value calculation and
- * optim allocation.
+ * First, a BlockReader is created for the blocks which this thread reads, and a random number generator
+ * and random value controller are created for this thread.
  *
- * Next, iterate through the blocks within the raster. For each block:
- *  - read the strat raster (and potentially access & optim rasters) into memory
+ * Next, iterate through the blocks within the chunk. For each block:
+ *  - get the strat raster (and potentially access & optim rasters) block, which the BlockReader
+ *    has read ahead on an I/O thread
  *  - calculate rand values for the new block
  *  - iterate through the pixels in the block
  *
@@ -415,8 +672,138 @@ public:
  *  - add index to existing vector if the pixel is part of an existing sample network
  *  - If the pixel is both accessible and not already sampled, update the index storage vectors
  *
- * Once all blocks have been processed, free any allocated memory and calculate the sample
- * allocation per strata, and return this allocation.
+ * @param int yBlockStart
+ * @param int yBlockEnd
+ * @param int numStrata
+ * @param RasterBandMetaData& band
+ * @param Access& access
+ * @param Existing& existing
+ * @param OptimAllocationDataManager& optim
+ * @param StratChunkResult& result
+ * @param uint64_t multiplier
+ * @param int width
+ * @param int height
+ */
+template <typename T>
+void
+processChunkStratRandom(
+	int yBlockStart,
+	int yBlockEnd,
+	int numStrata,
+	helper::RasterBandMetaData& band,
+	access::Access& access,
+	existing::Existing& existing,
+	OptimAllocationDataManager& optim,
+	StratChunkResult& result,
+	uint64_t multiplier,
+	int width,
+	int height)
+{
+	T nanInt = static_cast<T>(band.nan);
+	int xBlockSize = band.xBlockSize;
+	int yBlockSize = band.yBlockSize;
+
+	//the strat, access, and optim bands are read ahead on an I/O thread while the current block is processed
+	std::vector<helper::RasterBandMetaData *> bands = {&band};
+	if (access.used) {
+		bands.push_back(&access.band);
+	}
+	if (optim.used) {
+		bands.push_back(&optim.band);
+	}
+	reader::BlockReader blocks(
+		bands,
+		reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+		xBlockSize,
+		yBlockSize
+	);
+
+	//each thread has it's own random number generator
+	xso::xoshiro_4x64_plus rng;
+	helper::RandValController rand(xBlockSize, yBlockSize, multiplier, &rng);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_buffer = reinterpret_cast<T *>(p_block->buffers[0]);
+		int8_t *p_access = access.used ? reinterpret_cast<int8_t *>(p_block->buffers[1]) : nullptr;
+		void *p_optim = optim.used ? p_block->buffers.back() : nullptr;
+		int xBlock = p_block->window.xBlock;
+		int yBlock = p_block->window.yBlock;
+		int xValid = p_block->window.xValid;
+		int yValid = p_block->window.yValid;
+
+		//calculate rand vals
+		rand.calculateRandValues();
+
+		//iterate through block and update vectors
+		for (int y = 0; y < yValid; y++) {
+			int blockIndex = y * xBlockSize;
+			for (int x = 0; x < xValid; x++) {
+				T val = p_buffer[blockIndex];
+				helper::Index index = {x + xBlock * xBlockSize, y + yBlock * yBlockSize};
+
+				bool isNan = val == nanInt;
+				bool accessible = !access.used || p_access[blockIndex] != 1;
+				bool alreadySampled = existing.used && existing.containsIndex(index.x, index.y);
+
+				//check nan
+				if (isNan) {
+					blockIndex++;
+					continue;
+				}
+
+				if (val >= numStrata) {
+					throw std::runtime_error("the num_strata indicated for the strat raster band is less than or equal to one of the value sin that band.");
+				}
+
+				if (val < 0) {
+					std::string errmsg = "a negative value of " + std::to_string(val) + " was found in the strat raster, and has not been marked as a nodata value.";
+					throw std::runtime_error(errmsg);
+				}
+
+				//update optim allocation variance calculations
+				if (optim.used) {
+					optim.update(result.variances, p_optim, blockIndex, val);
+				}
+
+				//udpate strata counts
+				result.indices.updateStrataCounts(val);
+
+				//update existing sampled strata
+				if (alreadySampled) {
+					result.existingSamples[val].push_back(existing.getPoint(index.x, index.y));
+				}
+
+				//add val to stored indices
+				if (accessible && !alreadySampled) {
+					result.indices.updateFirstXIndexesVector(val, index);
+
+					if (rand.keep(blockIndex)) {
+						result.indices.updateIndexesVector(val, index);
+					}
+				}
+
+				//increment block index
+				blockIndex++;
+			}
+		}
+	}
+}
+
+/**
+ * @ingroup strat
+ * This function processes the strat raster in blocks using the 'random' method. In the random
+ * method, every pixel in a particular strata has the same priority of being added as any
+ * other pixel in that strata.
+ *
+ * The raster is split into chunks of rows of blocks depending on the number of threads,
+ * and each chunk is processed by the processChunkStratRandom() function within a thread.
+ * Since the whole raster must be iterated through, and each pixel is independant of the
+ * others when using the random method, every thread has it's own index storage vectors,
+ * existing sample vectors, optim variances, and random number generator. These are
+ * merged once all of the threads have finished.
+ *
+ * Once all blocks have been processed, calculate the sample allocation per strata,
+ * and return this allocation.
  *
  * @param int numSamples
  * @param int numStrata
@@ -426,13 +813,13 @@ public:
  * @param IndexStorageVectors& indices
  * @param std::vector<std::vector<OGRPoint>>& existingSamples
  * @param uint64_t multiplier
- * @param xoshiro_4x64_plus& rng
  * @param std::string allocation
  * @param OptimAllocationDataManager& optim
  * @param std::vector<double>weights
  * @param int width
  * @param int height
- * 
+ * @param int threads
+ *
  * @returns std::vector<int64_t>
  */
 template <typename T>
@@ -446,114 +833,62 @@ processBlocksStratRandom(
 	IndexStorageVectors& indices,
 	std::vector<std::vector<OGRPoint>>& existingSamples,
 	uint64_t multiplier,
-	xso::xoshiro_4x64_plus& rng,
 	std::string allocation,
 	OptimAllocationDataManager& optim,
 	std::vector<double> weights,
 	int width,
-	int height) 
+	int height,
+	int threads)
 {
-	T nanInt = static_cast<T>(band.nan);
-	int xBlockSize = band.xBlockSize;
        	int yBlockSize = band.yBlockSize;
 
-	int xBlocks = (width + xBlockSize - 1) / xBlockSize;
 	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
-
-	band.p_buffer = VSIMalloc3(xBlockSize, yBlockSize, band.size);
-	T *p_buffer = reinterpret_cast<T *>(band.p_buffer);
-	int8_t *p_access = nullptr;
-	if (access.used) {
-		access.band.p_buffer = VSIMalloc3(xBlockSize, yBlockSize, access.band.size);
-		p_access = reinterpret_cast<int8_t *>(access.band.p_buffer);
-	}
-
-	helper::RandValController rand(band.xBlockSize, band.yBlockSize, multiplier, &rng);
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
 
 	if (optim.used) {
-		optim.init(numStrata, xBlockSize, yBlockSize);
+		optim.init(numStrata);
 	}
 
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			int xValid, yValid;
-	
-			//read block
-			band.p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-			helper::rasterBandIO(band, band.p_buffer, xBlockSize, yBlockSize, xBlock, yBlock, xValid, yValid, true, false);
+	std::vector<StratChunkResult> results;
+	results.reserve(chunks);
+	for (int i = 0; i < chunks; i++) {
+		results.emplace_back(numStrata, indices.getX(), indices.getCapacities(), false, optim.used);
+	}
 
-			//read access block
-			if (access.used) {
-				helper::rasterBandIO(access.band, access.band.p_buffer, xBlockSize, yBlockSize, xBlock, yBlock, xValid, yValid, true, false);
+	boost::asio::thread_pool pool(threads);
+	for (int i = 0; i < chunks; i++) {
+		int yBlockStart = i * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+		StratChunkResult *p_result = &results[i];
+
+		boost::asio::post(pool, [
+			yBlockStart,
+			yBlockEnd,
+			numStrata,
+			&band,
+			&access,
+			&existing,
+			&optim,
+			p_result,
+			multiplier,
+			width,
+			height
+		] {
+			try {
+				processChunkStratRandom<T>(
+					yBlockStart, yBlockEnd, numStrata, band, access,
+					existing, optim, *p_result, multiplier, width, height
+				);
 			}
-
-			//read mraster block for optim
-			if (optim.used) {
-				optim.readNewBlock(xBlockSize, yBlockSize, xBlock, yBlock, xValid, yValid);
+			catch (...) {
+				p_result->error = std::current_exception();
 			}
-
-			//calculate rand vals
-			rand.calculateRandValues();
-
-			//iterate through block and update vectors
-			for (int y = 0; y < yValid; y++) {
-				int blockIndex = y * xBlockSize;
-				for (int x = 0; x < xValid; x++) {
-					T val = p_buffer[blockIndex];
-					helper::Index index = {x + xBlock * xBlockSize, y + yBlock * yBlockSize};
-
-					bool isNan = val == nanInt;
-					bool accessible = !access.used || p_access[blockIndex] != 1;
-					bool alreadySampled = existing.used && existing.containsIndex(index.x, index.y);
-
-					//check nan
-					if (isNan) {
-						blockIndex++;
-						continue;
-					}
-
-					if (val >= numStrata) {
-						throw std::runtime_error("the num_strata indicated for the strat raster band is less than or equal to one of the value sin that band.");
-					}
-
-					if (val < 0) {
-						std::string errmsg = "a negative value of " + std::to_string(val) + " was found in the strat raster, and has not been marked as a nodata value.";
-						throw std::runtime_error(errmsg);
-					}
-
-					//update optim allocation variance calculations
-					if (optim.used) {
-						optim.update(blockIndex, val);
-					}
-
-					//udpate strata counts
-					indices.updateStrataCounts(val);
-					
-					//update existing sampled strata
-					if (alreadySampled) {
-						existingSamples[val].push_back(existing.getPoint(index.x, index.y));
-					}
-
-					//add val to stored indices
-					if (accessible && !alreadySampled) {
-						indices.updateFirstXIndexesVector(val, index);
-
-						if (rand.next()) {
-							indices.updateIndexesVector(val, index);
-						}					
-					}
-
-					//increment block index
-					blockIndex++;
-				}
-			}
-		}
+		});
 	}
+	pool.join();
 
-	VSIFree(band.p_buffer);
-	if (access.used) {
-		VSIFree(access.band.p_buffer);
-	}	
+	mergeChunkResults(results, indices, nullptr, existingSamples, optim);
 
 	if (optim.used) {
 		weights = optim.getAllocationPercentages();
@@ -693,29 +1028,98 @@ struct FocalWindow {
 				       this->m[x + width * 6] && 
 				       this->valid[x + y * width];
 			default:
-				throw std::runtime_error("wrow must be one of 3, 5, 7.");				
+				throw std::runtime_error("wrow must be one of 3, 5, 7.");
+		}
+	}
+
+	/**
+	 * This function checks whether every pixel horizontally within the
+	 * focal window is the same. The start index is the index of the
+	 * left-most pixel in the focal window within the buffer.
+	 *
+	 * @param T *p_buffer
+	 * @param int start
+	 *
+	 * @returns bool
+	 */
+	template <typename T>
+	inline bool
+	checkHorizontal(T *p_buffer, int start) {
+		switch (this->wcol) {
+			case 3:
+				return p_buffer[start] == p_buffer[start + 1] &&
+				       p_buffer[start] == p_buffer[start + 2];
+			case 5:
+				return p_buffer[start] == p_buffer[start + 1] &&
+				       p_buffer[start] == p_buffer[start + 2] &&
+				       p_buffer[start] == p_buffer[start + 3] &&
+				       p_buffer[start] == p_buffer[start + 4];
+			case 7:
+				return p_buffer[start] == p_buffer[start + 1] &&
+				       p_buffer[start] == p_buffer[start + 2] &&
+				       p_buffer[start] == p_buffer[start + 3] &&
+				       p_buffer[start] == p_buffer[start + 4] &&
+				       p_buffer[start] == p_buffer[start + 5] &&
+				       p_buffer[start] == p_buffer[start + 6];
+			default:
+				throw std::runtime_error("wcol must be one of 3, 5, 7.");
+		}
+	}
+
+	/**
+	 * This function checks whether every pixel vertically within the
+	 * focal window is the same. The start index is the index of the
+	 * top-most pixel in the focal window within the buffer.
+	 *
+	 * @param T *p_buffer
+	 * @param int start
+	 *
+	 * @returns bool
+	 */
+	template <typename T>
+	inline bool
+	checkVertical(T *p_buffer, int start) {
+		switch (this->wrow) {
+			case 3:
+				return p_buffer[start] == p_buffer[start + width * 1] &&
+				       p_buffer[start] == p_buffer[start + width * 2];
+			case 5:
+				return p_buffer[start] == p_buffer[start + width * 1] &&
+				       p_buffer[start] == p_buffer[start + width * 2] &&
+				       p_buffer[start] == p_buffer[start + width * 3] &&
+				       p_buffer[start] == p_buffer[start + width * 4];
+			case 7:
+				return p_buffer[start] == p_buffer[start + width * 1] &&
+				       p_buffer[start] == p_buffer[start + width * 2] &&
+				       p_buffer[start] == p_buffer[start + width * 3] &&
+				       p_buffer[start] == p_buffer[start + width * 4] &&
+				       p_buffer[start] == p_buffer[start + width * 5] &&
+				       p_buffer[start] == p_buffer[start + width * 6];
+			default:
+				throw std::runtime_error("wrow must be one of 3, 5, 7.");
 		}
 	}
 };
 
 /**
  * @ingroup strat
- * This function processes the strat raster in blocks using the 'Queinnec' method. In the Queinnec
- * method, pixels which are surrounded by pixels of the same strata are prioritized for sampling 
- * over pixels which aren't.
+ * This function processes a chunk of scanline blocks within the strat raster using the 'Queinnec'
+ * method. It is called from within a thread by the processBlocksStratQueinnec() function, and fills
+ * the index storage vectors, existing samples, and variances of it's own StratChunkResult.
  *
- * First, the block size is adjusted to be scanlines with a height of either the original y block size,
- * or 128. This is done because the raster needs to be read as scanlines for the FocalWindow struct
- * to work well and not get any more complicated than it already is. However, we want the raster IO
- * to still be as efficient as possible, so chunks of the raster are still read on block boundaries,
- * just containing a lot more than just 1 block.  
- *
- * Next, memory is allocated and structs are created for random value calculation and optim allocation.
- * More memory is allocated than just 1 of the chunks (xBlockSize * yBlockSize), this is because
+ * First, block readers are created and structs are created for the focal window and random value calculation.
+ * The strat and access blocks are larger than just 1 of the chunks (xBlockSize * yBlockSize), this is because
  * usign the focal window struct method, we may have to read in some of the final few pixels of the
- * previous chunk, to the start of the new chunk.
+ * previous chunk, to the start of the new chunk. This padding is read for both the strat raster and
+ * the access raster.
+ *
+ * Each thread has it's own focal window. If the first block of this thread is not the first block of the
+ * raster, the focal window has not seen the rows in the padding above it. Those rows are iterated through
+ * first to set the focal window matrix and validity, without updating any of the counts or index storage
+ * vectors, since they are counted by the thread processing the previous chunk. This ensures that exactly the
+ * same queinnec pixels are found as if the raster was processed from top to bottom by a single thread.
  *
- * Next, iterate thorugh the blocks within the raster. For each block:
+ * Next, iterate thorugh the blocks within the chunk. For each block:
  *  - read block from the strat raster
  *  - calculate rand values (both normal and queinnec) for the new block
  *  - iterate through the pixels in the block
@@ -744,145 +1148,145 @@ struct FocalWindow {
  *  - set focal window matrix vector for the current pixel by checking horizontally adjacent pixels
  *  - check the focal window matrix for the pixel which will have just had all of it's vertical pixels horizontally checked.
  *    Calling this check on a pixel which would have a negative y will always result in a false due to the focal window
- *    matrix being automatically set to false. If this check succeeds -- check vertical pixels to see if they are the same 
+ *    matrix being automatically set to false. If this check succeeds -- check vertical pixels to see if they are the same
  *    and if so update the queinnec index storage vectors.
  *
- * Once all blocks have been processed, free any allocated memory and calculate the sample allocation per strata,
- * and return this allocation.
- *
- * @param int numSamples
- * @param int numStreata
+ * @param int yBlockStart
+ * @param int yBlockEnd
+ * @param int xBlockSize
+ * @param int yBlockSize
  * @param RasterBandMetaData& band
  * @param Access& access
  * @param Existing& existing
- * @param IndexStorageVectors& indices
- * @param IndexStorageVectors& queinnecIndices
- * @param FocalWindow& fw
- * @param std::vector<std::vector<OGRPoint>>& existingSamples
+ * @param OptimAllocationDataManager& optim
+ * @param StratChunkResult& result
+ * @param int wrow
+ * @param int wcol
  * @param uint64_t multiplier
  * @param uint64_t queinnecMultiplier
- * @param xso::xoshiro_4x64_plus& rng
- * @param std::string allocation
- * @param OptimAllocatoinDataManager& optim
- * @param std::vector<double> weights
  * @param int width
  * @param int height
- *
- * @returns std::vector<int64_t>
  */
 template <typename T>
-std::vector<int64_t>
-processBlocksStratQueinnec(
-	int numSamples,
-	int numStrata,
+void
+processChunkStratQueinnec(
+	int yBlockStart,
+	int yBlockEnd,
+	int xBlockSize,
+	int yBlockSize,
 	helper::RasterBandMetaData& band,
 	access::Access& access,
 	existing::Existing& existing,
-	IndexStorageVectors& indices,
-	IndexStorageVectors& queinnecIndices,
-	FocalWindow& fw,
-	std::vector<std::vector<OGRPoint>>& existingSamples,
+	OptimAllocationDataManager& optim,
+	StratChunkResult& result,
+	int wrow,
+	int wcol,
 	uint64_t multiplier,
 	uint64_t queinnecMultiplier,
-	xso::xoshiro_4x64_plus& rng,
-	std::string allocation,
-	OptimAllocationDataManager& optim,
-	std::vector<double> weights,
 	int width,
-	int height) 
+	int height)
 {
 	T nanInt = static_cast<T>(band.nan);
-
-	//adjust blocks to be a large chunk of scanlines
-	int xBlockSize = band.xBlockSize;
-	int yBlockSize = band.yBlockSize;
-	if (xBlockSize != width) {
-		xBlockSize = width;
-	}
-	else {
-		yBlockSize = std::min(128, height);
+	FocalWindow fw(wrow, wcol, width);
+	int pad = fw.vpad * 2;
+
+	//determine the windows to read. The strat and access windows contain padding rows above the
+	//block for the focal window, except for the first block in the raster which has no rows above it.
+	std::vector<reader::Window> paddedWindows;
+	std::vector<reader::Window> windows;
+	for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
+		reader::Window window;
+		window.yBlock = yBlock;
+		window.yOff = yBlock * yBlockSize;
+		window.xValid = width;
+		window.yValid = std::min(yBlockSize, height - yBlock * yBlockSize);
+		windows.push_back(window);
+
+		int yPad = (yBlock == 0) ? 0 : pad;
+		window.yOff -= yPad;
+		window.yValid += yPad;
+		paddedWindows.push_back(window);
 	}
 
-	//allocate required memory
-	band.p_buffer = VSIMalloc3(xBlockSize, yBlockSize + fw.vpad * 2, band.size);
-	T *p_buffer = reinterpret_cast<T *>(band.p_buffer);
-	int8_t *p_access = nullptr;
+	//the strat, access, and optim bands are read ahead on I/O threads while the current block is processed
+	std::vector<helper::RasterBandMetaData *> bands = {&band};
 	if (access.used) {
-		access.band.p_buffer = VSIMalloc3(xBlockSize, yBlockSize, access.band.size);
-		p_access = reinterpret_cast<int8_t *>(access.band.p_buffer);
+		bands.push_back(&access.band);
 	}
+	reader::BlockReader blocks(bands, paddedWindows, xBlockSize, yBlockSize + pad);
 
-	helper::RandValController rand(xBlockSize, yBlockSize, multiplier, &rng);
-	helper::RandValController queinnecRand(xBlockSize, yBlockSize, queinnecMultiplier, &rng);
-
+	std::unique_ptr<reader::BlockReader> p_optimBlocks;
 	if (optim.used) {
-		optim.init(numStrata, xBlockSize, yBlockSize);
+		p_optimBlocks = std::make_unique<reader::BlockReader>(
+			std::vector<helper::RasterBandMetaData *>{&optim.band},
+			windows,
+			xBlockSize,
+			yBlockSize
+		);
 	}
 
-	//get number of blocks
-	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	//each thread has it's own random number generator
+	xso::xoshiro_4x64_plus rng;
+	helper::RandValController rand(xBlockSize, yBlockSize, multiplier, &rng);
+	helper::RandValController queinnecRand(xBlockSize, yBlockSize, queinnecMultiplier, &rng);
+
+	for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
+		//get the strat, access, and optim blocks
+		reader::Block *p_block = blocks.next();
+		T *p_buffer = reinterpret_cast<T *>(p_block->buffers[0]);
+		int8_t *p_access = access.used ? reinterpret_cast<int8_t *>(p_block->buffers[1]) : nullptr;
+		void *p_optim = optim.used ? p_optimBlocks->next()->buffers[0] : nullptr;
 
-	int fwyi = 0;
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		//read block
-		int xOff = 0;
-		int yOff = yBlock * yBlockSize;
-		int xValid = width;
 		int yValid = std::min(yBlockSize, height - yBlock * yBlockSize);
+		int yPad = p_block->window.yValid - yValid;
+		int stratYOff = p_block->window.yOff;
 
-		//read block
-		if (yBlock == 0) { 
-			CPLErr err = band.p_band->RasterIO(GF_Read, xOff, yOff, xValid, yValid, band.p_buffer, xValid, yValid, band.type, 0, 0);
-			if (err) {
-				throw std::runtime_error("error reading block from raster.");
-			}
-		}
-		else {
-			int stratYOff = yOff - fw.vpad * 2;
-			int stratYValid = yValid + fw.vpad * 2;
-			CPLErr err = band.p_band->RasterIO(GF_Read, xOff, stratYOff, xValid, stratYValid, band.p_buffer, xValid, stratYValid, band.type, 0, 0);
-			if (err) {
-				throw std::runtime_error("error reading block from raster.");
-			}
-		}
+		//calculate rand vals
+		rand.calculateRandValues();
+		queinnecRand.calculateRandValues();
 
-		//read access block
-		if (access.used) {
-			CPLErr err = access.band.p_band->RasterIO(GF_Read, xOff, yOff, xValid, yValid, access.band.p_buffer, xValid, yValid, GDT_Int8, 0, 0);
-			if (err) {
-				throw std::runtime_error("error reading block from raster.");
-			}
-		}
+		//set the focal window matrix and validity for the padding rows, if this thread hasn't seen them
+		if (yBlock == yBlockStart && yPad != 0) {
+			for (int y = 0; y < yPad; y++) {
+				int row = stratYOff + y;
+				int fwyi = (row % fw.wrow) * width;
+				fw.reset(row);
 
-		//read mraster block for optim
-		if (optim.used) {
-			CPLErr err = optim.band.p_band->RasterIO(GF_Read, xOff, yOff, xValid, yValid, optim.band.p_buffer, xValid, yValid, optim.band.type, 0, 0);
-			if (err) {
-				throw std::runtime_error("error reading block from raster.");
+				for (int x = fw.hpad; x < width - fw.hpad; x++) {
+					T val = p_buffer[y * width + x];
+					if (val == nanInt) {
+						continue;
+					}
+
+					bool accessible = !access.used || p_access[y * width + x] != 1;
+					bool alreadySampled = existing.used && existing.containsIndex(x, row);
+
+					fw.m[fwyi + x] = fw.checkHorizontal(p_buffer, y * width + x - fw.hpad);
+					fw.valid[fwyi + x] = accessible && !alreadySampled;
+				}
 			}
 		}
 
-		//calculate rand vals
-		rand.calculateRandValues();
-		queinnecRand.calculateRandValues();
-
 		//calculate the within-block index. In the case where there is a padding at the top of the block,
 		//adjust for that.
-		int newBlockStart = (yBlock == 0) ? 0 : width * fw.vpad * 2;
+		int newBlockStart = width * yPad;
 
 		//iterate through block and update vectors
 		for (int y = 0; y < yValid; y++) {
+			int row = yBlock * yBlockSize + y;
+			int fwyi = (row % fw.wrow) * width;
+
 			//reset upcomming row in focal window matrix
-			fw.reset(yBlock * yBlockSize + y);	
-			
+			fw.reset(row);
+
 			//the indexes from 0 to the horizontal pad cannot be a queinnec index
-			//because they are too close to the edges of the raster	
+			//because they are too close to the edges of the raster
 			for (int x = 0; x < fw.hpad; x++) {
 				T val = p_buffer[newBlockStart + y * width + x];
-				helper::Index index = {x, y + yBlock * yBlockSize};
+				helper::Index index = {x, row};
 
 				bool isNan = val == nanInt;
-				bool accessible = !access.used || p_access[y * width + x] != 1;
+				bool accessible = !access.used || p_access[newBlockStart + y * width + x] != 1;
 				bool alreadySampled = existing.used && existing.containsIndex(index.x, index.y);
 
 				//check nan
@@ -892,35 +1296,35 @@ processBlocksStratQueinnec(
 
 				//update optim allocation variance calculations
 				if (optim.used) {
-					optim.update(y * width + x, val);
+					optim.update(result.variances, p_optim, y * width + x, val);
 				}
 
 				//update strata counts
-				indices.updateStrataCounts(val);
+				result.indices.updateStrataCounts(val);
 
 				//update existing samled strata
 				if (alreadySampled) {
-					existingSamples[val].push_back(existing.getPoint(index.x, index.y));
+					result.existingSamples[val].push_back(existing.getPoint(index.x, index.y));
 				}
 
 				//add val to stored indices
 				if (accessible && !alreadySampled) {
-					indices.updateFirstXIndexesVector(val, index);
+					result.indices.updateFirstXIndexesVector(val, index);
 
-					if (rand.next()) {
-						indices.updateIndexesVector(val, index);
+					if (rand.keep(y * width + x)) {
+						result.indices.updateIndexesVector(val, index);
 					}
 				}
 			}
-	
+
 			for (int x = fw.hpad; x < width - fw.hpad; x++) {
 				T val = p_buffer[newBlockStart + y * width + x];
-				helper::Index index = {x, y + yBlock * yBlockSize};
+				helper::Index index = {x, row};
 
 				bool isNan = val == nanInt;
-				bool accessible = !access.used || p_access[y * width + x] != 1;
+				bool accessible = !access.used || p_access[newBlockStart + y * width + x] != 1;
 				bool alreadySampled = existing.used && existing.containsIndex(index.x, index.y);
-				
+
 				//check nan
 				if (isNan) {
 					continue;
@@ -928,98 +1332,55 @@ processBlocksStratQueinnec(
 
 				//update optim allocation variance calculations
 				if (optim.used) {
-					optim.update(y * width + x, val);
+					optim.update(result.variances, p_optim, y * width + x, val);
 				}
 
 				//update strata counts
-				indices.updateStrataCounts(val);
+				result.indices.updateStrataCounts(val);
 
 				//update exisitng sampled strata
 				if (alreadySampled) {
-					existingSamples[val].push_back(existing.getPoint(index.x, index.y));
+					result.existingSamples[val].push_back(existing.getPoint(index.x, index.y));
 				};
 
 				//set focal window matrix value by checking horizontal indices within focal window
-				int start = newBlockStart + y * width + x - fw.hpad;
-				switch (fw.wcol) {
-					case 3:
-						fw.m[fwyi + x] = p_buffer[start] == p_buffer[start + 1] &&
-								 p_buffer[start] == p_buffer[start + 2];
-						break;
-					case 5: 
-						fw.m[fwyi + x] = p_buffer[start] == p_buffer[start + 1] &&
-								 p_buffer[start] == p_buffer[start + 2] &&
-								 p_buffer[start] == p_buffer[start + 3] &&
-								 p_buffer[start] == p_buffer[start + 4];
-						break;
-					case 7: 
-						fw.m[fwyi + x] = p_buffer[start] == p_buffer[start + 1] &&
-								 p_buffer[start] == p_buffer[start + 2] &&
-								 p_buffer[start] == p_buffer[start + 3] &&
-								 p_buffer[start] == p_buffer[start + 4] &&
-								 p_buffer[start] == p_buffer[start + 5] &&
-								 p_buffer[start] == p_buffer[start + 6];
-						break;
-					default:
-						throw std::runtime_error("wcol must be one of 3, 5, 6.");
-				}
-				
-				//add val to stored indices and update focal window validity	
+				fw.m[fwyi + x] = fw.checkHorizontal(p_buffer, newBlockStart + y * width + x - fw.hpad);
+
+				//add val to stored indices and update focal window validity
 				if (accessible && !alreadySampled) {
-					indices.updateFirstXIndexesVector(val, index);
+					result.indices.updateFirstXIndexesVector(val, index);
 
-					if (rand.next()) {
-						indices.updateIndexesVector(val, index);
+					if (rand.keep(y * width + x)) {
+						result.indices.updateIndexesVector(val, index);
 					}
-					
+
 					fw.valid[fwyi + x] = true;
 				}
 
 				//add index to queinnec indices if surrounding focal window is all the same
 				helper::Index fwIndex = {x, index.y - fw.vpad};
 				if (fw.check(fwIndex.x, fwIndex.y)) {
-					bool add = false;
 					int start = newBlockStart + y * width + x - 2 * width * fw.vpad;
-					switch (fw.wrow) {
-						case 3:
-							add = p_buffer[start] == p_buffer[start + width * 1] &&
-							      p_buffer[start] == p_buffer[start + width * 2];
-							break;
-						case 5:
-							add = p_buffer[start] == p_buffer[start + width * 1] &&
-							      p_buffer[start] == p_buffer[start + width * 2] &&
-							      p_buffer[start] == p_buffer[start + width * 3] &&
-							      p_buffer[start] == p_buffer[start + width * 4];
-							break;
-						case 7:
-							add = p_buffer[start] == p_buffer[start + width * 1] &&
-							      p_buffer[start] == p_buffer[start + width * 2] &&
-							      p_buffer[start] == p_buffer[start + width * 3] &&
-							      p_buffer[start] == p_buffer[start + width * 4] &&
-							      p_buffer[start] == p_buffer[start + width * 5] &&
-							      p_buffer[start] == p_buffer[start + width * 6];
-							break;
-					}
 
-					if (add) {
+					if (fw.checkVertical(p_buffer, start)) {
 						//(we know if we've made it here that val is the same for both the fw add and the current index)
-						queinnecIndices.updateFirstXIndexesVector(val, fwIndex);
+						result.queinnecIndices.updateFirstXIndexesVector(val, fwIndex);
 
-						if (queinnecRand.next()) {
-							queinnecIndices.updateIndexesVector(val, fwIndex);
+						if (queinnecRand.keep(y * width + x)) {
+							result.queinnecIndices.updateIndexesVector(val, fwIndex);
 						}
 					}
 				}
 			}
 
 			//the indexes from width - horizontal pad to width cannot be a queinnec index
-			//because they are too close to the edges of the raster	
+			//because they are too close to the edges of the raster
 			for (int x = width - fw.hpad; x < width; x++) {
 				T val = p_buffer[newBlockStart + y * width + x];
-				helper::Index index = {x, y + yBlock * yBlockSize};
+				helper::Index index = {x, row};
 
 				bool isNan = val == nanInt;
-				bool accessible = !access.used || p_access[y * width + x] != 1;
+				bool accessible = !access.used || p_access[newBlockStart + y * width + x] != 1;
 				bool alreadySampled = existing.used && existing.containsIndex(index.x, index.y);
 
 				//check nan
@@ -1029,38 +1390,155 @@ processBlocksStratQueinnec(
 
 				//update optim allocation variance calculations
 				if (optim.used) {
-					optim.update(y * width + x, val);
+					optim.update(result.variances, p_optim, y * width + x, val);
+				}
+
+				//update strata counts
+				result.indices.updateStrataCounts(val);
+
+				//update existing sampled strata
+				if (alreadySampled) {
+					result.existingSamples[val].push_back(existing.getPoint(index.x, index.y));
 				}
 
-				//update strata counts
-				indices.updateStrataCounts(val);
+				//add val to stored indices
+				if (accessible && !alreadySampled) {
+					result.indices.updateFirstXIndexesVector(val, index);
+
+					if (rand.keep(y * width + x)) {
+						result.indices.updateIndexesVector(val, index);
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @ingroup strat
+ * This function processes the strat raster in blocks using the 'Queinnec' method. In the Queinnec
+ * method, pixels which are surrounded by pixels of the same strata are prioritized for sampling
+ * over pixels which aren't.
+ *
+ * First, the block size is adjusted to be scanlines with a height of either the original y block size,
+ * or 128. This is done because the raster needs to be read as scanlines for the FocalWindow struct
+ * to work well and not get any more complicated than it already is. However, we want the raster IO
+ * to still be as efficient as possible, so chunks of the raster are still read on block boundaries,
+ * just containing a lot more than just 1 block.
+ *
+ * Next, the scanline blocks are split into chunks depending on the number of threads, and each chunk
+ * is processed by the processChunkStratQueinnec() function within a thread. Every thread has it's own
+ * index storage vectors, queinnec index storage vectors, existing sample vectors, optim variances,
+ * focal window, and random number generator. These are merged once all of the threads have finished.
+ *
+ * Once all blocks have been processed, calculate the sample allocation per strata, and return this
+ * allocation.
+ *
+ * @param int numSamples
+ * @param int numStreata
+ * @param RasterBandMetaData& band
+ * @param Access& access
+ * @param Existing& existing
+ * @param IndexStorageVectors& indices
+ * @param IndexStorageVectors& queinnecIndices
+ * @param int wrow
+ * @param int wcol
+ * @param std::vector<std::vector<OGRPoint>>& existingSamples
+ * @param uint64_t multiplier
+ * @param uint64_t queinnecMultiplier
+ * @param std::string allocation
+ * @param OptimAllocatoinDataManager& optim
+ * @param std::vector<double> weights
+ * @param int width
+ * @param int height
+ * @param int threads
+ *
+ * @returns std::vector<int64_t>
+ */
+template <typename T>
+std::vector<int64_t>
+processBlocksStratQueinnec(
+	int numSamples,
+	int numStrata,
+	helper::RasterBandMetaData& band,
+	access::Access& access,
+	existing::Existing& existing,
+	IndexStorageVectors& indices,
+	IndexStorageVectors& queinnecIndices,
+	int wrow,
+	int wcol,
+	std::vector<std::vector<OGRPoint>>& existingSamples,
+	uint64_t multiplier,
+	uint64_t queinnecMultiplier,
+	std::string allocation,
+	OptimAllocationDataManager& optim,
+	std::vector<double> weights,
+	int width,
+	int height,
+	int threads)
+{
+	//adjust blocks to be a large chunk of scanlines
+	int xBlockSize = band.xBlockSize;
+	int yBlockSize = band.yBlockSize;
+	if (xBlockSize != width) {
+		xBlockSize = width;
+	}
+	else {
+		yBlockSize = std::min(128, height);
+	}
+
+	//get number of blocks, and split them into chunks for each thread
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
 
-				//update existing sampled strata
-				if (alreadySampled) {
-					existingSamples[val].push_back(existing.getPoint(index.x, index.y));
-				}
+	if (optim.used) {
+		optim.init(numStrata);
+	}
 
-				//add val to stored indices
-				if (accessible && !alreadySampled) {
-					indices.updateFirstXIndexesVector(val, index);
+	std::vector<StratChunkResult> results;
+	results.reserve(chunks);
+	for (int i = 0; i < chunks; i++) {
+		results.emplace_back(numStrata, indices.getX(), indices.getCapacities(), true, optim.used);
+	}
 
-					if (rand.next()) {
-						indices.updateIndexesVector(val, index);
-					}
-				}
+	boost::asio::thread_pool pool(threads);
+	for (int i = 0; i < chunks; i++) {
+		int yBlockStart = i * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+		StratChunkResult *p_result = &results[i];
+
+		boost::asio::post(pool, [
+			yBlockStart,
+			yBlockEnd,
+			xBlockSize,
+			yBlockSize,
+			&band,
+			&access,
+			&existing,
+			&optim,
+			p_result,
+			wrow,
+			wcol,
+			multiplier,
+			queinnecMultiplier,
+			width,
+			height
+		] {
+			try {
+				processChunkStratQueinnec<T>(
+					yBlockStart, yBlockEnd, xBlockSize, yBlockSize, band, access, existing,
+					optim, *p_result, wrow, wcol, multiplier, queinnecMultiplier, width, height
+				);
 			}
-
-			fwyi += width;
-			if (fwyi == width * fw.wrow) {
-				fwyi = 0;
+			catch (...) {
+				p_result->error = std::current_exception();
 			}
-		}
+		});
 	}
+	pool.join();
 
-	VSIFree(band.p_buffer);
-	if (access.used) {
-		VSIFree(access.band.p_buffer);
-	}
+	mergeChunkResults(results, indices, &queinnecIndices, existingSamples, optim);
 
 	if (optim.used) {
 		weights = optim.getAllocationPercentages();
@@ -1073,7 +1551,7 @@ processBlocksStratQueinnec(
 		indices.getNumDataPixels()
 	);
 
-	return strataSampleCounts;	
+	return strataSampleCounts;
 }
 
 /**
@@ -1119,7 +1597,11 @@ processBlocksStratQueinnec(
  *
  * Next, the raster is processed in blocks either using the 'random' or 'Queinnec' 
  * methods, and the return of those functions contains the allocation of samples
- * per strata.
+ * per strata. The blocks are split between the given number of threads.
+ *
+ * If bounded is true, the saved indices of each strata are a reservoir with the capacity
+ * given by reservoirCapacities(), so the memory used is proportional to the number of
+ * samples and strata rather than the number of pixels.
  *
  * Strata are iterated through, with samples being added according to their total allocation.
  * First, existing pixels are added, all of which are added in the case where the force
@@ -1148,6 +1630,8 @@ processBlocksStratQueinnec(
  * @param bool plot
  * @param std::string filename
  * @param std::string tempFolder
+ * @param int threads
+ * @param bool bounded
  *
  * @returns std::tuple<
  * 		std::vector<std::vector<double>>,
@@ -1178,11 +1662,13 @@ strat(
 	std::vector<std::pair<std::string, int>> mapStratMapping,
 	bool plot,
 	std::string filename,
-	std::string tempFolder)
+	std::string tempFolder,
+	int threads,
+	bool bounded)
 {
 	GDALAllRegister();
+	profile::Scope phases(profile::SETUP);
 
-	double mindist_sq = mindist * mindist;
 	bool useMindist = mindist != 0;
 	int width = p_raster->getWidth();
 	int height = p_raster->getHeight();
@@ -1190,8 +1676,8 @@ strat(
 	bool mapped = mapStratMapping.size() != 0;		
 
 	std::mutex bandMutex;
-	std::mutex rngMutex;
 	std::mutex accessMutex;
+	std::mutex optimMutex;
 
 	//step 1: get raster band
 	helper::RasterBandMetaData band;
@@ -1248,8 +1734,10 @@ strat(
 		true, 
 		tempFolder, 
 		band.xBlockSize,
-		band.yBlockSize
+		band.yBlockSize,
+		threads
 	);
+	access.band.p_mutex = &accessMutex;
 
 	std::vector<double> xCoords, yCoords;
 	std::vector<std::vector<OGRPoint>> existingSamples(numStrata);	
@@ -1289,34 +1777,41 @@ strat(
 		access.area
 	);
 
-	//normal indices used with both methods, queinnec indices used only with queinnec method
-	IndexStorageVectors indices(numStrata, 10000);
-	IndexStorageVectors queinnecIndices(numStrata, 10000);	
-
-	FocalWindow fw(wrow, wcol, width);
+	//normal indices used with both methods, queinnec indices used only with queinnec method.
+	//With bounded memory each strata keeps a reservoir of indices rather than every index.
+	std::vector<int64_t> capacities;
+	if (bounded) {
+		capacities = reservoirCapacities(numSamples, numStrata, allocation, weights);
+	}
+	IndexStorageVectors indices(numStrata, 10000, capacities);
+	IndexStorageVectors queinnecIndices(numStrata, 10000, capacities);
 
 	OptimAllocationDataManager optim(p_mraster, mrastBandNum, allocation);
 
+	//the mraster may be the same dataset as the strat raster, in which case they must share a mutex
+	optim.band.p_mutex = (p_mraster == p_raster) ? &bandMutex : &optimMutex;
+
+	phases.next(profile::SCAN);
 	std::vector<int64_t> strataSampleCounts; 
 	if (method == "random") {
 		switch (band.type) {
 			case GDT_Int8:
 				strataSampleCounts = processBlocksStratRandom<int8_t>(numSamples, numStrata, band, access, 
 										      existing, indices, existingSamples,
-							 			      multiplier, rng, allocation, optim,
-										      weights, width, height);
+							 			      multiplier, allocation, optim,
+										      weights, width, height, threads);
 				break;
 			case GDT_Int16:
 				strataSampleCounts = processBlocksStratRandom<int16_t>(numSamples, numStrata, band, access, 
 										      existing, indices, existingSamples,
-							 			      multiplier, rng, allocation, optim,
-										      weights, width, height);
+							 			      multiplier, allocation, optim,
+										      weights, width, height, threads);
 				break;
 			default:
 				strataSampleCounts = processBlocksStratRandom<int32_t>(numSamples, numStrata, band, access, 
 										      existing, indices, existingSamples,
-							 			      multiplier, rng, allocation, optim,
-										      weights, width, height);
+							 			      multiplier, allocation, optim,
+										      weights, width, height, threads);
 				break;
 		}
 	}
@@ -1324,25 +1819,26 @@ strat(
 		switch (band.type) {
 			case GDT_Int8:
 				strataSampleCounts = processBlocksStratQueinnec<int8_t>(numSamples, numStrata, band, access, existing, 
-											indices, queinnecIndices, fw, existingSamples,
-							   				multiplier, queinnecMultiplier, rng, allocation, 
-											optim, weights, width, height);
+											indices, queinnecIndices, wrow, wcol, existingSamples,
+							   				multiplier, queinnecMultiplier, allocation, 
+											optim, weights, width, height, threads);
 				break;
 			case GDT_Int16:
 				strataSampleCounts = processBlocksStratQueinnec<int16_t>(numSamples, numStrata, band, access, existing, 
-											indices, queinnecIndices, fw, existingSamples,
-							   				multiplier, queinnecMultiplier, rng, allocation, 
-											optim, weights, width, height);
+											indices, queinnecIndices, wrow, wcol, existingSamples,
+							   				multiplier, queinnecMultiplier, allocation, 
+											optim, weights, width, height, threads);
 				break;
 			default:
 				strataSampleCounts = processBlocksStratQueinnec<int32_t>(numSamples, numStrata, band, access, existing, 
-											indices, queinnecIndices, fw, existingSamples,
-							   				multiplier, queinnecMultiplier, rng, allocation, 
-											optim, weights, width, height);
+											indices, queinnecIndices, wrow, wcol, existingSamples,
+							   				multiplier, queinnecMultiplier, allocation, 
+											optim, weights, width, height, threads);
 				break;
 		}
 	}
 
+	phases.next(profile::SELECT);
 	std::vector<std::vector<helper::Index> *> strataIndexVectors;
 	std::vector<size_t> nextIndexes(numStrata, 0);
 
@@ -1488,7 +1984,11 @@ strat(
 	}
 
 	//add existing sample plots
-	helper::NeighborMap neighbor_map;
+	std::unique_ptr<grid::SpatialGrid> p_grid;
+	if (useMindist) {
+		p_grid = std::make_unique<grid::SpatialGrid>(GT, width, height, mindist);
+	}
+
 	if (existing.used) {
 		if (force) {
 			//if force is used, add all samples no matter what
@@ -1527,7 +2027,7 @@ strat(
 					bool valid = true;
 
 					if (useMindist) {
-						valid = helper::is_valid_sample(x, y, neighbor_map, mindist, mindist_sq);
+						valid = p_grid->tryInsert(x, y);
 					}
 
 					if (valid) { 
@@ -1596,7 +2096,7 @@ strat(
 			OGRPoint newPoint = OGRPoint(x, y);
 
 			if (useMindist) {
-				valid = helper::is_valid_sample(x, y, neighbor_map, mindist, mindist_sq);
+				valid = p_grid->tryInsert(x, y);
 			}
 			
 			if (valid) { 
@@ -1625,63 +2125,127 @@ strat(
 	curStrata = 0;
 	
 	//step 8: generate coordinate points for each sample index.
-	while (numCompletedStrata < numStrata && addedSamples < numSamples) {
-		if (curStrata == numStrata) {
-			curStrata = 0;
-		}
-		if (completedStrata[curStrata]) {
-			curStrata++;
-			continue;
+	if (useMindist && threads > 1) {
+		//order the candidates in the same round robin order which the serial loop
+		//visits them in, then check batches of them against the grid in parallel.
+		//Only the candidates without a neighbor, in a stratum which still needs
+		//samples, are then tried serially, so the samples are the same as the
+		//serial loop below.
+		std::vector<std::pair<int64_t, helper::Index>> candidates;
+		bool remaining = true;
+		for (size_t round = 0; remaining; round++) {
+			remaining = false;
+			for (int64_t i = 0; i < numStrata; i++) {
+				if (completedStrata[i] || round >= strataIndexVectors[i]->size()) {
+					continue;
+				}
+				candidates.push_back({i, strataIndexVectors[i]->at(round)});
+				remaining = true;
+			}
 		}
 
-		int64_t sampleCount = strataSampleCounts[curStrata];
-		int64_t samplesAdded = samplesAddedPerStrata[curStrata];
-		if (samplesAdded == sampleCount) {
-			numCompletedStrata++;
-			completedStrata[curStrata] = true;
-			curStrata++;
-			continue;
+		std::vector<double> xs(candidates.size());
+		std::vector<double> ys(candidates.size());
+		for (size_t j = 0; j < candidates.size(); j++) {
+			std::tie(xs[j], ys[j]) = helper::sample_to_point(GT, candidates[j].second);
 		}
 
-		std::vector<helper::Index> *strataIndexes = strataIndexVectors[curStrata];
-		size_t nextIndex = nextIndexes[curStrata];
-		if (strataIndexes->size() == nextIndex) {
-			numCompletedStrata++;
-			completedStrata[curStrata] = true;
-			curStrata++;
-			continue;
-		}
+		//the thread pool is created once, and used by every batch
+		boost::asio::thread_pool pool(threads);
+		std::vector<uint8_t> rejected;
+		size_t batchStart = 0;
+		size_t batchEnd = 0;
+		for (size_t j = 0; j < candidates.size() && addedSamples < numSamples; j++) {
+			if (j == batchEnd) {
+				batchStart = j;
+				batchEnd = std::min(candidates.size(), j + GRID_PARALLEL_BATCH);
+				rejected.resize(batchEnd - batchStart);
+				p_grid->query(xs.data() + batchStart, ys.data() + batchStart, batchEnd - batchStart, rejected.data(), pool, threads);
+			}
 
-		helper::Index index = strataIndexes->at(nextIndex);
-		nextIndexes[curStrata]++;
-		
-		bool valid = true;
-		const auto [x, y] = helper::sample_to_point(GT, index);
-		OGRPoint newPoint = OGRPoint(x, y);
+			int64_t strata = candidates[j].first;
+			if (rejected[j - batchStart] || samplesAddedPerStrata[strata] >= strataSampleCounts[strata]) {
+				continue;
+			}
 
-		if (useMindist) {
-			valid = helper::is_valid_sample(x, y, neighbor_map, mindist, mindist_sq);
-		}
+			if (!p_grid->tryInsert(xs[j], ys[j])) {
+				continue;
+			}
 
-		if (valid) {
+			OGRPoint newPoint = OGRPoint(xs[j], ys[j]);
 			existing.used ?	
-				helper::addPoint(&newPoint, p_layer, fieldVectorPointersExistingFalse[curStrata]) :
-				helper::addPoint(&newPoint, p_layer, fieldVectorPointersNoExisting[curStrata]);
-				
-		
+				helper::addPoint(&newPoint, p_layer, fieldVectorPointersExistingFalse[strata]) :
+				helper::addPoint(&newPoint, p_layer, fieldVectorPointersNoExisting[strata]);
+
 			addedSamples++;
-			samplesAddedPerStrata[curStrata]++;
+			samplesAddedPerStrata[strata]++;
 
 			if (plot) {
-				xCoords.push_back(x);
-				yCoords.push_back(y);
+				xCoords.push_back(xs[j]);
+				yCoords.push_back(ys[j]);
 			}
 		}
+	}
+	else {
+		while (numCompletedStrata < numStrata && addedSamples < numSamples) {
+			if (curStrata == numStrata) {
+				curStrata = 0;
+			}
+			if (completedStrata[curStrata]) {
+				curStrata++;
+				continue;
+			}
+
+			int64_t sampleCount = strataSampleCounts[curStrata];
+			int64_t samplesAdded = samplesAddedPerStrata[curStrata];
+			if (samplesAdded == sampleCount) {
+				numCompletedStrata++;
+				completedStrata[curStrata] = true;
+				curStrata++;
+				continue;
+			}
+
+			std::vector<helper::Index> *strataIndexes = strataIndexVectors[curStrata];
+			size_t nextIndex = nextIndexes[curStrata];
+			if (strataIndexes->size() == nextIndex) {
+				numCompletedStrata++;
+				completedStrata[curStrata] = true;
+				curStrata++;
+				continue;
+			}
+
+			helper::Index index = strataIndexes->at(nextIndex);
+			nextIndexes[curStrata]++;
+		
+			bool valid = true;
+			const auto [x, y] = helper::sample_to_point(GT, index);
+			OGRPoint newPoint = OGRPoint(x, y);
+
+			if (useMindist) {
+				valid = p_grid->tryInsert(x, y);
+			}
+
+			if (valid) {
+				existing.used ?	
+					helper::addPoint(&newPoint, p_layer, fieldVectorPointersExistingFalse[curStrata]) :
+					helper::addPoint(&newPoint, p_layer, fieldVectorPointersNoExisting[curStrata]);
+				
+		
+				addedSamples++;
+				samplesAddedPerStrata[curStrata]++;
+
+				if (plot) {
+					xCoords.push_back(x);
+					yCoords.push_back(y);
+				}
+			}
 
-		curStrata++;
+			curStrata++;
+		}
 	}
 	
 	//step 10: write vector if filename is not "".
+	phases.next(profile::OUTPUT);
 	if (filename != "") {
 		try {
 			p_wrapper->write(filename);
@@ -1695,5 +2259,325 @@ strat(
 	return {{xCoords, yCoords}, p_wrapper, actualSampleCount};
 }
 
+/**
+ * @ingroup strat
+ * This function processes a chunk of rows of blocks within the strat raster, counting the
+ * pixels of each strata and updating the per-strata optim variances if an optim band is used.
+ * It is called from within a thread by the stratPartial() function.
+ *
+ * @param int yBlockStart
+ * @param int yBlockEnd
+ * @param int numStrata
+ * @param RasterBandMetaData& band
+ * @param OptimAllocationDataManager& optim
+ * @param StratChunkResult& result
+ * @param int width
+ * @param int height
+ */
+template <typename T>
+void
+processChunkStratPartial(
+	int yBlockStart,
+	int yBlockEnd,
+	int numStrata,
+	helper::RasterBandMetaData& band,
+	OptimAllocationDataManager& optim,
+	StratChunkResult& result,
+	int width,
+	int height)
+{
+	T nanInt = static_cast<T>(band.nan);
+
+	std::vector<helper::RasterBandMetaData *> bands = {&band};
+	if (optim.used) {
+		bands.push_back(&optim.band);
+	}
+	reader::BlockReader blocks(
+		bands,
+		reader::blockWindows(band.xBlockSize, band.yBlockSize, width, height, yBlockStart, yBlockEnd),
+		band.xBlockSize,
+		band.yBlockSize
+	);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_buffer = reinterpret_cast<T *>(p_block->buffers[0]);
+		void *p_optim = optim.used ? p_block->buffers.back() : nullptr;
+
+		for (int y = 0; y < p_block->window.yValid; y++) {
+			int blockIndex = y * band.xBlockSize;
+			for (int x = 0; x < p_block->window.xValid; x++) {
+				T val = p_buffer[blockIndex];
+
+				if (val != nanInt) {
+					if (val >= numStrata) {
+						throw std::runtime_error("the num_strata indicated for the strat raster band is less than or equal to one of the value sin that band.");
+					}
+
+					if (val < 0) {
+						std::string errmsg = "a negative value of " + std::to_string(val) + " was found in the strat raster, and has not been marked as a nodata value.";
+						throw std::runtime_error(errmsg);
+					}
+
+					if (optim.used) {
+						optim.update(result.variances, p_optim, blockIndex, val);
+					}
+
+					result.indices.updateStrataCounts(val);
+				}
+
+				blockIndex++;
+			}
+		}
+	}
+}
+
+/**
+ * @ingroup strat
+ * This function calculates the partial result of a strat raster (typically a single tile
+ * of a larger raster), which every allocation method depends on. This is the count of
+ * every strata, and if an mraster is given the intermediate values of the within-strata
+ * variance used by 'optim' allocation.
+ *
+ * Partial results of seperate tiles can be serialized, then merged by mergePartials() or
+ * allocated by allocatePartials(), so the sample allocation of a raster can be calculated
+ * without any single machine having to read the whole raster.
+ *
+ * The strata counts are the same values the pixel iteration within strat() calculates, 
+ * meaning they include pixels which are not accessible or already sampled.
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param int bandNum
+ * @param int64_t numStrata
+ * @param GDALRasterWrapper *p_mraster
+ * @param int mrastBandNum
+ * @param int threads
+ *
+ * @returns std::tuple<std::vector<int64_t>, std::vector<std::vector<double>>> the strata counts and variance states
+ */
+std::tuple<std::vector<int64_t>, std::vector<std::vector<double>>>
+stratPartial(
+	raster::GDALRasterWrapper *p_raster,
+	int bandNum,
+	int64_t numStrata,
+	raster::GDALRasterWrapper *p_mraster,
+	int mrastBandNum,
+	int threads)
+{
+	GDALAllRegister();
+
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+
+	std::mutex bandMutex;
+	std::mutex optimMutex;
+
+	helper::RasterBandMetaData band;
+	band.p_band = p_raster->getRasterBand(bandNum);
+	band.type = p_raster->getRasterBandType(bandNum);
+	band.size = p_raster->getRasterBandTypeSize(bandNum);
+	band.p_buffer = nullptr;
+	band.nan = band.p_band->GetNoDataValue();
+	band.p_mutex = &bandMutex;
+	band.p_band->GetBlockSize(&band.xBlockSize, &band.yBlockSize);
+
+	helper::printTypeWarningsForInt32Conversion(band.type);
+
+	OptimAllocationDataManager optim(p_mraster, mrastBandNum, "optim");
+	optim.band.p_mutex = (p_mraster == p_raster) ? &bandMutex : &optimMutex;
+	if (optim.used) {
+		optim.init(numStrata);
+	}
+
+	int yBlocks = (height + band.yBlockSize - 1) / band.yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
+
+	std::vector<StratChunkResult> results;
+	results.reserve(chunks);
+	for (int i = 0; i < chunks; i++) {
+		results.emplace_back(numStrata, 0, std::vector<int64_t>(), false, optim.used);
+	}
+
+	boost::asio::thread_pool pool(threads);
+	for (int i = 0; i < chunks; i++) {
+		int yBlockStart = i * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+		StratChunkResult *p_result = &results[i];
+
+		boost::asio::post(pool, [yBlockStart, yBlockEnd, numStrata, &band, &optim, p_result, width, height] {
+			try {
+				switch (band.type) {
+					case GDT_Int8:
+						processChunkStratPartial<int8_t>(yBlockStart, yBlockEnd, numStrata, band, optim, *p_result, width, height);
+						break;
+					case GDT_Int16:
+						processChunkStratPartial<int16_t>(yBlockStart, yBlockEnd, numStrata, band, optim, *p_result, width, height);
+						break;
+					default:
+						processChunkStratPartial<int32_t>(yBlockStart, yBlockEnd, numStrata, band, optim, *p_result, width, height);
+						break;
+				}
+			}
+			catch (...) {
+				p_result->error = std::current_exception();
+			}
+		});
+	}
+	pool.join();
+
+	IndexStorageVectors indices(numStrata, 0);
+	std::vector<std::vector<OGRPoint>> existingSamples(numStrata);
+	mergeChunkResults(results, indices, nullptr, existingSamples, optim);
+
+	std::vector<std::vector<double>> variances;
+	for (helper::Variance& variance : optim.variances) {
+		variances.push_back(variance.getState());
+	}
+
+	return {indices.getStrataCounts(), variances};
+}
+
+/**
+ * @ingroup strat
+ * This function merges the partial results (see stratPartial()) of multiple tiles into
+ * a single partial result. Strata counts are summed, and variances are merged using the
+ * pairwise update of Variance::merge(). The result can itself be merged again, so tiles
+ * may be combined in any grouping or order.
+ *
+ * Variances are only merged if every partial result contains them.
+ *
+ * @param std::vector<std::vector<int64_t>> tileCounts
+ * @param std::vector<std::vector<std::vector<double>>> tileVariances
+ *
+ * @returns std::tuple<std::vector<int64_t>, std::vector<std::vector<double>>> the strata counts and variance states
+ */
+std::tuple<std::vector<int64_t>, std::vector<std::vector<double>>>
+mergePartials(
+	std::vector<std::vector<int64_t>> tileCounts,
+	std::vector<std::vector<std::vector<double>>> tileVariances)
+{
+	if (tileCounts.empty() || tileCounts.size() != tileVariances.size()) {
+		throw std::runtime_error("there must be the same (non-zero) number of strata counts and variances to merge.");
+	}
+
+	size_t numStrata = tileCounts[0].size();
+	bool useVariances = true;
+	for (size_t t = 0; t < tileCounts.size(); t++) {
+		if (tileCounts[t].size() != numStrata) {
+			throw std::runtime_error("every partial result must have the same number of strata.");
+		}
+
+		if (tileVariances[t].empty()) {
+			useVariances = false;
+		}
+		else if (tileVariances[t].size() != numStrata) {
+			throw std::runtime_error("every partial result must have a variance for every strata.");
+		}
+	}
+
+	std::vector<int64_t> counts(numStrata, 0);
+	std::vector<helper::Variance> variances(useVariances ? numStrata : 0);
+	for (size_t t = 0; t < tileCounts.size(); t++) {
+		for (size_t i = 0; i < numStrata; i++) {
+			counts[i] += tileCounts[t][i];
+
+			if (useVariances) {
+				variances[i].merge(helper::Variance(tileVariances[t][i]));
+			}
+		}
+	}
+
+	std::vector<std::vector<double>> states;
+	for (helper::Variance& variance : variances) {
+		states.push_back(variance.getState());
+	}
+
+	return {counts, states};
+}
+
+/**
+ * @ingroup strat
+ * This function calculates the global sample allocation of a raster from the partial results
+ * of each of it's tiles, and splits it back between the tiles. The returned per-tile sample
+ * counts are passed to strat() on each tile with the 'fixed' allocation method, so the
+ * combined samples of every tile follow the allocation of the whole raster.
+ *
+ * The partial results are merged, and the allocation per strata is calculated by
+ * calculateAllocation() as strat() would on the whole raster, using the merged variances
+ * for 'optim' allocation. The samples of each strata are then split between tiles
+ * proportionally to the number of pixels of that strata in each tile, using the largest
+ * remainder method so each strata receives exactly it's allocation. A tile never receives
+ * more samples of a strata than it has pixels of that strata.
+ *
+ * @param int64_t numSamples
+ * @param std::string allocation
+ * @param std::vector<double> weights
+ * @param std::vector<std::vector<int64_t>> tileCounts
+ * @param std::vector<std::vector<std::vector<double>>> tileVariances
+ *
+ * @returns std::vector<std::vector<int64_t>> the sample counts per strata of each tile
+ */
+std::vector<std::vector<int64_t>>
+allocatePartials(
+	int64_t numSamples,
+	std::string allocation,
+	std::vector<double> weights,
+	std::vector<std::vector<int64_t>> tileCounts,
+	std::vector<std::vector<std::vector<double>>> tileVariances)
+{
+	auto [counts, states] = mergePartials(tileCounts, tileVariances);
+	size_t numStrata = counts.size();
+
+	if (allocation == "optim") {
+		if (states.empty()) {
+			throw std::runtime_error("every partial result must contain variances for 'optim' allocation.");
+		}
+
+		OptimAllocationDataManager optim(nullptr, -1, allocation);
+		for (std::vector<double>& state : states) {
+			optim.variances.push_back(helper::Variance(state));
+		}
+		weights = optim.getAllocationPercentages();
+	}
+
+	int64_t numPixels = 0;
+	for (int64_t count : counts) {
+		numPixels += count;
+	}
+
+	std::vector<int64_t> strataSampleCounts = calculateAllocation(numSamples, allocation, counts, weights, numPixels);
+
+	std::vector<std::vector<int64_t>> retval(tileCounts.size(), std::vector<int64_t>(numStrata, 0));
+	for (size_t i = 0; i < numStrata; i++) {
+		if (counts[i] == 0) {
+			continue;
+		}
+
+		int64_t remainder = strataSampleCounts[i];
+		std::vector<std::pair<double, size_t>> fractions;
+		for (size_t t = 0; t < tileCounts.size(); t++) {
+			double share = static_cast<double>(strataSampleCounts[i]) * static_cast<double>(tileCounts[t][i]) / static_cast<double>(counts[i]);
+			int64_t whole = static_cast<int64_t>(share);
+			retval[t][i] = whole;
+			remainder -= whole;
+			fractions.push_back({share - static_cast<double>(whole), t});
+		}
+
+		//largest fractional shares receive the remaining samples, ties go to the earlier tile
+		std::stable_sort(fractions.begin(), fractions.end(), [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+			return a.first > b.first;
+		});
+		for (size_t j = 0; remainder > 0 && j < fractions.size(); j++) {
+			size_t t = fractions[j].second;
+			if (retval[t][i] < tileCounts[t][i]) {
+				retval[t][i]++;
+				remainder--;
+			}
+		}
+	}
+
+	return retval;
+}
+
 } //namespace strat
 } //namespace sgs
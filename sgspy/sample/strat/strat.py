@@ -15,6 +15,7 @@ import os
 import sys
 import site
 import tempfile
+from contextlib import nullcontext
 from typing import Optional
 
 import numpy as np
@@ -25,13 +26,14 @@ from sgspy.utils import(
     SpatialVector,
     StratRasterBandMetadata,
     plot,
+    profile,
 )
 
 #ensure _sgs binary can be found
 site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackages()))[0]
 sys.path.append(os.path.join(site_packages, "sgspy"))
 sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
-from _sgs import strat_cpp
+from _sgs import strat_cpp, strat_partial_cpp, merge_strat_partials_cpp, allocate_strat_partials_cpp
 
 ##
 # @ingroup user_strat
@@ -62,6 +64,9 @@ from _sgs import strat_cpp
 # parameter must be given specifying which band. The optim method is specified by Gregoire and Valentine,
 # and optimizes the desired proportions based on the proportion of each strata AND the within-strata
 # variance in the specified raster band. https://doi.org/10.1201/9780203498880 Section 5.4.4.
+# The 'fixed' method requires the weights parameter to be a list of the exact number of samples of each
+# strata, which must sum to num_samples. It is used to sample a single tile of a larger raster, with
+# the per-tile sample counts returned by allocate_strat_partials().
 # 
 # The 'existing' parameter, if passed, must be a SpatialVector of type Point or MultiPoint. 
 # These points specify samples within an already-existing network. The SpatialVector may
@@ -76,6 +81,23 @@ from _sgs import strat_cpp
 # must be larger than buff_inner. For a multi-layer vector, layer_name
 # must be specified.
 # 
+# the thread_count parameter specifies the number of threads which this function will
+# utilize when iterating through the strat raster. The raster is split into chunks of 
+# blocks, and each thread keeps track of it's own potential sample pixels which are
+# combined once every thread has finished. The default is 8 threads, although the optimal
+# number will depend significantly on the hardware being used and may be less or more than 8.
+# If mindist is given and more than one thread is used, batches of the randomly chosen
+# candidates are also checked against the samples accepted so far in parallel. The samples
+# chosen do not depend on the number of threads.
+#
+# By default every candidate pixel which is kept while iterating through the strat raster is
+# stored, which for very large rasters with many strata can use a lot of memory. If bounded_memory
+# is True, each strata instead keeps a uniform random sample of at most a few times the number of
+# samples it can be allocated, so the memory used depends on num_samples and the number of strata
+# rather than the size of the raster. The samples are still chosen uniformly at random within
+# each strata. If a large mindist rejects most candidates, fewer samples may be found than without
+# bounded_memory.
+# 
 # Examples
 # --------------------
 # rast = sgspy.SpatialRaster("raster.tif") @n
@@ -122,9 +144,9 @@ from _sgs import strat_cpp
 # wcol : int @n
 #     the number of columns to be considered in the focal window for the 'Queinnec' method @n @n
 # allocation : str @n
-#     the allocation method to determine the number of samples per strata. One of 'prop', 'equal', 'optim', or 'manual' @n @n
+#     the allocation method to determine the number of samples per strata. One of 'prop', 'equal', 'optim', 'manual', or 'fixed' @n @n
 # weights : list[float] @n
-#     the allocation percentages of each strata if the allocation method is 'manual' @n @n
+#     the allocation percentages of each strata if the allocation method is 'manual', or sample counts if 'fixed' @n @n
 # mrast : SpatialRaster @n
 #     the raster used to calculate 'optim' allocation if 'optim' allocation is used @n @n
 # mrast_band : str | int @n
@@ -149,11 +171,18 @@ from _sgs import strat_cpp
 #     whether or not to plot the output samples @n @n
 # filename : str @n
 #     the output filename to write to if desired @n @n
+# thread_count : int @n
+#     the number of threads to use when iterating through the strat raster @n @n
+# bounded_memory : bool @n
+#     whether to keep a bounded random sample of the candidate pixels of each strata rather than all of them @n @n
+# stats : bool @n
+#     whether to also return a dict of where time was spent, see sgspy.profile @n @n
 # 
 # 
 # Returns
 # --------------------
-# a SpatialVector object containing point geometries of sample locations
+# a SpatialVector object containing point geometries of sample locations, and a stats dict
+# if stats is True
 def strat(
     strat_rast: SpatialRaster,
     num_samples: int,
@@ -175,6 +204,9 @@ def strat(
     buff_outer: Optional[int | float] = None,
     plot: bool = False,
     filename: str = "",
+    thread_count: int = 8,
+    bounded_memory: bool = False,
+    stats: bool = False,
     ):
 
     if type(strat_rast) is not SpatialRaster:
@@ -240,6 +272,15 @@ def strat(
     if type(filename) is not str:
         raise TypeError("'filename' parameter must be of type str.")
 
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if type(bounded_memory) is not bool:
+        raise TypeError("'bounded_memory' parameter must be of type bool.")
+
+    if type(stats) is not bool:
+        raise TypeError("'stats' parameter must be of type bool.")
+
     if strat_rast.closed:
         raise RuntimeError("the C++ object which the strat_rast object wraps has been cleaned up and closed.")
 
@@ -273,8 +314,8 @@ def strat(
     if method not in ["random", "Queinnec"]:
         raise ValueError("method must be either 'random' or 'Queinnec'.")
 
-    if allocation not in ["prop", "optim", "equal", "manual"]:
-        raise ValueError("method must be one of 'prop', 'optim', 'equal', or 'manual'.")
+    if allocation not in ["prop", "optim", "equal", "manual", "fixed"]:
+        raise ValueError("method must be one of 'prop', 'optim', 'equal', 'manual', or 'fixed'.")
 
     if allocation == "manual":
         if weights is None:
@@ -286,6 +327,21 @@ def strat(
         if len(weights) != num_strata:
             raise ValueError("length of 'weights' must be the same as the number of strata, which is {}".format(num_strata))
 
+    if allocation == "fixed":
+        if weights is None:
+            raise ValueError("for fixed allocation, weights must be given.")
+
+        if any(type(count) is not int or count < 0 for count in weights):
+            raise ValueError("for fixed allocation, weights must be non-negative integer sample counts.")
+
+        if sum(weights) != num_samples:
+            raise ValueError("for fixed allocation, weights must sum to num_samples.")
+
+        if len(weights) != num_strata:
+            raise ValueError("length of 'weights' must be the same as the number of strata, which is {}".format(num_strata))
+
+        weights = [float(count) for count in weights]
+
     if allocation == "optim":
         if not mrast:
             raise ValueError("the 'mrast' parameter must be provided if a SpatialRaster if allocation is 'optim'.")
@@ -347,7 +403,7 @@ def strat(
     else:
         existing_vector = None
 
-    if allocation != "manual":
+    if allocation not in ["manual", "fixed"]:
         weights = []
 
     if mindist is None:
@@ -356,35 +412,41 @@ def strat(
     if mindist < 0:
         raise ValueError("mindist must be greater than or equal to 0")
 
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
     temp_dir = strat_rast.cpp_raster.get_temp_dir()
     if temp_dir == "":
         temp_dir = tempfile.mkdtemp()
         strat_rast.cpp_raster.set_temp_dir(temp_dir)
 
-    [sample_coordinates, samples, num_points] = strat_cpp(
-        strat_rast.cpp_raster,
-        band,
-        num_samples,
-        num_strata,
-        allocation,
-        weights,
-        mrast_cpp_raster,
-        mrast_band,
-        method,
-        wrow,
-        wcol,
-        mindist,
-        existing_vector,
-        force,
-        access_vector,
-        layer_name,
-        buff_inner,
-        buff_outer,
-        map_strat_mapping,
-        plot,
-        filename,
-        temp_dir
-    )
+    with profile() if stats else nullcontext() as run_stats:
+        [sample_coordinates, samples, num_points] = strat_cpp(
+            strat_rast.cpp_raster,
+            band,
+            num_samples,
+            num_strata,
+            allocation,
+            weights,
+            mrast_cpp_raster,
+            mrast_band,
+            method,
+            wrow,
+            wcol,
+            mindist,
+            existing_vector,
+            force,
+            access_vector,
+            layer_name,
+            buff_inner,
+            buff_outer,
+            map_strat_mapping,
+            plot,
+            filename,
+            temp_dir,
+            thread_count,
+            bounded_memory
+        )
 
     if num_points < num_samples:
         print("unable to find the full {} samples within the given constraints. Sampled {} points.".format(num_samples, num_points))
@@ -406,4 +468,214 @@ def strat(
         except Exception as e:
             print("unable to plot output: " + str(e))
 
-    return SpatialVector(samples)
+    samples = SpatialVector(samples)
+    if not stats:
+        return samples
+
+    return samples, run_stats
+
+##
+# @ingroup user_strat
+# This function calculates the partial result of a strat raster, which is everything the
+# allocation of samples depends on: the number of pixels of each strata, and if mrast is
+# given, the intermediate values of the within-strata variance required by 'optim' allocation.
+#
+# It is intended for rasters which are too large to process on one machine. Each machine
+# calculates the partial result of it's own tile (for example a window of the raster, see
+# SpatialRaster.window()). The partial results are plain dictionaries which can be serialized
+# (for example using json), and are merged with merge_strat_partials(). Then, the sample counts
+# of every tile are calculated with allocate_strat_partials(), and each tile is sampled using
+# strat() with allocation='fixed'.
+#
+# Examples
+# --------------------
+# partials = [sgspy.sample.strat_partial(tile, num_strata=5) for (_, _, tile) in srast.tiles()] @n
+# counts = sgspy.sample.allocate_strat_partials(partials, num_samples=200) @n
+# samples = [sgspy.sample.strat(tile, num_samples=sum(c), num_strata=5, allocation="fixed", weights=c) for ((_, _, tile), c) in zip(srast.tiles(), counts) if sum(c) > 0]
+#
+# Parameters
+# --------------------
+# strat_rast : SpatialRaster @n
+#     the strat raster (or tile of a strat raster) @n @n
+# band : Optional[int | str] @n
+#     the band within the strat_rast to use, required if strat_rast has more than 1 band @n @n
+# num_strata : Optional[int] @n
+#     the value of the largest stratification in the strat_rast + 1 @n @n
+# mrast : Optional[SpatialRaster] @n
+#     the raster used to calculate 'optim' allocation, with the same extent as strat_rast @n @n
+# mrast_band : Optional[int | str] @n
+#     specifies the band within mrast to use @n @n
+# thread_count : int @n
+#     the number of threads to use when iterating through the strat raster @n @n
+#
+# Returns
+# --------------------
+# a dict containing 'strata_counts', and 'variances' as [count, mean, sum of squares] per strata (empty if mrast is not given)
+def strat_partial(
+    strat_rast: SpatialRaster,
+    band: Optional[int | str] = None,
+    num_strata: Optional[int] = None,
+    mrast: Optional[SpatialRaster] = None,
+    mrast_band: Optional[int | str] = None,
+    thread_count: int = 8,
+    ):
+
+    if type(strat_rast) is not SpatialRaster:
+        raise TypeError("'strat_rast' parameter must be of type sgspy.SpatialRaster.")
+
+    if band is not None and type(band) not in [int, str]:
+        raise TypeError("'band' parameter, if given, must be of type int or str.")
+
+    if num_strata is not None and type(num_strata) is not int:
+        raise TypeError("'num_strata' parameter, if given, must be of type int.")
+
+    if mrast is not None and type(mrast) is not SpatialRaster:
+        raise TypeError("'mrast' parameter, if given, must be of type sgspy.SpatialRaster.")
+
+    if mrast_band is not None and type(mrast_band) not in [int, str]:
+        raise TypeError("'mrast_band' parameter, if given, must be of type int or str.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if strat_rast.closed:
+        raise RuntimeError("the C++ object which the strat_rast object wraps has been cleaned up and closed.")
+
+    if mrast is not None and mrast.closed:
+        raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
+
+    if band is None:
+        if len(strat_rast.bands) > 1:
+            raise ValueError("'band' parameter must be given if there is more than 1 band in the strat_raster")
+        band = 0
+    else:
+        band = strat_rast.get_band_index(band)
+
+    if strat_rast.is_strat_rast:
+        num_strata = strat_rast.srast_metadata_info[strat_rast.bands[band]].get_num_strata()
+    elif num_strata is None:
+        raise ValueError("'if 'strat_rast' parameter is not the return value of an sgspy.stratify function, 'num_strata' is a required parameter.")
+
+    if num_strata < 1:
+        raise ValueError("num_strata must be greater than 0")
+
+    if mrast is not None:
+        if mrast.width != strat_rast.width or mrast.height != strat_rast.height:
+            raise ValueError("'mrast' must have the same width and height as 'strat_rast'.")
+
+        if mrast_band is None:
+            if len(mrast.bands) != 1:
+                raise ValueError("the 'mrast_band' parameter must be given if the 'mrast' SpatialRaster contains more than 1 band.")
+            mrast_band = 0
+        else:
+            mrast_band = mrast.get_band_index(mrast_band)
+
+        mrast_cpp_raster = mrast.cpp_raster
+    else:
+        mrast_cpp_raster = None
+        mrast_band = -1
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    [strata_counts, variances] = strat_partial_cpp(
+        strat_rast.cpp_raster,
+        band,
+        num_strata,
+        mrast_cpp_raster,
+        mrast_band,
+        thread_count
+    )
+
+    return {"strata_counts": strata_counts, "variances": variances}
+
+def _check_partials(partials):
+    if type(partials) is not list or len(partials) == 0:
+        raise TypeError("'partials' parameter must be a non-empty list of partial results returned by strat_partial().")
+
+    for partial in partials:
+        if type(partial) is not dict or "strata_counts" not in partial or "variances" not in partial:
+            raise TypeError("'partials' parameter must be a non-empty list of partial results returned by strat_partial().")
+
+    return [partial["strata_counts"] for partial in partials], [partial["variances"] for partial in partials]
+
+##
+# @ingroup user_strat
+# This function merges the partial results of multiple tiles, as returned by strat_partial(),
+# into a single partial result. The merged result can be merged again, so partial results
+# may be combined in any order or grouping (for example per machine, then globally).
+#
+# Parameters
+# --------------------
+# partials : list[dict] @n
+#     the partial results to merge @n @n
+#
+# Returns
+# --------------------
+# a dict in the same form as the return value of strat_partial()
+def merge_strat_partials(partials: list[dict]):
+    [tile_counts, tile_variances] = _check_partials(partials)
+    [strata_counts, variances] = merge_strat_partials_cpp(tile_counts, tile_variances)
+    return {"strata_counts": strata_counts, "variances": variances}
+
+##
+# @ingroup user_strat
+# This function calculates the allocation of samples of the whole raster from the partial
+# results of it's tiles, and splits the samples of each strata between the tiles proportionally
+# to the number of pixels of that strata within each tile. The number of samples of each tile
+# can then be passed to strat() with allocation='fixed'. The allocation parameters are the
+# same as those of strat(), and 'optim' allocation requires the partial results be calculated
+# with an mrast.
+#
+# Parameters
+# --------------------
+# partials : list[dict] @n
+#     the partial result of every tile, in the order the tiles will be sampled @n @n
+# num_samples : int @n
+#     the desired number of samples across every tile @n @n
+# allocation : str @n
+#     the allocation method, one of 'prop', 'equal', 'optim', or 'manual' @n @n
+# weights : list[float] @n
+#     the allocation percentages of each strata if the allocation method is 'manual' @n @n
+#
+# Returns
+# --------------------
+# a list containing, for each tile, a list of the number of samples of each strata
+def allocate_strat_partials(
+    partials: list[dict],
+    num_samples: int,
+    allocation: str = "prop",
+    weights: Optional[list[float]] = None,
+    ):
+
+    [tile_counts, tile_variances] = _check_partials(partials)
+    num_strata = len(tile_counts[0])
+
+    if type(num_samples) is not int:
+        raise TypeError("'num_samples' parameter must be of type int.")
+
+    if type(allocation) is not str:
+        raise TypeError("'allocation' parameter must be of type str.")
+
+    if weights is not None and type(weights) is not list:
+        raise TypeError("'weights' parameter, if given, must be a list of float values.")
+
+    if num_samples < 1:
+        raise ValueError("num_samples must be greater than 0")
+
+    if allocation not in ["prop", "optim", "equal", "manual"]:
+        raise ValueError("method must be one of 'prop', 'optim', 'equal', or 'manual'.")
+
+    if allocation == "manual":
+        if weights is None:
+            raise ValueError("for manual allocation, weights must be given.")
+
+        if np.sum(weights) != 1:
+            raise ValueError("weights must sum to 1.")
+
+        if len(weights) != num_strata:
+            raise ValueError("length of 'weights' must be the same as the number of strata, which is {}".format(num_strata))
+    else:
+        weights = []
+
+    return allocate_strat_partials_cpp(num_samples, allocation, weights, tile_counts, tile_variances)
@@ -12,13 +12,20 @@
  * @ingroup sample
  */
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <mutex>
+#include <numbers>
 #include <random>
+#include <utility>
+#include <vector>
 
 #include "utils/access.h"
 #include "utils/existing.h"
 #include "utils/helper.h"
 #include "utils/raster.h"
+#include "utils/reader.h"
 #include "utils/vector.h"
 
 namespace sgs {
@@ -26,82 +33,215 @@ namespace systematic {
 
 /**
  * @ingroup systematic
- * Helper function for generating a vector geometry containing polygons of the accessible
- * area. This function is called if an access vector is given.
+ * The number of points tried within each cell when the location is 'random',
+ * before the cell is left unsampled.
+ */
+#define SYSTEMATIC_RANDOM_TRIES 10
+
+/**
+ * @ingroup systematic
+ * This struct represents a rotated square or hexagonal lattice of grid cells
+ * covering the extent of a raster. Rather than building a polygon for
+ * every cell, the centers, corners, and outlines of cells are computed
+ * analytically from the cell indices.
  *
- * The input vector dataset must be comprised of solely LineString and MultiLineString geometries.
- * The LineStrings are buffered by buff outer, then have buff_inner subtracted from them.
+ * Cell positions are calculated in a (u, v) coordinate frame which is rotated
+ * by the grid rotation about the minimum corner of the raster extent. The
+ * lattice is offset within this frame by a random amount, so the position of
+ * the grid as well as it's rotation are random.
  *
- * The returned geometry is checked to see whether it contains points which are trying to be
- * sampled. If the geometry does not contain a given point, that point is considered inaccessible
- * and thus not sampled.
+ * Square cells have a side length of the cell size. Hexagonal cells are flat
+ * topped, with an edge length of the cell size, so their centers are in columns
+ * 1.5 * cellSize apart, where every odd column is shifted up by half of a cell
+ * height (sqrt(3) * cellSize).
  *
- * @param GDALVectorWrapper *p_access
- * @param std::string layerName
- * @param double buffInner
- * @param double buffOuter
- *
- * @returns OGRGeometry *
+ * Every corner of the lattice is owned by exactly one cell: the bottom left
+ * corner of a square cell, and the right and top right corners of a hexagonal
+ * cell. So emitting the owned corners of every cell emits each corner once.
  */
-OGRGeometry *getAccessPolygon(vector::GDALVectorWrapper *p_access, std::string layerName, double buffInner, double buffOuter) {
-	//step 1: create multipolygon buffers
-	OGRMultiPolygon *buffInnerPolygons = new OGRMultiPolygon;
-	OGRMultiPolygon *buffOuterPolygons = new OGRMultiPolygon;
-	OGRGeometry *p_polygonMask;
-
-	//step 2: add geometries to access polygon buffers
-	for (const auto& p_feature : *p_access->getLayer(layerName.c_str())) {
-		OGRGeometry *p_geometry = p_feature->GetGeometryRef();
-		OGRwkbGeometryType type = wkbFlatten(p_geometry->getGeometryType());
-
-		switch (type) {
-			case OGRwkbGeometryType::wkbLineString: {
-				OGRGeometry *p_outer = p_geometry->Buffer(buffOuter);
-				buffOuterPolygons->addGeometry(p_outer);
-				OGRGeometryFactory::destroyGeometry(p_outer);
-
-				if (buffInner != 0) {
-					OGRGeometry *p_inner = p_geometry->Buffer(buffInner);
-					buffInnerPolygons->addGeometry(p_inner);
-					OGRGeometryFactory::destroyGeometry(p_inner);
-				}
-				break;
-			}
-			case OGRwkbGeometryType::wkbMultiLineString: {
-				for (const auto& p_lineString : *p_geometry->toMultiLineString()) {
-					OGRGeometry *p_outer = p_geometry->Buffer(buffOuter);
-					buffOuterPolygons->addGeometry(p_outer);
-					OGRGeometryFactory::destroyGeometry(p_outer);
-					if (buffInner != 0) {
-						OGRGeometry *p_inner = p_geometry->Buffer(buffInner);
-						buffInnerPolygons->addGeometry(p_inner);
-						OGRGeometryFactory::destroyGeometry(p_inner);
-					}
-				}
-				break;
-			}
-			default: {
-				throw std::runtime_error("access polygon geometry type must be LineString or MultiLineString");
+struct Lattice {
+	bool hexagon;
+	double cellSize;
+	double cellHeight;
+	double xOrigin;
+	double yOrigin;
+	double cosRot;
+	double sinRot;
+	double uOffset;
+	double vOffset;
+	int iStart;
+	int iEnd;
+	int jStart;
+	int jEnd;
+
+	/**
+	 * Constructor for the lattice, which determines the range of cell indices
+	 * which may intersect the extent.
+	 *
+	 * @param bool hexagon
+	 * @param double cellSize
+	 * @param double rotation (in degrees)
+	 * @param double uFraction in [0, 1)
+	 * @param double vFraction in [0, 1)
+	 * @param double xMin
+	 * @param double xMax
+	 * @param double yMin
+	 * @param double yMax
+	 */
+	Lattice(bool hexagon, double cellSize, double rotation, double uFraction, double vFraction,
+		double xMin, double xMax, double yMin, double yMax) :
+		hexagon(hexagon), cellSize(cellSize), xOrigin(xMin), yOrigin(yMin)
+	{
+		double radians = rotation * std::numbers::pi / 180;
+		this->cosRot = std::cos(radians);
+		this->sinRot = std::sin(radians);
+		this->cellHeight = hexagon ? std::numbers::sqrt3 * cellSize : cellSize;
+
+		//the lattice repeats every 2 columns of hexagons
+		double uPeriod = hexagon ? 3 * cellSize : cellSize;
+		this->uOffset = uFraction * uPeriod;
+		this->vOffset = vFraction * this->cellHeight;
+
+		double uMin = INFINITY, uMax = -INFINITY, vMin = INFINITY, vMax = -INFINITY;
+		double xs[4] = {xMin, xMin, xMax, xMax};
+		double ys[4] = {yMin, yMax, yMin, yMax};
+		for (int i = 0; i < 4; i++) {
+			double u, v;
+			this->toUV(xs[i], ys[i], u, v);
+			uMin = std::min(uMin, u);
+			uMax = std::max(uMax, u);
+			vMin = std::min(vMin, v);
+			vMax = std::max(vMax, v);
+		}
+
+		double uStep = hexagon ? 1.5 * cellSize : cellSize;
+		this->iStart = static_cast<int>(std::floor((uMin - this->uOffset) / uStep)) - 1;
+		this->iEnd = static_cast<int>(std::floor((uMax - this->uOffset) / uStep)) + 1;
+		this->jStart = static_cast<int>(std::floor((vMin - this->vOffset) / this->cellHeight)) - 1;
+		this->jEnd = static_cast<int>(std::floor((vMax - this->vOffset) / this->cellHeight)) + 1;
+	}
+
+	/**
+	 * Convert raster coordinates to the rotated frame.
+	 *
+	 * @param double x
+	 * @param double y
+	 * @param double& u
+	 * @param double& v
+	 */
+	inline void toUV(double x, double y, double& u, double& v) const {
+		double dx = x - this->xOrigin;
+		double dy = y - this->yOrigin;
+		u = dx * this->cosRot + dy * this->sinRot;
+		v = dy * this->cosRot - dx * this->sinRot;
+	}
+
+	/**
+	 * Convert coordinates in the rotated frame to raster coordinates.
+	 *
+	 * @param double u
+	 * @param double v
+	 * @param double& x
+	 * @param double& y
+	 */
+	inline void toXY(double u, double v, double& x, double& y) const {
+		x = this->xOrigin + u * this->cosRot - v * this->sinRot;
+		y = this->yOrigin + u * this->sinRot + v * this->cosRot;
+	}
+
+	/**
+	 * The center of cell (i, j) in the rotated frame.
+	 *
+	 * @param int i
+	 * @param int j
+	 * @param double& u
+	 * @param double& v
+	 */
+	inline void center(int i, int j, double& u, double& v) const {
+		if (this->hexagon) {
+			u = this->uOffset + 1.5 * this->cellSize * i;
+			v = this->vOffset + this->cellHeight * (j + ((i & 1) ? 0.5 : 0));
+		}
+		else {
+			u = this->uOffset + this->cellSize * (i + 0.5);
+			v = this->vOffset + this->cellSize * (j + 0.5);
+		}
+	}
+
+	/**
+	 * The corners of cell (i, j) in the rotated frame, in counter-clockwise
+	 * order, starting with the owned corners.
+	 *
+	 * @param int i
+	 * @param int j
+	 * @param std::vector<double>& us
+	 * @param std::vector<double>& vs
+	 */
+	void corners(int i, int j, std::vector<double>& us, std::vector<double>& vs) const {
+		double cu, cv;
+		this->center(i, j, cu, cv);
+		us.clear();
+		vs.clear();
+
+		if (this->hexagon) {
+			for (int k = 0; k < 6; k++) {
+				us.push_back(cu + this->cellSize * std::cos(k * std::numbers::pi / 3));
+				vs.push_back(cv + this->cellSize * std::sin(k * std::numbers::pi / 3));
 			}
 		}
-	}	
+		else {
+			double half = this->cellSize / 2;
+			us.insert(us.end(), {cu - half, cu + half, cu + half, cu - half});
+			vs.insert(vs.end(), {cv - half, cv - half, cv + half, cv + half});
+		}
+	}
 
-	//step 3: generate the polygon mask and free no longer used memory
-	if (buffInner == 0) {
-		p_polygonMask = buffOuterPolygons->UnionCascaded();
+	/**
+	 * The number of corners owned by each cell.
+	 *
+	 * @returns int
+	 */
+	inline int ownedCorners() const {
+		return this->hexagon ? 2 : 1;
 	}
-	else {
-		OGRGeometry *buffOuterUnion = buffOuterPolygons->UnionCascaded();
-		OGRGeometry *buffInnerUnion = buffInnerPolygons->UnionCascaded();
-		p_polygonMask = buffOuterUnion->Difference(buffInnerUnion);
-		OGRGeometryFactory::destroyGeometry(buffOuterUnion);
-		OGRGeometryFactory::destroyGeometry(buffInnerUnion);
+
+	/**
+	 * Whether the point (u, v), relative to the center of a cell, falls within the cell.
+	 *
+	 * @param double du
+	 * @param double dv
+	 * @returns bool
+	 */
+	inline bool contains(double du, double dv) const {
+		if (this->hexagon) {
+			return std::abs(dv) <= this->cellHeight / 2 &&
+			       std::abs(du) <= this->cellSize - std::abs(dv) / std::numbers::sqrt3;
+		}
+		return std::abs(du) <= this->cellSize / 2 && std::abs(dv) <= this->cellSize / 2;
 	}
-	delete buffOuterPolygons;
-	delete buffInnerPolygons;
 
-	return p_polygonMask;
-}
+	/**
+	 * Whether the bounding box of cell (i, j) intersects the extent given. Cells
+	 * which don't are not part of the grid.
+	 *
+	 * @param int i
+	 * @param int j
+	 * @param double xMin
+	 * @param double xMax
+	 * @param double yMin
+	 * @param double yMax
+	 * @returns bool
+	 */
+	inline bool intersects(int i, int j, double xMin, double xMax, double yMin, double yMax) const {
+		double cu, cv, x, y;
+		this->center(i, j, cu, cv);
+		this->toXY(cu, cv, x, y);
+
+		//the circumscribed radius of the cell
+		double radius = this->hexagon ? this->cellSize : this->cellSize / std::numbers::sqrt2;
+		return x + radius >= xMin && x - radius <= xMax && y + radius >= yMin && y - radius <= yMax;
+	}
+};
 
 /**
  * @ingroup systematic
@@ -121,20 +261,6 @@ checkExtent(double x, double y, double xMin, double xMax, double yMin, double yM
 	return (x >= xMin && x <= xMax && y >= yMin && y <= yMax); 
 }
 
-/**
- * @ingroup systematic
- * Helper function for checking to see whether a pixel occurs within accessible area.
- *
- * @param OGRPoint *p_point
- * @param OGRGeometry *p_geometry
- *
- * @returns bool
- */
-inline bool
-checkAccess(OGRPoint *p_point, OGRGeometry *p_geometry) {
-	return !p_geometry || p_point->Within(p_geometry);
-}
-
 /**
  * @ingroup systematic
  * Helper function for checking to see whether a pixel is already an existing sample location.
@@ -152,87 +278,122 @@ checkExisting(double x, double y, existing::Existing& existing) {
 
 /**
  * @ingroup systematic
- * Helper function for checking to see whether a coordinate occurs in an area of nodata.
+ * Helper function which checks a batch of candidate points against the raster,
+ * setting keep[i] to false if candidate i falls on a nodata pixel of any band
+ * (if force is true) or on an inaccessible pixel (if access is used).
  *
- * the 'force' parameter is first checked, because if force is not true, then samples
- * are allowed to occur on nodata pixels.
+ * Rather than reading one pixel per candidate, the pixels are read with
+ * reader::readPixels(), which reads only the blocks containing at least one
+ * candidate, each exactly once, using threads threads.
  *
- * THe inverted geotransform is used to find the x and y values from the coordinates
- * given. Then, every raster band within the input raster is checked, and if that 
- * pixel is a no data value in any of them false is returned. the GDALRasterBand
- * RasterIO function is used to read the desried pixel from the raster.
- *
- * @param GDALRasterWrapper *p_raster,
- * @param double *IGT
- * @param double xCoord
- * @param double yCoord
+ * @param std::vector<helper::RasterBandMetaData>& bands
+ * @param access::Access& access
  * @param bool force
- *
- * @returns bool
+ * @param double *IGT
+ * @param int width
+ * @param int height
+ * @param std::vector<double>& xs
+ * @param std::vector<double>& ys
+ * @param std::vector<uint8_t>& keep
+ * @param int threads
  */
-inline bool
-checkNotNan(raster::GDALRasterWrapper *p_raster, double *IGT, double xCoord, double yCoord, bool force) {
+inline void
+checkPixels(
+	std::vector<helper::RasterBandMetaData>& bands,
+	access::Access& access,
+	bool force,
+	double *IGT,
+	int width,
+	int height,
+	std::vector<double>& xs,
+	std::vector<double>& ys,
+	std::vector<uint8_t>& keep,
+	int threads)
+{
+	if (!force && !access.used) {
+		return;
+	}
+
+	std::vector<helper::RasterBandMetaData *> p_bands;
+	std::vector<double> nans;
 	if (force) {
-		int x = static_cast<int>(IGT[0] + xCoord * IGT[1] + yCoord * IGT[2]);
-		int y = static_cast<int>(IGT[3] + xCoord * IGT[4] + yCoord * IGT[5]);
-	
-		for (int i = 0; i < p_raster->getBandCount(); i++) {
-			GDALRasterBand *p_band = p_raster->getRasterBand(i);
-			
-			double val;
-			OGRErr err = p_band->RasterIO(GF_Read, x, y, 1, 1, &val, 1, 1, GDT_Float64, 0, 0);
-			if (err) {
-				throw std::runtime_error("could not read value from raster.");
-			}
+		for (helper::RasterBandMetaData& band : bands) {
+			p_bands.push_back(&band);
+			nans.push_back(band.nan);
+		}
+	}
+	size_t rasterBands = p_bands.size();
+	if (access.used) {
+		p_bands.push_back(&access.band);
+	}
 
-			if (val == p_band->GetNoDataValue() || std::isnan(val)) {
-				return false;
-			}	
-		}	
+	//candidates which have already been rejected are given a pixel outside the raster, so they're not read
+	std::vector<int> pixelX(xs.size(), -1), pixelY(xs.size(), -1);
+	for (size_t i = 0; i < xs.size(); i++) {
+		if (keep[i]) {
+			pixelX[i] = std::clamp(static_cast<int>(IGT[0] + xs[i] * IGT[1] + ys[i] * IGT[2]), 0, width - 1);
+			pixelY[i] = std::clamp(static_cast<int>(IGT[3] + xs[i] * IGT[4] + ys[i] * IGT[5]), 0, height - 1);
+		}
 	}
 
-	return true;
-}	
+	bool useAccess = access.used;
+	reader::readPixels(p_bands, pixelX.data(), pixelY.data(), xs.size(), width, height, threads, [&](size_t i, const double *p_values) {
+		for (size_t b = 0; b < rasterBands; b++) {
+			if (p_values[b] == nans[b] || std::isnan(p_values[b])) {
+				keep[i] = false;
+			}
+		}
+		if (useAccess && p_values[rasterBands] == 1) {
+			keep[i] = false;
+		}
+	});
+}
 
 /**
  * @ingroup systematic
  * This function conducts Systematic sampling on an input raster image.
  *
- * First, the extent polygon of the raster is determined, then a random
- * point is found within the polygon to act as the origin. An SQL query
- * is conducted using one of the ST_SquareGrid, or ST_HexagonalGrid
- * spatialite functions to create a grid of polygons
- * of the user-specified shape. The grid is then rotated by a randomly
- * generated rotation angle.
- *
- * Next, the resulting grid polygons are iterated through, and a sample
- * point is determined for each polygon depending on the user-defined
- * location parameter (centers, corners, or random), and the samples are
- * saved to an OGRLayer which is part of GDALDataset. Plot-required data
- * is saved if plot is true (to later be utilized by the Python side
- * of the application with matplotlib).
- *
- * If the an access vector is given, then polygons of the accessible area
- * are created, and each sample is check to ensure it falls within the
- * accessible area.
+ * First, a random rotation angle and random lattice offset are chosen, and
+ * a Lattice is created of the user-specified shape which covers the extent
+ * of the raster. The cells of the lattice are never created as polygons,
+ * instead the candidate sample point of every cell is calculated directly
+ * (depending on the user-defined location parameter: centers, corners, or
+ * random) into coordinate arrays. Plot-required data is saved if plot is
+ * true (to later be utilized by the Python side of the application with
+ * matplotlib).
  *
+ * Every candidate is checked to ensure it falls within the raster extent.
  * If an existing vector is given, all of the sample points within the
- * existing vector are added, and each point is checked to ensure it
+ * existing vector are added, and each candidate is checked to ensure it
  * has not already been added by virtue of already existing as a sample
  * point.
  *
- * If the force parameter is given, every sample added is checked against
- * the input raster to ensure the sample does not fall in a no data pixel.
- * If it does the sample is thrown out. In the case where each grid cell
- * is randomly sampled, 10 tries are allowed to find a point which is
- * contains a data pixel otherwise that cell is not sampled.
+ * If an access vector is given, an access::Access mask is rasterized, and
+ * each candidate is checked to ensure it falls within the accessible area. If
+ * the force parameter is given, every candidate is checked against the input
+ * raster to ensure it does not fall in a no data pixel. Both of these checks
+ * are done as batched block reads using checkPixels(). In the case where each
+ * grid cell is randomly sampled, there are SYSTEMATIC_RANDOM_TRIES rounds where
+ * every cell which doesn't yet have a sample gets a new random candidate,
+ * otherwise that cell is not sampled.
+ *
+ * The accepted candidates are then added to the output layer, in the order
+ * of the cells of the lattice.
  *
  * @param GDALRasterWrapper *p_raster
  * @param double cellSize
  * @param std::string shape
  * @param std::string location
+ * @param GDALVectorWrapper *p_existing
+ * @param GDALVectorWrapper *p_access
+ * @param std::string layerName
+ * @param double buffInner
+ * @param double buffOuter
+ * @param bool force
  * @param bool plot
+ * @param std::string tempFolder
  * @param std::string filename
+ * @param int threads
  * @returns std::tuple<
  * 		GDALVectorWrapper *,
  * 		std::vector<std::vector<double>>,
@@ -256,7 +417,9 @@ systematic(
 	double buffOuter,
 	bool force,
 	bool plot,
-	std::string filename)
+	std::string tempFolder,
+	std::string filename,
+	int threads)
 {
 	GDALAllRegister();
 	
@@ -265,6 +428,9 @@ systematic(
 	GT = p_raster->getGeotransform();
 	GDALInvGeoTransform(GT, IGT);	
 
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+
 	//determine raster extent
 	double xMin, xMax, yMin, yMax;
 	xMin = p_raster->getXMin();
@@ -273,46 +439,16 @@ systematic(
 	yMax = p_raster->getYMax();
 	
 	//generate random number generator
-	double xDiff = xMax - xMin;
-	double yDiff = yMax - yMin;
-	double rngMax = yDiff * xDiff;
 	std::mt19937::result_type seed = time(nullptr);
-	auto rng = std::bind(
-		std::uniform_real_distribution<double>(0, rngMax),
-		std::mt19937(seed)
-	);
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<double> dist(0, 1);
+	auto rng = [&gen, &dist]() { return dist(gen); };
 
-	//determine random rotation angle within extent polygon
-	double rotation = rng() / (rngMax / 180);
-
-	//determine grid creation function
-	std::string gridFunction;
-	if (shape == "square") {
-		gridFunction = "ST_SquareGrid";
-	}
-	else { //shape == "hexagon" 
-		gridFunction = "ST_HexagonalGrid";
-	}
-
-	//create sql query using extent polygon and grid function
-	std::string extentPolygon = "'POLYGON (( " 
-		+ std::to_string(xMin) + " " + std::to_string(yMin) + ", "
-		+ std::to_string(xMin) + " " + std::to_string(yMax) + ", "
-		+ std::to_string(xMax) + " " + std::to_string(yMax) + ", "
-		+ std::to_string(xMax) + " " + std::to_string(yMin) + ", "
-		+ std::to_string(xMin) + " " + std::to_string(yMin) + " ))'";
-
-	std::string queryString = "SELECT RotateCoords(" 
-		+ gridFunction 
-		+ "(RotateCoords("
-		+ "ST_GeomFromText("
-		+ extentPolygon
-		+ "), " + std::to_string(-rotation) + "), "
-		+ std::to_string(cellSize) + "), "
-		+ std::to_string(rotation) + ")";
-
-	//query to create grid
-	OGRLayer *p_grid = p_raster->getDataset()->ExecuteSQL(queryString.c_str(), nullptr, "SQLITE");
+	//determine random rotation angle and lattice offset
+	double rotation = rng() * 180;
+	double uFraction = rng();
+	double vFraction = rng();
+	Lattice lattice(shape == "hexagon", cellSize, rotation, uFraction, vFraction, xMin, xMax, yMin, yMax);
 
 	//create output dataset before anything that might take a long time (in case creation of dataset fails)
 	GDALDriver *p_driver = GetGDALDriverManager()->GetDriverByName("MEM");
@@ -330,151 +466,157 @@ systematic(
 		throw std::runtime_error("unable to create output dataset layer.");
 	}
 
-	//get access polygon if access is given
-	OGRGeometry *access = nullptr;
-	if (p_access) {
-		//occasionally, samples end up being placed just outside the accessible area,
-		//typically when the buffer sizes are multiples of the pixel size. 
-		//
-		//Adjusting the buffers minorly fixes this problem.
-		double pixelSize = std::min(p_raster->getPixelHeight(), p_raster->getPixelWidth());
-		buffOuter = buffOuter - pixelSize / 50;
-		buffInner = buffInner == 0 ? 0 : buffInner + pixelSize / 50;
-
-		access = getAccessPolygon(p_access, layerName, buffInner, buffOuter);
+	//get raster bands, used for the nodata check and to determine the block size of the access mask
+	std::mutex dataMutex;
+	std::mutex accessMutex;
+	std::vector<helper::RasterBandMetaData> bands(p_raster->getBandCount());
+	for (size_t i = 0; i < bands.size(); i++) {
+		bands[i].p_band = p_raster->getRasterBand(i);
+		bands[i].type = p_raster->getRasterBandType(i);
+		bands[i].size = p_raster->getRasterBandTypeSize(i);
+		bands[i].nan = bands[i].p_band->GetNoDataValue();
+		bands[i].p_mutex = &dataMutex;
+		bands[i].p_band->GetBlockSize(&bands[i].xBlockSize, &bands[i].yBlockSize);
 	}
 
+	//generate access structure if access is given
+	access::Access access(
+		p_access,
+		p_raster,
+		layerName,
+		buffInner,
+		buffOuter,
+		true,
+		tempFolder,
+		bands[0].xBlockSize,
+		bands[0].yBlockSize,
+		threads
+	);
+	access.band.p_mutex = &accessMutex;
+
 	//coordinate representations the samples as vectors only if PLOT is true, returned to the (Python) caller
 	std::vector<double> xCoords, yCoords;
 
 	//create existing struct
-	existing::Existing existing(p_existing, p_raster, GT, p_raster->getWidth(), p_sampleLayer, plot, xCoords, yCoords);
+	existing::Existing existing(p_existing, p_raster, GT, width, p_sampleLayer, plot, xCoords, yCoords);
 	helper::Field fieldExistingFalse("existing", 0);
 
 	//grid represents the grid used to create the sampels only if PLOT is true, and is returned to the (Python) caller
 	std::vector<std::vector<std::vector<double>>> grid;
 
-	//iterate through the polygons in the grid and populate the ruturn data depending on user inputs
-	for (const auto& p_feature : *p_grid) {
-		OGRGeometry *p_geometry = p_feature->GetGeometryRef();
-		for (const auto& p_polygon : *p_geometry->toMultiPolygon()) {
-			//generate sample depending on 'location' parameter
-			OGRPoint point;
-			OGRPoint secondPoint;
-			if (location == "centers") {
-				p_polygon->Centroid(&point);
-
-				double x = point.getX();
-				double y = point.getY();
-				if (checkExtent(x, y, xMin, xMax, yMin, yMax) &&
-				    checkAccess(&point, access) &&
-				    checkExisting(x, y, existing) &&
-				    checkNotNan(p_raster, IGT, x, y, force)) 
-				{
-					existing.used ?
-						helper::addPoint(&point, p_sampleLayer, &fieldExistingFalse) :
-						helper::addPoint(&point, p_sampleLayer);
-
-					if (plot) {
-						xCoords.push_back(x);
-						yCoords.push_back(y);
-					}	
-				}
+	//step 1: determine the cells of the lattice which intersect the raster extent
+	std::vector<std::pair<int, int>> cells;
+	for (int j = lattice.jStart; j <= lattice.jEnd; j++) {
+		for (int i = lattice.iStart; i <= lattice.iEnd; i++) {
+			if (lattice.intersects(i, j, xMin, xMax, yMin, yMax)) {
+				cells.push_back({i, j});
 			}
-			else if (location == "corners") {
-				(*p_polygon->begin())->getPoint(0, &point);
-				(*p_polygon->begin())->getPoint(1, &secondPoint);
-
-				double x = point.getX();
-				double y = point.getY();
-				if (checkExtent(x, y, xMin, xMax, yMin, yMax) &&
-				    checkAccess(&point, access) &&
-				    checkExisting(x, y, existing) &&
-				    checkNotNan(p_raster, IGT, x, y, force)) 
-				{
-					existing.used ?
-						helper::addPoint(&point, p_sampleLayer, &fieldExistingFalse) :
-						helper::addPoint(&point, p_sampleLayer);
-
-					if (plot) {
-						xCoords.push_back(x);
-						yCoords.push_back(y);
-					}	
-				}
+		}
+	}
 
-				x = secondPoint.getX();
-				y = secondPoint.getY();
-				if (checkExtent(x, y, xMin, xMax, yMin, yMax) &&
-				    checkAccess(&secondPoint, access) &&
-				    checkExisting(x, y, existing) &&
-				    checkNotNan(p_raster, IGT, x, y, force)) 
-				{
-					existing.used ?
-						helper::addPoint(&point, p_sampleLayer, &fieldExistingFalse) :
-						helper::addPoint(&secondPoint, p_sampleLayer);
-
-					if (plot) {
-						xCoords.push_back(x);
-						yCoords.push_back(y);
-					}	
+	//the extent and existing checks are cheap, the raster checks are batched by block
+	auto check = [&](std::vector<double>& xs, std::vector<double>& ys) {
+		std::vector<uint8_t> keep(xs.size());
+		for (size_t i = 0; i < xs.size(); i++) {
+			keep[i] = checkExtent(xs[i], ys[i], xMin, xMax, yMin, yMax) && checkExisting(xs[i], ys[i], existing);
+		}
+		checkPixels(bands, access, force, IGT, width, height, xs, ys, keep, threads);
+		return keep;
+	};
+
+	//step 2: generate and check the candidate sample points of every cell
+	std::vector<double> xs, ys;
+	std::vector<uint8_t> keep;
+	if (location == "centers" || location == "corners") {
+		std::vector<double> us, vs;
+		for (const auto& [i, j] : cells) {
+			double u, v, x, y;
+			if (location == "centers") {
+				lattice.center(i, j, u, v);
+				lattice.toXY(u, v, x, y);
+				xs.push_back(x);
+				ys.push_back(y);
+			}
+			else {
+				lattice.corners(i, j, us, vs);
+				for (int k = 0; k < lattice.ownedCorners(); k++) {
+					lattice.toXY(us[k], vs[k], x, y);
+					xs.push_back(x);
+					ys.push_back(y);
 				}
+			}
+		}
+		keep = check(xs, ys);
+	}
+	else { //location == "random"
+		xs.resize(cells.size());
+		ys.resize(cells.size());
+		keep.assign(cells.size(), false);
+
+		std::vector<size_t> pending(cells.size());
+		for (size_t c = 0; c < cells.size(); c++) {
+			pending[c] = c;
+		}
 
+		double uHalf = lattice.hexagon ? cellSize : cellSize / 2;
+		double vHalf = lattice.cellHeight / 2;
+		for (int tries = 0; tries < SYSTEMATIC_RANDOM_TRIES && !pending.empty(); tries++) {
+			std::vector<double> tryXs(pending.size()), tryYs(pending.size());
+			for (size_t p = 0; p < pending.size(); p++) {
+				double cu, cv, du, dv;
+				lattice.center(cells[pending[p]].first, cells[pending[p]].second, cu, cv);
+				do {
+					du = (2 * rng() - 1) * uHalf;
+					dv = (2 * rng() - 1) * vHalf;
+				} while (!lattice.contains(du, dv));
+				lattice.toXY(cu + du, cv + dv, tryXs[p], tryYs[p]);
 			}
-			else { //location == "random"
-				OGREnvelope envelope;
-				p_polygon->getEnvelope(&envelope);
-				double xMinEnv = envelope.MinX;
-				double xMaxEnv = envelope.MaxX;
-				double xDiffEnv = xMaxEnv - xMinEnv;
-				double yMinEnv = envelope.MinY;
-				double yMaxEnv = envelope.MaxY;
-				double yDiffEnv = yMaxEnv - yMinEnv;
-
-				int tries = 0;
-				bool found = false;
-
-				while (tries < 10 && !found) {
-					point.setX(xMinEnv + rng() / (rngMax / xDiffEnv));
-					point.setY(yMinEnv + rng() / (rngMax / yDiffEnv));
-					while (!p_polygon->Contains(&point)) {
-						point.setX(xMinEnv + rng() / (rngMax / xDiffEnv));
-						point.setY(yMinEnv + rng() / (rngMax / yDiffEnv));
-					}
-
-					double x = point.getX();
-					double y = point.getY();
-					if (checkExtent(x, y, xMin, xMax, yMin, yMax) &&
-				    	    checkAccess(&point, access) &&
-				    	    checkExisting(x, y, existing) &&
-					    checkNotNan(p_raster, IGT, x, y, force)) 
-					{
-						found = true;
-						existing.used ?
-							helper::addPoint(&point, p_sampleLayer, &fieldExistingFalse) :
-							helper::addPoint(&point, p_sampleLayer);
-
-						if (plot) {
-							xCoords.push_back(x);
-							yCoords.push_back(y);
-						}	
-					}
-
-					tries++;
+
+			std::vector<uint8_t> tryKeep = check(tryXs, tryYs);
+			std::vector<size_t> stillPending;
+			for (size_t p = 0; p < pending.size(); p++) {
+				if (tryKeep[p]) {
+					xs[pending[p]] = tryXs[p];
+					ys[pending[p]] = tryYs[p];
+					keep[pending[p]] = true;
 				}
-			}
-	
-			//set grid vector to be plot
-			if (plot) {
-				grid.push_back({}); //add new polygon to grid
-				grid.back().push_back({}); //add new x vector to polygon grid
-				grid.back().push_back({}); //add new y vector to polygon grid
-				for (const auto& p_linearRing : *p_polygon) {
-					for (const auto& p_point : *p_linearRing) {
-						grid.back()[0].push_back(p_point.getX());
-						grid.back()[1].push_back(p_point.getY());
-					}
+				else {
+					stillPending.push_back(pending[p]);
 				}
 			}
+			pending.swap(stillPending);
+		}
+	}
+
+	//step 3: add the accepted samples to the output layer, in cell order
+	for (size_t i = 0; i < xs.size(); i++) {
+		if (!keep[i]) {
+			continue;
+		}
+
+		OGRPoint point(xs[i], ys[i]);
+		existing.used ?
+			helper::addPoint(&point, p_sampleLayer, &fieldExistingFalse) :
+			helper::addPoint(&point, p_sampleLayer);
+
+		if (plot) {
+			xCoords.push_back(xs[i]);
+			yCoords.push_back(ys[i]);
+		}
+	}
+
+	//set grid vector to be plot
+	if (plot) {
+		std::vector<double> us, vs;
+		for (const auto& [i, j] : cells) {
+			lattice.corners(i, j, us, vs);
+			grid.push_back({{}, {}});
+			for (size_t k = 0; k <= us.size(); k++) {
+				double x, y;
+				lattice.toXY(us[k % us.size()], vs[k % vs.size()], x, y);
+				grid.back()[0].push_back(x);
+				grid.back()[1].push_back(y);
+			}
 		}
 	}
 
@@ -487,12 +629,6 @@ systematic(
 		}
 	}	
 
-	//clean up memory
-	p_raster->getDataset()->ReleaseResultSet(p_grid);
-	if (p_access) {
-		OGRGeometryFactory::destroyGeometry(access);
-	}
-
 	return {p_wrapper, {xCoords, yCoords}, grid};
 }
 
@@ -14,6 +14,7 @@
 import os
 import sys
 import site
+import tempfile
 from typing import Optional
 
 import numpy as np
@@ -57,6 +58,11 @@ from _sgs import systematic_cpp
 # fall on an index which is NOT a no data value. This may result
 # in some grids not being sampled.
 # 
+# The grid is generated directly from the cell size, shape, and a random
+# rotation and offset, rather than as a set of polygons. The nodata (if force
+# is True) and access checks are batched by raster block, and use thread_count
+# threads.
+# 
 # Examples
 # --------------------
 # rast = sgspy.SpatialRaster("raster.tif") @n
@@ -102,6 +108,8 @@ from _sgs import systematic_cpp
 #     whether or not to plot the resulting samples @n @n
 # filename : str @n
 #     the filename to write to or "" if not to write @n @n
+# thread_count : int @n
+#     the number of threads to use when checking samples against the raster and access mask @n @n
 # 
 # Returns
 # --------------------
@@ -118,7 +126,8 @@ def systematic(
     buff_outer: Optional[int | float] = None,
     force: bool = False,
     plot: bool = False,
-    filename: str = ""):
+    filename: str = "",
+    thread_count: int = 8):
         
     if type(rast) is not SpatialRaster:
         raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster.")
@@ -156,6 +165,9 @@ def systematic(
     if type(filename) is not str:
         raise TypeError("'filename' parameter must be of type str.")
 
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
     if rast.closed:
         raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
 
@@ -168,6 +180,9 @@ def systematic(
     if location not in ["centers", "corners", "random"]:
         raise ValueError("location parameter must be one of 'centers', 'corners', 'random'")
 
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
     if (access):
         if layer_name is None:
             if len(access.layers) > 1:
@@ -198,6 +213,11 @@ def systematic(
     else:
         existing_vector = None
 
+    temp_dir = rast.cpp_raster.get_temp_dir()
+    if temp_dir == "":
+        temp_dir = tempfile.mkdtemp()
+        rast.cpp_raster.set_temp_dir(temp_dir)
+
     [samples, points, grid] = systematic_cpp(
         rast.cpp_raster,
         cellsize,
@@ -210,7 +230,9 @@ def systematic(
         buff_outer,
         force,
         plot,
-        filename
+        temp_dir,
+        filename,
+        thread_count
     )
 
     #plot new vector if requested
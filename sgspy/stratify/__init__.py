@@ -10,6 +10,7 @@ from . import (
     poly,
     quantiles,
     map,
+    pipeline,
 )
 
 from .breaks import breaks
@@ -17,6 +18,7 @@ from .kmeans import kmeans
 from .poly import poly
 from .quantiles import quantiles
 from .map import map
+from .pipeline import pipeline
 
 __all__ = [
     "breaks",
@@ -24,4 +26,5 @@ __all__ = [
     "poly",
     "quantiles",
     "map",
+    "pipeline",
 ]
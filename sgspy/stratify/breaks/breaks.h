@@ -13,118 +13,21 @@
  * @ingroup stratify
  */
 
+#pragma once
+
 #include <iostream>
 
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
 
 #include "utils/raster.h"
+#include "utils/classify.h"
 #include "utils/helper.h"
+#include "utils/reader.h"
 
 namespace sgs {
 namespace breaks {
 
-/**
- * @ingroup breaks
- * This is a helper function for processing a pixel of data
- * when a mapped stratification is being created.
- *
- * First, the value is read in as a double, and it is determined
- * whether the pixel is a nan pixel or not. The mapNan boolean 
- * is updated in addition to the isNan boolean, to ensure that
- * if one band within the raster is nan at a certain pixel
- * then the mapped raster (but not necessarily all output rasters)
- * is also nan at that pixel.
- *
- * Then, if it isn't a nan pixel the lower bound of the value 
- * within the vector of break values is found. For example,
- * if the value was 3 and the breaks vector was [2, 4, 6], the
- * lower bound would be 1, which is the index of 4, the first
- * value larger than 3 in the breaks vector. This lower bound
- * is the strata. This strata (or the nan value) is then written 
- * with the appropriate type to the strat raster band.
- *
- * @param size_t index
- * @param RasterBandMetaData& dataBand
- * @param void *p_dataBuffer
- * @param RasterBandMetaData& stratBand
- * @param void *p_stratBuffer
- * @param std::vector<double>& bandBreaks
- * @param size_t multiplier
- * @param bool& mapNan
- * @param size_t& mapStrat
- */
-inline void processMapPixel(
-	size_t index,
-	helper::RasterBandMetaData& dataBand,
-	void *p_dataBuffer,
-	helper::RasterBandMetaData& stratBand,
-	void *p_stratBuffer,
-	std::vector<double>& bandBreaks,
-	size_t multiplier,
-	bool& mapNan,
-	size_t& mapStrat)
-{
-	double val = helper::getPixelValueDependingOnType<double>(dataBand.type, p_dataBuffer, index);
-	bool isNan = std::isnan(val) || (double)val == dataBand.nan;
-	mapNan |= isNan;
-		
-	size_t strat = 0;
-	if (!isNan) {
-		auto it = std::lower_bound(bandBreaks.begin(), bandBreaks.end(), val);
-		strat = (it == bandBreaks.end()) ? bandBreaks.size() : std::distance(bandBreaks.begin(), it);
-	}
-
-	helper::setStrataPixelDependingOnType(stratBand.type, p_stratBuffer, index, isNan, strat);
-
-	if (!mapNan) {
-		mapStrat += strat * multiplier;
-	}
-}	
-
-/**
- * @ingroup breaks
- * This is a helper function for processing a pixel of data.
- *
- * First, the value is read in as a double, and it is determined
- * whether the pixel is a nan pixel or not.
- *
- * Then, if it isn't a nan pixel the lower bound of the value 
- * within the vector of break values is found. For example,
- * if the value was 3 and the breaks vector was [2, 4, 6], the
- * lower bound would be 1, which is the index of 4, the first
- * value larger than 3 in the breaks vector. This lower bound
- * is the strata. This strata (or the nan value) is then written 
- * with the appropriate type to the strat raster band.
- *
- * @param size_t index
- * @param void *p_data
- * @param RasterBandMetaData *p_dataBand
- * @param void *p_strat
- * @param RasterBandMetaData *p_stratBand
- * @param std::vector<double>& bandBreaks
- */
-inline void
-processPixel(
-	size_t index,
-	void *p_data,
-	helper::RasterBandMetaData *p_dataBand,
-	void *p_strat,
-	helper::RasterBandMetaData *p_stratBand,
-	std::vector<double>& bandBreaks)
-{
-	double val = helper::getPixelValueDependingOnType<double>(p_dataBand->type, p_data, index);
-	bool isNan = std::isnan(val) || val == p_dataBand->nan;
-
-	size_t strat = 0;
-	if (!isNan) {
-		auto it = std::lower_bound(bandBreaks.begin(), bandBreaks.end(), val);
-		strat = (it == bandBreaks.end()) ? bandBreaks.size() : std::distance(bandBreaks.begin(), it);
-	}
-
-	helper::setStrataPixelDependingOnType(p_stratBand->type, p_strat, index, isNan, strat);
-}
-
 /**
  * @ingroup breaks
  * This function stratifies a given raster using user-defined breaks.
@@ -383,7 +286,6 @@ raster::GDALRasterWrapper *breaks(
 
 	//iterate through all pixels and update the stratified raster bands
 	if (largeRaster) {
-		pybind11::gil_scoped_acquire acquire;
 		boost::asio::thread_pool pool(threads);
 
 		if (map) {
@@ -391,9 +293,8 @@ raster::GDALRasterWrapper *breaks(
 			int xBlockSize = dataBands[0].xBlockSize;
 			int yBlockSize = dataBands[0].yBlockSize;
 
-			int xBlocks = (p_raster->getWidth() + xBlockSize - 1) / xBlockSize;
 			int yBlocks = (p_raster->getHeight() + yBlockSize - 1) / yBlockSize;
-			int chunkSize = yBlocks / threads;
+			int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
 
 			for (int yBlockStart = 0; yBlockStart < yBlocks; yBlockStart += chunkSize) {
 				int yBlockEnd = std::min(yBlockStart + chunkSize, yBlocks);
@@ -404,97 +305,87 @@ raster::GDALRasterWrapper *breaks(
 					yBlockSize, 
 					yBlockStart, 
 					yBlockEnd, 
-					xBlocks, 
+					width,
+					height,
 					&dataBands, 
 					&stratBands, 
 					&bandBreaks,
 					&multipliers
 				] {
-					std::vector<void *> dataBuffers(dataBands.size());
 					std::vector<void *> stratBuffers(stratBands.size());
-					for (size_t band = 0; band < dataBuffers.size(); band++) {
-						dataBuffers[band] = VSIMalloc3(xBlockSize, yBlockSize, dataBands[band].size);
+					for (size_t band = 0; band < stratBuffers.size(); band++) {
 						stratBuffers[band] = VSIMalloc3(xBlockSize, yBlockSize, stratBands[band].size);
 					}
-					stratBuffers.back() = VSIMalloc3(xBlockSize, yBlockSize, stratBands.back().size);
-
-					for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
-						for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-							int xValid, yValid;
-							dataBands[0].p_mutex->lock();
-							dataBands[0].p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-							dataBands[0].p_mutex->unlock();
-
-							//read raster band data into band buffers
-							for (size_t band = 0; band < bandCount; band++) {
-								helper::rasterBandIO(
-									dataBands[band], 
-									dataBuffers[band], 
-									xBlockSize, 
-									yBlockSize, 
-									xBlock, 
-									yBlock, 
-									xValid, 
-									yValid, 
-									true //read = true
-								);		
-							}
-
-							//process blocked band data
-							for (int y = 0; y < yValid; y++) {
-								size_t index = static_cast<size_t>(y * xBlockSize);
-								for (int x = 0; x < xValid; x++) {
-									bool mapNan = false;
-									size_t mapStrat = 0;
-									
-									for (size_t band = 0; band < bandCount; band++) {
-										processMapPixel(
-											index, 
-											dataBands[band], 
-											dataBuffers[band], 
-											stratBands[band], 
-											stratBuffers[band], 
-											bandBreaks[band],
-											multipliers[band],
-											mapNan,
-											mapStrat
-										);
-									}
-								
-									helper::setStrataPixelDependingOnType(
-										stratBands.back().type,
-										stratBuffers.back(),
-										index,
-										mapNan,
-										mapStrat
-									);
-
-									index++;
-								}
-							}
-					
-							//write strat band data
-							for (size_t band = 0; band <= bandCount; band++) {
-								helper::rasterBandIO(
-									stratBands[band],
-									stratBuffers[band],
-									xBlockSize,
-									yBlockSize,
-									xBlock,
-									yBlock,
-									xValid,
-									yValid,
-									false //read = false
-								);
-							}
+
+					//mapped strata are accumulated across the bands of each block before being written
+					std::vector<int64_t> mapStrata(static_cast<size_t>(xBlockSize) * yBlockSize, 0);
+					std::vector<uint8_t> mapNan(static_cast<size_t>(xBlockSize) * yBlockSize, 0);
+
+					//raster band data is read ahead on an I/O thread while the current block is processed
+					std::vector<helper::RasterBandMetaData *> p_dataBands(bandCount);
+					for (size_t band = 0; band < bandCount; band++) {
+						p_dataBands[band] = &dataBands[band];
+					}
+					reader::BlockReader blocks(
+						p_dataBands,
+						reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+						xBlockSize,
+						yBlockSize
+					);
+
+					while (reader::Block *p_block = blocks.next()) {
+						std::vector<void *>& dataBuffers = p_block->buffers;
+						int xBlock = p_block->window.xBlock;
+						int yBlock = p_block->window.yBlock;
+						int xValid = p_block->window.xValid;
+						int yValid = p_block->window.yValid;
+
+						//process blocked band data
+						for (size_t band = 0; band < bandCount; band++) {
+							classify::classifyBlock(
+								dataBands[band],
+								dataBuffers[band],
+								stratBands[band],
+								stratBuffers[band],
+								xValid,
+								yValid,
+								xBlockSize,
+								bandBreaks[band],
+								multipliers[band],
+								mapStrata.data(),
+								mapNan.data()
+							);
+						}
+
+						classify::writeMap(
+							stratBands.back(),
+							stratBuffers.back(),
+							xValid,
+							yValid,
+							xBlockSize,
+							mapStrata.data(),
+							mapNan.data()
+						);
+				
+						//write strat band data
+						for (size_t band = 0; band <= bandCount; band++) {
+							helper::rasterBandIO(
+								stratBands[band],
+								stratBuffers[band],
+								xBlockSize,
+								yBlockSize,
+								xBlock,
+								yBlock,
+								xValid,
+								yValid,
+								false //read = false
+							);
 						}
 					}
 
-					for (size_t band = 0; band < dataBuffers.size(); band++) {
-						VSIFree(dataBuffers[band]);
+					for (size_t band = 0; band < stratBuffers.size(); band++) {
 						VSIFree(stratBuffers[band]);
 					}
-					VSIFree(stratBuffers.back());
 				});
 			}	
 		}
@@ -506,9 +397,8 @@ raster::GDALRasterWrapper *breaks(
 				int xBlockSize = p_dataBand->xBlockSize;
 				int yBlockSize = p_dataBand->yBlockSize;
 					
-				int xBlocks = (p_raster->getWidth() + xBlockSize - 1) / xBlockSize;
 				int yBlocks = (p_raster->getHeight() + yBlockSize - 1) / yBlockSize;			
-				int chunkSize = yBlocks / threads;
+				int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
 				
 				for (int yBlockStart = 0; yBlockStart < yBlocks; yBlockStart += chunkSize) {
 					int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
@@ -519,108 +409,98 @@ raster::GDALRasterWrapper *breaks(
 						yBlockSize, 
 						yBlockStart, 
 						yBlockEnd, 
-						xBlocks, 
+						width,
+						height,
 						p_dataBand, 
 						p_stratBand, 
 						p_breaks
 					] {
-						void *p_data = VSIMalloc3(xBlockSize, yBlockSize, p_dataBand->size);
 						void *p_strat = VSIMalloc3(xBlockSize, yBlockSize, p_stratBand->size);
 
-						int xValid, yValid;
-						for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
-							for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-								p_dataBand->p_mutex->lock();
-								p_dataBand->p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-								p_dataBand->p_mutex->unlock();
-								
-								//read block into memory
-								helper::rasterBandIO(
-									*p_dataBand,
-									p_data,
-									xBlockSize,
-									yBlockSize,
-									xBlock,
-									yBlock,
-									xValid,
-									yValid,
-									true //read = true
-								);
-
-								//process block
-								for (int y = 0; y < yValid; y++) {
-									size_t index = static_cast<size_t>(y * xBlockSize);
-									for (int x = 0; x < xValid; x++) {
-										processPixel(index, p_data, p_dataBand, p_strat, p_stratBand, *p_breaks);
-										index++;
-									}
-								}
-								
-								//write resulting stratifications to disk
-								helper::rasterBandIO(
-									*p_stratBand,
-									p_strat,
-									xBlockSize,
-									yBlockSize,
-									xBlock,
-									yBlock,
-									xValid,
-									yValid,
-									false //read = false
-								);
-							}
+						//blocks are read ahead on an I/O thread while the current block is processed
+						reader::BlockReader blocks(
+							{p_dataBand},
+							reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+							xBlockSize,
+							yBlockSize
+						);
+
+						while (reader::Block *p_block = blocks.next()) {
+							void *p_data = p_block->buffers[0];
+							int xValid = p_block->window.xValid;
+							int yValid = p_block->window.yValid;
+
+							//process block
+							classify::classifyBlock(*p_dataBand, p_data, *p_stratBand, p_strat, xValid, yValid, xBlockSize, *p_breaks);
+							
+							//write resulting stratifications to disk
+							helper::rasterBandIO(
+								*p_stratBand,
+								p_strat,
+								xBlockSize,
+								yBlockSize,
+								p_block->window.xBlock,
+								p_block->window.yBlock,
+								xValid,
+								yValid,
+								false //read = false
+							);
 						}
-						VSIFree(p_data);
 						VSIFree(p_strat);
 					});
 				}
 			}
 		}
 		pool.join();
-		pybind11::gil_scoped_release release;
 	}
 	else {
-		size_t pixelCount = static_cast<size_t>(p_raster->getWidth()) * static_cast<size_t>(p_raster->getHeight());
 		if (map) {
-			for (size_t index = 0; index < pixelCount; index++) {
-				bool mapNan = false;
-				size_t mapStrat = 0;
-									
+			//mapped strata are accumulated across the bands of each row before being written
+			std::vector<int64_t> mapStrata(width, 0);
+			std::vector<uint8_t> mapNan(width, 0);
+
+			for (int y = 0; y < height; y++) {
+				size_t offset = static_cast<size_t>(y) * static_cast<size_t>(width);
+
 				for (size_t band = 0; band < bandCount; band++) {
-					processMapPixel(
-						index, 
-						dataBands[band], 
-						dataBands[band].p_buffer, 
-						stratBands[band], 
-						stratBands[band].p_buffer, 
+					classify::classifyBlock(
+						dataBands[band],
+						reinterpret_cast<int8_t *>(dataBands[band].p_buffer) + offset * dataBands[band].size,
+						stratBands[band],
+						reinterpret_cast<int8_t *>(stratBands[band].p_buffer) + offset * stratBands[band].size,
+						width,
+						1,
+						width,
 						bandBreaks[band],
 						multipliers[band],
-						mapNan,
-						mapStrat
+						mapStrata.data(),
+						mapNan.data()
 					);
 				}
 
-				helper::setStrataPixelDependingOnType(
-					stratBands.back().type,
-					stratBands.back().p_buffer,
-					index,
-					mapNan,
-					mapStrat
+				classify::writeMap(
+					stratBands.back(),
+					reinterpret_cast<int8_t *>(stratBands.back().p_buffer) + offset * stratBands.back().size,
+					width,
+					1,
+					width,
+					mapStrata.data(),
+					mapNan.data()
 				);
 			}
 		}
 		else {
 			for (size_t band = 0; band < bandCount; band++) {
-				for (size_t i = 0; i < pixelCount; i++) {
-					processPixel(
-						i,
-					       	dataBands[band].p_buffer,	
-						&dataBands[band], 
-						stratBands[band].p_buffer,
-						&stratBands[band],
-						bandBreaks[band]
-					);
-				}
+				classify::classifyBlock(
+					dataBands[band],
+					dataBands[band].p_buffer,
+					stratBands[band],
+					stratBands[band].p_buffer,
+					width,
+					height,
+					width,
+					bandBreaks[band]
+				);
 			}
 		}
 
@@ -246,7 +246,7 @@ def breaks(
         bin_count = histogram_bins if histogram_bins is not None else 50 
 
         for (band, break_vals) in breaks_dict.items():
-            result = dist_cpp(rast.cpp_raster, band, cpp_vector, layer, bin_count, thread_count)
+            result = dist_cpp(rast.cpp_raster, band, cpp_vector, layer, bin_count, False, False, thread_count)
             [bins, counts] = result["population"]
             freq = counts / np.sum(counts)
             bin_size = bins[1] - bins[0]
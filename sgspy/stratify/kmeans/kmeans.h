@@ -0,0 +1,637 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: C++ implementation of raster stratification using k-means clustering
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup kmeans kmeans
+ * @ingroup stratify
+ */
+
+#pragma once
+
+#include <exception>
+#include <iostream>
+#include <limits>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+
+#include "utils/raster.h"
+#include "utils/helper.h"
+#include "utils/reader.h"
+
+#include "oneapi/dal.hpp"
+#include <xoshiro.h>
+
+typedef oneapi::dal::homogen_table				DALHomogenTable;
+
+namespace sgs {
+namespace kmeans {
+
+/**
+ * @ingroup kmeans
+ * This struct stores the pixels of a single chunk of the raster which were
+ * randomly selected for the training pool, along with any exception thrown
+ * while reading the chunk, which is re-thrown once the threads have joined.
+ */
+template <typename T>
+struct KmeansPoolChunk {
+	std::vector<T> features;
+	int64_t count = 0;
+	std::exception_ptr error = nullptr;
+};
+
+/**
+ * @ingroup kmeans
+ * This function reads a chunk of rows of blocks of the raster, adding a random subset
+ * of the pixels which are not nan in any band to the pool. Every pixel has the same
+ * probability of being added, which is determined by the multiplier (see
+ * helper::getProbabilityMultiplier()).
+ *
+ * The bands are read into a single interleaved buffer, so the features of a pixel are
+ * contiguous, in the same way as the CLHS pool.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param KmeansPoolChunk<T>& chunk
+ * @param GDALDataType type
+ * @param uint64_t multiplier
+ * @param int yBlockStart
+ * @param int yBlockEnd
+ * @param int width
+ * @param int height
+ */
+template <typename T>
+void
+readPoolChunk(
+	std::vector<helper::RasterBandMetaData>& bands,
+	KmeansPoolChunk<T>& chunk,
+	GDALDataType type,
+	uint64_t multiplier,
+	int yBlockStart,
+	int yBlockEnd,
+	int width,
+	int height)
+{
+	int nFeat = static_cast<int>(bands.size());
+	int xBlockSize = bands[0].xBlockSize;
+	int yBlockSize = bands[0].yBlockSize;
+
+	std::vector<helper::RasterBandMetaData *> p_bands(nFeat);
+	for (int b = 0; b < nFeat; b++) {
+		p_bands[b] = &bands[b];
+	}
+	reader::BlockReader blocks(
+		p_bands,
+		reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+		xBlockSize,
+		yBlockSize,
+		type,
+		sizeof(T)
+	);
+
+	//each thread has it's own random number generator
+	xso::xoshiro_4x64_plus rng;
+	helper::RandValController rand(xBlockSize, yBlockSize, multiplier, &rng);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+		rand.calculateRandValues();
+
+		for (int y = 0; y < p_block->window.yValid; y++) {
+			int index = y * xBlockSize;
+			for (int x = 0; x < p_block->window.xValid; x++) {
+				T *p_features = p_data + static_cast<size_t>(index) * nFeat;
+
+				bool isNan = false;
+				for (int b = 0; b < nFeat && !isNan; b++) {
+					isNan = std::isnan(p_features[b]) || p_features[b] == static_cast<T>(bands[b].nan);
+				}
+
+				if (!isNan && rand.keep(index)) {
+					chunk.features.insert(chunk.features.end(), p_features, p_features + nFeat);
+					chunk.count++;
+				}
+				index++;
+			}
+		}
+	}
+}
+
+/**
+ * @ingroup kmeans
+ * This function assigns every pixel within a chunk of rows of blocks to the strata of
+ * it's nearest centroid, and writes the strata to the output band. Pixels which are nan
+ * in any band are given the nodata value of the output band.
+ *
+ * The features of each pixel are standardized using the same offsets and scales as the
+ * training pool, and the centroids are in the standardized space.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param RasterBandMetaData& stratBand
+ * @param std::vector<T>& centroids
+ * @param std::vector<T>& offsets
+ * @param std::vector<T>& scales
+ * @param int numStrata
+ * @param GDALDataType type
+ * @param int yBlockStart
+ * @param int yBlockEnd
+ * @param int width
+ * @param int height
+ */
+template <typename T, typename S>
+void
+assignChunk(
+	std::vector<helper::RasterBandMetaData>& bands,
+	helper::RasterBandMetaData& stratBand,
+	std::vector<T>& centroids,
+	std::vector<T>& offsets,
+	std::vector<T>& scales,
+	int numStrata,
+	GDALDataType type,
+	int yBlockStart,
+	int yBlockEnd,
+	int width,
+	int height)
+{
+	int nFeat = static_cast<int>(bands.size());
+	int xBlockSize = bands[0].xBlockSize;
+	int yBlockSize = bands[0].yBlockSize;
+	S nanStrata = static_cast<S>(stratBand.nan);
+
+	std::vector<helper::RasterBandMetaData *> p_bands(nFeat);
+	for (int b = 0; b < nFeat; b++) {
+		p_bands[b] = &bands[b];
+	}
+	reader::BlockReader blocks(
+		p_bands,
+		reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+		xBlockSize,
+		yBlockSize,
+		type,
+		sizeof(T)
+	);
+
+	std::vector<S> strata(static_cast<size_t>(xBlockSize) * static_cast<size_t>(yBlockSize));
+	std::vector<T> features(nFeat);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+		int xValid = p_block->window.xValid;
+		int yValid = p_block->window.yValid;
+
+		for (int y = 0; y < yValid; y++) {
+			int index = y * xBlockSize;
+			for (int x = 0; x < xValid; x++) {
+				T *p_features = p_data + static_cast<size_t>(index) * nFeat;
+
+				bool isNan = false;
+				for (int b = 0; b < nFeat && !isNan; b++) {
+					isNan = std::isnan(p_features[b]) || p_features[b] == static_cast<T>(bands[b].nan);
+					features[b] = (p_features[b] - offsets[b]) / scales[b];
+				}
+
+				if (isNan) {
+					strata[index] = nanStrata;
+					index++;
+					continue;
+				}
+
+				//find nearest centroid using squared euclidean distance
+				int nearest = 0;
+				T nearestDist = std::numeric_limits<T>::max();
+				for (int k = 0; k < numStrata; k++) {
+					const T *p_centroid = centroids.data() + static_cast<size_t>(k) * nFeat;
+					T dist = 0;
+					for (int b = 0; b < nFeat; b++) {
+						T diff = features[b] - p_centroid[b];
+						dist += diff * diff;
+					}
+
+					if (dist < nearestDist) {
+						nearestDist = dist;
+						nearest = k;
+					}
+				}
+
+				strata[index] = static_cast<S>(nearest);
+				index++;
+			}
+		}
+
+		helper::rasterBandIO(
+			stratBand,
+			strata.data(),
+			xBlockSize,
+			yBlockSize,
+			p_block->window.xBlock,
+			p_block->window.yBlock,
+			xValid,
+			yValid,
+			false //read = false
+		);
+	}
+}
+
+/**
+ * @ingroup kmeans
+ * This function trains the k-means model on a random pool of the raster, for a
+ * particular floating point type T.
+ *
+ * The raster is split into chunks of rows of blocks, and each chunk is read by a thread
+ * which adds a random subset of the pixels to it's own pool. The pools are concatenated
+ * in raster order once every thread has finished. If scale is true, the offset and scale
+ * of every feature are set to the mean and standard deviation of that feature within the
+ * pool, so that bands with large values do not dominate the distances, otherwise they are
+ * 0 and 1. The standardized pool is passed to oneDAL, which initializes the centroids
+ * using k-means++ and trains the model using Lloyd's algorithm.
+ *
+ * The centroids are sorted by their first feature, so that the strata are ordered
+ * consistently between runs.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param GDALDataType type
+ * @param int numStrata
+ * @param int64_t poolSize
+ * @param int maxIterations
+ * @param double accuracy
+ * @param bool scale
+ * @param double pixelWidth
+ * @param double pixelHeight
+ * @param int width
+ * @param int height
+ * @param int threads
+ * @param std::vector<T>& centroids the standardized centroids, written by this function
+ * @param std::vector<T>& offsets the offset of every feature, written by this function
+ * @param std::vector<T>& scales the scale of every feature, written by this function
+ * @returns std::vector<std::vector<double>> the centroids in the units of the raster bands
+ */
+template <typename T>
+std::vector<std::vector<double>>
+train(
+	std::vector<helper::RasterBandMetaData>& bands,
+	GDALDataType type,
+	int numStrata,
+	int64_t poolSize,
+	int maxIterations,
+	double accuracy,
+	bool scale,
+	double pixelWidth,
+	double pixelHeight,
+	int width,
+	int height,
+	int threads,
+	std::vector<T>& centroids,
+	std::vector<T>& offsets,
+	std::vector<T>& scales)
+{
+	int nFeat = static_cast<int>(bands.size());
+	int yBlockSize = bands[0].yBlockSize;
+
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
+
+	//step 1: read the random training pool in parallel
+	uint64_t multiplier = helper::getProbabilityMultiplier(width, height, pixelWidth, pixelHeight, 1, static_cast<int>(poolSize), false, -1);
+
+	std::vector<KmeansPoolChunk<T>> poolChunks(chunks);
+	{
+		boost::asio::thread_pool pool(threads);
+		for (int i = 0; i < chunks; i++) {
+			int yBlockStart = i * chunkSize;
+			int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+			KmeansPoolChunk<T> *p_chunk = &poolChunks[i];
+
+			boost::asio::post(pool, [&bands, p_chunk, type, multiplier, yBlockStart, yBlockEnd, width, height] {
+				try {
+					readPoolChunk<T>(bands, *p_chunk, type, multiplier, yBlockStart, yBlockEnd, width, height);
+				}
+				catch (...) {
+					p_chunk->error = std::current_exception();
+				}
+			});
+		}
+		pool.join();
+	}
+
+	int64_t count = 0;
+	for (KmeansPoolChunk<T>& chunk : poolChunks) {
+		if (chunk.error) {
+			std::rethrow_exception(chunk.error);
+		}
+		count += chunk.count;
+	}
+
+	if (count < numStrata) {
+		throw std::runtime_error("not enough pixels which aren't nan were found in the raster to train " + std::to_string(numStrata) + " clusters.");
+	}
+
+	std::vector<T> features;
+	features.reserve(static_cast<size_t>(count) * nFeat);
+	for (KmeansPoolChunk<T>& chunk : poolChunks) {
+		features.insert(features.end(), chunk.features.begin(), chunk.features.end());
+		std::vector<T>().swap(chunk.features);
+	}
+
+	//step 2: standardize the pool
+	offsets.assign(nFeat, 0);
+	scales.assign(nFeat, 1);
+	if (scale) {
+		std::vector<helper::Variance> variances(nFeat);
+		for (int64_t i = 0; i < count; i++) {
+			for (int b = 0; b < nFeat; b++) {
+				variances[b].update(static_cast<double>(features[i * nFeat + b]));
+			}
+		}
+
+		for (int b = 0; b < nFeat; b++) {
+			double stdev = variances[b].getStdev();
+			offsets[b] = static_cast<T>(variances[b].getMean());
+			scales[b] = stdev > 0 ? static_cast<T>(stdev) : static_cast<T>(1);
+		}
+
+		for (int64_t i = 0; i < count; i++) {
+			for (int b = 0; b < nFeat; b++) {
+				T& val = features[i * nFeat + b];
+				val = (val - offsets[b]) / scales[b];
+			}
+		}
+	}
+
+	//step 3: initialize and train the model with oneDAL
+	DALHomogenTable table = DALHomogenTable(features.data(), count, nFeat, [](const T *){}, oneapi::dal::data_layout::row_major);
+
+	const auto init_desc = oneapi::dal::kmeans_init::descriptor<T, oneapi::dal::kmeans_init::method::plus_plus_dense>()
+		.set_cluster_count(numStrata);
+	const auto init_result = oneapi::dal::compute(init_desc, table);
+
+	const auto kmeans_desc = oneapi::dal::kmeans::descriptor<T>()
+		.set_cluster_count(numStrata)
+		.set_max_iteration_count(maxIterations)
+		.set_accuracy_threshold(accuracy);
+	const auto train_result = oneapi::dal::train(kmeans_desc, table, init_result.get_centroids());
+
+	oneapi::dal::row_accessor<const T> acc {train_result.get_model().get_centroids()};
+	auto block = acc.pull();
+
+	//sort the centroids by their first feature so strata are ordered consistently
+	std::vector<int> order(numStrata);
+	for (int k = 0; k < numStrata; k++) {
+		order[k] = k;
+	}
+	std::stable_sort(order.begin(), order.end(), [&block, nFeat](int a, int b) {
+		return block[a * nFeat] < block[b * nFeat];
+	});
+
+	centroids.resize(static_cast<size_t>(numStrata) * nFeat);
+	std::vector<std::vector<double>> retval(numStrata, std::vector<double>(nFeat));
+	for (int k = 0; k < numStrata; k++) {
+		for (int b = 0; b < nFeat; b++) {
+			T val = block[order[k] * nFeat + b];
+			centroids[k * nFeat + b] = val;
+			retval[k][b] = static_cast<double>(val * scales[b] + offsets[b]);
+		}
+	}
+
+	return retval;
+}
+
+/**
+ * @ingroup kmeans
+ * This function trains the k-means model and assigns the strata of every pixel, for
+ * a particular floating point type T.
+ *
+ * TRAINING:
+ * The model is trained on a random pool of the raster by train().
+ *
+ * ASSIGNMENT:
+ * The raster is split into chunks again, and every pixel in each chunk is assigned the
+ * strata of it's nearest centroid by assignChunk(), which writes the strata to the output band.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param RasterBandMetaData& stratBand
+ * @param GDALDataType type
+ * @param int numStrata
+ * @param int64_t poolSize
+ * @param int maxIterations
+ * @param double accuracy
+ * @param bool scale
+ * @param double pixelWidth
+ * @param double pixelHeight
+ * @param int width
+ * @param int height
+ * @param int threads
+ * @returns std::vector<std::vector<double>> the centroids in the units of the raster bands
+ */
+template <typename T>
+std::vector<std::vector<double>>
+trainAndAssign(
+	std::vector<helper::RasterBandMetaData>& bands,
+	helper::RasterBandMetaData& stratBand,
+	GDALDataType type,
+	int numStrata,
+	int64_t poolSize,
+	int maxIterations,
+	double accuracy,
+	bool scale,
+	double pixelWidth,
+	double pixelHeight,
+	int width,
+	int height,
+	int threads)
+{
+	int yBlockSize = bands[0].yBlockSize;
+
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
+
+	std::vector<T> centroids, offsets, scales;
+	std::vector<std::vector<double>> retval = train<T>(
+		bands, type, numStrata, poolSize, maxIterations, accuracy, scale,
+		pixelWidth, pixelHeight, width, height, threads, centroids, offsets, scales
+	);
+
+	//assign every pixel to the strata of it's nearest centroid in parallel
+	std::vector<std::exception_ptr> errors(chunks, nullptr);
+	{
+		boost::asio::thread_pool pool(threads);
+		for (int i = 0; i < chunks; i++) {
+			int yBlockStart = i * chunkSize;
+			int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+			std::exception_ptr *p_error = &errors[i];
+
+			boost::asio::post(pool, [&bands, &stratBand, &centroids, &offsets, &scales, numStrata, type, yBlockStart, yBlockEnd, width, height, p_error] {
+				try {
+					switch (stratBand.type) {
+						case GDT_Int8:
+							assignChunk<T, int8_t>(bands, stratBand, centroids, offsets, scales, numStrata, type, yBlockStart, yBlockEnd, width, height);
+							break;
+						case GDT_Int16:
+							assignChunk<T, int16_t>(bands, stratBand, centroids, offsets, scales, numStrata, type, yBlockStart, yBlockEnd, width, height);
+							break;
+						default:
+							assignChunk<T, int32_t>(bands, stratBand, centroids, offsets, scales, numStrata, type, yBlockStart, yBlockEnd, width, height);
+							break;
+					}
+				}
+				catch (...) {
+					*p_error = std::current_exception();
+				}
+			});
+		}
+		pool.join();
+	}
+
+	for (std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	return retval;
+}
+
+/**
+ * @ingroup kmeans
+ * This function stratifies a raster using k-means clustering of the given raster
+ * bands, with one strata per cluster.
+ *
+ * Rather than loading every pixel of every band into memory, the model is trained
+ * on a random pool of at most roughly poolSize pixels, in the same way as the CLHS
+ * pool. Each pixel is then assigned to the strata of it's nearest centroid while
+ * iterating through the raster in blocks, split between the given number of threads.
+ * This means the memory used does not depend on the size of the raster.
+ *
+ * The output dataset is created in the same way as breaks(): if a filename is given
+ * the strata are written to that file, otherwise a VRT dataset backed by temporary
+ * files is used if the raster is large, and an in-memory dataset otherwise. The single
+ * output band is named 'strat_kmeans'.
+ *
+ * The bands are processed as double precision values if any of them is of type
+ * double, otherwise as single precision values.
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param std::vector<int> bandNums
+ * @param int numStrata
+ * @param int64_t poolSize
+ * @param int maxIterations
+ * @param double accuracy
+ * @param bool scale
+ * @param std::string filename
+ * @param bool largeRaster
+ * @param int threads
+ * @param std::string tempFolder
+ * @param std::map<std::string, std::string> driverOptions
+ * @returns std::tuple<GDALRasterWrapper *, std::vector<std::vector<double>>> the strat raster and cluster centroids
+ */
+std::tuple<raster::GDALRasterWrapper *, std::vector<std::vector<double>>>
+kmeans(
+	raster::GDALRasterWrapper *p_raster,
+	std::vector<int> bandNums,
+	int numStrata,
+	int64_t poolSize,
+	int maxIterations,
+	double accuracy,
+	bool scale,
+	std::string filename,
+	bool largeRaster,
+	int threads,
+	std::string tempFolder,
+	std::map<std::string, std::string> driverOptions)
+{
+	GDALAllRegister();
+
+	int height = p_raster->getHeight();
+	int width = p_raster->getWidth();
+	double *geotransform = p_raster->getGeotransform();
+	std::string projection = std::string(p_raster->getDataset()->GetProjectionRef());
+
+	std::mutex dataBandMutex;
+	std::mutex stratBandMutex;
+
+	std::vector<helper::RasterBandMetaData> bands(bandNums.size());
+	GDALDataType type = GDT_Float32;
+	for (size_t i = 0; i < bandNums.size(); i++) {
+		bands[i].p_band = p_raster->getRasterBand(bandNums[i]);
+		bands[i].type = p_raster->getRasterBandType(bandNums[i]);
+		bands[i].size = p_raster->getRasterBandTypeSize(bandNums[i]);
+		bands[i].nan = bands[i].p_band->GetNoDataValue();
+		bands[i].p_mutex = &dataBandMutex;
+		bands[i].p_band->GetBlockSize(&bands[i].xBlockSize, &bands[i].yBlockSize);
+
+		if (bands[i].type == GDT_Float64) {
+			type = GDT_Float64;
+		}
+	}
+
+	helper::RasterBandMetaData stratBand;
+	helper::setStratBandTypeAndSize(numStrata, &stratBand.type, &stratBand.size);
+	stratBand.name = "strat_kmeans";
+	stratBand.xBlockSize = bands[0].xBlockSize;
+	stratBand.yBlockSize = bands[0].yBlockSize;
+	stratBand.p_mutex = &stratBandMutex;
+
+	bool isMEMDataset = !largeRaster && filename == "";
+	bool isVRTDataset = largeRaster && filename == "";
+
+	//create output dataset before doing anything which will take a long time in case of failure.
+	GDALDataset *p_dataset = nullptr;
+	std::vector<helper::VRTBandDatasetInfo> VRTBandInfo;
+	if (isMEMDataset || isVRTDataset) {
+		p_dataset = helper::createVirtualDataset(isMEMDataset ? "MEM" : "VRT", width, height, geotransform, projection);
+
+		if (isMEMDataset) {
+			helper::addBandToMEMDataset(p_dataset, stratBand);
+		}
+		else {
+			helper::createVRTBandDataset(p_dataset, stratBand, tempFolder, "kmeans", VRTBandInfo, driverOptions);
+		}
+	}
+	else {
+		std::filesystem::path filepath = filename;
+		if (filepath.extension().string() != ".tif") {
+			throw std::runtime_error("sgs only supports .tif files right now");
+		}
+
+		bool useTiles = stratBand.xBlockSize != width && stratBand.yBlockSize != height;
+		p_dataset = helper::createDataset(
+			filename,
+			"Gtiff",
+			width,
+			height,
+			geotransform,
+			projection,
+			&stratBand,
+			1,
+			useTiles,
+			driverOptions
+		);
+	}
+
+	std::vector<std::vector<double>> centroids = type == GDT_Float64 ?
+		trainAndAssign<double>(bands, stratBand, type, numStrata, poolSize, maxIterations, accuracy, scale,
+				       p_raster->getPixelWidth(), p_raster->getPixelHeight(), width, height, threads) :
+		trainAndAssign<float>(bands, stratBand, type, numStrata, poolSize, maxIterations, accuracy, scale,
+				      p_raster->getPixelWidth(), p_raster->getPixelHeight(), width, height, threads);
+
+	//close and add the VRT sub dataset as a band
+	if (isVRTDataset) {
+		GDALClose(VRTBandInfo[0].p_dataset);
+		helper::addBandToVRTDataset(p_dataset, stratBand, VRTBandInfo[0]);
+	}
+
+	raster::GDALRasterWrapper *p_wrapper = isMEMDataset ?
+		new raster::GDALRasterWrapper(p_dataset, {stratBand.p_buffer}) :
+		new raster::GDALRasterWrapper(p_dataset);
+
+	return {p_wrapper, centroids};
+}
+
+} //namespace kmeans
+} //namespace sgs
@@ -1,3 +1,233 @@
-def kmeans():
-    print(__file__)
-    raise NotImplementedError
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: stratification using k-means clustering
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+##
+# @defgroup user_kmeans kmeans
+# @ingroup user_stratify
+
+import os
+import sys
+import site
+import tempfile
+from typing import Optional
+
+from sgspy.utils import SpatialRaster, StratRasterBandMetadata
+
+#ensure _sgs binary can be found
+site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackages()))[0]
+sys.path.append(os.path.join(site_packages, "sgspy"))
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from _sgs import kmeans_cpp
+
+GIGABYTE = 1073741824
+
+##
+# @ingroup user_kmeans
+# This function conducts stratification on the raster given using k-means
+# clustering of one or more raster bands, where each cluster is a strata.
+#
+# The raster is never loaded into memory all at once. Instead, the k-means model
+# is trained on a random pool of roughly pool_size pixels (every pixel which is not
+# nan in any of the bands has the same chance of being added to the pool), then
+# every pixel is assigned to the strata of it's nearest cluster centroid while the
+# raster is iterated through in blocks, using thread_count threads.
+#
+# The model is initialized using k-means++ and trained using Lloyd's algorithm,
+# stopping after max_iterations iterations or once the objective function improves
+# by less than accuracy. If scale is True (the default), each band is standardized
+# using the mean and standard deviation of the pool, so that bands with large values
+# do not dominate the distances between pixels. The strata are ordered by the
+# centroid of the first band.
+#
+# the filename parameter specifies an output file name. Right now the only file format
+# excepted is GTiff (.tif).
+#
+# The driver_options parameter is used to specify creation options for a the output raster.
+# See options for the Gtiff driver here: https://gdal.org/en/stable/drivers/raster/gtiff.html#creation-options
+# The keys in the driver_options dict must be strings, the values are converted to string.
+# The options must be valid for the driver corresponding to the filename, and if filename is not given
+# they must be valid for the GTiff format, as that is the format used to store temporary raster files.
+# Note that if this parameter is given, but filename is not and the raster fits entirely in memory, the
+# driver_options parameter will be ignored.
+#
+# Examples
+# --------------------
+# rast = sgspy.SpatialRaster("multi_band_rast.tif") @n
+# srast = sgspy.stratify.kmeans(rast, num_strata=5)
+#
+# rast = sgspy.SpatialRaster("multi_band_rast.tif") @n
+# srast = sgspy.stratify.kmeans(rast, num_strata=8, bands=["zq90", "zsd"], filename="kmeans.tif")
+#
+# Parameters
+# --------------------
+# rast : SpatialRaster @n
+#     raster data structure containing the raster to stratify @n @n
+# num_strata : int @n
+#     the number of clusters (strata) @n @n
+# bands : Optional[list[int | str]] @n
+#     the bands to cluster, either 0-indexed int values or band names. Every band is used if not given @n @n
+# pool_size : int @n
+#     the approximate number of randomly selected pixels to train the model on @n @n
+# max_iterations : int @n
+#     the maximum number of iterations of Lloyd's algorithm @n @n
+# accuracy : float @n
+#     the threshold of improvement in the objective function below which training stops @n @n
+# scale : bool @n
+#     whether to standardize each band before clustering @n @n
+# filename : str @n
+#     filename to write to or '' if no file should be written @n @n
+# thread_count : int @n
+#     the number of threads to use when reading and stratifying the raster @n @n
+# driver_options : dict[] @n
+#     the creation options as defined by GDAL which will be passed when creating output files @n @n
+#
+# Returns
+# --------------------
+# a SpatialRaster object containing the stratified raster band.
+def kmeans(
+    rast: SpatialRaster,
+    num_strata: int,
+    bands: Optional[list[int | str]] = None,
+    pool_size: int = 1000000,
+    max_iterations: int = 300,
+    accuracy: float = 1e-4,
+    scale: bool = True,
+    filename: str = '',
+    thread_count: int = 8,
+    driver_options: dict = None,
+    ):
+
+    MAX_STRATA_VAL = 2147483647 #maximum value stored within a 32-bit signed integer to ensure no overflow
+
+    if type(rast) is not SpatialRaster:
+        raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster")
+
+    if type(num_strata) is not int:
+        raise TypeError("'num_strata' parameter must be of type int.")
+
+    if bands is not None and type(bands) is not list:
+        raise TypeError("'bands' parameter, if given, must be a list of int or str values.")
+
+    if type(pool_size) is not int:
+        raise TypeError("'pool_size' parameter must be of type int.")
+
+    if type(max_iterations) is not int:
+        raise TypeError("'max_iterations' parameter must be of type int.")
+
+    if type(accuracy) not in [int, float]:
+        raise TypeError("'accuracy' parameter must be of type float.")
+
+    if type(scale) is not bool:
+        raise TypeError("'scale' parameter must be of type bool.")
+
+    if type(filename) is not str:
+        raise TypeError("'filename' parameter must be of type str.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if driver_options is not None and type(driver_options) is not dict:
+        raise TypeError("'driver_options' parameter, if givne, must be of type dict.")
+
+    if rast.closed:
+            raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
+
+    if num_strata < 1 or num_strata > MAX_STRATA_VAL:
+        raise ValueError("num_strata must be greater than 0, and fit within a 32-bit signed integer.")
+
+    if bands is None:
+        band_indices = list(range(rast.band_count))
+    else:
+        if len(bands) == 0:
+            raise ValueError("'bands' list must contain at least one band.")
+
+        band_indices = []
+        for band in bands:
+            if type(band) not in [int, str]:
+                raise TypeError("'bands' parameter, if given, must be a list of int or str values.")
+
+            if type(band) is str and band not in rast.bands:
+                raise ValueError("band " + band + " not in given raster.")
+
+            if type(band) is int and (band < 0 or band >= rast.band_count):
+                raise ValueError("0-indexed band of " + str(band) + " given, but raster only has " + str(rast.band_count) + " bands.")
+
+            band_indices.append(rast.get_band_index(band))
+
+        if len(set(band_indices)) != len(band_indices):
+            raise ValueError("'bands' list must not contain the same band more than once.")
+
+    if pool_size < num_strata:
+        raise ValueError("pool_size must be at least num_strata.")
+
+    if max_iterations < 1:
+        raise ValueError("max_iterations must be greater than 0.")
+
+    if accuracy < 0:
+        raise ValueError("accuracy can't be negative.")
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    #ensure driver options keys are string, and convert driver options vals to string
+    driver_options_str = {}
+    if driver_options:
+        for (key, val) in driver_options.items():
+            if type(key) is not str:
+                raise ValueError("the key for all key/value pairs in the driver_options dict must be a string.")
+            driver_options_str[key] = str(val)
+
+    #if large_raster is true, the output strat raster is a VRT backed by temporary files
+    large_raster = False
+    raster_size_bytes = 0
+    for band in band_indices:
+        band_size = rast.height * rast.width * rast.cpp_raster.get_raster_band_type_size(band)
+        raster_size_bytes += band_size
+        if band_size >= GIGABYTE:
+            large_raster = True
+            break
+    large_raster = large_raster or (raster_size_bytes > GIGABYTE * 4)
+
+    #make a temp directory which will be deleted if there is any problem when calling the cpp function
+    temp_dir = tempfile.mkdtemp()
+    rast.have_temp_dir = True
+    rast.temp_dir = temp_dir
+
+    [cpp_raster, centroids] = kmeans_cpp(
+        rast.cpp_raster,
+        band_indices,
+        num_strata,
+        pool_size,
+        max_iterations,
+        float(accuracy),
+        scale,
+        filename,
+        large_raster,
+        thread_count,
+        temp_dir,
+        driver_options_str
+    )
+    srast = SpatialRaster(cpp_raster)
+
+    #now that it's created, give the cpp raster object ownership of the temporary directory
+    rast.have_temp_dir = False
+    srast.cpp_raster.set_temp_dir(temp_dir)
+    srast.temp_dataset = filename == "" and large_raster
+    srast.filename = filename
+
+    #describe each strata by the centroid of it's cluster
+    metadata = []
+    for centroid in centroids:
+        metadata.append(", ".join(f"{rast.bands[band]} = {val:.5f}" for (band, val) in zip(band_indices, centroid)))
+
+    srast.srast_metadata_info = {
+        "strat_kmeans": StratRasterBandMetadata(mapped=False, strata_count=num_strata, band_metadata=metadata)
+    }
+    srast.is_strat_rast = True
+    return srast
@@ -12,15 +12,180 @@
  * @ingroup stratify
  */
 
+#include <exception>
+#include <type_traits>
+
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
 
-#include "utils/raster.h"
+#include "utils/classify.h"
 #include "utils/helper.h"
+#include "utils/raster.h"
+#include "utils/reader.h"
 
 namespace sgs {
 namespace map {
 
+/**
+ * @ingroup map
+ * This function throws the error describing the first strata within a row of a
+ * strat band which is either negative or not less than the number of strata given for
+ * that band. It is only called once accumulateRow() has found such a strata, so the
+ * check is kept out of the inner loop.
+ *
+ * @param RasterBandMetaData& band
+ * @param const T *p_data
+ * @param size_t count
+ * @param int numStrata
+ * @param const uint8_t *p_mapNan the nan flags of the row, whose pixels are not checked
+ */
+template <typename T, bool HasNoData>
+[[noreturn]] void
+throwInvalidStrata(
+	helper::RasterBandMetaData& band,
+	const T *p_data,
+	size_t count,
+	int numStrata,
+	const uint8_t *p_mapNan)
+{
+	std::string bandName = band.p_band->GetDescription();
+	T nan = static_cast<T>(band.nan);
+	for (size_t i = 0; i < count; i++) {
+		bool isNan = p_mapNan[i];
+		if constexpr (std::is_floating_point_v<T>) {
+			isNan |= std::isnan(p_data[i]);
+		}
+		if constexpr (HasNoData) {
+			isNan |= p_data[i] == nan;
+		}
+		if (isNan) {
+			continue;
+		}
+
+		int64_t strat = static_cast<int64_t>(p_data[i]);
+		if (strat < 0) {
+			std::string errmsg = "a negative strata value of " + std::to_string(strat) + " was found in band " + bandName + ", and is not marked as a nodata value.";
+			throw std::runtime_error(errmsg);
+		}
+		if (strat >= numStrata) {
+			std::string errmsg = "the num_strata indicated for band " + bandName + " is less than or equal to one of the values in that band.";
+			throw std::runtime_error(errmsg);
+		}
+	}
+	throw std::runtime_error("invalid strata value found in band " + bandName + ".");
+}
+
+/**
+ * @ingroup map
+ * This function adds the strata of a row of a single strat band of type T,
+ * multiplied by the multiplier of that band, to the mapped strata of the row, and
+ * marks the pixels which are nan in p_mapNan.
+ *
+ * The loop has no branches, so that it can be vectorized: the nan check is only
+ * compiled in for floating point types, or if HasNoData is true, and strata which are
+ * out of range are only recorded, not reported. Pixels which were already nan in a
+ * previous band are not checked, in the same way as the checks stop at the first
+ * nan band of a pixel.
+ *
+ * @param const T *p_data
+ * @param size_t count
+ * @param T nan
+ * @param int numStrata
+ * @param int64_t multiplier
+ * @param int64_t *p_map
+ * @param uint8_t *p_mapNan
+ * @returns bool whether any strata in the row is out of range
+ */
+template <typename T, bool HasNoData>
+inline bool
+accumulateRow(
+	const T *p_data,
+	size_t count,
+	T nan,
+	int numStrata,
+	int64_t multiplier,
+	int64_t *p_map,
+	uint8_t *p_mapNan)
+{
+	bool invalid = false;
+	for (size_t i = 0; i < count; i++) {
+		T val = p_data[i];
+		bool isNan = false;
+		if constexpr (std::is_floating_point_v<T>) {
+			isNan = std::isnan(val);
+		}
+		if constexpr (HasNoData) {
+			isNan |= val == nan;
+		}
+
+		int64_t strat = isNan ? 0 : static_cast<int64_t>(val);
+		invalid |= !(isNan || p_mapNan[i]) && ((strat < 0) || (strat >= numStrata));
+		p_map[i] += strat * multiplier;
+		p_mapNan[i] |= isNan;
+	}
+	return invalid;
+}
+
+/**
+ * @ingroup map
+ * This function adds the strata of the valid pixels of a block (or of a row of an
+ * entire in-memory band) of a single strat band to the mapped strata, which are
+ * written by classify::writeMap() once every band has been accumulated. The kernel
+ * is chosen once per block depending on the data type of the band, and whether it
+ * has a nodata value (see helper::dispatchPixelType() and helper::dispatchFlags()),
+ * rather than switching on the type of every pixel.
+ *
+ * @param RasterBandMetaData& band
+ * @param void *p_data
+ * @param int xValid
+ * @param int yValid
+ * @param size_t stride
+ * @param bool hasNoData
+ * @param int numStrata
+ * @param size_t multiplier
+ * @param int64_t *p_map
+ * @param uint8_t *p_mapNan
+ */
+inline void
+accumulateBlock(
+	helper::RasterBandMetaData& band,
+	void *p_data,
+	int xValid,
+	int yValid,
+	size_t stride,
+	bool hasNoData,
+	int numStrata,
+	size_t multiplier,
+	int64_t *p_map,
+	uint8_t *p_mapNan)
+{
+	helper::dispatchPixelType(band.type, [&](auto tag) {
+		using T = typename decltype(tag)::type;
+		helper::dispatchFlags([&](auto hasNoDataTag) {
+			constexpr bool HasNoData = decltype(hasNoDataTag)::value;
+			T nan = static_cast<T>(band.nan);
+
+			for (int y = 0; y < yValid; y++) {
+				size_t offset = static_cast<size_t>(y) * stride;
+				const T *p_row = reinterpret_cast<T *>(p_data) + offset;
+				bool invalid = accumulateRow<T, HasNoData>(
+					p_row,
+					xValid,
+					nan,
+					numStrata,
+					static_cast<int64_t>(multiplier),
+					p_map + offset,
+					p_mapNan + offset
+				);
+
+				if (invalid) {
+					throwInvalidStrata<T, HasNoData>(band, p_row, xValid, numStrata, p_mapNan + offset);
+				}
+			}
+		}, hasNoData);
+	});
+}
+
 /**
  * @ingroup map
  * This function maps multiple already stratified rasters into a single 
@@ -83,6 +248,13 @@ namespace map {
  * through and first read from the input bands, multiplied by their corresponding,
  * multipliers, then the product is written to the output band.
  *
+ * In both cases the strata of each band are accumulated a block (or a row) at a
+ * time by accumulateBlock(), which chooses a kernel specialized on the data type of
+ * the band and whether it has a nodata value once per block, so the inner loops have
+ * no per-pixel type switch and can be vectorized. Strata which are out of range are
+ * reported once the row has been accumulated, and an exception thrown within a
+ * thread is re-thrown once every thread has finished.
+ *
  *
  * CLEANUP:
  * If the output dataset is a VRT dataset, the datasets which represent
@@ -256,143 +428,146 @@ raster::GDALRasterWrapper *map(
 		);
 	}
 
-	if (largeRaster) {
-		pybind11::gil_scoped_acquire acquire;
-		boost::asio::thread_pool pool(threadCount);
+	//whether each band has a nodata value decides which kernel is used for it
+	std::vector<bool> hasNoData(bandCount);
+	for (size_t band = 0; band < bandCount; band++) {
+		hasNoData[band] = helper::hasNoDataValue(stratBands[band].p_band);
+	}
 
+	if (largeRaster) {
 		int xBlockSize = stratBands[0].xBlockSize;
 		int yBlockSize = stratBands[0].yBlockSize;
 
-		int xBlocks = (width + xBlockSize - 1) / xBlockSize;
 		int yBlocks = (height + yBlockSize - 1) / yBlockSize;
-		int chunkSize = yBlocks / threadCount;
-
-		for (int yBlockStart = 0; yBlockStart < yBlocks; yBlockStart += chunkSize) {
-			int yBlockEnd = std::min(yBlockStart + chunkSize, yBlocks);
-
-			boost::asio::post(pool, [
-				bandCount,
-				xBlockSize,
-				yBlockSize,
-				yBlockStart,
-				yBlockEnd,
-				xBlocks,
-				&stratBands,
-				&numStrataPerBand,
-				&mapBand,
-				&multipliers	
-			] {
-				std::vector<void *> stratBuffers(bandCount);
-				for (size_t band = 0; band < bandCount; band++) {
-					stratBuffers[band] = VSIMalloc3(xBlockSize, yBlockSize, stratBands[band].size);
-				}
-				void *p_mapBuffer = VSIMalloc3(xBlockSize, yBlockSize, mapBand.size);
+		int chunkSize = std::max(1, (yBlocks + threadCount - 1) / threadCount);
+		int chunks = (yBlocks + chunkSize - 1) / chunkSize;
 
-				//cast to int so there is less data type conversion while processign
-				std::vector<int> intNoDataValues(bandCount);
-				for (size_t band = 0; band < bandCount; band++) {
-					intNoDataValues[band] = static_cast<int>(stratBands[band].nan);
-				}
+		std::vector<helper::RasterBandMetaData *> p_stratBands(bandCount);
+		for (size_t band = 0; band < bandCount; band++) {
+			p_stratBands[band] = &stratBands[band];
+		}
 
-				for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
-					for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-						int xValid, yValid;
-						stratBands[0].p_mutex->lock();
-						stratBands[0].p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-						stratBands[0].p_mutex->unlock();
-
-						for (size_t band = 0; band < bandCount; band++) {
-							rasterBandIO(
-								stratBands[band],
-								stratBuffers[band],
+		std::vector<std::exception_ptr> errors(chunks, nullptr);
+		{
+			boost::asio::thread_pool pool(threadCount);
+			for (int chunk = 0; chunk < chunks; chunk++) {
+				int yBlockStart = chunk * chunkSize;
+				int yBlockEnd = std::min(yBlockStart + chunkSize, yBlocks);
+				std::exception_ptr *p_error = &errors[chunk];
+
+				boost::asio::post(pool, [
+					bandCount,
+					xBlockSize,
+					yBlockSize,
+					yBlockStart,
+					yBlockEnd,
+					width,
+					height,
+					&p_stratBands,
+					&stratBands,
+					&hasNoData,
+					&numStrataPerBand,
+					&mapBand,
+					&multipliers,
+					p_error
+				] {
+					void *p_mapBuffer = nullptr;
+					try {
+						p_mapBuffer = VSIMalloc3(xBlockSize, yBlockSize, mapBand.size);
+
+						//mapped strata are accumulated across the bands of each block before being written
+						std::vector<int64_t> mapStrata(static_cast<size_t>(xBlockSize) * yBlockSize, 0);
+						std::vector<uint8_t> mapNan(static_cast<size_t>(xBlockSize) * yBlockSize, 0);
+
+						//strat band data is read ahead on an I/O thread while the current block is processed
+						reader::BlockReader blocks(
+							p_stratBands,
+							reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+							xBlockSize,
+							yBlockSize
+						);
+
+						while (reader::Block *p_block = blocks.next()) {
+							int xValid = p_block->window.xValid;
+							int yValid = p_block->window.yValid;
+
+							for (size_t band = 0; band < bandCount; band++) {
+								accumulateBlock(
+									stratBands[band],
+									p_block->buffers[band],
+									xValid,
+									yValid,
+									xBlockSize,
+									hasNoData[band],
+									numStrataPerBand[band],
+									multipliers[band],
+									mapStrata.data(),
+									mapNan.data()
+								);
+							}
+
+							classify::writeMap(mapBand, p_mapBuffer, xValid, yValid, xBlockSize, mapStrata.data(), mapNan.data());
+
+							helper::rasterBandIO(
+								mapBand,
+								p_mapBuffer,
 								xBlockSize,
 								yBlockSize,
-								xBlock,
-								yBlock,
+								p_block->window.xBlock,
+								p_block->window.yBlock,
 								xValid,
 								yValid,
-								true //read = true
+								false //read = false
 							);
 						}
-
-						for (int y = 0; y < yValid;  y++) {
-							for (int x = 0; x < xValid; x++) {
-								size_t index = static_cast<size_t>(x + y * xBlockSize);
-								bool isNan = false;
-								int mappedStrat = 0;
-
-								for (size_t band = 0; band < bandCount; band++) {
-									int strat = helper::getPixelValueDependingOnType<int>(stratBands[band].type, stratBuffers[band], index);
-									isNan = strat == intNoDataValues[band];
-	
-									if (!isNan) {
-										if (strat >= numStrataPerBand[band]) {
-											std::string bandName = stratBands[band].p_band->GetDescription();
-											std::string errmsg = "the num_strata indicated for band " + bandName + " is less than or equal to one of the values in that band.";
-											throw std::runtime_error(errmsg);
-										}
-
-										if (strat < 0) {
-											std::string bandName = stratBands[band].p_band->GetDescription();
-											std::string errmsg = "a negative strata value of " + std::to_string(strat) + " was found in band " + bandName + ", and is not marked as a nodata value.";
-											throw std::runtime_error(errmsg);
-										}
-
-										mappedStrat += strat * multipliers[band];
-									}
-									else {
-										break;
-									}
-								}
-
-								helper::setStrataPixelDependingOnType(mapBand.type, p_mapBuffer, index, isNan, mappedStrat);
-							}
-						}
-
-						helper::rasterBandIO(
-							mapBand,
-							p_mapBuffer,
-							xBlockSize,
-							yBlockSize,
-							xBlock,
-							yBlock,
-							xValid,
-							yValid,
-							false //read = false
-						);
 					}
-				}
+					catch (...) {
+						*p_error = std::current_exception();
+					}
+					VSIFree(p_mapBuffer);
+				});
+			}
+			pool.join();
+		}
 
-				for (size_t band = 0; band < bandCount; band++) {
-					VSIFree(stratBuffers[band]);
-				}
-				VSIFree(p_mapBuffer);
-			});
+		for (const std::exception_ptr& error : errors) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
 		}
-		
-		pool.join();
-		pybind11::gil_scoped_release release;
 	}
 	else {
-		std::vector<int> intNoDataValues(bandCount);
-		for (size_t band = 0; band < bandCount; band++) {
-			intNoDataValues[band] = static_cast<int>(stratBands[band].nan);
-		}
-
-		size_t pixelCount = static_cast<size_t>(height) * static_cast<size_t>(width);
-		for (size_t index = 0; index < pixelCount;  index++) {
-			bool isNan = false;
-			int mappedStrat = 0;
-
-			for (size_t band = 0; (band < bandCount) && !isNan; band++) {
-				int strat = helper::getPixelValueDependingOnType<int>(stratBands[band].type, stratBands[band].p_buffer, index);
-				isNan = strat == intNoDataValues[band];
-				if (!isNan) {
-					mappedStrat += strat * multipliers[band];
-				}
+		//mapped strata are accumulated across the bands of each row before being written
+		std::vector<int64_t> mapStrata(width, 0);
+		std::vector<uint8_t> mapNan(width, 0);
+
+		for (int y = 0; y < height; y++) {
+			size_t offset = static_cast<size_t>(y) * static_cast<size_t>(width);
+
+			for (size_t band = 0; band < bandCount; band++) {
+				accumulateBlock(
+					stratBands[band],
+					reinterpret_cast<int8_t *>(stratBands[band].p_buffer) + offset * stratBands[band].size,
+					width,
+					1,
+					width,
+					hasNoData[band],
+					numStrataPerBand[band],
+					multipliers[band],
+					mapStrata.data(),
+					mapNan.data()
+				);
 			}
 
-			helper::setStrataPixelDependingOnType(mapBand.type, mapBand.p_buffer, index, isNan, mappedStrat);
+			classify::writeMap(
+				mapBand,
+				reinterpret_cast<int8_t *>(mapBand.p_buffer) + offset * mapBand.size,
+				width,
+				1,
+				width,
+				mapStrata.data(),
+				mapNan.data()
+			);
 		}
 
 		if (!isVRTDataset && !isMEMDataset) {
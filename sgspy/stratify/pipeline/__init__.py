@@ -0,0 +1,2 @@
+from . import pipeline
+from .pipeline import pipeline
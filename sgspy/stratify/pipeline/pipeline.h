@@ -0,0 +1,301 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: C++ implementation of fused breaks, quantiles, and map stratification
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup pipeline pipeline
+ * @ingroup stratify
+ */
+
+#include <exception>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+
+#include "utils/raster.h"
+#include "utils/helper.h"
+#include "utils/reader.h"
+#include "utils/sketch.h"
+#include "stratify/breaks/breaks.h"
+#include "stratify/quantiles/quantiles.h"
+
+namespace sgs {
+namespace pipeline {
+
+/**
+ * @ingroup pipeline
+ * This function calculates the quantiles of multiple bands of a large
+ * raster in a single pass over the raster, rather than one pass per
+ * band as quantiles::batchCalcQuantiles() does.
+ *
+ * Every band is read in the blocks of the first band, so all of the
+ * bands of a block are read together. The raster is split into chunks
+ * of rows of blocks depending on the number of threads, and each chunk
+ * has its own QuantileSketch (see utils/sketch.h) for every band, so
+ * no synchronization is required between the threads. Once every chunk
+ * has been sketched, the sketches of each band are merged in chunk order
+ * and the quantiles are taken from the merged sketch.
+ *
+ * The rank error of every quantile is bounded by the epsilon (eps) value
+ * in the same way as quantiles::batchCalcQuantiles().
+ *
+ * @param int width
+ * @param int height
+ * @param std::vector<helper::RasterBandMetaData *>& bands
+ * @param std::vector<std::vector<double> *>& probabilities
+ * @param std::vector<std::vector<double> *>& quantiles
+ * @param double eps
+ * @param int threadCount
+ */
+template <typename T>
+void sketchBands(
+	int width,
+	int height,
+	std::vector<helper::RasterBandMetaData *>& bands,
+	std::vector<std::vector<double> *>& probabilities,
+	std::vector<std::vector<double> *>& quantiles,
+	double eps,
+	int threadCount)
+{
+	if (bands.empty()) {
+		return;
+	}
+
+	int xBlockSize = bands[0]->xBlockSize;
+	int yBlockSize = bands[0]->yBlockSize;
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threadCount - 1) / threadCount);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
+
+	size_t k = sketch::sketchCapacity(eps, static_cast<int64_t>(width) * static_cast<int64_t>(height));
+	std::vector<std::vector<sketch::QuantileSketch<T>>> sketches(
+		chunks,
+		std::vector<sketch::QuantileSketch<T>>(bands.size(), sketch::QuantileSketch<T>(k))
+	);
+	std::vector<std::exception_ptr> errors(chunks, nullptr);
+
+	boost::asio::thread_pool pool(threadCount);
+	for (int i = 0; i < chunks; i++) {
+		int yBlockStart = i * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+		std::vector<sketch::QuantileSketch<T>> *p_sketches = &sketches[i];
+		std::exception_ptr *p_error = &errors[i];
+
+		boost::asio::post(pool, [&bands, xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd, p_sketches, p_error] {
+			try {
+				std::vector<T> filtered(static_cast<size_t>(xBlockSize) * static_cast<size_t>(yBlockSize));
+
+				//the next blocks of the chunk are read ahead on an I/O thread
+				reader::BlockReader blocks(
+					bands,
+					reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+					xBlockSize,
+					yBlockSize
+				);
+				while (reader::Block *p_block = blocks.next()) {
+					int xValid = p_block->window.xValid;
+					int yValid = p_block->window.yValid;
+
+					for (size_t band = 0; band < bands.size(); band++) {
+						void *p_buffer = p_block->buffers[band];
+						T nan = static_cast<T>(bands[band]->nan);
+
+						size_t fi = 0;
+						for (int y = 0; y < yValid; y++) {
+							size_t index = static_cast<size_t>(y) * static_cast<size_t>(xBlockSize);
+							for (int x = 0; x < xValid; x++) {
+								T val = helper::getPixelValueDependingOnType<T>(bands[band]->type, p_buffer, index);
+								bool isNan = std::isnan(val) || val == nan;
+								if (!isNan) {
+									filtered[fi] = val;
+									fi++;
+								}
+								index++;
+							}
+						}
+
+						(*p_sketches)[band].update(filtered.data(), fi);
+					}
+				}
+			}
+			catch (...) {
+				*p_error = std::current_exception();
+			}
+		});
+	}
+	pool.join();
+
+	for (const std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	for (size_t band = 0; band < bands.size(); band++) {
+		for (int i = 1; i < chunks; i++) {
+			sketches[0][band].merge(sketches[i][band]);
+		}
+		*quantiles[band] = sketches[0][band].quantiles(*probabilities[band]);
+	}
+}
+
+/**
+ * @ingroup pipeline
+ * This function stratifies a raster using user-defined breaks on some bands
+ * and user-defined quantile probabilities on others, writing the stratification
+ * of every band and (optionally) the mapped stratification of all of them in a
+ * single pass over the raster.
+ *
+ * Running breaks() and quantiles() separately and then mapping their outputs with
+ * map() reads every input band, writes every strat band, and then reads every strat
+ * band back again to write the mapped band. Here the quantile values of the quantile
+ * bands are calculated first, after which they are just breaks, so every band is
+ * classified by breaks::breaks() in one pass in which the strata of each block are
+ * kept in block buffers and combined into the mapped strata before anything is written.
+ *
+ * The quantile values are calculated in the same way as quantiles::quantiles(). For
+ * an in-memory raster (largeRaster is false) they are exact, otherwise they are
+ * estimated with quantile sketches which are built for all of the quantile bands in a
+ * single pass using sketchBands(). In both cases they are taken from and stored in the
+ * statistics cache of the raster. If an overview level is given (overview is not -1)
+ * they are instead estimated from that overview, which avoids reading the full
+ * resolution bands more than once.
+ *
+ * A band may not be given both breaks and probabilities. The output bands are ordered
+ * by band index, followed by the mapped band if map is true.
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param std::map<int, std::vector<double>> breaks
+ * @param std::map<int, std::vector<double>> probabilities
+ * @param bool map
+ * @param std::string filename
+ * @param std::string tempFolder
+ * @param bool largeRaster
+ * @param int threadCount
+ * @param std::map<std::string, std::string> driverOptions
+ * @param double eps
+ * @param int overview
+ * @returns std::pair<GDALRasterWrapper *, std::unordered_map<std::string, std::vector<double>>>
+ */
+std::pair<raster::GDALRasterWrapper *, std::unordered_map<std::string, std::vector<double>>>
+pipeline(
+	raster::GDALRasterWrapper *p_raster,
+	std::map<int, std::vector<double>> breaks,
+	std::map<int, std::vector<double>> probabilities,
+	bool map,
+	std::string filename,
+	std::string tempFolder,
+	bool largeRaster,
+	int threadCount,
+	std::map<std::string, std::string> driverOptions,
+	double eps,
+	int overview)
+{
+	GDALAllRegister();
+
+	for (auto const& [key, val] : probabilities) {
+		if (breaks.count(key)) {
+			throw std::runtime_error("band " + std::to_string(key) + " was given both breaks and quantiles.");
+		}
+	}
+
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+	stats::StatisticsCache& cache = p_raster->getStatistics();
+
+	std::mutex dataBandMutex;
+	std::vector<int> bandIndices;
+	std::vector<helper::RasterBandMetaData> dataBands(probabilities.size());
+	std::vector<std::vector<double>> bandProbabilities;
+	std::vector<std::vector<double>> quantiles(probabilities.size());
+
+	size_t band = 0;
+	for (auto const& [key, val] : probabilities) {
+		helper::RasterBandMetaData *p_dataBand = &dataBands[band];
+
+		GDALRasterBand *p_band = p_raster->getRasterBand(key);
+		p_dataBand->p_band = p_band;
+		p_dataBand->type = p_raster->getRasterBandType(key);
+		p_dataBand->size = p_raster->getRasterBandTypeSize(key);
+		p_dataBand->p_buffer = largeRaster ? nullptr : p_raster->getRasterBandBuffer(key);
+		p_dataBand->nan = p_band->GetNoDataValue();
+		p_dataBand->p_mutex = &dataBandMutex;
+		p_band->GetBlockSize(&p_dataBand->xBlockSize, &p_dataBand->yBlockSize);
+
+		bandIndices.push_back(key);
+		bandProbabilities.push_back(val);
+		quantiles[band].resize(val.size());
+		band++;
+	}
+
+	if (overview != -1) {
+		for (size_t i = 0; i < dataBands.size(); i++) {
+			quantiles::overviewQuantiles(dataBands[i], overview, bandProbabilities[i], quantiles[i], eps, threadCount);
+		}
+	}
+	else if (largeRaster) {
+		//bands which aren't already in the statistics cache are sketched together in a single
+		//pass, split by the precision of the sketch required by the type of the band
+		std::vector<helper::RasterBandMetaData *> spBands, dpBands;
+		std::vector<std::vector<double> *> spProbabilities, dpProbabilities;
+		std::vector<std::vector<double> *> spQuantiles, dpQuantiles;
+		for (size_t i = 0; i < dataBands.size(); i++) {
+			if (cache.getQuantiles(bandIndices[i], bandProbabilities[i], eps, quantiles[i])) {
+				continue;
+			}
+
+			bool dp = dataBands[i].type == GDT_Float64;
+			(dp ? dpBands : spBands).push_back(&dataBands[i]);
+			(dp ? dpProbabilities : spProbabilities).push_back(&bandProbabilities[i]);
+			(dp ? dpQuantiles : spQuantiles).push_back(&quantiles[i]);
+		}
+
+		sketchBands<float>(width, height, spBands, spProbabilities, spQuantiles, eps, threadCount);
+		sketchBands<double>(width, height, dpBands, dpProbabilities, dpQuantiles, eps, threadCount);
+
+		for (size_t i = 0; i < dataBands.size(); i++) {
+			cache.setQuantiles(bandIndices[i], bandProbabilities[i], eps, quantiles[i]);
+		}
+	}
+	else {
+		//the exact quantiles (eps of 0) are used for in-memory rasters
+		for (size_t i = 0; i < dataBands.size(); i++) {
+			if (cache.getQuantiles(bandIndices[i], bandProbabilities[i], 0, quantiles[i])) {
+				continue;
+			}
+
+			(dataBands[i].type != GDT_Float64) ?
+				quantiles::calcSPQuantiles(p_raster, dataBands[i], bandProbabilities[i], quantiles[i]) :
+				quantiles::calcDPQuantiles(p_raster, dataBands[i], bandProbabilities[i], quantiles[i]);
+			cache.setQuantiles(bandIndices[i], bandProbabilities[i], 0, quantiles[i]);
+		}
+	}
+
+	//the quantile values are now the breaks of their bands
+	std::unordered_map<std::string, std::vector<double>> quantileValues;
+	for (size_t i = 0; i < dataBands.size(); i++) {
+		breaks[bandIndices[i]] = quantiles[i];
+		quantileValues.insert({std::string(dataBands[i].p_band->GetDescription()), quantiles[i]});
+	}
+
+	raster::GDALRasterWrapper *p_strat = breaks::breaks(
+		p_raster,
+		breaks,
+		map,
+		filename,
+		largeRaster,
+		threadCount,
+		tempFolder,
+		driverOptions
+	);
+
+	return {p_strat, quantileValues};
+}
+
+} //namespace pipeline
+} //namespace sgs
@@ -0,0 +1,284 @@
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: fused stratification by breaks and quantiles with mapping
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+##
+# @defgroup user_pipeline pipeline
+# @ingroup user_stratify
+
+import os
+import sys
+import site
+import tempfile
+from typing import Optional
+
+import numpy as np
+
+from sgspy.utils import SpatialRaster, StratRasterBandMetadata
+
+#ensure _sgs binary can be found
+site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackages()))[0]
+sys.path.append(os.path.join(site_packages, "sgspy"))
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from _sgs import pipeline_cpp
+
+GIGABYTE = 1073741824
+
+##
+# @ingroup user_pipeline
+# This function stratifies some bands of the raster by user defined breaks, and others
+# by user defined quantiles, and maps the stratifications of all of them onto a single
+# band, in one pass over the raster.
+#
+# It produces the same bands as calling sgspy.stratify.breaks() and sgspy.stratify.quantiles()
+# and then combining their outputs with sgspy.stratify.map(), but without writing the
+# intermediate strat rasters and reading them back again: the strata of every band are
+# calculated block by block and combined into the mapped band before they are written.
+#
+# The 'breaks' parameter is a dict where the key is the name of a raster band and the value
+# is a list of break values, as in sgspy.stratify.breaks(). The 'quantiles' parameter is a
+# dict where the key is the name of a raster band and the value is either the number of
+# quantiles of equal size, or a list of probabilities between 0 and 1, as in
+# sgspy.stratify.quantiles(). A band may only be given in one of the two.
+#
+# The output raster contains a 'strat_<band name>' band for every band given, in the order
+# of the bands in the input raster, followed by a 'strat_map' band if the map parameter is true.
+#
+# The quantiles are calculated before the bands are stratified, in the same way as
+# sgspy.stratify.quantiles(): exactly if the raster fits in memory, and otherwise with
+# quantile sketches (with an error controlled by the 'eps' parameter), in which
+# case all of the quantile bands are sketched together in a single pass. The 'overview'
+# parameter estimates the quantiles from an overview of the raster instead (see
+# sgspy.stratify.quantiles() for the error this adds), so the full resolution bands
+# are only read once.
+#
+# The 'info' parameter, when true, prints the quantile values of each quantile band.
+#
+# See sgspy.stratify.breaks() for the 'filename', 'thread_count', and 'driver_options' parameters.
+#
+# Examples
+# --------------------
+# rast = sgspy.SpatialRaster('multi_band_rast.tif') @n
+# srast = sgspy.stratify.pipeline(rast, breaks={'zq90': [3, 5, 11, 18]}, quantiles={'pzabove2': 4})
+#
+# rast = sgspy.SpatialRaster('multi_band_rast.tif') @n
+# srast = sgspy.stratify.pipeline(rast, quantiles={'zq90': 5, 'pzabove2': [.2, .4, .8]}, filename='srast.tif')
+#
+# Parameters
+# --------------------
+# rast : SpatialRaster @n
+#     raster data structure containing the raster to stratify @n @n
+# breaks : Optional[dict[str, list[float]]] @n
+#     user defined breaks of the bands to stratify by breaks @n @n
+# quantiles : Optional[dict[str, int | list[float]]] @n
+#     user defined quantiles of the bands to stratify by quantiles @n @n
+# map : bool @n
+#     whether to map the stratification of the raster bands onto a single band @n @n
+# filename : str @n
+#     filename to write to or '' if no file should be written @n @n
+# thread_count : int @n
+#     the number of threads to use when multithreading large images @n @n
+# driver_options : dict[] @n
+#     the creation options as defined by GDAL which will be passed when creating output files @n @n
+# eps : float @n
+#     the epsilon value, controlling the error of stream-processed quantiles @n @n
+# info : Optional[bool] @n
+#     when true, print the quantile values of each quantile band after calculation @n @n
+# overview : Optional[int] @n
+#     the overview level to estimate the quantiles from, or None to use every pixel @n @n
+#
+# Returns
+# --------------------
+# a SpatialRaster object containing stratified raster bands.
+def pipeline(
+    rast: SpatialRaster,
+    breaks: Optional[dict[str, list[float]]] = None,
+    quantiles: Optional[dict[str, int | list[float]]] = None,
+    map: bool = True,
+    filename: str = '',
+    thread_count: int = 8,
+    driver_options: dict = None,
+    eps: float = .001,
+    info: Optional[bool] = None,
+    overview: Optional[int] = None):
+
+    MAX_STRATA_VAL = 2147483647 #maximum value stored within a 32-bit signed integer to ensure no overflow
+
+    if type(rast) is not SpatialRaster:
+        raise TypeError("'rast' parameter must be of type sgspy.SpatialRaster")
+
+    if breaks is not None and type(breaks) is not dict:
+        raise TypeError("'breaks' parameter, if given, must be of type dict.")
+
+    if quantiles is not None and type(quantiles) is not dict:
+        raise TypeError("'quantiles' parameter, if given, must be of type dict.")
+
+    if type(map) is not bool:
+        raise TypeError("'map' parameter must be of type bool.")
+
+    if type(filename) is not str:
+        raise TypeError("'filename' parameter must be of type str.")
+
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if driver_options is not None and type(driver_options) is not dict:
+        raise TypeError("'driver_options' parameter, if given, must be of type dict.")
+
+    if type(eps) is not float:
+        raise TypeError("'eps' parameter must be of type float.")
+
+    if info is not None and type(info) is not bool:
+        raise TypeError("'info' parameter, if given, must be of type bool.")
+
+    if overview is not None and type(overview) is not int:
+        raise TypeError("'overview' parameter, if given, must be of type int.")
+
+    if rast.closed:
+            raise RuntimeError("the C++ object which the raster object wraps has been cleaned up and closed.")
+
+    if not breaks and not quantiles:
+        raise ValueError("at least one of the 'breaks' and 'quantiles' parameters must be given.")
+
+    if overview is not None and (overview < 0 or overview >= rast.overview_count):
+        raise ValueError("'overview' must be between 0 and " + str(rast.overview_count - 1) + ", the raster has " + str(rast.overview_count) + " overviews.")
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    breaks_dict = {}
+    for key, val in (breaks or {}).items():
+        if type(key) is not str:
+            raise TypeError("all keys of the 'breaks' dict must be of type str.")
+        if type(val) is not list or len(val) < 1:
+            raise TypeError("all values of the 'breaks' dict must be a non-empty list[float].")
+        if key not in rast.bands:
+            raise ValueError("breaks dict key must be a valid band name (see SpatialRaster.bands for list of names)")
+
+        breaks_dict[rast.band_name_dict[key]] = val
+
+    probabilities_dict = {}
+    for key, val in (quantiles or {}).items():
+        if type(key) is not str:
+            raise TypeError("all keys of the 'quantiles' dict must be of type str.")
+        if type(val) not in [int, list]:
+            raise TypeError("all values of the 'quantiles' dict must be of type int or list[float].")
+        if key not in rast.bands:
+            raise ValueError("quantiles dict key must be a valid band name (see SpatialRaster.bands for list of names)")
+        if breaks is not None and key in breaks:
+            raise ValueError("band '" + key + "' is given in both the 'breaks' and 'quantiles' parameters.")
+
+        band_num = rast.band_name_dict[key]
+        if type(val) is int:
+            if val < 2:
+                raise ValueError("the number of quantiles must be at least 2.")
+            probabilities_dict[band_num] = list(np.array(range(1, val)) / val)
+        else:
+            if len(val) < 1:
+                raise ValueError("quantiles list[float] must contain at least one element.")
+            if min(val) < 0:
+                raise ValueError("list[float] must not contain value less than 0")
+            elif max(val) > 1:
+                raise ValueError("list[float] must not contain value greater than 1")
+            probabilities_dict[band_num] = [p for p in val if p not in [0.0, 1.0]]
+
+    #error check max value for potential overflow error
+    max_mapped_strata = int(map)
+    strata_counts = [len(val) + 1 for val in breaks_dict.values()] + [len(val) + 1 for val in probabilities_dict.values()]
+    for strata_count in strata_counts:
+        if strata_count > MAX_STRATA_VAL:
+            raise ValueError("one of the breaks or quantiles given will cause an integer overflow error because the max strata number is too large.")
+        max_mapped_strata = max_mapped_strata * strata_count
+
+    if max_mapped_strata > MAX_STRATA_VAL:
+        raise ValueError("the mapped strata will cause an overflow error because the max strata number is too large.")
+
+    driver_options_str = {}
+    if driver_options:
+        for (key, val) in driver_options.items():
+            if type(key) is not str:
+                raise ValueError("the key for all key/value pairs in the driver_options dict must be a string.")
+            driver_options_str[key] = str(val)
+
+    large_raster = False
+    raster_size_bytes = 0
+    height = rast.height
+    width = rast.width
+    for key in list(breaks_dict.keys()) + list(probabilities_dict.keys()):
+        pixel_size = rast.cpp_raster.get_raster_band_type_size(key)
+        band_size = height * width * pixel_size
+        raster_size_bytes += band_size
+        if band_size >= GIGABYTE:
+            large_raster = True
+            break
+
+    #if large_raster is true, the C++ function will process the raster in blocks
+    large_raster = large_raster or (raster_size_bytes > GIGABYTE * 4)
+
+    #make a temp directory which will be deleted if there is any problem when calling the cpp function
+    temp_dir = tempfile.mkdtemp()
+    rast.have_temp_dir = True
+    rast.temp_dir = temp_dir
+
+    [srast, quantile_vals] = pipeline_cpp(
+        rast.cpp_raster,
+        breaks_dict,
+        probabilities_dict,
+        map,
+        filename,
+        temp_dir,
+        large_raster,
+        thread_count,
+        driver_options_str,
+        eps,
+        -1 if overview is None else overview
+    )
+
+    srast = SpatialRaster(srast)
+
+    #now that it's created, give the cpp raster object ownership of the temporary directory
+    rast.have_temp_dir = False
+    srast.cpp_raster.set_temp_dir(temp_dir)
+    srast.temp_dataset = filename == "" and large_raster
+    srast.filename = filename
+
+    if info:
+        for band, vals in quantile_vals.items():
+            print("band " + str(band) + " quantile values:")
+            print(vals)
+            print()
+
+    #the output bands are ordered by band index, as are the multipliers of the mapped band
+    band_breaks = dict(breaks_dict)
+    for index in probabilities_dict.keys():
+        band_breaks[index] = quantile_vals[rast.bands[index]]
+
+    metadata_info = {}
+    mapped_band_metadata = []
+    mapped_strata_count = 1
+    for index in sorted(band_breaks.keys()):
+        name = rast.bands[index]
+        vals = sorted(band_breaks[index])
+        strata_count = len(vals) + 1
+
+        metadata = [f"{name} < {vals[0]:.5f}"]
+        for i in range(1, len(vals)):
+            metadata.append(f"{vals[i-1]:.5f} <= {name} < {vals[i]:.5f}")
+        metadata.append(f"{vals[-1]:.5f} <= {name}")
+        metadata_info["strat_" + name] = StratRasterBandMetadata(mapped=False, strata_count=strata_count, band_metadata = metadata)
+
+        if map:
+            mapped_band_metadata.append(("strat_" + name, strata_count))
+            mapped_strata_count = mapped_strata_count * strata_count
+
+    if map:
+        metadata_info["strat_map"] = StratRasterBandMetadata(mapped=True, strata_count=mapped_strata_count, mapped_band_metadata=mapped_band_metadata)
+
+    srast.srast_metadata_info = metadata_info
+    srast.is_strat_rast = True
+    return srast
@@ -12,12 +12,14 @@
  * @ingroup stratify
  */
 
+#include <mutex>
+
 #include "utils/helper.h"
 #include "utils/raster.h"
+#include "utils/rasterize.h"
+#include "utils/reader.h"
 #include "utils/vector.h"
 
-#include "gdal_utils.h"
-
 namespace sgs {
 namespace poly {
 
@@ -37,11 +39,15 @@ namespace poly {
  * The Python function which calls this C++ function created an SQL 
  * query which, when ran on the polygon, maps feature values of a
  * particular attribute in a specific layer to stratification values.
- * The GDALRasterize function is called using this SQL query to rasterize
- * the polygon into different stratifications according to the user-
- * defined inputs. One of the parameters to this rasterization function
- * is the output raster dataset created, which has the output of the
- * rasterization written to it's first band.
+ * The query is executed, and the geometry of every resulting feature
+ * is inserted into a rasterize::TileIndex over tiles of the output raster.
+ *
+ * Rather than rasterizing the whole layer at once, the tiles are then
+ * rasterized in parallel using threads threads. Each tile is initialized
+ * as nodata, only the polygons which may intersect it are burned into it
+ * with their strata value (in the order of the query, so later features
+ * overwrite earlier ones as with GDALRasterize), and the tile is written
+ * to the first band of the output raster.
  *
  * The resulting dataset is then returned as a GDALRasterWrapper object.
  *
@@ -54,6 +60,7 @@ namespace poly {
  * @param bool largeRaster
  * @param std::string tempFolder
  * @param std::map<std::string, std::string> driverOptions
+ * @param int threads
  *
  * @returns GDALRasterWrapper *
  */
@@ -66,7 +73,8 @@ raster::GDALRasterWrapper *poly(
 	std::string filename,
 	bool largeRaster,
 	std::string tempFolder,
-	std::map<std::string, std::string> driverOptions)
+	std::map<std::string, std::string> driverOptions,
+	int threads)
 {
 	GDALAllRegister();
 
@@ -129,43 +137,78 @@ raster::GDALRasterWrapper *poly(
 		p_dataset = helper::createDataset(filename, driver, width, height, geotransform, projection, &band, 1, false, driverOptions);
 	}
 
-	band.p_band->Fill(band.nan);
-
-	//step 4: generate options list for GDALRasterize()
-	char ** argv = nullptr;
-
-	//specify the vector attribute to 'strata', which is created by the sql query
-	argv = CSLAddString(argv, "-a");
-	argv = CSLAddString(argv, "strata");
+	//step 3: run the query, and index the geometry of every resulting feature by the tiles it may intersect
+	OGRLayer *p_queryLayer = p_vectorDS->ExecuteSQL(query.c_str(), nullptr, "SQLITE");
+	if (!p_queryLayer) {
+		throw std::runtime_error("unable to execute query on vector layer.");
+	}
 
-	//specify sql query
-	argv = CSLAddString(argv, "-sql");
-	argv = CSLAddString(argv, query.c_str());
+	int xTileSize = rasterize::tileSize(band.xBlockSize, width);
+	int yTileSize = rasterize::tileSize(band.yBlockSize, height);
+	rasterize::TileIndex index(geotransform, width, height, xTileSize, yTileSize);
+	std::vector<OGRGeometry *> geometries;
+	std::vector<double> strata;
+
+	int strataField = p_queryLayer->GetLayerDefn()->GetFieldIndex("strata");
+	for (const auto& p_feature : *p_queryLayer) {
+		OGRGeometry *p_geometry = p_feature->GetGeometryRef();
+		if (!p_geometry || p_geometry->IsEmpty() || !p_feature->IsFieldSetAndNotNull(strataField)) {
+			continue;
+		}
 
-	//specify sql dialect
-	argv = CSLAddString(argv, "-dialect");
-	argv = CSLAddString(argv, "SQLITE");	
+		OGREnvelope env;
+		p_geometry->getEnvelope(&env);
+		index.insert(geometries.size(), env, 0);
+		geometries.push_back(p_geometry->clone());
+		strata.push_back(p_feature->GetFieldAsDouble(strataField));
+	}
+	p_vectorDS->ReleaseResultSet(p_queryLayer);
+
+	//step 4: burn the geometries intersecting each tile into a nodata-filled tile buffer, in parallel
+	std::mutex writeMutex;
+	size_t tilePixels = static_cast<size_t>(xTileSize) * yTileSize;
+
+	try {
+		rasterize::forEachTile(width, height, xTileSize, yTileSize, threads, [&](const reader::Window& window, int) {
+			std::vector<uint8_t> buffer(tilePixels * band.size);
+			for (size_t i = 0; i < tilePixels; i++) {
+				helper::setStrataPixelDependingOnType(band.type, buffer.data(), i, true, 0);
+			}
+
+			const std::vector<size_t>& ids = index.query(window);
+			std::vector<OGRGeometryH> tileGeometries;
+			std::vector<double> burnValues;
+			tileGeometries.reserve(ids.size());
+			burnValues.reserve(ids.size());
+			for (size_t id : ids) {
+				tileGeometries.push_back(OGRGeometry::ToHandle(geometries[id]));
+				burnValues.push_back(strata[id]);
+			}
+
+			rasterize::burnTile(buffer.data(), band.type, band.size, window, xTileSize, geotransform, tileGeometries, burnValues, false);
+
+			std::lock_guard<std::mutex> lock(writeMutex);
+			helper::rasterBandIO(band, buffer.data(), xTileSize, yTileSize, window.xBlock, window.yBlock, window.xValid, window.yValid, false, false);
+		});
+	}
+	catch (...) {
+		for (OGRGeometry *p_geometry : geometries) {
+			OGRGeometryFactory::destroyGeometry(p_geometry);
+		}
+		throw;
+	}
 
-	GDALRasterizeOptions *options = GDALRasterizeOptionsNew(argv, nullptr);
-	//step 5: rasterize vector to in-memory dataset
-	GDALRasterize(
-		nullptr,
-		!isVRTDataset ? p_dataset : VRTBandInfo[0].p_dataset,
-		p_vectorDS,
-		options,
-		nullptr
-	);
+	//step 5: free the cloned geometries
+	for (OGRGeometry *p_geometry : geometries) {
+		OGRGeometryFactory::destroyGeometry(p_geometry);
+	}
 
-	//step 6: free dynamically allocated rasterization options
-	GDALRasterizeOptionsFree(options);
-	CSLDestroy(argv);	
-	
 	if (isVRTDataset) {
 		GDALClose(VRTBandInfo[0].p_dataset);
 		helper::addBandToVRTDataset(p_dataset, band, VRTBandInfo[0]);	
 	}
 
-	//step 7: create new GDALRasterWrapper using dataset pointer
+	//step 6: create new GDALRasterWrapper using dataset pointer
 	//this dynamically allocated object will be cleaned up by python
 	return isMEMDataset ?
 		new raster::GDALRasterWrapper(p_dataset, {band.p_buffer}) :
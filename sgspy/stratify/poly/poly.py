@@ -50,6 +50,10 @@ GIGABYTE = 1073741824
 #     would result in 2 stratifications (0, 1) where 'low' would correspond
 #     to stratification 0, and both medium and high to stratification 1.
 # 
+# The polygons are rasterized in tiles, using thread_count threads. Each tile
+# only rasterizes the polygons which may intersect it, so the whole layer is never
+# rasterized at once.
+# 
 # Examples
 # --------------------
 # rast = sgspy.SpatialRaster('rast.tif') @n
@@ -74,6 +78,10 @@ GIGABYTE = 1073741824
 #     the stratification values of each feature value, represented as the index in the list  @n @n
 # filename : str @n
 #     the output filename to write to, if desired  @n @n
+# thread_count : int @n
+#     the number of threads to use when rasterizing tiles of the polygons @n @n
+# driver_options : dict[] @n
+#     the creation options as defined by GDAL which will be passed when creating output files @n @n
 # 
 # Returns
 # --------------------
@@ -85,6 +93,7 @@ def poly(
     attribute: str,
     features: list[str|list[str]],
     filename:str = '',
+    thread_count: int = 8,
     driver_options: dict = None):
 
     MAX_STRATA_VAL = 2147483647 #maximum value stored within a 32-bit signed integer to ensure no overflow
@@ -107,12 +116,18 @@ def poly(
     if type(filename) is not str:
         raise TypeError("'filename' parameter must be of type str.")
 
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
     if driver_options is not None and type(driver_options) is not dict:
         raise TypeError("'driver_options' parameter, if givne, must be of type dict.")
 
     if rast.closed:
             raise RuntimeError("the C++ object which the rast object wraps has been cleaned up and closed.")
 
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
     cases = ""
     where_entries = []
     num_strata = len(features)
@@ -168,7 +183,8 @@ def poly(
         filename,
         large_raster,
         temp_dir,
-        driver_options_str
+        driver_options_str,
+        thread_count
     ))
 
     #now that it's created, give the cpp raster object ownership of the temporary directory
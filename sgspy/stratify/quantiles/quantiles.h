@@ -7,10 +7,15 @@
  *
  ******************************************************************************/
 
+#pragma once
+
 #include "utils/raster.h"
+#include "utils/classify.h"
 #include "utils/helper.h"
+#include "utils/reader.h"
+#include "utils/sketch.h"
 
-#include <condition_variable>
+#include <exception>
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
 #include <mkl.h>
@@ -23,6 +28,13 @@
 namespace sgs {
 namespace quantiles {
 
+/**
+ * @ingroup quantiles
+ * The number of chunks a large raster band is split into by batchCalcQuantiles(), whatever
+ * the number of threads, so the merged sketch (and the quantiles) don't depend on the thread count.
+ */
+#define QUANTILES_BATCH_CHUNKS 64
+
 /** 
  * @ingroup quantiles
  * This helper function is used to calculate the quantiles of a
@@ -168,418 +180,163 @@ void calcDPQuantiles(
 	status = vslSSDeleteTask(&task);
 }
 
-/** 
+/**
  * @ingroup quantiles
  * This helper function is used to calculate the quantiles of a
  * large raster which is more efficient to calculate in batches
- * rather than trying to allocate into memory. This is the single
- * precision version of this function, which is used for all 
- * raster data types except double precision floating point 
- * values.
- *
- * Both the quantile probabilities, and the quantiles themselves
- * are double precision, however, so they must be converted
- * before and after execution to and from single precision
- * floating point.
- *
- * Intel's MKL (Math Kernel Library) package is used to calculate the quantiles.
- * The MKL package does not account for nan values, 
- * so the data must be filtered first, leaving only the data 
- * pixel values left.
- *
- * the following MKL VSL (Vector Statistics Library) functions
- * are used to calculate the quantiles:
- * vslsSSCreateTask()
- * vslsSSEditStreamQuantiles()
- * vslsSSCompute()
- * vslSSDeleteTask()
- *
- * CreateTask is called at the start of execution, and
- * VSLsSSEditStreamQuantiles() is called after the first
- * set of values has been written into the buffer. It was 
- * found that calling this function before resulted in 
- * incorrect values, although the funciton still only
- * has to be called once. The Compute function is called many
- * times, to continuously update the quantiles across batches.
- * The fast calculation method is used, which means afterwards
- * the Compute funciton must be called again with the normal
- * method and an observable count of 0 to get the final quantile
- * values. Quantile streaming algorithms are not exact, since the 
- * entire raster must be in memory to get the most precise
- * possible values. However, the amount of error can be controlled
- * to a specific epsilon (eps) value.
- *
- * The Quantile streaming method is the method introduced by 
- * Zhang et al. and utilized by MKL:
- * https://web.cs.ucla.edu/~weiwang/paper/SSDBM07_2.pdf
- * https://www.intel.com/content/www/us/en/docs/onemkl/developer-reference-summary-statistics-notes/2021-1/computing-quantiles-with-vsl-ss-method-squants-zw.html
- *
- * Due to the fact that large raster processing in batches is
- * multi-threaded in SGS, a condition variable (cv) is used to 
- * ensure a thread which would be using the calculated quantiles
- * doesn't begin processing or writing any data before the quantiles
- * are finalized. The shared resource is a boolean representing the
- * band which is set to true by this thread once the quantiles are
- * calculated. Any number of processing threads may be waiting on 
- * the quantiles of this band to be calculated, so notify_all is 
- * called on the cv to wake those threads up.
- *
- * @param GDALRasterWrapper *p_raster
+ * rather than trying to allocate into memory. The float version
+ * is used for all raster data types except double precision
+ * floating point values.
+ *
+ * The raster band is split into (up to) QUANTILES_BATCH_CHUNKS chunks
+ * of rows of blocks. Each chunk is read by one of the threads and
+ * added to its own QuantileSketch (see utils/sketch.h), so no
+ * synchronization is required between the threads. Once every chunk
+ * has been sketched, the sketches are merged in chunk order and the
+ * quantiles are taken from the merged sketch. Since neither the chunks
+ * nor the merge order depend on the number of threads, the result is
+ * the same for any thread count.
+ *
+ * Quantile sketches are not exact, since the entire raster must be
+ * in memory to get the most precise possible values. However, the
+ * rank error of every quantile is bounded by the epsilon (eps) value,
+ * which determines the capacity of the sketches.
+ *
+ * @param int width
+ * @param int height
  * @param RasterBandMetaData& band
  * @param std::vector<double>& probabilities
  * @param std::vector<double>& quantiles
- * @param std::mutex& mutex
- * @param std::condition_variable& cdv
- * @param bool& calculated
  * @param double eps
+ * @param int threadCount
  */
-void batchCalcSPQuantiles(
-	raster::GDALRasterWrapper *p_raster, 
+template <typename T>
+void batchCalcQuantiles(
+	int width,
+	int height,
 	helper::RasterBandMetaData& band, 
 	std::vector<double>& probabilities,
 	std::vector<double>& quantiles,
-	std::mutex& mutex,
-	std::condition_variable& cv,
-	bool& calculated,
-	double eps) 
+	double eps,
+	int threadCount) 
 {
-	std::vector<float> spProbabilities(probabilities.size());
-	std::vector<float> spQuantiles(quantiles.size());
-
-	//get float vector of probabilities
-	for (size_t i = 0; i < probabilities.size(); i++) {
-		spProbabilities[i] = static_cast<float>(probabilities[i]);
-	}
-
-	int xBlocks = (p_raster->getWidth() + band.xBlockSize - 1) / band.xBlockSize;
-	int yBlocks = (p_raster->getHeight() + band.yBlockSize - 1) / band.yBlockSize;
-	
-	float nan = static_cast<float>(band.nan);
-	float spEps = static_cast<float>(eps);
-	void *p_buffer = VSIMalloc3(band.xBlockSize, band.yBlockSize, band.size);
-	float *p_filtered = reinterpret_cast<float *>(VSIMalloc3(band.xBlockSize, band.yBlockSize, sizeof(float)));
-
-	//define variables to pass to MKL quantiles calculation function
-	//https://www.intel.com/content/www/us/en/docs/onemkl/developer-reference-c/2025-2/vslsseditstreamquantiles.html
-	VSLSSTaskPtr task;
-	int status;
-       	MKL_INT quant_order_n = spProbabilities.size();	
-	MKL_INT p = 1;
-	MKL_INT n = band.xBlockSize * band.yBlockSize;
-	MKL_INT nparams = VSL_SS_SQUANTS_ZW_PARAMS_N;
-	MKL_INT xstorage = VSL_SS_MATRIX_STORAGE_ROWS;
-
-	float *quant_order = reinterpret_cast<float *>(spProbabilities.data());
-	float *quants = reinterpret_cast<float *>(spQuantiles.data());
-
-	status = vslsSSNewTask(&task, &p, &n, &xstorage, p_filtered, nullptr, nullptr);
-
-	//read and compute raster by blocks
-	bool calledEditStreamQuantiles = false;
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			int xValid, yValid;
-			band.p_mutex->lock();
-			band.p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-			CPLErr err = band.p_band->ReadBlock(xBlock, yBlock, p_buffer);
-			band.p_mutex->unlock();
-			if (err) {
-				throw std::runtime_error("error reading block from band.");
-			}
-
-			int fi = 0;
-			for (int y = 0; y < yValid; y++) {
-				int index = y * band.xBlockSize;
-				for (int x = 0; x < xValid; x++) {
-					float val = helper::getPixelValueDependingOnType<float>(band.type, p_buffer, index);
-					bool isNan = std::isnan(val) || val == nan;
-					if (!isNan) {
-						p_filtered[fi] = val;
-						fi++;
+	int yBlocks = (height + band.yBlockSize - 1) / band.yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + QUANTILES_BATCH_CHUNKS - 1) / QUANTILES_BATCH_CHUNKS);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
+
+	size_t k = sketch::sketchCapacity(eps, static_cast<int64_t>(width) * static_cast<int64_t>(height));
+	std::vector<sketch::QuantileSketch<T>> sketches(chunks, sketch::QuantileSketch<T>(k));
+	std::vector<std::exception_ptr> errors(chunks, nullptr);
+
+	boost::asio::thread_pool pool(threadCount);
+	for (int i = 0; i < chunks; i++) {
+		int yBlockStart = i * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+		sketch::QuantileSketch<T> *p_sketch = &sketches[i];
+		std::exception_ptr *p_error = &errors[i];
+
+		boost::asio::post(pool, [&band, width, height, yBlockStart, yBlockEnd, p_sketch, p_error] {
+			try {
+				T nan = static_cast<T>(band.nan);
+				std::vector<T> filtered(static_cast<size_t>(band.xBlockSize) * static_cast<size_t>(band.yBlockSize));
+
+				//the next blocks of the chunk are read ahead on an I/O thread
+				reader::BlockReader blocks(
+					{&band},
+					reader::blockWindows(band.xBlockSize, band.yBlockSize, width, height, yBlockStart, yBlockEnd),
+					band.xBlockSize,
+					band.yBlockSize
+				);
+				while (reader::Block *p_block = blocks.next()) {
+					void *p_buffer = p_block->buffers[0];
+					int xValid = p_block->window.xValid;
+					int yValid = p_block->window.yValid;
+
+					size_t fi = 0;
+					for (int y = 0; y < yValid; y++) {
+						size_t index = static_cast<size_t>(y) * static_cast<size_t>(band.xBlockSize);
+						for (int x = 0; x < xValid; x++) {
+							T val = helper::getPixelValueDependingOnType<T>(band.type, p_buffer, index);
+							bool isNan = std::isnan(val) || val == nan;
+							if (!isNan) {
+								filtered[fi] = val;
+								fi++;
+							}
+							index++;
+						}
 					}
-					index++;
+
+					p_sketch->update(filtered.data(), fi);
 				}
 			}
-
-			if (fi == 0) {
-				continue;
+			catch (...) {
+				*p_error = std::current_exception();
 			}
+		});
+	}
+	pool.join();
 
-			n = fi;
-			if (!calledEditStreamQuantiles) {
-				//for some reason this has issues if called before the first band of data is loaded,
-				//although it only has to be called once.
-				status = vslsSSEditStreamQuantiles(task, &quant_order_n, quant_order, quants, &nparams, &spEps);
-				calledEditStreamQuantiles = true;
-			}
-			status = vslsSSCompute(task, VSL_SS_STREAM_QUANTS, VSL_SS_METHOD_SQUANTS_ZW_FAST);
+	for (const std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
 		}
 	}
 
-	//use VSL_SS_METHOD_SQUANTS_ZW (not VSL_SS_METHOD_SQUANTS_ZW_FAST) to get final estimates
-	n = 0;
-	vslsSSCompute(task, VSL_SS_STREAM_QUANTS, VSL_SS_METHOD_SQUANTS_ZW);	
-	status = vslSSDeleteTask(&task);
-
-	//assign double quantile values
-	for(size_t i = 0; i < spQuantiles.size(); i++) {
-		quantiles[i] = static_cast<double>(spQuantiles[i]);
+	for (int i = 1; i < chunks; i++) {
+		sketches[0].merge(sketches[i]);
 	}
-
-	VSIFree(p_buffer);
-	VSIFree(p_filtered);
-
-	mutex.lock();
-	calculated = true;
-	mutex.unlock();
-	cv.notify_all();
+	quantiles = sketches[0].quantiles(probabilities);
 }
 
-
 /**
  * @ingroup quantiles
- * This helper function is used to calculate the quantiles of a
- * large raster which is more efficient to calculate in batches
- * rather than trying to allocate into memory. This is the double
- * precision version of this function.
- *
- * Intel's MKL (Math Kernel Library) package is used to calculate the quantiles.
- * The MKL package does not account for nan values, 
- * so the data must be filtered first, leaving only the data 
- * pixel values left.
- *
- * the following MKL VSL (Vector Statistics Library) functions
- * are used to calculate the quantiles:
- * vsldSSCreateTask()
- * vsldSSEditStreamQuantiles()
- * vsldSSCompute()
- * vslSSDeleteTask()
- *
- * CreateTask is called at the start of execution, and
- * VSLsSSEditStreamQuantiles() is called after the first
- * set of values has been written into the buffer. It was 
- * found that calling this function before resulted in 
- * incorrect values, although the funciton still only
- * has to be called once. The Compute function is called many
- * times, to continuously update the quantiles across batches.
- * The fast calculation method is used, which means afterwards
- * the Compute funciton must be called again with the normal
- * method and an observable count of 0 to get the final quantile
- * values. Quantile streaming algorithms are not exact, since the 
- * entire raster must be in memory to get the most precise
- * possible values. However, the amount of error can be controlled
- * to a specific epsilon (eps) value.
- *
- * The Quantile streaming method is the method introduced by 
- * Zhang et al. and utilized by MKL:
- * https://web.cs.ucla.edu/~weiwang/paper/SSDBM07_2.pdf
- * https://www.intel.com/content/www/us/en/docs/onemkl/developer-reference-summary-statistics-notes/2021-1/computing-quantiles-with-vsl-ss-method-squants-zw.html
- *
- * Due to the fact that large raster processing in batches is
- * multi-threaded in SGS, a condition variable (cv) is used to 
- * ensure a thread which would be using the calculated quantiles
- * doesn't begin processing or writing any data before the quantiles
- * are finalized. The shared resource is a boolean representing the
- * band which is set to true by this thread once the quantiles are
- * calculated. Any number of processing threads may be waiting on 
- * the quantiles of this band to be calculated, so notify_all is 
- * called on the cv to wake those threads up.
- *
- * @param GDALRasterWrapper *p_raster
- * @param RasterBandMetaData& band
+ * This function calculates the quantiles of a band from one of it's overviews
+ * rather than the full resolution band, using batchCalcQuantiles(). An overview
+ * at level l of a COG typically has 4^(l+1) times fewer pixels than the band, so
+ * only that fraction of the band is read (or fetched, for a remote raster).
+ *
+ * The result is an estimate of the quantiles of the band. In addition to the eps
+ * rank error of the sketch, there is the error of using the overview pixels in place
+ * of every pixel. If the overview was built with nearest neighbour resampling, its
+ * pixels are a regular subsample of the band and, treating them as a random sample
+ * of n pixels, the rank of every quantile is within sqrt(ln(2 / a) / (2n)) times the
+ * number of pixels of its exact rank with probability 1 - a (the Dvoretzky-Kiefer-Wolfowitz
+ * inequality). Spatially autocorrelated bands usually do better than this. Averaging
+ * resampling smooths the values of the band, which pulls the outer quantiles toward
+ * the median, so there is no such bound for overviews built that way.
+ *
+ * @param helper::RasterBandMetaData& band
+ * @param int overview
  * @param std::vector<double>& probabilities
  * @param std::vector<double>& quantiles
- * @param std::mutex& mutex
- * @param std::condition_variable& cdv
- * @param bool& calculated
  * @param double eps
+ * @param int threadCount
  */
-void batchCalcDPQuantiles(
-	raster::GDALRasterWrapper *p_raster, 
-	helper::RasterBandMetaData& band, 
+inline void
+overviewQuantiles(
+	helper::RasterBandMetaData& band,
+	int overview,
 	std::vector<double>& probabilities,
 	std::vector<double>& quantiles,
-	std::mutex& mutex,
-	std::condition_variable& cv,
-	bool& calculated,
-	double eps) 
-{
-	int xBlocks = (p_raster->getWidth() + band.xBlockSize - 1) / band.xBlockSize;
-	int yBlocks = (p_raster->getHeight() + band.yBlockSize - 1) / band.yBlockSize;
-	
-	void *p_buffer = VSIMalloc3(band.xBlockSize, band.yBlockSize, band.size);
-	double *p_filtered = reinterpret_cast<double *>(VSIMalloc3(band.xBlockSize, band.yBlockSize, sizeof(double)));
-
-	//define variables to pass to MKL quantiles calculation function
-	//https://www.intel.com/content/www/us/en/docs/onemkl/developer-reference-c/2025-2/vslsseditstreamquantiles.html
-	VSLSSTaskPtr task;
-	int status;
-       	MKL_INT quant_order_n = probabilities.size();	
-	MKL_INT p = 1;
-	MKL_INT n = band.xBlockSize * band.yBlockSize;
-	MKL_INT nparams = VSL_SS_SQUANTS_ZW_PARAMS_N;
-	MKL_INT xstorage = VSL_SS_MATRIX_STORAGE_ROWS;
-
-	double *quant_order = reinterpret_cast<double *>(probabilities.data());
-	double *quants = reinterpret_cast<double *>(quantiles.data());
-
-	vsldSSNewTask(&task, &p, &n, &xstorage, p_filtered, 0, 0);
-
-	//read and compute raster by blocks
-	bool calledEditStreamQuantiles = false;
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			int xValid, yValid;
-			band.p_mutex->lock();
-			band.p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-			CPLErr err = band.p_band->ReadBlock(xBlock, yBlock, p_buffer);
-			band.p_mutex->unlock();
-			if (err) {
-				throw std::runtime_error("error reading block from band.");
-			}
-
-			int fi = 0;
-			for (int y = 0; y < yValid; y++) {
-				int index = y * band.xBlockSize;
-				for (int x = 0; x < xValid; x++) {
-					double val = helper::getPixelValueDependingOnType<double>(band.type, p_buffer, index);
-					bool isNan = std::isnan(val) || val == band.nan;
-					if (!isNan) {
-						p_filtered[fi] = val;
-						fi++;
-					}
-					index++;
-				}
-			}
-
-			if (fi == 0) {
-				continue;
-			}
-
-			n = fi;
-			if (!calledEditStreamQuantiles) {
-				//for some reason this has issues if called before the first band of data is loaded,
-				//although it only has to be called once.
-				status = vsldSSEditStreamQuantiles(task, &quant_order_n, quant_order, quants, &nparams, &eps);
-				calledEditStreamQuantiles = true;
-			}
-			status = vsldSSCompute(task, VSL_SS_STREAM_QUANTS, VSL_SS_METHOD_SQUANTS_ZW_FAST);
-		}
-	}
-
-	//use VSL_SS_METHOD_SQUANTS_ZW (not VSL_SS_METHOD_SQUANTS_ZW_FAST) to get final estimates
-	n = 0;
-	vsldSSCompute(task, VSL_SS_STREAM_QUANTS, VSL_SS_METHOD_SQUANTS_ZW);	
-	status = vslSSDeleteTask(&task);
-
-	mutex.lock();
-	calculated = true;
-	mutex.unlock();
-	cv.notify_all();
-
-	VSIFree(p_buffer);
-	VSIFree(p_filtered);
-}
-
-/**
- * @ingroup quantiles
- * This is a helper function for processing a pixel of data
- * when a mapped stratification is being created.
- *
- * First, the value is read in as a double, and it is determined
- * whether the pixel is a nan pixel or not. The mapNan boolean 
- * is updated in addition to the isNan boolean, to ensure that
- * if one band within the raster is nan at a certain pixel
- * then the mapped raster (but not necessarily all output rasters)
- * is also nan at that pixel.
- *
- * Then, if it isn't a nan pixel the lower bound of the value 
- * within the vector of break values is found. For example,
- * if the value was 3 and the breaks vector was [2, 4, 6], the
- * lower bound would be 1, which is the index of 4, the first
- * value larger than 3 in the breaks vector. This lower bound
- * is the strata. This strata (or the nan value) is then written 
- * with the appropriate type to the strat raster band.
- *
- * @param size_t index
- * @param RasterBandMetaData& dataBand
- * @param void *p_dataBuffer
- * @param RasterBandMetaData& stratBand
- * @param void *p_stratBuffer
- * @param std::vector<double>& quantiles
- * @param size_t multiplier
- * @param bool& mapNan
- * @param size_t &mapStrat
- */
-inline void processMapPixel(
-	size_t index,
-	helper::RasterBandMetaData& dataBand,
-	void * p_dataBuffer,
-	helper::RasterBandMetaData& stratBand,
-	void * p_stratBuffer,
-	std::vector<double>& quantiles,
-	size_t multiplier,
-	bool& mapNan,
-	size_t& mapStrat)
-{
-	double val = helper::getPixelValueDependingOnType<double>(dataBand.type, p_dataBuffer, index);
-	bool isNan = std::isnan(val) || (double)val == dataBand.nan;
-	mapNan |= isNan;
-		
-	size_t strat = 0;
-	if (!isNan) {
-		auto it = std::lower_bound(quantiles.begin(), quantiles.end(), val);
-		strat = (it == quantiles.end()) ? quantiles.size() : std::distance(quantiles.begin(), it);
-	}
-
-	helper::setStrataPixelDependingOnType(stratBand.type, p_stratBuffer, index, isNan, strat);
-
-	if (!mapNan) {
-		mapStrat += strat * multiplier;
-	}
-}	
-
-/**
- * @ingroup quantiles
- * This is a helper function for processing a pixel of data.
- *
- * First, the value is read in as a double, and it is determined
- * whether the pixel is a nan pixel or not.
- *
- * Then, if it isn't a nan pixel the lower bound of the value 
- * within the vector of break values is found. For example,
- * if the value was 3 and the breaks vector was [2, 4, 6], the
- * lower bound would be 1, which is the index of 4, the first
- * value larger than 3 in the breaks vector. This lower bound
- * is the strata. This strata (or the nan value) is then written 
- * with the appropriate type to the strat raster band.
- *
- * @param size_t index
- * @param void *p_data
- * @param RasterBandMetaData *p_dataBand
- * @param void *p_strat
- * @param RasterBandMetaData *p_stratBand
- * @param std::vector<double>& quantiles
- */
-inline void
-processPixel(
-	size_t index,
-	void *p_data,
-	helper::RasterBandMetaData *p_dataBand,
-	void *p_strat,
-	helper::RasterBandMetaData *p_stratBand,
-	std::vector<double>& quantiles)
+	double eps,
+	int threadCount)
 {
-	double val = helper::getPixelValueDependingOnType<double>(p_dataBand->type, p_data, index);
-	bool isNan = std::isnan(val) || val == p_dataBand->nan;
-
-	size_t strat = 0;
-	if (!isNan) {
-		auto it = std::lower_bound(quantiles.begin(), quantiles.end(), val);
-		strat = (it == quantiles.end()) ? quantiles.size() : std::distance(quantiles.begin(), it);
+	GDALRasterBand *p_overview = band.p_band->GetOverview(overview);
+	if (!p_overview) {
+		throw std::runtime_error("raster band has no overview at level " + std::to_string(overview) + ".");
 	}
 
-	helper::setStrataPixelDependingOnType(p_stratBand->type, p_strat, index, isNan, strat);
+	//the overview shares the dataset (and so the mutex) of the band
+	helper::RasterBandMetaData overviewBand = band;
+	overviewBand.p_band = p_overview;
+	overviewBand.p_buffer = nullptr;
+	p_overview->GetBlockSize(&overviewBand.xBlockSize, &overviewBand.yBlockSize);
+
+	int width = p_overview->GetXSize();
+	int height = p_overview->GetYSize();
+	(band.type != GDT_Float64) ?
+		batchCalcQuantiles<float>(width, height, overviewBand, probabilities, quantiles, eps, threadCount) :
+		batchCalcQuantiles<double>(width, height, overviewBand, probabilities, quantiles, eps, threadCount);
 }
 
 /**
@@ -597,8 +354,8 @@ processPixel(
  * the setup, metadata is acquired for the input raster, and an output dataset
  * is created which depends on user-given parameters and the input raster.
  * During the quantiles calculation, Intel's Math Kernel Library (MKL) is
- * used to calculate quantiles either with the entire raster in memory
- * or in batches. During the processing step the raster is iterated through,
+ * used to calculate quantiles with the entire raster in memory, or a
+ * mergeable quantile sketch is used to calculate them in batches. During the processing step the raster is iterated through,
  * either by blocks or with the entire raster in memory, the strata are determined
  * for each pixel and then written to the output dataset. During the finish/return 
  * step, a GDALRasterWrapper object is created using the output dataset.
@@ -651,14 +408,24 @@ processPixel(
  * be significantly less for single precision floating point values.
  *
  * For batch processing vs non-batch processing, slightly different algorithms
- * are used. The batch processing algorithm is a quantile streaming algorithm
- * within MKL which creates a fast and accurate approximation of the quantiles
- * without requiring the whole raster to be in memory at once. More information
- * is contained in the documentation for those particular functions.
+ * are used. The batch processing algorithm sketches chunks of the raster in
+ * parallel and merges the sketches, which creates a fast and accurate
+ * approximation of the quantiles without requiring the whole raster to be in
+ * memory at once. More information is contained in the documentation for
+ * batchCalcQuantiles() and utils/sketch.h.
  *
- * Information on the quantile streaming algorithm can be found here:
- *  - https://www.cs.unc.edu/~weiwang/paper/SSDBM07_2.pdf
- *  - https://www.intel.com/content/www/us/en/docs/onemkl/developer-reference-summary-statistics-notes/2021-1/computing-quantiles-with-vsl-ss-method-squants-zw.html
+ * The quantiles of each band are stored in the statistics cache of the raster
+ * (keyed by the probabilities, and by eps for the sketch), so a
+ * later call with the same probabilities skips the calculation entirely.
+ *
+ * If an overview level is given (overview is not -1), the quantiles of every
+ * band are instead estimated from that overview using overviewQuantiles(),
+ * and are neither taken from nor stored in the statistics cache. The bands are
+ * still stratified at full resolution.
+ *
+ * Information on the quantile sketch can be found here:
+ *  - https://dl.acm.org/doi/10.1145/276305.276342
+ *  - https://arxiv.org/abs/1603.05346
  *
  * PROCESSING:
  * the processing section iterated through ever pixel in every input band,
@@ -707,6 +474,7 @@ processPixel(
  * @param int threadCount
  * @param std::map<std::string, std::string> driverOptions,
  * @param double eps
+ * @param int overview
  * @returns GDALRasterWrapper *pointer to newly created stratified raster
  */
 std::pair<raster::GDALRasterWrapper *, std::unordered_map<std::string, std::vector<double>>>
@@ -719,7 +487,8 @@ quantiles(
 	bool largeRaster,
 	int threadCount,
 	std::map<std::string, std::string> driverOptions,
-	double eps) 
+	double eps,
+	int overview) 
 {
 	GDALAllRegister();
 
@@ -732,6 +501,8 @@ quantiles(
 
 	int bandCount = userProbabilites.size();
 	std::vector<std::vector<double>> probabilities;
+	std::vector<int> bandIndices;
+	stats::StatisticsCache& cache = p_raster->getStatistics();
 	std::vector<std::string> bandNames = p_raster->getBands();
 
 	std::vector<helper::RasterBandMetaData> dataBands(bandCount);
@@ -782,6 +553,7 @@ quantiles(
 
 		//add probabilities
 		probabilities.push_back(val);	
+		bandIndices.push_back(key);
 
 		//update metadata of new strat raster
 		size_t maxStrata = val.size() + 1;
@@ -866,72 +638,38 @@ quantiles(
 	}
 
 	std::vector<std::vector<double>> quantiles(probabilities.size());
-	if (largeRaster) {
-		pybind11::gil_scoped_acquire acquire;
-		boost::asio::thread_pool pool(threadCount); 
-	
-		//initialize synchronization variables
-		std::vector<std::mutex> mutexes(map ? 1 : bandCount);
-		std::vector<std::condition_variable> cvs(map ? 1 : bandCount);
-		bool *quantilesCalculated = reinterpret_cast<bool *>(VSIMalloc2(bandCount, sizeof(bool))); //don't use std::vector<bool> because can't reference individual bools from it
-
-		//call batch processing quantiles function depending on data type
+	if (overview != -1) {
 		for (int i = 0; i < bandCount; i++) {
-			helper::RasterBandMetaData band = dataBands[i];
+			overviewQuantiles(dataBands[i], overview, probabilities[i], quantiles[i], eps, threadCount);
+		}
+	}
+
+	if (largeRaster) {
+		//calculate the quantiles of every band which aren't already in the statistics
+		//cache, each band is sketched in parallel across chunks of the band
+		for (int i = 0; overview == -1 && i < bandCount; i++) {
+			helper::RasterBandMetaData& band = dataBands[i];
 			quantiles[i].resize(probabilities[i].size());
-			quantilesCalculated[i] = false;
-			if (band.type != GDT_Float64) {
-				boost::asio::post(pool, std::bind(batchCalcSPQuantiles,
-					p_raster,
-					std::ref(band),
-					std::ref(probabilities[i]),
-					std::ref(quantiles[i]),
-					std::ref(mutexes[map ? 0 : i]),
-					std::ref(cvs[map ? 0 : i]),
-					std::ref(quantilesCalculated[i]),
-					static_cast<double>(eps)
-				));
-			}
-			else {
-				boost::asio::post(pool, std::bind(batchCalcDPQuantiles,
-					p_raster,
-					std::ref(band),
-					std::ref(probabilities[i]),
-					std::ref(quantiles[i]),
-					std::ref(mutexes[i]),
-					std::ref(cvs[i]),
-					std::ref(quantilesCalculated[i]),
-					static_cast<double>(eps)
-				));
+			if (cache.getQuantiles(bandIndices[i], probabilities[i], eps, quantiles[i])) {
+				continue;
 			}
+
+			(band.type != GDT_Float64) ?
+				batchCalcQuantiles<float>(width, height, band, probabilities[i], quantiles[i], eps, threadCount) :
+				batchCalcQuantiles<double>(width, height, band, probabilities[i], quantiles[i], eps, threadCount);
+			cache.setQuantiles(bandIndices[i], probabilities[i], eps, quantiles[i]);
 		}
 
+		boost::asio::thread_pool pool(threadCount); 
+
 		//iterate through all pixels and update the stratified raster bands
 		if (map) {
-
-			//NOTE: all processing threads in the case of a mapped raster must wait
-			//until quantiles have been calculated for every band.
-			std::unique_lock lock(mutexes[0]);
-			bool allBandsQuantilesCalculated = true;
-			for (int i = 0; i < bandCount; i++) {
-				allBandsQuantilesCalculated &= quantilesCalculated[i];
-			}
-
-			while (!allBandsQuantilesCalculated) {
-				cvs[0].wait(lock);
-				allBandsQuantilesCalculated = true;
-				for (int i = 0; i < bandCount; i++) {
-					allBandsQuantilesCalculated &= quantilesCalculated[i];
-				}
-			}
-
 			//use the first raster band to determine block size
 			int xBlockSize = dataBands[0].xBlockSize;
 			int yBlockSize = dataBands[0].yBlockSize;
 
-			int xBlocks = (p_raster->getWidth() + xBlockSize - 1) / xBlockSize;
 			int yBlocks = (p_raster->getHeight() + yBlockSize - 1) / yBlockSize;
-			int chunkSize = yBlocks / threadCount;
+			int chunkSize = std::max(1, (yBlocks + QUANTILES_BATCH_CHUNKS - 1) / QUANTILES_BATCH_CHUNKS);
 
 			for (int yBlockStart = 0; yBlockStart < yBlocks; yBlockStart += chunkSize) {
 				int yBlockEnd = std::min(yBlockStart + chunkSize, yBlocks);
@@ -942,97 +680,87 @@ quantiles(
 					yBlockSize, 
 					yBlockStart, 
 					yBlockEnd, 
-					xBlocks, 
+					width,
+					height,
 					&dataBands, 
 					&stratBands, 
 					&quantiles,
 					&multipliers
 				] {			
-					std::vector<void *> dataBuffers(dataBands.size());
 					std::vector<void *> stratBuffers(stratBands.size());
-					for (size_t band = 0; band < dataBuffers.size(); band++) {
-						dataBuffers[band] = VSIMalloc3(xBlockSize, yBlockSize, dataBands[band].size);
+					for (size_t band = 0; band < stratBuffers.size(); band++) {
 						stratBuffers[band] = VSIMalloc3(xBlockSize, yBlockSize, stratBands[band].size);
 					}
-					stratBuffers.back() = VSIMalloc3(xBlockSize, yBlockSize, stratBands.back().size);
-
-					for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
-						for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-							int xValid, yValid;
-							dataBands[0].p_mutex->lock();
-							dataBands[0].p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-							dataBands[0].p_mutex->unlock();
-
-							//read raster band data into band buffers
-							for (size_t band = 0; band < static_cast<size_t>(bandCount); band++) {
-								helper::rasterBandIO(
-									dataBands[band], 
-									dataBuffers[band], 
-									xBlockSize, 
-									yBlockSize, 
-									xBlock, 
-									yBlock, 
-									xValid, 
-									yValid, 
-									true //read = true
-								);		
-							}
 
-							//process blocked band data
-							for (int y = 0; y < yValid; y++) {
-								size_t index = static_cast<size_t>(y * xBlockSize);
-								for (int x = 0; x < xValid; x++) {
-									bool mapNan = false;
-									size_t mapStrat = 0;
-									
-									for (size_t band = 0; band < static_cast<size_t>(bandCount); band++) {
-										processMapPixel(
-											index, 
-											dataBands[band], 
-											dataBuffers[band], 
-											stratBands[band], 
-											stratBuffers[band], 
-											quantiles[band],
-											multipliers[band],
-											mapNan,
-											mapStrat
-										);
-									}
-								
-									helper::setStrataPixelDependingOnType(
-										stratBands.back().type,
-										stratBuffers.back(),
-										index,
-										mapNan,
-										mapStrat
-									);
-
-									index++;
-								}
-							}
-					
-							//write strat band data
-							for (size_t band = 0; band <= static_cast<size_t>(bandCount); band++) {
-								helper::rasterBandIO(
-									stratBands[band],
-									stratBuffers[band],
-									xBlockSize,
-									yBlockSize,
-									xBlock,
-									yBlock,
-									xValid,
-									yValid,
-									false //read = false
-								);
-							}
+					//mapped strata are accumulated across the bands of each block before being written
+					std::vector<int64_t> mapStrata(static_cast<size_t>(xBlockSize) * yBlockSize, 0);
+					std::vector<uint8_t> mapNan(static_cast<size_t>(xBlockSize) * yBlockSize, 0);
+
+					//raster band data is read ahead on an I/O thread while the current block is processed
+					std::vector<helper::RasterBandMetaData *> p_dataBands(bandCount);
+					for (size_t band = 0; band < static_cast<size_t>(bandCount); band++) {
+						p_dataBands[band] = &dataBands[band];
+					}
+					reader::BlockReader blocks(
+						p_dataBands,
+						reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+						xBlockSize,
+						yBlockSize
+					);
+
+					while (reader::Block *p_block = blocks.next()) {
+						std::vector<void *>& dataBuffers = p_block->buffers;
+						int xBlock = p_block->window.xBlock;
+						int yBlock = p_block->window.yBlock;
+						int xValid = p_block->window.xValid;
+						int yValid = p_block->window.yValid;
+
+						//process blocked band data
+						for (size_t band = 0; band < static_cast<size_t>(bandCount); band++) {
+							classify::classifyBlock(
+								dataBands[band],
+								dataBuffers[band],
+								stratBands[band],
+								stratBuffers[band],
+								xValid,
+								yValid,
+								xBlockSize,
+								quantiles[band],
+								multipliers[band],
+								mapStrata.data(),
+								mapNan.data()
+							);
+						}
+
+						classify::writeMap(
+							stratBands.back(),
+							stratBuffers.back(),
+							xValid,
+							yValid,
+							xBlockSize,
+							mapStrata.data(),
+							mapNan.data()
+						);
+				
+						//write strat band data
+						for (size_t band = 0; band <= static_cast<size_t>(bandCount); band++) {
+							helper::rasterBandIO(
+								stratBands[band],
+								stratBuffers[band],
+								xBlockSize,
+								yBlockSize,
+								xBlock,
+								yBlock,
+								xValid,
+								yValid,
+								false //read = false
+							);
 						}
 					}
 
-					for (size_t band = 0; band < dataBuffers.size(); band++) {
-						VSIFree(dataBuffers[band]);
+					for (size_t band = 0; band < stratBuffers.size(); band++) {
 						VSIFree(stratBuffers[band]);
 					}
-					VSIFree(stratBuffers.back());
 				});
 			}	
 		}
@@ -1044,83 +772,55 @@ quantiles(
 				int xBlockSize = p_dataBand->xBlockSize;
 				int yBlockSize = p_dataBand->yBlockSize;
 					
-				int xBlocks = (p_raster->getWidth() + xBlockSize - 1) / xBlockSize;
 				int yBlocks = (p_raster->getHeight() + yBlockSize - 1) / yBlockSize;			
-				int chunkSize = yBlocks / threadCount;
+				int chunkSize = std::max(1, (yBlocks + QUANTILES_BATCH_CHUNKS - 1) / QUANTILES_BATCH_CHUNKS);
 				
 				for (int yBlockStart = 0; yBlockStart < yBlocks; yBlockStart += chunkSize) {
 					int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
 					std::vector<double> *p_quantiles = &quantiles[band];
-					std::mutex *p_mutex = &mutexes[band];
-					std::condition_variable *p_cv = &cvs[band];
-					bool *p_calculated = &quantilesCalculated[band];
 					
 					boost::asio::post(pool, [
 						xBlockSize, 
 						yBlockSize, 
 						yBlockStart, 
 						yBlockEnd, 
-						xBlocks, 
+						width,
+						height,
 						p_dataBand, 
 						p_stratBand, 
-						p_quantiles,
-						p_mutex,
-						p_cv,
-						p_calculated
+						p_quantiles
 					] {
-						std::unique_lock lock(*p_mutex);
-
-						if (!(*p_calculated)) {
-							p_cv->wait(lock);
-						}
-
-						void *p_data = VSIMalloc3(xBlockSize, yBlockSize, p_dataBand->size);
 						void *p_strat = VSIMalloc3(xBlockSize, yBlockSize, p_stratBand->size);
 
-						int xValid, yValid;
-						for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
-							for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-								p_dataBand->p_mutex->lock();
-								p_dataBand->p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-								p_dataBand->p_mutex->unlock();
-								
-								//read block into memory
-								rasterBandIO(
-									*p_dataBand,
-									p_data,
-									xBlockSize,
-									yBlockSize,
-									xBlock,
-									yBlock,
-									xValid,
-									yValid,
-									true //read = true
-								);
-
-								//process block
-								for (int y = 0; y < yValid; y++) {
-									size_t index = static_cast<size_t>(y * xBlockSize);
-									for (int x = 0; x < xValid; x++) {
-										processPixel(index, p_data, p_dataBand, p_strat, p_stratBand, *p_quantiles);
-										index++;
-									}
-								}
-								
-								//write resulting stratifications to disk
-								helper::rasterBandIO(
-									*p_stratBand,
-									p_strat,
-									xBlockSize,
-									yBlockSize,
-									xBlock,
-									yBlock,
-									xValid,
-									yValid,
-									false //read = false
-								);
-							}
+						//blocks are read ahead on an I/O thread while the current block is processed
+						reader::BlockReader blocks(
+							{p_dataBand},
+							reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd),
+							xBlockSize,
+							yBlockSize
+						);
+
+						while (reader::Block *p_block = blocks.next()) {
+							void *p_data = p_block->buffers[0];
+							int xValid = p_block->window.xValid;
+							int yValid = p_block->window.yValid;
+
+							//process block
+							classify::classifyBlock(*p_dataBand, p_data, *p_stratBand, p_strat, xValid, yValid, xBlockSize, *p_quantiles);
+							
+							//write resulting stratifications to disk
+							helper::rasterBandIO(
+								*p_stratBand,
+								p_strat,
+								xBlockSize,
+								yBlockSize,
+								p_block->window.xBlock,
+								p_block->window.yBlock,
+								xValid,
+								yValid,
+								false //read = false
+							);
 						}
-						VSIFree(p_data);
 						VSIFree(p_strat);
 					});
 				}
@@ -1128,60 +828,70 @@ quantiles(
 		}
 
 		pool.join();
-		VSIFree(quantilesCalculated);
-		pybind11::gil_scoped_release release;
 	}
 	else {
-		//call quantiles calculation fuction depending on type
-		for (int i = 0; i < bandCount; i++) {
+		//call quantiles calculation fuction depending on type, unless the exact
+		//quantiles (eps of 0) of the band are already in the statistics cache
+		for (int i = 0; overview == -1 && i < bandCount; i++) {
 			helper::RasterBandMetaData band = dataBands[i];
 			quantiles[i].resize(probabilities[i].size());
+			if (cache.getQuantiles(bandIndices[i], probabilities[i], 0, quantiles[i])) {
+				continue;
+			}
+
 			(band.type != GDT_Float64) ?
 				calcSPQuantiles(p_raster, band, probabilities[i], quantiles[i]) :
 				calcDPQuantiles(p_raster, band, probabilities[i], quantiles[i]);
+			cache.setQuantiles(bandIndices[i], probabilities[i], 0, quantiles[i]);
 		}
 
-		size_t pixelCount = static_cast<size_t>(p_raster->getWidth()) * static_cast<size_t>(p_raster->getHeight());
 		if (map) {
-			for (size_t index = 0; index < pixelCount; index++) {
-				bool mapNan = false;
-				size_t mapStrat = 0;
-									
+			//mapped strata are accumulated across the bands of each row before being written
+			std::vector<int64_t> mapStrata(width, 0);
+			std::vector<uint8_t> mapNan(width, 0);
+
+			for (int y = 0; y < height; y++) {
+				size_t offset = static_cast<size_t>(y) * static_cast<size_t>(width);
+
 				for (size_t band = 0; band < static_cast<size_t>(bandCount); band++) {
-					processMapPixel(
-						index, 
-						dataBands[band], 
-						dataBands[band].p_buffer, 
-						stratBands[band], 
-						stratBands[band].p_buffer, 
+					classify::classifyBlock(
+						dataBands[band],
+						reinterpret_cast<int8_t *>(dataBands[band].p_buffer) + offset * dataBands[band].size,
+						stratBands[band],
+						reinterpret_cast<int8_t *>(stratBands[band].p_buffer) + offset * stratBands[band].size,
+						width,
+						1,
+						width,
 						quantiles[band],
 						multipliers[band],
-						mapNan,
-						mapStrat
+						mapStrata.data(),
+						mapNan.data()
 					);
 				}
 
-				helper::setStrataPixelDependingOnType(
-					stratBands.back().type,
-					stratBands.back().p_buffer,
-					index,
-					mapNan,
-					mapStrat
+				classify::writeMap(
+					stratBands.back(),
+					reinterpret_cast<int8_t *>(stratBands.back().p_buffer) + offset * stratBands.back().size,
+					width,
+					1,
+					width,
+					mapStrata.data(),
+					mapNan.data()
 				);
 			}
 		}
 		else {
 			for (size_t band = 0; band < static_cast<size_t>(bandCount); band++) {
-				for (size_t i = 0; i < pixelCount; i++) {
-					processPixel(
-						i,
-					       	dataBands[band].p_buffer,	
-						&dataBands[band], 
-						stratBands[band].p_buffer,
-						&stratBands[band],
-						quantiles[band]
-					);
-				}
+				classify::classifyBlock(
+					dataBands[band],
+					dataBands[band].p_buffer,
+					stratBands[band],
+					stratBands[band].p_buffer,
+					width,
+					height,
+					width,
+					quantiles[band]
+				);
 			}
 		}
 
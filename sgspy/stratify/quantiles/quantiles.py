@@ -72,10 +72,13 @@ GIGABYTE = 1073741824
 # the eps parameter is used only if batch processing is used to calculate the quantiles
 # for a raster. Quantile streaming algorithms cannot be perfectly accurate, as this
 # would necessitate having the entire raster in memory at once. A good approximation
-# can be made, and the error is controlled by this epsilon (eps) value.
-# The Quantile streaming method is the method introduced by  Zhang et al. and utilized by MKL:
-#     https://web.cs.ucla.edu/~weiwang/paper/SSDBM07_2.pdf
-#     https://www.intel.com/content/www/us/en/docs/onemkl/developer-reference-summary-statistics-notes/2021-1/computing-quantiles-with-vsl-ss-method-squants-zw.html
+# can be made, and the error is controlled by this epsilon (eps) value: the rank of
+# every quantile is within eps times the number of pixels of its exact rank.
+# The raster is split into parts which are sketched in parallel, and the sketches are
+# merged in order (so the result doesn't depend on thread_count), using the compactor
+# method of Manku et al. (the deterministic form of KLL):
+#     https://dl.acm.org/doi/10.1145/276305.276342
+#     https://arxiv.org/abs/1603.05346
 #
 # Additionally, the 'plot' parameter determines whether a histogram plot will be made of the
 # stratified bands. The histogram will be the distribution of each of the raster bands which
@@ -83,6 +86,16 @@ GIGABYTE = 1073741824
 # parameter indicates the number of bands in each of the plotted histograms.
 #
 # The 'info' parameter, when true, prints the quantile values of each raster band.
+#
+# The 'overview' parameter estimates the quantiles from an overview of the raster (see
+# SpatialRaster.overview()) rather than every pixel, while still stratifying every pixel.
+# For a large or remote raster this avoids reading the whole raster twice. If the overview
+# was built with nearest neighbour resampling its pixels are a regular subsample of the
+# raster, and with n overview pixels the rank of each quantile is within about
+# sqrt(ln(2 / a) / 2n) of its exact rank (as a fraction of the pixels) with probability
+# 1 - a, for example 0.0006 with n = 4 million and a = .05, in addition to the error
+# controlled by eps. Overviews built by averaging pull the outer quantiles toward the
+# median, and have no such bound.
 # 
 # Examples
 # --------------------
@@ -120,6 +133,8 @@ GIGABYTE = 1073741824
 #     The number of bins in the plotted histogram. @n @n
 # info : Optional[bool] @n
 #     when true, plot quantile values of each band after calculation @n @n
+# overview : Optional[int] @n
+#     the overview level to estimate the quantiles from, or None to use every pixel @n @n
 # 
 # Returns
 # --------------------
@@ -134,7 +149,8 @@ def quantiles(
     eps: float = .001,
     plot: Optional[bool] = None,
     histogram_bins: Optional[int] = None,
-    info: Optional[bool] = None):
+    info: Optional[bool] = None,
+    overview: Optional[int] = None):
     
     MAX_STRATA_VAL = 2147483647 #maximum value stored within a 32-bit signed integer to ensure no overflow
     
@@ -171,6 +187,12 @@ def quantiles(
     if info is not None and type(info) is not bool:
         raise TypeError("'info' parameter, if given, must be of type bool.")
 
+    if overview is not None and type(overview) is not int:
+        raise TypeError("'overview' parameter, if given, must be of type int.")
+
+    if overview is not None and (overview < 0 or overview >= rast.overview_count):
+        raise ValueError("'overview' must be between 0 and " + str(rast.overview_count - 1) + ", the raster has " + str(rast.overview_count) + " overviews.")
+
     probabilities_dict = {}
     if type(quantiles) is int:
         #error check number of raster bands
@@ -293,7 +315,8 @@ def quantiles(
         large_raster,
         thread_count,
         driver_options_str,
-        eps
+        eps,
+        -1 if overview is None else overview
     )
 
     srast = SpatialRaster(srast)
@@ -316,7 +339,7 @@ def quantiles(
         bin_count = histogram_bins if histogram_bins is not None else 50
 
         for band, vals in quantile_vals.items():
-            result = dist_cpp(rast.cpp_raster, rast.bands.index(band), cpp_vector, layer, bin_count, thread_count)
+            result = dist_cpp(rast.cpp_raster, rast.bands.index(band), cpp_vector, layer, bin_count, False, False, thread_count)
             [bins, counts] = result["population"]
             freq = counts / np.sum(counts)
             bin_size = bins[1] - bins[0]
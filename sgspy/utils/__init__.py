@@ -5,16 +5,27 @@
 # Explanations of both the SpatialRaster and SpatialVector classes.
 
 from . import (
+    profiling,
     raster,
     vector,
 )
 
 from .raster import SpatialRaster
 from .raster import StratRasterBandMetadata
+from .raster import set_remote_read_options
+from .raster import set_memory_limit
+from .raster import memory_usage
 from .vector import SpatialVector
+from .profiling import profile
+from .profiling import write_trace
 
 __all__ = [
     "SpatialRaster",
     "StratRasterBandMetadata",
+    "set_remote_read_options",
+    "set_memory_limit",
+    "memory_usage",
+    "profile",
+    "write_trace",
     "spatialVector",
 ]
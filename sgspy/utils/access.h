@@ -14,8 +14,12 @@
 
 #pragma once
 
+#include <cstring>
+#include <mutex>
+
 #include "helper.h"
 #include "raster.h"
+#include "rasterize.h"
 #include "vector.h"
 #include "gdal_utils.h"
 
@@ -37,28 +41,35 @@ struct Access {
 	* This constructor is responsible for setting the used, area, p_dataset, and band
 	* members of this struct. In the case where an access vector is given, the dataset
 	* which contain a raster dataset with a rasterized version of the access, where a
-	* pixel is '1' if it falls within accessible area.
+	* pixel is '1' if it falls outside of the accessible area.
 	*
 	* First, if p_vector is not given, then the 'used' member remains false.
 	*
 	* If p_vector is given, it is checked to ensure it has the same spatial reference
-	* system as the p_raster. Polygons are created such that The polygons contain
-	* the accessible area. This is done by buffering the linestrings in the access
-	* vector using buff_outer, and removing the buff_inner buffer.
+	* system as the p_raster. The accessible area is the area within buff_outer of
+	* the linestrings in the access vector, but not within buff_inner.
+	*
+	* The union of the buffers of every linestring is never built. Instead, each
+	* linestring (or part of a multilinestring) is inserted into a rasterize::TileIndex
+	* over tiles of the raster, using its envelope expanded by the buffer distance.
+	* The tiles are then processed in parallel, where a tile:
+	* 	- clips only the linestrings which may intersect it to the tile (expanded
+	* 	  by the buffer distance, so that the clipped buffers are exact within the tile).
+	* 	- buffers the clipped linestrings, and takes the cascaded union of the
+	* 	  outer buffers, removing the cascaded union of the inner buffers.
+	* 	- adds the area of the mask within the tile to the accessible area.
+	* 	- rasterizes the inverse of the mask with a burn value of 1 and all
+	* 	  touched set, exactly as GDALRasterize() -at would over the whole raster.
+	* 	- writes the tile to an Int8 GTiff in the temporary folder.
 	*
-	* A vector is created usign the output polygons from this calculation. Then,
-	* GDALRasterize() is called specifying:
-	* -at					(all touched -- sets all pixels touched by polygon)
-	* -burn 1 				(setting the burn value to 1)
-	* -l access 				(specifying the layer name in the polygon dataset as 'access')
-	* -te {xmin} {ymin} {xmax} {ymax}	(setting the extent to the raster extent)
-	* -ts {width} {height}			(setting the dimensions to the raster dimensions)
-	* -ot Int8				(setting the output type to int8_t)
+	* A tile with no linestrings near it is entirely inaccessible, and is written
+	* without rasterizing anything. As a result, the size of the geometries any
+	* one union is taken over is bounded by the tile size regardless of the size
+	* of the access network.
 	*
-	* The resulting raster dataset created by the GDALRasterize() function is then
-	* checked by sampling functions to ensure their samples fall within accessible
-	* areas. The 'band' parameter's metadata is set according to the output raster
-	* dataset.
+	* The resulting raster dataset is then checked by sampling functions to ensure
+	* their samples fall within accessible areas. The 'band' parameter's metadata
+	* is set according to the output raster dataset.
 	*
 	* @param GDALVectorWrapper *p_vector
 	* @param GDALRasterWrapper *p_raster
@@ -69,6 +80,7 @@ struct Access {
 	* @param std::string tempFolder
 	* @param int xBlockSize
 	* @param int yBlockSize
+	* @param int threads
 	*/
 	Access(vector::GDALVectorWrapper *p_vector,
 	       raster::GDALRasterWrapper *p_raster,
@@ -78,7 +90,8 @@ struct Access {
 	       bool largeRaster,
 	       std::string tempFolder,
 	       int xBlockSize,
-	       int yBlockSize) 
+	       int yBlockSize,
+	       int threads = 1) 
 	{
 		if (!p_vector) {
 			return;
@@ -93,10 +106,9 @@ struct Access {
 			throw std::runtime_error("access vector and raster do not have the same spatial reference system.");
 		}
 
-		//step 1: create multipolygon buffers
-		OGRMultiPolygon *buffInnerPolygons = new OGRMultiPolygon;
-		OGRMultiPolygon *buffOuterPolygons = new OGRMultiPolygon;
-		OGRGeometry *p_polygonMask;
+		int width = p_raster->getWidth();
+		int height = p_raster->getHeight();
+		double *GT = p_raster->getGeotransform();
 	
 		//occasionally, samples end up being placed just outside the accessible area,
 		//typically when the buffer sizes are multiples of the pixel size. 
@@ -105,175 +117,213 @@ struct Access {
 		double pixelSize = std::min(p_raster->getPixelHeight(), p_raster->getPixelWidth());
 		buffOuter = buffOuter - pixelSize / 50;
 		buffInner = buffInner == 0 ? 0 : buffInner + pixelSize / 50;
+		double buffMax = std::max(buffOuter, buffInner);
+
+		//step 1: index every linestring by the tiles it's buffer may intersect
+		int xTileSize = rasterize::tileSize(xBlockSize, width);
+		int yTileSize = rasterize::tileSize(yBlockSize, height);
+		rasterize::TileIndex index(GT, width, height, xTileSize, yTileSize);
+		std::vector<OGRGeometry *> lines;
+
+		auto addLine = [&](OGRGeometry *p_line) {
+			OGREnvelope env;
+			p_line->getEnvelope(&env);
+			index.insert(lines.size(), env, buffMax);
+			lines.push_back(p_line->clone());
+		};
 
-		//step 2: add geometries to access polygon buffers
-		for (const auto& p_feature : *p_vector->getLayer(layerName.c_str())) {
+		for (const auto& p_feature : *p_inputLayer) {
 			OGRGeometry *p_geometry = p_feature->GetGeometryRef();
 			OGRwkbGeometryType type = wkbFlatten(p_geometry->getGeometryType());
 	
 			switch (type) {
 				case OGRwkbGeometryType::wkbLineString: {
-					OGRGeometry *p_outer = p_geometry->Buffer(buffOuter);
-					buffOuterPolygons->addGeometry(p_outer);
-					OGRGeometryFactory::destroyGeometry(p_outer);	
-	
-					if (buffInner != 0) {
-						OGRGeometry *p_inner = p_geometry->Buffer(buffInner);
-						buffInnerPolygons->addGeometry(p_inner);
-						OGRGeometryFactory::destroyGeometry(p_inner);
-					}
+					addLine(p_geometry);
 					break;
 				}
 				case OGRwkbGeometryType::wkbMultiLineString: {
 					for (const auto& p_lineString : *p_geometry->toMultiLineString()) {
-						OGRGeometry *p_outer = p_lineString->Buffer(buffOuter);
-						buffOuterPolygons->addGeometry(p_outer);
-						OGRGeometryFactory::destroyGeometry(p_outer);	
-	
-						if (buffInner != 0) {
-							OGRGeometry *p_inner = p_lineString->Buffer(buffInner);
-							buffInnerPolygons->addGeometry(p_inner);
-							OGRGeometryFactory::destroyGeometry(p_inner);
-						}
+						addLine(p_lineString);
 					}
-	
 					break;
 				}
 				default: {
+					for (OGRGeometry *p_line : lines) {
+						OGRGeometryFactory::destroyGeometry(p_line);
+					}
 					throw std::runtime_error("geometry type must be LineString or MultiLineString");
 				}
 			}
 		}	
-	
-		//step 3: generate the polygon mask and free no longer used memory
-		if (buffInner == 0) {
-			p_polygonMask = buffOuterPolygons->UnionCascaded();
-		}
-		else {
-			OGRGeometry *buffOuterUnion = buffOuterPolygons->UnionCascaded();
-			OGRGeometry *buffInnerUnion = buffInnerPolygons->UnionCascaded();
-			p_polygonMask = buffOuterUnion->Difference(buffInnerUnion);
-			OGRGeometryFactory::destroyGeometry(buffOuterUnion);
-			OGRGeometryFactory::destroyGeometry(buffInnerUnion);	
-		}
-		delete buffOuterPolygons;
-		delete buffInnerPolygons;
 
-		//update area to contain the total accessible are within the raster	
-		this->area = 0;
-		OGRPolygon extent(p_raster->getXMin(), p_raster->getYMin(), p_raster->getXMax(), p_raster->getYMax());
-		OGRGeometry *p_polygonWithinExtent;
-		OGRwkbGeometryType geomtype = p_polygonMask->getGeometryType();
-		if (geomtype == wkbPolygon) {
-			p_polygonWithinExtent = p_polygonMask->toPolygon()->Intersection(&extent);
+		//step 2: create the access mask dataset, tiled if the block size allows it
+		std::filesystem::path path = tempFolder;
+		path = path / "access.tif";
+
+		this->band.type = GDT_Int8;
+		this->band.size = sizeof(int8_t);
+		this->band.name = "access";
+		this->band.xBlockSize = xBlockSize;
+		this->band.yBlockSize = yBlockSize;
+		bool useTiles = xBlockSize % 16 == 0 && yBlockSize % 16 == 0;
+		std::map<std::string, std::string> driverOptions;
+		this->p_dataset = helper::createDataset(
+			path.string(),
+			"GTiff",
+			width,
+			height,
+			GT,
+			rastProj,
+			&this->band,
+			1,
+			useTiles,
+			driverOptions
+		);
+
+		//step 3: build, rasterize, and write the mask of every tile in parallel
+		threads = std::max(1, threads);
+		std::vector<double> areas(rasterize::tileChunks(height, yTileSize, threads), 0);
+		std::mutex writeMutex;
+
+		try {
+			rasterize::forEachTile(width, height, xTileSize, yTileSize, threads, [&](const reader::Window& window, int chunk) {
+				std::vector<int8_t> buffer(static_cast<size_t>(xTileSize) * yTileSize, 1);
+				const std::vector<size_t>& ids = index.query(window);
+
+				if (!ids.empty()) {
+					areas[chunk] += this->processTile(buffer.data(), window, GT, width, height, xTileSize, ids, lines, buffInner, buffOuter, buffMax);
+				}
+
+				std::lock_guard<std::mutex> lock(writeMutex);
+				helper::rasterBandIO(this->band, buffer.data(), xTileSize, yTileSize, window.xBlock, window.yBlock, window.xValid, window.yValid, false, false);
+			});
 		}
-		else if (geomtype == wkbMultiPolygon) {
-			p_polygonWithinExtent = p_polygonMask->toMultiPolygon()->Intersection(&extent);
+		catch (...) {
+			for (OGRGeometry *p_line : lines) {
+				OGRGeometryFactory::destroyGeometry(p_line);
+			}
+			throw;
 		}
-		else {
-			throw std::runtime_error("p_polygonMask is not a polygon or a multipolygon!");
+
+		//step 4: free dynamically allocated data
+		for (OGRGeometry *p_line : lines) {
+			OGRGeometryFactory::destroyGeometry(p_line);
 		}
 
-		geomtype = p_polygonWithinExtent->getGeometryType();
-		if (geomtype == wkbPolygon) {
-			this->area += p_polygonWithinExtent->toPolygon()->toUpperClass()->get_Area();
+		this->area = 0;
+		for (double chunkArea : areas) {
+			this->area += chunkArea;
 		}
-		else if (geomtype == wkbMultiPolygon) {
-			for (const auto& p_polygon : *p_polygonWithinExtent->toMultiPolygon()) {
-				this->area += p_polygon->toUpperClass()->get_Area();
+
+		this->p_dataset->FlushCache();
+		this->band.p_band->GetBlockSize(&this->band.xBlockSize, &this->band.yBlockSize);
+		this->used = true;
+	}
+
+	/**
+	 * Build the access mask of a single tile from the linestrings which may
+	 * intersect it, and rasterize the inaccessible area into the tile buffer
+	 * (which is initialized as entirely inaccessible).
+	 *
+	 * The mask is built over the tile expanded by one pixel, so that pixels on
+	 * the edge of the tile which are touched by an inaccessible area just outside
+	 * of it are still set, as they would be rasterizing the whole raster at once.
+	 *
+	 * @param int8_t *p_buffer
+	 * @param const reader::Window& window
+	 * @param double *GT
+	 * @param int width
+	 * @param int height
+	 * @param int xTileSize
+	 * @param const std::vector<size_t>& ids
+	 * @param std::vector<OGRGeometry *>& lines
+	 * @param double buffInner
+	 * @param double buffOuter
+	 * @param double buffMax
+	 * @returns double the accessible area within the tile
+	 */
+	double processTile(
+		int8_t *p_buffer,
+		const reader::Window& window,
+		double *GT,
+		int width,
+		int height,
+		int xTileSize,
+		const std::vector<size_t>& ids,
+		std::vector<OGRGeometry *>& lines,
+		double buffInner,
+		double buffOuter,
+		double buffMax)
+	{
+		OGREnvelope tileEnv = rasterize::tileEnvelope(GT, window, width, height, 0);
+		OGREnvelope maskEnv = rasterize::tileEnvelope(GT, window, width, height, 1);
+		OGRPolygon tile(tileEnv.MinX, tileEnv.MinY, tileEnv.MaxX, tileEnv.MaxY);
+		OGRPolygon maskExtent(maskEnv.MinX, maskEnv.MinY, maskEnv.MaxX, maskEnv.MaxY);
+		OGRPolygon clip(maskEnv.MinX - buffMax, maskEnv.MinY - buffMax, maskEnv.MaxX + buffMax, maskEnv.MaxY + buffMax);
+
+		OGRMultiPolygon buffOuterPolygons;
+		OGRMultiPolygon buffInnerPolygons;
+		for (size_t id : ids) {
+			OGRGeometry *p_clipped = lines[id]->Intersection(&clip);
+			if (!p_clipped || p_clipped->IsEmpty()) {
+				OGRGeometryFactory::destroyGeometry(p_clipped);
+				continue;
+			}
+
+			OGRGeometry *p_outer = p_clipped->Buffer(buffOuter);
+			rasterize::addPolygons(buffOuterPolygons, p_outer);
+			OGRGeometryFactory::destroyGeometry(p_outer);
+
+			if (buffInner != 0) {
+				OGRGeometry *p_inner = p_clipped->Buffer(buffInner);
+				rasterize::addPolygons(buffInnerPolygons, p_inner);
+				OGRGeometryFactory::destroyGeometry(p_inner);
 			}
+			OGRGeometryFactory::destroyGeometry(p_clipped);
 		}
-		else {
-			throw std::runtime_error("taking the intersection of polygons somehow resulted in something not a polygon! This is a bug.");
+
+		if (buffOuterPolygons.getNumGeometries() == 0) {
+			return 0;
 		}
 
-		//invert polygon mask
-		OGRGeometry *p_invertedMask = extent.Difference(p_polygonMask);
-
-		//step 4: create new GDAL dataset to rasterize as access mask
-		GDALDataset *p_accessPolygonDataset = GetGDALDriverManager()->GetDriverByName("MEM")->Create(
-			"",
-			0,
-			0,
-			0,
-			GDT_Unknown,
-			nullptr
-		);
-	
-		OGRLayer *p_layer = p_accessPolygonDataset->CreateLayer(
-			"access", 
-			p_vector->getLayer(layerName.c_str())->GetSpatialRef(), 
-			p_invertedMask->getGeometryType(), 
-			nullptr
-		);
-		OGRFieldDefn field("index", OFTInteger);
-		p_layer->CreateField(&field);
-		
-		//step 6: add the access polygon to the new layer
-		OGRFeature *p_feature = OGRFeature::CreateFeature(p_layer->GetLayerDefn());
-		p_feature->SetField("index", 0);
-		p_feature->SetGeometry(p_invertedMask);
-		p_layer->CreateFeature(p_feature); //error handling here???
-		OGRFeature::DestroyFeature(p_feature);
-	
-		std::filesystem::path path = tempFolder;
-		path = path / "access.tif";
+		OGRGeometry *p_polygonMask = buffOuterPolygons.UnionCascaded();
+		if (buffInnerPolygons.getNumGeometries() != 0) {
+			OGRGeometry *p_buffInnerUnion = buffInnerPolygons.UnionCascaded();
+			OGRGeometry *p_difference = p_polygonMask->Difference(p_buffInnerUnion);
+			OGRGeometryFactory::destroyGeometry(p_polygonMask);
+			OGRGeometryFactory::destroyGeometry(p_buffInnerUnion);
+			p_polygonMask = p_difference;
+		}
+		if (!p_polygonMask) {
+			throw std::runtime_error("unable to generate access polygon mask.");
+		}
 
-		//step 9: generate options list for rasterization	
-		char **argv = nullptr;
+		OGRGeometry *p_polygonWithinTile = p_polygonMask->Intersection(&tile);
+		double area = rasterize::area(p_polygonWithinTile);
+		OGRGeometryFactory::destroyGeometry(p_polygonWithinTile);
 
-		//specify 'all touched'
-		argv = CSLAddString(argv, "-at");
+		//invert polygon mask, and burn the inaccessible area
+		OGRGeometry *p_invertedMask = maskExtent.Difference(p_polygonMask);
+		OGRGeometryFactory::destroyGeometry(p_polygonMask);
 
-		//specify the burn value for the polygon
-		argv = CSLAddString(argv, "-burn");
-		argv = CSLAddString(argv, std::to_string(1).c_str());
-	
-		//specify the layer
-		argv = CSLAddString(argv, "-l");
-		argv = CSLAddString(argv, "access");
-
-		//specify extent
-		argv = CSLAddString(argv, "-te");
-		argv = CSLAddString(argv, std::to_string(p_raster->getXMin()).c_str());
-		argv = CSLAddString(argv, std::to_string(p_raster->getYMin()).c_str());
-		argv = CSLAddString(argv, std::to_string(p_raster->getXMax()).c_str());
-		argv = CSLAddString(argv, std::to_string(p_raster->getYMax()).c_str());
-	
-		//specify dimensions
-		argv = CSLAddString(argv, "-ts");
-		argv = CSLAddString(argv, std::to_string(p_raster->getWidth()).c_str());
-		argv = CSLAddString(argv, std::to_string(p_raster->getHeight()).c_str());
-
-		//specify output type
-		argv = CSLAddString(argv, "-ot");
-		argv = CSLAddString(argv, "Int8");
-
-		GDALRasterizeOptions *options = GDALRasterizeOptionsNew(argv, nullptr);
-
-		//step 10: rasterize vector creating in-memory dataset
-		this->p_dataset = GDALDataset::FromHandle(GDALRasterize(
-			path.string().c_str(),
-			nullptr,
-			p_accessPolygonDataset,
-			options,
-			nullptr
-		));
-
-		this->band.p_band = this->p_dataset->GetRasterBand(1);
-		this->band.type = GDT_Int8;
-		this->band.size = sizeof(int8_t);
-		this->band.p_band->GetBlockSize(&this->band.xBlockSize, &this->band.yBlockSize);
+		for (int y = 0; y < window.yValid; y++) {
+			std::memset(p_buffer + static_cast<size_t>(y) * xTileSize, 0, window.xValid);
+		}
 
-		//step 11: free dynamically allocated data
-		GDALRasterizeOptionsFree(options);
-		CSLDestroy(argv);
-		GDALClose(GDALDataset::ToHandle(p_accessPolygonDataset));
-		OGRGeometryFactory::destroyGeometry(p_polygonMask);
-		OGRGeometryFactory::destroyGeometry(p_polygonWithinExtent);
+		if (p_invertedMask && !p_invertedMask->IsEmpty()) {
+			std::vector<OGRGeometryH> geometries = {OGRGeometry::ToHandle(p_invertedMask)};
+			std::vector<double> burnValues = {1};
+			try {
+				rasterize::burnTile(p_buffer, GDT_Int8, sizeof(int8_t), window, xTileSize, GT, geometries, burnValues, true);
+			}
+			catch (...) {
+				OGRGeometryFactory::destroyGeometry(p_invertedMask);
+				throw;
+			}
+		}
 		OGRGeometryFactory::destroyGeometry(p_invertedMask);
 
-		this->used = true;
+		return area;
 	}
 
 	~Access() {
@@ -0,0 +1,363 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: process wide memory budget for in-memory raster band buffers
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup budget budget
+ * @ingroup utils
+ *
+ * Accounting of the raster band buffers which GDALRasterWrappers hold in memory
+ * (full resolution bands, and the downsampled bands used for plotting), with a
+ * configurable limit on the total bytes across the whole process.
+ *
+ * Every buffer is an entry in a least recently used list. When the total size of
+ * the entries is over the limit, the least recently used entries are evicted by
+ * calling back into their owner, which either frees the buffer (to be read again
+ * from the dataset if it's required later) or, if the dataset itself is in memory,
+ * first spills the dataset to temporary files.
+ *
+ * A buffer may be pinned while something outside of the owner refers to it. The
+ * memoryviews returned to Python pin their buffer until the numpy arrays using
+ * them are garbage collected, and pinned buffers are never evicted.
+ *
+ * Eviction only happens outside of an Operation. Every C++ function called from
+ * Python which may use band buffers runs as an Operation, so buffers are never
+ * evicted while a function holds a pointer to them. When the last Operation ends,
+ * the buffers are trimmed back down to the limit.
+ *
+ * By default there is no limit, and nothing is ever evicted.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace sgs {
+namespace budget {
+
+/**
+ * @ingroup budget
+ * Interface of the owner of band buffers which may be evicted.
+ */
+class Evictable {
+	public:
+	virtual ~Evictable() = default;
+
+	/**
+	 * Release the buffer of a band. Returns false if the buffer could not
+	 * be released, in which case it remains tracked.
+	 *
+	 * @param int band
+	 * @param bool display
+	 * @returns bool
+	 */
+	virtual bool evictBuffer(int band, bool display) = 0;
+};
+
+/**
+ * @ingroup budget
+ * The LRU list and byte accounting of every tracked band buffer. Entries are keyed
+ * by a unique owner id rather than the owners address, so that stale pins from an
+ * owner which has been destroyed can never refer to a different owner.
+ */
+class BufferManager {
+	private:
+	typedef std::tuple<uint64_t, int, bool> Key;
+
+	struct Entry {
+		Evictable *p_owner = nullptr;
+		size_t bytes = 0;
+		int pins = 0;
+		std::list<Key>::iterator position;
+	};
+
+	std::mutex mutex;
+	std::map<Key, Entry> entries;
+	std::list<Key> lru; //most recently used first
+	size_t limit = 0;
+	size_t used = 0;
+	int operations = 0;
+	int64_t evictions = 0;
+
+	/**
+	 * Remove and return the least recently used unpinned entries, until the total
+	 * size is within the limit. Must be called with the mutex locked.
+	 *
+	 * @returns std::vector<std::pair<Key, Entry>>
+	 */
+	std::vector<std::pair<Key, Entry>> takeVictims() {
+		std::vector<std::pair<Key, Entry>> victims;
+		if (this->limit == 0 || this->operations > 0) {
+			return victims;
+		}
+
+		auto it = this->lru.end();
+		while (this->used > this->limit && it != this->lru.begin()) {
+			it--;
+			Entry& entry = this->entries.at(*it);
+			if (entry.pins > 0) {
+				continue;
+			}
+
+			Key key = *it;
+			victims.push_back({key, entry});
+			this->used -= entry.bytes;
+			it = this->lru.erase(it);
+			this->entries.erase(key);
+		}
+		return victims;
+	}
+
+	public:
+	/**
+	 * Track a newly allocated buffer as the most recently used.
+	 *
+	 * @param uint64_t owner id
+	 * @param Evictable *p_owner
+	 * @param int band
+	 * @param bool display
+	 * @param size_t bytes
+	 */
+	void track(uint64_t id, Evictable *p_owner, int band, bool display, size_t bytes) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		Key key = {id, band, display};
+		auto it = this->entries.find(key);
+		if (it != this->entries.end()) {
+			this->used -= it->second.bytes;
+			this->lru.erase(it->second.position);
+			this->entries.erase(it);
+		}
+
+		this->lru.push_front(key);
+		Entry& entry = this->entries[key];
+		entry.p_owner = p_owner;
+		entry.bytes = bytes;
+		entry.position = this->lru.begin();
+		this->used += bytes;
+	}
+
+	/**
+	 * Stop tracking a buffer, because it has been freed or handed to something else.
+	 *
+	 * @param uint64_t owner id
+	 * @param int band
+	 * @param bool display
+	 */
+	void untrack(uint64_t id, int band, bool display) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->entries.find({id, band, display});
+		if (it != this->entries.end()) {
+			this->used -= it->second.bytes;
+			this->lru.erase(it->second.position);
+			this->entries.erase(it);
+		}
+	}
+
+	/**
+	 * Stop tracking every buffer of an owner.
+	 *
+	 * @param uint64_t owner id
+	 */
+	void untrackAll(uint64_t id) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->entries.lower_bound({id, std::numeric_limits<int>::min(), false});
+		while (it != this->entries.end() && std::get<0>(it->first) == id) {
+			this->used -= it->second.bytes;
+			this->lru.erase(it->second.position);
+			it = this->entries.erase(it);
+		}
+	}
+
+	/**
+	 * Mark a buffer as the most recently used.
+	 *
+	 * @param uint64_t owner id
+	 * @param int band
+	 * @param bool display
+	 */
+	void touch(uint64_t id, int band, bool display) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->entries.find({id, band, display});
+		if (it != this->entries.end()) {
+			this->lru.splice(this->lru.begin(), this->lru, it->second.position);
+		}
+	}
+
+	/**
+	 * Pin a buffer (and mark it as the most recently used) so it isn't evicted.
+	 *
+	 * @param uint64_t owner id
+	 * @param int band
+	 * @param bool display
+	 */
+	void pin(uint64_t id, int band, bool display) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->entries.find({id, band, display});
+		if (it != this->entries.end()) {
+			it->second.pins++;
+			this->lru.splice(this->lru.begin(), this->lru, it->second.position);
+		}
+	}
+
+	/**
+	 * Release a pin made by pin(). The buffer may be evicted once it has no pins.
+	 *
+	 * @param uint64_t owner id
+	 * @param int band
+	 * @param bool display
+	 */
+	void unpin(uint64_t id, int band, bool display) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->entries.find({id, band, display});
+		if (it != this->entries.end() && it->second.pins > 0) {
+			it->second.pins--;
+		}
+	}
+
+	/**
+	 * Begin an Operation, during which nothing is evicted.
+	 */
+	void begin() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->operations++;
+	}
+
+	/**
+	 * End an Operation, trimming the buffers if it was the last.
+	 */
+	void end() {
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->operations--;
+		}
+		this->trim();
+	}
+
+	/**
+	 * Evict the least recently used unpinned buffers until the total size of the
+	 * buffers is within the limit. The owners are called without the mutex locked,
+	 * since evicting a buffer may untrack (or track) others. Buffers which their
+	 * owner is unable to evict are tracked again as the most recently used, so
+	 * they aren't tried again immediately.
+	 */
+	void trim() {
+		std::vector<std::pair<Key, Entry>> victims;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			victims = this->takeVictims();
+		}
+
+		for (auto& [key, entry] : victims) {
+			auto [id, band, display] = key;
+			if (entry.p_owner->evictBuffer(band, display)) {
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->evictions++;
+			}
+			else {
+				this->track(id, entry.p_owner, band, display, entry.bytes);
+			}
+		}
+	}
+
+	/**
+	 * Set the limit in bytes of the total size of the buffers, 0 for no limit.
+	 *
+	 * @param size_t limit
+	 */
+	void setLimit(size_t limit) {
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->limit = limit;
+		}
+		this->trim();
+	}
+
+	/**
+	 * @returns std::tuple<size_t, size_t, size_t, size_t, int64_t> the limit, the total
+	 * bytes of the buffers, the number of buffers, the bytes of the pinned buffers, and
+	 * the number of buffers evicted so far.
+	 */
+	std::tuple<size_t, size_t, size_t, size_t, int64_t> usage() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		size_t pinned = 0;
+		for (const auto& [key, entry] : this->entries) {
+			pinned += entry.pins > 0 ? entry.bytes : 0;
+		}
+		return {this->limit, this->used, this->entries.size(), pinned, this->evictions};
+	}
+};
+
+/**
+ * @ingroup budget
+ * @returns BufferManager& the process wide buffer manager
+ */
+inline BufferManager&
+manager() {
+	static BufferManager instance;
+	return instance;
+}
+
+/**
+ * @ingroup budget
+ * @returns uint64_t a unique id for an owner of buffers
+ */
+inline uint64_t
+nextId() {
+	static std::atomic<uint64_t> id = 0;
+	return ++id;
+}
+
+/**
+ * @ingroup budget
+ * Scope during which no buffers are evicted. Used as a pybind11 call guard on
+ * the functions which use band buffers, so it's constructed and destroyed with the
+ * GIL held.
+ */
+class Operation {
+	public:
+	Operation() {
+		manager().begin();
+	}
+
+	~Operation() {
+		manager().end();
+	}
+
+	Operation(const Operation&) = delete;
+	Operation& operator=(const Operation&) = delete;
+};
+
+/**
+ * @ingroup budget
+ * Set the process wide limit in bytes of in-memory band buffers, 0 for no limit.
+ *
+ * @param size_t limit
+ */
+inline void
+setLimit(size_t limit) {
+	manager().setLimit(limit);
+}
+
+/**
+ * @ingroup budget
+ * @returns std::tuple<size_t, size_t, size_t, size_t, int64_t> see BufferManager::usage()
+ */
+inline std::tuple<size_t, size_t, size_t, size_t, int64_t>
+usage() {
+	return manager().usage();
+}
+
+} //namespace budget
+} //namespace sgs
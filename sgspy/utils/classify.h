@@ -0,0 +1,441 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: vectorized classification of pixels into strata using sorted breaks
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup classify classify
+ * @ingroup utils
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <vector>
+
+//the AVX2 and AVX-512 kernels are compiled with function level target attributes and
+//chosen at runtime, which GCC and Clang support on x86. Other compilers and architectures
+//only use the portable kernel.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CLASSIFY_RUNTIME_DISPATCH 1
+#include <immintrin.h>
+#else
+#define CLASSIFY_RUNTIME_DISPATCH 0
+#endif
+
+#include <gdal_priv.h>
+
+#include "utils/helper.h"
+
+/**
+ * @ingroup classify
+ * The number of pixels converted and classified at a time. The tile buffers
+ * are kept on the stack so they stay in L1 cache.
+ */
+#define CLASSIFY_TILE_SIZE 256
+
+/**
+ * @ingroup classify
+ * The largest number of breaks which are compared linearly against every pixel.
+ * Comparing against every break is branchless and vectorizes, but past this many
+ * breaks a binary search per pixel does less work.
+ */
+#define CLASSIFY_LINEAR_MAX_BREAKS 64
+
+namespace sgs {
+namespace classify {
+
+#if CLASSIFY_RUNTIME_DISPATCH
+/**
+ * @ingroup classify
+ * The AVX-512 kernel of countBreaks(), which compares 8 values at a time against every
+ * break. Returns the number of values processed, which is a multiple of 8.
+ *
+ * @param const double *p_vals
+ * @param int32_t *p_counts
+ * @param size_t n
+ * @param const double *p_breaks
+ * @param size_t nBreaks
+ * @returns size_t
+ */
+__attribute__((target("avx512f"))) inline size_t
+countBreaksAVX512(
+	const double *p_vals,
+	int32_t *p_counts,
+	size_t n,
+	const double *p_breaks,
+	size_t nBreaks)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m512d vals = _mm512_loadu_pd(p_vals + i);
+		__m512i counts = _mm512_setzero_si512();
+		__m512i ones = _mm512_set1_epi64(1);
+		for (size_t b = 0; b < nBreaks; b++) {
+			__mmask8 greater = _mm512_cmp_pd_mask(vals, _mm512_set1_pd(p_breaks[b]), _CMP_GT_OQ);
+			counts = _mm512_mask_add_epi64(counts, greater, counts, ones);
+		}
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(p_counts + i), _mm512_maskz_cvtepi64_epi32(0xFF, counts));
+	}
+	return i;
+}
+
+/**
+ * @ingroup classify
+ * The AVX2 kernel of countBreaks(), which compares 4 values at a time against every
+ * break. Returns the number of values processed, which is a multiple of 4.
+ *
+ * @param const double *p_vals
+ * @param int32_t *p_counts
+ * @param size_t n
+ * @param const double *p_breaks
+ * @param size_t nBreaks
+ * @returns size_t
+ */
+__attribute__((target("avx2"))) inline size_t
+countBreaksAVX2(
+	const double *p_vals,
+	int32_t *p_counts,
+	size_t n,
+	const double *p_breaks,
+	size_t nBreaks)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d vals = _mm256_loadu_pd(p_vals + i);
+		__m256i counts = _mm256_setzero_si256();
+		for (size_t b = 0; b < nBreaks; b++) {
+			//the comparison mask is all ones (-1) in lanes where the value is greater than the break
+			__m256d greater = _mm256_cmp_pd(vals, _mm256_set1_pd(p_breaks[b]), _CMP_GT_OQ);
+			counts = _mm256_sub_epi64(counts, _mm256_castpd_si256(greater));
+		}
+
+		//pack the low 32 bits of each 64 bit lane
+		__m256i packed = _mm256_permutevar8x32_epi32(counts, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(p_counts + i), _mm256_castsi256_si128(packed));
+	}
+	return i;
+}
+
+/**
+ * @ingroup classify
+ * The instruction sets a countBreaks() kernel may use.
+ */
+enum class Isa { Portable, AVX2, AVX512 };
+
+/**
+ * @ingroup classify
+ * Determine the widest kernel the CPU running the module supports. This is only
+ * checked once, the first time it's called.
+ *
+ * @returns Isa
+ */
+inline Isa
+supportedIsa(void) {
+	static const Isa isa = [] {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) {
+			return Isa::AVX512;
+		}
+		if (__builtin_cpu_supports("avx2")) {
+			return Isa::AVX2;
+		}
+		return Isa::Portable;
+	}();
+	return isa;
+}
+#endif
+
+/**
+ * @ingroup classify
+ * This function counts the number of breaks which are strictly less than each value
+ * in a tile. Since the breaks are sorted, this is the index of the lower bound of the
+ * value within the breaks, which is the strata of the value.
+ *
+ * When built with GCC or Clang for x86, the values are compared against every break 8
+ * or 4 at a time by an AVX-512 or AVX2 kernel, chosen at runtime by supportedIsa() so the
+ * module still runs on CPUs without them. Otherwise (and for the values left over at the
+ * end of the tile) the loops are written so that the compiler is able to auto-vectorize them
+ * using the instruction set the build targets. If there are more than CLASSIFY_LINEAR_MAX_BREAKS
+ * breaks, std::lower_bound is used instead.
+ *
+ * nan values are never greater than a break, so they are given a count of 0. They are
+ * masked by the caller.
+ *
+ * @param const double *p_vals
+ * @param int32_t *p_counts
+ * @param size_t n
+ * @param const double *p_breaks
+ * @param size_t nBreaks
+ */
+inline void
+countBreaks(
+	const double *p_vals,
+	int32_t *p_counts,
+	size_t n,
+	const double *p_breaks,
+	size_t nBreaks)
+{
+	if (nBreaks > CLASSIFY_LINEAR_MAX_BREAKS) {
+		for (size_t i = 0; i < n; i++) {
+			p_counts[i] = std::isnan(p_vals[i]) ? 0 : static_cast<int32_t>(
+				std::lower_bound(p_breaks, p_breaks + nBreaks, p_vals[i]) - p_breaks
+			);
+		}
+		return;
+	}
+
+	size_t i = 0;
+
+#if CLASSIFY_RUNTIME_DISPATCH
+	switch (supportedIsa()) {
+		case Isa::AVX512:
+			i = countBreaksAVX512(p_vals, p_counts, n, p_breaks, nBreaks);
+			break;
+		case Isa::AVX2:
+			i = countBreaksAVX2(p_vals, p_counts, n, p_breaks, nBreaks);
+			break;
+		default:
+			break;
+	}
+#endif
+
+	for (size_t j = i; j < n; j++) {
+		p_counts[j] = 0;
+	}
+	for (size_t b = 0; b < nBreaks; b++) {
+		double brk = p_breaks[b];
+		for (size_t j = i; j < n; j++) {
+			p_counts[j] += p_vals[j] > brk;
+		}
+	}
+}
+
+/**
+ * @ingroup classify
+ * This function classifies a contiguous run of pixels of input type T, writing
+ * strata of type S. Pixels which are nan, or equal to the nodata value of the
+ * input band, are given the strata -1.
+ *
+ * The pixels are processed in tiles of CLASSIFY_TILE_SIZE. Each tile is first
+ * converted to double, so that one comparison kernel (countBreaks()) is used
+ * for every input type and the comparisons are exact for every type up to and
+ * including 32 bit integers.
+ *
+ * If HasMap is true, the strata multiplied by the multiplier is added to p_map,
+ * and p_mapNan is set for pixels which are nan. This is how a mapped stratification
+ * is accumulated across multiple bands. The nan check is only compiled in for floating
+ * point types, or if HasNoData is true.
+ *
+ * @param const T *p_data
+ * @param S *p_strat
+ * @param size_t count
+ * @param const std::vector<double>& breaks
+ * @param double nan
+ * @param size_t multiplier
+ * @param int64_t *p_map
+ * @param uint8_t *p_mapNan
+ */
+template <typename T, typename S, bool HasNoData, bool HasMap>
+void
+classify(
+	const T *p_data,
+	S *p_strat,
+	size_t count,
+	const std::vector<double>& breaks,
+	double nan,
+	size_t multiplier,
+	int64_t *p_map,
+	uint8_t *p_mapNan)
+{
+	double vals[CLASSIFY_TILE_SIZE];
+	int32_t counts[CLASSIFY_TILE_SIZE];
+
+	for (size_t start = 0; start < count; start += CLASSIFY_TILE_SIZE) {
+		size_t n = std::min(static_cast<size_t>(CLASSIFY_TILE_SIZE), count - start);
+
+		for (size_t i = 0; i < n; i++) {
+			vals[i] = static_cast<double>(p_data[start + i]);
+		}
+
+		countBreaks(vals, counts, n, breaks.data(), breaks.size());
+
+		for (size_t i = 0; i < n; i++) {
+			bool isNan = false;
+			if constexpr (std::is_floating_point_v<T>) {
+				isNan = std::isnan(vals[i]);
+			}
+			if constexpr (HasNoData) {
+				isNan |= vals[i] == nan;
+			}
+
+			p_strat[start + i] = isNan ? static_cast<S>(-1) : static_cast<S>(counts[i]);
+			if constexpr (HasMap) {
+				p_map[start + i] += static_cast<int64_t>(counts[i]) * static_cast<int64_t>(multiplier);
+				p_mapNan[start + i] |= isNan;
+			}
+		}
+	}
+}
+
+/**
+ * @ingroup classify
+ * This function classifies the valid pixels of a block (or of an entire in-memory band
+ * if xValid is the width of the band and yValid is the height) of input type T into
+ * strata of type S. The block buffers, and map buffers if used, have a line stride
+ * of 'stride' pixels.
+ *
+ * @param void *p_data
+ * @param void *p_strat
+ * @param int xValid
+ * @param int yValid
+ * @param size_t stride
+ * @param const std::vector<double>& breaks
+ * @param double nan
+ * @param size_t multiplier
+ * @param int64_t *p_map
+ * @param uint8_t *p_mapNan
+ */
+template <typename T, typename S, bool HasNoData, bool HasMap>
+void
+classifyRows(
+	void *p_data,
+	void *p_strat,
+	int xValid,
+	int yValid,
+	size_t stride,
+	const std::vector<double>& breaks,
+	double nan,
+	size_t multiplier,
+	int64_t *p_map,
+	uint8_t *p_mapNan)
+{
+	for (int y = 0; y < yValid; y++) {
+		size_t offset = static_cast<size_t>(y) * stride;
+		classify<T, S, HasNoData, HasMap>(
+			reinterpret_cast<T *>(p_data) + offset,
+			reinterpret_cast<S *>(p_strat) + offset,
+			static_cast<size_t>(xValid),
+			breaks,
+			nan,
+			multiplier,
+			HasMap ? p_map + offset : nullptr,
+			HasMap ? p_mapNan + offset : nullptr
+		);
+	}
+}
+
+/**
+ * @ingroup classify
+ * This function stratifies the valid pixels of a block of a data band using a sorted
+ * vector of breaks, and writes the strata to the strat buffer. The kernel is chosen
+ * once per block depending on the data type of the data band, the data type of the
+ * strat band, whether the data band has a nodata value, and whether a map is accumulated
+ * (see helper::dispatchPixelType() and helper::dispatchFlags()).
+ *
+ * If p_map is given (it must have the same line stride as the block), the strata of
+ * this band multiplied by the multiplier is accumulated in p_map and the nan pixels are
+ * marked in p_mapNan. writeMap() then writes the mapped strata once every band has
+ * been classified.
+ *
+ * @param RasterBandMetaData& dataBand
+ * @param void *p_data
+ * @param RasterBandMetaData& stratBand
+ * @param void *p_strat
+ * @param int xValid
+ * @param int yValid
+ * @param size_t stride
+ * @param const std::vector<double>& breaks
+ * @param size_t multiplier
+ * @param int64_t *p_map
+ * @param uint8_t *p_mapNan
+ */
+inline void
+classifyBlock(
+	helper::RasterBandMetaData& dataBand,
+	void *p_data,
+	helper::RasterBandMetaData& stratBand,
+	void *p_strat,
+	int xValid,
+	int yValid,
+	size_t stride,
+	const std::vector<double>& breaks,
+	size_t multiplier = 0,
+	int64_t *p_map = nullptr,
+	uint8_t *p_mapNan = nullptr)
+{
+	double nan = dataBand.nan;
+
+	//the kernel for this combination of data type, strata type, and flags is chosen once per block
+	helper::dispatchPixelType(dataBand.type, [&](auto dataTag) {
+		helper::dispatchStrataType(stratBand.type, [&](auto strataTag) {
+			helper::dispatchFlags([&](auto hasNoData, auto hasMap) {
+				classifyRows<typename decltype(dataTag)::type, typename decltype(strataTag)::type, hasNoData, hasMap>(
+					p_data, p_strat, xValid, yValid, stride, breaks, nan, multiplier, p_map, p_mapNan
+				);
+			}, helper::hasNoDataValue(dataBand.p_band), p_map != nullptr);
+		});
+	});
+}
+
+/**
+ * @ingroup classify
+ * This helper function writes the mapped strata accumulated by classifyBlock() for
+ * a single row, and resets the accumulators so they can be used for the next block.
+ *
+ * @param S *p_strat
+ * @param int64_t *p_map
+ * @param uint8_t *p_mapNan
+ * @param size_t count
+ */
+template <typename S>
+inline void
+writeMapRow(S *p_strat, int64_t *p_map, uint8_t *p_mapNan, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		p_strat[i] = p_mapNan[i] ? static_cast<S>(-1) : static_cast<S>(p_map[i]);
+		p_map[i] = 0;
+		p_mapNan[i] = 0;
+	}
+}
+
+/**
+ * @ingroup classify
+ * This function writes the mapped strata accumulated by classifyBlock() over every
+ * band to the strat buffer of the map band. Pixels that were nan in any band are given
+ * the strata -1. The accumulators are reset to 0 afterwards.
+ *
+ * @param RasterBandMetaData& stratBand
+ * @param void *p_strat
+ * @param int xValid
+ * @param int yValid
+ * @param size_t stride
+ * @param int64_t *p_map
+ * @param uint8_t *p_mapNan
+ */
+inline void
+writeMap(
+	helper::RasterBandMetaData& stratBand,
+	void *p_strat,
+	int xValid,
+	int yValid,
+	size_t stride,
+	int64_t *p_map,
+	uint8_t *p_mapNan)
+{
+	helper::dispatchStrataType(stratBand.type, [&](auto strataTag) {
+		using S = typename decltype(strataTag)::type;
+		for (int y = 0; y < yValid; y++) {
+			size_t offset = static_cast<size_t>(y) * stride;
+			writeMapRow(reinterpret_cast<S *>(p_strat) + offset, p_map + offset, p_mapNan + offset, xValid);
+		}
+	});
+}
+
+} //namespace classify
+} //namespace sgs
@@ -12,8 +12,19 @@
  * @ingroup utils
  */
 
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+
 #include "utils/helper.h"
 #include "utils/raster.h"
+#include "utils/reader.h"
+#include "utils/stats.h"
 #include "utils/vector.h"
 
 namespace sgs {
@@ -21,62 +32,440 @@ namespace dist {
 
 /**
  * @ingroup dist
- * This is a helper function for finding the minimum and maximum values
- * within a given raster band.
+ * The number of provisional bins of every ProvisionalHistogram, 8 MB of counts per thread.
+ */
+#define DIST_PROVISIONAL_BINS 1048576
+
+/**
+ * @ingroup dist
+ * The exponent of the narrowest provisional bins, which are 2^DIST_MIN_EXPONENT wide.
+ */
+#define DIST_MIN_EXPONENT -1000
+
+/**
+ * @ingroup dist
+ * The maximum number of bits of the magnitude of a provisional bin key, which keeps every
+ * key (and the bounds of its bin) exactly representable as a double.
+ */
+#define DIST_MAX_KEY_BITS 52
+
+/**
+ * @ingroup dist
+ * This class is a histogram of values whose range isn't known in advance, used for the
+ * single pass over the raster band before the minimum and maximum (and therefore the bins
+ * returned to the user) are known.
+ *
+ * The provisional bins are aligned to powers of two: with an exponent e, the bin with the
+ * key k contains the values v where k * 2^e <= v < (k + 1) * 2^e. There are DIST_PROVISIONAL_BINS
+ * bins, starting at some base key. When a value doesn't fit within the bins, the bins are
+ * moved, and if the range of the values is too large for them, the exponent is increased
+ * and every pair of bins k = 2j and k = 2j + 1 is merged into the bin j. Because the bins
+ * of every exponent are nested within the bins of the next, this never moves a value into
+ * a bin which doesn't contain it, and histograms with different exponents can be merged
+ * exactly.
+ *
+ * After a value is added the bins are at least range / DIST_PROVISIONAL_BINS wide, but
+ * never more than twice that (unless the range is so narrow relative to the magnitude of
+ * the values that keys would need more than DIST_MAX_KEY_BITS bits, in which case the bins
+ * are about max(|min|, |max|) / 2^DIST_MAX_KEY_BITS wide), so a final bin of the distribution
+ * usually spans many provisional bins. Integer values of a band with a range smaller than the number of provisional bins
+ * are each given their own provisional bin.
+ */
+class ProvisionalHistogram {
+	private:
+	int exponent = DIST_MIN_EXPONENT;
+	double scale = std::ldexp(1.0, -DIST_MIN_EXPONENT);
+	int64_t base = 0;
+	int64_t lo = 0;
+	int64_t hi = -1;
+	std::vector<int64_t> counts;
+
+	static constexpr double maxKey = static_cast<double>(static_cast<int64_t>(1) << DIST_MAX_KEY_BITS);
+
+	/**
+	 * Floor division of a key by 2^bits.
+	 *
+	 * @param int64_t key
+	 * @param int bits
+	 * @returns int64_t
+	 */
+	static inline int64_t
+	shift(int64_t key, int bits) {
+		return bits >= 63 ? (key < 0 ? -1 : 0) : key >> bits;
+	}
+
+	/**
+	 * Calculate the key of a value at an exponent. The value must be within the
+	 * range allowed by DIST_MAX_KEY_BITS.
+	 *
+	 * @param double val
+	 * @param int exponent
+	 * @returns int64_t
+	 */
+	static inline int64_t
+	keyAt(double val, int exponent) {
+		int64_t key = static_cast<int64_t>(std::floor(std::ldexp(val, -exponent)));
+
+		//a negative value which underflowed to -0 is still below the bin starting at 0
+		return (key == 0 && val < 0) ? -1 : key;
+	}
+
+	/**
+	 * Move the counts to the bins of a (larger or equal) exponent such that
+	 * the keys lo and hi, of the new exponent, are within the bins. The
+	 * bins between lo and hi are then considered part of the histogram.
+	 *
+	 * @param int newExponent
+	 * @param int64_t newLo
+	 * @param int64_t newHi
+	 */
+	void
+	rebin(int newExponent, int64_t newLo, int64_t newHi) {
+		int64_t newBase = newLo - (DIST_PROVISIONAL_BINS - 1 - (newHi - newLo)) / 2;
+		std::vector<int64_t> newCounts(DIST_PROVISIONAL_BINS, 0);
+		int bits = newExponent - this->exponent;
+		for (int64_t key = this->lo; key <= this->hi && !this->counts.empty(); key++) {
+			int64_t count = this->counts[key - this->base];
+			if (count != 0) {
+				newCounts[shift(key, bits) - newBase] += count;	
+			}
+		}
+
+		this->counts = std::move(newCounts);
+		this->exponent = newExponent;
+		this->scale = std::ldexp(1.0, -newExponent);
+		this->base = newBase;
+		this->lo = newLo;
+		this->hi = newHi;
+	}
+
+	/**
+	 * Find the smallest exponent, no smaller than the given exponent, at which the keys
+	 * lo and hi of the given exponent fit within the bins, and rebin to it.
+	 *
+	 * @param int newExponent
+	 * @param int64_t newLo
+	 * @param int64_t newHi
+	 */
+	void
+	fit(int newExponent, int64_t newLo, int64_t newHi) {
+		while (newHi - newLo >= DIST_PROVISIONAL_BINS) {
+			newExponent++;
+			newLo = shift(newLo, 1);
+			newHi = shift(newHi, 1);
+		}
+		rebin(newExponent, newLo, newHi);
+	}
+
+	public:
+	/**
+	 * @returns bool whether no values have been added
+	 */
+	inline bool
+	empty(void) const {
+		return this->hi < this->lo;
+	}
+
+	/**
+	 * Get the key of the bin a value is within. The value must be within the
+	 * minimum and maximum values added.
+	 *
+	 * @param double val
+	 * @returns int64_t
+	 */
+	inline int64_t
+	key(double val) const {
+		return keyAt(val, this->exponent);
+	}
+
+	/**
+	 * Get the lower (inclusive) and upper (exclusive) bounds of the values of a bin.
+	 *
+	 * @param int64_t key
+	 * @returns std::pair<double, double>
+	 */
+	inline std::pair<double, double>
+	bounds(int64_t key) const {
+		return {
+			std::ldexp(static_cast<double>(key), this->exponent),
+			std::ldexp(static_cast<double>(key + 1), this->exponent)
+		};
+	}
+
+	/**
+	 * Add a finite value to the histogram.
+	 *
+	 * @param double val
+	 */
+	inline void
+	add(double val) {
+		double scaled = std::floor(val * this->scale);
+		if (scaled == 0 && val < 0) {
+			scaled = -1; //underflowed to -0
+		}
+
+		int64_t key;
+		if (this->empty() || !(std::abs(scaled) <= maxKey)) {
+			key = grow(val);
+		}
+		else {
+			key = static_cast<int64_t>(scaled);
+			if (key < this->base || key >= this->base + DIST_PROVISIONAL_BINS) {
+				key = grow(val);
+			}
+		}
+
+		this->counts[key - this->base]++;
+		this->lo = std::min(this->lo, key);
+		this->hi = std::max(this->hi, key);
+	}
+
+	/**
+	 * Move (and if necessary widen) the bins so that they contain a value, and
+	 * return the key of it's bin.
+	 *
+	 * @param double val
+	 * @returns int64_t
+	 */
+	int64_t
+	grow(double val) {
+		//the exponent is increased until the key of the value fits within DIST_MAX_KEY_BITS
+		int newExponent = this->exponent;
+		if (val != 0) {
+			newExponent = std::max(newExponent, std::ilogb(val) + 1 - DIST_MAX_KEY_BITS);
+		}
+
+		int64_t key = keyAt(val, newExponent);
+		if (this->empty()) {
+			rebin(newExponent, key, key);
+			return key;
+		}
+
+		int bits = newExponent - this->exponent;
+		fit(newExponent, std::min(shift(this->lo, bits), key), std::max(shift(this->hi, bits), key));
+		return keyAt(val, this->exponent);
+	}
+
+	/**
+	 * Add the counts of another histogram to this one.
+	 *
+	 * @param const ProvisionalHistogram& other
+	 */
+	void
+	merge(const ProvisionalHistogram& other) {
+		if (other.empty()) {
+			return;
+		}
+
+		if (this->empty()) {
+			*this = other;
+			return;
+		}
+
+		int newExponent = std::max(this->exponent, other.exponent);
+		int bits = newExponent - this->exponent;
+		int otherBits = newExponent - other.exponent;
+		fit(
+			newExponent,
+			std::min(shift(this->lo, bits), shift(other.lo, otherBits)),
+			std::max(shift(this->hi, bits), shift(other.hi, otherBits))
+		);
+
+		otherBits = this->exponent - other.exponent;
+		for (int64_t key = other.lo; key <= other.hi; key++) {
+			int64_t count = other.counts[key - other.base];
+			if (count != 0) {
+				this->counts[shift(key, otherBits) - this->base] += count;
+			}
+		}
+	}
+
+	/**
+	 * Call a function on the key and count of every non-empty bin, in order.
+	 *
+	 * @param F func
+	 */
+	template <typename F>
+	void
+	forEach(F func) const {
+		for (int64_t key = this->lo; key <= this->hi; key++) {
+			int64_t count = this->counts[key - this->base];
+			if (count != 0) {
+				func(key, count);
+			}
+		}
+	}
+};
+
+/**
+ * @ingroup dist
+ * This struct stores the results of a single chunk of the raster band, which is
+ * processed by a single thread. It contains:
+ *
+ * T min, max:
+ * 	the minimum and maximum non-nan values within the chunk.
+ *
+ * ProvisionalHistogram histogram:
+ * 	the histogram of the finite non-nan values within the chunk.
+ *
+ * int64_t negInf, posInf:
+ * 	the number of infinite values within the chunk, which aren't in the histogram.
+ *
+ * std::vector<std::pair<T, T>> ranges:
+ * 	the minimum and maximum non-nan values of each window of the chunk.
+ *
+ * std::vector<reader::Window> refine:
+ * 	the windows which must be read again by the refinement pass.
+ *
+ * std::vector<int64_t> counts:
+ * 	the bin counts of the refined values, once they have been read again.
+ *
+ * Exceptions can't be thrown out of a thread pool, so any exception thrown while processing
+ * the chunk is stored and re-thrown once the threads have been joined.
+ */
+template <typename T>
+struct DistChunkResult {
+	T min = std::numeric_limits<T>::max();
+	T max = std::numeric_limits<T>::lowest();
+	ProvisionalHistogram histogram;
+	int64_t negInf = 0;
+	int64_t posInf = 0;
+	std::vector<std::pair<T, T>> ranges;
+	std::vector<reader::Window> refine;
+	std::vector<int64_t> counts;
+	std::exception_ptr error = nullptr;
+};
+
+/**
+ * @ingroup dist
+ * This helper function runs a function on every chunk within a thread pool, and
+ * re-throws the first exception any of the chunks encountered once they have all
+ * finished.
+ *
+ * @param std::vector<DistChunkResult<T>>& results
+ * @param int threads
+ * @param F func
+ */
+template <typename T, typename F>
+void
+runChunks(std::vector<DistChunkResult<T>>& results, int threads, F func) {
+	boost::asio::thread_pool pool(threads);
+	for (size_t i = 0; i < results.size(); i++) {
+		DistChunkResult<T> *p_result = &results[i];
+		boost::asio::post(pool, [i, p_result, &func] {
+			try {
+				func(i, *p_result);
+			}
+			catch (...) {
+				p_result->error = std::current_exception();
+			}
+		});
+	}
+	pool.join();
+
+	for (DistChunkResult<T>& result : results) {
+		if (result.error) {
+			std::rethrow_exception(result.error);
+		}
+	}
+}
+
+/**
+ * @ingroup dist
+ * This helper function gets the minimum and maximum values of the band from the
+ * statistics GDAL has stored with the dataset, without reading any pixels. Only
+ * exact statistics are used, approximate statistics (for example those computed
+ * from overviews) would produce different bins than reading the band.
  *
- * The min and max variables are passed as references, and the min value
- * is initialized to the largest value the data type can have, and the max
- * value is initialized to the smallest value the data type can have.
-*
  * @param RasterBandMetaData& band
- * @param int width
- * @param int height
  * @param T& min
  * @param T& max
+ * @returns bool whether exact statistics were available
+ */
+template <typename T>
+bool
+statisticsMinMax(helper::RasterBandMetaData& band, T& min, T& max) {
+	const char *p_approx = band.p_band->GetMetadataItem("STATISTICS_APPROXIMATE");
+	if (p_approx && CPLTestBool(p_approx)) {
+		return false;
+	}
+
+	double dmin, dmax, mean, stdev;
+	if (band.p_band->GetStatistics(FALSE, FALSE, &dmin, &dmax, &mean, &stdev) != CE_None) {
+		return false;
+	}
+
+	min = static_cast<T>(dmin);
+	max = static_cast<T>(dmax);
+	return true;
+}
+
+/**
+ * @ingroup dist
+ * This function makes the single pass over a chunk of the raster band which is required
+ * to calculate the distribution. It is called from within a thread by the populationDistribution()
+ * function.
+ *
+ * The minimum and maximum values of the chunk are found while the pixels are read. Since
+ * the bins aren't known until every chunk has finished, the values are instead counted within
+ * the provisional bins of a ProvisionalHistogram, which are re-binned once the bins are known.
+ * No pixel values are kept. The minimum and maximum of every window is also recorded, so that
+ * the refinement pass (see refineChunk()) only reads windows which may contain a value it requires.
+ *
+ * @param RasterBandMetaData& band
+ * @param std::vector<reader::Window> windows
+ * @param DistChunkResult<T>& result
  */
 template <typename T>
 void 
-findMinMax(
+scanChunk(
 	helper::RasterBandMetaData& band, 
-	int width, 
-	int height,
-	T& min,
-	T& max) 
+	std::vector<reader::Window> windows,
+	DistChunkResult<T>& result) 
 {
-	int xBlocks = (width + band.xBlockSize - 1) / band.xBlockSize;
-	int yBlocks = (height + band.yBlockSize - 1) / band.yBlockSize;
-
-	min = std::numeric_limits<T>::max();
-	max = std::numeric_limits<T>::min();
 	T nan = static_cast<T>(band.nan);
-	void *p_data = VSIMalloc3(band.xBlockSize, band.yBlockSize, band.size);
-
-	//calculate raster band minimum and maximum values
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			int xValid, yValid;
-			band.p_mutex->lock();
-			band.p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-			band.p_mutex->unlock();
-			
-			//read the band into memory
-			rasterBandIO(band, p_data, band.xBlockSize, band.yBlockSize, xBlock, yBlock, xValid, yValid, true, true);
-
-			for (int y = 0; y < yValid; y++) {
-				int index = y * width;
-				for (int x = 0; x < xValid; x++) {
-					T val = reinterpret_cast<T *>(p_data)[index];
-					if (val != nan && !std::isnan(val)) {
-						min = std::min(min, val);
-						max = std::max(max, val);
+	T min = std::numeric_limits<T>::max();
+	T max = std::numeric_limits<T>::lowest();
+	result.ranges.reserve(windows.size());
+
+	//blocks are read ahead on an I/O thread while the current block is processed
+	reader::BlockReader blocks({&band}, windows, band.xBlockSize, band.yBlockSize);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+		int xValid = p_block->window.xValid;
+		int yValid = p_block->window.yValid;
+		T windowMin = std::numeric_limits<T>::max();
+		T windowMax = std::numeric_limits<T>::lowest();
+
+		for (int y = 0; y < yValid; y++) {
+			int index = y * band.xBlockSize;
+			for (int x = 0; x < xValid; x++) {
+				T val = p_data[index];
+				if (val != nan && !std::isnan(val)) {
+					windowMin = std::min(windowMin, val);
+					windowMax = std::max(windowMax, val);
+
+					if constexpr (std::is_floating_point_v<T>) {
+						if (std::isinf(val)) {
+							(val < 0) ? result.negInf++ : result.posInf++;
+							index++;
+							continue;
+						}
 					}
-					index++;
+					result.histogram.add(static_cast<double>(val));
 				}
-			}	
-		}
+				index++;
+			}
+		}	
+
+		result.ranges.push_back({windowMin, windowMax});
+		min = std::min(min, windowMin);
+		max = std::max(max, windowMax);
 	}
-	
-	VSIFree(p_data);
+
+	result.min = min;
+	result.max = max;
 }
 
 /**
@@ -145,75 +534,373 @@ setBins(
 	}
 }
 
+/**
+ * @ingroup dist
+ * This helper function determines which bin a value falls into. The bin values represent
+ * the start of each bin, so the bin of a value is the last bin which is less than or equal
+ * to the value. Values smaller than the first bin aren't placed in any bin, and -1 is returned.
+ *
+ * @param std::vector<T>& binVals
+ * @param T val
+ * @returns int
+ */
+template <typename T>
+inline int
+binIndex(std::vector<T>& binVals, T val) {
+	return static_cast<int>(std::upper_bound(binVals.begin(), binVals.end(), val) - binVals.begin()) - 1;
+}
+
+/**
+ * @ingroup dist
+ * This function bins every non-nan pixel within a set of windows of the raster band.
+ * It is used for every window if the minimum and maximum are known before the band is read.
+ *
+ * @param RasterBandMetaData& band
+ * @param std::vector<reader::Window> windows
+ * @param std::vector<T>& binVals
+ * @param std::vector<int64_t>& counts
+ */
+template <typename T>
+void
+binChunk(
+	helper::RasterBandMetaData& band,
+	std::vector<reader::Window> windows,
+	std::vector<T>& binVals,
+	std::vector<int64_t>& counts)
+{
+	T nan = static_cast<T>(band.nan);
+	counts.assign(binVals.size(), 0);
+
+	//blocks are read ahead on an I/O thread while the current block is processed
+	reader::BlockReader blocks({&band}, windows, band.xBlockSize, band.yBlockSize);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+		int xValid = p_block->window.xValid;
+		int yValid = p_block->window.yValid;
+
+		for (int y = 0; y < yValid; y++) {
+			int index = y * band.xBlockSize;
+			for (int x = 0; x < xValid; x++) {
+				T val = p_data[index];
+
+				if (val != nan && !std::isnan(val)) {
+					int bin = binIndex(binVals, val);
+					if (bin >= 0) {
+						counts[bin]++;
+					}
+				}
+				index++;
+			}
+		}
+	}
+}
+
+/**
+ * @ingroup dist
+ * This helper function determines the bins (as given by binIndex()) of the smallest and
+ * largest values of type T within a provisional bin of a histogram, and between min and max.
+ *
+ * @param const ProvisionalHistogram& histogram
+ * @param int64_t key
+ * @param T min
+ * @param T max
+ * @param std::vector<T>& binVals
+ * @returns std::pair<int, int>
+ */
+template <typename T>
+std::pair<int, int>
+provisionalBins(const ProvisionalHistogram& histogram, int64_t key, T min, T max, std::vector<T>& binVals) {
+	auto [lower, upper] = histogram.bounds(key);
+
+	T low = min;
+	T high = max;
+	if constexpr (std::is_floating_point_v<T>) {
+		//round the bounds of the bin inward to the nearest values of type T
+		if (lower > static_cast<double>(min)) {
+			low = static_cast<T>(lower);
+			if (static_cast<double>(low) < lower) {
+				low = std::nextafter(low, std::numeric_limits<T>::infinity());
+			}
+		}
+		if (upper <= static_cast<double>(max)) {
+			high = static_cast<T>(upper);
+			if (static_cast<double>(high) >= upper) {
+				high = std::nextafter(high, -std::numeric_limits<T>::infinity());
+			}
+		}
+	}
+	else {
+		lower = std::ceil(lower);
+		upper = std::ceil(upper) - 1;
+		if (lower > static_cast<double>(min)) {
+			low = static_cast<T>(lower);
+		}
+		if (upper < static_cast<double>(max)) {
+			high = static_cast<T>(upper);
+		}
+	}
+
+	return {binIndex(binVals, low), binIndex(binVals, high)};
+}
+
+/**
+ * @ingroup dist
+ * This function makes the refinement pass over the windows of a chunk which may contain
+ * values within provisional bins that span more than one bin of the distribution. Only
+ * the values within those provisional bins (whose keys are given by the sorted refine
+ * vector) are binned, all of the other values were already binned from the histogram.
+ *
+ * @param RasterBandMetaData& band
+ * @param std::vector<reader::Window> windows
+ * @param const ProvisionalHistogram& histogram
+ * @param std::vector<int64_t>& refine
+ * @param std::vector<T>& binVals
+ * @param std::vector<int64_t>& counts
+ */
+template <typename T>
+void
+refineChunk(
+	helper::RasterBandMetaData& band,
+	std::vector<reader::Window> windows,
+	const ProvisionalHistogram& histogram,
+	std::vector<int64_t>& refine,
+	std::vector<T>& binVals,
+	std::vector<int64_t>& counts)
+{
+	T nan = static_cast<T>(band.nan);
+	counts.assign(binVals.size(), 0);
+
+	//blocks are read ahead on an I/O thread while the current block is processed
+	reader::BlockReader blocks({&band}, windows, band.xBlockSize, band.yBlockSize);
+
+	while (reader::Block *p_block = blocks.next()) {
+		T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+		int xValid = p_block->window.xValid;
+		int yValid = p_block->window.yValid;
+
+		for (int y = 0; y < yValid; y++) {
+			int index = y * band.xBlockSize;
+			for (int x = 0; x < xValid; x++) {
+				T val = p_data[index];
+				index++;
+
+				if (val == nan || !std::isfinite(static_cast<double>(val))) {
+					continue;
+				}
+
+				if (std::binary_search(refine.begin(), refine.end(), histogram.key(static_cast<double>(val)))) {
+					counts[binIndex(binVals, val)]++;
+				}
+			}
+		}
+	}
+}
+
 /**
  * @ingroup dist
  * This function calculates the distribution of pixels across the entire population
  * (the whole raster band).
  *
- * The chunk of the raster assigned to this call of the function is iterated through
- * in blocks. All of the pixels in each block are then iterated through, the nan values
- * are ignored.
+ * The raster band is split into chunks of rows of blocks depending on the number of threads.
+ * Each chunk is scanned by the scanChunk() function within a thread pool, which finds the
+ * minimum and maximum of the chunk while counting the values within the provisional bins of
+ * a ProvisionalHistogram. Once the histograms of the chunks are merged and the bins are set,
+ * every provisional bin whose values all fall within a single bin is added to that bin, without
+ * reading the band again.
+ *
+ * A provisional bin which contains the start of a bin (other than the first) may have values
+ * on both sides of it. There are at most nBins - 1 of these. By default, each is added to the
+ * bin containing it's center, without reading the band again. Only pixels within a provisional
+ * bin of the start of a bin can then be counted in the neighbouring bin, so the count of a bin
+ * is off by at most the number of pixels within the width of a provisional bin (usually at
+ * most 2 * (max - min) / DIST_PROVISIONAL_BINS, see ProvisionalHistogram) of it's boundaries.
+ *
+ * If exact is true, the values within those provisional bins are instead binned exactly by
+ * a refinement pass (refineChunk()), which reads again every window whose minimum and maximum
+ * shows it may have values within them. Since the boundaries of the bins are spread over the
+ * range of values, for wide ranged or floating point bands most windows will usually be read
+ * again. For integer bands with a range of values smaller than DIST_PROVISIONAL_BINS, every
+ * value has it's own provisional bin, so the result is always exact and there is never a
+ * refinement pass.
+ *
+ * If useStatistics is true and GDAL has exact statistics for the band, the minimum and
+ * maximum are taken from them, the scan is skipped, and the band is read a single time
+ * by the binChunk() function.
  *
- * The bin values are passed as a parameter, and the value in the vector represents the
- * start of a particular bin. This means that the first index in the bins vector which
- * is less than or equal to a particular pixel, is that pixles bin. For each pixel,
- * the iteration starts at the largest bin and iterates down until it reaches a bin
- * value less than or equal to a particular pixel.
+ * The statistics cache of the raster is checked first. If a histogram with the same number
+ * of bins is cached (and is exact, if exact is true), the band isn't read at all, and if the
+ * minimum and maximum are cached the scan is skipped. The minimum, maximum, and histogram are
+ * added to the cache afterwards.
  *
  * @param RasterBandMetaData& band
+ * @param StatisticsCache& cache
+ * @param int index
  * @param int width
  * @param int height
  * @param int nBins
- * @param std::vector<T>& binVals
+ * @param bool useStatistics
+ * @param bool exact
+ * @param int threads
+ * @param std::vector<double>& dbins
+ * @param std::vector<T>& tbins
  * @param std::vector<int64_t>& counts
  */
 template <typename T>
 void
 populationDistribution(
 	helper::RasterBandMetaData& band,
+	stats::StatisticsCache& cache,
+	int index,
 	int width,
 	int height,
 	int nBins,
-	std::vector<T>& binVals,
+	bool useStatistics,
+	bool exact,
+	int threads,
+	std::vector<double>& dbins,
+	std::vector<T>& tbins,
 	std::vector<int64_t>& counts)
 {
-	int xBlocks = (width + band.xBlockSize - 1) / band.xBlockSize;
+	stats::Histogram histogram;
+	if (cache.getHistogram(index, nBins, exact, histogram)) {
+		setBins<T>(static_cast<T>(histogram.min), static_cast<T>(histogram.max), nBins, band.type, dbins, tbins);
+		counts = std::move(histogram.counts);
+		return;
+	}
+
 	int yBlocks = (height + band.yBlockSize - 1) / band.yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
 
-	T nan = static_cast<T>(band.nan);
-	void *p_data = VSIMalloc3(band.xBlockSize, band.yBlockSize, band.size);
-
-	for (int yBlock = 0; yBlock < yBlocks; yBlock++) {
-		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
-			
-			int xValid, yValid;
-			band.p_mutex->lock();
-			band.p_band->GetActualBlockSize(xBlock, yBlock, &xValid, &yValid);
-			band.p_mutex->unlock();
-
-			//read the band into memory
-			rasterBandIO(band, p_data, band.xBlockSize, band.yBlockSize, xBlock, yBlock, xValid, yValid, true, true);
-
-			for (int y = 0; y < yValid; y++) {
-				int index = y * width;
-				for (int x = 0; x < xValid; x++) {
-					T val = reinterpret_cast<T *>(p_data)[index];
-
-					if (val != nan && !std::isnan(val)) {
-						for (int i = nBins - 1; i >= 0; i--) {
-							if (binVals[i] <= val) {
-								counts[i]++;	
-								break;
-							}
-						}
-					}
-					index++;
-				}
+	std::vector<std::vector<reader::Window>> chunkWindows(chunks);
+	for (int i = 0; i < chunks; i++) {
+		int yBlockStart = i * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+		chunkWindows[i] = reader::blockWindows(band.xBlockSize, band.yBlockSize, width, height, yBlockStart, yBlockEnd);
+	}
+
+	std::vector<DistChunkResult<T>> results(chunks);
+
+	T min = std::numeric_limits<T>::max();
+	T max = std::numeric_limits<T>::lowest();
+	double dmin, dmax;
+	bool statistics = cache.getMinMax(index, dmin, dmax);
+	if (statistics) {
+		min = static_cast<T>(dmin);
+		max = static_cast<T>(dmax);
+	}
+	else {
+		statistics = useStatistics && statisticsMinMax<T>(band, min, max);
+	}
+
+	if (statistics) {
+		//the bins are known, so every window is binned in a single pass
+		setBins<T>(min, max, nBins, band.type, dbins, tbins);
+		counts.assign(nBins, 0);
+
+		runChunks<T>(results, threads, [&band, &chunkWindows, &tbins](size_t i, DistChunkResult<T>& result) {
+			binChunk<T>(band, chunkWindows[i], tbins, result.counts);
+		});
+
+		for (const DistChunkResult<T>& result : results) {
+			for (size_t i = 0; i < result.counts.size(); i++) {
+				counts[i] += result.counts[i];
 			}
 		}
+
+		cache.setHistogram(index, {static_cast<double>(min), static_cast<double>(max), counts});
+		return;
 	}
-	
-	VSIFree(p_data);
+
+	runChunks<T>(results, threads, [&band, &chunkWindows](size_t i, DistChunkResult<T>& result) {
+		scanChunk<T>(band, chunkWindows[i], result);
+	});
+
+	ProvisionalHistogram merged;
+	int64_t negInf = 0;
+	int64_t posInf = 0;
+	for (DistChunkResult<T>& result : results) {
+		min = std::min(min, result.min);
+		max = std::max(max, result.max);
+		merged.merge(result.histogram);
+		result.histogram = ProvisionalHistogram();
+		negInf += result.negInf;
+		posInf += result.posInf;
+	}
+
+	cache.setMinMax(index, static_cast<double>(min), static_cast<double>(max));
+	setBins<T>(min, max, nBins, band.type, dbins, tbins);
+	counts.assign(nBins, 0);
+
+	if constexpr (std::is_floating_point_v<T>) {
+		int negBin = binIndex(tbins, -std::numeric_limits<T>::infinity());
+		int posBin = binIndex(tbins, std::numeric_limits<T>::infinity());
+		if (negBin >= 0) {
+			counts[negBin] += negInf;
+		}
+		if (posBin >= 0) {
+			counts[posBin] += posInf;
+		}
+	}
+
+	//re-bin the provisional bins. Those which span more than one bin are either added to the
+	//bin containing their center, or kept to be refined if the histogram must be exact.
+	std::vector<int64_t> refine;
+	bool approximated = false;
+	merged.forEach([&](int64_t key, int64_t count) {
+		auto [low, high] = provisionalBins<T>(merged, key, min, max, tbins);
+		if (low == high) {
+			counts[low] += count;
+		}
+		else if (exact) {
+			refine.push_back(key);
+		}
+		else {
+			auto [lower, upper] = merged.bounds(key);
+			double center = (std::max(lower, static_cast<double>(min)) + std::min(upper, static_cast<double>(max))) / 2;
+			counts[std::clamp(binIndex(tbins, static_cast<T>(center)), low, high)] += count;
+			approximated = true;
+		}
+	});
+
+	if (refine.empty()) {
+		cache.setHistogram(index, {static_cast<double>(min), static_cast<double>(max), counts, !approximated});
+		return;
+	}
+
+	//only the windows whose range of values includes a provisional bin being refined are read again
+	for (int i = 0; i < chunks; i++) {
+		DistChunkResult<T>& result = results[i];
+		for (size_t j = 0; j < chunkWindows[i].size(); j++) {
+			auto [windowMin, windowMax] = result.ranges[j];
+			if (windowMin > windowMax) {
+				continue;
+			}
+
+			//infinite values aren't in any provisional bin
+			int64_t keyMin = std::isfinite(static_cast<double>(windowMin)) ? merged.key(static_cast<double>(windowMin)) : refine.front();
+			int64_t keyMax = std::isfinite(static_cast<double>(windowMax)) ? merged.key(static_cast<double>(windowMax)) : refine.back();
+			auto it = std::lower_bound(refine.begin(), refine.end(), keyMin);
+			if (it != refine.end() && *it <= keyMax) {
+				result.refine.push_back(chunkWindows[i][j]);
+			}
+		}
+	}
+
+	runChunks<T>(results, threads, [&band, &merged, &refine, &tbins](size_t, DistChunkResult<T>& result) {
+		if (!result.refine.empty()) {
+			refineChunk<T>(band, result.refine, merged, refine, tbins, result.counts);
+		}
+	});
+
+	for (const DistChunkResult<T>& result : results) {
+		for (size_t i = 0; i < result.counts.size(); i++) {
+			counts[i] += result.counts[i];
+		}
+	}
+
+	cache.setHistogram(index, {static_cast<double>(min), static_cast<double>(max), counts});
 }
 
 /**
@@ -242,11 +929,9 @@ sampleDistribution(
 	T val;
 	for (const helper::Index& index : samples) {
 		band.p_band->RasterIO(GF_Read, index.x, index.y, 1, 1, &val, 1, 1, band.type, 0, 0);
-		for (int i = nBins - 1; i >= 0; i--) {
-			if (binVals[i] <= val) {
-				retval[i]++;
-				break;
-			}
+		int bin = binIndex(binVals, val);
+		if (bin >= 0) {
+			retval[bin]++;
 		}
 	}
 
@@ -257,49 +942,46 @@ sampleDistribution(
  * @ingroup dist
  *
  * This is the function which does most of calculations for the distribution calculation.
- * First the findMinMax() function is called to find the minimum and maximum pixel values
- * within the raster. Then the setBins() function is called to set the bin values
- * depending on the minumum and maximum values within the raster. Next, the populationDistribution()
- * function is ran to determine the population distribution within the calculated raster bins. Finally,
- * if the user provided a sample layer to compare against, the sampleDistribution() function is called
- * to determine the distribution within that particular sample.
- *
- * Both the findMinMax() and populationDistribution() function are called multiple times, each with
- * a different chunk (where the chunk count and chunk size is determined by the number of threads).
+ * First the populationDistribution() function is called, which determines the minimum and
+ * maximum pixel values, sets the bins using the setBins() function, and determines the
+ * population distribution within those bins. Then, if the user provided a sample layer 
+ * to compare against, the sampleDistribution() function is called to determine the 
+ * distribution within that particular sample.
  * 
  * @param RasterBandMetaData& band
+ * @param StatisticsCache& cache
+ * @param int index
  * @param std::vector<Index>& sampled
  * @param int height
  * @param int width
  * @param int nBins
+ * @param bool useStatistics
+ * @param bool exact
+ * @param int threads
  * @param std::unordered_map<std::string, std::pair<std::vector<double>, std::vector<int64_t>>>& retval
  */
 template <typename T>
 void 
 calculateDist(
 	helper::RasterBandMetaData& band,
+	stats::StatisticsCache& cache,
+	int index,
 	std::vector<helper::Index>& sampled,
 	int height,
 	int width,
 	int nBins,
+	bool useStatistics,
+	bool exact,
+	int threads,
 	std::unordered_map<std::string, std::pair<std::vector<double>, std::vector<int64_t>>>& retval)
 {
-	//determine min and max values in the raster
-	T min;
-	T max;
-	findMinMax<T>(band, width, height, min, max);
-
-	//call the setBins function which sets the vector<double> bins to return to the user,
-	//and the vector<T> bins to use to create the distribution. There is a seperate vector<T>
-	//bins object so that while iterating through every pixel, they don't have to be cast to
-	//type double to check.
+	//the vector<double> bins are returned to the user, and the vector<T> bins are used
+	//to create the distribution. There is a seperate vector<T> bins object so that while 
+	//iterating through every pixel, they don't have to be cast to type double to check.
 	std::vector<double> dbins;
 	std::vector<T> tbins;
-	setBins<T>(min, max, nBins, band.type, dbins, tbins);
-
-	//determine the population distribution of the raster band
-	std::vector<int64_t> counts(nBins, 0);
-	populationDistribution<T>(band, width, height, nBins, tbins, counts);	
+	std::vector<int64_t> counts;
+	populationDistribution<T>(band, cache, index, width, height, nBins, useStatistics, exact, threads, dbins, tbins, counts);	
 
 	//add population distribution to return value
 	retval.insert({std::string("population"), {dbins, counts}});
@@ -331,6 +1013,9 @@ calculateDist(
  * @param GDALVectorWrapper *p_vector
  * @param std::string layer
  * @param int nBins
+ * @param bool useStatistics
+ * @param bool exact
+ * @param int threads
  * @returns std::unordered_map<std::string, std::pari<std::vector<double>, std::vector<int64_t>>>
  */
 std::unordered_map<std::string, std::pair<std::vector<double>, std::vector<int64_t>>>
@@ -339,9 +1024,11 @@ dist(
 	int index,
 	vector::GDALVectorWrapper *p_vector,
 	std::string layer,
-	int nBins)
+	int nBins,
+	bool useStatistics,
+	bool exact,
+	int threads)
 {
-	std::mutex datasetMutex;
 	double *GT = p_raster->getGeotransform();
 	double IGT[6];
        	GDALInvGeoTransform(GT, IGT);	
@@ -395,36 +1082,36 @@ dist(
 	band.p_band = p_raster->getRasterBand(index);
 	band.type = p_raster->getRasterBandType(index);
 	band.size = p_raster->getRasterBandTypeSize(index);
-	band.p_mutex = &datasetMutex;
 	band.nan = band.p_band->GetNoDataValue();
 	band.p_band->GetBlockSize(&band.xBlockSize, &band.yBlockSize);
 	band.p_mutex = &bandMutex;
 
 	int height = p_raster->getHeight();
 	int width = p_raster->getWidth();
+	stats::StatisticsCache& cache = p_raster->getStatistics();
 
 	std::unordered_map<std::string, std::pair<std::vector<double>, std::vector<int64_t>>> retval;
 	switch (band.type) {
 		case GDT_Int8: 
-			calculateDist<int8_t>(band, sampled, height, width, nBins, retval);
+			calculateDist<int8_t>(band, cache, index, sampled, height, width, nBins, useStatistics, exact, threads, retval);
 			break;
 		case GDT_UInt16: 
-			calculateDist<uint16_t>(band, sampled, height, width, nBins, retval);
+			calculateDist<uint16_t>(band, cache, index, sampled, height, width, nBins, useStatistics, exact, threads, retval);
 			break;
 		case GDT_Int16: 
-			calculateDist<int16_t>(band, sampled, height, width, nBins, retval);
+			calculateDist<int16_t>(band, cache, index, sampled, height, width, nBins, useStatistics, exact, threads, retval);
 			break;
 		case GDT_UInt32:
-			calculateDist<uint32_t>(band, sampled, height, width, nBins, retval);
+			calculateDist<uint32_t>(band, cache, index, sampled, height, width, nBins, useStatistics, exact, threads, retval);
 			break;
 		case GDT_Int32:
-			calculateDist<int32_t>(band, sampled, height, width, nBins, retval);
+			calculateDist<int32_t>(band, cache, index, sampled, height, width, nBins, useStatistics, exact, threads, retval);
 			break;
 		case GDT_Float32:
-			calculateDist<float>(band, sampled, height, width, nBins, retval);
+			calculateDist<float>(band, cache, index, sampled, height, width, nBins, useStatistics, exact, threads, retval);
 			break;
 		case GDT_Float64:
-			calculateDist<double>(band, sampled, height, width, nBins, retval);	
+			calculateDist<double>(band, cache, index, sampled, height, width, nBins, useStatistics, exact, threads, retval);	
 			break;
 		default:
 			throw std::runtime_error("raster pixel data type not supported.");
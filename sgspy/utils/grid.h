@@ -0,0 +1,394 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: dense cell grid spatial index for minimum distance checks
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup grid grid
+ * @ingroup utils
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <latch>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+
+#define GRID_MAX_CELLS 16777216 //2^24 cells, 64 MB of cell heads
+#define GRID_EMPTY UINT32_MAX
+#define GRID_PARALLEL_BATCH 65536 //number of candidates checked in parallel before the grid is updated
+
+namespace sgs {
+namespace grid {
+
+/**
+ * @ingroup grid
+ * This class is a spatial index used to ensure new sample points are not within
+ * a minimum distance of points which have already been accepted.
+ *
+ * The extent of the raster is divided into a dense grid of square cells, with a
+ * side length of at least mindist. Any point within mindist of a given point
+ * must therefore be in the same cell or one of the 8 surrounding cells. Each cell
+ * stores the index of the most recently inserted point within it, and each point
+ * stores the index of the previous point inserted into the same cell, so the points
+ * of a cell can be walked without any hashing, and all storage is contiguous.
+ *
+ * If a grid with cells of side length mindist would have more than GRID_MAX_CELLS
+ * cells, the cell size is increased to limit memory use. Points outside of the raster
+ * extent (for example existing sample points) are placed in the nearest border cell.
+ * Because this clamping never separates two cells which were adjacent, the result
+ * of every check is unchanged.
+ */
+class SpatialGrid {
+	private:
+	double xMin;
+	double yMin;
+	double xMax;
+	double yMax;
+	double mindist;
+	double cellSize;
+	double mindistSq;
+	int64_t xCells;
+	int64_t yCells;
+
+	std::vector<uint32_t> heads;
+	std::vector<uint32_t> next;
+	std::vector<double> xs;
+	std::vector<double> ys;
+
+	/**
+	 * Get the clamped cell index of a coordinate along a single axis.
+	 *
+	 * @param double val
+	 * @param double min
+	 * @param int64_t cells
+	 * @returns int64_t
+	 */
+	inline int64_t
+	cell(double val, double min, int64_t cells) const {
+		double c = std::floor((val - min) / this->cellSize);
+		if (!(c > 0)) {
+			return 0;
+		}
+		return c >= static_cast<double>(cells) ? cells - 1 : static_cast<int64_t>(c);
+	}
+
+	/**
+	 * Determine whether there is already a point that is within mindist
+	 * of the point (x, y), which is in the cell (cx, cy).
+	 *
+	 * @param double x
+	 * @param double y
+	 * @param int64_t cx
+	 * @param int64_t cy
+	 * @returns bool
+	 */
+	inline bool
+	hasNeighbor(double x, double y, int64_t cx, int64_t cy) const {
+		int64_t yStart = std::max<int64_t>(cy - 1, 0);
+		int64_t yEnd = std::min<int64_t>(cy + 1, this->yCells - 1);
+		int64_t xStart = std::max<int64_t>(cx - 1, 0);
+		int64_t xEnd = std::min<int64_t>(cx + 1, this->xCells - 1);
+
+		for (int64_t ny = yStart; ny <= yEnd; ny++) {
+			const uint32_t *p_row = this->heads.data() + ny * this->xCells;
+			for (int64_t nx = xStart; nx <= xEnd; nx++) {
+				for (uint32_t i = p_row[nx]; i != GRID_EMPTY; i = this->next[i]) {
+					double dx = x - this->xs[i];
+					double dy = y - this->ys[i];
+					if (dx * dx + dy * dy < this->mindistSq) {
+						return true;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Add the point (x, y) to the cell (cx, cy).
+	 *
+	 * @param double x
+	 * @param double y
+	 * @param int64_t cx
+	 * @param int64_t cy
+	 */
+	inline void
+	insert(double x, double y, int64_t cx, int64_t cy) {
+		if (this->xs.size() >= GRID_EMPTY) {
+			throw std::runtime_error("too many points added to spatial grid.");
+		}
+
+		uint32_t i = static_cast<uint32_t>(this->xs.size());
+		uint32_t& head = this->heads[cy * this->xCells + cx];
+		this->xs.push_back(x);
+		this->ys.push_back(y);
+		this->next.push_back(head);
+		head = i;
+	}
+
+	/**
+	 * Set the bounds and cell size of the grid, and allocate the cells.
+	 *
+	 * @param double xMin
+	 * @param double yMin
+	 * @param double xMax
+	 * @param double yMax
+	 * @param double mindist
+	 * @param double maxCells
+	 */
+	inline void
+	init(double xMin, double yMin, double xMax, double yMax, double mindist, double maxCells) {
+		if (!(mindist > 0)) {
+			throw std::runtime_error("mindist of spatial grid must be greater than 0.");
+		}
+
+		this->xMin = xMin;
+		this->yMin = yMin;
+		this->xMax = xMax;
+		this->yMax = yMax;
+		this->mindist = mindist;
+		double xExtent = std::max(xMax - xMin, mindist);
+		double yExtent = std::max(yMax - yMin, mindist);
+
+		//the cell size may be increased (but never decreased) to limit the number of cells
+		this->cellSize = mindist;
+		double cells = std::ceil(xExtent / mindist) * std::ceil(yExtent / mindist);
+		if (cells > maxCells) {
+			this->cellSize = mindist * std::sqrt(cells / maxCells) * 1.01;
+		}
+		this->mindistSq = mindist * mindist;
+
+		this->xCells = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(xExtent / this->cellSize)));
+		this->yCells = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(yExtent / this->cellSize)));
+		this->heads.assign(static_cast<size_t>(this->xCells * this->yCells), GRID_EMPTY);
+	}
+
+	public:
+	/**
+	 * Constructor for the SpatialGrid class. The bounds of the grid are
+	 * computed from the geotransform and size of the raster being sampled.
+	 *
+	 * @param double *GT
+	 * @param int width
+	 * @param int height
+	 * @param double mindist
+	 */
+	SpatialGrid(double *GT, int width, int height, double mindist) {
+		//bounding box of the four corners of the raster
+		double xCorners[4] = {GT[0], GT[0] + width * GT[1], GT[0] + height * GT[2], GT[0] + width * GT[1] + height * GT[2]};
+		double yCorners[4] = {GT[3], GT[3] + width * GT[4], GT[3] + height * GT[5], GT[3] + width * GT[4] + height * GT[5]};
+		auto [xLow, xHigh] = std::minmax_element(xCorners, xCorners + 4);
+		auto [yLow, yHigh] = std::minmax_element(yCorners, yCorners + 4);
+
+		init(*xLow, *yLow, *xHigh, *yHigh, mindist, GRID_MAX_CELLS);
+	}
+
+	/**
+	 * Constructor for the SpatialGrid class, given the bounds of the grid
+	 * and the maximum number of cells it may contain.
+	 *
+	 * @param double xMin
+	 * @param double yMin
+	 * @param double xMax
+	 * @param double yMax
+	 * @param double mindist
+	 * @param double maxCells
+	 */
+	SpatialGrid(double xMin, double yMin, double xMax, double yMax, double mindist, double maxCells) {
+		init(xMin, yMin, xMax, yMax, mindist, std::max(1.0, maxCells));
+	}
+
+	/**
+	 * Reserve space for a number of points.
+	 *
+	 * @param size_t count
+	 */
+	inline void
+	reserve(size_t count) {
+		this->xs.reserve(count);
+		this->ys.reserve(count);
+		this->next.reserve(count);
+	}
+
+	/**
+	 * Get the number of points which have been added to the grid.
+	 *
+	 * @returns size_t
+	 */
+	inline size_t
+	size(void) const {
+		return this->xs.size();
+	}
+
+	/**
+	 * Determine whether there is already a point within mindist of (x, y).
+	 *
+	 * @param double x
+	 * @param double y
+	 * @returns bool
+	 */
+	inline bool
+	hasNeighbor(double x, double y) const {
+		return hasNeighbor(x, y, cell(x, this->xMin, this->xCells), cell(y, this->yMin, this->yCells));
+	}
+
+	/**
+	 * Add the point (x, y) to the grid, without checking for neighbors.
+	 *
+	 * @param double x
+	 * @param double y
+	 */
+	inline void
+	insert(double x, double y) {
+		insert(x, y, cell(x, this->xMin, this->xCells), cell(y, this->yMin, this->yCells));
+	}
+
+	/**
+	 * Add the point (x, y) to the grid only if there is no point within
+	 * mindist of it already.
+	 *
+	 * @param double x
+	 * @param double y
+	 * @returns bool true if the point was added
+	 */
+	inline bool
+	tryInsert(double x, double y) {
+		int64_t cx = cell(x, this->xMin, this->xCells);
+		int64_t cy = cell(y, this->yMin, this->yCells);
+
+		if (hasNeighbor(x, y, cx, cy)) {
+			return false;
+		}
+
+		insert(x, y, cx, cy);
+		return true;
+	}
+
+	/**
+	 * Add a batch of points to the grid, without checking for neighbors.
+	 *
+	 * @param const double *p_x
+	 * @param const double *p_y
+	 * @param size_t count
+	 */
+	inline void
+	insert(const double *p_x, const double *p_y, size_t count) {
+		reserve(this->xs.size() + count);
+		for (size_t i = 0; i < count; i++) {
+			insert(p_x[i], p_y[i]);
+		}
+	}
+
+	/**
+	 * Try to add a batch of points to the grid, in order. A point is added only
+	 * if no point already in the grid, including those accepted earlier in the
+	 * batch, is within mindist of it. The result of each point is written
+	 * to p_accepted.
+	 *
+	 * @param const double *p_x
+	 * @param const double *p_y
+	 * @param size_t count
+	 * @param uint8_t *p_accepted
+	 * @returns size_t the number of points added
+	 */
+	inline size_t
+	tryInsert(const double *p_x, const double *p_y, size_t count, uint8_t *p_accepted) {
+		size_t accepted = 0;
+		for (size_t i = 0; i < count; i++) {
+			bool added = tryInsert(p_x[i], p_y[i]);
+			p_accepted[i] = static_cast<uint8_t>(added);
+			accepted += added;
+		}
+		return accepted;
+	}
+
+	/**
+	 * Determine for each point of a batch whether there is a point in the
+	 * grid within mindist of it. The grid is not modified.
+	 *
+	 * @param const double *p_x
+	 * @param const double *p_y
+	 * @param size_t count
+	 * @param uint8_t *p_hasNeighbor
+	 */
+	inline void
+	query(const double *p_x, const double *p_y, size_t count, uint8_t *p_hasNeighbor) const {
+		for (size_t i = 0; i < count; i++) {
+			p_hasNeighbor[i] = static_cast<uint8_t>(hasNeighbor(p_x[i], p_y[i]));
+		}
+	}
+
+	/**
+	 * Determine for each point of a batch whether there is a point in the
+	 * grid within mindist of it, splitting the batch into (up to) threads chunks
+	 * which are checked on the given thread pool. The grid is not modified.
+	 *
+	 * The pool is created once by the caller and reused for every batch, this
+	 * function only waits for its own chunks to finish rather than joining the pool.
+	 *
+	 * Since points are only ever added to the grid, a point which has a neighbor
+	 * now will also be rejected by any later call to tryInsert(). Callers may
+	 * therefore query a batch of candidates in parallel, then call tryInsert() only
+	 * on the remaining candidates in their original order, and accept exactly the
+	 * same points as if every candidate was given to tryInsert() serially. Only the
+	 * rejection of candidates is parallel, the accepted points are still inserted
+	 * one at a time.
+	 *
+	 * @param const double *p_x
+	 * @param const double *p_y
+	 * @param size_t count
+	 * @param uint8_t *p_hasNeighbor
+	 * @param boost::asio::thread_pool& pool
+	 * @param int threads
+	 */
+	inline void
+	query(const double *p_x, const double *p_y, size_t count, uint8_t *p_hasNeighbor, boost::asio::thread_pool& pool, int threads) const {
+		size_t chunks = std::min<size_t>(threads > 1 ? threads : 1, count / 1024 + 1);
+		if (chunks <= 1) {
+			query(p_x, p_y, count, p_hasNeighbor);
+			return;
+		}
+
+		size_t chunkSize = (count + chunks - 1) / chunks;
+		std::vector<std::exception_ptr> errors(chunks);
+		std::latch done(static_cast<std::ptrdiff_t>(chunks));
+		for (size_t c = 0; c < chunks; c++) {
+			boost::asio::post(pool, [&, c] {
+				try {
+					size_t start = c * chunkSize;
+					size_t end = std::min(count, start + chunkSize);
+					if (start < end) {
+						query(p_x + start, p_y + start, end - start, p_hasNeighbor + start);
+					}
+				}
+				catch (...) {
+					errors[c] = std::current_exception();
+				}
+				done.count_down();
+			});
+		}
+		done.wait();
+
+		for (size_t c = 0; c < chunks; c++) {
+			if (errors[c]) {
+				std::rethrow_exception(errors[c]);
+			}
+		}
+	}
+};
+
+} //namespace grid
+} //namespace sgs
@@ -14,17 +14,24 @@
 
 #pragma once
 
+#include <algorithm>
+#include <bit>
 #include <iostream>
 #include <filesystem>
 #include <mutex>
+#include <type_traits>
 
 #include <xoshiro.h>
 #include <gdal_priv.h>
 #include <ogrsf_frmts.h>
 #include <ogr_core.h>
 
+#include "utils/profile.h"
+#include "utils/stats.h"
+
 #define MAXINT8		127
 #define MAXINT16	32767
+#define RAND_LANES	8
 
 namespace sgs {
 namespace helper {
@@ -237,6 +244,109 @@ setStrataPixelDependingOnType(
 	}
 }
 
+/**
+ * @ingroup helper
+ * Calls fn once with a std::type_identity<T> tag, where T is the C++ type of the
+ * pixels of a raster band of the given GDALDataType. This is how a kernel templated
+ * on the pixel type is chosen once per band or block, rather than switching on the
+ * type of every pixel as getPixelValueDependingOnType() does:
+ *
+ *	dispatchPixelType(band.type, [&](auto tag) {
+ *		using T = typename decltype(tag)::type;
+ *		kernel<T>(reinterpret_cast<T *>(band.p_buffer), ...);
+ *	});
+ *
+ * @param GDALDataType type
+ * @param F&& fn
+ * @returns the return value of fn, which must be the same for every type
+ */
+template <typename F>
+inline decltype(auto)
+dispatchPixelType(GDALDataType type, F&& fn) {
+	switch (type) {
+		case GDT_Int8:
+			return fn(std::type_identity<int8_t>{});
+		case GDT_UInt16:
+			return fn(std::type_identity<uint16_t>{});
+		case GDT_Int16:
+			return fn(std::type_identity<int16_t>{});
+		case GDT_UInt32:
+			return fn(std::type_identity<uint32_t>{});
+		case GDT_Int32:
+			return fn(std::type_identity<int32_t>{});
+		case GDT_Float32:
+			return fn(std::type_identity<float>{});
+		case GDT_Float64:
+			return fn(std::type_identity<double>{});
+		default:
+			throw std::runtime_error("raster pixel data type not supported.");
+	}
+}
+
+/**
+ * @ingroup helper
+ * Calls fn once with a std::type_identity<S> tag, where S is the C++ type of the
+ * pixels of a strat raster band of the given GDALDataType (see setStratBandTypeAndSize()).
+ *
+ * @param GDALDataType type
+ * @param F&& fn
+ * @returns the return value of fn, which must be the same for every type
+ */
+template <typename F>
+inline decltype(auto)
+dispatchStrataType(GDALDataType type, F&& fn) {
+	switch (type) {
+		case GDT_Int8:
+			return fn(std::type_identity<int8_t>{});
+		case GDT_Int16:
+			return fn(std::type_identity<int16_t>{});
+		case GDT_Int32:
+			return fn(std::type_identity<int32_t>{});
+		default:
+			throw std::runtime_error("strata pixel data type not supported.");
+	}
+}
+
+/**
+ * @ingroup helper
+ * The base case of dispatchFlags(), once every flag has been converted to a
+ * std::bool_constant.
+ *
+ * @param F&& fn
+ */
+template <bool... Flags, typename F>
+inline decltype(auto)
+dispatchFlags(F&& fn) {
+	return fn(std::bool_constant<Flags>{}...);
+}
+
+/**
+ * @ingroup helper
+ * Calls fn once with a std::bool_constant for each of the runtime flags given, so
+ * that a kernel can be specialized on whether, for example, the band has a nodata
+ * value or an access mask is used, and the check compiled out of the inner loop
+ * with 'if constexpr' when it isn't needed. Combined with dispatchPixelType(), a
+ * kernel is instantiated for every combination of pixel type and flags, and the
+ * combination is chosen once per band rather than once per pixel:
+ *
+ *	dispatchFlags([&](auto hasNoData, auto hasAccess) {
+ *		kernel<T, hasNoData, hasAccess>(...);
+ *	}, helper::hasNoDataValue(band.p_band), access.used);
+ *
+ * @param F&& fn
+ * @param bool flag
+ * @param Rest... rest
+ * @returns the return value of fn, which must be the same for every combination of flags
+ */
+template <bool... Flags, typename F, typename... Rest>
+inline decltype(auto)
+dispatchFlags(F&& fn, bool flag, Rest... rest) {
+	if (flag) {
+		return dispatchFlags<Flags..., true>(std::forward<F>(fn), rest...);
+	}
+	return dispatchFlags<Flags..., false>(std::forward<F>(fn), rest...);
+}
+
 /**
  * @ingroup helper
  * Helper function which prints a warning to the user if conversion
@@ -407,6 +517,11 @@ createDataset(
 		papszOptions = CSLSetNameValue(papszOptions, key.c_str(), val.c_str());
 	}
 
+	//statistics cached from a previous version of the file no longer apply
+	if (filename != "") {
+		stats::invalidateFileCache(filename.rfind("/vsi", 0) == 0 ? filename : std::filesystem::absolute(filename).lexically_normal().string());
+	}
+
 	GDALDataset *p_dataset = p_driver->Create(
 		filename.c_str(),
 		width,
@@ -459,13 +574,21 @@ createDataset(
  * raster band which was added is updated with a pointer to the
  * GDALRasterBand object.
  *
+ * The pixelOffset and lineOffset (in bytes) may be given to wrap
+ * an existing buffer which isn't contiguous, such as a strided numpy
+ * array. When they are 0 the buffer is expected to be contiguous.
+ *
  * @param GDALDataset *p_dataset
  * @param RasterBandMetaData& band
+ * @param GSpacing pixelOffset
+ * @param GSpacing lineOffset
  */
 inline void
 addBandToMEMDataset(
 	GDALDataset *p_dataset,
-	RasterBandMetaData& band)
+	RasterBandMetaData& band,
+	GSpacing pixelOffset = 0,
+	GSpacing lineOffset = 0)
 {
 	//allocate data buffer if it has not been allocated yet
 	if (!band.p_buffer) {
@@ -480,6 +603,12 @@ addBandToMEMDataset(
 	char **papszOptions = nullptr;
 	std::string datapointer = std::to_string((size_t)band.p_buffer);
 	papszOptions = CSLSetNameValue(papszOptions, "DATAPOINTER", datapointer.c_str());
+	if (pixelOffset != 0) {
+		papszOptions = CSLSetNameValue(papszOptions, "PIXELOFFSET", std::to_string(pixelOffset).c_str());
+	}
+	if (lineOffset != 0) {
+		papszOptions = CSLSetNameValue(papszOptions, "LINEOFFSET", std::to_string(lineOffset).c_str());
+	}
 
 	err = p_dataset->AddBand(band.type, papszOptions);
 	CSLDestroy(papszOptions);
@@ -622,7 +751,9 @@ addBandToVRTDataset(
  * of memory from or to a raster band. If the block size of
  * the band corresponds to the block size of the memory,
  * ReadBlock() or WriteBlock() may be used. Otherwise,
- * RasterIO is used. The boolean parameter 'read' lets
+ * RasterIO is used, with a line stride of the x block
+ * size of the memory so that partial blocks on the edge
+ * of the raster are not resampled. The boolean parameter 'read' lets
  * the function know whether the band should be read
  * to the buffer, or the buffer should be written to the
  * band.
@@ -656,8 +787,9 @@ rasterBandIO(
 			yBlockSize == band.yBlockSize;
 
 	if (threaded) {
-		band.p_mutex->lock();
+		profile::lock(band.p_mutex);
 	}
+	profile::IOScope io(band.p_band, static_cast<int64_t>(xValid) * yValid * band.size, read);
 	if (useBlock && read) {
 		err = read ?
 			band.p_band->ReadBlock(xBlock, yBlock, p_buffer) :
@@ -671,11 +803,11 @@ rasterBandIO(
 			xValid,
 			yValid,
 			p_buffer,
-			xBlockSize,
-			yBlockSize,
+			xValid,
+			yValid,
 			band.type,
 			0,
-			0
+			static_cast<GSpacing>(band.size) * xBlockSize
 		);
 	}
 	if (threaded) {
@@ -688,6 +820,49 @@ rasterBandIO(
 	}
 }
 
+/**
+ * @ingroup helper
+ * Whether a raster band has a nodata value set. Kernels specialized on this (see
+ * dispatchFlags()) skip comparing every pixel against the nodata value when it
+ * isn't, since GetNoDataValue() then returns a default which no pixel should match.
+ * A band without a GDALRasterBand is assumed to have one.
+ *
+ * @param GDALRasterBand *p_band
+ * @returns bool
+ */
+inline bool
+hasNoDataValue(GDALRasterBand *p_band) {
+	if (!p_band) {
+		return true;
+	}
+
+	int success = 0;
+	p_band->GetNoDataValue(&success);
+	return success != 0;
+}
+
+/**
+ * @ingroup helper
+ * Whether a raster band is read over a network, for example a COG behind
+ * /vsicurl/ or /vsis3/. Each read of such a band is at least one HTTP
+ * request, so readers of remote bands tell GDAL which windows are coming
+ * (see reader::BlockReader) so the requests can be coalesced and fetched
+ * in parallel. Bands of in-memory or virtual datasets are never remote.
+ *
+ * @param GDALRasterBand *p_band
+ * @returns bool
+ */
+inline bool
+isRemote(GDALRasterBand *p_band) {
+	GDALDataset *p_dataset = p_band ? p_band->GetDataset() : nullptr;
+	if (!p_dataset) {
+		return false;
+	}
+
+	std::string filename = p_dataset->GetDescription();
+	return !filename.empty() && !VSIIsLocal(filename.c_str());
+}
+
 /**
  * @ingroup helper
  * Helper function to add a point to a layer.
@@ -836,6 +1011,26 @@ class Variance {
 	double oldM = 0;
 	
 	public:
+	Variance() {}
+
+	/**
+	 * Constructor which restores a variance calculation from it's intermediate
+	 * values, as returned by getState(). This allows partial variance calculations
+	 * to be serialized, and merged on a different machine.
+	 *
+	 * @param const std::vector<double>& state {count, mean, sum of squares}
+	 */
+	Variance(const std::vector<double>& state) {
+		if (state.size() != 3) {
+			throw std::runtime_error("variance state must contain the count, mean, and sum of squares.");
+		}
+
+		this->k = static_cast<int64_t>(state[0]);
+		this->M = state[1];
+		this->S = state[2];
+		this->oldM = this->M;
+	}
+
 	inline void
 	/**
 	 * update the variance calculation with a new value.
@@ -884,6 +1079,48 @@ class Variance {
 	getCount() {
 		return this->k;
 	}
+
+	/**
+	 * get the intermediate values of the variance calculation, which
+	 * can be used to re-create it with the Variance(state) constructor.
+	 *
+	 * @returns std::vector<double> {count, mean, sum of squares}
+	 */
+	inline std::vector<double>
+	getState() {
+		return {static_cast<double>(this->k), this->M, this->S};
+	}
+
+	/**
+	 * merge another variance calculation into this one. This is used
+	 * when seperate portions of a raster are processed by different
+	 * threads, each with their own Variance. The pairwise update
+	 * is specified by Chan et al.
+	 * https://doi.org/10.1080/00031305.1983.10483115
+	 *
+	 * @param const Variance& other
+	 */
+	inline void
+	merge(const Variance& other) {
+		if (other.k == 0) {
+			return;
+		}
+
+		if (this->k == 0) {
+			*this = other;
+			return;
+		}
+
+		int64_t n = this->k + other.k;
+		double delta = other.M - this->M;
+		double dk = static_cast<double>(this->k);
+		double dok = static_cast<double>(other.k);
+
+		this->M = this->M + delta * dok / static_cast<double>(n);
+		this->S = this->S + other.S + delta * delta * dk * dok / static_cast<double>(n);
+		this->oldM = this->M;
+		this->k = n;
+	}
 };
 
 /**
@@ -960,7 +1197,7 @@ getProbabilityMultiplier(double width, double height, double pixelWidth, double
  * each pixel to see if it will be saved for potential sampling.
  *
  * The xoshiro random number generator is used because it is efficient and 
- * statistically sound. The specific generator used (xso::xoshrio_4x64_plus) is used
+ * statistically sound. The specific generator used (xoshiro256+) is used
  * because it is very fast. However, it's lowest 11 bits have low linear complexity (Blackman & Vigna).
  * 
  * We have no need for these lower 11 bits, instead using only the upper 53 bits of the uint64_t value.
@@ -968,22 +1205,56 @@ getProbabilityMultiplier(double width, double height, double pixelWidth, double
  * 1/(2^(56)), or roughly 1 sample per 10^16 pixels. If there were 10^16 pixels to process than a minimum of
  * multiple years would likely pass before execution finished.
  *
- * Rather than calling the generator on every iteration, the generator is repeatedly called at the 
- * beginning of a block for the remaining required pixels, and the true/false values for whether
- * to save a pixel or not are stored in a vector of type boolean.
+ * Rather than calling the generator on every iteration, the keep/reject decision of every pixel
+ * in a block is calculated at the beginning of the block, and stored as one bit per pixel in
+ * 64 bit words. The generator is run as RAND_LANES independent xoshiro256+ streams (seeded from
+ * the given generator) updated together, so the compiler can vectorize it. The multiplier is a
+ * run of n low bits, and a pixel is kept if n bits of the generator output are all 1, so the 53
+ * upper bits of every output are split into as many n bit fields as fit, each deciding one pixel.
+ * When only 1 in 1024 pixels are kept, this means 5 pixels are decided per random number.
+ *
+ * The block loops can then skip entire words of rejected pixels, see forEachKept().
  */
 class RandValController {
 private:
-	std::vector<bool> randVals;
-	size_t randValIndex = 0;
+	std::vector<uint64_t> masks;
+	size_t pixels = 0;
 	uint64_t multiplier = 0;
-	xso::xoshiro_4x64_plus *p_rng = nullptr;
+	int fieldBits = 0;
+	int fieldsPerDraw = 0;
 	bool alwaysTrue = false;
 
+	//state of each of the RAND_LANES xoshiro256+ streams
+	uint64_t s0[RAND_LANES];
+	uint64_t s1[RAND_LANES];
+	uint64_t s2[RAND_LANES];
+	uint64_t s3[RAND_LANES];
+
+	/**
+	 * advance each of the xoshiro256+ streams, writing one output per stream.
+	 *
+	 * @param uint64_t *p_out
+	 */
+	inline void
+	nextLanes(uint64_t *p_out) {
+		for (int l = 0; l < RAND_LANES; l++) {
+			p_out[l] = s0[l] + s3[l];
+
+			uint64_t t = s1[l] << 17;
+			s2[l] ^= s0[l];
+			s3[l] ^= s1[l];
+			s1[l] ^= s2[l];
+			s0[l] ^= s3[l];
+			s2[l] ^= t;
+			s3[l] = (s3[l] << 45) | (s3[l] >> 19);
+		}
+	}
+
 public:
 	/**
-	 * Constructor, sets the size of the boolean vector, and assigns the randValIndex, multiplier, and p_rng
-	 * member variables.
+	 * Constructor, sets the size of the mask vector, seeds the streams from p_rng, and
+	 * determines how many pixels can be decided from a single random value given the
+	 * multiplier.
 	 *
 	 * @param int xBlockSize
 	 * @param int yBlockSize
@@ -991,26 +1262,39 @@ public:
 	 * @param xso::xoshiro_4x64_plus *p_rng
 	 */
 	RandValController(int xBlockSize, int yBlockSize, uint64_t multiplier, xso::xoshiro_4x64_plus *p_rng) {
+		this->pixels = static_cast<size_t>(xBlockSize) * static_cast<size_t>(yBlockSize);
+		this->masks.resize((this->pixels + 63) / 64);
+
 		if (multiplier == 0) {
 			this->alwaysTrue = true;
+			std::fill(this->masks.begin(), this->masks.end(), UINT64_MAX);
+			return;
 		}
-		else {
-			this->randVals.resize(xBlockSize * yBlockSize);
-			this->randValIndex = static_cast<size_t>(xBlockSize * yBlockSize);
-			this->multiplier = multiplier;
-			this->p_rng = p_rng;
+
+		this->multiplier = multiplier;
+
+		//a multiplier which isn't a run of low bits is tested against a whole random value
+		bool lowBits = (multiplier & (multiplier + 1)) == 0;
+		this->fieldBits = lowBits ? std::popcount(multiplier) : 53;
+		this->fieldsPerDraw = lowBits ? std::max(1, 53 / this->fieldBits) : 1;
+
+		for (int l = 0; l < RAND_LANES; l++) {
+			do {
+				s0[l] = (*p_rng)();
+				s1[l] = (*p_rng)();
+				s2[l] = (*p_rng)();
+				s3[l] = (*p_rng)();
+			} while ((s0[l] | s1[l] | s2[l] | s3[l]) == 0);
 		}
 	}
 
 	/**
-	 * Calculates the true/false values from rand values, a number of times equal to the
-	 * number of used random values from the previous block. The return value of the
+	 * Calculates the keep/reject bit of every pixel in the block. The return value of the
 	 * random number generator is bit shifted by 11 to ignore the lower 11 bits, which
 	 * have low linear complexity.
 	 *
-	 * Next, the bit shifted random value is masked with the multiplier, and if the random
-	 * value contains a 1 in every bit which the multiplier does, true is added to the rand
-	 * val vector.
+	 * Next, each field of the bit shifted random value is masked with the multiplier, and
+	 * if the field contains a 1 in every bit which the multiplier does, the pixel is kept.
 	 *
 	 * This function is called before iterating through a new block.
 	 */
@@ -1020,82 +1304,91 @@ public:
 			return;
 		}
 
-		for (size_t i = 0; i < randValIndex; i++) {
-			randVals[i] = (((*p_rng)() >> 11) & multiplier) == multiplier;
+		uint64_t out[RAND_LANES];
+		uint64_t word = 0;
+		size_t bit = 0;
+		size_t w = 0;
+		while (bit < this->pixels) {
+			nextLanes(out);
+
+			for (int l = 0; l < RAND_LANES && bit < this->pixels; l++) {
+				uint64_t r = out[l] >> 11;
+
+				for (int f = 0; f < this->fieldsPerDraw && bit < this->pixels; f++) {
+					word |= static_cast<uint64_t>((r & this->multiplier) == this->multiplier) << (bit & 63);
+					r >>= this->fieldBits;
+					bit++;
+
+					if ((bit & 63) == 0) {
+						this->masks[w] = word;
+						word = 0;
+						w++;
+					}
+				}
+			}
+		}
+
+		if (bit & 63) {
+			this->masks[w] = word;
 		}
-		randValIndex = 0;
 	}
 
 	/**
-	 * get the next boolean value from the storage vector, and increment the index of this vector.
+	 * get whether the pixel at the given index within the block is to be kept.
+	 *
+	 * @param size_t blockIndex
+	 * @returns bool
 	 */
-	inline bool 
-	next(void) {
-		if (alwaysTrue) {
-			return true;
-		}
-
-		bool retval = randVals[randValIndex];
-		randValIndex++;
-		return retval;
+	inline bool
+	keep(size_t blockIndex) const {
+		return (this->masks[blockIndex >> 6] >> (blockIndex & 63)) & 1;
 	}
-};
 
-/**
- * @ingroup helper
- * This is the hashing function used to store the points for spatial indexing during sampling.
- */
-struct PointHash {
-	inline std::size_t operator()(const std::pair<int, int> &v) const {
-		std::size_t h1 = std::hash<int>{}(v.first);
-		std::size_t h2 = std::hash<int>{}(v.second);
-		return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2));
+	/**
+	 * get the 64 bit keep masks of the block, where bit i of word w
+	 * corresponds to the pixel at block index (w * 64 + i).
+	 *
+	 * @returns const uint64_t *
+	 */
+	inline const uint64_t *
+	getMasks(void) const {
+		return this->masks.data();
 	}
-};
 
-/**
- * @ingroup helper
- * This is a type alias for the neighborhood used for spatial hashing during sampling.
- */
-typedef std::unordered_map<std::pair<int, int>, std::vector<std::pair<double, double>>, PointHash> NeighborMap;
-
-/**
- * @ingroup helper
- * This is the spatial hashing core implementation if a minimum distance is provided.
- * @param double x
- * @param double y
- * @param NeighborMap& neighbor_map
- * @param float mindist
- * @param float mindist_sq
- */
-inline bool is_valid_sample(double x, double y, NeighborMap& neighbor_map, float mindist, float mindist_sq) {
-	int cx = static_cast<int>(std::floor(x / mindist));
-	int cy = static_cast<int>(std::floor(y / mindist));
-
-	for (int dx = -1; dx <= 1; dx++) {
-		for (int dy = -1; dy <= 1; dy++) {
-			std::pair<int, int> neighbor = {cx + dx, cy + dy};
-
-			auto it = neighbor_map.find(neighbor);
-			if (it == neighbor_map.end())
-				continue;
+	/**
+	 * call func(blockIndex) for every kept pixel with a block index in [start, end),
+	 * in increasing order. Words of the mask with no kept pixels are skipped entirely,
+	 * and the kept pixels within a word are found using count trailing zeros.
+	 *
+	 * @param size_t start
+	 * @param size_t end
+	 * @param F func
+	 */
+	template <typename F>
+	inline void
+	forEachKept(size_t start, size_t end, F func) const {
+		if (start >= end) {
+			return;
+		}
 
-			for (const auto &[nx, ny] : it->second) {
-				float dxp = x - nx;
-				float dyp = y - ny;
-				float dist_sq = dxp * dxp + dyp * dyp;
+		size_t first = start >> 6;
+		size_t last = (end - 1) >> 6;
+		for (size_t w = first; w <= last; w++) {
+			uint64_t mask = this->masks[w];
+			if (w == first) {
+				mask &= UINT64_MAX << (start & 63);
+			}
+			if (w == last && (end & 63)) {
+				mask &= UINT64_MAX >> (64 - (end & 63));
+			}
 
-				if (dist_sq < mindist_sq) {
-					return false;
-				}
+			while (mask) {
+				func((w << 6) + static_cast<size_t>(std::countr_zero(mask)));
+				mask &= mask - 1;
 			}
 		}
 	}
-
-	// add point to neighborhood
-	neighbor_map[{cx, cy}].emplace_back(x, y);
-	return true;
-}
+};
 
 /**
  * @ingroup helper
@@ -0,0 +1,480 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: streaming quantile matrices of multi-band rasters
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup hypercube hypercube
+ * @ingroup utils
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+#include <gdal_priv.h>
+
+#include "utils/helper.h"
+#include "utils/raster.h"
+#include "utils/reader.h"
+#include "utils/sketch.h"
+#include "utils/vector.h"
+
+namespace sgs {
+namespace hypercube {
+
+/**
+ * @ingroup hypercube
+ * The number of chunks of rows of blocks forEachPixel() splits a raster into,
+ * so that per-chunk results can be allocated before it is called.
+ *
+ * @param int height
+ * @param int yBlockSize
+ * @param int threads
+ * @returns int
+ */
+inline int
+chunkCount(int height, int yBlockSize, int threads) {
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	return (yBlocks + chunkSize - 1) / chunkSize;
+}
+
+/**
+ * @ingroup hypercube
+ * Call fn(chunk, p_features, x, y, accessible) for every pixel of the raster which
+ * is not nan in any of the bands, where p_features points to the values of every band
+ * at that pixel as type T. The raster is split into chunks of rows of blocks which are
+ * processed on a pool of threads, one task per chunk, so calls with the same chunk
+ * never happen at the same time and per-chunk results need no synchronization.
+ *
+ * The bands are read into a single interleaved buffer by a reader::BlockReader. If
+ * p_access is given, the access band is read alongside them, and accessible is false
+ * for pixels which fall outside of the accessible area. Otherwise every pixel is
+ * accessible. An exception thrown by fn is re-thrown once every task has finished.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param RasterBandMetaData *p_access
+ * @param int width
+ * @param int height
+ * @param int threads
+ * @param F fn
+ */
+template <typename T, typename F>
+void
+forEachPixel(
+	std::vector<helper::RasterBandMetaData>& bands,
+	helper::RasterBandMetaData *p_access,
+	int width,
+	int height,
+	int threads,
+	F fn)
+{
+	int nFeat = static_cast<int>(bands.size());
+	int xBlockSize = bands[0].xBlockSize;
+	int yBlockSize = bands[0].yBlockSize;
+	GDALDataType type = std::is_same_v<T, double> ? GDT_Float64 : GDT_Float32;
+
+	int yBlocks = (height + yBlockSize - 1) / yBlockSize;
+	int chunkSize = std::max(1, (yBlocks + threads - 1) / threads);
+	int chunks = (yBlocks + chunkSize - 1) / chunkSize;
+
+	std::vector<helper::RasterBandMetaData *> p_bands(nFeat);
+	for (int b = 0; b < nFeat; b++) {
+		p_bands[b] = &bands[b];
+	}
+
+	std::vector<std::exception_ptr> errors(chunks, nullptr);
+	boost::asio::thread_pool pool(threads);
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		int yBlockStart = chunk * chunkSize;
+		int yBlockEnd = std::min(yBlocks, yBlockStart + chunkSize);
+
+		boost::asio::post(pool, [&, chunk, yBlockStart, yBlockEnd] {
+			try {
+				std::vector<reader::Window> windows = reader::blockWindows(xBlockSize, yBlockSize, width, height, yBlockStart, yBlockEnd);
+				reader::BlockReader blocks(p_bands, windows, xBlockSize, yBlockSize, type, sizeof(T));
+
+				std::unique_ptr<reader::BlockReader> p_accessBlocks;
+				if (p_access) {
+					p_accessBlocks = std::make_unique<reader::BlockReader>(
+						std::vector<helper::RasterBandMetaData *>{p_access},
+						windows,
+						xBlockSize,
+						yBlockSize
+					);
+				}
+
+				std::vector<bool> isNan(nFeat);
+				while (reader::Block *p_block = blocks.next()) {
+					T *p_data = reinterpret_cast<T *>(p_block->buffers[0]);
+					int8_t *p_accessData = p_accessBlocks ?
+						reinterpret_cast<int8_t *>(p_accessBlocks->next()->buffers[0]) :
+						nullptr;
+
+					const reader::Window& window = p_block->window;
+					for (int y = 0; y < window.yValid; y++) {
+						size_t index = static_cast<size_t>(y) * xBlockSize;
+						for (int x = 0; x < window.xValid; x++) {
+							const T *p_features = p_data + index * nFeat;
+
+							bool nan = false;
+							for (int b = 0; b < nFeat && !nan; b++) {
+								nan = std::isnan(p_features[b]) || p_features[b] == static_cast<T>(bands[b].nan);
+							}
+
+							if (!nan) {
+								bool accessible = !p_accessData || p_accessData[index] != 1;
+								fn(chunk, p_features, window.xOff + x, window.yOff + y, accessible);
+							}
+							index++;
+						}
+					}
+				}
+			}
+			catch (...) {
+				errors[chunk] = std::current_exception();
+			}
+		});
+	}
+	pool.join();
+
+	for (const std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+/**
+ * @ingroup hypercube
+ * This struct represents the quantile matrix of a set of raster bands, the
+ * description of the feature space used by the latin hypercube methods. Each band
+ * is split into nQuant quantiles with equal probability, and the matrix stores the
+ * number of pixels which fall within each quantile of each band:
+ *
+ * std::vector<std::vector<double>> breaks:
+ * 	the nQuant - 1 break values of each band. A value v is in quantile q
+ * 	of band b if breaks[b][q - 1] <= v < breaks[b][q], the same as quantiles().
+ *
+ * std::vector<int64_t> counts:
+ * 	the number of pixels within each quantile of each band, indexed by
+ * 	b * nQuant + q. If a band has many tied values, some quantiles may be empty.
+ *
+ * int64_t pixels:
+ * 	the number of pixels which are not nan in any band.
+ */
+struct QuantileMatrix {
+	int nQuant = 0;
+	std::vector<std::vector<double>> breaks;
+	std::vector<int64_t> counts;
+	int64_t pixels = 0;
+
+	/**
+	 * The quantile of band b a value falls within.
+	 *
+	 * @param int b
+	 * @param double value
+	 * @returns int
+	 */
+	inline int
+	quantile(int b, double value) const {
+		const std::vector<double>& bandBreaks = this->breaks[b];
+		return static_cast<int>(std::upper_bound(bandBreaks.begin(), bandBreaks.end(), value) - bandBreaks.begin());
+	}
+
+	/**
+	 * The fraction of pixels within quantile q of band b.
+	 *
+	 * @param int b
+	 * @param int q
+	 * @returns double
+	 */
+	inline double
+	density(int b, int q) const {
+		return this->pixels == 0 ? 0 : static_cast<double>(this->counts[static_cast<size_t>(b) * this->nQuant + q]) / static_cast<double>(this->pixels);
+	}
+};
+
+/**
+ * @ingroup hypercube
+ * Calculate the break values of the quantile matrix of a set of bands. Each chunk of
+ * the raster adds its pixels to its own QuantileSketch per band (see utils/sketch.h),
+ * and the sketches are merged once every chunk is read, as in quantiles(). The rank
+ * of every break is within eps times the number of pixels of its exact rank. Only
+ * pixels which are not nan in any band are used, so every band describes the same
+ * population of pixels.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param int width
+ * @param int height
+ * @param int nQuant
+ * @param double eps
+ * @param int threads
+ * @returns std::vector<std::vector<double>>
+ */
+template <typename T>
+std::vector<std::vector<double>>
+calculateBreaks(
+	std::vector<helper::RasterBandMetaData>& bands,
+	int width,
+	int height,
+	int nQuant,
+	double eps,
+	int threads)
+{
+	int nFeat = static_cast<int>(bands.size());
+	int chunks = chunkCount(height, bands[0].yBlockSize, threads);
+
+	size_t k = sketch::sketchCapacity(eps, static_cast<int64_t>(width) * static_cast<int64_t>(height));
+	std::vector<std::vector<sketch::QuantileSketch<T>>> sketches(
+		chunks,
+		std::vector<sketch::QuantileSketch<T>>(nFeat, sketch::QuantileSketch<T>(k))
+	);
+
+	forEachPixel<T>(bands, nullptr, width, height, threads, [&sketches, nFeat](int chunk, const T *p_features, int, int, bool) {
+		for (int b = 0; b < nFeat; b++) {
+			sketches[chunk][b].update(p_features[b]);
+		}
+	});
+
+	std::vector<double> probabilities(nQuant - 1);
+	for (int q = 1; q < nQuant; q++) {
+		probabilities[q - 1] = static_cast<double>(q) / static_cast<double>(nQuant);
+	}
+
+	std::vector<std::vector<double>> breaks(nFeat);
+	for (int b = 0; b < nFeat; b++) {
+		for (int chunk = 1; chunk < chunks; chunk++) {
+			sketches[0][b].merge(sketches[chunk][b]);
+		}
+
+		if (sketches[0][b].size() == 0) {
+			throw std::runtime_error("every pixel of the raster is nan in at least one band.");
+		}
+		breaks[b] = sketches[0][b].quantiles(probabilities);
+	}
+
+	return breaks;
+}
+
+/**
+ * @ingroup hypercube
+ * Calculate the quantile matrix of a set of bands, using one pass over the raster
+ * to calculate the breaks with calculateBreaks() and a second to count the pixels
+ * within each quantile. Each chunk counts into it's own matrix, and the counts are
+ * summed once every chunk is read.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param int width
+ * @param int height
+ * @param int nQuant
+ * @param double eps
+ * @param int threads
+ * @returns QuantileMatrix
+ */
+template <typename T>
+QuantileMatrix
+calculateMatrix(
+	std::vector<helper::RasterBandMetaData>& bands,
+	int width,
+	int height,
+	int nQuant,
+	double eps,
+	int threads)
+{
+	int nFeat = static_cast<int>(bands.size());
+	int chunks = chunkCount(height, bands[0].yBlockSize, threads);
+
+	QuantileMatrix matrix;
+	matrix.nQuant = nQuant;
+	matrix.breaks = calculateBreaks<T>(bands, width, height, nQuant, eps, threads);
+
+	std::vector<std::vector<int64_t>> counts(chunks, std::vector<int64_t>(static_cast<size_t>(nFeat) * nQuant, 0));
+	std::vector<int64_t> pixels(chunks, 0);
+	forEachPixel<T>(bands, nullptr, width, height, threads, [&](int chunk, const T *p_features, int, int, bool) {
+		for (int b = 0; b < nFeat; b++) {
+			counts[chunk][static_cast<size_t>(b) * nQuant + matrix.quantile(b, p_features[b])]++;
+		}
+		pixels[chunk]++;
+	});
+
+	matrix.counts.assign(static_cast<size_t>(nFeat) * nQuant, 0);
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		for (size_t i = 0; i < matrix.counts.size(); i++) {
+			matrix.counts[i] += counts[chunk][i];
+		}
+		matrix.pixels += pixels[chunk];
+	}
+
+	return matrix;
+}
+
+/**
+ * @ingroup hypercube
+ * Get the pixel coordinates of every point in the single layer of an existing
+ * sample network. Points outside of the raster are skipped. Unlike existing::Existing,
+ * two points within the same pixel are both kept, since they are separate samples.
+ *
+ * @param GDALVectorWrapper *p_existing
+ * @param GDALRasterWrapper *p_raster
+ * @param std::vector<int>& pixelX
+ * @param std::vector<int>& pixelY
+ */
+inline void
+existingPixels(
+	vector::GDALVectorWrapper *p_existing,
+	raster::GDALRasterWrapper *p_raster,
+	std::vector<int>& pixelX,
+	std::vector<int>& pixelY)
+{
+	std::vector<std::string> layerNames = p_existing->getLayerNames();
+	if (layerNames.size() != 1) {
+		throw std::runtime_error("the file containing existing sample points must have only a single layer.");
+	}
+	OGRLayer *p_layer = p_existing->getLayer(layerNames[0]);
+
+	OGRSpatialReference rastSRS;
+	rastSRS.importFromWkt(p_raster->getDataset()->GetProjectionRef());
+	if (!rastSRS.IsSame(p_layer->GetSpatialRef())) {
+		throw std::runtime_error("existing sample vector and raster do not have the same spatial reference system.");
+	}
+
+	double IGT[6];
+	GDALInvGeoTransform(p_raster->getGeotransform(), IGT);
+	int width = p_raster->getWidth();
+	int height = p_raster->getHeight();
+
+	auto addPoint = [&](const OGRPoint *p_point) {
+		double x = IGT[0] + p_point->getX() * IGT[1] + p_point->getY() * IGT[2];
+		double y = IGT[3] + p_point->getX() * IGT[4] + p_point->getY() * IGT[5];
+		if (x >= 0 && y >= 0 && x < width && y < height) {
+			pixelX.push_back(static_cast<int>(x));
+			pixelY.push_back(static_cast<int>(y));
+		}
+	};
+
+	for (const auto& p_feature : *p_layer) {
+		OGRGeometry *p_geometry = p_feature->GetGeometryRef();
+		switch (wkbFlatten(p_geometry->getGeometryType())) {
+			case OGRwkbGeometryType::wkbPoint:
+				addPoint(p_geometry->toPoint());
+				break;
+			case OGRwkbGeometryType::wkbMultiPoint:
+				for (const auto& p_point : *p_geometry->toMultiPoint()) {
+					addPoint(p_point);
+				}
+				break;
+			default:
+				throw std::runtime_error("the file containing existing sample points must have only Point or MultiPoint geometries.");
+		}
+	}
+}
+
+/**
+ * @ingroup hypercube
+ * Count the existing samples within each quantile of each band of a quantile matrix,
+ * in the same b * nQuant + q layout as QuantileMatrix::counts. The values of the bands
+ * at the samples are read with reader::readPixels(), so only the blocks containing a
+ * sample are read. Samples which are nan in any band are not counted.
+ *
+ * @param std::vector<RasterBandMetaData>& bands
+ * @param const QuantileMatrix& matrix
+ * @param std::vector<int>& pixelX
+ * @param std::vector<int>& pixelY
+ * @param int width
+ * @param int height
+ * @param int threads
+ * @param int64_t& samples the number of samples counted
+ * @returns std::vector<int64_t>
+ */
+inline std::vector<int64_t>
+countSamples(
+	std::vector<helper::RasterBandMetaData>& bands,
+	const QuantileMatrix& matrix,
+	std::vector<int>& pixelX,
+	std::vector<int>& pixelY,
+	int width,
+	int height,
+	int threads,
+	int64_t& samples)
+{
+	int nFeat = static_cast<int>(bands.size());
+	std::vector<helper::RasterBandMetaData *> p_bands(nFeat);
+	for (int b = 0; b < nFeat; b++) {
+		p_bands[b] = &bands[b];
+	}
+
+	//each sample is written by exactly one call, so no locking is required
+	size_t n = pixelX.size();
+	std::vector<int> quantiles(n * nFeat, -1);
+	if (n > 0) {
+		reader::readPixels(p_bands, pixelX.data(), pixelY.data(), n, width, height, threads, [&](size_t i, const double *p_values) {
+			for (int b = 0; b < nFeat; b++) {
+				if (std::isnan(p_values[b]) || p_values[b] == bands[b].nan) {
+					return;
+				}
+			}
+			for (int b = 0; b < nFeat; b++) {
+				quantiles[i * nFeat + b] = matrix.quantile(b, p_values[b]);
+			}
+		});
+	}
+
+	samples = 0;
+	std::vector<int64_t> counts(static_cast<size_t>(nFeat) * matrix.nQuant, 0);
+	for (size_t i = 0; i < n; i++) {
+		if (quantiles[i * nFeat] == -1) {
+			continue;
+		}
+		for (int b = 0; b < nFeat; b++) {
+			counts[static_cast<size_t>(b) * matrix.nQuant + quantiles[i * nFeat + b]]++;
+		}
+		samples++;
+	}
+
+	return counts;
+}
+
+/**
+ * @ingroup hypercube
+ * Get the metadata of every band of a raster, with a single shared mutex, and the
+ * type every band is processed as (double if any band is double, otherwise float).
+ *
+ * @param GDALRasterWrapper *p_raster
+ * @param std::mutex *p_mutex
+ * @param GDALDataType& type
+ * @returns std::vector<RasterBandMetaData>
+ */
+inline std::vector<helper::RasterBandMetaData>
+getBands(raster::GDALRasterWrapper *p_raster, std::mutex *p_mutex, GDALDataType& type) {
+	std::vector<helper::RasterBandMetaData> bands(p_raster->getBandCount());
+	type = GDT_Float32;
+	for (size_t i = 0; i < bands.size(); i++) {
+		bands[i].p_band = p_raster->getRasterBand(i);
+		bands[i].type = p_raster->getRasterBandType(i);
+		bands[i].size = p_raster->getRasterBandTypeSize(i);
+		bands[i].nan = bands[i].p_band->GetNoDataValue();
+		bands[i].p_mutex = p_mutex;
+		bands[i].p_band->GetBlockSize(&bands[i].xBlockSize, &bands[i].yBlockSize);
+
+		if (bands[i].type == GDT_Float64) {
+			type = GDT_Float64;
+		}
+	}
+	return bands;
+}
+
+} //namespace hypercube
+} //namespace sgs
@@ -0,0 +1,457 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: lightweight timing and I/O instrumentation
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup profile profile
+ * @ingroup utils
+ *
+ * Instrumentation of where time is spent within the sgs functions: reading and
+ * writing raster bands, waiting on the mutex of a band, waiting on a BlockReader,
+ * and the high level phases of a function (such as scanning the raster, and
+ * selecting or annealing the samples).
+ *
+ * Nothing is recorded unless a profile is started with start(), so the cost of
+ * the instrumentation when it is not in use is a single relaxed atomic load per
+ * scope. While a profile is running, phases are accumulated in lock-free counters,
+ * while the per band counters (and trace events, if tracing) are accumulated under
+ * a mutex once per block read or written.
+ *
+ * Building with SGS_PROFILE defined as 0 (the 'profiling' meson option) removes the
+ * instrumentation entirely, in which case start() and stop() still exist but the
+ * profile is always empty.
+ *
+ * The profile is process wide, so if multiple sgs functions run at once from
+ * different Python threads, their counters are combined.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <gdal_priv.h>
+
+#ifndef SGS_PROFILE
+#define SGS_PROFILE 1
+#endif
+
+namespace sgs {
+namespace profile {
+
+/**
+ * @ingroup profile
+ * The phases which time is accumulated within. READ, WRITE, LOCK_WAIT and
+ * BLOCK_WAIT are recorded by the raster I/O functions, the remaining phases
+ * are recorded by the sgs functions themselves.
+ */
+enum Phase {
+	SETUP = 0,
+	SCAN,
+	SELECT,
+	ANNEAL,
+	OUTPUT,
+	READ,
+	WRITE,
+	LOCK_WAIT,
+	BLOCK_WAIT,
+	PHASE_COUNT
+};
+
+inline const char *
+phaseName(Phase phase) {
+	static const char *names[PHASE_COUNT] = {
+		"setup",
+		"scan",
+		"select",
+		"anneal",
+		"output",
+		"read",
+		"write",
+		"lock_wait",
+		"block_wait",
+	};
+	return names[phase];
+}
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @ingroup profile
+ * The I/O counters of a single raster band.
+ */
+struct BandCounters {
+	std::string name;
+	int64_t blocksRead = 0;
+	int64_t bytesRead = 0;
+	int64_t readNs = 0;
+	int64_t blocksWritten = 0;
+	int64_t bytesWritten = 0;
+	int64_t writeNs = 0;
+};
+
+/**
+ * @ingroup profile
+ * A single timed scope, as an event of a Chrome trace.
+ */
+struct TraceEvent {
+	Phase phase;
+	int thread;
+	int64_t startNs;
+	int64_t durationNs;
+};
+
+/**
+ * @ingroup profile
+ * The stats returned by stop(), which are:
+ * 	- the wall time of the profile in seconds,
+ * 	- the name, total seconds (summed over threads) and count of every phase,
+ * 	- the name, blocks read, bytes read, read seconds, blocks written, bytes written,
+ * 	  and write seconds of every band which was read or written,
+ * 	- the number of annealing iterations,
+ * 	- the phase name, thread, start and duration in microseconds of every trace event.
+ */
+using Stats = std::tuple<
+	double,
+	std::vector<std::tuple<std::string, double, int64_t>>,
+	std::vector<std::tuple<std::string, int64_t, int64_t, double, int64_t, int64_t, double>>,
+	int64_t,
+	std::vector<std::tuple<std::string, int, double, double>>
+>;
+
+/**
+ * @ingroup profile
+ * The process wide profiler. Profiles may be nested (for example, a function called
+ * with stats=True from within an sgspy.profile() block), in which case only the outer
+ * most start() resets the counters and stop() returns the counters accumulated so far.
+ */
+class Profiler {
+	private:
+	std::atomic<int> depth{0};
+	std::atomic<bool> tracing{false};
+	Clock::time_point origin;
+
+	std::array<std::atomic<int64_t>, PHASE_COUNT> phaseNs{};
+	std::array<std::atomic<int64_t>, PHASE_COUNT> phaseCounts{};
+	std::atomic<int64_t> iterations{0};
+
+	std::mutex mutex;
+	std::unordered_map<GDALRasterBand *, BandCounters> bands;
+	std::unordered_map<std::thread::id, int> threads;
+	std::vector<TraceEvent> events;
+
+	int64_t
+	sinceOrigin(Clock::time_point time) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(time - this->origin).count();
+	}
+
+	/**
+	 * A small integer id for the calling thread, since std::thread::id can't be
+	 * written to a trace. Must be called with the mutex locked.
+	 */
+	int
+	threadId() {
+		auto [it, inserted] = this->threads.try_emplace(std::this_thread::get_id(), static_cast<int>(this->threads.size()));
+		return it->second;
+	}
+
+	public:
+	bool
+	enabled() {
+		return this->depth.load(std::memory_order_relaxed) > 0;
+	}
+
+	/**
+	 * Start a profile, resetting every counter if there isn't already one running.
+	 *
+	 * @param bool trace
+	 */
+	void
+	start(bool trace) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (this->depth.load() == 0) {
+			for (int i = 0; i < PHASE_COUNT; i++) {
+				this->phaseNs[i].store(0);
+				this->phaseCounts[i].store(0);
+			}
+			this->iterations.store(0);
+			this->bands.clear();
+			this->threads.clear();
+			this->events.clear();
+			this->tracing.store(false);
+			this->origin = Clock::now();
+		}
+		if (trace) {
+			this->tracing.store(true);
+		}
+		this->depth.fetch_add(1);
+	}
+
+	/**
+	 * Stop a profile, returning the stats accumulated since the outer most start().
+	 *
+	 * @returns Stats
+	 */
+	Stats
+	stop() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (this->depth.load() > 0) {
+			this->depth.fetch_sub(1);
+		}
+
+		double seconds = static_cast<double>(sinceOrigin(Clock::now())) / 1e9;
+
+		std::vector<std::tuple<std::string, double, int64_t>> phases;
+		for (int i = 0; i < PHASE_COUNT; i++) {
+			phases.push_back({
+				phaseName(static_cast<Phase>(i)),
+				static_cast<double>(this->phaseNs[i].load()) / 1e9,
+				this->phaseCounts[i].load()
+			});
+		}
+
+		std::vector<std::tuple<std::string, int64_t, int64_t, double, int64_t, int64_t, double>> bandStats;
+		for (const auto& [p_band, counters] : this->bands) {
+			bandStats.push_back({
+				counters.name,
+				counters.blocksRead,
+				counters.bytesRead,
+				static_cast<double>(counters.readNs) / 1e9,
+				counters.blocksWritten,
+				counters.bytesWritten,
+				static_cast<double>(counters.writeNs) / 1e9
+			});
+		}
+
+		std::vector<std::tuple<std::string, int, double, double>> trace;
+		trace.reserve(this->events.size());
+		for (const TraceEvent& event : this->events) {
+			trace.push_back({
+				phaseName(event.phase),
+				event.thread,
+				static_cast<double>(event.startNs) / 1e3,
+				static_cast<double>(event.durationNs) / 1e3
+			});
+		}
+
+		return {seconds, phases, bandStats, this->iterations.load(), trace};
+	}
+
+	/**
+	 * Add the time between start and end to a phase.
+	 *
+	 * @param Phase phase
+	 * @param Clock::time_point start
+	 * @param Clock::time_point end
+	 */
+	void
+	addPhase(Phase phase, Clock::time_point start, Clock::time_point end) {
+		int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		this->phaseNs[phase].fetch_add(ns, std::memory_order_relaxed);
+		this->phaseCounts[phase].fetch_add(1, std::memory_order_relaxed);
+
+		if (this->tracing.load(std::memory_order_relaxed)) {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->events.push_back({phase, threadId(), sinceOrigin(start), ns});
+		}
+	}
+
+	/**
+	 * Add a block read from or written to a band.
+	 *
+	 * @param GDALRasterBand *p_band
+	 * @param int64_t bytes
+	 * @param bool read
+	 * @param Clock::time_point start
+	 * @param Clock::time_point end
+	 */
+	void
+	addIO(GDALRasterBand *p_band, int64_t bytes, bool read, Clock::time_point start, Clock::time_point end) {
+		addPhase(read ? READ : WRITE, start, end);
+
+		int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto [it, inserted] = this->bands.try_emplace(p_band);
+		BandCounters& counters = it->second;
+		if (inserted) {
+			GDALDataset *p_dataset = p_band->GetDataset();
+			std::string description = p_band->GetDescription();
+			counters.name = (p_dataset ? std::string(p_dataset->GetDescription()) : std::string("")) +
+				":" + std::to_string(p_band->GetBand()) +
+				(description.empty() ? "" : " (" + description + ")");
+		}
+
+		if (read) {
+			counters.blocksRead++;
+			counters.bytesRead += bytes;
+			counters.readNs += ns;
+		}
+		else {
+			counters.blocksWritten++;
+			counters.bytesWritten += bytes;
+			counters.writeNs += ns;
+		}
+	}
+
+	void
+	addIterations(int64_t count) {
+		this->iterations.fetch_add(count, std::memory_order_relaxed);
+	}
+};
+
+inline Profiler&
+profiler() {
+	static Profiler instance;
+	return instance;
+}
+
+/**
+ * @ingroup profile
+ * Start a (possibly nested) profile.
+ *
+ * @param bool trace
+ */
+inline void
+start(bool trace) {
+	profiler().start(trace);
+}
+
+/**
+ * @ingroup profile
+ * Stop a profile, returning it's stats.
+ *
+ * @returns Stats
+ */
+inline Stats
+stop() {
+	return profiler().stop();
+}
+
+/**
+ * @ingroup profile
+ * Adds the time from it's construction to it's destruction to a phase, if a
+ * profile was running when it was constructed.
+ */
+class Scope {
+	private:
+	Phase phase;
+	bool active;
+	Clock::time_point begin;
+
+	public:
+	Scope(Phase phase) : phase(phase) {
+		this->active = SGS_PROFILE && profiler().enabled();
+		if (this->active) {
+			this->begin = Clock::now();
+		}
+	}
+
+	~Scope() {
+		if (this->active) {
+			profiler().addPhase(this->phase, this->begin, Clock::now());
+		}
+	}
+
+	/**
+	 * Ends the current phase and starts the next, for functions which are
+	 * made up of a sequence of phases.
+	 *
+	 * @param Phase next
+	 */
+	void
+	next(Phase next) {
+		if (this->active) {
+			Clock::time_point now = Clock::now();
+			profiler().addPhase(this->phase, this->begin, now);
+			this->begin = now;
+		}
+		this->phase = next;
+	}
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+};
+
+/**
+ * @ingroup profile
+ * Records a block read from or written to a band, timed from it's construction
+ * to it's destruction, if a profile was running when it was constructed.
+ */
+class IOScope {
+	private:
+	GDALRasterBand *p_band;
+	int64_t bytes;
+	bool read;
+	bool active;
+	Clock::time_point begin;
+
+	public:
+	IOScope(GDALRasterBand *p_band, int64_t bytes, bool read) : p_band(p_band), bytes(bytes), read(read) {
+		this->active = SGS_PROFILE && profiler().enabled();
+		if (this->active) {
+			this->begin = Clock::now();
+		}
+	}
+
+	~IOScope() {
+		if (this->active) {
+			profiler().addIO(this->p_band, this->bytes, this->read, this->begin, Clock::now());
+		}
+	}
+
+	IOScope(const IOScope&) = delete;
+	IOScope& operator=(const IOScope&) = delete;
+};
+
+/**
+ * @ingroup profile
+ * Locks a mutex, adding the time spent waiting for it to LOCK_WAIT. The clock
+ * is only read if the mutex is contended, so an uncontended lock costs a single
+ * try_lock() as it otherwise would.
+ *
+ * @param std::mutex *p_mutex
+ */
+inline void
+lock(std::mutex *p_mutex) {
+	if (SGS_PROFILE && profiler().enabled()) {
+		if (p_mutex->try_lock()) {
+			return;
+		}
+
+		Clock::time_point begin = Clock::now();
+		p_mutex->lock();
+		profiler().addPhase(LOCK_WAIT, begin, Clock::now());
+		return;
+	}
+
+	p_mutex->lock();
+}
+
+/**
+ * @ingroup profile
+ * Adds a number of annealing iterations to the profile.
+ *
+ * @param int64_t count
+ */
+inline void
+addIterations(int64_t count) {
+	if (SGS_PROFILE && profiler().enabled()) {
+		profiler().addIterations(count);
+	}
+}
+
+} //namespace profile
+} //namespace sgs
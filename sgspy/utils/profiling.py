@@ -0,0 +1,132 @@
+# ******************************************************************************
+#
+#  Project: sgs
+#  Purpose: timing and I/O counters of the C++ functions
+#  Author: Joseph Meyer
+#  Date: October, 2026
+#
+# ******************************************************************************
+
+import json
+import os
+import sys
+import site
+from typing import Optional
+
+#ensure _sgs binary can be found
+site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackages()))[0]
+sys.path.append(os.path.join(site_packages, "sgspy"))
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from _sgs import profile_start, profile_stop
+
+def _stats_dict(raw):
+    """
+    converts the tuple returned by profile_stop() into the stats dict.
+    """
+    [seconds, phases, bands, iterations, trace] = raw
+
+    stats = {
+        "seconds": seconds,
+        "phases": {
+            name: {"seconds": phase_seconds, "count": count}
+            for (name, phase_seconds, count) in phases if count > 0
+        },
+        "bands": {
+            name: {
+                "blocks_read": blocks_read,
+                "bytes_read": bytes_read,
+                "read_seconds": read_seconds,
+                "blocks_written": blocks_written,
+                "bytes_written": bytes_written,
+                "write_seconds": write_seconds,
+            }
+            for (name, blocks_read, bytes_read, read_seconds, blocks_written, bytes_written, write_seconds) in bands
+        },
+    }
+
+    if iterations > 0:
+        stats["iterations"] = iterations
+        anneal_seconds = stats["phases"].get("anneal", {}).get("seconds", 0)
+        if anneal_seconds > 0:
+            stats["iterations_per_second"] = iterations / anneal_seconds
+
+    if trace:
+        stats["trace"] = trace
+
+    return stats
+
+def write_trace(stats: dict, filename: str):
+    """
+    Writes the trace events of a stats dict (collected with trace=True) as a Chrome
+    trace, which can be opened with chrome://tracing or https://ui.perfetto.dev.
+
+    Parameters:
+    stats : dict
+        the stats dict returned by a profile
+    filename : str
+        the JSON file to write to
+    """
+    if "trace" not in stats:
+        raise ValueError("the stats dict does not contain a trace, the profile must be created with trace=True.")
+
+    events = [
+        {"name": name, "cat": "sgs", "ph": "X", "ts": start, "dur": duration, "pid": 0, "tid": thread}
+        for (name, thread, start, duration) in stats["trace"]
+    ]
+
+    with open(filename, 'w') as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, f)
+
+class profile:
+    """
+    Records where time is spent within the sgs functions called inside of a with
+    block. The stats dict returned by the with statement is filled in once the
+    block exits, and contains:
+
+    'seconds': the wall time of the block. @n
+    'phases': for each phase which was entered, the total 'seconds' spent within it summed
+    over every thread, and the 'count' of times it was entered. The phases are 'setup', 'scan',
+    'select', 'anneal', and 'output' for the steps of strat and clhs, 'read' and 'write' for
+    raster band I/O, 'lock_wait' for time spent waiting for another thread to finish using a
+    raster dataset, and 'block_wait' for time spent waiting for blocks to be read from disk. @n
+    'bands': for each band read or written, the number of blocks, bytes, and seconds of each. @n
+    'iterations' and 'iterations_per_second': the number of clhs annealing iterations, if any. @n
+    'trace': the individual timed events, if trace is True or a trace filename is given.
+
+    The stats are process wide, so functions running at the same time on other threads are
+    also counted. If the package was built with the 'profiling' meson option disabled, the
+    stats are always empty.
+
+    Examples
+    --------------------
+    rast = sgspy.SpatialRaster("raster.tif") @n
+    with sgspy.profile() as stats: @n
+        samples = sgspy.sample.clhs(rast, num_samples=200) @n
+    print(stats['phases']['read']['seconds'], stats['iterations_per_second'])
+
+    with sgspy.profile(trace="strat_trace.json"): @n
+        samples = sgspy.sample.strat(srast, num_samples=200)
+
+    Parameters
+    --------------------
+    trace : bool | str @n
+        whether to record a trace, or the filename of a Chrome trace to write once the block exits @n @n
+    """
+    def __init__(self, trace: bool | str = False):
+        if type(trace) not in [bool, str]:
+            raise TypeError("'trace' parameter must be of type bool or str.")
+
+        self.trace = trace
+        self.stats = {}
+
+    def __enter__(self):
+        profile_start(self.trace is not False and self.trace != "")
+        return self.stats
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.stats.update(_stats_dict(profile_stop()))
+
+        if type(self.trace) is str and self.trace != "" and exc_type is None:
+            write_trace(self.stats, self.trace)
+
+        return False
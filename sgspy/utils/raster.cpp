@@ -31,6 +31,15 @@ py::class_<sgs::raster::GDALRasterWrapper>(m, "GDALRasterWrapper")
 	.def("get_data_type", &sgs::raster::GDALRasterWrapper::getDataType)
 	.def("set_temp_dir", &sgs::raster::GDALRasterWrapper::setTempDir)
 	.def("get_temp_dir", &sgs::raster::GDALRasterWrapper::getTempDir)
+	.def("set_persist_statistics", &sgs::raster::GDALRasterWrapper::setPersistStatistics)
+	.def("clear_statistics", &sgs::raster::GDALRasterWrapper::clearStatistics)
+	.def("get_block_size", &sgs::raster::GDALRasterWrapper::getBlockSize)
+	.def("window", &sgs::raster::GDALRasterWrapper::window)
+	.def("get_overview_count", &sgs::raster::GDALRasterWrapper::getOverviewCount)
+	.def("overview", &sgs::raster::GDALRasterWrapper::overview)
+	.def("extract", &sgs::raster::GDALRasterWrapper::extract)
 	.def("release_band_buffers", &sgs::raster::GDALRasterWrapper::releaseBandBuffers)
 	.def("close", &sgs::raster::GDALRasterWrapper::close);
 
+m.def("set_remote_read_options", &sgs::raster::setRemoteReadOptions);
+
@@ -14,24 +14,77 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
 
 #include <gdal_priv.h>
+#include <gdal_utils.h>
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <utils/budget.h>
 #include <utils/helper.h>
+#include <utils/reader.h>
+#include <utils/stats.h>
 
 //used as cutoff for max band allowed in memory
 #define GIGABYTE 1073741824
 
+//tile size of the files which in-memory datasets are spilled to
+#define SPILL_BLOCK_SIZE 256
+
 namespace sgs {
 namespace raster {
 
 namespace py = pybind11;
 using namespace pybind11::literals;
 
+/**
+ * @ingroup raster
+ * A dataset which must stay open while a memory mapping made from it is still
+ * viewed from Python, closed once the last of those mappings is released.
+ */
+struct ViewedDataset {
+	GDALDataset *p_dataset = nullptr;
+
+	~ViewedDataset() {
+		if (this->p_dataset) {
+			GDALClose(GDALDataset::ToHandle(this->p_dataset));
+		}
+	}
+};
+
+/**
+ * @ingroup raster
+ * The memory which the memoryviews (and numpy arrays) of a raster band refer to.
+ *
+ * Every view of a band holds a reference to the same ViewedBuffer, and so does the
+ * GDALRasterWrapper. While the wrapper owns the memory, the ViewedBuffer is empty.
+ * When the wrapper would otherwise free the memory (when closed, or when the buffer
+ * is evicted or replaced) it hands it to the ViewedBuffer instead and drops its
+ * reference, so the memory is freed by whichever of the wrapper and the views lets
+ * go of it last.
+ */
+struct ViewedBuffer {
+	void *p_buffer = nullptr;
+	CPLVirtualMem *p_mem = nullptr;
+	std::shared_ptr<ViewedDataset> p_dataset;
+
+	~ViewedBuffer() {
+		//the mapping is released before the dataset it was made from may be closed
+		if (this->p_mem) {
+			CPLVirtualMemFree(this->p_mem);
+		}
+		if (this->p_buffer) {
+			CPLFree(this->p_buffer);
+		}
+	}
+};
+
 /**
  * @ingroup raster
  * Wrapper class for a GDAL dataset containing a raster image.
@@ -53,18 +106,33 @@ using namespace pybind11::literals;
  * a py::buffer, and it's exposed to the C++ side of the application using
  * a void *. The expectation is that this void pointer will be cast 
  * to another data type pointer as required.
+ *
+ * The allocated band buffers are tracked by the process wide buffer budget
+ * (see utils/budget.h), which may evict them with evictBuffer() when they
+ * haven't been used recently and aren't referenced from Python.
  */
-class GDALRasterWrapper {
+class GDALRasterWrapper : public budget::Evictable {
 	private:
 	GDALDatasetUniquePtr p_dataset;
 
 	std::vector<void *> rasterBandPointers;
 	std::vector<bool> rasterBandRead;
+	std::vector<bool> externalRasterBands;
+	std::vector<bool> datasetRasterBands;
+
+	std::vector<CPLVirtualMem *> mappedRasterBands;
+	std::vector<int> mappedPixelSpace;
+	std::vector<GIntBig> mappedLineSpace;
+
+	//the memory referenced by views of the full resolution and display bands (see ViewedBuffer)
+	std::vector<std::shared_ptr<ViewedBuffer>> viewedRasterBands;
+	std::vector<std::shared_ptr<ViewedBuffer>> viewedDisplayRasterBands;
+	std::shared_ptr<ViewedDataset> p_viewedDataset;
 
 	std::vector<void *> displayRasterBandPointers;
 	std::vector<bool> displayRasterBandRead;
-	int displayRasterWidth = -1;
-	int displayRasterHeight = -1;
+	std::vector<int> displayRasterWidths;
+	std::vector<int> displayRasterHeights;
 
 	double geotransform[6];
 	std::string crs = "";
@@ -72,8 +140,22 @@ class GDALRasterWrapper {
 
 	std::string tempDir = "";
 
+	std::shared_ptr<stats::StatisticsCache> p_stats = std::make_shared<stats::StatisticsCache>();
+	std::string filename = "";
+	std::string stamp = "";
+	bool persistStatistics = false;
+
 	bool destroyed = false;
-	bool externalRasterData = false;
+
+	//the id of the raster within the buffer budget, whether a window or overview
+	//references the dataset, and the directory the dataset was spilled to (if any)
+	uint64_t budgetId = budget::nextId();
+	bool referenced = false;
+	std::string spillDir = "";
+
+	//reference to the numpy array (if any) which the in-memory dataset wraps, so that
+	//it isn't garbage collected while the dataset still points to its data
+	py::object externalBuffer;
 
 	/**
 	 * Internal function used to read raster band data.
@@ -131,14 +213,20 @@ class GDALRasterWrapper {
 		}
 
 		//update dislpay information as required
-		if (width != this->getWidth() || height != this->getHeight()) {
+		bool display = width != this->getWidth() || height != this->getHeight();
+		if (display) {
 			this->displayRasterBandRead[band] = true;
 			this->displayRasterBandPointers[band] = p_data;
+			this->displayRasterWidths[band] = width;
+			this->displayRasterHeights[band] = height;
 		}
 		else {
 			this->rasterBandRead[band] = true;
 			this->rasterBandPointers[band] = p_data;
 		}
+
+		size_t bytes = static_cast<size_t>(height) * static_cast<size_t>(width) * size;
+		budget::manager().track(this->budgetId, this, band, display, bytes);
 	}
 
 	/**
@@ -150,18 +238,250 @@ class GDALRasterWrapper {
 	 * @param void *p_raster pointer to allocated raster
 	 * @param int width 
 	 * @param int height
+	 * @param py::object base
 	 * @returns py::buffer memoryview object of the data
 	 */
 	template <typename T> 
-	py::buffer getBuffer(size_t size, void *p_buffer, int width, int height) {
-		//see https://pybind11.readthedocs.io/en/stable/advanced/pycpp/numpy.html#memory-view
-		return py::memoryview::from_buffer(
-			(T*)p_buffer, 		//buffer
-			{height, width}, 	//shape
-			{size * width, size} 	//stride
+	py::buffer getBuffer(size_t size, void *p_buffer, int width, int height, py::object base) {
+		//the memoryview is of an array with the given base, so the base is only
+		//released once every memoryview and numpy array of the buffer is gone
+		py::array_t<T> array(
+			{static_cast<py::ssize_t>(height), static_cast<py::ssize_t>(width)},			//shape
+			{static_cast<py::ssize_t>(size * width), static_cast<py::ssize_t>(size)},	//stride
+			reinterpret_cast<T *>(p_buffer),						//buffer
+			base
 		);
+		return py::memoryview(array);
 	}	
 
+	/**
+	 * Internal function which returns a capsule holding a reference to the ViewedBuffer
+	 * of a band, creating it if required. The memory of the band is not freed until the
+	 * capsule is garbage collected.
+	 *
+	 * @param int band
+	 * @param bool display
+	 * @returns py::capsule
+	 */
+	py::capsule viewBuffer(int band, bool display) {
+		std::shared_ptr<ViewedBuffer>& p_viewed = display ?
+			this->viewedDisplayRasterBands[band] :
+			this->viewedRasterBands[band];
+		if (!p_viewed) {
+			p_viewed = std::make_shared<ViewedBuffer>();
+		}
+
+		auto *p_ref = new std::shared_ptr<ViewedBuffer>(p_viewed);
+		return py::capsule(p_ref, [](void *p) {
+			delete reinterpret_cast<std::shared_ptr<ViewedBuffer> *>(p);
+		});
+	}
+
+	/**
+	 * Internal function which frees an allocated band buffer, or hands it to the
+	 * ViewedBuffer of the band if the band has been viewed, to be freed once the
+	 * last view of it is garbage collected.
+	 *
+	 * @param void *p_buffer
+	 * @param std::shared_ptr<ViewedBuffer>& p_viewed
+	 */
+	void releaseBuffer(void *p_buffer, std::shared_ptr<ViewedBuffer>& p_viewed) {
+		if (p_viewed) {
+			p_viewed->p_buffer = p_buffer;
+			p_viewed.reset();
+		}
+		else {
+			CPLFree(p_buffer);
+		}
+	}
+
+	/**
+	 * Internal function which closes the dataset, or hands it to a ViewedDataset if
+	 * a memory mapping of one of its bands is still viewed, to be closed once the
+	 * last of those mappings is released.
+	 */
+	void closeDataset() {
+		if (this->p_viewedDataset) {
+			this->p_viewedDataset->p_dataset = this->p_dataset.release();
+			this->p_viewedDataset.reset();
+		}
+		else {
+			GDALClose(GDALDataset::ToHandle(this->p_dataset.release()));
+		}
+	}
+
+	/**
+	 * Internal function which pins a band buffer within the buffer budget, and
+	 * returns a capsule which releases the pin when it's garbage collected.
+	 *
+	 * @param int band
+	 * @param bool display
+	 * @returns py::capsule
+	 */
+	py::capsule pinBuffer(int band, bool display) {
+		budget::manager().pin(this->budgetId, band, display);
+		auto *p_key = new std::tuple<uint64_t, int, bool>(this->budgetId, band, display);
+		return py::capsule(p_key, [](void *p) {
+			auto *p_key = reinterpret_cast<std::tuple<uint64_t, int, bool> *>(p);
+			budget::manager().unpin(std::get<0>(*p_key), std::get<1>(*p_key), std::get<2>(*p_key));
+			delete p_key;
+		});
+	}
+
+	/**
+	 * Internal function which moves an in-memory (MEM) dataset to disk, so that the
+	 * band buffers which it wraps may be evicted. Each band is written to its own
+	 * GTiff file in a new temporary directory, and the dataset is replaced by a VRT
+	 * dataset of those files, in the same way as the VRT outputs of the stratification
+	 * functions. The buffers themselves are left allocated, but they're now copies of
+	 * the bands which can be evicted and re-read like those of any other dataset.
+	 *
+	 * A dataset which a window or overview references can't be spilled, since the
+	 * window or overview would still refer to the in-memory dataset.
+	 *
+	 * @returns bool whether the dataset was spilled
+	 */
+	bool spill() {
+		bool wrapped = std::all_of(this->datasetRasterBands.begin(), this->datasetRasterBands.end(), [](bool b) { return b; });
+		if (this->referenced || !wrapped) {
+			return false;
+		}
+
+		//the generated name is unique to the process, but it's relative to CPL_TMPDIR (or the working directory)
+		std::filesystem::path dir = std::filesystem::temp_directory_path() / CPLGetFilename(CPLGenerateTempFilename("sgspy_spill"));
+		std::filesystem::create_directories(dir);
+
+		int width = this->getWidth();
+		int height = this->getHeight();
+		std::map<std::string, std::string> driverOptions;
+		GDALDataset *p_vrt = helper::createVirtualDataset("VRT", width, height, this->geotransform, std::string(this->p_dataset->GetProjectionRef()));
+
+		std::vector<helper::RasterBandMetaData> bands(this->getBandCount());
+		std::vector<helper::VRTBandDatasetInfo> VRTBandInfo;
+		bool written = true;
+		for (int i = 0; i < this->getBandCount(); i++) {
+			GDALRasterBand *p_band = this->getRasterBand(i);
+			bands[i].type = this->getRasterBandType(i);
+			bands[i].size = this->getRasterBandTypeSize(i);
+			bands[i].name = std::string(p_band->GetDescription());
+			bands[i].nan = p_band->GetNoDataValue();
+			bands[i].xBlockSize = SPILL_BLOCK_SIZE;
+			bands[i].yBlockSize = SPILL_BLOCK_SIZE;
+			helper::createVRTBandDataset(p_vrt, bands[i], dir.string(), std::to_string(i), VRTBandInfo, driverOptions);
+
+			CPLErr err = bands[i].p_band->RasterIO(GF_Write, 0, 0, width, height, this->rasterBandPointers[i], width, height, bands[i].type, 0, 0);
+			written &= !err;
+		}
+
+		for (size_t i = 0; i < VRTBandInfo.size(); i++) {
+			GDALClose(VRTBandInfo[i].p_dataset);
+			if (written) {
+				helper::addBandToVRTDataset(p_vrt, bands[i], VRTBandInfo[i]);
+			}
+		}
+
+		if (!written) {
+			GDALClose(GDALDataset::ToHandle(p_vrt));
+			std::filesystem::remove_all(dir);
+			return false;
+		}
+
+		//the MEM dataset doesn't own the buffers it wraps, so closing it leaves them allocated
+		this->unmapRasterBands();
+		this->closeDataset();
+		this->p_dataset = GDALDatasetUniquePtr(p_vrt);
+		this->spillDir = dir.string();
+		std::fill(this->datasetRasterBands.begin(), this->datasetRasterBands.end(), false);
+		return true;
+	}
+
+	/**
+	 * Internal function which returns a read only pybuffer of a raster band
+	 * which has been memory mapped by mapRasterBand(), using the pixel and
+	 * line spacing of the mapping. The memoryview is of an array whose base
+	 * holds a reference to the mapping (see viewBuffer()), so the mapping
+	 * remains valid for as long as any numpy array made from it.
+	 *
+	 * @param int band
+	 * @returns py::buffer memoryview object of the data
+	 */
+	template <typename T>
+	py::buffer getMappedBuffer(int band) {
+		py::array_t<T> array(
+			{static_cast<py::ssize_t>(this->getHeight()), static_cast<py::ssize_t>(this->getWidth())},				//shape
+			{static_cast<py::ssize_t>(this->mappedLineSpace[band]), static_cast<py::ssize_t>(this->mappedPixelSpace[band])},	//stride
+			reinterpret_cast<const T *>(CPLVirtualMemGetAddr(this->mappedRasterBands[band])),				//buffer
+			this->viewBuffer(band, false)
+		);
+		array.attr("setflags")("write"_a = false);
+		return py::memoryview(array);
+	}
+
+	/**
+	 * Internal function used to map a raster band into memory without reading
+	 * or copying it, using GDALRasterBand::GetVirtualMemAuto(). This works for
+	 * formats which store the band uncompressed and in native byte order, such as
+	 * uncompressed GeoTIFF or ENVI, on platforms which support it (64-bit Linux).
+	 * The file itself is then memory mapped, so the band is paged in by the
+	 * operating system as it's accessed and isn't limited by available memory.
+	 *
+	 * GDAL's default implementation, which pages in data using a segmentation
+	 * fault handler, is not used since it may not co-exist with the Python
+	 * interpreters own signal handlers.
+	 *
+	 * @param int band
+	 * @returns bool whether the band is mapped
+	 */
+	bool mapRasterBand(int band) {
+		if (this->mappedRasterBands[band]) {
+			return true;
+		}
+
+		char **papszOptions = nullptr;
+		papszOptions = CSLSetNameValue(papszOptions, "USE_DEFAULT_IMPLEMENTATION", "NO");
+
+		int pixelSpace;
+		GIntBig lineSpace;
+		CPLVirtualMem *p_mem = this->getRasterBand(band)->GetVirtualMemAuto(GF_Read, &pixelSpace, &lineSpace, papszOptions);
+		CSLDestroy(papszOptions);
+
+		if (!p_mem) {
+			return false;
+		}
+
+		this->mappedRasterBands[band] = p_mem;
+		this->mappedPixelSpace[band] = pixelSpace;
+		this->mappedLineSpace[band] = lineSpace;
+		return true;
+	}
+
+	/**
+	 * Internal function which releases the memory mappings made by mapRasterBand().
+	 * The mappings must be released before the dataset is closed, so a mapping which
+	 * is still viewed is handed to the ViewedBuffer of its band along with (a reference
+	 * to) the dataset, which closeDataset() then leaves open until the last view is gone.
+	 */
+	void unmapRasterBands() {
+		for (size_t i = 0; i < this->mappedRasterBands.size(); i++) {
+			if (!this->mappedRasterBands[i]) {
+				continue;
+			}
+
+			if (this->viewedRasterBands[i]) {
+				if (!this->p_viewedDataset) {
+					this->p_viewedDataset = std::make_shared<ViewedDataset>();
+				}
+				this->viewedRasterBands[i]->p_mem = this->mappedRasterBands[i];
+				this->viewedRasterBands[i]->p_dataset = this->p_viewedDataset;
+				this->viewedRasterBands[i].reset();
+			}
+			else {
+				CPLVirtualMemFree(this->mappedRasterBands[i]);
+			}
+			this->mappedRasterBands[i] = nullptr;
+		}
+	}
+
 	/**
 	 * Populates/constructs the GDALRasterWrapper object using a raster
 	 * dataset pointer. Called by some of the GDALRasterWrapper 
@@ -196,8 +516,17 @@ class GDALRasterWrapper {
 		//initialize (but don't read) raster band pointers
 		this->rasterBandPointers = std::vector<void *>(this->getBandCount(), nullptr);
 		this->rasterBandRead = std::vector<bool>(this->getBandCount(), false);
+		this->externalRasterBands = std::vector<bool>(this->getBandCount(), false);
+		this->datasetRasterBands = std::vector<bool>(this->getBandCount(), false);
+		this->mappedRasterBands = std::vector<CPLVirtualMem *>(this->getBandCount(), nullptr);
+		this->mappedPixelSpace = std::vector<int>(this->getBandCount(), 0);
+		this->mappedLineSpace = std::vector<GIntBig>(this->getBandCount(), 0);
+		this->viewedRasterBands = std::vector<std::shared_ptr<ViewedBuffer>>(this->getBandCount());
+		this->viewedDisplayRasterBands = std::vector<std::shared_ptr<ViewedBuffer>>(this->getBandCount());
 		this->displayRasterBandPointers = std::vector<void *>(this->getBandCount(), nullptr);
 		this->displayRasterBandRead = std::vector<bool>(this->getBandCount(), false);	
+		this->displayRasterWidths = std::vector<int>(this->getBandCount(), -1);
+		this->displayRasterHeights = std::vector<int>(this->getBandCount(), -1);
 	}
 
 	public:
@@ -229,6 +558,14 @@ class GDALRasterWrapper {
 		}
 
 		this->createFromDataset(p_dataset);
+
+		//share the statistics cache of any other raster opened from the same unmodified file
+		this->filename = filename.rfind("/vsi", 0) == 0 ? filename : std::filesystem::absolute(filename).lexically_normal().string();
+		this->stamp = stats::fileStamp(filename);
+		this->p_stats = stats::getFileCache(this->filename, this->stamp);
+		if (this->stamp != "") {
+			this->p_stats->load(this->p_dataset.get(), this->stamp);
+		}
 	}	
 
 	/**
@@ -238,6 +575,9 @@ class GDALRasterWrapper {
 	 * Calls createFromDataset() passing p_dataset parameter, and
 	 * sets internal raster band parameters accordingly.
 	 *
+	 * If the dataset is a MEM dataset, the bands are the storage of the
+	 * dataset itself, so it must be spilled to disk before they can be evicted.
+	 *
 	 * @param GDALDataset *p_dataset GDAL raster dataset
 	 * @param std::vector<void *> raster bands
 	 */
@@ -245,6 +585,13 @@ class GDALRasterWrapper {
 		this->createFromDataset(p_dataset);
 		this->rasterBandPointers = bands;
 		this->rasterBandRead = std::vector<bool>(bands.size(), true);
+
+		bool mem = std::string(p_dataset->GetDriverName()) == "MEM";
+		size_t pixels = static_cast<size_t>(this->getWidth()) * static_cast<size_t>(this->getHeight());
+		for (size_t i = 0; i < bands.size() && bands[i]; i++) {
+			this->datasetRasterBands[i] = mem;
+			budget::manager().track(this->budgetId, this, i, false, pixels * this->getRasterBandTypeSize(i));
+		}
 	}
 
 	/**
@@ -280,19 +627,24 @@ class GDALRasterWrapper {
 		
 		py::buffer_info info = buffer.request();
 
-		//get height width and band count from pybuffer
+		//get height width and band count, and the spacing between bands, lines, and pixels from pybuffer
 		int width, height;
-		size_t bandCount, bandSize;
+		size_t bandCount;
+		py::ssize_t bandSpace = 0, lineSpace, pixelSpace;
 		if (info.ndim == 3) {
 			bandCount = info.shape[0];
 			height = info.shape[1];
 			width = info.shape[2];
-			bandSize = info.strides[0];
+			bandSpace = info.strides[0];
+			lineSpace = info.strides[1];
+			pixelSpace = info.strides[2];
 		}
 		else if (info.ndim == 2) {
 			bandCount = 1;
 			height = info.shape[0];
 			width = info.shape[1];
+			lineSpace = info.strides[0];
+			pixelSpace = info.strides[1];
 		}
 		else {
 			throw std::runtime_error("dimension of numpy array must be 2 or 3");
@@ -337,25 +689,38 @@ class GDALRasterWrapper {
 			throw std::runtime_error("data type of array must be one of int8, int16, uint16, int32, uint32, float32, or float64.");
 		}
 
+		if (bandSpace < 0 || lineSpace <= 0 || pixelSpace <= 0) {
+			throw std::runtime_error("numpy array must not have negative strides.");
+		}
+
+		//the MEM dataset wraps the numpy data directly, without copying it. Bands which
+		//aren't contiguous (for example a slice of a larger array) are wrapped using the
+		//pixel and line offsets, and are only copied if they're needed as a contiguous buffer.
+		bool contiguous = pixelSpace == static_cast<py::ssize_t>(size) &&
+				  lineSpace == static_cast<py::ssize_t>(size) * width;
+
 		GDALAllRegister();
 		GDALDataset *p_dataset = helper::createVirtualDataset("MEM", width, height, geotransform.data(), projection);
 		std::vector<void *> bands(bandCount);	
 		for (size_t i = 0; i < bandCount; i++) {
 			helper::RasterBandMetaData band;
-			band.p_buffer = (void *)((size_t)info.ptr + (i * bandSize));
+			band.p_buffer = (void *)((size_t)info.ptr + (i * bandSpace));
 			band.type = type;
 		       	band.size = size;
 			band.nan = nanVals[i];
 			band.name = names[i];
-			helper::addBandToMEMDataset(p_dataset, band);	
+			helper::addBandToMEMDataset(p_dataset, band, pixelSpace, lineSpace);	
 			bands[i] = band.p_buffer;
 
 		}
 
 		this->createFromDataset(p_dataset);
-		this->rasterBandPointers = bands;
-		this->rasterBandRead = std::vector<bool>(bandCount, true);
-		this->externalRasterData = true;
+		this->externalBuffer = buffer;
+		if (contiguous) {
+			this->rasterBandPointers = bands;
+			this->rasterBandRead = std::vector<bool>(bandCount, true);
+			this->externalRasterBands = std::vector<bool>(bandCount, true);
+		}
 	}
 
 	/**
@@ -367,24 +732,35 @@ class GDALRasterWrapper {
 			return;
 		}
 
+		budget::manager().untrackAll(this->budgetId);
+
 		for (int i = 0; i < this->getBandCount(); i++) {
-			//if the raster data is coming from a numpy array (this->externalRasterData true), then
+			//if the raster data is coming from a numpy array (this->externalRasterBands[i] true), then
 			//the memory will be cleaned up by Pythons garbage collector
-			if (this->rasterBandRead[i] && !this->externalRasterData) {
-				CPLFree(this->rasterBandPointers[i]);
+			if (this->rasterBandRead[i] && !this->externalRasterBands[i]) {
+				this->releaseBuffer(this->rasterBandPointers[i], this->viewedRasterBands[i]);
 			}
 
 			if (this->displayRasterBandRead[i]) {
-				CPLFree(this->displayRasterBandPointers[i]);
+				this->releaseBuffer(this->displayRasterBandPointers[i], this->viewedDisplayRasterBands[i]);
 			}
 		}
 
-		GDALClose(GDALDataset::ToHandle(this->p_dataset.release()));
+		if (this->persistStatistics && this->stamp != "") {
+			this->p_stats->save(this->p_dataset.get(), this->stamp);
+		}
+
+		this->unmapRasterBands();
+		this->closeDataset();
 
 		if (this->tempDir != "") {
 			std::filesystem::path temp = this->tempDir;
 			std::filesystem::remove_all(temp);
 		}	
+
+		if (this->spillDir != "") {
+			std::filesystem::remove_all(this->spillDir);
+		}
 	}
 
 	/**
@@ -399,25 +775,37 @@ class GDALRasterWrapper {
 	 * accessed after it has been deleted from within the Pyhton code.
 	 */
 	void close(void) {
+		budget::manager().untrackAll(this->budgetId);
+
 		for (int i = 0; i < this->getBandCount(); i++) {
-			//if the raster data is coming from a numpy array (this->externalRasterData true), then
+			//if the raster data is coming from a numpy array (this->externalRasterBands[i] true), then
 			//the memory will be cleaned up by Pythons garbage collector
-			if (this->rasterBandRead[i]) {
-				CPLFree(this->rasterBandPointers[i]);
+			if (this->rasterBandRead[i] && !this->externalRasterBands[i]) {
+				this->releaseBuffer(this->rasterBandPointers[i], this->viewedRasterBands[i]);
 			}
 
 			if (this->displayRasterBandRead[i]) {
-				CPLFree(this->displayRasterBandPointers[i]);
+				this->releaseBuffer(this->displayRasterBandPointers[i], this->viewedDisplayRasterBands[i]);
 			}
 		}
 
-		GDALClose(GDALDataset::ToHandle(this->p_dataset.release()));
+		if (this->persistStatistics && this->stamp != "") {
+			this->p_stats->save(this->p_dataset.get(), this->stamp);
+		}
+
+		this->unmapRasterBands();
+		this->closeDataset();
+		this->externalBuffer = py::object();
 
 		if (this->tempDir != "") {
 			std::filesystem::path temp = this->tempDir;
 			std::filesystem::remove_all(temp);
 		}
 
+		if (this->spillDir != "") {
+			std::filesystem::remove_all(this->spillDir);
+		}
+
 		destroyed = true;	
 	}
 
@@ -430,6 +818,207 @@ class GDALRasterWrapper {
 		return this->p_dataset.get();
 	}
 
+	/**
+	 * Getter method for the block size of the first band of the dataset,
+	 * as {xBlockSize, yBlockSize}.
+	 *
+	 * @returns std::vector<int>
+	 */
+	std::vector<int> getBlockSize() {
+		int xBlockSize, yBlockSize;
+		this->p_dataset->GetRasterBand(1)->GetBlockSize(&xBlockSize, &yBlockSize);
+		return {xBlockSize, yBlockSize};
+	}
+
+	/**
+	 * Create a new GDALRasterWrapper over a window of this raster. The window
+	 * is a virtual (VRT) dataset referencing this dataset, so no raster data is
+	 * copied, and its geotransform is offset to the window's origin. This allows
+	 * any of the algorithms to run on a sub-extent, or on a raster tile by tile.
+	 *
+	 * The window references the dataset of this wrapper, so this wrapper must
+	 * outlive the window. The Python side keeps a reference to ensure this.
+	 *
+	 * @param int xOff
+	 * @param int yOff
+	 * @param int xSize
+	 * @param int ySize
+	 * @returns GDALRasterWrapper *
+	 */
+	GDALRasterWrapper *window(int xOff, int yOff, int xSize, int ySize) {
+		if (xOff < 0 || yOff < 0 || xSize < 1 || ySize < 1 || 
+			xOff + xSize > this->getWidth() || yOff + ySize > this->getHeight()) {
+			throw std::runtime_error("window must be within the extent of the raster.");
+		}
+
+		char **argv = nullptr;
+		argv = CSLAddString(argv, "-of");
+		argv = CSLAddString(argv, "VRT");
+		argv = CSLAddString(argv, "-srcwin");
+		argv = CSLAddString(argv, std::to_string(xOff).c_str());
+		argv = CSLAddString(argv, std::to_string(yOff).c_str());
+		argv = CSLAddString(argv, std::to_string(xSize).c_str());
+		argv = CSLAddString(argv, std::to_string(ySize).c_str());
+
+		GDALTranslateOptions *options = GDALTranslateOptionsNew(argv, nullptr);
+		CSLDestroy(argv);
+		if (!options) {
+			throw std::runtime_error("unable to create options for window.");
+		}
+
+		this->referenced = true;
+		int usageError = 0;
+		GDALDatasetH hWindow = GDALTranslate("", GDALDataset::ToHandle(this->p_dataset.get()), options, &usageError);
+		GDALTranslateOptionsFree(options);
+		if (!hWindow || usageError) {
+			throw std::runtime_error("unable to create window of raster.");
+		}
+
+		return new GDALRasterWrapper(GDALDataset::FromHandle(hWindow));
+	}
+
+	/**
+	 * Getter method for the number of overviews of the first band of the dataset.
+	 *
+	 * @returns int
+	 */
+	int getOverviewCount() {
+		return this->p_dataset->GetRasterBand(1)->GetOverviewCount();
+	}
+
+	/**
+	 * Create a new GDALRasterWrapper over an overview of this raster, where level 0
+	 * is the most detailed overview. Like a window, the overview is a virtual (VRT)
+	 * dataset referencing this dataset, with the same extent but the geotransform
+	 * of the overview. For a cloud optimized GeoTIFF, reading an overview fetches only
+	 * a fraction of the bytes of the full resolution raster.
+	 *
+	 * The overview references the dataset of this wrapper, so this wrapper must
+	 * outlive the overview. The Python side keeps a reference to ensure this.
+	 *
+	 * @param int level
+	 * @returns GDALRasterWrapper *
+	 */
+	GDALRasterWrapper *overview(int level) {
+		if (level < 0 || level >= this->getOverviewCount()) {
+			throw std::runtime_error("raster has no overview at level " + std::to_string(level) + ".");
+		}
+
+		char **argv = nullptr;
+		argv = CSLAddString(argv, "-of");
+		argv = CSLAddString(argv, "VRT");
+		argv = CSLAddString(argv, "-ovr");
+		argv = CSLAddString(argv, std::to_string(level).c_str());
+
+		GDALTranslateOptions *options = GDALTranslateOptionsNew(argv, nullptr);
+		CSLDestroy(argv);
+		if (!options) {
+			throw std::runtime_error("unable to create options for overview.");
+		}
+
+		this->referenced = true;
+		int usageError = 0;
+		GDALDatasetH hOverview = GDALTranslate("", GDALDataset::ToHandle(this->p_dataset.get()), options, &usageError);
+		GDALTranslateOptionsFree(options);
+		if (!hOverview || usageError) {
+			throw std::runtime_error("unable to create overview of raster.");
+		}
+
+		return new GDALRasterWrapper(GDALDataset::FromHandle(hOverview));
+	}
+
+	/**
+	 * Extract the values of a set of bands at a set of points. The
+	 * xCoords and yCoords buffers are contiguous 1-dimensional arrays of doubles
+	 * containing the coordinates of n points. The out buffer is a writable,
+	 * C-contiguous n x bands.size() array of doubles, where row i is set to
+	 * the values of the pixel containing point i. Points outside of the raster
+	 * extent are set to nan. Nodata values are not changed.
+	 *
+	 * The pixels are read with reader::readPixels(), so only the blocks which
+	 * contain points are read, each exactly once and in Morton order, using
+	 * threads threads. The GIL is released while the raster is read.
+	 *
+	 * @param py::buffer xCoords
+	 * @param py::buffer yCoords
+	 * @param std::vector<int> bands
+	 * @param py::buffer out
+	 * @param int threads
+	 */
+	void extract(py::buffer xCoords, py::buffer yCoords, std::vector<int> bands, py::buffer out, int threads) {
+		py::buffer_info xInfo = xCoords.request();
+		py::buffer_info yInfo = yCoords.request();
+		py::buffer_info outInfo = out.request(true);
+
+		std::string format = py::format_descriptor<double>::format();
+		if (xInfo.format != format || yInfo.format != format || outInfo.format != format) {
+			throw std::runtime_error("coordinate and output arrays must be of type float64.");
+		}
+		if (xInfo.ndim != 1 || yInfo.ndim != 1 || xInfo.shape[0] != yInfo.shape[0] ||
+			xInfo.strides[0] != sizeof(double) || yInfo.strides[0] != sizeof(double)) {
+			throw std::runtime_error("coordinate arrays must be contiguous, 1-dimensional, and the same length.");
+		}
+		if (bands.empty()) {
+			throw std::runtime_error("at least one band must be given.");
+		}
+
+		size_t n = static_cast<size_t>(xInfo.shape[0]);
+		size_t nBands = bands.size();
+		if (outInfo.ndim != 2 || static_cast<size_t>(outInfo.shape[0]) != n || static_cast<size_t>(outInfo.shape[1]) != nBands ||
+			outInfo.strides[0] != static_cast<py::ssize_t>(nBands * sizeof(double)) || outInfo.strides[1] != sizeof(double)) {
+			throw std::runtime_error("output array must be a contiguous array with one row per point and one column per band.");
+		}
+		for (int band : bands) {
+			if (band < 0 || band >= this->getBandCount()) {
+				throw std::runtime_error("band index out of range.");
+			}
+		}
+
+		const double *p_x = reinterpret_cast<const double *>(xInfo.ptr);
+		const double *p_y = reinterpret_cast<const double *>(yInfo.ptr);
+		double *p_out = reinterpret_cast<double *>(outInfo.ptr);
+
+		py::gil_scoped_release release;
+
+		int width = this->getWidth();
+		int height = this->getHeight();
+		double xMin = this->getXMin();
+		double xMax = this->getXMax();
+		double yMin = this->getYMin();
+		double yMax = this->getYMax();
+		double IGT[6];
+		GDALInvGeoTransform(this->geotransform, IGT);
+
+		//every band is in the same dataset, so they share a mutex
+		std::mutex mutex;
+		std::vector<helper::RasterBandMetaData> metadata(nBands);
+		std::vector<helper::RasterBandMetaData *> p_bands(nBands);
+		for (size_t b = 0; b < nBands; b++) {
+			metadata[b].p_band = this->getRasterBand(bands[b]);
+			metadata[b].type = this->getRasterBandType(bands[b]);
+			metadata[b].size = this->getRasterBandTypeSize(bands[b]);
+			metadata[b].p_mutex = &mutex;
+			metadata[b].p_band->GetBlockSize(&metadata[b].xBlockSize, &metadata[b].yBlockSize);
+			p_bands[b] = &metadata[b];
+		}
+
+		//points on the maximum edges of the extent belong to the last pixel
+		std::vector<int> pixelX(n, -1), pixelY(n, -1);
+		for (size_t i = 0; i < n; i++) {
+			double x = p_x[i];
+			double y = p_y[i];
+			if (x >= xMin && x <= xMax && y >= yMin && y <= yMax) {
+				pixelX[i] = std::clamp(static_cast<int>(std::floor(IGT[0] + x * IGT[1] + y * IGT[2])), 0, width - 1);
+				pixelY[i] = std::clamp(static_cast<int>(std::floor(IGT[3] + x * IGT[4] + y * IGT[5])), 0, height - 1);
+			}
+		}
+
+		std::fill(p_out, p_out + n * nBands, std::nan(""));
+		reader::readPixels(p_bands, pixelX.data(), pixelY.data(), n, width, height, std::max(1, threads), [&](size_t i, const double *p_values) {
+			std::copy(p_values, p_values + nBands, p_out + i * nBands);
+		});
+	}
+
 	/**
 	 * Getter method for the raster driver.
 	 *
@@ -607,14 +1196,25 @@ class GDALRasterWrapper {
 	 * and uses py::memoryview::from_buffer() to create the buffer of the 
 	 * correct size/dimensions without copying data unecessarily.
 	 *
+	 * If the full resolution band is requested, and the format stores it uncompressed,
+	 * the band is memory mapped (see mapRasterBand()) rather than read. The memoryview
+	 * then refers directly to the file, so bands larger than the 1 gigabyte limit on
+	 * allocated bands can be viewed as well.
+	 *
 	 * This function requires that width and height be defined according
 	 * to GDAL target_downscaling_factor rules. Otherwise, the incorrect amount
 	 * of memory will be allocated. Information on target_downsampling_factor
 	 * can be found here:
 	 * https://gdal.org/en/stable/api/gdaldataset_cpp.html#classGDALDataset_1ae66e21b09000133a0f4d99baabf7a0ec
 	 *
-	 * for py::memoryview::from_buffer() information see:
-	 * https://pybind11.readthedocs.io/en/stable/advanced/pycpp/numpy.html#memory-view
+	 * Downsampled bands are kept for the next call with the same width and height,
+	 * so plotting a band again doesn't read it again. The buffer is pinned within the
+	 * buffer budget (see utils/budget.h) until the memoryview, and every numpy array
+	 * made from it, have been garbage collected, and the function runs as a budget
+	 * Operation so the buffer can't be evicted before it's pinned.
+	 *
+	 * The view also holds a reference to the ViewedBuffer of the band, so the memory it
+	 * refers to (allocated or mapped) stays valid even after the raster is closed.
 	 *
 	 * @param int width
 	 * @param int height
@@ -622,24 +1222,59 @@ class GDALRasterWrapper {
 	 * @returns py::buffer python memoryview of the raster
 	 */
 	py::buffer getRasterBandAsMemView(int width, int height, int band) {
+		budget::Operation operation;
 		bool display = (width != this->getWidth() || height != this->getHeight());
+		bool mapped = false;
 		void *p_buffer;
 		GDALDataType type = this->getRasterBandType(band);
 
-		//allocate raster if required
-		if (!display && !this->rasterBandRead[band]) {
-			this->readRasterBand(width, height, band);
-		}
+		//the GIL is only required to create the memoryview, not to read the raster band
+		{
+			py::gil_scoped_release release;
 
-		//(re)allocate display raster if required
-		if (display) {
-			if (width != this->displayRasterWidth || height != this->displayRasterHeight) {
-				free(this->displayRasterBandPointers[band]);
-				this->displayRasterBandRead[band] = false;
+			//map the raster band if the format allows it, otherwise allocate raster if required
+			if (!display && !this->rasterBandRead[band]) {
+				mapped = this->mapRasterBand(band);
+				if (!mapped) {
+					this->readRasterBand(width, height, band);
+				}
+			}
+
+			//(re)allocate display raster if required
+			if (display) {
+				bool resized = width != this->displayRasterWidths[band] || height != this->displayRasterHeights[band];
+				if (this->displayRasterBandRead[band] && resized) {
+					budget::manager().untrack(this->budgetId, band, true);
+					this->releaseBuffer(this->displayRasterBandPointers[band], this->viewedDisplayRasterBands[band]);
+					this->displayRasterBandPointers[band] = nullptr;
+					this->displayRasterBandRead[band] = false;
+				}
+
+				if (this->displayRasterBandRead[band] == false) {
+					this->readRasterBand(width, height, band);
+				}
 			}
+		}
 
-			if (this->displayRasterBandRead[band] == false) {
-				this->readRasterBand(width, height, band);
+		//a mapped raster band is viewed directly, using the spacing of the mapping
+		if (mapped) {
+			switch(type) {
+				case GDT_Int8:
+					return getMappedBuffer<int8_t>(band);
+				case GDT_UInt16:
+					return getMappedBuffer<uint16_t>(band);
+				case GDT_Int16:
+					return getMappedBuffer<int16_t>(band);
+				case GDT_UInt32:
+					return getMappedBuffer<uint32_t>(band);
+				case GDT_Int32:
+					return getMappedBuffer<int32_t>(band);
+				case GDT_Float32:
+					return getMappedBuffer<float>(band);
+				case GDT_Float64:
+					return getMappedBuffer<double>(band);
+				default:
+					throw std::runtime_error("raster pixel data type not supported.");
 			}
 		}
 
@@ -647,22 +1282,29 @@ class GDALRasterWrapper {
 		p_buffer = (!display) ?
 			this->rasterBandPointers[band] :
 			this->displayRasterBandPointers[band];
+		//the base of the view pins the buffer within the budget, and keeps the buffer (or the
+		//numpy array the band wraps) allocated after the raster is closed
+		py::object base = py::make_tuple(
+			this->pinBuffer(band, display),
+			this->viewBuffer(band, display),
+			(!display && this->externalRasterBands[band]) ? this->externalBuffer : py::none()
+		);
 
 		switch(type) {
 			case GDT_Int8:
-				return getBuffer<int8_t>(sizeof(int8_t), p_buffer, width, height);
+				return getBuffer<int8_t>(sizeof(int8_t), p_buffer, width, height, base);
 			case GDT_UInt16:
-				return getBuffer<uint16_t>(sizeof(uint16_t), p_buffer, width, height);
+				return getBuffer<uint16_t>(sizeof(uint16_t), p_buffer, width, height, base);
 			case GDT_Int16:
-				return getBuffer<int16_t>(sizeof(int16_t), p_buffer, width, height);
+				return getBuffer<int16_t>(sizeof(int16_t), p_buffer, width, height, base);
 			case GDT_UInt32:
-				return getBuffer<uint32_t>(sizeof(uint32_t), p_buffer, width, height);
+				return getBuffer<uint32_t>(sizeof(uint32_t), p_buffer, width, height, base);
 			case GDT_Int32:
-				return getBuffer<int32_t>(sizeof(int32_t), p_buffer, width, height);
+				return getBuffer<int32_t>(sizeof(int32_t), p_buffer, width, height, base);
 			case GDT_Float32:
-				return getBuffer<float>(sizeof(float), p_buffer, width, height);
+				return getBuffer<float>(sizeof(float), p_buffer, width, height, base);
 			case GDT_Float64:
-				return getBuffer<double>(sizeof(double), p_buffer, width, height);
+				return getBuffer<double>(sizeof(double), p_buffer, width, height, base);
 			default:
 				throw std::runtime_error("raster pixel data type not supported.");
 		}
@@ -678,10 +1320,14 @@ class GDALRasterWrapper {
 	 * not cleaned up by the deconstructor when the C++ object is freed.
 	 *
 	 * This is essentially a memory leak as far as the C++ code is concerned, however
-	 * the numpy array will retain ownership and delete when required.
+	 * the numpy array will retain ownership and delete when required. The buffers are
+	 * no longer counted by the buffer budget.
 	 */
 	void releaseBandBuffers(void) {
 		for (size_t i = 0; i < this->rasterBandPointers.size(); i++) {
+			budget::manager().untrack(this->budgetId, i, false);
+			viewedRasterBands[i].reset();
+			datasetRasterBands[i] = false;
 			rasterBandPointers[i] = nullptr;
 			rasterBandRead[i] = false;
 		}	
@@ -700,6 +1346,9 @@ class GDALRasterWrapper {
 	/**
 	 * Getter method for the whole GDALRasterBand data buffer.
 	 *
+	 * The buffer is only valid until it's evicted by the buffer budget, which can't
+	 * happen during the budget Operation of the function calling this.
+	 *
 	 * @param int
 	 * @returns void *
 	 */
@@ -711,10 +1360,56 @@ class GDALRasterWrapper {
 				band
 			);
 		}
+		else {
+			budget::manager().touch(this->budgetId, band, false);
+		}
 
 		return this->rasterBandPointers[band];
 	}
 
+	/**
+	 * Release the buffer of a band, called by the buffer budget when the
+	 * buffer is the least recently used. The buffer is read again from the
+	 * dataset if it's required later. If the buffer is the storage of an
+	 * in-memory dataset, the dataset is first spilled to disk with spill().
+	 *
+	 * @param int band
+	 * @param bool display
+	 * @returns bool whether the buffer was released
+	 */
+	bool evictBuffer(int band, bool display) override {
+		if (this->destroyed) {
+			return true;
+		}
+
+		if (display) {
+			if (this->displayRasterBandRead[band]) {
+				this->releaseBuffer(this->displayRasterBandPointers[band], this->viewedDisplayRasterBands[band]);
+				this->displayRasterBandPointers[band] = nullptr;
+				this->displayRasterBandRead[band] = false;
+			}
+			return true;
+		}
+
+		if (!this->rasterBandRead[band] || this->externalRasterBands[band]) {
+			return true;
+		}
+
+		try {
+			if (this->datasetRasterBands[band] && !this->spill()) {
+				return false;
+			}
+		}
+		catch (const std::exception&) {
+			return false;
+		}
+
+		this->releaseBuffer(this->rasterBandPointers[band], this->viewedRasterBands[band]);
+		this->rasterBandPointers[band] = nullptr;
+		this->rasterBandRead[band] = false;
+		return true;
+	}
+
 	/**
 	 * Getter method for the pixel / raster data type.
 	 *
@@ -766,7 +1461,9 @@ class GDALRasterWrapper {
 		}
 	
 		GDALDriver *p_driver = GetGDALDriverManager()->GetDriverByName("GTiff");
-	
+
+		//statistics cached from a previous version of the file no longer apply
+		stats::invalidateFileCache(filename.rfind("/vsi", 0) == 0 ? filename : std::filesystem::absolute(filename).lexically_normal().string());
 		GDALClose(p_driver->CreateCopy(filename.c_str(), this->p_dataset.get(), (int)false, nullptr, nullptr, nullptr));
 	}
 
@@ -789,6 +1486,35 @@ class GDALRasterWrapper {
 		return this->tempDir;
 	}
 
+	/**
+	 * Getter method for the statistics cache of the raster. Rasters opened from the
+	 * same unmodified file share a cache.
+	 *
+	 * @returns stats::StatisticsCache&
+	 */
+	stats::StatisticsCache& getStatistics() {
+		return *this->p_stats;
+	}
+
+	/**
+	 * Set whether the cached statistics are written to the datasets metadata (the PAM
+	 * .aux.xml sidecar for most file formats) when the raster is closed, so that they
+	 * are available the next time the file is opened. Only applies to rasters opened
+	 * from a file.
+	 *
+	 * @param bool persist
+	 */
+	void setPersistStatistics(bool persist) {
+		this->persistStatistics = persist;
+	}
+
+	/**
+	 * Remove every cached statistic of the raster.
+	 */
+	void clearStatistics() {
+		this->p_stats->clear();
+	}
+
 	/**
 	 * Getter method for the geotransform. Meant to be used by the python side of the application.
 	 * Specifically, used when converting from an sgs object to another Python geospatial library
@@ -834,5 +1560,44 @@ class GDALRasterWrapper {
 	}
 };
 
+/**
+ * @ingroup raster
+ * Set the GDAL configuration options which control how remote rasters (such as
+ * COGs behind /vsicurl/ or /vsis3/) are read. These are process wide:
+ *
+ * GDAL_NUM_THREADS:
+ * 	the number of threads GDAL uses to fetch and decode the tiles of a single
+ * 	read or advised region in parallel.
+ *
+ * GDAL_HTTP_MULTIRANGE:
+ * 	with more than one thread the ranges of an advised region are requested in
+ * 	parallel (GDAL's default), with one thread they are requested one at a time.
+ *
+ * CPL_VSIL_CURL_CACHE_SIZE:
+ * 	the size of the cache of downloaded ranges, in megabytes. GDAL only reads this
+ * 	when the first remote file is opened.
+ *
+ * GDAL_DISABLE_READDIR_ON_OPEN:
+ * 	set to EMPTY_DIR, so that opening a remote raster does not first list the
+ * 	contents of it's directory.
+ *
+ * @param int threads
+ * @param int cacheSize
+ */
+inline void
+setRemoteReadOptions(int threads, int cacheSize) {
+	if (threads < 1) {
+		throw std::runtime_error("number of threads can't be less than 1.");
+	}
+	if (cacheSize < 1) {
+		throw std::runtime_error("cache size must be at least 1 megabyte.");
+	}
+
+	CPLSetConfigOption("GDAL_NUM_THREADS", std::to_string(threads).c_str());
+	CPLSetConfigOption("GDAL_HTTP_MULTIRANGE", threads == 1 ? "SERIAL" : nullptr);
+	CPLSetConfigOption("CPL_VSIL_CURL_CACHE_SIZE", std::to_string(static_cast<int64_t>(cacheSize) * 1024 * 1024).c_str());
+	CPLSetConfigOption("GDAL_DISABLE_READDIR_ON_OPEN", "EMPTY_DIR");
+}
+
 } //namespace raster
 } //namespace sgs
@@ -12,6 +12,7 @@ import sys
 import os
 import site
 import shutil
+import weakref
 from typing import Optional
 
 import numpy as np
@@ -26,6 +27,9 @@ site_packages = list(filter(lambda x : 'site-packages' in x, site.getsitepackage
 sys.path.append(os.path.join(site_packages, "sgspy"))
 sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
 from _sgs import GDALRasterWrapper
+from _sgs import set_remote_read_options as _set_remote_read_options
+from _sgs import set_memory_limit as _set_memory_limit
+from _sgs import memory_usage as _memory_usage
 
 #rasterio optional import
 try: 
@@ -152,7 +156,12 @@ PROJDB_PATH = os.path.join(sys.prefix, "sgspy")
 # plot() @n
 #     takes one optional 'band' argument of type int, or str @n @n
 # band() @n
-#     returns the band data as a numpy array, may throw an error if the raster band is too large
+#     returns the band data as a numpy array, may throw an error if the raster band is too large @n @n
+# persist_statistics() @n
+#     takes one optional 'persist' argument of type bool. When set, statistics calculated by sgs
+#     functions (min/max, histograms, quantiles) are saved with the file when it is closed @n @n
+# clear_statistics() @n
+#     takes no arguments, removes the cached statistics of the raster
 #     
 # Optionally, any of the arguments that can be passed to matplotlib.pyplot.imshow 
 #     can also be passed to plot_image().
@@ -211,7 +220,10 @@ class SpatialRaster:
         self.pixel_width = self.cpp_raster.get_pixel_width()
         self.pixel_height = self.cpp_raster.get_pixel_height() 
         self.band_name_dict = {}
-        self.band_data_dict = {}
+
+        #arrays are only cached while they're in use, so that the C++ buffers they
+        #view can be evicted once they're not (see set_memory_limit())
+        self.band_data_dict = weakref.WeakValueDictionary()
         self.bands = self.cpp_raster.get_bands()
         for i in range(0, len(self.bands)):
             self.band_name_dict[self.bands[i]] = i
@@ -270,10 +282,12 @@ class SpatialRaster:
         if self.closed:
             raise RuntimeError("the C++ object which this class wraps has been cleaned up and closed.")
 
-        self.band_data_dict[band_index] = np.asarray(
+        arr = np.asarray(
             self.cpp_raster.get_raster_as_memoryview(self.width, self.height, band_index).toreadonly(), 
             copy=False
         )
+        self.band_data_dict[band_index] = arr
+        return arr
 
     def band(self, band: str | int):
         """
@@ -291,10 +305,212 @@ class SpatialRaster:
 
         index = self.get_band_index(band)
 
-        if index not in self.band_data_dict:
-            self.load_arr(index)
+        arr = self.band_data_dict.get(index)
+        if arr is None:
+            arr = self.load_arr(index)
         
-        return self.band_data_dict[index]
+        return arr
+
+    def persist_statistics(self, persist: bool = True):
+        """
+        Statistics calculated by sgs functions (such as min/max, histograms, and quantiles)
+        are cached, so that later calls on the same unmodified raster file don't have to
+        scan the raster again. This function sets whether those statistics are also saved
+        alongside the file (in the GDAL .aux.xml sidecar) when the raster is closed, so
+        they are available the next time the file is opened.
+
+        Parameters:
+        persist : bool
+            whether to save the cached statistics
+        """
+        if type(persist) is not bool:
+            raise TypeError("'persist' parameter must be of type bool.")
+
+        if self.closed:
+            raise RuntimeError("the C++ object which this class wraps has been cleaned up and closed.")
+
+        self.cpp_raster.set_persist_statistics(persist)
+
+    def clear_statistics(self):
+        """
+        Removes every cached statistic of the raster, forcing the next sgs function
+        call to scan the raster again.
+        """
+        if self.closed:
+            raise RuntimeError("the C++ object which this class wraps has been cleaned up and closed.")
+
+        self.cpp_raster.clear_statistics()
+
+    def window(self, x_off: int, y_off: int, x_size: int, y_size: int):
+        """
+        Returns a new SpatialRaster covering a window of this raster, which can be
+        passed to any sgs function in place of the full raster. The window is a
+        virtual raster referencing this one, so no raster data is copied or written
+        to disk, and its extent and geotransform are those of the window.
+
+        Parameters:
+        x_off : int
+            the pixel column of the top left corner of the window
+        y_off : int
+            the pixel row of the top left corner of the window
+        x_size : int
+            the width of the window in pixels
+        y_size : int
+            the height of the window in pixels
+        """
+        for (name, val) in (("x_off", x_off), ("y_off", y_off), ("x_size", x_size), ("y_size", y_size)):
+            if type(val) is not int:
+                raise TypeError("'" + name + "' parameter must be of type int.")
+
+        if x_off < 0 or y_off < 0:
+            raise ValueError("'x_off' and 'y_off' can't be negative.")
+
+        if x_size < 1 or y_size < 1:
+            raise ValueError("'x_size' and 'y_size' must be greater than 0.")
+
+        if x_off + x_size > self.width or y_off + y_size > self.height:
+            raise ValueError("window must be within the extent of the raster.")
+
+        if self.closed:
+            raise RuntimeError("the C++ object which this class wraps has been cleaned up and closed.")
+
+        win = SpatialRaster(self.cpp_raster.window(x_off, y_off, x_size, y_size))
+
+        #the window references this rasters dataset, so it must stay open as long as the window does
+        win.parent = self
+        return win
+
+    @property
+    def overview_count(self):
+        """
+        The number of overviews of the raster (0 if it has none).
+        """
+        return self.cpp_raster.get_overview_count()
+
+    def overview(self, level: int):
+        """
+        Returns a new SpatialRaster of an overview of this raster, which can be
+        passed to any sgs function in place of the full raster. Level 0 is the most
+        detailed overview. Like a window, the overview is a virtual raster referencing
+        this one, with the same extent but fewer, larger pixels. For a cloud optimized
+        GeoTIFF, only the overview's part of the file is ever fetched.
+
+        Parameters:
+        level : int
+            the overview level, from 0 to overview_count - 1
+        """
+        if type(level) is not int:
+            raise TypeError("'level' parameter must be of type int.")
+
+        if self.closed:
+            raise RuntimeError("the C++ object which this class wraps has been cleaned up and closed.")
+
+        if level < 0 or level >= self.overview_count:
+            raise ValueError("'level' must be between 0 and " + str(self.overview_count - 1) + ", the raster has " + str(self.overview_count) + " overviews.")
+
+        ovr = SpatialRaster(self.cpp_raster.overview(level))
+
+        #the overview references this rasters dataset, so it must stay open as long as the overview does
+        ovr.parent = self
+        return ovr
+
+    def extract(self, x, y, bands: Optional[list[int | str]] = None, thread_count: int = 8):
+        """
+        Gets the values of the raster bands at a set of points, as a contiguous
+        numpy array of float64 with one row per point and one column per band.
+        Points outside of the raster extent have nan values, nodata values are
+        returned as is.
+
+        The points are grouped by the raster block they fall in, so each block
+        containing a point is read once (in parallel, using thread_count threads)
+        regardless of the number of points within it.
+
+        Parameters:
+        x : array-like
+            the x coordinates of the points
+        y : array-like
+            the y coordinates of the points
+        bands : list[int | str]
+            the bands to extract, either 0-indexed int values or band names. Every band is extracted if not given
+        thread_count : int
+            the number of threads to use when reading the raster
+        """
+        if bands is not None and type(bands) is not list:
+            raise TypeError("'bands' parameter, if given, must be a list of int or str values.")
+
+        if type(thread_count) is not int:
+            raise TypeError("'thread_count' parameter must be of type int.")
+
+        if thread_count < 1:
+            raise ValueError("number of threads can't be less than 1.")
+
+        if self.closed:
+            raise RuntimeError("the C++ object which this class wraps has been cleaned up and closed.")
+
+        x = np.ascontiguousarray(x, dtype=np.float64).ravel()
+        y = np.ascontiguousarray(y, dtype=np.float64).ravel()
+        if x.shape != y.shape:
+            raise ValueError("'x' and 'y' must contain the same number of coordinates.")
+
+        if bands is None:
+            band_indices = list(range(self.band_count))
+        else:
+            band_indices = []
+            for band in bands:
+                if type(band) not in [int, str]:
+                    raise TypeError("'bands' parameter, if given, must be a list of int or str values.")
+
+                if type(band) is str and band not in self.bands:
+                    raise ValueError("band " + band + " not in raster.")
+
+                if type(band) is int and (band < 0 or band >= self.band_count):
+                    raise ValueError("0-indexed band of " + str(band) + " given, but raster only has " + str(self.band_count) + " bands.")
+
+                band_indices.append(self.get_band_index(band))
+
+            if len(band_indices) == 0:
+                raise ValueError("'bands' list must contain at least one band.")
+
+        values = np.empty((x.shape[0], len(band_indices)), dtype=np.float64)
+        self.cpp_raster.extract(x, y, band_indices, values, thread_count)
+        return values
+
+    def tiles(self, tile_width: Optional[int] = None, tile_height: Optional[int] = None):
+        """
+        Generator which splits the raster into tiles, yielding (x_off, y_off, tile)
+        tuples where tile is a SpatialRaster window (see window()). Tile sizes are
+        rounded up to a multiple of the raster's block size, so that every block
+        is read by only one tile. By default a tile is one row of blocks.
+
+        Parameters:
+        tile_width : int
+            the width of a tile in pixels
+        tile_height : int
+            the height of a tile in pixels
+        """
+        if tile_width is not None and type(tile_width) is not int:
+            raise TypeError("'tile_width' parameter, if given, must be of type int.")
+
+        if tile_height is not None and type(tile_height) is not int:
+            raise TypeError("'tile_height' parameter, if given, must be of type int.")
+
+        if (tile_width is not None and tile_width < 1) or (tile_height is not None and tile_height < 1):
+            raise ValueError("'tile_width' and 'tile_height' must be greater than 0.")
+
+        if self.closed:
+            raise RuntimeError("the C++ object which this class wraps has been cleaned up and closed.")
+
+        [x_block, y_block] = self.cpp_raster.get_block_size()
+        tile_width = self.width if tile_width is None else tile_width
+        tile_height = y_block if tile_height is None else tile_height
+        tile_width = min(self.width, -(-tile_width // x_block) * x_block)
+        tile_height = min(self.height, -(-tile_height // y_block) * y_block)
+
+        for y_off in range(0, self.height, tile_height):
+            for x_off in range(0, self.width, tile_width):
+                x_size = min(tile_width, self.width - x_off)
+                y_size = min(tile_height, self.height - y_off)
+                yield (x_off, y_off, self.window(x_off, y_off, x_size, y_size))
 
     def plot(self, 
              ax: Optional[matplotlib.axes.Axes] = None,
@@ -634,6 +850,80 @@ class SpatialRaster:
         #each entry in the srast_metadata_info list should contain a StratRasterBandMetadata object
         self.srast_metadata_info[band].print_info()
 
+def set_remote_read_options(thread_count: int = 8, cache_size: int = 64):
+    """
+    Sets how GDAL reads remote rasters, such as cloud optimized GeoTIFFs opened with
+    a '/vsicurl/' or '/vsis3/' path. sgs tells GDAL which blocks of a remote raster
+    are about to be read, so they are requested together as a batch of coalesced
+    byte ranges. thread_count is the number of those requests (and of tile decodes)
+    GDAL makes in parallel, and cache_size is the size in megabytes of the cache of
+    downloaded ranges. These options apply to every raster, and the cache size only
+    takes effect if this is called before the first remote raster is opened.
+
+    Parameters:
+    thread_count : int
+        the number of threads used to fetch and decode the tiles of a remote raster
+    cache_size : int
+        the size of the cache of downloaded data, in megabytes
+    """
+    if type(thread_count) is not int:
+        raise TypeError("'thread_count' parameter must be of type int.")
+
+    if type(cache_size) is not int:
+        raise TypeError("'cache_size' parameter must be of type int.")
+
+    if thread_count < 1:
+        raise ValueError("number of threads can't be less than 1.")
+
+    if cache_size < 1:
+        raise ValueError("'cache_size' must be at least 1 megabyte.")
+
+    _set_remote_read_options(thread_count, cache_size)
+
+def set_memory_limit(limit: Optional[int]):
+    """
+    Sets a limit in bytes on the total size of the raster bands which every SpatialRaster
+    in the process holds in memory, including the downsampled bands used for plotting.
+    None (the default) means there is no limit.
+
+    When the limit is exceeded, the least recently used bands are released once no sgs
+    function is running. A band read from a file is read again if it's needed later. A
+    band of a raster which exists only in memory (such as the output of the stratification
+    functions when no filename is given) is first spilled to temporary GTiff files which
+    then back the raster. Bands which are still referenced by a numpy array (for example
+    the result of SpatialRaster.band()) are never released, so they don't count toward
+    freeing memory until the arrays are garbage collected. A raster which exists only in
+    memory can't be spilled once a window or overview of it has been made.
+
+    Parameters:
+    limit : Optional[int]
+        the maximum number of bytes of raster bands in memory, or None for no limit
+    """
+    if limit is not None and type(limit) is not int:
+        raise TypeError("'limit' parameter, if given, must be of type int.")
+
+    if limit is not None and limit < 1:
+        raise ValueError("'limit' must be at least 1 byte.")
+
+    _set_memory_limit(0 if limit is None else limit)
+
+def memory_usage():
+    """
+    Returns the memory used by the raster bands every SpatialRaster in the process holds
+    in memory, as a dict containing 'limit' (the limit set by set_memory_limit(), or None),
+    'bytes' (the total size of the bands), 'bands' (the number of bands), 'pinned_bytes'
+    (the size of the bands referenced by numpy arrays, which can't be released), and
+    'evictions' (the number of bands released so far to stay within the limit).
+    """
+    (limit, used, bands, pinned, evictions) = _memory_usage()
+    return {
+        'limit': None if limit == 0 else limit,
+        'bytes': used,
+        'bands': bands,
+        'pinned_bytes': pinned,
+        'evictions': evictions,
+    }
+
 class StratRasterBandMetadata:
     """
     The StratRasterBandMetadata class is meant to be used to store info on a particular
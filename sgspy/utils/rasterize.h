@@ -0,0 +1,357 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: tiled, parallel rasterization of vector geometries
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup rasterize rasterize
+ * @ingroup utils
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+
+#include <gdal_priv.h>
+#include <gdal_alg.h>
+#include <ogr_api.h>
+
+#include "utils/helper.h"
+#include "utils/reader.h"
+
+#define RASTERIZE_TILE_SIZE 512
+
+namespace sgs {
+namespace rasterize {
+
+/**
+ * @ingroup rasterize
+ * The size of a rasterization tile along one axis. Tiles are a multiple of
+ * the block size of the output band when blocks are smaller than RASTERIZE_TILE_SIZE,
+ * so that the writes of different tiles never touch the same block. With large
+ * blocks (for example scanlines) RASTERIZE_TILE_SIZE is used, so that the memory
+ * used by a tile is bounded.
+ *
+ * @param int blockSize
+ * @param int rasterSize
+ * @returns int
+ */
+inline int
+tileSize(int blockSize, int rasterSize) {
+	int size = blockSize >= RASTERIZE_TILE_SIZE ?
+		RASTERIZE_TILE_SIZE :
+		blockSize * ((RASTERIZE_TILE_SIZE + blockSize - 1) / blockSize);
+
+	return std::max(1, std::min(size, rasterSize));
+}
+
+/**
+ * @ingroup rasterize
+ * The extent of a tile in the coordinates of the raster, expanded by pad pixels on every
+ * side, but never past the extent of the raster itself. Only north-up geotransforms are
+ * supported, like the rest of sgs.
+ *
+ * @param double *GT
+ * @param const reader::Window& window
+ * @param int width
+ * @param int height
+ * @param int pad
+ * @returns OGREnvelope
+ */
+inline OGREnvelope
+tileEnvelope(double *GT, const reader::Window& window, int width, int height, int pad) {
+	int xStart = std::max(0, window.xOff - pad);
+	int yStart = std::max(0, window.yOff - pad);
+	int xEnd = std::min(width, window.xOff + window.xValid + pad);
+	int yEnd = std::min(height, window.yOff + window.yValid + pad);
+
+	OGREnvelope env;
+	env.MinX = std::min(GT[0] + xStart * GT[1], GT[0] + xEnd * GT[1]);
+	env.MaxX = std::max(GT[0] + xStart * GT[1], GT[0] + xEnd * GT[1]);
+	env.MinY = std::min(GT[3] + yStart * GT[5], GT[3] + yEnd * GT[5]);
+	env.MaxY = std::max(GT[3] + yStart * GT[5], GT[3] + yEnd * GT[5]);
+	return env;
+}
+
+/**
+ * @ingroup rasterize
+ * A spatial index of geometries over the tiles of a raster, standing in for an
+ * STRtree. Since the only queries are the tiles themselves, every geometry is
+ * inserted once into the bucket of each tile its (padded) envelope overlaps, and
+ * a query is a single lookup. Within a bucket, geometries stay in the order they
+ * were inserted, so features later in a layer are still burned over earlier ones.
+ */
+class TileIndex {
+	private:
+	double *GT;
+	int width;
+	int height;
+	int xTileSize;
+	int yTileSize;
+	int xTiles;
+	int yTiles;
+	std::vector<std::vector<size_t>> buckets;
+
+	public:
+	/**
+	 * Constructor for the index.
+	 *
+	 * @param double *GT
+	 * @param int width
+	 * @param int height
+	 * @param int xTileSize
+	 * @param int yTileSize
+	 */
+	TileIndex(double *GT, int width, int height, int xTileSize, int yTileSize) :
+		GT(GT), width(width), height(height), xTileSize(xTileSize), yTileSize(yTileSize)
+	{
+		this->xTiles = (width + xTileSize - 1) / xTileSize;
+		this->yTiles = (height + yTileSize - 1) / yTileSize;
+		this->buckets.resize(static_cast<size_t>(this->xTiles) * this->yTiles);
+	}
+
+	/**
+	 * Insert the geometry with the given id, using its envelope expanded by pad
+	 * (in the units of the raster). Geometries entirely outside of the raster are
+	 * ignored.
+	 *
+	 * @param size_t id
+	 * @param const OGREnvelope& env
+	 * @param double pad
+	 */
+	void insert(size_t id, const OGREnvelope& env, double pad) {
+		double x1 = (env.MinX - pad - GT[0]) / GT[1];
+		double x2 = (env.MaxX + pad - GT[0]) / GT[1];
+		double y1 = (env.MinY - pad - GT[3]) / GT[5];
+		double y2 = (env.MaxY + pad - GT[3]) / GT[5];
+
+		double xMin = std::floor(std::min(x1, x2));
+		double xMax = std::floor(std::max(x1, x2));
+		double yMin = std::floor(std::min(y1, y2));
+		double yMax = std::floor(std::max(y1, y2));
+
+		if (xMax < 0 || yMax < 0 || xMin >= this->width || yMin >= this->height) {
+			return;
+		}
+
+		int xTileStart = static_cast<int>(std::max(0.0, xMin)) / this->xTileSize;
+		int yTileStart = static_cast<int>(std::max(0.0, yMin)) / this->yTileSize;
+		int xTileEnd = static_cast<int>(std::min(static_cast<double>(this->width - 1), xMax)) / this->xTileSize;
+		int yTileEnd = static_cast<int>(std::min(static_cast<double>(this->height - 1), yMax)) / this->yTileSize;
+
+		for (int yTile = yTileStart; yTile <= yTileEnd; yTile++) {
+			for (int xTile = xTileStart; xTile <= xTileEnd; xTile++) {
+				this->buckets[static_cast<size_t>(yTile) * this->xTiles + xTile].push_back(id);
+			}
+		}
+	}
+
+	/**
+	 * The ids of the geometries which may intersect the given tile.
+	 *
+	 * @param const reader::Window& window
+	 * @returns const std::vector<size_t>&
+	 */
+	const std::vector<size_t>& query(const reader::Window& window) const {
+		return this->buckets[static_cast<size_t>(window.yBlock) * this->xTiles + window.xBlock];
+	}
+};
+
+/**
+ * @ingroup rasterize
+ * Burn geometries into the buffer of a single tile. The buffer has a line stride of
+ * xTileSize pixels, and is wrapped by an in-memory dataset with the geotransform of
+ * the tile so that GDALRasterizeGeometries() only touches the pixels of this tile.
+ * Each tile has its own dataset, so multiple tiles may be burned at once.
+ *
+ * @param void *p_buffer
+ * @param GDALDataType type
+ * @param size_t size
+ * @param const reader::Window& window
+ * @param int xTileSize
+ * @param double *GT
+ * @param std::vector<OGRGeometryH>& geometries
+ * @param std::vector<double>& burnValues
+ * @param bool allTouched
+ */
+inline void
+burnTile(
+	void *p_buffer,
+	GDALDataType type,
+	size_t size,
+	const reader::Window& window,
+	int xTileSize,
+	double *GT,
+	std::vector<OGRGeometryH>& geometries,
+	std::vector<double>& burnValues,
+	bool allTouched)
+{
+	if (geometries.empty()) {
+		return;
+	}
+
+	double tileGT[6] = {
+		GT[0] + window.xOff * GT[1],
+		GT[1],
+		GT[2],
+		GT[3] + window.yOff * GT[5],
+		GT[4],
+		GT[5]
+	};
+
+	GDALDataset *p_tileDataset = helper::createVirtualDataset("MEM", window.xValid, window.yValid, tileGT, "");
+
+	helper::RasterBandMetaData band;
+	band.p_buffer = p_buffer;
+	band.type = type;
+	band.size = size;
+	helper::addBandToMEMDataset(p_tileDataset, band, 0, static_cast<GSpacing>(size) * xTileSize);
+
+	char **papszOptions = nullptr;
+	if (allTouched) {
+		papszOptions = CSLSetNameValue(papszOptions, "ALL_TOUCHED", "TRUE");
+	}
+
+	int bandList[1] = {1};
+	CPLErr err = GDALRasterizeGeometries(
+		GDALDataset::ToHandle(p_tileDataset),
+		1,
+		bandList,
+		static_cast<int>(geometries.size()),
+		geometries.data(),
+		nullptr,
+		nullptr,
+		burnValues.data(),
+		papszOptions,
+		nullptr,
+		nullptr
+	);
+
+	CSLDestroy(papszOptions);
+	GDALClose(GDALDataset::ToHandle(p_tileDataset));
+
+	if (err) {
+		throw std::runtime_error("unable to rasterize geometries.");
+	}
+}
+
+/**
+ * @ingroup rasterize
+ * Call fn(window, chunk) for every tile of a raster, using a pool of threads.
+ * Rows of tiles are split into contiguous chunks, one task per chunk, the same way
+ * the other parallel raster functions split rows of blocks. An exception thrown by
+ * any task is re-thrown once every task has finished.
+ *
+ * @param int width
+ * @param int height
+ * @param int xTileSize
+ * @param int yTileSize
+ * @param int threads
+ * @param F fn
+ */
+template <typename F>
+inline void
+forEachTile(int width, int height, int xTileSize, int yTileSize, int threads, F fn) {
+	int yTiles = (height + yTileSize - 1) / yTileSize;
+	int chunkSize = std::max(1, (yTiles + threads - 1) / threads);
+	int chunks = (yTiles + chunkSize - 1) / chunkSize;
+
+	std::vector<std::exception_ptr> errors(chunks);
+	boost::asio::thread_pool pool(threads);
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		int yTileStart = chunk * chunkSize;
+		int yTileEnd = std::min(yTiles, yTileStart + chunkSize);
+
+		boost::asio::post(pool, [&, chunk, yTileStart, yTileEnd] {
+			try {
+				for (const reader::Window& window : reader::blockWindows(xTileSize, yTileSize, width, height, yTileStart, yTileEnd)) {
+					fn(window, chunk);
+				}
+			}
+			catch (...) {
+				errors[chunk] = std::current_exception();
+			}
+		});
+	}
+	pool.join();
+
+	for (const std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+/**
+ * @ingroup rasterize
+ * The number of chunks forEachTile() will split the tiles into, so that per-chunk
+ * results can be allocated before it is called.
+ *
+ * @param int height
+ * @param int yTileSize
+ * @param int threads
+ * @returns int
+ */
+inline int
+tileChunks(int height, int yTileSize, int threads) {
+	int yTiles = (height + yTileSize - 1) / yTileSize;
+	int chunkSize = std::max(1, (yTiles + threads - 1) / threads);
+	return (yTiles + chunkSize - 1) / chunkSize;
+}
+
+/**
+ * @ingroup rasterize
+ * Add every polygon in a geometry to a multipolygon, whether the geometry
+ * is a single polygon or a collection of them (as a buffer or intersection
+ * may return). The geometry is not taken ownership of.
+ *
+ * @param OGRMultiPolygon& polygons
+ * @param OGRGeometry *p_geometry
+ */
+inline void
+addPolygons(OGRMultiPolygon& polygons, OGRGeometry *p_geometry) {
+	if (!p_geometry || p_geometry->IsEmpty()) {
+		return;
+	}
+
+	switch (wkbFlatten(p_geometry->getGeometryType())) {
+		case OGRwkbGeometryType::wkbPolygon:
+			polygons.addGeometry(p_geometry);
+			break;
+		case OGRwkbGeometryType::wkbMultiPolygon:
+		case OGRwkbGeometryType::wkbGeometryCollection:
+			for (OGRGeometry *p_part : *p_geometry->toGeometryCollection()) {
+				addPolygons(polygons, p_part);
+			}
+			break;
+		default:
+			//lines or points from a degenerate intersection have no area
+			break;
+	}
+}
+
+/**
+ * @ingroup rasterize
+ * The area of a geometry, 0 if the geometry is null.
+ *
+ * @param OGRGeometry *p_geometry
+ * @returns double
+ */
+inline double
+area(OGRGeometry *p_geometry) {
+	return p_geometry ? OGR_G_Area(OGRGeometry::ToHandle(p_geometry)) : 0;
+}
+
+} //namespace rasterize
+} //namespace sgs
@@ -0,0 +1,659 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: prefetching raster block reader
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup reader reader
+ * @ingroup utils
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
+#include <gdal_priv.h>
+
+#include "utils/helper.h"
+#include "utils/profile.h"
+
+#define READER_ADVISE_WINDOWS 16
+
+namespace sgs {
+namespace reader {
+
+/**
+ * @ingroup reader
+ * This struct represents a rectangular window of a raster which is read
+ * into memory as a single block. It stores:
+ *
+ * int xBlock, yBlock:
+ * 	the block indices of the window. These are only used when the
+ * 	window corresponds exactly to a natural block of the raster band,
+ * 	in which case GDALRasterBand::ReadBlock() is used.
+ *
+ * int xOff, yOff:
+ * 	the pixel offset of the top left corner of the window.
+ *
+ * int xValid, yValid:
+ * 	the number of valid pixels in the x and y directions of the window.
+ */
+struct Window {
+	int xBlock = 0;
+	int yBlock = 0;
+	int xOff = 0;
+	int yOff = 0;
+	int xValid = 0;
+	int yValid = 0;
+};
+
+/**
+ * @ingroup reader
+ * This struct represents a window which has been read into memory. There is
+ * one buffer per band, unless the reader is interleaved, in which case there
+ * is a single buffer containing every band.
+ *
+ * Each buffer has a line stride of the x buffer size of the reader (multiplied
+ * by the band count if interleaved), the same as a natural block would.
+ */
+struct Block {
+	Window window;
+	std::vector<void *> buffers;
+};
+
+/**
+ * @ingroup reader
+ * This helper function creates the windows corresponding to the natural blocks
+ * within a range of rows of blocks. The windows are in row-major order, and the
+ * valid sizes of the windows on the edges of the raster are calculated
+ * so GDALRasterBand::GetActualBlockSize() doesn't have to be called.
+ *
+ * @param int xBlockSize
+ * @param int yBlockSize
+ * @param int width
+ * @param int height
+ * @param int yBlockStart
+ * @param int yBlockEnd
+ * @returns std::vector<Window>
+ */
+inline std::vector<Window>
+blockWindows(
+	int xBlockSize,
+	int yBlockSize,
+	int width,
+	int height,
+	int yBlockStart,
+	int yBlockEnd)
+{
+	int xBlocks = (width + xBlockSize - 1) / xBlockSize;
+
+	std::vector<Window> windows;
+	windows.reserve(static_cast<size_t>(xBlocks) * std::max(0, yBlockEnd - yBlockStart));
+	for (int yBlock = yBlockStart; yBlock < yBlockEnd; yBlock++) {
+		for (int xBlock = 0; xBlock < xBlocks; xBlock++) {
+			Window window;
+			window.xBlock = xBlock;
+			window.yBlock = yBlock;
+			window.xOff = xBlock * xBlockSize;
+			window.yOff = yBlock * yBlockSize;
+			window.xValid = std::min(xBlockSize, width - window.xOff);
+			window.yValid = std::min(yBlockSize, height - window.yOff);
+			windows.push_back(window);
+		}
+	}
+
+	return windows;
+}
+
+/**
+ * @ingroup reader
+ * The BlockReader class reads a sequence of windows of one or more raster bands
+ * on a dedicated I/O thread, so that reading the next blocks from disk overlaps with
+ * the processing of the current block.
+ *
+ * A bounded pool of (prefetch + 1) blocks is allocated when the reader is constructed.
+ * The I/O thread takes free blocks from the pool, reads the next window into them,
+ * and places them in a ready queue in order. The consumer calls next() to take the
+ * next ready block; the block previously returned by next() is given back to the
+ * pool at that time. As a result, at most prefetch blocks are read ahead, and the
+ * memory used by the reader doesn't depend on the size of the raster.
+ *
+ * The p_mutex of each band is still locked while it is read, since a GDAL dataset
+ * handle can't be accessed from multiple threads at once. However, that locking
+ * now happens on the I/O thread rather than interrupting the processing thread.
+ *
+ * If the reader is interleaved, every band is read into a single buffer with a
+ * common data type, where the pixel values of each band are adjacent to one another,
+ * as required by the PCA computations.
+ *
+ * If any band is remote (see helper::isRemote()), the I/O thread calls
+ * GDALRasterBand::AdviseRead() over each batch of READER_ADVISE_WINDOWS upcoming
+ * windows before reading them. For a cloud optimized GeoTIFF this lets GDAL fetch
+ * every tile of the batch with one set of coalesced, parallel range requests,
+ * rather than one request per block as each is read.
+ *
+ * While a profile is running (see profile.h), every band read is recorded, as is
+ * the time the consumer spends waiting in next() for the I/O thread.
+ *
+ * An exception thrown while reading is stored, and re-thrown from next().
+ */
+class BlockReader {
+	private:
+	std::vector<helper::RasterBandMetaData *> bands;
+	std::vector<Window> windows;
+	int xBufferSize;
+	int yBufferSize;
+
+	bool interleaved = false;
+	GDALDataType interleavedType = GDT_Unknown;
+	size_t interleavedSize = 0;
+	bool remote = false;
+
+	std::vector<Block> pool;
+	std::deque<Block *> freeBlocks;
+	std::deque<Block *> readyBlocks;
+	Block *p_current = nullptr;
+
+	bool stop = false;
+	bool finished = false;
+	std::exception_ptr error = nullptr;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::thread worker;
+
+	/**
+	 * Allocates the buffers of every block in the pool, and
+	 * starts the I/O thread.
+	 *
+	 * @param int prefetch
+	 */
+	void init(int prefetch) {
+		this->pool.resize(std::max(1, prefetch) + 1);
+		for (Block& block : this->pool) {
+			if (this->interleaved) {
+				size_t pixelSize = this->interleavedSize * this->bands.size();
+				block.buffers.push_back(VSIMalloc3(this->xBufferSize, this->yBufferSize, pixelSize));
+			}
+			else {
+				for (helper::RasterBandMetaData *p_band : this->bands) {
+					block.buffers.push_back(VSIMalloc3(this->xBufferSize, this->yBufferSize, p_band->size));
+				}
+			}
+
+			for (void *p_buffer : block.buffers) {
+				if (!p_buffer) {
+					this->freeBuffers();
+					throw std::runtime_error("unable to allocate block reader buffers.");
+				}
+			}
+			this->freeBlocks.push_back(&block);
+		}
+
+		for (helper::RasterBandMetaData *p_band : this->bands) {
+			this->remote |= helper::isRemote(p_band->p_band);
+		}
+
+		this->worker = std::thread(&BlockReader::run, this);
+	}
+
+	/**
+	 * Frees the buffers of every block in the pool.
+	 */
+	void freeBuffers() {
+		for (Block& block : this->pool) {
+			for (void *p_buffer : block.buffers) {
+				VSIFree(p_buffer);
+			}
+			block.buffers.clear();
+		}
+	}
+
+	/**
+	 * Reads a single band of a window into a buffer. If the window is a whole
+	 * natural block of the band, and the buffer has the same dimensions as the
+	 * block, GDALRasterBand::ReadBlock() is used. Otherwise, GDALRasterBand::RasterIO()
+	 * is used with a line stride of the x buffer size, so that the buffer has
+	 * the same layout as a block would.
+	 *
+	 * @param RasterBandMetaData& band
+	 * @param const Window& window
+	 * @param void *p_buffer
+	 * @param GDALDataType type
+	 * @param size_t pixelSpace
+	 * @param size_t lineSpace
+	 */
+	void readBand(
+		helper::RasterBandMetaData& band,
+		const Window& window,
+		void *p_buffer,
+		GDALDataType type,
+		size_t pixelSpace,
+		size_t lineSpace)
+	{
+		bool useBlock = !this->interleaved &&
+			this->xBufferSize == band.xBlockSize &&
+			this->yBufferSize == band.yBlockSize &&
+			window.xOff == window.xBlock * band.xBlockSize &&
+			window.yOff == window.yBlock * band.yBlockSize &&
+			window.xValid == std::min(band.xBlockSize, band.p_band->GetXSize() - window.xOff) &&
+			window.yValid == std::min(band.yBlockSize, band.p_band->GetYSize() - window.yOff);
+
+		CPLErr err;
+		if (band.p_mutex) {
+			profile::lock(band.p_mutex);
+		}
+		profile::IOScope io(band.p_band, static_cast<int64_t>(window.xValid) * window.yValid * GDALGetDataTypeSizeBytes(type), true);
+		if (useBlock) {
+			err = band.p_band->ReadBlock(window.xBlock, window.yBlock, p_buffer);
+		}
+		else {
+			err = band.p_band->RasterIO(
+				GF_Read,
+				window.xOff,
+				window.yOff,
+				window.xValid,
+				window.yValid,
+				p_buffer,
+				window.xValid,
+				window.yValid,
+				type,
+				pixelSpace,
+				lineSpace
+			);
+		}
+		if (band.p_mutex) {
+			band.p_mutex->unlock();
+		}
+		if (err) {
+			throw std::runtime_error("unable to read block from raster.");
+		}
+	}
+
+	/**
+	 * Reads every band of a window into a block.
+	 *
+	 * @param Block& block
+	 * @param const Window& window
+	 */
+	void readWindow(Block& block, const Window& window) {
+		block.window = window;
+
+		if (this->interleaved) {
+			size_t pixelSpace = this->interleavedSize * this->bands.size();
+			size_t lineSpace = pixelSpace * this->xBufferSize;
+			for (size_t i = 0; i < this->bands.size(); i++) {
+				void *p_buffer = reinterpret_cast<void *>(
+					reinterpret_cast<char *>(block.buffers[0]) + i * this->interleavedSize
+				);
+				readBand(*this->bands[i], window, p_buffer, this->interleavedType, pixelSpace, lineSpace);
+			}
+		}
+		else {
+			for (size_t i = 0; i < this->bands.size(); i++) {
+				helper::RasterBandMetaData *p_band = this->bands[i];
+				readBand(*p_band, window, block.buffers[i], p_band->type, p_band->size, p_band->size * this->xBufferSize);
+			}
+		}
+	}
+
+	/**
+	 * Advises every band of the batch of windows starting at the given index. The
+	 * batch is advised as its bounding rectangle, so batches which are too sparse
+	 * for that rectangle to be mostly made up of the windows themselves (as when a
+	 * few scattered points are read) are not advised, and are read as usual.
+	 * Readers of other chunks of the same dataset may replace this advice with
+	 * their own before it is used, which costs extra requests but never changes
+	 * the values read.
+	 *
+	 * @param size_t start
+	 */
+	void adviseWindows(size_t start) {
+		size_t end = std::min(this->windows.size(), start + READER_ADVISE_WINDOWS);
+
+		int xMin = this->windows[start].xOff;
+		int yMin = this->windows[start].yOff;
+		int xMax = xMin;
+		int yMax = yMin;
+		int64_t area = 0;
+		for (size_t i = start; i < end; i++) {
+			const Window& window = this->windows[i];
+			xMin = std::min(xMin, window.xOff);
+			yMin = std::min(yMin, window.yOff);
+			xMax = std::max(xMax, window.xOff + window.xValid);
+			yMax = std::max(yMax, window.yOff + window.yValid);
+			area += static_cast<int64_t>(window.xValid) * window.yValid;
+		}
+
+		int xSize = xMax - xMin;
+		int ySize = yMax - yMin;
+		if (static_cast<int64_t>(xSize) * ySize > 2 * area) {
+			return;
+		}
+
+		for (helper::RasterBandMetaData *p_band : this->bands) {
+			if (p_band->p_mutex) {
+				profile::lock(p_band->p_mutex);
+			}
+			//advice is only a hint, so a failure is not an error
+			p_band->p_band->AdviseRead(xMin, yMin, xSize, ySize, xSize, ySize, p_band->type, nullptr);
+			if (p_band->p_mutex) {
+				p_band->p_mutex->unlock();
+			}
+		}
+	}
+
+	/**
+	 * The function run by the I/O thread. Each window is read in order into
+	 * a free block, which is then added to the ready queue. The thread waits
+	 * whenever there are no free blocks, and exits once every window has been
+	 * read, the reader is destroyed, or an error occurs.
+	 */
+	void run() {
+		try {
+			for (size_t i = 0; i < this->windows.size(); i++) {
+				const Window& window = this->windows[i];
+				if (this->remote && i % READER_ADVISE_WINDOWS == 0) {
+					adviseWindows(i);
+				}
+
+				Block *p_block;
+				{
+					std::unique_lock lock(this->mutex);
+					this->cv.wait(lock, [this]{ return this->stop || !this->freeBlocks.empty(); });
+					if (this->stop) {
+						return;
+					}
+					p_block = this->freeBlocks.front();
+					this->freeBlocks.pop_front();
+				}
+
+				readWindow(*p_block, window);
+
+				{
+					std::lock_guard lock(this->mutex);
+					this->readyBlocks.push_back(p_block);
+				}
+				this->cv.notify_all();
+			}
+		}
+		catch (...) {
+			std::lock_guard lock(this->mutex);
+			this->error = std::current_exception();
+		}
+
+		{
+			std::lock_guard lock(this->mutex);
+			this->finished = true;
+		}
+		this->cv.notify_all();
+	}
+
+	public:
+	/**
+	 * Constructor for a reader which reads each band into it's own buffer.
+	 *
+	 * @param std::vector<RasterBandMetaData *> bands
+	 * @param std::vector<Window> windows
+	 * @param int xBufferSize
+	 * @param int yBufferSize
+	 * @param int prefetch
+	 */
+	BlockReader(
+		std::vector<helper::RasterBandMetaData *> bands,
+		std::vector<Window> windows,
+		int xBufferSize,
+		int yBufferSize,
+		int prefetch = 2) :
+		bands(std::move(bands)),
+		windows(std::move(windows)),
+		xBufferSize(xBufferSize),
+		yBufferSize(yBufferSize)
+	{
+		init(prefetch);
+	}
+
+	/**
+	 * Constructor for an interleaved reader, which reads every band into a
+	 * single buffer with the given data type.
+	 *
+	 * @param std::vector<RasterBandMetaData *> bands
+	 * @param std::vector<Window> windows
+	 * @param int xBufferSize
+	 * @param int yBufferSize
+	 * @param GDALDataType type
+	 * @param size_t size
+	 * @param int prefetch
+	 */
+	BlockReader(
+		std::vector<helper::RasterBandMetaData *> bands,
+		std::vector<Window> windows,
+		int xBufferSize,
+		int yBufferSize,
+		GDALDataType type,
+		size_t size,
+		int prefetch = 2) :
+		bands(std::move(bands)),
+		windows(std::move(windows)),
+		xBufferSize(xBufferSize),
+		yBufferSize(yBufferSize),
+		interleaved(true),
+		interleavedType(type),
+		interleavedSize(size)
+	{
+		init(prefetch);
+	}
+
+	BlockReader(const BlockReader&) = delete;
+	BlockReader& operator=(const BlockReader&) = delete;
+
+	/**
+	 * Destructor, stops and joins the I/O thread then frees the buffers.
+	 */
+	~BlockReader() {
+		{
+			std::lock_guard lock(this->mutex);
+			this->stop = true;
+		}
+		this->cv.notify_all();
+		if (this->worker.joinable()) {
+			this->worker.join();
+		}
+		freeBuffers();
+	}
+
+	/**
+	 * Returns the next block, in the same order as the windows passed to
+	 * the constructor, waiting for it to be read if necessary. The block
+	 * returned by the previous call is released back to the pool, so it
+	 * must no longer be used. Returns nullptr once every window has been read.
+	 *
+	 * @returns Block *
+	 */
+	Block *next() {
+		std::unique_lock lock(this->mutex);
+		if (this->p_current) {
+			this->freeBlocks.push_back(this->p_current);
+			this->p_current = nullptr;
+			this->cv.notify_all();
+		}
+
+		if (this->readyBlocks.empty() && !this->finished) {
+			profile::Scope wait(profile::BLOCK_WAIT);
+			this->cv.wait(lock, [this]{ return !this->readyBlocks.empty() || this->finished; });
+		}
+		if (this->readyBlocks.empty()) {
+			if (this->error) {
+				std::rethrow_exception(this->error);
+			}
+			return nullptr;
+		}
+
+		this->p_current = this->readyBlocks.front();
+		this->readyBlocks.pop_front();
+		return this->p_current;
+	}
+};
+
+/**
+ * @ingroup reader
+ * The Morton (Z-order) code of a block, interleaving the bits of the block indices
+ * so that blocks which are close to eachother in the raster have close codes.
+ *
+ * @param uint32_t xBlock
+ * @param uint32_t yBlock
+ * @returns uint64_t
+ */
+inline uint64_t
+mortonCode(uint32_t xBlock, uint32_t yBlock) {
+	auto spread = [](uint64_t v) {
+		v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+		v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+		v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		v = (v | (v << 2)) & 0x3333333333333333ULL;
+		v = (v | (v << 1)) & 0x5555555555555555ULL;
+		return v;
+	};
+	return spread(xBlock) | (spread(yBlock) << 1);
+}
+
+/**
+ * @ingroup reader
+ * This function reads the value of every band at a set of pixels, without
+ * reading any block more than once or reading blocks which contain none of
+ * the pixels.
+ *
+ * The pixels are sorted by the Morton code of the block (of the first band)
+ * they fall in, and each block containing at least one pixel becomes a window.
+ * The windows are split into contiguous chunks (which, because of the Morton
+ * order, are also spatially compact) which are processed using threads threads,
+ * each chunk with it's own interleaved BlockReader which converts every band
+ * to double.
+ *
+ * fn(i, p_values) is called once for every pixel i within the raster, where
+ * p_values points to the nBands values of that pixel. Pixels outside of the
+ * raster are skipped. Each pixel is passed to exactly one call, but calls for
+ * different pixels may happen at the same time on different threads.
+ *
+ * @param std::vector<RasterBandMetaData *> bands
+ * @param const int *pixelX
+ * @param const int *pixelY
+ * @param size_t n
+ * @param int width
+ * @param int height
+ * @param int threads
+ * @param F fn
+ */
+template <typename F>
+inline void
+readPixels(
+	std::vector<helper::RasterBandMetaData *> bands,
+	const int *pixelX,
+	const int *pixelY,
+	size_t n,
+	int width,
+	int height,
+	int threads,
+	F fn)
+{
+	int xBlockSize = bands[0]->xBlockSize;
+	int yBlockSize = bands[0]->yBlockSize;
+	size_t nBands = bands.size();
+
+	//step 1: sort the pixels within the raster by the Morton code of their block
+	std::vector<size_t> order;
+	std::vector<uint64_t> codes(n);
+	order.reserve(n);
+	for (size_t i = 0; i < n; i++) {
+		if (pixelX[i] < 0 || pixelY[i] < 0 || pixelX[i] >= width || pixelY[i] >= height) {
+			continue;
+		}
+		codes[i] = mortonCode(pixelX[i] / xBlockSize, pixelY[i] / yBlockSize);
+		order.push_back(i);
+	}
+
+	if (order.empty()) {
+		return;
+	}
+
+	std::sort(order.begin(), order.end(), [&codes](size_t a, size_t b) {
+		return codes[a] < codes[b];
+	});
+
+	//step 2: create a window for every block containing a pixel
+	std::vector<Window> windows;
+	std::vector<size_t> windowStarts;
+	for (size_t k = 0; k < order.size(); k++) {
+		if (k != 0 && codes[order[k]] == codes[order[k - 1]]) {
+			continue;
+		}
+
+		Window window;
+		window.xBlock = pixelX[order[k]] / xBlockSize;
+		window.yBlock = pixelY[order[k]] / yBlockSize;
+		window.xOff = window.xBlock * xBlockSize;
+		window.yOff = window.yBlock * yBlockSize;
+		window.xValid = std::min(xBlockSize, width - window.xOff);
+		window.yValid = std::min(yBlockSize, height - window.yOff);
+		windows.push_back(window);
+		windowStarts.push_back(k);
+	}
+	windowStarts.push_back(order.size());
+
+	//step 3: read the blocks and pass the values of their pixels to fn in parallel
+	int windowCount = static_cast<int>(windows.size());
+	int chunkSize = std::max(1, (windowCount + threads - 1) / threads);
+	int chunks = (windowCount + chunkSize - 1) / chunkSize;
+
+	std::vector<std::exception_ptr> errors(chunks);
+	boost::asio::thread_pool pool(threads);
+	for (int chunk = 0; chunk < chunks; chunk++) {
+		int windowStart = chunk * chunkSize;
+		int windowEnd = std::min(windowCount, windowStart + chunkSize);
+
+		boost::asio::post(pool, [&, chunk, windowStart, windowEnd] {
+			try {
+				std::vector<Window> chunkWindows(windows.begin() + windowStart, windows.begin() + windowEnd);
+				BlockReader reader(bands, chunkWindows, xBlockSize, yBlockSize, GDT_Float64, sizeof(double));
+
+				int w = windowStart;
+				while (Block *p_block = reader.next()) {
+					const double *p_data = reinterpret_cast<const double *>(p_block->buffers[0]);
+					const Window& window = p_block->window;
+
+					for (size_t k = windowStarts[w]; k < windowStarts[w + 1]; k++) {
+						size_t i = order[k];
+						size_t pixel = static_cast<size_t>(pixelY[i] - window.yOff) * xBlockSize + (pixelX[i] - window.xOff);
+						fn(i, p_data + pixel * nBands);
+					}
+					w++;
+				}
+			}
+			catch (...) {
+				errors[chunk] = std::current_exception();
+			}
+		});
+	}
+	pool.join();
+
+	for (const std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+} //namespace reader
+} //namespace sgs
@@ -0,0 +1,244 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: mergeable streaming quantile sketch
+ * Author: Joseph Meyer
+ * Date: October, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup sketch sketch
+ * @ingroup utils
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace sgs {
+namespace sketch {
+
+/**
+ * @ingroup sketch
+ * The smallest number of values a level of the sketch holds before it is compacted.
+ */
+#define SKETCH_MIN_CAPACITY 64
+
+/**
+ * @ingroup sketch
+ * This function calculates the capacity of every level of a QuantileSketch, such that
+ * the rank error of any quantile is at most eps * n after n values have been added.
+ *
+ * Each compaction of level h moves a sorted pair of values of weight 2^h into a single
+ * value of weight 2^(h+1), changing the rank of any value by at most 2^h. A level is
+ * compacted once it holds k values, so level h is compacted at most n / (k * 2^h) times,
+ * and contributes a rank error of at most n / k. With H levels the total error is at most
+ * H * n / k, so k = H / eps, where H itself depends on k.
+ *
+ * @param double eps
+ * @param int64_t n the (maximum) number of values which will be added
+ * @returns size_t
+ */
+inline size_t
+sketchCapacity(double eps, int64_t n) {
+	double count = std::max(static_cast<double>(n), 1.0);
+	double k = std::ceil(1 / eps);
+	for (int i = 0; i < 4; i++) {
+		double levels = std::max(1.0, std::ceil(std::log2(std::max(1.0, count / k))) + 1);
+		k = std::ceil(levels / eps);
+	}
+	return std::max(static_cast<size_t>(SKETCH_MIN_CAPACITY), static_cast<size_t>(std::min(k, count)));
+}
+
+/**
+ * @ingroup sketch
+ * A deterministic, mergeable quantile sketch with bounded error, based on the compactor
+ * hierarchy of Manku, Rajagopalan, and Lindsay (the deterministic form of KLL):
+ * https://dl.acm.org/doi/10.1145/276305.276342
+ * https://arxiv.org/abs/1603.05346
+ *
+ * Values are added to level 0. Once a level holds k values it is sorted, and every
+ * second value (alternating between the odd and even positions on each compaction) is
+ * promoted to the next level with double the weight. Until the first compaction the
+ * sketch is exact.
+ *
+ * Sketches built with the same capacity on seperate parts of a raster can be combined
+ * with merge(), which keeps the same error bound. This allows every thread to sketch its
+ * own blocks, without any synchronization until the sketches are merged at the end.
+ */
+template <typename T>
+class QuantileSketch {
+	private:
+	size_t k;
+	int64_t count = 0;
+	std::vector<std::vector<T>> levels;
+	std::vector<uint8_t> offsets;
+
+	/**
+	 * Compact level h into level h + 1. If the level holds an odd number of values
+	 * the largest stays at level h.
+	 *
+	 * @param size_t h
+	 */
+	void compact(size_t h) {
+		if (h + 1 == this->levels.size()) {
+			this->levels.emplace_back();
+			this->offsets.push_back(0);
+		}
+
+		std::vector<T>& level = this->levels[h];
+		std::vector<T>& next = this->levels[h + 1];
+		std::sort(level.begin(), level.end());
+
+		size_t pairs = level.size() / 2;
+		size_t offset = this->offsets[h];
+		this->offsets[h] ^= 1;
+
+		for (size_t i = 0; i < pairs; i++) {
+			next.push_back(level[2 * i + offset]);
+		}
+
+		if (level.size() % 2 == 1) {
+			level[0] = level.back();
+			level.resize(1);
+		}
+		else {
+			level.clear();
+		}
+	}
+
+	/**
+	 * Compact every level, starting at level h, which is at capacity.
+	 *
+	 * @param size_t h
+	 */
+	void cascade(size_t h) {
+		for (; h < this->levels.size(); h++) {
+			if (this->levels[h].size() >= this->k) {
+				this->compact(h);
+			}
+		}
+	}
+
+	public:
+	/**
+	 * Constructor for the sketch, k is the capacity of a level, see sketchCapacity().
+	 *
+	 * @param size_t k
+	 */
+	QuantileSketch(size_t k) : k(std::max(k, static_cast<size_t>(2))) {
+		this->levels.emplace_back();
+		this->levels[0].reserve(this->k);
+		this->offsets.push_back(0);
+	}
+
+	/**
+	 * Add a single value to the sketch.
+	 *
+	 * @param T val
+	 */
+	inline void update(T val) {
+		this->levels[0].push_back(val);
+		this->count++;
+		if (this->levels[0].size() >= this->k) {
+			this->cascade(0);
+		}
+	}
+
+	/**
+	 * Add count values to the sketch.
+	 *
+	 * @param const T *p_vals
+	 * @param size_t count
+	 */
+	void update(const T *p_vals, size_t count) {
+		while (count > 0) {
+			size_t n = std::min(count, this->k - this->levels[0].size());
+			this->levels[0].insert(this->levels[0].end(), p_vals, p_vals + n);
+			this->count += n;
+			p_vals += n;
+			count -= n;
+
+			if (this->levels[0].size() >= this->k) {
+				this->cascade(0);
+			}
+		}
+	}
+
+	/**
+	 * Merge another sketch (which should have the same capacity) into this one.
+	 *
+	 * @param const QuantileSketch<T>& other
+	 */
+	void merge(const QuantileSketch<T>& other) {
+		while (this->levels.size() < other.levels.size()) {
+			this->levels.emplace_back();
+			this->offsets.push_back(0);
+		}
+
+		for (size_t h = 0; h < other.levels.size(); h++) {
+			this->levels[h].insert(this->levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+		}
+		this->count += other.count;
+
+		this->cascade(0);
+	}
+
+	/**
+	 * The number of values added to the sketch (including merged sketches).
+	 *
+	 * @returns int64_t
+	 */
+	int64_t size() {
+		return this->count;
+	}
+
+	/**
+	 * Get the quantiles of the values added to the sketch. The quantile of probability p
+	 * is the smallest value whose (weighted) rank is at least p times the total count.
+	 *
+	 * @param const std::vector<double>& probabilities
+	 * @returns std::vector<double>
+	 */
+	std::vector<double> quantiles(const std::vector<double>& probabilities) {
+		std::vector<std::pair<T, int64_t>> items;
+		for (size_t h = 0; h < this->levels.size(); h++) {
+			for (T val : this->levels[h]) {
+				items.push_back({val, static_cast<int64_t>(1) << h});
+			}
+		}
+
+		std::vector<double> retval(probabilities.size(), std::nan(""));
+		if (items.empty()) {
+			return retval;
+		}
+
+		std::sort(items.begin(), items.end(), [](const std::pair<T, int64_t>& a, const std::pair<T, int64_t>& b) {
+			return a.first < b.first;
+		});
+
+		//cumulative weights, so each quantile is a binary search
+		std::vector<double> ranks(items.size());
+		int64_t rank = 0;
+		for (size_t i = 0; i < items.size(); i++) {
+			rank += items[i].second;
+			ranks[i] = static_cast<double>(rank);
+		}
+
+		for (size_t i = 0; i < probabilities.size(); i++) {
+			double target = probabilities[i] * ranks.back();
+			size_t j = std::lower_bound(ranks.begin(), ranks.end(), target) - ranks.begin();
+			retval[i] = static_cast<double>(items[std::min(j, items.size() - 1)].first);
+		}
+
+		return retval;
+	}
+};
+
+} //sketch
+} //sgs
@@ -0,0 +1,463 @@
+/******************************************************************************
+ *
+ * Project: sgs
+ * Purpose: per-raster cache of band statistics
+ * Author: Joseph Meyer
+ * Date: March, 2026
+ *
+ ******************************************************************************/
+
+/**
+ * @defgroup stats stats
+ * @ingroup utils
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gdal_priv.h>
+
+namespace sgs {
+namespace stats {
+
+/**
+ * @ingroup stats
+ * The metadata domain which cached statistics are written to when they are persisted. For
+ * a read-only dataset GDAL stores the domain in the PAM (.aux.xml) sidecar file.
+ */
+#define STATS_METADATA_DOMAIN "SGS_STATISTICS"
+
+/**
+ * @ingroup stats
+ * The metadata item (in STATS_METADATA_DOMAIN) which records the stamp of the file the
+ * persisted statistics were calculated from. Statistics with a different stamp are ignored.
+ */
+#define STATS_STAMP_ITEM "STAMP"
+
+/**
+ * @ingroup stats
+ * A cached histogram. The minimum and maximum are stored alongside the counts so that
+ * the exact bins can be re-created for the band type. A histogram which isn't exact
+ * may have assigned a few pixels near the boundaries of bins to a neighbouring bin.
+ */
+struct Histogram {
+	double min;
+	double max;
+	std::vector<int64_t> counts;
+	bool exact = true;
+};
+
+/**
+ * @ingroup stats
+ * Every statistic which has been calculated for a single raster band.
+ *
+ * Quantiles are keyed by both the probabilities and the epsilon they were calculated
+ * with, since a streaming (approximate) calculation may not give the same values as
+ * an exact one. An epsilon of 0 is used for exact quantiles.
+ */
+struct BandStatistics {
+	bool hasMinMax = false;
+	double min = 0;
+	double max = 0;
+
+	std::map<int, Histogram> histograms;
+	std::map<std::pair<std::vector<double>, double>, std::vector<double>> quantiles;
+};
+
+/**
+ * @ingroup stats
+ * Helper function for writing a vector of doubles as a comma seperated list, using
+ * enough digits for the values to be read back exactly.
+ *
+ * @param const std::vector<T>& values
+ * @returns std::string
+ */
+template <typename T>
+inline std::string
+join(const std::vector<T>& values) {
+	std::string retval;
+	char buf[32];
+	for (size_t i = 0; i < values.size(); i++) {
+		std::snprintf(buf, sizeof(buf), i == 0 ? "%.17g" : ",%.17g", static_cast<double>(values[i]));
+		retval += buf;
+	}
+	return retval;
+}
+
+/**
+ * @ingroup stats
+ * Helper function for reading a comma seperated list written by join().
+ *
+ * @param std::string str
+ * @returns std::vector<T>
+ */
+template <typename T>
+inline std::vector<T>
+split(std::string str) {
+	std::vector<T> retval;
+	std::stringstream stream(str);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		retval.push_back(static_cast<T>(std::stod(item)));
+	}
+	return retval;
+}
+
+/**
+ * @ingroup stats
+ * Thread safe cache of the statistics calculated for the bands of a single raster.
+ *
+ * A cache is shared by every GDALRasterWrapper which opens the same (unmodified) file,
+ * see getFileCache(). This allows the scans done by one function (for example dist) to be
+ * skipped by the next call on the same raster (for example quantiles).
+ *
+ * The cache may optionally be persisted to the datasets metadata with save(), and re-loaded
+ * when the file is opened again with load().
+ */
+class StatisticsCache {
+	private:
+	std::mutex mutex;
+	std::map<int, BandStatistics> bands;
+
+	public:
+	/**
+	 * Get the cached minimum and maximum of a band.
+	 *
+	 * @param int band
+	 * @param double& min
+	 * @param double& max
+	 * @returns bool whether the values were cached
+	 */
+	bool getMinMax(int band, double& min, double& max) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->bands.find(band);
+		if (it == this->bands.end() || !it->second.hasMinMax) {
+			return false;
+		}
+		min = it->second.min;
+		max = it->second.max;
+		return true;
+	}
+
+	/**
+	 * Set the minimum and maximum of a band.
+	 *
+	 * @param int band
+	 * @param double min
+	 * @param double max
+	 */
+	void setMinMax(int band, double min, double max) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		BandStatistics& stats = this->bands[band];
+		stats.hasMinMax = true;
+		stats.min = min;
+		stats.max = max;
+	}
+
+	/**
+	 * Get a cached histogram of a band with a particular number of bins. If exact is
+	 * true, a histogram which isn't exact is ignored.
+	 *
+	 * @param int band
+	 * @param int nBins
+	 * @param bool exact
+	 * @param Histogram& histogram
+	 * @returns bool whether the histogram was cached
+	 */
+	bool getHistogram(int band, int nBins, bool exact, Histogram& histogram) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->bands.find(band);
+		if (it == this->bands.end()) {
+			return false;
+		}
+		auto hist = it->second.histograms.find(nBins);
+		if (hist == it->second.histograms.end() || (exact && !hist->second.exact)) {
+			return false;
+		}
+		histogram = hist->second;
+		return true;
+	}
+
+	/**
+	 * Set the histogram of a band. The number of bins is the size of the counts. A
+	 * histogram which isn't exact never replaces one which is.
+	 *
+	 * @param int band
+	 * @param Histogram histogram
+	 */
+	void setHistogram(int band, Histogram histogram) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		int nBins = static_cast<int>(histogram.counts.size());
+		auto& histograms = this->bands[band].histograms;
+		auto it = histograms.find(nBins);
+		if (it != histograms.end() && it->second.exact && !histogram.exact) {
+			return;
+		}
+		histograms[nBins] = std::move(histogram);
+	}
+
+	/**
+	 * Get cached quantiles of a band.
+	 *
+	 * @param int band
+	 * @param const std::vector<double>& probabilities
+	 * @param double eps the epsilon used by a streaming calculation, or 0 if exact
+	 * @param std::vector<double>& quantiles
+	 * @returns bool whether the quantiles were cached
+	 */
+	bool getQuantiles(int band, const std::vector<double>& probabilities, double eps, std::vector<double>& quantiles) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		auto it = this->bands.find(band);
+		if (it == this->bands.end()) {
+			return false;
+		}
+		auto quant = it->second.quantiles.find({probabilities, eps});
+		if (quant == it->second.quantiles.end()) {
+			return false;
+		}
+		quantiles = quant->second;
+		return true;
+	}
+
+	/**
+	 * Set the quantiles of a band.
+	 *
+	 * @param int band
+	 * @param const std::vector<double>& probabilities
+	 * @param double eps the epsilon used by a streaming calculation, or 0 if exact
+	 * @param const std::vector<double>& quantiles
+	 */
+	void setQuantiles(int band, const std::vector<double>& probabilities, double eps, const std::vector<double>& quantiles) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->bands[band].quantiles[{probabilities, eps}] = quantiles;
+	}
+
+	/**
+	 * Remove every cached statistic.
+	 */
+	void clear() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->bands.clear();
+	}
+
+	/**
+	 * Write every cached statistic to the STATS_METADATA_DOMAIN metadata domain of the
+	 * dataset bands, along with the stamp of the file. Each statistic is its own
+	 * metadata item:
+	 *  - MINMAX=min,max
+	 *  - HISTOGRAM_<nBins>=min,max,counts... (only for exact histograms)
+	 *  - QUANTILES_<i>=eps,n,probabilities...,quantiles...
+	 *
+	 * @param GDALDataset *p_dataset
+	 * @param std::string stamp
+	 */
+	void save(GDALDataset *p_dataset, std::string stamp) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (const auto& [band, stats] : this->bands) {
+			if (band < 0 || band >= p_dataset->GetRasterCount()) {
+				continue;
+			}
+
+			GDALRasterBand *p_band = p_dataset->GetRasterBand(band + 1);
+			char **metadata = nullptr;
+			metadata = CSLSetNameValue(metadata, STATS_STAMP_ITEM, stamp.c_str());
+
+			if (stats.hasMinMax) {
+				metadata = CSLSetNameValue(metadata, "MINMAX", join<double>({stats.min, stats.max}).c_str());
+			}
+
+			for (const auto& [nBins, histogram] : stats.histograms) {
+				//only exact histograms are persisted
+				if (!histogram.exact) {
+					continue;
+				}
+
+				std::vector<double> values = {histogram.min, histogram.max};
+				values.insert(values.end(), histogram.counts.begin(), histogram.counts.end());
+				std::string key = "HISTOGRAM_" + std::to_string(nBins);
+				metadata = CSLSetNameValue(metadata, key.c_str(), join<double>(values).c_str());
+			}
+
+			int i = 0;
+			for (const auto& [key, quantiles] : stats.quantiles) {
+				std::vector<double> values = {key.second, static_cast<double>(key.first.size())};
+				values.insert(values.end(), key.first.begin(), key.first.end());
+				values.insert(values.end(), quantiles.begin(), quantiles.end());
+				std::string name = "QUANTILES_" + std::to_string(i++);
+				metadata = CSLSetNameValue(metadata, name.c_str(), join<double>(values).c_str());
+			}
+
+			p_band->SetMetadata(metadata, STATS_METADATA_DOMAIN);
+			CSLDestroy(metadata);
+		}
+	}
+
+	/**
+	 * Read statistics written by save() from the dataset bands. Bands whose stamp does
+	 * not match the given stamp were persisted from a different version of the file, and
+	 * are ignored. Statistics which are already cached are not overwritten.
+	 *
+	 * @param GDALDataset *p_dataset
+	 * @param std::string stamp
+	 */
+	void load(GDALDataset *p_dataset, std::string stamp) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (int band = 0; band < p_dataset->GetRasterCount(); band++) {
+			GDALRasterBand *p_band = p_dataset->GetRasterBand(band + 1);
+			const char *p_stamp = p_band->GetMetadataItem(STATS_STAMP_ITEM, STATS_METADATA_DOMAIN);
+			if (!p_stamp || stamp != p_stamp) {
+				continue;
+			}
+
+			BandStatistics& stats = this->bands[band];
+			char **metadata = p_band->GetMetadata(STATS_METADATA_DOMAIN);
+			for (int i = 0; metadata && metadata[i]; i++) {
+				char *p_key = nullptr;
+				const char *p_value = CPLParseNameValue(metadata[i], &p_key);
+				if (!p_key || !p_value) {
+					CPLFree(p_key);
+					continue;
+				}
+
+				std::string key = p_key;
+				CPLFree(p_key);
+
+				std::vector<double> values;
+				try {
+					values = split<double>(p_value);
+				}
+				catch (const std::exception&) {
+					continue;
+				}
+
+				if (key == "MINMAX" && values.size() == 2 && !stats.hasMinMax) {
+					stats.hasMinMax = true;
+					stats.min = values[0];
+					stats.max = values[1];
+				}
+				else if (key.rfind("HISTOGRAM_", 0) == 0 && values.size() > 2) {
+					Histogram histogram;
+					histogram.min = values[0];
+					histogram.max = values[1];
+					histogram.counts.assign(values.begin() + 2, values.end());
+					stats.histograms.insert({static_cast<int>(histogram.counts.size()), std::move(histogram)});
+				}
+				else if (key.rfind("QUANTILES_", 0) == 0 && values.size() >= 2) {
+					size_t n = static_cast<size_t>(values[1]);
+					if (values.size() != 2 + 2 * n) {
+						continue;
+					}
+					std::vector<double> probabilities(values.begin() + 2, values.begin() + 2 + n);
+					std::vector<double> quantiles(values.begin() + 2 + n, values.end());
+					stats.quantiles.insert({{probabilities, values[0]}, quantiles});
+				}
+			}
+		}
+	}
+};
+
+/**
+ * @ingroup stats
+ * Get a stamp which identifies the current version of a file, made of its modification time
+ * and size. The modification time of a local file is taken at the full resolution of the file
+ * system, so that a file rewritten within the same second still gets a new stamp. VSIStatL()
+ * (which only gives whole seconds) is used for GDAL virtual file systems.
+ *
+ * @param std::string filename
+ * @returns std::string an empty string if the file can't be stat'ed
+ */
+inline std::string
+fileStamp(std::string filename) {
+	VSIStatBufL stat;
+	if (VSIStatL(filename.c_str(), &stat) != 0) {
+		return "";
+	}
+
+	std::string mtime = std::to_string(static_cast<int64_t>(stat.st_mtime));
+	if (filename.rfind("/vsi", 0) != 0) {
+		std::error_code ec;
+		auto time = std::filesystem::last_write_time(filename, ec);
+		if (!ec) {
+			mtime = std::to_string(static_cast<int64_t>(time.time_since_epoch().count()));
+		}
+	}
+	return mtime + ":" + std::to_string(static_cast<int64_t>(stat.st_size));
+}
+
+/**
+ * @ingroup stats
+ * The statistics caches of every file which has been opened, keyed by filename, along
+ * with the stamp of the file each cache was calculated from.
+ */
+struct FileCacheRegistry {
+	std::mutex mutex;
+	std::map<std::string, std::pair<std::string, std::shared_ptr<StatisticsCache>>> caches;
+};
+
+/**
+ * @ingroup stats
+ * Get the process wide registry of statistics caches.
+ *
+ * @returns FileCacheRegistry&
+ */
+inline FileCacheRegistry&
+fileCacheRegistry(void) {
+	static FileCacheRegistry registry;
+	return registry;
+}
+
+/**
+ * @ingroup stats
+ * Get the statistics cache shared by every raster opened from the given file. The cache is
+ * kept for as long as the process runs, and is replaced if the file is modified (its stamp
+ * changes) or written to by sgs (see invalidateFileCache()).
+ *
+ * A file which can't be stat'ed gets a cache of its own.
+ *
+ * @param std::string filename
+ * @param std::string stamp from fileStamp()
+ * @returns std::shared_ptr<StatisticsCache>
+ */
+inline std::shared_ptr<StatisticsCache>
+getFileCache(std::string filename, std::string stamp) {
+	if (stamp == "") {
+		return std::make_shared<StatisticsCache>();
+	}
+
+	FileCacheRegistry& registry = fileCacheRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	auto it = registry.caches.find(filename);
+	if (it == registry.caches.end() || it->second.first != stamp) {
+		auto p_cache = std::make_shared<StatisticsCache>();
+		registry.caches[filename] = {stamp, p_cache};
+		return p_cache;
+	}
+	return it->second.second;
+}
+
+/**
+ * @ingroup stats
+ * Forget the statistics cache of a file which is about to be (over)written, so that
+ * rasters opened from the new file never share the statistics of the old one, even if
+ * the file system doesn't record a different modification time or size. Rasters which
+ * are already open keep their own reference to the old cache.
+ *
+ * @param std::string filename
+ */
+inline void
+invalidateFileCache(std::string filename) {
+	FileCacheRegistry& registry = fileCacheRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	registry.caches.erase(filename);
+}
+
+} //stats
+} //sgs
@@ -16,14 +16,22 @@ class TestDistribution:
     #we're testing with numpy (but not using numpy in the sgs package) because the sgspy distribution function
     #should be able to calculate the distribution on very large raster images which wouldn't
     #be able to effectively fit within memory in a numpy array
-    def check(self, result, arr, bins, samples=False):
+    def check(self, result, arr, bins, samples=False, exact=True):
         [bin_vals, counts] = result["population"]
 
         farr = np.ndarray.flatten(arr)
         farr = farr[~np.isnan(farr)]
         [check_counts, check_bin_vals] = np.histogram(farr, bins=bins)
 
-        assert np.array_equal(counts, check_counts)
+        if exact:
+            assert np.array_equal(counts, check_counts)
+        else:
+            #only pixels within a provisional bin (2 millionths of the range) of the
+            #start of a bin may be counted in the neighbouring bin
+            width = 2 * (farr.max() - farr.min()) / 2**20
+            near = sum(int(np.sum(np.abs(farr - b) <= width)) for b in check_bin_vals[1:-1])
+            assert np.sum(counts) == np.sum(check_counts)
+            assert int(np.sum(np.abs(counts - check_counts))) <= 2 * near
         np.testing.assert_almost_equal(bin_vals, check_bin_vals, decimal=5)
 
         if samples:
@@ -49,7 +57,7 @@ class TestDistribution:
         
         for bins in [1, 10, 50, 100]:
             for band in ['zq90', 'pzabove2', 'zq90']:
-                result = sgs.calculate.distribution(self.rast, band=band, bins=bins, plot=False)
+                result = sgs.calculate.distribution(self.rast, band=band, bins=bins, plot=False, exact=True)
                 self.check(result, bands[band], bins)
 
     def test_sample_dist(self):
@@ -62,5 +70,72 @@ class TestDistribution:
         bins = 50
 
         for band in ['zq90', 'pzabove2', 'zsd']:
-            result = sgs.calculate.distribution(self.rast, band=band, bins=bins, samples=self.samples, plot=False)
+            result = sgs.calculate.distribution(self.rast, band=band, bins=bins, samples=self.samples, plot=False, exact=True)
             self.check(result, bands[band], bins, True)
+
+    def test_thread_count(self):
+        bands = {
+            'zq90': self.rast.band('zq90'),
+            'zsd': self.rast.band('zsd')
+        }
+
+        bins = 50
+
+        for thread_count in [1, 2, 3, 8]:
+            for band in ['zq90', 'zsd']:
+                result = sgs.calculate.distribution(self.rast, band=band, bins=bins, samples=self.samples, plot=False, exact=True, thread_count=thread_count)
+                self.check(result, bands[band], bins, True)
+
+    def test_cached_statistics(self):
+        arr = self.rast.band('zq90')
+        bins = 20
+
+        #the second call on the same raster and the call on a new raster opened from the
+        #same file use the cached histogram, and should give the same result
+        self.rast.clear_statistics()
+        first = sgs.calculate.distribution(self.rast, band='zq90', bins=bins, plot=False, exact=True)
+        second = sgs.calculate.distribution(self.rast, band='zq90', bins=bins, plot=False, exact=True)
+        third = sgs.calculate.distribution(sgs.SpatialRaster(mraster_geotiff_path), band='zq90', bins=bins, plot=False, exact=True)
+
+        for result in [first, second, third]:
+            self.check(result, arr, bins)
+
+        #a cached histogram must still allow the sample distribution to be calculated
+        result = sgs.calculate.distribution(self.rast, band='zq90', bins=bins, samples=self.samples, plot=False)
+        self.check(result, arr, bins, True)
+
+    def test_approximate(self):
+        bands = {
+            'zq90': self.rast.band('zq90'),
+            'pzabove2': self.rast.band('pzabove2'),
+            'zsd': self.rast.band('zsd')
+        }
+
+        #by default the band is read once, and pixels near the boundaries of bins
+        #may be counted in the neighbouring bin
+        self.rast.clear_statistics()
+        for bins in [1, 10, 50, 100]:
+            for band in ['zq90', 'pzabove2', 'zsd']:
+                result = sgs.calculate.distribution(self.rast, band=band, bins=bins, plot=False)
+                self.check(result, bands[band], bins, exact=False)
+
+        #an approximate histogram which was cached is not used when an exact one is requested
+        result = sgs.calculate.distribution(self.rast, band='zq90', bins=50, plot=False, exact=True)
+        self.check(result, bands['zq90'], 50)
+
+        #and an exact histogram which was cached is used by approximate calls
+        result = sgs.calculate.distribution(self.rast, band='zq90', bins=50, plot=False)
+        self.check(result, bands['zq90'], 50)
+
+    def test_inputs(self):
+        with pytest.raises(TypeError):
+            sgs.calculate.distribution(self.rast, band='zq90', plot=False, thread_count=2.0)
+
+        with pytest.raises(TypeError):
+            sgs.calculate.distribution(self.rast, band='zq90', plot=False, use_statistics=1)
+
+        with pytest.raises(TypeError):
+            sgs.calculate.distribution(self.rast, band='zq90', plot=False, exact=1)
+
+        with pytest.raises(ValueError):
+            sgs.calculate.distribution(self.rast, band='zq90', plot=False, thread_count=0)
@@ -40,3 +40,9 @@ class TestPCA:
 
         with pytest.raises(ValueError):
             pca = sgs.pca(self.rast, num_comp=4)
+
+        with pytest.raises(TypeError):
+            pca = sgs.pca(self.rast, num_comp=2, thread_count=2.0)
+
+        with pytest.raises(ValueError):
+            pca = sgs.pca(self.rast, num_comp=2, thread_count=0)
@@ -1,8 +1,51 @@
+import numpy as np
 import pytest
+
 import sgspy as sgs
 
+from files import (
+    mraster_geotiff_path,
+    sraster_geotiff_path,
+    existing_shapefile_path,
+)
+
 class TestRepresentation:
-    #TODO add real tests before implementing representation
-    @pytest.mark.xfail
-    def test_not_implemented(self):
-        sgs.calculate.representation()
+    rast = sgs.SpatialRaster(mraster_geotiff_path)
+    srast = sgs.SpatialRaster(sraster_geotiff_path)
+    existing = sgs.SpatialVector(existing_shapefile_path)
+
+    def test_strata(self):
+        result = sgs.calculate.representation(self.srast, self.existing)
+
+        strata = self.srast.band(0)
+        strata = strata[~np.isnan(strata)]
+        for (s, count) in zip(result['strata'], result['raster_count']):
+            assert count == np.sum(strata == s)
+
+        assert np.sum(result['sample_count']) <= len(self.existing.samples_as_wkt())
+        assert np.isclose(np.sum(result['raster_coverage']), 1)
+        assert np.isclose(np.sum(result['sample_coverage']), 1)
+        assert np.allclose(result['difference'], result['sample_coverage'] - result['raster_coverage'])
+
+    def test_quantiles(self):
+        result = sgs.calculate.representation(self.rast, self.existing, num_quantiles=4)
+        assert result['ratio'].shape == (self.rast.band_count, 4)
+        assert np.allclose(np.sum(result['raster_coverage'], axis=1), 1)
+
+        #each band is split into roughly equal quantiles
+        assert np.allclose(result['raster_coverage'], 0.25, atol=0.02)
+
+        #the breaks are close to the exact quantiles
+        zq90 = self.rast.band('zq90')
+        exact = np.nanquantile(zq90, [0.25, 0.5, 0.75])
+        assert np.allclose(result['quantiles']['zq90'], exact, rtol=0.02)
+
+    def test_inputs(self):
+        with pytest.raises(ValueError):
+            sgs.calculate.representation(self.rast, self.existing)
+
+        with pytest.raises(ValueError):
+            sgs.calculate.representation(self.rast, self.existing, band='zq90', num_quantiles=4)
+
+        with pytest.raises(ValueError):
+            sgs.calculate.representation(self.rast, self.existing, num_quantiles=1)
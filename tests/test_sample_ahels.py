@@ -1,8 +1,64 @@
+import geopandas as gpd
+import numpy as np
 import pytest
+
 import sgspy as sgs
 
-class TestAhels():
-    #TODO add real tests before implementing ahels
-    @pytest.mark.xfail
-    def test_not_implemented(self):
-        sgs.sample.ahels()
+from files import (
+    mraster_geotiff_path,
+    access_shapefile_path,
+    existing_shapefile_path,
+)
+
+class TestAhels:
+    rast = sgs.SpatialRaster(mraster_geotiff_path)
+    access = sgs.SpatialVector(access_shapefile_path)
+    existing = sgs.SpatialVector(existing_shapefile_path)
+
+    def test_num_samples(self):
+        num_existing = len(self.existing.samples_as_wkt())
+
+        samples = sgs.sample.ahels(self.rast, self.existing, num_samples=20).samples_as_wkt()
+        assert len(samples) == num_existing + 20
+
+        #new samples are not placed on existing samples
+        assert len(set(samples)) == len(samples)
+
+    def test_threshold(self):
+        samples, details = sgs.sample.ahels(self.rast, self.existing, threshold=0.8, tolerance=0.05, details=True)
+        ratio = details['ratio']
+        assert ratio.shape == (self.rast.band_count, 10)
+        assert np.all(ratio[~np.isnan(ratio)] >= 0.75)
+        assert set(details['quantiles'].keys()) == set(self.rast.bands)
+
+    def test_under_represented(self):
+        #adding samples to the lowest ratio raises it
+        before = sgs.calculate.representation(self.rast, self.existing, num_quantiles=10)
+        _, after = sgs.sample.ahels(self.rast, self.existing, num_samples=50, details=True)
+        assert np.nanmin(after['ratio']) > np.nanmin(before['ratio'])
+
+    def test_access(self):
+        samples = sgs.sample.ahels(self.rast, self.existing, num_samples=20, access=self.access, buff_outer=200).samples_as_wkt()
+        assert len(samples) == len(self.existing.samples_as_wkt()) + 20
+
+        #every new sample is within buff_outer of the access network
+        accessable = gpd.read_file(access_shapefile_path).buffer(200).union_all()
+        existing = set(self.existing.samples_as_wkt())
+        for sample in gpd.GeoSeries.from_wkt([s for s in samples if s not in existing]):
+            assert accessable.contains(sample)
+
+    def test_inputs(self):
+        with pytest.raises(TypeError):
+            sgs.sample.ahels(self.rast, None)
+
+        with pytest.raises(ValueError):
+            sgs.sample.ahels(self.rast, self.existing, num_quantiles=1)
+
+        with pytest.raises(ValueError):
+            sgs.sample.ahels(self.rast, self.existing, num_samples=0)
+
+        with pytest.raises(ValueError):
+            sgs.sample.ahels(self.rast, self.existing, tolerance=0.5)
+
+        with pytest.raises(ValueError):
+            sgs.sample.ahels(self.rast, self.existing, thread_count=0)
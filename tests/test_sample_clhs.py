@@ -119,3 +119,60 @@ class TestClhs:
             warnings.simplefilter("ignore")
             assert len(gs_samples.intersection(gs_file)) == len(gs_samples)
 
+
+    def test_chains(self):
+        with pytest.raises(ValueError):
+            sgs.sample.clhs(self.rast, 200, chains=0)
+
+        with pytest.raises(ValueError):
+            sgs.sample.clhs(self.rast, 200, exchange_interval=-1)
+
+        with pytest.raises(ValueError):
+            sgs.sample.clhs(self.rast, 200, thread_count=0)
+
+        for (chains, exchange_interval, thread_count) in [(1, 0, 1), (4, 0, 4), (4, 500, 2), (3, 100, 8)]:
+            samples = sgs.sample.clhs(
+                self.rast, 
+                200, 
+                chains=chains, 
+                exchange_interval=exchange_interval, 
+                thread_count=thread_count
+            ).samples_as_wkt()
+            gs = gpd.GeoSeries.from_wkt(samples)
+
+            assert len(gs) == 200
+            assert len(set(samples)) == 200
+
+            for point in gs:
+                x_index = (point.x - self.rast.xmin) / self.rast.pixel_width
+                y_index = self.rast.height - ((point.y - self.rast.ymin) / self.rast.pixel_height)
+                assert not np.isnan(self.rast.band(0)[int(y_index), int(x_index)])
+
+        #chains continue from the kept existing samples
+        samples = sgs.sample.clhs(self.rast, 250, existing=self.existing, chains=4).to_geopandas()
+        existing_set = set(gpd.read_file(existing_shapefile_path)['geometry'])
+        samples_set = set(samples['geometry'])
+        assert len(existing_set.difference(samples_set)) == 0
+        assert len(samples_set.difference(existing_set)) == 50
+
+    def test_compact(self):
+        with pytest.raises(TypeError):
+            sgs.sample.clhs(self.rast, 200, compact=1)
+
+        for chains in [1, 4]:
+            samples = sgs.sample.clhs(self.rast, 200, chains=chains, compact=True).samples_as_wkt()
+            gs = gpd.GeoSeries.from_wkt(samples)
+
+            assert len(gs) == 200
+            assert len(set(samples)) == 200
+
+            for point in gs:
+                x_index = (point.x - self.rast.xmin) / self.rast.pixel_width
+                y_index = self.rast.height - ((point.y - self.rast.ymin) / self.rast.pixel_height)
+                assert not np.isnan(self.rast.band(0)[int(y_index), int(x_index)])
+
+        samples = sgs.sample.clhs(self.rast, 250, existing=self.existing, compact=True).to_geopandas()
+        existing_set = set(gpd.read_file(existing_shapefile_path)['geometry'])
+        samples_set = set(samples['geometry'])
+        assert len(existing_set.difference(samples_set)) == 0
+        assert len(samples_set.difference(existing_set)) == 50
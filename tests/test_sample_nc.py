@@ -1,8 +1,52 @@
+import geopandas as gpd
+import numpy as np
 import pytest
+
 import sgspy as sgs
 
+from files import (
+    mraster_geotiff_path,
+    access_shapefile_path,
+)
+
 class TestNc:
-    #TODO add real tests before implementing nc
-    @pytest.mark.xfail
-    def test_not_implemented(self):
-        sgs.sample.nc()
+    rast = sgs.SpatialRaster(mraster_geotiff_path)
+    access = sgs.SpatialVector(access_shapefile_path)
+
+    def test_num_points(self):
+        samples = sgs.sample.nc(self.rast, num_samples=5).samples_as_wkt()
+        assert len(samples) == 5
+
+        samples = sgs.sample.nc(self.rast, num_samples=10, k=3).samples_as_wkt()
+        assert len(samples) == 30
+        assert len(set(samples)) == 30
+
+    def test_spread(self):
+        #the samples of different clusters cover the range of the first band
+        samples = gpd.GeoSeries.from_wkt(sgs.sample.nc(self.rast, num_samples=10, thread_count=3).samples_as_wkt())
+        zq90 = self.rast.band('zq90')
+        assert len(samples) == 10
+
+        gt = self.rast.cpp_raster.get_geotransform()
+        vals = [zq90[int((p.y - gt[3]) / gt[5]), int((p.x - gt[0]) / gt[1])] for p in samples]
+        assert np.all(~np.isnan(vals))
+        assert np.max(vals) - np.min(vals) > (np.nanmax(zq90) - np.nanmin(zq90)) / 2
+
+    def test_access(self):
+        samples = gpd.GeoSeries.from_wkt(sgs.sample.nc(self.rast, num_samples=10, access=self.access, buff_outer=200).samples_as_wkt())
+        accessable = gpd.read_file(access_shapefile_path).buffer(200).union_all()
+        for sample in samples:
+            assert accessable.contains(sample)
+
+    def test_inputs(self):
+        with pytest.raises(ValueError):
+            sgs.sample.nc(self.rast, num_samples=0)
+
+        with pytest.raises(ValueError):
+            sgs.sample.nc(self.rast, num_samples=5, k=0)
+
+        with pytest.raises(ValueError):
+            sgs.sample.nc(self.rast, num_samples=5, pool_size=2)
+
+        with pytest.raises(ValueError):
+            sgs.sample.nc(self.rast, num_samples=5, thread_count=0)
@@ -54,6 +54,37 @@ class TestSrs:
         samples = sgs.srs(self.rast, mindist=mindist, num_samples=1000).samples_as_wkt()
         check_samples(mindist, samples)
 
+    def test_thread_count(self):
+        with pytest.raises(ValueError):
+            sgs.srs(self.rast, mindist=50, num_samples=100, thread_count=0)
+
+        with pytest.raises(TypeError):
+            sgs.srs(self.rast, mindist=50, num_samples=100, thread_count=1.5)
+
+        for thread_count in [1, 2, 8]:
+            for mindist in [50, 200.5]:
+                samples = sgs.srs(self.rast, mindist=mindist, num_samples=1000, thread_count=thread_count).samples_as_wkt()
+                gs = gpd.GeoSeries.from_wkt(samples)
+                assert len(gs) > 0
+                for i in range(len(samples) - 1):
+                    distances = gs[i].distance(gs[i+1:])
+                    assert 0 == int(np.sum(np.array([distances < mindist]).astype(int)))
+
+        #with the same seed, the samples don't depend on the number of threads, including
+        #enough samples that more than one batch of candidates is checked in parallel
+        for (rast, num_samples, mindist) in [(self.rast, 1000, 50), (self.mrast_full, 30000, 30)]:
+            expected = sgs.srs(rast, mindist=mindist, num_samples=num_samples, thread_count=1, seed=7).samples_as_wkt()
+            assert len(expected) > 0
+            for thread_count in [2, 8]:
+                samples = sgs.srs(rast, mindist=mindist, num_samples=num_samples, thread_count=thread_count, seed=7).samples_as_wkt()
+                assert samples == expected
+
+        with pytest.raises(TypeError):
+            sgs.srs(self.rast, num_samples=100, seed=1.5)
+
+        with pytest.raises(ValueError):
+            sgs.srs(self.rast, num_samples=100, seed=-1)
+
     def test_points_in_bounds(self):
         samples = sgs.srs(self.rast, num_samples=1000).samples_as_wkt()
         gs = gpd.GeoSeries.from_wkt(samples)
@@ -125,4 +156,59 @@ class TestSrs:
         for sample in existing:
             assert samples.contains(sample).any()
     
+    def sparse_raster(self, gdal, path, nodata=None):
+        #a tiled sparse GeoTIFF with only the blocks of the left half written
+        src = gdal.Open(mraster_geotiff_path)
+        dataset = gdal.GetDriverByName("GTiff").Create(
+            path, 512, 512, 1, gdal.GDT_Float32,
+            options=["TILED=YES", "BLOCKXSIZE=64", "BLOCKYSIZE=64", "SPARSE_OK=TRUE"]
+        )
+        dataset.SetProjection(src.GetProjection())
+        dataset.SetGeoTransform((0, 1, 0, 512, 0, -1))
+        band = dataset.GetRasterBand(1)
+        if nodata is not None:
+            band.SetNoDataValue(nodata)
+        band.WriteArray(np.full((512, 256), 5, dtype=np.float32), 0, 0)
+        dataset = None
+        return sgs.SpatialRaster(path)
+
+    def test_sparse(self, tmp_path):
+        gdal = pytest.importorskip("osgeo.gdal")
+
+        #without a nodata value the unwritten blocks read as 0, which are valid pixels
+        rast = self.sparse_raster(gdal, str(tmp_path / "sparse.tif"))
+        for num_samples in [50, 100000]:
+            samples = gpd.GeoSeries.from_wkt(sgs.srs(rast, num_samples=num_samples).samples_as_wkt())
+            assert len(samples) == num_samples
+            assert (samples.x > 256).any()
+            assert (samples.x < 256).any()
+
+        #with a nodata value the unwritten blocks read as nodata, and are never sampled
+        for nodata in [-1, 0]:
+            rast = self.sparse_raster(gdal, str(tmp_path / f"sparse_nodata{nodata}.tif"), nodata=nodata)
+            for num_samples in [50, 100000]:
+                samples = gpd.GeoSeries.from_wkt(sgs.srs(rast, num_samples=num_samples).samples_as_wkt())
+                assert len(samples) == num_samples
+                assert (samples.x < 256).all()
+
+    def test_overview(self, tmp_path):
+        gdal = pytest.importorskip("osgeo.gdal")
+        path = str(tmp_path / "overview.tif")
+        gdal.Translate(path, mraster_geotiff_path, creationOptions=["TILED=YES", "BLOCKXSIZE=16", "BLOCKYSIZE=16"])
+        dataset = gdal.Open(path, gdal.GA_Update)
+        dataset.BuildOverviews("NEAREST", [2])
+        dataset = None
+
+        #few samples from many small blocks use the random access strategy, with the
+        #fraction of valid pixels estimated from the overview
+        rast = sgs.SpatialRaster(path)
+        assert rast.overview_count == 1
+        for num_samples in [1, 10, 50, 2000]:
+            samples = gpd.GeoSeries.from_wkt(sgs.srs(rast, num_samples=num_samples).samples_as_wkt())
+            assert len(samples) == num_samples
+            assert len(set(zip(samples.x, samples.y))) == num_samples
+            cols = ((samples.x.to_numpy() - rast.xmin) / rast.pixel_width).astype(int)
+            rows = ((rast.ymax - samples.y.to_numpy()) / rast.pixel_height).astype(int)
+            assert not np.isnan(rast.band(0)[rows, cols]).any()
+
     #TODO test input values
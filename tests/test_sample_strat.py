@@ -840,6 +840,101 @@ class TestStrat:
             ).samples_as_wkt())
             self.check_focal_window(srast, samples, wrow=5, wcol=3)
  
+    def test_thread_count(self):
+        srast = sgs.stratify.quantiles(self.rast, quantiles={"zq90": 5})
+
+        #the strat raster is split between threads, the results should not
+        #depend on how many threads are used
+        for thread_count in [1, 2, 3, 8, 64]:
+            samples = gpd.GeoSeries.from_wkt(sgs.sample.strat(
+                srast,
+                band='strat_zq90',
+                num_samples=500,
+                num_strata=5,
+                allocation="equal",
+                method="random",
+                thread_count=thread_count,
+            ).samples_as_wkt())
+
+            assert len(samples) == 500
+            self.check_points_in_bounds(srast, samples)
+            percentages = self.get_allocation_percentages(srast, samples)
+            for percentage in percentages.values():
+                assert percentage - 0.2 == pytest.approx(0)
+
+            samples = gpd.GeoSeries.from_wkt(sgs.sample.strat(
+                srast,
+                band='strat_zq90',
+                num_samples=50,
+                num_strata=5,
+                wrow=5,
+                wcol=5,
+                allocation="equal",
+                method="Queinnec",
+                thread_count=thread_count,
+            ).samples_as_wkt())
+
+            assert len(samples) == 50
+            self.check_points_in_bounds(srast, samples)
+            self.check_focal_window(srast, samples, 5, 5)
+
+    def test_bounded_memory(self):
+        srast = sgs.stratify.quantiles(self.rast, quantiles={"zq90": 5})
+
+        #each strata keeps a bounded random sample of it's candidates, which
+        #are merged between threads, so the allocation should be the same
+        for thread_count in [1, 8]:
+            samples = gpd.GeoSeries.from_wkt(sgs.sample.strat(
+                srast,
+                band='strat_zq90',
+                num_samples=500,
+                num_strata=5,
+                allocation="equal",
+                method="random",
+                thread_count=thread_count,
+                bounded_memory=True,
+            ).samples_as_wkt())
+
+            assert len(samples) == 500
+            self.check_points_in_bounds(srast, samples)
+            percentages = self.get_allocation_percentages(srast, samples)
+            for percentage in percentages.values():
+                assert percentage - 0.2 == pytest.approx(0)
+
+            samples = gpd.GeoSeries.from_wkt(sgs.sample.strat(
+                srast,
+                band='strat_zq90',
+                num_samples=200,
+                num_strata=5,
+                allocation="prop",
+                method="random",
+                mindist=50,
+                thread_count=thread_count,
+                bounded_memory=True,
+            ).samples_as_wkt())
+
+            assert len(samples) == 200
+            self.check_points_in_bounds(srast, samples)
+            self.check_mindist(50, samples)
+
+            samples = gpd.GeoSeries.from_wkt(sgs.sample.strat(
+                srast,
+                band='strat_zq90',
+                num_samples=50,
+                num_strata=5,
+                allocation="equal",
+                method="Queinnec",
+                thread_count=thread_count,
+                bounded_memory=True,
+            ).samples_as_wkt())
+
+            assert len(samples) == 50
+            self.check_points_in_bounds(srast, samples)
+            self.check_focal_window(srast, samples, 3, 3)
+
+        with pytest.raises(TypeError):
+            sgs.sample.strat(srast, band='strat_zq90', num_samples=50, num_strata=5, bounded_memory=1)
+
     def test_function_inputs(self):
         srast = sgs.stratify.quantiles(self.rast, quantiles={"zq90": 5})
 
@@ -920,3 +1015,58 @@ class TestStrat:
                 method="random",
                 mindist=-1,
             )
+
+        #test thread_count
+        with pytest.raises(ValueError):
+            sgs.sample.strat(
+                srast,
+                band='strat_zq90',
+                num_strata=5,
+                num_samples=5,
+                allocation="equal",
+                method="random",
+                thread_count=0,
+            )
+
+    def test_partial_allocation(self):
+        srast = sgs.stratify.quantiles(self.rast, quantiles={"zq90": 5})
+
+        whole = sgs.sample.strat_partial(srast, band='strat_zq90', num_strata=5, mrast=self.rast, mrast_band='zq90')
+        assert sum(whole["strata_counts"]) == np.count_nonzero(~np.isnan(srast.band('strat_zq90')))
+        assert len(whole["variances"]) == 5
+
+        tiles = list(srast.tiles(tile_height=100))
+        partials = []
+        for (x_off, y_off, tile) in tiles:
+            mtile = self.rast.window(x_off, y_off, tile.width, tile.height)
+            partials.append(sgs.sample.strat_partial(tile, band='strat_zq90', num_strata=5, mrast=mtile, mrast_band='zq90'))
+
+        #merging in any grouping gives the same result as the whole raster
+        merged = sgs.sample.merge_strat_partials([partials[0], sgs.sample.merge_strat_partials(partials[1:])])
+        assert merged["strata_counts"] == whole["strata_counts"]
+        for (a, b) in zip(merged["variances"], whole["variances"]):
+            assert a == pytest.approx(b)
+
+        for allocation in ["prop", "equal", "optim"]:
+            counts = sgs.sample.allocate_strat_partials(partials, num_samples=200, allocation=allocation)
+            assert len(counts) == len(tiles)
+            assert sum(sum(c) for c in counts) == 200
+            for (c, partial) in zip(counts, partials):
+                assert all(n <= total for (n, total) in zip(c, partial["strata_counts"]))
+
+        counts = sgs.sample.allocate_strat_partials(partials, num_samples=200, allocation="equal")
+        per_strata = [0] * 5
+        for ((_, _, tile), c) in zip(tiles, counts):
+            if sum(c) == 0:
+                continue
+
+            samples = sgs.sample.strat(tile, band='strat_zq90', num_samples=sum(c), num_strata=5, allocation="fixed", weights=c, method="random")
+            assert len(gpd.GeoSeries.from_wkt(samples.samples_as_wkt())) == sum(c)
+            per_strata = [a + b for (a, b) in zip(per_strata, c)]
+        assert per_strata == [40] * 5
+
+        with pytest.raises(ValueError):
+            sgs.sample.strat(tiles[0][2], band='strat_zq90', num_samples=10, num_strata=5, allocation="fixed", weights=[1, 1, 1, 1, 1])
+
+        with pytest.raises(TypeError):
+            sgs.sample.merge_strat_partials([])
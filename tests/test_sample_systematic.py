@@ -88,6 +88,33 @@ class TestSystematic:
         with pytest.raises(ValueError):
             sgs.systematic(self.rast, 100, "squares", "centers")
 
+        with pytest.raises(TypeError):
+            sgs.systematic(self.rast, 100, "square", "centers", thread_count=1.0)
+
+        with pytest.raises(ValueError):
+            sgs.systematic(self.rast, 100, "square", "centers", thread_count=0)
+
+    def test_grid(self):
+        #every corner of the lattice is sampled once
+        for shape in ["square", "hexagon"]:
+            samples = gpd.GeoSeries.from_wkt(sgs.systematic(self.rast, 200, shape, "corners").samples_as_wkt())
+            coords = {(round(sample.x, 6), round(sample.y, 6)) for sample in samples}
+            assert len(coords) == len(samples)
+
+        #square grids have about one center per cell size squared of the extent
+        area = (self.rast.xmax - self.rast.xmin) * (self.rast.ymax - self.rast.ymin)
+        samples = sgs.systematic(self.rast, 200, "square", "centers").samples_as_wkt()
+        assert abs(len(samples) - area / 200**2) < 0.2 * area / 200**2
+
+    def test_force(self):
+        band = self.rast.band(0)
+        for location in ["centers", "corners", "random"]:
+            samples = gpd.GeoSeries.from_wkt(sgs.systematic(self.rast, 100, "hexagon", location, force=True, thread_count=4).samples_as_wkt())
+            for sample in samples:
+                x = min(int((sample.x - self.rast.xmin) / self.rast.pixel_width), self.rast.width - 1)
+                y = min(int((self.rast.ymax - sample.y) / self.rast.pixel_height), self.rast.height - 1)
+                assert not np.isnan(band[y, x])
+
     def test_write(self, tmp_path):
         temp_dir = tmp_path / "test_output"
         temp_dir.mkdir()
@@ -1,5 +1,6 @@
 import pytest
 import numpy as np
+from concurrent.futures import ThreadPoolExecutor
 
 import sgspy as sgs
 
@@ -86,3 +87,16 @@ class TestBreaks:
         test = test_rast.band('strat_zq90')
         correct = np.nan_to_num(np.subtract(self.zq90_output_rast.band(0), 1), nan=-1)
         assert np.array_equal(test, correct, equal_nan=True)
+
+    def test_concurrent_python_threads(self):
+        #the GIL is released while stratifying, so calls from multiple Python threads
+        #run at the same time. Each thread uses it's own raster, since GDAL datasets
+        #shouldn't be shared between threads.
+        def run(_):
+            rast = sgs.SpatialRaster(mraster_geotiff_path)
+            return sgs.breaks(rast, breaks={'zq90': [3, 5, 11, 18]}).band('strat_zq90')
+
+        correct = np.nan_to_num(np.subtract(self.zq90_output_rast.band(0), 1), nan=-1)
+        with ThreadPoolExecutor(max_workers=4) as executor:
+            for test in executor.map(run, range(8)):
+                assert np.array_equal(test, correct, equal_nan=True)
@@ -1,8 +1,58 @@
 import pytest
+import numpy as np
+
 import sgspy as sgs
 
+from files import (
+    mraster_geotiff_path,
+)
+
 class TestKmeans:
-    #TODO add real tests before implementing kmeans
-    @pytest.mark.xfail
-    def test_not_implemented(self):
-        sgs.stratify.kmeans()
+    rast = sgs.SpatialRaster(mraster_geotiff_path)
+
+    def test_strata(self):
+        srast = sgs.stratify.kmeans(self.rast, num_strata=5)
+        assert srast.is_strat_rast
+        assert srast.bands == ['strat_kmeans']
+        assert srast.width == self.rast.width
+        assert srast.height == self.rast.height
+
+        strata = srast.band('strat_kmeans')
+        nan = np.isnan(self.rast.band(0)) | np.isnan(self.rast.band(1)) | np.isnan(self.rast.band(2))
+        assert np.all(strata[nan] == -1)
+        assert set(np.unique(strata[~nan])) == {0, 1, 2, 3, 4}
+
+        #strata are ordered by the centroid of the first band, so the mean zq90 increases with strata
+        zq90 = self.rast.band(0)
+        means = [np.mean(zq90[strata == s]) for s in range(5)]
+        assert means == sorted(means)
+
+    def test_single_band(self):
+        srast = sgs.stratify.kmeans(self.rast, num_strata=3, bands=['zq90'], thread_count=3)
+        strata = srast.band(0)
+        zq90 = self.rast.band('zq90')
+
+        #clusters of a single band are contiguous intervals of that band
+        for s in range(2):
+            assert np.nanmax(zq90[strata == s]) <= np.nanmin(zq90[strata == s + 1])
+
+        assert len(srast.srast_metadata_info['strat_kmeans'].band_metadata) == 3
+
+    def test_function_inputs(self):
+        with pytest.raises(TypeError):
+            sgs.stratify.kmeans(self.rast, num_strata=5.0)
+
+        with pytest.raises(ValueError):
+            sgs.stratify.kmeans(self.rast, num_strata=0)
+
+        with pytest.raises(ValueError):
+            sgs.stratify.kmeans(self.rast, num_strata=3, bands=['not_a_band'])
+
+        with pytest.raises(ValueError):
+            sgs.stratify.kmeans(self.rast, num_strata=3, bands=[0, 0])
+
+        with pytest.raises(RuntimeError):
+            sgs.stratify.kmeans(self.rast, num_strata=3, filename='kmeans.png')
+
+        with pytest.raises(ValueError):
+            sgs.stratify.kmeans(self.rast, num_strata=3, thread_count=0)
@@ -55,6 +55,13 @@ class TestMap:
         with pytest.raises(ValueError):
             mapped = sgs.map((breaks, [1, 2], [5, 5]))
 
+    def test_strata_out_of_range(self):
+        breaks = sgs.breaks(self.rast, breaks={'zq90': [3, 5, 11, 18], 'pzabove2': [20, 40, 60, 80]})
+
+        #strat_zq90 contains strata up to 4, which don't fit within 3 strata
+        with pytest.raises(RuntimeError):
+            sgs.map((breaks, ['strat_zq90', 'strat_pzabove2'], [3, 5]))
+
     def test_write_functionality(self, tmp_path):
         zq90_mapping = {}
         pz2_mapping = {}
@@ -0,0 +1,52 @@
+import pytest
+import numpy as np
+
+import sgspy as sgs
+
+from files import (
+    mraster_geotiff_path,
+)
+
+class TestPipeline:
+    rast = sgs.SpatialRaster(mraster_geotiff_path)
+
+    def test_matches_separate_stratifications(self):
+        test_rast = sgs.pipeline(self.rast, breaks={"zq90": [3, 5, 11, 18]}, quantiles={"pzabove2": [0.2, 0.4, 0.8], "zsd": 3})
+        breaks_rast = sgs.breaks(self.rast, breaks={"zq90": [3, 5, 11, 18]})
+        quantiles_rast = sgs.quantiles(self.rast, quantiles={"pzabove2": [0.2, 0.4, 0.8], "zsd": 3})
+
+        assert test_rast.bands == ["strat_zq90", "strat_pzabove2", "strat_zsd", "strat_map"]
+        assert np.array_equal(test_rast.band("strat_zq90"), breaks_rast.band("strat_zq90"), equal_nan=True)
+        assert np.array_equal(test_rast.band("strat_pzabove2"), quantiles_rast.band("strat_pzabove2"), equal_nan=True)
+        assert np.array_equal(test_rast.band("strat_zsd"), quantiles_rast.band("strat_zsd"), equal_nan=True)
+
+    def test_mapping_outputs(self):
+        test_rast = sgs.pipeline(self.rast, breaks={"zq90": [3, 5, 11, 18]}, quantiles={"pzabove2": 4})
+        zq90 = test_rast.band("strat_zq90")
+        pz2 = test_rast.band("strat_pzabove2")
+        mapped = test_rast.band("strat_map")
+
+        valid = (zq90 != -1) & (pz2 != -1)
+        assert np.array_equal(mapped[valid], zq90[valid] + 5 * pz2[valid])
+        assert np.all(mapped[~valid] == -1)
+        assert test_rast.srast_metadata_info["strat_map"].strata_count == 25
+
+    def test_no_map(self):
+        test_rast = sgs.pipeline(self.rast, quantiles={"zq90": 5}, map=False)
+        assert test_rast.bands == ["strat_zq90"]
+
+    def test_inputs(self):
+        with pytest.raises(ValueError):
+            sgs.pipeline(self.rast)
+
+        with pytest.raises(ValueError):
+            sgs.pipeline(self.rast, breaks={"zq90": [3, 5]}, quantiles={"zq90": 4})
+
+        with pytest.raises(ValueError):
+            sgs.pipeline(self.rast, breaks={"not_a_band": [3, 5]})
+
+        with pytest.raises(ValueError):
+            sgs.pipeline(self.rast, quantiles={"zq90": [0.2, 1.1]})
+
+        with pytest.raises(TypeError):
+            sgs.pipeline(self.rast, breaks=[[3, 5]])
@@ -69,3 +69,31 @@ class TestPoly:
         correct = np.subtract(correct, 1)
         assert np.array_equal(test, correct, equal_nan=True)
 
+
+    def test_thread_count(self):
+        correct = sgs.poly(
+            self.rast,
+            self.vect,
+            attribute='NUTRIENTS',
+            layer_name='inventory_polygons',
+            features=['poor', 'rich', 'medium'],
+            thread_count=1,
+        ).band(0)
+
+        #the tiles are burned independently, so the result doesn't depend on the number of threads
+        for thread_count in [2, 3, 8]:
+            test = sgs.poly(
+                self.rast,
+                self.vect,
+                attribute='NUTRIENTS',
+                layer_name='inventory_polygons',
+                features=['poor', 'rich', 'medium'],
+                thread_count=thread_count,
+            ).band(0)
+            assert np.array_equal(test, correct)
+
+        with pytest.raises(TypeError):
+            sgs.poly(self.rast, self.vect, attribute='NUTRIENTS', layer_name='inventory_polygons', features=['poor'], thread_count=2.0)
+
+        with pytest.raises(ValueError):
+            sgs.poly(self.rast, self.vect, attribute='NUTRIENTS', layer_name='inventory_polygons', features=['poor'], thread_count=0)
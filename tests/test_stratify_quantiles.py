@@ -1,3 +1,5 @@
+import importlib
+
 import pytest
 import numpy as np
 
@@ -10,6 +12,8 @@ from files import (
     strat_quantiles_pz2_r_path,
 )
 
+quantiles_module = importlib.import_module("sgspy.stratify.quantiles.quantiles")
+
 class TestQuantiles:
     #input raster
     rast = sgs.SpatialRaster(mraster_geotiff_path)
@@ -86,3 +90,102 @@ class TestQuantiles:
         test = test_rast.band('strat_zq90')
         correct = np.nan_to_num(np.subtract(self.zq90_output_rast.band(0), 1), nan=-1)
         assert np.array_equal(test, correct, equal_nan=True)
+
+    def test_overview(self, tmp_path):
+        gdal = pytest.importorskip("osgeo.gdal")
+        path = str(tmp_path / "overview.tif")
+        gdal.Translate(path, mraster_geotiff_path)
+        dataset = gdal.Open(path, gdal.GA_Update)
+        dataset.BuildOverviews("NEAREST", [2])
+        dataset = None
+
+        rast = sgs.SpatialRaster(path)
+        assert rast.overview_count == 1
+        assert rast.overview(0).width == (rast.width + 1) // 2
+        assert rast.overview(0).xmin == rast.xmin
+
+        #the quantiles of every other pixel still split every pixel into (close to) equal strata
+        test_rast = sgs.quantiles(rast, quantiles={'zq90': 4}, overview=0)
+        assert test_rast.width == rast.width
+        strata = test_rast.band('strat_zq90')
+        counts = np.bincount(strata[strata != -1]) / np.sum(strata != -1)
+        assert np.all(np.abs(counts - .25) < .02)
+
+        with pytest.raises(ValueError):
+            sgs.quantiles(rast, quantiles={'zq90': 4}, overview=1)
+
+        with pytest.raises(ValueError):
+            sgs.quantiles(self.rast, quantiles={'zq90': 4}, overview=0)
+
+    def write_raster(self, gdal, path, values):
+        #a tiled single band raster of the given values, with nan as nodata
+        gdal_type = gdal.GDT_Float64 if values.dtype == np.float64 else gdal.GDT_Float32
+        dataset = gdal.GetDriverByName("GTiff").Create(
+            path, values.shape[1], values.shape[0], 1, gdal_type,
+            options=["TILED=YES", "BLOCKXSIZE=64", "BLOCKYSIZE=64"]
+        )
+        dataset.SetProjection(gdal.Open(mraster_geotiff_path).GetProjection())
+        dataset.SetGeoTransform((0, 1, 0, values.shape[0], 0, -1))
+        band = dataset.GetRasterBand(1)
+        band.SetNoDataValue(np.nan)
+        band.WriteArray(values)
+        dataset = None
+        return sgs.SpatialRaster(path)
+
+    def batch_strata(self, monkeypatch, rast, probabilities, eps, thread_count=8):
+        #a band size limit of 1 byte makes any raster use the batch (sketch) path
+        monkeypatch.setattr(quantiles_module, "GIGABYTE", 1)
+        strata = np.array(sgs.quantiles(rast, quantiles=probabilities, eps=eps, thread_count=thread_count).band(0))
+        monkeypatch.undo()
+        return strata
+
+    def test_batch_rank_error(self, tmp_path, monkeypatch):
+        gdal = pytest.importorskip("osgeo.gdal")
+        rng = np.random.default_rng(0)
+        shape = (700, 600)
+        normal = rng.normal(0, 1, shape).astype(np.float32)
+        normal[rng.random(shape) < 0.05] = np.nan
+        distributions = {
+            "uniform": rng.uniform(-100, 100, shape).astype(np.float32),
+            "normal": normal,
+            "lognormal": rng.lognormal(0, 2, shape),
+        }
+        probabilities = [0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99]
+
+        for name, values in distributions.items():
+            rast = self.write_raster(gdal, str(tmp_path / f"{name}.tif"), values)
+            valid = ~np.isnan(values)
+            n = np.sum(valid)
+
+            #the in memory path calculates the exact quantiles
+            exact = np.array(sgs.quantiles(rast, quantiles=probabilities).band(0))
+
+            for eps in [.01, .001]:
+                strata = self.batch_strata(monkeypatch, rast, probabilities, eps)
+                assert np.array_equal(strata == -1, ~valid)
+
+                #the fraction of pixels below each quantile is within eps of its probability
+                for i, p in enumerate(probabilities):
+                    below = np.sum(strata[valid] <= i) / n
+                    assert abs(below - p) <= eps + 2 / n
+
+                #and each boundary moves at most eps of the pixels into another stratum
+                differ = np.sum(strata[valid] != exact[valid]) / n
+                assert differ <= len(probabilities) * (eps + 2 / n)
+
+    def test_batch_deterministic(self, tmp_path, monkeypatch):
+        gdal = pytest.importorskip("osgeo.gdal")
+        rng = np.random.default_rng(1)
+        values = rng.gamma(2, 3, (900, 500)).astype(np.float32)
+        probabilities = [0.2, 0.4, 0.6, 0.8]
+
+        #the chunk sketches are merged in order, and the chunks don't depend on the
+        #thread count, so every run gives the same strata. Each run uses its own file
+        #so the quantiles aren't taken from the statistics cache.
+        strata = []
+        for i, thread_count in enumerate([1, 8, 8, 3]):
+            rast = self.write_raster(gdal, str(tmp_path / f"gamma{i}.tif"), values)
+            strata.append(self.batch_strata(monkeypatch, rast, probabilities, .001, thread_count))
+
+        for other in strata[1:]:
+            assert np.array_equal(strata[0], other)
@@ -0,0 +1,63 @@
+import gc
+
+import numpy as np
+import pytest
+
+import sgspy as sgs
+
+from files import (
+    mraster_geotiff_path,
+)
+
+class TestMemoryBudget:
+    def teardown_method(self):
+        sgs.set_memory_limit(None)
+
+    def test_errors(self):
+        with pytest.raises(TypeError):
+            sgs.set_memory_limit(1.5)
+
+        with pytest.raises(ValueError):
+            sgs.set_memory_limit(0)
+
+    def test_usage(self):
+        rast = sgs.SpatialRaster(mraster_geotiff_path)
+        rast.band('zq90')
+
+        usage = sgs.memory_usage()
+        assert usage['limit'] is None
+        assert usage['bands'] >= 1
+        assert usage['bytes'] >= rast.width * rast.height * 4
+        assert usage['pinned_bytes'] <= usage['bytes']
+
+        sgs.set_memory_limit(1 << 30)
+        assert sgs.memory_usage()['limit'] == 1 << 30
+
+    def test_pinned_band(self):
+        rast = sgs.SpatialRaster(mraster_geotiff_path)
+        arr = rast.band('zq90')
+        expected = arr.copy()
+
+        sgs.set_memory_limit(1)
+        rast.band('pzabove2')
+        assert sgs.memory_usage()['pinned_bytes'] > 0
+        np.testing.assert_array_equal(arr, expected)
+
+        del arr
+        gc.collect()
+        sgs.set_memory_limit(1)
+        np.testing.assert_array_equal(rast.band('zq90'), expected)
+
+    def test_spill_in_memory_raster(self):
+        rast = sgs.SpatialRaster(mraster_geotiff_path)
+        srast = sgs.stratify.breaks(rast, breaks={'zq90': [3, 5, 11, 18]})
+        expected = srast.band('strat_zq90').copy()
+        gc.collect()
+
+        evictions = sgs.memory_usage()['evictions']
+        sgs.set_memory_limit(1)
+        assert sgs.memory_usage()['evictions'] > evictions
+
+        np.testing.assert_array_equal(srast.band('strat_zq90'), expected)
+        samples = sgs.sample.strat(srast, band='strat_zq90', num_samples=50, num_strata=5, method="random")
+        assert len(samples.samples_as_wkt()) == 50
@@ -0,0 +1,73 @@
+import json
+
+import pytest
+
+import sgspy as sgs
+
+from files import (
+    mraster_geotiff_path,
+)
+
+class TestProfile:
+    rast = sgs.SpatialRaster(mraster_geotiff_path)
+
+    def test_phases(self):
+        srast = sgs.stratify.quantiles(self.rast, quantiles={"zq90": 5})
+
+        with sgs.profile() as stats:
+            sgs.sample.strat(srast, band='strat_zq90', num_samples=100, num_strata=5, method="random")
+
+        assert stats['seconds'] > 0
+        for phase in ['setup', 'scan', 'select', 'output']:
+            assert stats['phases'][phase]['count'] == 1
+            assert stats['phases'][phase]['seconds'] >= 0
+        assert 'anneal' not in stats['phases']
+        assert 'trace' not in stats
+
+    def test_band_counters(self):
+        with sgs.profile() as stats:
+            sgs.sample.clhs(self.rast, num_samples=50, iterations=500)
+
+        assert stats['phases']['read']['count'] > 0
+        assert len(stats['bands']) == self.rast.band_count
+        for band in stats['bands'].values():
+            assert band['blocks_read'] > 0
+            assert band['bytes_read'] > 0
+
+    def test_stats_parameter(self):
+        samples, stats = sgs.sample.clhs(self.rast, num_samples=50, iterations=500, stats=True)
+        assert len(samples.samples_as_wkt()) == 50
+        assert 0 < stats['iterations'] <= 500
+        assert stats['iterations_per_second'] > 0
+
+        samples = sgs.sample.clhs(self.rast, num_samples=50, iterations=500)
+        assert type(samples) is sgs.SpatialVector
+
+        with pytest.raises(TypeError):
+            sgs.sample.clhs(self.rast, num_samples=50, stats=1)
+
+    def test_nested(self):
+        with sgs.profile() as outer:
+            sgs.sample.srs(self.rast, num_samples=50)
+            samples, inner = sgs.sample.clhs(self.rast, num_samples=50, iterations=500, stats=True)
+
+        assert inner['iterations'] > 0
+        assert outer['iterations'] >= inner['iterations']
+        assert outer['phases']['read']['count'] >= inner['phases']['read']['count']
+
+    def test_trace(self, tmp_path):
+        filename = str(tmp_path / "trace.json")
+        with sgs.profile(trace=filename) as stats:
+            sgs.sample.clhs(self.rast, num_samples=50, iterations=500)
+
+        assert len(stats['trace']) > 0
+        with open(filename) as f:
+            trace = json.load(f)
+
+        assert len(trace['traceEvents']) == len(stats['trace'])
+        for event in trace['traceEvents']:
+            assert event['ph'] == 'X'
+            assert event['dur'] >= 0
+
+        with pytest.raises(ValueError):
+            sgs.write_trace({}, filename)
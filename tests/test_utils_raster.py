@@ -1,3 +1,4 @@
+import gc
 import pytest
 import sgspy as sgs
 import numpy as np
@@ -112,3 +113,109 @@ class TestSpatialRaster:
         rast = sgs.utils.raster.SpatialRaster(sraster2_geotiff_path)
         new_rast = sgs.utils.raster.SpatialRaster(rast.cpp_raster)
         self.sraster2_check(new_rast) 
+
+    def test_uncompressed_file_band(self, tmp_path):
+        #bands of uncompressed files may be memory mapped rather than read, and must
+        #give the same values as the band read from an in-memory raster
+        rast = sgs.utils.raster.SpatialRaster(mraster_geotiff_path)
+        filename = str(tmp_path / "strat.tif")
+        in_mem = sgs.quantiles(rast, quantiles={"zq90": 4})
+        sgs.quantiles(rast, quantiles={"zq90": 4}, filename=filename)
+
+        written = sgs.utils.raster.SpatialRaster(filename)
+        assert np.array_equal(in_mem.band(0), written.band(0))
+        assert not written.band(0).flags.writeable
+
+    def test_band_outlives_raster(self, tmp_path):
+        #arrays of a band keep the memory they view (whether mapped or allocated)
+        #valid after the raster they came from is closed or garbage collected
+        rast = sgs.utils.raster.SpatialRaster(mraster_geotiff_path)
+        filename = str(tmp_path / "strat.tif")
+        in_mem = sgs.quantiles(rast, quantiles={"zq90": 4})
+        expected = np.array(in_mem.band(0))
+        sgs.quantiles(rast, quantiles={"zq90": 4}, filename=filename)
+
+        mapped = sgs.utils.raster.SpatialRaster(filename).band(0)
+        gc.collect()
+        assert np.array_equal(mapped, expected)
+        assert mapped.sum() == expected.sum()
+
+        written = sgs.utils.raster.SpatialRaster(filename)
+        mapped = written.band(0)
+        written.cpp_raster.close()
+        written.closed = True
+        assert np.array_equal(mapped, expected)
+
+        expected = np.array(rast.band(1))
+        read = sgs.utils.raster.SpatialRaster(mraster_geotiff_path)
+        arr = read.band(1)
+        read.cpp_raster.close()
+        read.closed = True
+        del read
+        gc.collect()
+        assert np.array_equal(arr, expected, equal_nan=True)
+
+    def test_window(self):
+        rast = sgs.SpatialRaster(mraster_geotiff_path)
+        win = rast.window(50, 30, 100, 80)
+        assert win.width == 100
+        assert win.height == 80
+        assert win.band_count == 3
+        assert win.bands == rast.bands
+        assert win.xmin == rast.xmin + 50 * rast.pixel_width
+        assert win.ymax == rast.ymax - 30 * rast.pixel_height
+        assert np.array_equal(rast.band(0)[30:110, 50:150], win.band(0), equal_nan=True)
+
+        with pytest.raises(ValueError):
+            rast.window(300, 0, 100, 10)
+
+        with pytest.raises(TypeError):
+            rast.window(0.5, 0, 10, 10)
+
+        tiles = list(rast.tiles(tile_height=100))
+        assert sum(tile.width * tile.height for (_, _, tile) in tiles) == rast.width * rast.height
+        for (x_off, y_off, tile) in tiles:
+            assert np.array_equal(rast.band(2)[y_off:y_off + tile.height, x_off:x_off + tile.width], tile.band(2), equal_nan=True)
+
+    def test_extract(self):
+        rast = sgs.SpatialRaster(mraster_geotiff_path)
+        rng = np.random.default_rng(0)
+        cols = rng.integers(0, rast.width, 5000)
+        rows = rng.integers(0, rast.height, 5000)
+
+        #pixel centers, and one point outside of the extent
+        x = np.append(rast.xmin + (cols + 0.5) * rast.pixel_width, rast.xmax + 100)
+        y = np.append(rast.ymax - (rows + 0.5) * rast.pixel_height, rast.ymin)
+
+        for thread_count in [1, 4]:
+            values = rast.extract(x, y, thread_count=thread_count)
+            assert values.shape == (5001, 3)
+            assert values.flags.c_contiguous
+            for band in range(3):
+                assert np.array_equal(values[:-1, band], rast.band(band)[rows, cols].astype(np.float64), equal_nan=True)
+            assert np.all(np.isnan(values[-1]))
+
+        values = rast.extract(x, y, bands=['zsd'])
+        assert values.shape == (5001, 1)
+        assert np.array_equal(values[:-1, 0], rast.band('zsd')[rows, cols].astype(np.float64), equal_nan=True)
+
+        with pytest.raises(ValueError):
+            rast.extract(x, y[:-1])
+
+        with pytest.raises(ValueError):
+            rast.extract(x, y, bands=['not_a_band'])
+
+        with pytest.raises(ValueError):
+            rast.extract(x, y, thread_count=0)
+
+    def test_remote_read_options(self):
+        sgs.set_remote_read_options(thread_count=4, cache_size=32)
+
+        with pytest.raises(TypeError):
+            sgs.set_remote_read_options(thread_count=4.0)
+
+        with pytest.raises(ValueError):
+            sgs.set_remote_read_options(thread_count=0)
+
+        with pytest.raises(ValueError):
+            sgs.set_remote_read_options(cache_size=0)